@@ -20,6 +20,8 @@ void cpu_init() {
                  "orr x0, x0, #(1 << 26)\n\t"
                  "msr sctlr_el1, x0\n\t" ::
                      : "x0");
+
+    aarch64_uaccess_init();
 }
 
 extern void syscall_handler_init();
@@ -148,9 +150,6 @@ void read_barrier(void) { __asm__ volatile("dsb ld" : : : "memory"); }
 
 void write_barrier(void) { __asm__ volatile("dsb st" : : : "memory"); }
 
-void arch_enable_user_access() {}
-void arch_disable_user_access() {}
-
 bool arch_memory_region_usable(uint64_t addr, uint64_t len) {
     (void)addr;
     (void)len;
@@ -49,5 +49,7 @@ void write_barrier(void);
 
 void arch_enable_user_access();
 void arch_disable_user_access();
+extern bool aarch64_pan_enabled;
+void aarch64_uaccess_init(void);
 bool arch_memory_region_usable(uint64_t addr, uint64_t len);
 uintptr_t arch_get_return_address(uint32_t level);
@@ -0,0 +1,400 @@
+#include <bpf/jit.h>
+
+/*
+ * Classic BPF -> AArch64.
+ *
+ * The image is called as uint32_t f(const uint8_t *data, uint32_t len), so
+ * data arrives in x0 and len in w1. A lives in w2 and is moved to w0 on
+ * return, X in w3, and w4-w6 are scratch; all of them are caller-saved.
+ * M[] is 64 bytes below sp, zeroed by the prologue when the program uses it.
+ *
+ * Every instruction is 4 bytes and each BPF instruction expands to a fixed
+ * sequence, so the sizing pass and the emitting pass agree exactly.
+ */
+
+#define R_DATA 0
+#define R_LEN 1
+#define R_A 2
+#define R_X 3
+#define R_T0 4
+#define R_T1 5
+#define R_T2 6
+#define R_ZR 31
+#define R_SP 31
+
+#define A64_EQ 0x0
+#define A64_NE 0x1
+#define A64_HS 0x2
+#define A64_LO 0x3
+#define A64_HI 0x8
+#define A64_LS 0x9
+
+static void emit(bpf_jit_ctx_t *ctx, uint32_t insn) {
+    bpf_jit_emit(ctx, &insn, sizeof(insn));
+}
+
+/* Three-register data processing: op Wd, Wn, Wm. */
+static void emit_rrr(bpf_jit_ctx_t *ctx, uint32_t op, int rd, int rn, int rm) {
+    emit(ctx, op | (rm << 16) | (rn << 5) | rd);
+}
+
+#define A64_ADD 0x0b000000
+#define A64_SUB 0x4b000000
+#define A64_SUBS 0x6b000000
+#define A64_AND 0x0a000000
+#define A64_ANDS 0x6a000000
+#define A64_ORR 0x2a000000
+#define A64_EOR 0x4a000000
+#define A64_MUL 0x1b007c00
+#define A64_UDIV 0x1ac00800
+#define A64_LSLV 0x1ac02000
+#define A64_LSRV 0x1ac02400
+#define A64_LDRB_UXTW 0x38604800
+#define A64_LDRH_UXTW 0x78604800
+#define A64_LDR_UXTW 0xb8604800
+
+static void emit_mov(bpf_jit_ctx_t *ctx, int rd, int rm) {
+    emit_rrr(ctx, A64_ORR, rd, R_ZR, rm); // mov wd, wm
+}
+
+static void emit_imm(bpf_jit_ctx_t *ctx, int rd, uint32_t imm) {
+    uint32_t lo = imm & 0xffff;
+    uint32_t hi = imm >> 16;
+
+    if (!hi) {
+        emit(ctx, 0x52800000 | (lo << 5) | rd); // movz wd, #lo
+    } else if (!lo) {
+        emit(ctx, 0x52a00000 | (hi << 5) | rd); // movz wd, #hi, lsl #16
+    } else {
+        emit(ctx, 0x52800000 | (lo << 5) | rd); // movz wd, #lo
+        emit(ctx, 0x72a00000 | (hi << 5) | rd); // movk wd, #hi, lsl #16
+    }
+}
+
+/* ubfm wd, wn, #immr, #imms: lsl/lsr/ubfiz by constant. */
+static void emit_ubfm(bpf_jit_ctx_t *ctx, int rd, int rn, uint32_t immr,
+                      uint32_t imms) {
+    emit(ctx, 0x53000000 | (immr << 16) | (imms << 10) | (rn << 5) | rd);
+}
+
+/* cmp wn, #imm12 */
+static void emit_cmp_imm(bpf_jit_ctx_t *ctx, int rn, uint32_t imm) {
+    emit(ctx, 0x7100001f | (imm << 10) | (rn << 5));
+}
+
+static void emit_bcond(bpf_jit_ctx_t *ctx, uint32_t cond, uint32_t target) {
+    int32_t disp = ((int32_t)target - (int32_t)ctx->pos) / 4;
+    emit(ctx, 0x54000000 | (((uint32_t)disp & 0x7ffff) << 5) | cond);
+}
+
+static void emit_b(bpf_jit_ctx_t *ctx, uint32_t target) {
+    int32_t disp = ((int32_t)target - (int32_t)ctx->pos) / 4;
+    emit(ctx, 0x14000000 | ((uint32_t)disp & 0x3ffffff));
+}
+
+/* ldr/str wt, [sp, #4 * slot] */
+static void emit_scratch(bpf_jit_ctx_t *ctx, bool store, int rt,
+                         uint32_t slot) {
+    emit(ctx, (store ? 0xb9000000 : 0xb9400000) | ((slot & 0xf) << 10) |
+                  (R_SP << 5) | rt);
+}
+
+static void emit_epilogue(bpf_jit_ctx_t *ctx) {
+    if (ctx->uses_scratch)
+        emit(ctx, 0x910003ff | (BPF_JIT_SCRATCH_SIZE << 10)); // add sp, sp, #64
+    emit_mov(ctx, 0, R_A);
+    emit(ctx, 0xd65f03c0); // ret
+}
+
+/*
+ * Packet load from offset t1 into rd, or 0 when it does not fit. The offset
+ * is checked as len - off >= size with unsigned borrow, so ld [x+k] offsets
+ * that wrapped are rejected as well.
+ */
+static void emit_packet_load(bpf_jit_ctx_t *ctx, int rd, uint32_t size,
+                             const uint32_t *load, int nload) {
+    // subs t2, len, off; b.lo oob; cmp t2, #size; b.lo oob; load...; b done
+    uint32_t oob = ctx->pos + (4 + nload + 1) * 4;
+
+    emit_rrr(ctx, A64_SUBS, R_T2, R_LEN, R_T1);
+    emit_bcond(ctx, A64_LO, oob);
+    emit_cmp_imm(ctx, R_T2, size);
+    emit_bcond(ctx, A64_LO, oob);
+    for (int i = 0; i < nload; i++)
+        emit(ctx, load[i]);
+    emit_b(ctx, oob + 4);
+    emit_imm(ctx, rd, 0); // oob: mov rd, #0
+}
+
+static void emit_load(bpf_jit_ctx_t *ctx, uint16_t code, uint32_t k) {
+    uint32_t load[2];
+    uint32_t size;
+    int nload;
+
+    if (BPF_MODE(code) == BPF_ABS) {
+        emit_imm(ctx, R_T1, k);
+    } else {
+        emit_imm(ctx, R_T0, k);
+        emit_rrr(ctx, A64_ADD, R_T1, R_X, R_T0);
+    }
+
+    uint32_t addr = (R_T1 << 16) | (R_DATA << 5) | R_A;
+    switch (BPF_SIZE(code)) {
+    case BPF_W:
+        load[0] = A64_LDR_UXTW | addr;
+        load[1] = 0x5ac00800 | (R_A << 5) | R_A; // rev wA, wA
+        size = 4;
+        nload = 2;
+        break;
+    case BPF_H:
+        load[0] = A64_LDRH_UXTW | addr;
+        load[1] = 0x5ac00400 | (R_A << 5) | R_A; // rev16 wA, wA
+        size = 2;
+        nload = 2;
+        break;
+    default:
+        load[0] = A64_LDRB_UXTW | addr;
+        size = 1;
+        nload = 1;
+        break;
+    }
+    emit_packet_load(ctx, R_A, size, load, nload);
+}
+
+static void emit_msh(bpf_jit_ctx_t *ctx, uint32_t k) {
+    uint32_t load[2] = {
+        A64_LDRB_UXTW | (R_T1 << 16) | (R_DATA << 5) | R_X,
+        // ubfiz wX, wX, #2, #4
+        0x53000000 | (30 << 16) | (3 << 10) | (R_X << 5) | R_X,
+    };
+
+    emit_imm(ctx, R_T1, k);
+    emit_packet_load(ctx, R_X, 1, load, 2);
+}
+
+static void emit_alu(bpf_jit_ctx_t *ctx, uint16_t code, uint32_t k) {
+    int src = R_X;
+    uint32_t op;
+
+    switch (BPF_OP(code)) {
+    case BPF_ADD:
+        op = A64_ADD;
+        break;
+    case BPF_SUB:
+        op = A64_SUB;
+        break;
+    case BPF_MUL:
+        op = A64_MUL;
+        break;
+    case BPF_OR:
+        op = A64_ORR;
+        break;
+    case BPF_AND:
+        op = A64_AND;
+        break;
+    case BPF_XOR:
+        op = A64_EOR;
+        break;
+    case BPF_LSH:
+        if (BPF_SRC(code) == BPF_K) {
+            uint32_t s = k & 31;
+            emit_ubfm(ctx, R_A, R_A, (32 - s) & 31, 31 - s); // lsl
+            return;
+        }
+        op = A64_LSLV;
+        break;
+    case BPF_RSH:
+        if (BPF_SRC(code) == BPF_K) {
+            emit_ubfm(ctx, R_A, R_A, k & 31, 31); // lsr
+            return;
+        }
+        op = A64_LSRV;
+        break;
+    case BPF_DIV:
+        // udiv by zero yields zero, which is what bpf_run does as well
+        op = A64_UDIV;
+        break;
+    case BPF_MOD:
+        if (BPF_SRC(code) == BPF_K) {
+            emit_imm(ctx, R_T0, k);
+            src = R_T0;
+        }
+        // t1 = A - (A / src) * src; A = src ? t1 : 0
+        emit_rrr(ctx, A64_UDIV, R_T1, R_A, src);
+        emit(ctx, 0x1b008000 | (src << 16) | (R_A << 10) | (R_T1 << 5) |
+                      R_T1); // msub t1, t1, src, A
+        emit_cmp_imm(ctx, src, 0);
+        emit(ctx, 0x1a800000 | (R_ZR << 16) | (A64_NE << 12) | (R_T1 << 5) |
+                      R_A); // csel A, t1, wzr, ne
+        return;
+    case BPF_NEG:
+        emit_rrr(ctx, A64_SUB, R_A, R_ZR, R_A); // neg wA, wA
+        return;
+    default:
+        return;
+    }
+
+    if (BPF_SRC(code) == BPF_K) {
+        emit_imm(ctx, R_T0, k);
+        src = R_T0;
+    }
+    emit_rrr(ctx, op, R_A, R_A, src);
+}
+
+static void emit_cond_jump(bpf_jit_ctx_t *ctx, uint32_t i,
+                           const struct sock_filter *insn) {
+    uint16_t code = insn->code;
+    uint32_t t = bpf_jit_target(ctx, i, insn->jt);
+    uint32_t f = bpf_jit_target(ctx, i, insn->jf);
+    uint32_t cc, inv;
+    int src = R_X;
+
+    switch (BPF_OP(code)) {
+    case BPF_JEQ:
+        cc = A64_EQ;
+        inv = A64_NE;
+        break;
+    case BPF_JGT:
+        cc = A64_HI;
+        inv = A64_LS;
+        break;
+    case BPF_JGE:
+        cc = A64_HS;
+        inv = A64_LO;
+        break;
+    case BPF_JSET:
+        cc = A64_NE;
+        inv = A64_EQ;
+        break;
+    default:
+        // unknown condition: the interpreter always takes jf
+        if (insn->jf)
+            emit_b(ctx, f);
+        return;
+    }
+
+    if (insn->jt == insn->jf) {
+        if (insn->jt)
+            emit_b(ctx, t);
+        return;
+    }
+
+    if (BPF_SRC(code) == BPF_K) {
+        emit_imm(ctx, R_T0, insn->k);
+        src = R_T0;
+    }
+    emit_rrr(ctx, BPF_OP(code) == BPF_JSET ? A64_ANDS : A64_SUBS, R_ZR, R_A,
+             src);
+
+    if (!insn->jf) {
+        emit_bcond(ctx, cc, t);
+    } else if (!insn->jt) {
+        emit_bcond(ctx, inv, f);
+    } else {
+        emit_bcond(ctx, cc, t);
+        emit_b(ctx, f);
+    }
+}
+
+bool bpf_jit_arch_supported(void) { return true; }
+
+int bpf_jit_arch_build(bpf_jit_ctx_t *ctx) {
+    emit(ctx, 0xd503245f); // bti c
+    if (ctx->uses_scratch) {
+        emit(ctx, 0xd10003ff | (BPF_JIT_SCRATCH_SIZE << 10)); // sub sp, sp, #64
+        for (uint32_t off = 0; off < BPF_JIT_SCRATCH_SIZE; off += 16)
+            emit(ctx, 0xa9000000 | ((off / 8) << 15) | (R_ZR << 10) |
+                          (R_SP << 5) | R_ZR); // stp xzr, xzr, [sp, #off]
+    }
+    emit_imm(ctx, R_A, 0);
+    emit_imm(ctx, R_X, 0);
+
+    for (uint32_t i = 0; i < ctx->len; i++) {
+        const struct sock_filter *insn = &ctx->insns[i];
+        uint16_t code = insn->code;
+        uint32_t k = insn->k;
+
+        ctx->offsets[i] = ctx->pos;
+
+        switch (BPF_CLASS(code)) {
+        case BPF_LD:
+            switch (BPF_MODE(code)) {
+            case BPF_IMM:
+                emit_imm(ctx, R_A, k);
+                break;
+            case BPF_ABS:
+            case BPF_IND:
+                if (BPF_SIZE(code) != BPF_W && BPF_SIZE(code) != BPF_H &&
+                    BPF_SIZE(code) != BPF_B)
+                    break;
+                emit_load(ctx, code, k);
+                break;
+            case BPF_MEM:
+                emit_scratch(ctx, false, R_A, k);
+                break;
+            case BPF_LEN:
+                emit_mov(ctx, R_A, R_LEN);
+                break;
+            }
+            break;
+
+        case BPF_LDX:
+            switch (BPF_MODE(code)) {
+            case BPF_IMM:
+                emit_imm(ctx, R_X, k);
+                break;
+            case BPF_MEM:
+                emit_scratch(ctx, false, R_X, k);
+                break;
+            case BPF_LEN:
+                emit_mov(ctx, R_X, R_LEN);
+                break;
+            case BPF_MSH:
+                emit_msh(ctx, k);
+                break;
+            }
+            break;
+
+        case BPF_ST:
+            emit_scratch(ctx, true, R_A, k);
+            break;
+
+        case BPF_STX:
+            emit_scratch(ctx, true, R_X, k);
+            break;
+
+        case BPF_ALU:
+            emit_alu(ctx, code, k);
+            break;
+
+        case BPF_JMP:
+            if (BPF_OP(code) == BPF_JA) {
+                if (k)
+                    emit_b(ctx, bpf_jit_target(ctx, i, k));
+            } else {
+                emit_cond_jump(ctx, i, insn);
+            }
+            break;
+
+        case BPF_RET:
+            if (BPF_RVAL(code) != BPF_A)
+                emit_imm(ctx, R_A, k);
+            emit_epilogue(ctx);
+            break;
+
+        case BPF_MISC:
+            switch (BPF_MISCOP(code)) {
+            case BPF_TAX:
+                emit_mov(ctx, R_X, R_A);
+                break;
+            case BPF_TXA:
+                emit_mov(ctx, R_A, R_X);
+                break;
+            }
+            break;
+        }
+    }
+    ctx->offsets[ctx->len] = ctx->pos;
+
+    return 0;
+}
@@ -5,6 +5,8 @@
 #include <task/task.h>
 #include <task/signal.h>
 #include <mm/fault.h>
+#include <mm/extable.h>
+#include <task/perf_event.h>
 
 #define SEGV_MAPERR 1
 #define SEGV_ACCERR 2
@@ -547,6 +549,7 @@ void handle_exception(struct pt_regs *frame) {
             asm volatile("mrs %0, far_el1" : "=r"(fault_addr));
 
         uint64_t fault_flags = aarch64_fault_flags(ec, iss);
+        perf_event_page_fault(frame, fault_addr);
         page_fault_result_t result =
             handle_page_fault_flags(current_task, fault_addr, fault_flags);
         if (result == PF_RES_OK) {
@@ -557,6 +560,9 @@ void handle_exception(struct pt_regs *frame) {
             arch_flush_tlb(fault_addr);
             aarch64_handle_signal_on_user_return(frame);
             return;
+        } else if (!aarch64_user_mode_frame(frame) &&
+                   fixup_exception(&frame->pc)) {
+            return;
         } else if (result == PF_RES_SEGF) {
             if (aarch64_should_deliver_user_sigsegv(current_task) &&
                 aarch64_deliver_user_sigsegv(frame, fault_addr,
@@ -42,6 +42,13 @@
 #define ARCH_PT_IS_LARGE(x)                                                    \
     (((x) & (ARCH_PT_FLAG_VALID | ARCH_PT_FLAG_TABLE)) == ARCH_PT_FLAG_VALID)
 
+/*
+ * Entries are made with AF already set and without DBM, so the hardware
+ * tracks neither: every mapping looks young and every writable one dirty.
+ */
+#define ARCH_PT_IS_YOUNG(x) (((x) & ARCH_PT_FLAG_ACCESS) != 0)
+#define ARCH_PT_IS_DIRTY(x) (((x) & ARCH_PT_FLAG_READONLY) == 0)
+
 uint64_t get_arch_page_table_flags(uint64_t flags);
 uint64_t arch_page_table_levels();
 void arch_flush_tlb(uint64_t vaddr);
@@ -5,7 +5,10 @@
 #include <mm/mm_syscall.h>
 #include <task/futex.h>
 #include <task/keyring.h>
+#include <task/perf_event.h>
 #include <task/ptrace.h>
+#include <task/syscall_stats.h>
+#include <task/trace.h>
 #include <task/task_syscall.h>
 #include <drivers/rtc.h>
 #include <net/net_syscall.h>
@@ -718,8 +721,8 @@ void syscall_handler_init() {
     regist_syscall_handler(SYS_PWRITEV, (syscall_handle_t)sys_pwritev);
     // regist_syscall_handler(SYS_RT_TGSIGQUEUEINFO,
     // (syscall_handle_t)sys_rt_tgsigqueueinfo);
-    // regist_syscall_handler(SYS_PERF_EVENT_OPEN,
-    // (syscall_handle_t)sys_perf_event_open);
+    regist_syscall_handler(SYS_PERF_EVENT_OPEN,
+                           (syscall_handle_t)sys_perf_event_open);
 #ifdef SYS_RECVMMSG
     regist_syscall_handler(SYS_RECVMMSG, (syscall_handle_t)sys_recvmmsg);
 #endif
@@ -830,6 +833,7 @@ void syscall_handler_init() {
 
 void aarch64_do_syscall(struct pt_regs *frame) {
     uint64_t ret = 0;
+    uint64_t stats_start = 0;
 
     uint64_t idx = frame->x8;
     uint64_t arg1 = frame->x0;
@@ -848,6 +852,8 @@ void aarch64_do_syscall(struct pt_regs *frame) {
     frame->x0 = self->last_syscall_ret;
     frame->syscallno = idx;
     ptrace_on_syscall_enter(frame);
+    trace_sys_enter(idx, arg1, arg2, arg3, arg4, arg5, arg6);
+    stats_start = syscall_stats_enter();
 
     if (idx > MAX_SYSCALL_NUM) {
         frame->x0 = (uint64_t)-ENOSYS;
@@ -880,6 +886,8 @@ void aarch64_do_syscall(struct pt_regs *frame) {
 done:
     self->last_syscall_ret = frame->x0;
 
+    syscall_stats_exit(self, idx, stats_start, frame->x0);
+    trace_sys_exit(idx, frame->x0);
     ptrace_on_syscall_exit(frame);
 
     if (idx != SYS_BRK && idx != SYS_RSEQ && frame->x0 == (uint64_t)-ENOSYS) {
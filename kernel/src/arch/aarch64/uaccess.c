@@ -0,0 +1,37 @@
+#include <arch/arch.h>
+#include <mm/extable.h>
+
+#define ID_AA64MMFR1_PAN_SHIFT 20
+#define SCTLR_EL1_SPAN (1ULL << 23)
+
+bool aarch64_pan_enabled = false;
+
+static bool aarch64_cpu_has_pan(void) {
+    uint64_t mmfr1;
+    asm volatile("mrs %0, id_aa64mmfr1_el1" : "=r"(mmfr1));
+    return ((mmfr1 >> ID_AA64MMFR1_PAN_SHIFT) & 0xf) != 0;
+}
+
+void aarch64_uaccess_init(void) {
+    if (!aarch64_cpu_has_pan() || !uaccess_strict_requested())
+        return;
+
+    /* SPAN clear: every exception taken to EL1 sets PSTATE.PAN. */
+    uint64_t sctlr;
+    asm volatile("mrs %0, sctlr_el1" : "=r"(sctlr));
+    sctlr &= ~SCTLR_EL1_SPAN;
+    asm volatile("msr sctlr_el1, %0\n\tisb" ::"r"(sctlr) : "memory");
+    asm volatile(".inst 0xd500419f" ::: "memory"); // msr pan, #1
+
+    aarch64_pan_enabled = true;
+}
+
+void arch_enable_user_access() {
+    if (aarch64_pan_enabled)
+        asm volatile(".inst 0xd500409f" ::: "memory"); // msr pan, #0
+}
+
+void arch_disable_user_access() {
+    if (aarch64_pan_enabled)
+        asm volatile(".inst 0xd500419f" ::: "memory"); // msr pan, #1
+}
@@ -5,9 +5,11 @@
 #include <arch/loongarch64/syscall/syscall.h>
 #include <irq/irq_manager.h>
 #include <mm/fault.h>
+#include <mm/extable.h>
 #include <mm/vma.h>
 #include <task/signal.h>
 #include <task/task.h>
+#include <task/perf_event.h>
 
 extern void loongarch64_trap_entry();
 extern void do_irq(struct pt_regs *regs, uint64_t irq_num);
@@ -225,6 +227,7 @@ static void loongarch64_handle_page_fault(struct pt_regs *regs,
 
     uint64_t fault_addr = regs->csr_badv;
     uint64_t fault_flags = loongarch64_fault_flags(regs, ecode);
+    perf_event_page_fault(regs, fault_addr);
     page_fault_result_t result =
         handle_page_fault_flags(current_task, fault_addr, fault_flags);
 
@@ -237,6 +240,9 @@ static void loongarch64_handle_page_fault(struct pt_regs *regs,
         return;
     }
 
+    if (!loongarch64_user_mode_frame(regs) && fixup_exception(&regs->pc))
+        return;
+
     if (result == PF_RES_SEGF &&
         loongarch64_should_deliver_user_sigsegv(current_task) &&
         loongarch64_deliver_user_sigsegv(
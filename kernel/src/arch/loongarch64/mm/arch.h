@@ -46,6 +46,13 @@
     (((x) & (ARCH_PT_FLAG_PRESENT | ARCH_PT_FLAG_HUGE)) ==                     \
      (ARCH_PT_FLAG_PRESENT | ARCH_PT_FLAG_HUGE))
 
+/*
+ * Software-managed TLB: V and D are preset when an entry is made, so these
+ * only say the page is mapped and mapped writable.
+ */
+#define ARCH_PT_IS_YOUNG(x) (((x) & ARCH_PT_FLAG_ACCESS) != 0)
+#define ARCH_PT_IS_DIRTY(x) (((x) & ARCH_PT_FLAG_DIRTY) != 0)
+
 uint64_t get_arch_page_table_flags(uint64_t flags);
 uint64_t arch_page_table_levels();
 uint64_t *get_current_page_dir(bool user);
@@ -5,7 +5,10 @@
 #include <net/net_syscall.h>
 #include <task/futex.h>
 #include <task/keyring.h>
+#include <task/perf_event.h>
 #include <task/ptrace.h>
+#include <task/syscall_stats.h>
+#include <task/trace.h>
 #include <task/signal.h>
 #include <task/task.h>
 #include <task/task_syscall.h>
@@ -515,6 +518,8 @@ void syscall_handler_init() {
     regist_syscall_handler(SYS_ACCEPT4, (syscall_handle_t)sys_accept);
     regist_syscall_handler(SYS_SIGNALFD4, (syscall_handle_t)sys_signalfd4);
     regist_syscall_handler(SYS_EVENTFD2, (syscall_handle_t)sys_eventfd2);
+    regist_syscall_handler(SYS_PERF_EVENT_OPEN,
+                           (syscall_handle_t)sys_perf_event_open);
     regist_syscall_handler(SYS_DUP3, (syscall_handle_t)sys_dup3);
     regist_syscall_handler(SYS_PIPE2, (syscall_handle_t)sys_pipe);
     regist_syscall_handler(SYS_PREADV, (syscall_handle_t)sys_preadv);
@@ -587,6 +592,8 @@ void loongarch64_do_syscall(struct pt_regs *frame) {
     frame->a0 = self->last_syscall_ret;
     frame->syscallno = idx;
     ptrace_on_syscall_enter(frame);
+    trace_sys_enter(idx, arg1, arg2, arg3, arg4, arg5, arg6);
+    uint64_t stats_start = syscall_stats_enter();
 
     if (idx >= MAX_SYSCALL_NUM || !syscall_handlers[idx]) {
         frame->a0 = (uint64_t)-ENOSYS;
@@ -607,6 +614,8 @@ void loongarch64_do_syscall(struct pt_regs *frame) {
 
 done:
     self->last_syscall_ret = frame->a0;
+    syscall_stats_exit(self, idx, stats_start, frame->a0);
+    trace_sys_exit(idx, frame->a0);
     ptrace_on_syscall_exit(frame);
     if (idx != SYS_BRK && idx != SYS_RSEQ && frame->a0 == (uint64_t)-ENOSYS) {
         serial_fprintk("syscall %d not implemented\n", idx);
@@ -1,3 +1,5 @@
+#include <arch/loongarch64/csr.h>
+#include <task/perf_event.h>
 #include <task/ptrace.h>
 
 uint32_t arch_ptrace_audit_arch(void) {
@@ -24,3 +26,20 @@ uint64_t arch_ptrace_copy_regs(task_t *target, const struct pt_regs *regs,
     (void)user_buf;
     return (uint64_t)-ENOSYS;
 }
+
+uint64_t arch_perf_instruction_pointer(const struct pt_regs *regs) {
+    return regs->pc;
+}
+
+uint64_t arch_perf_frame_pointer(const struct pt_regs *regs) {
+    return regs->fp;
+}
+
+bool arch_perf_user_mode(const struct pt_regs *regs) {
+    return (regs->csr_prmd & LOONGARCH_PRMD_PPLV_MASK) == LOONGARCH_PLV_USER;
+}
+
+/* fp points past the frame record [saved fp, saved ra]. */
+int64_t arch_perf_frame_link_offset(void) { return -16; }
+
+int64_t arch_perf_frame_ret_offset(void) { return -8; }
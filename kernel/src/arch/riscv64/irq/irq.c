@@ -4,9 +4,11 @@
 #include <mod/dlinker.h>
 #include <irq/irq_manager.h>
 #include <mm/fault.h>
+#include <mm/extable.h>
 #include <mm/vma.h>
 #include <task/signal.h>
 #include <task/task.h>
+#include <task/perf_event.h>
 
 extern void do_irq(struct pt_regs *regs, uint64_t irq_num);
 
@@ -301,11 +303,15 @@ static void riscv_handle_page_fault(struct pt_regs *regs) {
         riscv_unhandled_trap(regs);
     }
 
+    perf_event_page_fault(regs, regs->stval);
     page_fault_result_t result = handle_page_fault_flags(
         current_task, regs->stval, riscv_fault_flags(regs));
     if (result == PF_RES_OK)
         return;
 
+    if (!riscv_user_mode_frame(regs) && fixup_exception(&regs->sepc))
+        return;
+
     if (result == PF_RES_SEGF &&
         riscv_should_deliver_user_sigsegv(current_task) &&
         riscv_deliver_user_sigsegv(regs, regs->stval,
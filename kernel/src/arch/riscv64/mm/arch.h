@@ -41,6 +41,10 @@
      (((x) & (ARCH_PT_FLAG_READ | ARCH_PT_FLAG_WRITE | ARCH_PT_FLAG_EXEC)) !=  \
       0))
 
+/* A and D are preset when an entry is made, so these only say it exists. */
+#define ARCH_PT_IS_YOUNG(x) (((x) & ARCH_PT_FLAG_ACCESS) != 0)
+#define ARCH_PT_IS_DIRTY(x) (((x) & ARCH_PT_FLAG_DIRTY) != 0)
+
 uint64_t get_arch_page_table_flags(uint64_t flags);
 uint64_t arch_page_table_levels();
 uint64_t riscv64_make_satp(uint64_t root_paddr);
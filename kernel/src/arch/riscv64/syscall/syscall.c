@@ -6,7 +6,10 @@
 #include <mm/mm_syscall.h>
 #include <task/futex.h>
 #include <task/keyring.h>
+#include <task/perf_event.h>
 #include <task/ptrace.h>
+#include <task/syscall_stats.h>
+#include <task/trace.h>
 #include <task/task_syscall.h>
 #include <drivers/rtc.h>
 #include <net/net_syscall.h>
@@ -688,8 +691,8 @@ void syscall_handler_init() {
     syscall_handlers[SYS_PSELECT6_TIME32] = (syscall_handle_t)sys_pselect6;
     // syscall_handlers[SYS_RT_TGSIGQUEUEINFO] =
     //     (syscall_handle_t)sys_rt_tgsigqueueinfo;
-    // syscall_handlers[SYS_PERF_EVENT_OPEN] =
-    //     (syscall_handle_t)sys_perf_event_open;
+    syscall_handlers[SYS_PERF_EVENT_OPEN] =
+        (syscall_handle_t)sys_perf_event_open;
     syscall_handlers[SYS_RECVMMSG_TIME32] = (syscall_handle_t)sys_recvmmsg;
     // syscall_handlers[SYS_FANOTIFY_INIT] =
     // (syscall_handle_t)sys_fanotify_init; syscall_handlers[SYS_FANOTIFY_MARK]
@@ -797,6 +800,8 @@ void riscv64_do_syscall(struct pt_regs *frame) {
     frame->a0 = self->last_syscall_ret;
     frame->syscallno = idx;
     ptrace_on_syscall_enter(frame);
+    trace_sys_enter(idx, arg1, arg2, arg3, arg4, arg5, arg6);
+    uint64_t stats_start = syscall_stats_enter();
 
     if (idx >= MAX_SYSCALL_NUM || !syscall_handlers[idx]) {
         frame->a0 = (uint64_t)-ENOSYS;
@@ -817,6 +822,8 @@ void riscv64_do_syscall(struct pt_regs *frame) {
 
 done:
     self->last_syscall_ret = frame->a0;
+    syscall_stats_exit(self, idx, stats_start, frame->a0);
+    trace_sys_exit(idx, frame->a0);
     ptrace_on_syscall_exit(frame);
     if (idx != SYS_BRK && idx != SYS_RSEQ && idx != SYS_RISCV_HWPROBE &&
         frame->a0 == (uint64_t)-ENOSYS) {
@@ -1,3 +1,4 @@
+#include <task/perf_event.h>
 #include <task/ptrace.h>
 #include <task/task_syscall.h>
 
@@ -106,3 +107,20 @@ uint64_t arch_ptrace_copy_regs(task_t *target, const struct pt_regs *regs,
         return (uint64_t)-EFAULT;
     return 0;
 }
+
+uint64_t arch_perf_instruction_pointer(const struct pt_regs *regs) {
+    return regs->sepc;
+}
+
+uint64_t arch_perf_frame_pointer(const struct pt_regs *regs) {
+    return regs->s0;
+}
+
+bool arch_perf_user_mode(const struct pt_regs *regs) {
+    return (regs->sstatus & (1UL << 8)) == 0;
+}
+
+/* s0 points past the frame record [saved s0, saved ra]. */
+int64_t arch_perf_frame_link_offset(void) { return -16; }
+
+int64_t arch_perf_frame_ret_offset(void) { return -8; }
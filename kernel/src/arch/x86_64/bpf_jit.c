@@ -0,0 +1,364 @@
+#include <bpf/jit.h>
+
+/*
+ * Classic BPF -> x86_64.
+ *
+ * The image is called as uint32_t f(const uint8_t *data, uint32_t len), so
+ * data arrives in rdi and len in esi. A lives in eax (which is also the
+ * return register), X in r9d, and ecx/edx are scratch. Only caller-saved
+ * registers are touched; M[] is 64 bytes of stack pushed as zeroes by the
+ * prologue when the program uses it.
+ *
+ * Every BPF instruction has a fixed encoding (jumps between instructions are
+ * always rel32) so the sizing pass and the emitting pass agree exactly.
+ */
+
+#define EMIT(...)                                                              \
+    do {                                                                       \
+        const uint8_t __b[] = {__VA_ARGS__};                                   \
+        bpf_jit_emit(ctx, __b, sizeof(__b));                                   \
+    } while (0)
+
+static void emit_u32(bpf_jit_ctx_t *ctx, uint32_t v) {
+    EMIT(v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24);
+}
+
+static void emit_jmp(bpf_jit_ctx_t *ctx, uint32_t target) {
+    EMIT(0xe9); // jmp rel32
+    emit_u32(ctx, target - (uint32_t)(ctx->pos + 4));
+}
+
+static void emit_jcc(bpf_jit_ctx_t *ctx, uint8_t cc, uint32_t target) {
+    EMIT(0x0f, 0x80 | cc); // jcc rel32
+    emit_u32(ctx, target - (uint32_t)(ctx->pos + 4));
+}
+
+#define X86_JB 0x2
+#define X86_JAE 0x3
+#define X86_JE 0x4
+#define X86_JNE 0x5
+#define X86_JBE 0x6
+#define X86_JA 0x7
+
+static void emit_epilogue(bpf_jit_ctx_t *ctx) {
+    if (ctx->uses_scratch)
+        EMIT(0x48, 0x83, 0xc4, BPF_JIT_SCRATCH_SIZE); // add rsp, 64
+    EMIT(0xc3);                                       // ret
+}
+
+/*
+ * Packet load: offset in edx, result in eax (or X for msh). Out-of-range
+ * offsets, including ones that wrapped in ld [x+k], yield 0 like the
+ * interpreter. Local branches are rel8 with fixed distances.
+ */
+static void emit_bounds_check(bpf_jit_ctx_t *ctx, uint8_t size,
+                              uint8_t load_size) {
+    uint8_t skip = load_size + 2; // load + jmp over the zeroing
+    EMIT(0x89, 0xf1);             // mov ecx, esi
+    EMIT(0x29, 0xd1);             // sub ecx, edx
+    EMIT(0x72, skip + 5);         // jb oob
+    EMIT(0x83, 0xf9, size);       // cmp ecx, size
+    EMIT(0x72, skip);             // jb oob
+}
+
+static void emit_load(bpf_jit_ctx_t *ctx, uint16_t code, uint32_t k) {
+    if (BPF_MODE(code) == BPF_ABS) {
+        EMIT(0xba); // mov edx, imm32
+        emit_u32(ctx, k);
+    } else {
+        EMIT(0x44, 0x89, 0xca); // mov edx, r9d
+        EMIT(0x81, 0xc2);       // add edx, imm32
+        emit_u32(ctx, k);
+    }
+
+    switch (BPF_SIZE(code)) {
+    case BPF_W:
+        emit_bounds_check(ctx, 4, 5);
+        EMIT(0x8b, 0x04, 0x17); // mov eax, [rdi+rdx]
+        EMIT(0x0f, 0xc8);       // bswap eax
+        break;
+    case BPF_H:
+        emit_bounds_check(ctx, 2, 8);
+        EMIT(0x0f, 0xb7, 0x04, 0x17); // movzx eax, word [rdi+rdx]
+        EMIT(0x66, 0xc1, 0xc0, 0x08); // rol ax, 8
+        break;
+    case BPF_B:
+        emit_bounds_check(ctx, 1, 4);
+        EMIT(0x0f, 0xb6, 0x04, 0x17); // movzx eax, byte [rdi+rdx]
+        break;
+    }
+    EMIT(0xeb, 0x02); // jmp done
+    EMIT(0x31, 0xc0); // oob: xor eax, eax
+}
+
+static void emit_msh(bpf_jit_ctx_t *ctx, uint32_t k) {
+    EMIT(0xba); // mov edx, imm32
+    emit_u32(ctx, k);
+    emit_bounds_check(ctx, 1, 13);
+    EMIT(0x44, 0x0f, 0xb6, 0x0c, 0x17); // movzx r9d, byte [rdi+rdx]
+    EMIT(0x41, 0x83, 0xe1, 0x0f);       // and r9d, 0xf
+    EMIT(0x41, 0xc1, 0xe1, 0x02);       // shl r9d, 2
+    EMIT(0xeb, 0x03);                   // jmp done
+    EMIT(0x45, 0x31, 0xc9);             // oob: xor r9d, r9d
+}
+
+static void emit_alu(bpf_jit_ctx_t *ctx, uint16_t code, uint32_t k) {
+    bool x = BPF_SRC(code) == BPF_X;
+
+    switch (BPF_OP(code)) {
+    case BPF_ADD:
+        if (x)
+            EMIT(0x44, 0x01, 0xc8); // add eax, r9d
+        else {
+            EMIT(0x05); // add eax, imm32
+            emit_u32(ctx, k);
+        }
+        break;
+    case BPF_SUB:
+        if (x)
+            EMIT(0x44, 0x29, 0xc8); // sub eax, r9d
+        else {
+            EMIT(0x2d); // sub eax, imm32
+            emit_u32(ctx, k);
+        }
+        break;
+    case BPF_MUL:
+        if (x)
+            EMIT(0x41, 0x0f, 0xaf, 0xc1); // imul eax, r9d
+        else {
+            EMIT(0x69, 0xc0); // imul eax, eax, imm32
+            emit_u32(ctx, k);
+        }
+        break;
+    case BPF_DIV:
+    case BPF_MOD: {
+        bool mod = BPF_OP(code) == BPF_MOD;
+        if (x) {
+            EMIT(0x45, 0x85, 0xc9);   // test r9d, r9d
+            EMIT(0x75, 0x04);         // jne 1f
+            EMIT(0x31, 0xc0);         // xor eax, eax
+            EMIT(0xeb, mod ? 7 : 5);  // jmp 2f
+            EMIT(0x31, 0xd2);         // 1: xor edx, edx
+            EMIT(0x41, 0xf7, 0xf1);   // div r9d
+        } else if (k == 0) {
+            EMIT(0x31, 0xc0); // xor eax, eax
+            break;
+        } else {
+            EMIT(0xb9); // mov ecx, imm32
+            emit_u32(ctx, k);
+            EMIT(0x31, 0xd2); // xor edx, edx
+            EMIT(0xf7, 0xf1); // div ecx
+        }
+        if (mod)
+            EMIT(0x89, 0xd0); // mov eax, edx
+        break;                // 2:
+    }
+    case BPF_OR:
+        if (x)
+            EMIT(0x44, 0x09, 0xc8); // or eax, r9d
+        else {
+            EMIT(0x0d); // or eax, imm32
+            emit_u32(ctx, k);
+        }
+        break;
+    case BPF_AND:
+        if (x)
+            EMIT(0x44, 0x21, 0xc8); // and eax, r9d
+        else {
+            EMIT(0x25); // and eax, imm32
+            emit_u32(ctx, k);
+        }
+        break;
+    case BPF_XOR:
+        if (x)
+            EMIT(0x44, 0x31, 0xc8); // xor eax, r9d
+        else {
+            EMIT(0x35); // xor eax, imm32
+            emit_u32(ctx, k);
+        }
+        break;
+    case BPF_LSH:
+    case BPF_RSH: {
+        uint8_t ext = BPF_OP(code) == BPF_LSH ? 0xe0 : 0xe8; // shl / shr
+        if (x) {
+            EMIT(0x44, 0x89, 0xc9); // mov ecx, r9d
+            EMIT(0xd3, ext);        // shl/shr eax, cl
+        } else {
+            EMIT(0xc1, ext, k & 31); // shl/shr eax, imm8
+        }
+        break;
+    }
+    case BPF_NEG:
+        EMIT(0xf7, 0xd8); // neg eax
+        break;
+    }
+}
+
+static void emit_cond_jump(bpf_jit_ctx_t *ctx, uint32_t i,
+                           const struct sock_filter *insn) {
+    uint16_t code = insn->code;
+    bool x = BPF_SRC(code) == BPF_X;
+    uint32_t t = bpf_jit_target(ctx, i, insn->jt);
+    uint32_t f = bpf_jit_target(ctx, i, insn->jf);
+    uint8_t cc, inv;
+
+    switch (BPF_OP(code)) {
+    case BPF_JEQ:
+        cc = X86_JE;
+        inv = X86_JNE;
+        break;
+    case BPF_JGT:
+        cc = X86_JA;
+        inv = X86_JBE;
+        break;
+    case BPF_JGE:
+        cc = X86_JAE;
+        inv = X86_JB;
+        break;
+    case BPF_JSET:
+        cc = X86_JNE;
+        inv = X86_JE;
+        break;
+    default:
+        // unknown condition: the interpreter always takes jf
+        if (insn->jf)
+            emit_jmp(ctx, f);
+        return;
+    }
+
+    if (insn->jt == insn->jf) {
+        if (insn->jt)
+            emit_jmp(ctx, t);
+        return;
+    }
+
+    if (BPF_OP(code) == BPF_JSET) {
+        if (x)
+            EMIT(0x44, 0x85, 0xc8); // test eax, r9d
+        else {
+            EMIT(0xa9); // test eax, imm32
+            emit_u32(ctx, insn->k);
+        }
+    } else {
+        if (x)
+            EMIT(0x44, 0x39, 0xc8); // cmp eax, r9d
+        else {
+            EMIT(0x3d); // cmp eax, imm32
+            emit_u32(ctx, insn->k);
+        }
+    }
+
+    if (!insn->jf) {
+        emit_jcc(ctx, cc, t);
+    } else if (!insn->jt) {
+        emit_jcc(ctx, inv, f);
+    } else {
+        emit_jcc(ctx, cc, t);
+        emit_jmp(ctx, f);
+    }
+}
+
+bool bpf_jit_arch_supported(void) { return true; }
+
+int bpf_jit_arch_build(bpf_jit_ctx_t *ctx) {
+    EMIT(0xf3, 0x0f, 0x1e, 0xfa); // endbr64
+    if (ctx->uses_scratch) {
+        for (int i = 0; i < 8; i++)
+            EMIT(0x6a, 0x00); // push 0
+    }
+    EMIT(0x31, 0xc0);       // xor eax, eax
+    EMIT(0x45, 0x31, 0xc9); // xor r9d, r9d
+
+    for (uint32_t i = 0; i < ctx->len; i++) {
+        const struct sock_filter *insn = &ctx->insns[i];
+        uint16_t code = insn->code;
+        uint32_t k = insn->k;
+
+        ctx->offsets[i] = ctx->pos;
+
+        switch (BPF_CLASS(code)) {
+        case BPF_LD:
+            switch (BPF_MODE(code)) {
+            case BPF_IMM:
+                EMIT(0xb8); // mov eax, imm32
+                emit_u32(ctx, k);
+                break;
+            case BPF_ABS:
+            case BPF_IND:
+                if (BPF_SIZE(code) != BPF_W && BPF_SIZE(code) != BPF_H &&
+                    BPF_SIZE(code) != BPF_B)
+                    break;
+                emit_load(ctx, code, k);
+                break;
+            case BPF_MEM:
+                EMIT(0x8b, 0x44, 0x24, (k & 0xf) * 4); // mov eax, [rsp+4k]
+                break;
+            case BPF_LEN:
+                EMIT(0x89, 0xf0); // mov eax, esi
+                break;
+            }
+            break;
+
+        case BPF_LDX:
+            switch (BPF_MODE(code)) {
+            case BPF_IMM:
+                EMIT(0x41, 0xb9); // mov r9d, imm32
+                emit_u32(ctx, k);
+                break;
+            case BPF_MEM:
+                EMIT(0x44, 0x8b, 0x4c, 0x24, (k & 0xf) * 4); // mov r9d, [rsp+4k]
+                break;
+            case BPF_LEN:
+                EMIT(0x41, 0x89, 0xf1); // mov r9d, esi
+                break;
+            case BPF_MSH:
+                emit_msh(ctx, k);
+                break;
+            }
+            break;
+
+        case BPF_ST:
+            EMIT(0x89, 0x44, 0x24, (k & 0xf) * 4); // mov [rsp+4k], eax
+            break;
+
+        case BPF_STX:
+            EMIT(0x44, 0x89, 0x4c, 0x24, (k & 0xf) * 4); // mov [rsp+4k], r9d
+            break;
+
+        case BPF_ALU:
+            emit_alu(ctx, code, k);
+            break;
+
+        case BPF_JMP:
+            if (BPF_OP(code) == BPF_JA) {
+                if (k)
+                    emit_jmp(ctx, bpf_jit_target(ctx, i, k));
+            } else {
+                emit_cond_jump(ctx, i, insn);
+            }
+            break;
+
+        case BPF_RET:
+            if (BPF_RVAL(code) != BPF_A) {
+                EMIT(0xb8); // mov eax, imm32
+                emit_u32(ctx, k);
+            }
+            emit_epilogue(ctx);
+            break;
+
+        case BPF_MISC:
+            switch (BPF_MISCOP(code)) {
+            case BPF_TAX:
+                EMIT(0x41, 0x89, 0xc1); // mov r9d, eax
+                break;
+            case BPF_TXA:
+                EMIT(0x44, 0x89, 0xc8); // mov eax, r9d
+                break;
+            }
+            break;
+        }
+    }
+    ctx->offsets[ctx->len] = ctx->pos;
+
+    return 0;
+}
@@ -520,6 +520,7 @@ uint64_t general_ap_entry() {
     asm volatile("movq %0, %%cr3" ::"r"(cr3) : "memory");
 
     sse_init();
+    x64_uaccess_init(false);
 
     gdtidt_setup();
 
@@ -8,6 +8,8 @@
 #include <task/signal.h>
 #include <mod/dlinker.h>
 #include <mm/fault.h>
+#include <mm/extable.h>
+#include <task/perf_event.h>
 
 #define X64_PFEC_PRESENT (1UL << 0)
 #define X64_PFEC_WRITE (1UL << 1)
@@ -93,6 +95,16 @@ static bool x64_fault_access_allowed_now(task_t *task, uint64_t vaddr,
     return true;
 }
 
+/* With SMAP on, a supervisor access to a user page outside a stac/clac
+ * window faults even though the page is mapped; retrying would loop. */
+static bool x64_smap_violation(struct pt_regs *regs, uint64_t vaddr,
+                               uint64_t error_code) {
+    return x64_smap_enabled && (regs->cs & 3) == 0 &&
+           (error_code & X64_PFEC_PRESENT) && !(error_code & X64_PFEC_USER) &&
+           !(error_code & X64_PFEC_INSTR) && vaddr < user_va_limit() &&
+           !(regs->rflags & (1ULL << 18));
+}
+
 static bool x64_should_deliver_user_sigsegv(task_t *task) {
     if (!task || !task->signal || !task->signal->sighand)
         return false;
@@ -548,6 +560,16 @@ void do_page_fault(struct pt_regs *regs, uint64_t error_code) {
 
     task_t *self = current_task;
 
+    if (x64_smap_violation(regs, cr2, error_code)) {
+        if (fixup_exception(&regs->rip))
+            return;
+        dump_regs(regs, "SMAP violation cr2 = %#018lx, error_code = %#018lx",
+                  cr2, error_code);
+        while (1)
+            asm volatile("hlt");
+    }
+
+    perf_event_page_fault(regs, cr2);
     if (handle_page_fault_flags(self, cr2,
                                 x64_error_code_to_fault_flags(error_code)) ==
         PF_RES_OK) {
@@ -561,6 +583,9 @@ void do_page_fault(struct pt_regs *regs, uint64_t error_code) {
         return;
     }
 
+    if ((regs->cs & 3) == 0 && fixup_exception(&regs->rip))
+        return;
+
     if (x64_should_deliver_user_sigsegv(self)) {
         if (x64_deliver_user_sigsegv(regs, cr2, error_code)) {
             x64_handle_signal_on_user_return(regs);
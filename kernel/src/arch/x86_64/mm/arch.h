@@ -13,6 +13,8 @@
 #define ARCH_PT_FLAG_USER (0x1UL << 2)
 #define ARCH_PT_FLAG_PWT (0x1UL << 3)
 #define ARCH_PT_FLAG_PCD (0x1UL << 4)
+#define ARCH_PT_FLAG_ACCESSED (0x1UL << 5)
+#define ARCH_PT_FLAG_DIRTY (0x1UL << 6)
 #define ARCH_PT_FLAG_HUGE (0x1UL << 7)
 #define ARCH_PT_FLAG_COW (0x1UL << 56)
 #define ARCH_PT_FLAG_NX (0x1UL << 63)
@@ -36,6 +38,10 @@
     (((x) & (ARCH_PT_FLAG_VALID | ARCH_PT_FLAG_HUGE)) ==                       \
      (ARCH_PT_FLAG_VALID | ARCH_PT_FLAG_HUGE))
 
+/* Set by the MMU on first access and first write through the entry. */
+#define ARCH_PT_IS_YOUNG(x) (((x) & ARCH_PT_FLAG_ACCESSED) != 0)
+#define ARCH_PT_IS_DIRTY(x) (((x) & ARCH_PT_FLAG_DIRTY) != 0)
+
 uint64_t get_arch_page_table_flags(uint64_t flags);
 uint64_t arch_page_table_levels();
 void arch_flush_tlb(uint64_t vaddr);
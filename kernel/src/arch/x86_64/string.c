@@ -0,0 +1,11 @@
+#include <arch/arch.h>
+
+bool x64_has_erms = false;
+
+void x64_string_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    /* Enhanced rep movsb/stosb: byte-granular string ops run at full
+     * cache-line speed, so memcpy/memset can skip the qword split. */
+    x64_has_erms = (ebx & (1U << 9)) != 0;
+}
@@ -7,7 +7,10 @@
 #include <mm/mm_syscall.h>
 #include <task/futex.h>
 #include <task/keyring.h>
+#include <task/perf_event.h>
 #include <task/ptrace.h>
+#include <task/syscall_stats.h>
+#include <task/trace.h>
 #include <task/sched.h>
 #include <task/task_syscall.h>
 #include <drivers/rtc.h>
@@ -401,7 +404,9 @@ void syscall_init() {
     wrmsr(MSR_LSTAR, (uint64_t)syscall_handler_asm);
 
     // 4. 设置 SYSCALL_MASK MSR (RFLAGS 掩码)
-    wrmsr(MSR_SYSCALL_MASK, (1 << 9));
+    /* Clear IF and AC on entry so user code cannot carry AC into the
+     * kernel and bypass SMAP. */
+    wrmsr(MSR_SYSCALL_MASK, (1 << 9) | (1 << 18));
 }
 
 syscall_handle_t syscall_handlers[MAX_SYSCALL_NUM];
@@ -801,8 +806,8 @@ void syscall_handler_init() {
     regist_syscall_handler(SYS_PWRITEV, (syscall_handle_t)sys_pwritev);
     // regist_syscall_handler(SYS_RT_TGSIGQUEUEINFO,
     // (syscall_handle_t)sys_rt_tgsigqueueinfo);
-    // regist_syscall_handler(SYS_PERF_EVENT_OPEN,
-    // (syscall_handle_t)sys_perf_event_open);
+    regist_syscall_handler(SYS_PERF_EVENT_OPEN,
+                           (syscall_handle_t)sys_perf_event_open);
 #ifdef SYS_RECVMMSG
     regist_syscall_handler(SYS_RECVMMSG, (syscall_handle_t)sys_recvmmsg);
 #endif
@@ -919,6 +924,7 @@ static inline uint64_t syscall_account_running_ns(task_t *task,
 void syscall_handler(struct pt_regs *regs, uint64_t user_rsp) {
     uint64_t idx = regs->rax & 0xFFFFFFFF;
     bool irq_enabled_for_syscall = false;
+    uint64_t stats_start = 0;
 
     regs->rip = regs->rcx;
     regs->rflags = regs->r11;
@@ -949,6 +955,9 @@ void syscall_handler(struct pt_regs *regs, uint64_t user_rsp) {
     uint64_t arg5 = regs->r8;
     uint64_t arg6 = regs->r9;
 
+    trace_sys_enter(idx, arg1, arg2, arg3, arg4, arg5, arg6);
+    stats_start = syscall_stats_enter();
+
     if (self)
         syscall_account_running_ns(self, nano_time());
     uint64_t syscall_user_base = self ? self->user_time_ns : 0;
@@ -989,6 +998,8 @@ done:
     if (self)
         self->last_syscall_ret = regs->rax;
 
+    syscall_stats_exit(self, idx, stats_start, regs->rax);
+    trace_sys_exit(idx, regs->rax);
     ptrace_on_syscall_exit(regs);
 
     if (idx != SYS_BRK && idx != SYS_RSEQ && regs->rax == (uint64_t)-ENOSYS) {
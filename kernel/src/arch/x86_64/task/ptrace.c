@@ -1,3 +1,4 @@
+#include <task/perf_event.h>
 #include <task/ptrace.h>
 #include <task/task_syscall.h>
 
@@ -93,3 +94,20 @@ uint64_t arch_ptrace_copy_regs(task_t *target, const struct pt_regs *regs,
         return (uint64_t)-EFAULT;
     return 0;
 }
+
+uint64_t arch_perf_instruction_pointer(const struct pt_regs *regs) {
+    return regs->rip;
+}
+
+uint64_t arch_perf_frame_pointer(const struct pt_regs *regs) {
+    return regs->rbp;
+}
+
+bool arch_perf_user_mode(const struct pt_regs *regs) {
+    return (regs->cs & 0x3) == 0x3;
+}
+
+/* Frame records are [saved rbp, return address] at rbp. */
+int64_t arch_perf_frame_link_offset(void) { return 0; }
+
+int64_t arch_perf_frame_ret_offset(void) { return 8; }
@@ -0,0 +1,35 @@
+#include <arch/arch.h>
+#include <mm/extable.h>
+
+#define X64_CR0_WP (1ULL << 16)
+#define X64_CR4_SMAP (1ULL << 21)
+
+bool x64_smap_enabled = false;
+
+static bool x64_cpu_has_smap(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    return (ebx & (1U << 20)) != 0;
+}
+
+void x64_uaccess_init(bool bsp) {
+    /* Kernel writes through user mappings must honour read-only PTEs so
+     * copy-on-write pages fault instead of being modified in place. */
+    set_cr0(get_cr0() | X64_CR0_WP);
+
+    if (bsp)
+        x64_smap_enabled = x64_cpu_has_smap() && uaccess_strict_requested();
+
+    if (x64_smap_enabled)
+        set_cr4(get_cr4() | X64_CR4_SMAP);
+}
+
+void arch_enable_user_access() {
+    if (x64_smap_enabled)
+        asm volatile("stac" ::: "memory");
+}
+
+void arch_disable_user_access() {
+    if (x64_smap_enabled)
+        asm volatile("clac" ::: "memory");
+}
@@ -11,6 +11,8 @@ void arch_early_init() {
     init_serial();
 
     sse_init();
+    x64_uaccess_init(true);
+    x64_string_init();
     irq_init();
     generic_interrupt_table_init_early();
     hpet_init();
@@ -65,9 +67,6 @@ void arch_shutdown() {
     }
 }
 
-void arch_enable_user_access() {}
-void arch_disable_user_access() {}
-
 void arch_program_timer_deadline_local(uint64_t deadline_ns) {
     if (deadline_ns == UINT64_MAX) {
         apic_timer_set_interval_ns(1000000000ULL / SCHED_HZ);
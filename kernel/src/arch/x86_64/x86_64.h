@@ -52,5 +52,9 @@ void write_barrier(void);
 
 void arch_enable_user_access();
 void arch_disable_user_access();
+extern bool x64_smap_enabled;
+void x64_uaccess_init(bool bsp);
+extern bool x64_has_erms;
+void x64_string_init(void);
 bool arch_memory_region_usable(uint64_t addr, uint64_t len);
 uintptr_t arch_get_return_address(uint32_t level);
@@ -0,0 +1,638 @@
+#include <block/blkcg.h>
+#include <block/block.h>
+#include <cgroup/cgroup.h>
+#include <libs/string_builder.h>
+#include <task/task.h>
+
+#define BLKCG_REFILL_MAX_MS 1000000ULL // keeps elapsed * rate in 64 bits
+#define BLKCG_COST_MAX (1ULL << 48)
+#define BLKCG_NAME_MAX 64
+
+/* Per device: the groups competing for it under io.weight. */
+struct blkcg_queue {
+    struct llist_header node; // blkcg_queues
+    uint64_t dev_id;
+    spinlock_t lock;
+    struct llist_header active; // blkcg_dev_t, pruned lazily once idle
+};
+
+static DEFINE_LLIST(blkcg_queues);
+static spinlock_t blkcg_queues_lock;
+
+static blkcg_queue_t *blkcg_queue_get(uint64_t dev_id) {
+    blkcg_queue_t *queue, *tmp;
+    blkcg_queue_t *new_queue = NULL;
+
+    while (true) {
+        spin_lock(&blkcg_queues_lock);
+        llist_for_each(queue, tmp, &blkcg_queues, node) {
+            if (queue->dev_id == dev_id) {
+                spin_unlock(&blkcg_queues_lock);
+                free(new_queue);
+                return queue;
+            }
+        }
+        if (new_queue) {
+            llist_append(&blkcg_queues, &new_queue->node);
+            spin_unlock(&blkcg_queues_lock);
+            return new_queue;
+        }
+        spin_unlock(&blkcg_queues_lock);
+
+        new_queue = calloc(1, sizeof(*new_queue));
+        if (!new_queue)
+            return NULL;
+        new_queue->dev_id = dev_id;
+        spin_init(&new_queue->lock);
+        llist_init_head(&new_queue->active);
+    }
+}
+
+blkcg_t *blkcg_create(blkcg_t *parent) {
+    blkcg_t *blkcg = calloc(1, sizeof(*blkcg));
+
+    if (!blkcg)
+        return NULL;
+
+    blkcg->parent = parent;
+    spin_init(&blkcg->lock);
+    llist_init_head(&blkcg->devs);
+    blkcg->weight = BLKCG_WEIGHT_DFL;
+    return blkcg;
+}
+
+/* The cgroup is gone, so no request of its can still be running. */
+void blkcg_destroy(blkcg_t *blkcg) {
+    blkcg_dev_t *dev, *tmp;
+
+    if (!blkcg)
+        return;
+
+    llist_for_each(dev, tmp, &blkcg->devs, node) {
+        spin_lock(&dev->queue->lock);
+        if (dev->on_active)
+            llist_delete(&dev->active_node);
+        spin_unlock(&dev->queue->lock);
+        llist_delete(&dev->node);
+        free(dev);
+    }
+    free(blkcg);
+}
+
+static blkcg_dev_t *blkcg_dev_find_locked(blkcg_t *blkcg, uint64_t dev_id) {
+    blkcg_dev_t *dev, *tmp;
+
+    llist_for_each(dev, tmp, &blkcg->devs, node) {
+        if (dev->dev_id == dev_id)
+            return dev;
+    }
+    return NULL;
+}
+
+/* Entries live as long as the blkcg, so they can be used unlocked. */
+static blkcg_dev_t *blkcg_dev_get(blkcg_t *blkcg, uint64_t dev_id) {
+    blkcg_queue_t *queue;
+    blkcg_dev_t *dev, *new_dev;
+
+    spin_lock(&blkcg->lock);
+    dev = blkcg_dev_find_locked(blkcg, dev_id);
+    spin_unlock(&blkcg->lock);
+    if (dev)
+        return dev;
+
+    queue = blkcg_queue_get(dev_id);
+    new_dev = queue ? calloc(1, sizeof(*new_dev)) : NULL;
+    if (!new_dev)
+        return NULL;
+
+    new_dev->dev_id = dev_id;
+    new_dev->queue = queue;
+    llist_init_head(&new_dev->active_node);
+    for (int dir = 0; dir < NR_BLKCG_DIRS; dir++) {
+        new_dev->bps[dir].limit = BLKCG_LIMIT_MAX;
+        new_dev->iops[dir].limit = BLKCG_LIMIT_MAX;
+    }
+
+    spin_lock(&blkcg->lock);
+    dev = blkcg_dev_find_locked(blkcg, dev_id);
+    if (!dev) {
+        llist_append(&blkcg->devs, &new_dev->node);
+        dev = new_dev;
+        new_dev = NULL;
+    }
+    spin_unlock(&blkcg->lock);
+
+    free(new_dev);
+    return dev;
+}
+
+static int64_t blkcg_bucket_burst(uint64_t limit) {
+    return (int64_t)MAX(limit / (1000000000ULL / BLKCG_SLICE_NS), 1ULL);
+}
+
+static void blkcg_bucket_set(blkcg_bucket_t *bucket, uint64_t limit,
+                             uint64_t now) {
+    bucket->limit = limit;
+    bucket->last_ns = now;
+    bucket->tokens =
+        limit == BLKCG_LIMIT_MAX ? 0 : blkcg_bucket_burst(bucket->limit);
+}
+
+/* Takes amount out of the bucket and returns how long to sleep off debt. */
+static uint64_t blkcg_bucket_charge(blkcg_bucket_t *bucket, uint64_t amount,
+                                    uint64_t now) {
+    uint64_t elapsed_ms;
+
+    if (bucket->limit == BLKCG_LIMIT_MAX)
+        return 0;
+
+    elapsed_ms = now > bucket->last_ns ? (now - bucket->last_ns) / 1000000ULL
+                                       : 0;
+    if (elapsed_ms) {
+        bucket->last_ns += elapsed_ms * 1000000ULL;
+        elapsed_ms = MIN(elapsed_ms, BLKCG_REFILL_MAX_MS);
+        bucket->tokens =
+            MIN(bucket->tokens + (int64_t)(elapsed_ms * bucket->limit / 1000),
+                blkcg_bucket_burst(bucket->limit));
+    }
+
+    bucket->tokens -= (int64_t)amount;
+    if (bucket->tokens >= 0)
+        return 0;
+    return ((uint64_t)-bucket->tokens * 1000 / bucket->limit + 1) * 1000000ULL;
+}
+
+static bool blkcg_dev_active_locked(blkcg_dev_t *dev, uint64_t now) {
+    return dev->nr_active || now - dev->last_done_ns < BLKCG_ACTIVE_GRACE_NS;
+}
+
+/* Lowest virtual time among the other groups still using the device. */
+static bool blkcg_queue_min_vtime_locked(blkcg_queue_t *queue,
+                                         blkcg_dev_t *self, uint64_t now,
+                                         uint64_t *min_vtime) {
+    blkcg_dev_t *dev, *tmp;
+    bool found = false;
+
+    llist_for_each(dev, tmp, &queue->active, active_node) {
+        if (dev != self && !blkcg_dev_active_locked(dev, now)) {
+            llist_delete(&dev->active_node);
+            dev->on_active = false;
+            continue;
+        }
+        if (dev == self)
+            continue;
+        if (!found || dev->vtime < *min_vtime) {
+            *min_vtime = dev->vtime;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void blkcg_weight_wait(blkcg_dev_t *dev, uint64_t cost,
+                              bool may_sleep) {
+    blkcg_queue_t *queue = dev->queue;
+
+    for (int waits = 0;; waits++) {
+        uint64_t now = nano_time();
+        uint64_t min_vtime = 0;
+        bool ahead;
+
+        spin_lock(&queue->lock);
+        // an idle group does not bank credit for the time it sat out
+        if (!blkcg_dev_active_locked(dev, now) &&
+            blkcg_queue_min_vtime_locked(queue, dev, now, &min_vtime) &&
+            dev->vtime < min_vtime)
+            dev->vtime = min_vtime;
+        if (!dev->on_active) {
+            llist_append(&queue->active, &dev->active_node);
+            dev->on_active = true;
+        }
+
+        ahead = blkcg_queue_min_vtime_locked(queue, dev, now, &min_vtime) &&
+                dev->vtime > min_vtime + BLKCG_VTIME_SLACK;
+        if (!ahead || !may_sleep || waits == BLKCG_WEIGHT_MAX_WAITS) {
+            dev->nr_active++;
+            dev->vtime += cost;
+            spin_unlock(&queue->lock);
+            return;
+        }
+        spin_unlock(&queue->lock);
+
+        task_block(current_task, TASK_BLOCKING, BLKCG_WEIGHT_WAIT_NS,
+                   "blkcg_weight");
+    }
+}
+
+void blkcg_io_start(uint64_t dev_id, int dir, uint64_t len, blkcg_io_t *io) {
+    task_t *task = current_task;
+    bool may_sleep = arch_interrupt_enabled();
+    uint64_t cost = len + BLKCG_IO_COST;
+    uint64_t now = nano_time();
+    uint64_t wait_ns = 0;
+    blkcg_t *blkcg;
+
+    memset(io, 0, sizeof(*io));
+    io->dev_id = dev_id;
+    io->dir = dir;
+    if (!task)
+        return;
+
+    spin_lock(&task->psi_lock);
+    io->cgroup = cgroup_get(task->cgroup);
+    spin_unlock(&task->psi_lock);
+
+    blkcg = cgroup_blkcg(io->cgroup);
+    if (!blkcg) {
+        cgroup_put(io->cgroup);
+        io->cgroup = NULL;
+        return;
+    }
+
+    // every level's io.max applies, and every level's weight scales cost
+    for (blkcg_t *pos = blkcg; pos; pos = pos->parent) {
+        blkcg_dev_t *dev = blkcg_dev_get(pos, dev_id);
+        uint32_t weight;
+
+        if (!dev)
+            continue;
+        if (pos == blkcg)
+            io->dev = dev;
+
+        spin_lock(&pos->lock);
+        wait_ns = MAX(wait_ns, blkcg_bucket_charge(&dev->bps[dir], len, now));
+        wait_ns = MAX(wait_ns, blkcg_bucket_charge(&dev->iops[dir], 1, now));
+        weight = dev->weight ? dev->weight : pos->weight;
+        spin_unlock(&pos->lock);
+
+        cost = MIN(cost * BLKCG_WEIGHT_DFL / weight, BLKCG_COST_MAX);
+    }
+
+    if (wait_ns && may_sleep)
+        task_block(task, TASK_BLOCKING,
+                   (int64_t)MIN(wait_ns, BLKCG_MAX_WAIT_NS), "blkcg_throttle");
+    if (io->dev)
+        blkcg_weight_wait(io->dev, cost, may_sleep);
+}
+
+void blkcg_io_done(blkcg_io_t *io, uint64_t len, bool ok) {
+    if (!io || !io->cgroup)
+        return;
+
+    if (io->dev) {
+        blkcg_queue_t *queue = io->dev->queue;
+
+        spin_lock(&queue->lock);
+        io->dev->nr_active--;
+        io->dev->last_done_ns = nano_time();
+        spin_unlock(&queue->lock);
+    }
+
+    for (blkcg_t *pos = cgroup_blkcg(io->cgroup); ok && pos;
+         pos = pos->parent) {
+        blkcg_dev_t *dev;
+
+        spin_lock(&pos->lock);
+        dev = blkcg_dev_find_locked(pos, io->dev_id);
+        if (dev) {
+            dev->bytes[io->dir] += len;
+            dev->ios[io->dir]++;
+        }
+        spin_unlock(&pos->lock);
+    }
+
+    cgroup_put(io->cgroup);
+    io->cgroup = NULL;
+}
+
+static const char *blkcg_parse_token(const char *buf, char *token,
+                                     size_t size) {
+    size_t len = 0;
+
+    while (*buf == ' ' || *buf == '\t' || *buf == '\n')
+        buf++;
+    while (*buf && *buf != ' ' && *buf != '\t' && *buf != '\n') {
+        if (len + 1 < size)
+            token[len++] = *buf;
+        buf++;
+    }
+    token[len] = '\0';
+    return buf;
+}
+
+static int blkcg_parse_u64(const char *buf, uint64_t *value) {
+    uint64_t parsed = 0;
+
+    if (*buf < '0' || *buf > '9')
+        return -EINVAL;
+    while (*buf >= '0' && *buf <= '9') {
+        parsed = parsed * 10 + (uint64_t)(*buf - '0');
+        buf++;
+    }
+    if (*buf)
+        return -EINVAL;
+
+    *value = parsed;
+    return 0;
+}
+
+static int blkcg_parse_weight(const char *buf, uint32_t *weight) {
+    uint64_t value;
+    int ret = blkcg_parse_u64(buf, &value);
+
+    if (ret < 0)
+        return ret;
+    if (value < BLKCG_WEIGHT_MIN || value > BLKCG_WEIGHT_MAX)
+        return -ERANGE;
+
+    *weight = (uint32_t)value;
+    return 0;
+}
+
+/* "$WEIGHT", "default $WEIGHT", "$DEV $WEIGHT" or "$DEV default". */
+int blkcg_set_weight(blkcg_t *blkcg, const char *buf) {
+    char first[BLKCG_NAME_MAX], second[BLKCG_NAME_MAX], extra[2];
+    uint32_t weight = 0;
+    blkdev_t *bdev;
+    blkcg_dev_t *dev;
+    int ret;
+
+    if (!blkcg)
+        return -EINVAL;
+
+    buf = blkcg_parse_token(buf, first, sizeof(first));
+    buf = blkcg_parse_token(buf, second, sizeof(second));
+    blkcg_parse_token(buf, extra, sizeof(extra));
+    if (!first[0] || extra[0])
+        return -EINVAL;
+
+    if (!second[0] || !strcmp(first, "default")) {
+        ret = blkcg_parse_weight(second[0] ? second : first, &weight);
+        if (ret < 0)
+            return ret;
+        __atomic_store_n(&blkcg->weight, weight, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    bdev = find_blkdev_by_name(first);
+    if (!bdev)
+        return -ENODEV;
+    if (strcmp(second, "default")) {
+        ret = blkcg_parse_weight(second, &weight);
+        if (ret < 0)
+            return ret;
+    }
+
+    dev = blkcg_dev_get(blkcg, bdev->id);
+    if (!dev)
+        return -ENOMEM;
+    spin_lock(&blkcg->lock);
+    dev->weight = weight;
+    spin_unlock(&blkcg->lock);
+    return 0;
+}
+
+static const char *const blkcg_max_keys[] = {"rbps", "wbps", "riops",
+                                             "wiops"};
+
+static blkcg_bucket_t *blkcg_max_bucket(blkcg_dev_t *dev, int key) {
+    return key < NR_BLKCG_DIRS ? &dev->bps[key]
+                               : &dev->iops[key - NR_BLKCG_DIRS];
+}
+
+/* "$DEV rbps=N wbps=N riops=N wiops=N", any subset; "max" lifts one. */
+int blkcg_set_max(blkcg_t *blkcg, const char *buf) {
+    char name[BLKCG_NAME_MAX], token[BLKCG_NAME_MAX];
+    uint64_t values[4];
+    bool set[4] = {false};
+    uint64_t now = nano_time();
+    blkdev_t *bdev;
+    blkcg_dev_t *dev;
+
+    if (!blkcg)
+        return -EINVAL;
+
+    buf = blkcg_parse_token(buf, name, sizeof(name));
+    if (!name[0])
+        return -EINVAL;
+    bdev = find_blkdev_by_name(name);
+    if (!bdev)
+        return -ENODEV;
+
+    while (true) {
+        const char *value = NULL;
+        int key;
+
+        buf = blkcg_parse_token(buf, token, sizeof(token));
+        if (!token[0])
+            break;
+
+        for (key = 0; key < 4; key++) {
+            size_t len = strlen(blkcg_max_keys[key]);
+
+            if (!strncmp(token, blkcg_max_keys[key], len) &&
+                token[len] == '=') {
+                value = token + len + 1;
+                break;
+            }
+        }
+        if (!value)
+            return -EINVAL;
+
+        if (!strcmp(value, "max")) {
+            values[key] = BLKCG_LIMIT_MAX;
+        } else {
+            int ret = blkcg_parse_u64(value, &values[key]);
+
+            if (ret < 0)
+                return ret;
+            if (!values[key])
+                return -ERANGE;
+            if (values[key] >= BLKCG_RATE_MAX)
+                values[key] = BLKCG_LIMIT_MAX;
+        }
+        set[key] = true;
+    }
+
+    dev = blkcg_dev_get(blkcg, bdev->id);
+    if (!dev)
+        return -ENOMEM;
+
+    spin_lock(&blkcg->lock);
+    for (int key = 0; key < 4; key++) {
+        if (set[key])
+            blkcg_bucket_set(blkcg_max_bucket(dev, key), values[key], now);
+    }
+    spin_unlock(&blkcg->lock);
+    return 0;
+}
+
+typedef struct blkcg_dev_snapshot {
+    uint64_t dev_id;
+    uint64_t bytes[NR_BLKCG_DIRS];
+    uint64_t ios[NR_BLKCG_DIRS];
+    uint64_t limits[4];
+    uint32_t weight;
+} blkcg_dev_snapshot_t;
+
+/* Copies the entries out so the text can be built without the lock. */
+static blkcg_dev_snapshot_t *blkcg_snapshot(blkcg_t *blkcg, size_t *count) {
+    blkcg_dev_snapshot_t *snap;
+    blkcg_dev_t *dev, *tmp;
+    size_t capacity = 0;
+
+    *count = 0;
+    spin_lock(&blkcg->lock);
+    llist_for_each(dev, tmp, &blkcg->devs, node) {
+        capacity++;
+    }
+    spin_unlock(&blkcg->lock);
+
+    snap = calloc(MAX(capacity, (size_t)1), sizeof(*snap));
+    if (!snap)
+        return NULL;
+
+    spin_lock(&blkcg->lock);
+    llist_for_each(dev, tmp, &blkcg->devs, node) {
+        blkcg_dev_snapshot_t *entry;
+
+        if (*count == capacity)
+            break;
+        entry = &snap[(*count)++];
+        entry->dev_id = dev->dev_id;
+        entry->weight = dev->weight;
+        for (int dir = 0; dir < NR_BLKCG_DIRS; dir++) {
+            entry->bytes[dir] = dev->bytes[dir];
+            entry->ios[dir] = dev->ios[dir];
+        }
+        for (int key = 0; key < 4; key++)
+            entry->limits[key] = blkcg_max_bucket(dev, key)->limit;
+    }
+    spin_unlock(&blkcg->lock);
+    return snap;
+}
+
+static char *blkcg_finish(string_builder_t *builder, size_t *content_len) {
+    char *data = builder->data;
+
+    *content_len = builder->size;
+    free(builder);
+    return data;
+}
+
+static const char *blkcg_dev_name(uint64_t dev_id) {
+    blkdev_t *bdev = find_blkdev_by_id(dev_id);
+
+    return bdev && bdev->name ? bdev->name : NULL;
+}
+
+char *blkcg_show_weight(blkcg_t *blkcg, size_t *content_len) {
+    blkcg_dev_snapshot_t *snap;
+    string_builder_t *builder;
+    size_t count;
+
+    *content_len = 0;
+    if (!blkcg)
+        return NULL;
+    snap = blkcg_snapshot(blkcg, &count);
+    if (!snap)
+        return NULL;
+    builder = create_string_builder(64);
+    if (!builder) {
+        free(snap);
+        return NULL;
+    }
+
+    string_builder_append(
+        builder, "default %u\n",
+        (unsigned int)__atomic_load_n(&blkcg->weight, __ATOMIC_RELAXED));
+    for (size_t i = 0; i < count; i++) {
+        const char *name = blkcg_dev_name(snap[i].dev_id);
+
+        if (name && snap[i].weight)
+            string_builder_append(builder, "%s %u\n", name,
+                                  (unsigned int)snap[i].weight);
+    }
+
+    free(snap);
+    return blkcg_finish(builder, content_len);
+}
+
+char *blkcg_show_max(blkcg_t *blkcg, size_t *content_len) {
+    blkcg_dev_snapshot_t *snap;
+    string_builder_t *builder;
+    size_t count;
+
+    *content_len = 0;
+    if (!blkcg)
+        return NULL;
+    snap = blkcg_snapshot(blkcg, &count);
+    if (!snap)
+        return NULL;
+    builder = create_string_builder(64);
+    if (!builder) {
+        free(snap);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const char *name = blkcg_dev_name(snap[i].dev_id);
+        bool limited = false;
+
+        for (int key = 0; key < 4; key++)
+            limited |= snap[i].limits[key] != BLKCG_LIMIT_MAX;
+        if (!name || !limited)
+            continue;
+
+        string_builder_append(builder, "%s", name);
+        for (int key = 0; key < 4; key++) {
+            if (snap[i].limits[key] == BLKCG_LIMIT_MAX)
+                string_builder_append(builder, " %s=max",
+                                      blkcg_max_keys[key]);
+            else
+                string_builder_append(
+                    builder, " %s=%llu", blkcg_max_keys[key],
+                    (unsigned long long)snap[i].limits[key]);
+        }
+        string_builder_append(builder, "\n");
+    }
+
+    free(snap);
+    return blkcg_finish(builder, content_len);
+}
+
+char *blkcg_show_stat(blkcg_t *blkcg, size_t *content_len) {
+    blkcg_dev_snapshot_t *snap;
+    string_builder_t *builder;
+    size_t count;
+
+    *content_len = 0;
+    if (!blkcg)
+        return NULL;
+    snap = blkcg_snapshot(blkcg, &count);
+    if (!snap)
+        return NULL;
+    builder = create_string_builder(128);
+    if (!builder) {
+        free(snap);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const char *name = blkcg_dev_name(snap[i].dev_id);
+
+        if (!name || !(snap[i].ios[BLKCG_READ] | snap[i].ios[BLKCG_WRITE]))
+            continue;
+        string_builder_append(
+            builder,
+            "%s rbytes=%llu wbytes=%llu rios=%llu wios=%llu dbytes=0 "
+            "dios=0\n",
+            name, (unsigned long long)snap[i].bytes[BLKCG_READ],
+            (unsigned long long)snap[i].bytes[BLKCG_WRITE],
+            (unsigned long long)snap[i].ios[BLKCG_READ],
+            (unsigned long long)snap[i].ios[BLKCG_WRITE]);
+    }
+
+    free(snap);
+    return blkcg_finish(builder, content_len);
+}
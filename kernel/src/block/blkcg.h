@@ -0,0 +1,98 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <libs/llist.h>
+
+struct cgroup;
+
+/*
+ * io controller. blkdev_read()/blkdev_write() run every request through
+ * blkcg_io_start()/blkcg_io_done() on behalf of the submitting task's
+ * cgroup and each of its ancestors:
+ *
+ *  - io.stat counts bytes and requests per device at every level;
+ *  - io.max is a token bucket per direction for bytes and for requests,
+ *    refilled at the configured rate with a 100ms burst. A request may
+ *    overdraw it and the submitter sleeps off the debt before issuing;
+ *  - io.weight gives every group with requests on a device a virtual
+ *    clock advanced by request cost scaled down by its weight. A submitter
+ *    that runs too far ahead of the slowest competing group waits a little
+ *    for it to catch up.
+ *
+ * Drivers complete synchronously, so the submitter is always the one to
+ * wait; callers that cannot sleep (interrupts off) only run up the debt
+ * for whoever submits next. Tasks in the root cgroup are not accounted.
+ */
+
+#define BLKCG_WEIGHT_DFL 100
+#define BLKCG_WEIGHT_MIN 1
+#define BLKCG_WEIGHT_MAX 10000
+#define BLKCG_LIMIT_MAX UINT64_MAX
+#define BLKCG_RATE_MAX (1ULL << 42) // larger io.max rates mean unlimited
+#define BLKCG_SLICE_NS (100ULL * 1000000ULL)
+#define BLKCG_MAX_WAIT_NS (1000ULL * 1000000ULL)
+#define BLKCG_IO_COST 4096ULL // per-request vtime charge, in bytes
+#define BLKCG_VTIME_SLACK (2ULL * 1024 * 1024)
+#define BLKCG_ACTIVE_GRACE_NS (10ULL * 1000000ULL)
+#define BLKCG_WEIGHT_WAIT_NS (1ULL * 1000000ULL)
+#define BLKCG_WEIGHT_MAX_WAITS 20
+
+enum blkcg_dir {
+    BLKCG_READ,
+    BLKCG_WRITE,
+    NR_BLKCG_DIRS,
+};
+
+typedef struct blkcg_bucket {
+    uint64_t limit; // per second, BLKCG_LIMIT_MAX when unlimited
+    int64_t tokens; // negative while in debt
+    uint64_t last_ns;
+} blkcg_bucket_t;
+
+typedef struct blkcg_queue blkcg_queue_t;
+
+/* One cgroup's state on one device, under the owning blkcg's lock. */
+typedef struct blkcg_dev {
+    struct llist_header node; // blkcg->devs
+    uint64_t dev_id;
+    blkcg_queue_t *queue;
+    uint64_t bytes[NR_BLKCG_DIRS];
+    uint64_t ios[NR_BLKCG_DIRS];
+    blkcg_bucket_t bps[NR_BLKCG_DIRS];
+    blkcg_bucket_t iops[NR_BLKCG_DIRS];
+    uint32_t weight; // 0 follows the cgroup's default
+
+    /* Under queue->lock. */
+    struct llist_header active_node;
+    bool on_active;
+    uint32_t nr_active;
+    uint64_t last_done_ns;
+    uint64_t vtime;
+} blkcg_dev_t;
+
+typedef struct blkcg {
+    struct blkcg *parent;
+    spinlock_t lock;
+    struct llist_header devs;
+    uint32_t weight;
+} blkcg_t;
+
+/* Carried from blkcg_io_start() to blkcg_io_done(). */
+typedef struct blkcg_io {
+    struct cgroup *cgroup; // reference held while the request runs
+    blkcg_dev_t *dev;      // leaf entry, NULL when not accounted
+    uint64_t dev_id;
+    int dir;
+} blkcg_io_t;
+
+blkcg_t *blkcg_create(blkcg_t *parent);
+void blkcg_destroy(blkcg_t *blkcg);
+
+void blkcg_io_start(uint64_t dev_id, int dir, uint64_t len, blkcg_io_t *io);
+void blkcg_io_done(blkcg_io_t *io, uint64_t len, bool ok);
+
+int blkcg_set_weight(blkcg_t *blkcg, const char *buf);
+int blkcg_set_max(blkcg_t *blkcg, const char *buf);
+char *blkcg_show_weight(blkcg_t *blkcg, size_t *content_len);
+char *blkcg_show_max(blkcg_t *blkcg, size_t *content_len);
+char *blkcg_show_stat(blkcg_t *blkcg, size_t *content_len);
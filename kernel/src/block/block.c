@@ -1,9 +1,13 @@
 #include <block/block.h>
+#include <block/blkcg.h>
 #include <mm/mm.h>
 #include <block/partition.h>
 #include <dev/device.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <task/psi.h>
+#include <task/trace.h>
+#include <task/taskstats.h>
 
 DEFINE_LLIST(blk_dev_list);
 uint64_t blk_devnum = 0;
@@ -42,6 +46,10 @@ blkdev_t *find_blkdev_by_name(const char *name) {
 }
 
 void blkdev_register(blkdev_t *dev) {
+    dev->stats = calloc(MAX_CPU_NUM, sizeof(blkdev_cpu_stats_t));
+    dev->in_flight = 0;
+    dev->io_stamp_ns = 0;
+    dev->io_ticks_ns = 0;
     llist_append(&blk_dev_list, &dev->list);
     dev->id = blk_devnum++;
     dev->mounted = false;
@@ -277,6 +285,95 @@ uint64_t blkdev_ioctl(uint64_t drive, uint64_t cmd, uint64_t arg) {
     return 0;
 }
 
+/*
+ * Per-device I/O accounting for /proc/diskstats, in the spirit of Linux's
+ * part_stat: counters go to the completing CPU's slot, and the only shared
+ * words are in_flight and the io_ticks stamp, both updated with relaxed
+ * atomics. A request counts from before blkcg throttling to completion.
+ */
+typedef struct blkdev_io_acct {
+    blkdev_t *dev;
+    int dir;
+    uint64_t start_ns;
+} blkdev_io_acct_t;
+
+/* Busy time advances whoever moves the stamp while requests are out. */
+static void blkdev_update_io_ticks(blkdev_t *dev, uint64_t now_ns, bool end) {
+    uint64_t stamp = __atomic_load_n(&dev->io_stamp_ns, __ATOMIC_RELAXED);
+
+    if (now_ns <= stamp)
+        return;
+    if (__atomic_compare_exchange_n(&dev->io_stamp_ns, &stamp, now_ns, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED) &&
+        (end || __atomic_load_n(&dev->in_flight, __ATOMIC_RELAXED)))
+        __atomic_fetch_add(&dev->io_ticks_ns, now_ns - stamp,
+                           __ATOMIC_RELAXED);
+}
+
+static void blkdev_acct_start(uint64_t drive, int dir,
+                              blkdev_io_acct_t *acct) {
+    acct->dev = find_blkdev_by_id(drive);
+    acct->dir = dir;
+    acct->start_ns = nano_time();
+    if (!acct->dev)
+        return;
+
+    blkdev_update_io_ticks(acct->dev, acct->start_ns, false);
+    __atomic_fetch_add(&acct->dev->in_flight, 1, __ATOMIC_RELAXED);
+}
+
+static void blkdev_acct_done(blkdev_io_acct_t *acct, uint64_t ret) {
+    blkdev_t *dev = acct->dev;
+    blkdev_cpu_stats_t *stats;
+    uint64_t now_ns, cpu_id;
+
+    if (!dev)
+        return;
+
+    now_ns = nano_time();
+    blkdev_update_io_ticks(dev, now_ns, true);
+    __atomic_fetch_sub(&dev->in_flight, 1, __ATOMIC_RELAXED);
+    task_delay_add(current_task, TASK_DELAY_BLKIO,
+                   now_ns > acct->start_ns ? now_ns - acct->start_ns : 0);
+    if (acct->dir == BLKCG_READ && (int64_t)ret > 0)
+        task_io_add(current_task, TASK_IO_READ_BYTES, ret);
+    if (!dev->stats)
+        return;
+
+    cpu_id = current_cpu_id;
+    stats = &dev->stats[cpu_id < MAX_CPU_NUM ? cpu_id : 0];
+    __atomic_fetch_add(&stats->ios[acct->dir], 1, __ATOMIC_RELAXED);
+    if ((int64_t)ret > 0)
+        __atomic_fetch_add(&stats->sectors[acct->dir], ret >> 9,
+                           __ATOMIC_RELAXED);
+    if (now_ns > acct->start_ns)
+        __atomic_fetch_add(&stats->ticks_ns[acct->dir],
+                           now_ns - acct->start_ns, __ATOMIC_RELAXED);
+}
+
+void blkdev_stats_read(blkdev_t *dev, blkdev_stats_t *out) {
+    size_t online_cpus = cpu_count ? MIN(cpu_count, (uint64_t)MAX_CPU_NUM) : 1;
+
+    memset(out, 0, sizeof(*out));
+    if (!dev)
+        return;
+
+    for (size_t cpu = 0; dev->stats && cpu < online_cpus; cpu++) {
+        blkdev_cpu_stats_t *stats = &dev->stats[cpu];
+
+        for (int dir = 0; dir < 2; dir++) {
+            out->ios[dir] +=
+                __atomic_load_n(&stats->ios[dir], __ATOMIC_RELAXED);
+            out->sectors[dir] +=
+                __atomic_load_n(&stats->sectors[dir], __ATOMIC_RELAXED);
+            out->ticks_ns[dir] +=
+                __atomic_load_n(&stats->ticks_ns[dir], __ATOMIC_RELAXED);
+        }
+    }
+    out->in_flight = __atomic_load_n(&dev->in_flight, __ATOMIC_RELAXED);
+    out->io_ticks_ns = __atomic_load_n(&dev->io_ticks_ns, __ATOMIC_RELAXED);
+}
+
 #define DMA_ALIGN PAGE_SIZE
 #define IS_DMA_BUF(p) (((uintptr_t)(p) & (DMA_ALIGN - 1)) == 0)
 
@@ -312,7 +409,8 @@ static bool blk_copy_from_buffer(void *dst, const void *src, uint64_t len,
     return true;
 }
 
-uint64_t blkdev_read(uint64_t drive, uint64_t offset, void *buf, uint64_t len) {
+static uint64_t blkdev_do_read(uint64_t drive, uint64_t offset, void *buf,
+                               uint64_t len) {
     if (len == 0)
         return 0;
 
@@ -425,8 +523,30 @@ uint64_t blkdev_read(uint64_t drive, uint64_t offset, void *buf, uint64_t len) {
     return total;
 }
 
-uint64_t blkdev_write(uint64_t drive, uint64_t offset, const void *buf,
-                      uint64_t len) {
+/*
+ * The caller sleeps or spins until the device is done: that is io pressure,
+ * and so is any time its cgroup's io limits hold it back first.
+ */
+uint64_t blkdev_read(uint64_t drive, uint64_t offset, void *buf, uint64_t len) {
+    unsigned long pflags;
+    blkdev_io_acct_t acct;
+    blkcg_io_t io;
+    uint64_t ret;
+
+    psi_iowait_enter(&pflags);
+    blkdev_acct_start(drive, BLKCG_READ, &acct);
+    blkcg_io_start(drive, BLKCG_READ, len, &io);
+    trace_block_rq_issue(drive, offset, len, BLKCG_READ);
+    ret = blkdev_do_read(drive, offset, buf, len);
+    trace_block_rq_complete(drive, offset, len, BLKCG_READ, ret);
+    blkcg_io_done(&io, ret, (int64_t)ret >= 0);
+    blkdev_acct_done(&acct, ret);
+    psi_iowait_leave(&pflags);
+    return ret;
+}
+
+static uint64_t blkdev_do_write(uint64_t drive, uint64_t offset,
+                                const void *buf, uint64_t len) {
     if (len == 0)
         return 0;
 
@@ -551,3 +671,22 @@ uint64_t blkdev_write(uint64_t drive, uint64_t offset, const void *buf,
 
     return total;
 }
+
+uint64_t blkdev_write(uint64_t drive, uint64_t offset, const void *buf,
+                      uint64_t len) {
+    unsigned long pflags;
+    blkdev_io_acct_t acct;
+    blkcg_io_t io;
+    uint64_t ret;
+
+    psi_iowait_enter(&pflags);
+    blkdev_acct_start(drive, BLKCG_WRITE, &acct);
+    blkcg_io_start(drive, BLKCG_WRITE, len, &io);
+    trace_block_rq_issue(drive, offset, len, BLKCG_WRITE);
+    ret = blkdev_do_write(drive, offset, buf, len);
+    trace_block_rq_complete(drive, offset, len, BLKCG_WRITE, ret);
+    blkcg_io_done(&io, ret, (int64_t)ret >= 0);
+    blkdev_acct_done(&acct, ret);
+    psi_iowait_leave(&pflags);
+    return ret;
+}
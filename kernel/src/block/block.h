@@ -5,6 +5,26 @@
 
 #define MAX_BLKDEV_NUM 64
 
+/*
+ * One CPU's share of a device's I/O counters, indexed by BLKCG_READ and
+ * BLKCG_WRITE. Sectors are 512 bytes whatever the device block size, and
+ * ticks run from issue (throttling included) to completion.
+ */
+typedef struct blkdev_cpu_stats {
+    uint64_t ios[2];
+    uint64_t sectors[2];
+    uint64_t ticks_ns[2];
+} blkdev_cpu_stats_t;
+
+/* A device's counters summed over every CPU, for /proc/diskstats. */
+typedef struct blkdev_stats {
+    uint64_t ios[2];
+    uint64_t sectors[2];
+    uint64_t ticks_ns[2];
+    uint64_t in_flight;
+    uint64_t io_ticks_ns; // time with at least one request in flight
+} blkdev_stats_t;
+
 /**
  * Registered block device descriptor. Drivers provide sector-sized read/write
  * callbacks while higher layers manage lookup, mount state, and ioctl helpers.
@@ -20,6 +40,10 @@ typedef struct blkdev {
     bool mounted;
     uint64_t (*read)(void *data, uint64_t lba, void *buffer, uint64_t size);
     uint64_t (*write)(void *data, uint64_t lba, void *buffer, uint64_t size);
+    blkdev_cpu_stats_t *stats; // MAX_CPU_NUM slots, NULL if out of memory
+    uint64_t in_flight;
+    uint64_t io_stamp_ns; // last in_flight change, for io_ticks_ns
+    uint64_t io_ticks_ns;
 } blkdev_t;
 
 extern struct llist_header blk_dev_list;
@@ -68,6 +92,12 @@ enum {
  */
 uint64_t blkdev_ioctl(uint64_t drive, uint64_t cmd, uint64_t arg);
 
+/**
+ * Sum a device's per-CPU I/O counters. Lock-free; fields may be a request
+ * apart from each other.
+ */
+void blkdev_stats_read(blkdev_t *dev, blkdev_stats_t *out);
+
 /**
  * Read a byte range from a registered block device.
  */
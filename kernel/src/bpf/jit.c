@@ -0,0 +1,312 @@
+#include <bpf/jit.h>
+#include <boot/boot.h>
+#include <drivers/logger.h>
+#include <mm/bitmap.h>
+#include <mm/mm.h>
+#include <mm/page_table_flags.h>
+
+int bpf_jit_enable = 0;
+
+static spinlock_t bpf_jit_lock = SPIN_INIT;
+static uint8_t bpf_jit_map_buf[BPF_JIT_SPACE_PAGES / 8];
+static Bitmap bpf_jit_map;
+static size_t bpf_jit_cursor;
+
+int bpf_jit_arch_build(bpf_jit_ctx_t *ctx) __attribute__((weak));
+
+int bpf_jit_arch_build(bpf_jit_ctx_t *ctx) {
+    (void)ctx;
+    return -EOPNOTSUPP;
+}
+
+bool bpf_jit_arch_supported(void) __attribute__((weak));
+
+bool bpf_jit_arch_supported(void) { return false; }
+
+/*
+ * Next-fit over the JIT area: freed ranges are only reused after the cursor
+ * wraps, so a filter that was just detached does not get its address handed
+ * to the next one straight away.
+ */
+static uint64_t bpf_jit_alloc_va(size_t pages) {
+    size_t index;
+
+    spin_lock(&bpf_jit_lock);
+    index = bitmap_find_range_from(&bpf_jit_map, pages, false, bpf_jit_cursor);
+    if (index == (size_t)-1)
+        index = bitmap_find_range(&bpf_jit_map, pages, false);
+    if (index != (size_t)-1) {
+        bitmap_set_range(&bpf_jit_map, index, index + pages, true);
+        bpf_jit_cursor = index + pages;
+        if (bpf_jit_cursor >= BPF_JIT_SPACE_PAGES)
+            bpf_jit_cursor = 0;
+    }
+    spin_unlock(&bpf_jit_lock);
+
+    if (index == (size_t)-1)
+        return 0;
+    return BPF_JIT_SPACE_START + index * PAGE_SIZE;
+}
+
+static void bpf_jit_free_va(uint64_t va, size_t pages) {
+    size_t index = (va - BPF_JIT_SPACE_START) / PAGE_SIZE;
+
+    spin_lock(&bpf_jit_lock);
+    bitmap_set_range(&bpf_jit_map, index, index + pages, false);
+    spin_unlock(&bpf_jit_lock);
+}
+
+static void bpf_jit_dump(const bpf_prog_t *prog, const uint8_t *code,
+                         size_t size) {
+    printk("BPF JIT: %u insns -> %lu bytes at %#lx\n", prog->len, size,
+           (uint64_t)prog->image);
+    for (size_t i = 0; i < size; i += 16) {
+        char line[16 * 3 + 1];
+        size_t n = MIN(size - i, (size_t)16);
+        for (size_t j = 0; j < n; j++)
+            sprintf(line + j * 3, "%02x ", code[i + j]);
+        line[n * 3] = '\0';
+        printk("  %04lx: %s\n", i, line);
+    }
+}
+
+static bool bpf_jit_uses_scratch(const struct sock_filter *insns,
+                                 uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        uint16_t code = insns[i].code;
+        switch (BPF_CLASS(code)) {
+        case BPF_ST:
+        case BPF_STX:
+            return true;
+        case BPF_LD:
+        case BPF_LDX:
+            if (BPF_MODE(code) == BPF_MEM)
+                return true;
+            break;
+        }
+    }
+    return false;
+}
+
+/*
+ * Translates a validated program into native code. The image is written
+ * through a writable mapping which is then flipped to read+execute before
+ * anyone can call it, so no page of the JIT area is ever W and X at once.
+ * Any failure leaves prog->jited NULL and the interpreter takes over.
+ */
+int bpf_jit_compile(bpf_prog_t *prog) {
+    bpf_jit_ctx_t ctx = {
+        .insns = prog->insns,
+        .len = prog->len,
+    };
+    uint8_t *code = NULL;
+    uint64_t va = 0;
+    size_t pages = 0;
+    int ret;
+
+    if (!__atomic_load_n(&bpf_jit_enable, __ATOMIC_RELAXED) ||
+        !bpf_jit_arch_supported())
+        return -EOPNOTSUPP;
+
+    ctx.offsets = calloc(prog->len + 1, sizeof(uint32_t));
+    if (!ctx.offsets)
+        return -ENOMEM;
+    ctx.uses_scratch = bpf_jit_uses_scratch(prog->insns, prog->len);
+
+    ret = bpf_jit_arch_build(&ctx);
+    if (ret < 0)
+        goto out;
+
+    size_t size = ctx.pos;
+    code = malloc(size);
+    if (!code) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    ctx.image = code;
+    ctx.pos = 0;
+    ret = bpf_jit_arch_build(&ctx);
+    if (ret < 0)
+        goto out;
+    if (ctx.pos != size) {
+        printk("BPF JIT: image size changed between passes (%lu != %lu)\n",
+               ctx.pos, size);
+        ret = -EFAULT;
+        goto out;
+    }
+
+    pages = PADDING_UP(size, PAGE_SIZE) / PAGE_SIZE;
+    va = bpf_jit_alloc_va(pages);
+    if (!va) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    uint64_t *pgdir = get_current_page_dir(false);
+    if (map_page_range(pgdir, va, (uint64_t)-1, pages * PAGE_SIZE,
+                       PT_FLAG_R | PT_FLAG_W) != 0) {
+        unmap_page_range(pgdir, va, pages * PAGE_SIZE);
+        bpf_jit_free_va(va, pages);
+        ret = -ENOMEM;
+        goto out;
+    }
+    memcpy((void *)va, code, size);
+    map_change_attribute_range(pgdir, va, pages * PAGE_SIZE,
+                               PT_FLAG_R | PT_FLAG_X, true);
+    sync_instruction_memory_range((void *)va, size);
+
+    prog->image = (void *)va;
+    prog->image_pages = pages;
+    prog->jited = (bpf_jit_func_t)va;
+
+    if (__atomic_load_n(&bpf_jit_enable, __ATOMIC_RELAXED) > 1)
+        bpf_jit_dump(prog, code, size);
+
+out:
+    free(code);
+    free(ctx.offsets);
+    return ret;
+}
+
+void bpf_jit_free(bpf_prog_t *prog) {
+    if (!prog->image)
+        return;
+
+    uint64_t va = (uint64_t)prog->image;
+    prog->jited = NULL;
+    unmap_page_range(get_current_page_dir(false), va,
+                     prog->image_pages * PAGE_SIZE);
+    bpf_jit_free_va(va, prog->image_pages);
+    prog->image = NULL;
+    prog->image_pages = 0;
+}
+
+static uint32_t bpf_selftest_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return (uint32_t)x;
+}
+
+static uint32_t bpf_selftest_k(uint64_t *state) {
+    uint32_t r = bpf_selftest_rand(state);
+    switch (r & 3) {
+    case 0:
+        return r >> 26; // offsets and shifts inside a small packet
+    case 1:
+        return (uint32_t)-(int32_t)(r >> 29) - 1; // wraps in ld [x+k]
+    default:
+        return bpf_selftest_rand(state);
+    }
+}
+
+/*
+ * Random but valid programs: every opcode byte is allowed (unknown ones are
+ * no-ops or take jf in the interpreter, and the JIT has to agree), only M[]
+ * indices and jump targets are clamped so bpf_validate accepts them.
+ */
+static uint32_t bpf_selftest_gen(uint64_t *state, struct sock_filter *insns,
+                                 uint32_t max) {
+    uint32_t len = 2 + bpf_selftest_rand(state) % (max - 1);
+
+    for (uint32_t i = 0; i < len; i++) {
+        struct sock_filter *insn = &insns[i];
+        uint32_t left = len - i - 1;
+
+        insn->code = bpf_selftest_rand(state) & 0xff;
+        insn->k = bpf_selftest_k(state);
+        insn->jt = left ? bpf_selftest_rand(state) % left : 0;
+        insn->jf = left ? bpf_selftest_rand(state) % left : 0;
+
+        if (i == len - 1) {
+            insn->code = BPF_RET | (bpf_selftest_rand(state) & 0x18);
+            continue;
+        }
+
+        switch (BPF_CLASS(insn->code)) {
+        case BPF_LD:
+        case BPF_LDX:
+            if (BPF_MODE(insn->code) == BPF_MEM)
+                insn->k &= 0xf;
+            break;
+        case BPF_ST:
+        case BPF_STX:
+            insn->k &= 0xf;
+            break;
+        case BPF_JMP:
+            if (BPF_OP(insn->code) == BPF_JA)
+                insn->k = left ? bpf_selftest_rand(state) % left : 0;
+            break;
+        case BPF_RET:
+            // keep most programs long enough to reach the interesting part
+            if (bpf_selftest_rand(state) & 3)
+                insn->code = BPF_MISC | BPF_TAX;
+            break;
+        }
+    }
+
+    return len;
+}
+
+/*
+ * Differential test of the JIT against bpf_run on random programs and
+ * packets, enabled with "bpf_jit_selftest" on the command line. Any
+ * mismatch turns the JIT off for the rest of the boot.
+ */
+static void bpf_jit_selftest() {
+    enum { PROGS = 2000, PACKETS = 16, MAX_INSNS = 48, MAX_PACKET = 96 };
+    struct sock_filter insns[MAX_INSNS];
+    uint8_t packet[MAX_PACKET];
+    uint64_t state = nano_time() | 1;
+    uint32_t jited = 0;
+
+    for (uint32_t n = 0; n < PROGS; n++) {
+        uint32_t len = bpf_selftest_gen(&state, insns, MAX_INSNS);
+        bpf_prog_t *prog = NULL;
+
+        if (bpf_prog_create(insns, len, &prog) < 0)
+            continue;
+        if (!prog->jited) {
+            bpf_prog_free(prog);
+            continue;
+        }
+        jited++;
+
+        for (uint32_t p = 0; p < PACKETS; p++) {
+            uint32_t plen = bpf_selftest_rand(&state) % (MAX_PACKET + 1);
+            for (uint32_t i = 0; i < plen; i++)
+                packet[i] = bpf_selftest_rand(&state);
+
+            uint32_t want = bpf_run(insns, len, packet, plen);
+            uint32_t got = prog->jited(packet, plen);
+            if (want == got)
+                continue;
+
+            printk("BPF JIT: selftest mismatch, interpreter %#x, jit %#x, "
+                   "packet len %u\n",
+                   want, got, plen);
+            for (uint32_t i = 0; i < len; i++)
+                printk("  %3u: { %#04x, %u, %u, %#010x }\n", i, insns[i].code,
+                       insns[i].jt, insns[i].jf, insns[i].k);
+            bpf_prog_free(prog);
+            __atomic_store_n(&bpf_jit_enable, 0, __ATOMIC_RELAXED);
+            printk("BPF JIT: disabled\n");
+            return;
+        }
+        bpf_prog_free(prog);
+    }
+
+    printk("BPF JIT: selftest passed, %u programs x %u packets\n", jited,
+           PACKETS);
+}
+
+void bpf_jit_init() {
+    bitmap_init(&bpf_jit_map, bpf_jit_map_buf, sizeof(bpf_jit_map_buf));
+    bpf_jit_enable = bpf_jit_arch_supported() ? 1 : 0;
+
+    const char *cmdline = boot_get_cmdline();
+    if (bpf_jit_enable && cmdline && strstr(cmdline, "bpf_jit_selftest"))
+        bpf_jit_selftest();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <bpf/socket_filter.h>
+#include <mod/dlinker.h>
+
+/*
+ * JIT images live in their own slice of the kernel half, right above the
+ * module area, so a stray jump into either can be told apart in a trace.
+ */
+#define BPF_JIT_SPACE_START KERNEL_MODULES_SPACE_END
+#define BPF_JIT_SPACE_END 0xfffffffff0000000
+#define BPF_JIT_SPACE_PAGES                                                    \
+    ((BPF_JIT_SPACE_END - BPF_JIT_SPACE_START) / PAGE_SIZE)
+
+/* Scratch memory M[] lives on the stack of the generated function. */
+#define BPF_JIT_SCRATCH_SIZE (16 * sizeof(uint32_t))
+
+/*
+ * State shared between the generic driver and an architecture emitter.
+ * The emitter is run twice: once with image == NULL to size every
+ * instruction, then with a buffer to write into. Encodings must only depend
+ * on the program, never on offsets, so both passes agree byte for byte.
+ */
+typedef struct bpf_jit_ctx {
+    const struct sock_filter *insns;
+    uint32_t len;
+    uint32_t *offsets; // offsets[i] = start of insn i, offsets[len] = end
+    uint8_t *image;
+    size_t pos;
+    bool uses_scratch;
+} bpf_jit_ctx_t;
+
+static inline void bpf_jit_emit(bpf_jit_ctx_t *ctx, const void *bytes,
+                                size_t size) {
+    if (ctx->image)
+        memcpy(ctx->image + ctx->pos, bytes, size);
+    ctx->pos += size;
+}
+
+/* Target of a jump taken from insn, skipping 'skip' instructions. */
+static inline uint32_t bpf_jit_target(const bpf_jit_ctx_t *ctx, uint32_t insn,
+                                      uint32_t skip) {
+    return ctx->offsets[insn + 1 + skip];
+}
+
+/*
+ * Emits the whole program into ctx. Returns 0, or a negative errno if the
+ * architecture cannot translate it (the interpreter is used instead).
+ * Weak: architectures without a JIT keep the default, which refuses.
+ */
+int bpf_jit_arch_build(bpf_jit_ctx_t *ctx);
+bool bpf_jit_arch_supported(void);
+
+int bpf_jit_compile(bpf_prog_t *prog);
+void bpf_jit_free(bpf_prog_t *prog);
@@ -1,5 +1,7 @@
 #include <bpf/socket_filter.h>
+#include <bpf/jit.h>
 #include <drivers/logger.h>
+#include <mm/mm.h>
 
 int bpf_validate(const struct sock_filter *prog, int len) {
     if (len < 1) {
@@ -31,8 +33,9 @@ int bpf_validate(const struct sock_filter *prog, int len) {
 
         case BPF_JMP:
             // 检查跳转目标
+            // 64 位计算，避免 ja 的大偏移回绕成合法目标
             if (BPF_OP(code) == BPF_JA) {
-                if (i + 1 + insn->k >= len) {
+                if ((uint64_t)i + 1 + insn->k >= (uint64_t)len) {
                     printk("BPF: invalid jump at %d\n", i);
                     return -1;
                 }
@@ -190,11 +193,11 @@ uint32_t bpf_run(const struct sock_filter *prog, int proglen,
             case BPF_XOR:
                 vm.A ^= src;
                 break;
-            case BPF_LSH:
-                vm.A <<= src;
+            case BPF_LSH: // 与 x86/arm64 硬件一致，只取低 5 位
+                vm.A <<= src & 31;
                 break;
             case BPF_RSH:
-                vm.A >>= src;
+                vm.A >>= src & 31;
                 break;
             case BPF_NEG:
                 vm.A = -vm.A;
@@ -264,3 +267,62 @@ uint32_t bpf_run(const struct sock_filter *prog, int proglen,
 
     return 0; // 异常退出，丢弃
 }
+
+int bpf_prog_create(const struct sock_filter *insns, uint32_t len,
+                    bpf_prog_t **out) {
+    if (!insns || !len || len > BPF_MAXINSNS || !out)
+        return -EINVAL;
+    if (bpf_validate(insns, (int)len) < 0)
+        return -EINVAL;
+
+    bpf_prog_t *prog = calloc(1, sizeof(*prog));
+    if (!prog)
+        return -ENOMEM;
+    prog->insns = malloc(len * sizeof(struct sock_filter));
+    if (!prog->insns) {
+        free(prog);
+        return -ENOMEM;
+    }
+    memcpy(prog->insns, insns, len * sizeof(struct sock_filter));
+    prog->len = len;
+
+    // JIT 失败不影响挂载，解释器兜底
+    bpf_jit_compile(prog);
+
+    *out = prog;
+    return 0;
+}
+
+int bpf_prog_attach_user(const void *optval, size_t optlen, bpf_prog_t **out) {
+    struct sock_fprog fprog;
+    size_t filter_bytes;
+
+    if (!optval || optlen < sizeof(fprog))
+        return -EINVAL;
+    memcpy(&fprog, optval, sizeof(fprog));
+    if (!fprog.len || !fprog.filter || fprog.len > BPF_MAXINSNS)
+        return -EINVAL;
+    if (check_user_array_overflow((uint64_t)fprog.filter, fprog.len,
+                                  sizeof(struct sock_filter), &filter_bytes))
+        return -EFAULT;
+
+    struct sock_filter *insns = malloc(filter_bytes);
+    if (!insns)
+        return -ENOMEM;
+    if (copy_from_user(insns, fprog.filter, filter_bytes)) {
+        free(insns);
+        return -EFAULT;
+    }
+
+    int ret = bpf_prog_create(insns, fprog.len, out);
+    free(insns);
+    return ret;
+}
+
+void bpf_prog_free(bpf_prog_t *prog) {
+    if (!prog)
+        return;
+    bpf_jit_free(prog);
+    free(prog->insns);
+    free(prog);
+}
@@ -12,6 +12,8 @@ struct bpf_vm {
     uint32_t len;        // 数据包长度
 };
 
+#define BPF_MAXINSNS 4096
+
 #define BPF_CLASS(code) ((code) & 0x07)
 #define BPF_LD 0x00
 #define BPF_LDX 0x01
@@ -80,14 +82,14 @@ struct bpf_vm {
  */
 static inline uint32_t bpf_read_word(const uint8_t *data, uint32_t len,
                                      uint32_t offset) {
-    if (offset + 4 > len)
+    if (offset > len || len - offset < 4)
         return 0;
     return ntohl(*(uint32_t *)(data + offset));
 }
 
 static inline uint16_t bpf_read_half(const uint8_t *data, uint32_t len,
                                      uint32_t offset) {
-    if (offset + 2 > len)
+    if (offset > len || len - offset < 2)
         return 0;
     return ntohs(*(uint16_t *)(data + offset));
 }
@@ -102,3 +104,35 @@ static inline uint8_t bpf_read_byte(const uint8_t *data, uint32_t len,
 int bpf_validate(const struct sock_filter *prog, int len);
 uint32_t bpf_run(const struct sock_filter *prog, int proglen,
                  const uint8_t *data, uint32_t datalen);
+
+/* Native entry point produced by the JIT: returns the same value as bpf_run. */
+typedef uint32_t (*bpf_jit_func_t)(const uint8_t *data, uint32_t len);
+
+/*
+ * A validated socket filter as attached to a socket. The instructions are
+ * always kept so the interpreter can run the program when no JIT image
+ * exists for it.
+ */
+typedef struct bpf_prog {
+    uint32_t len;
+    struct sock_filter *insns;
+    bpf_jit_func_t jited;
+    void *image;
+    size_t image_pages;
+} bpf_prog_t;
+
+/* 0: interpret, 1: JIT new filters, 2: JIT and dump the image. */
+extern int bpf_jit_enable;
+
+void bpf_jit_init();
+int bpf_prog_create(const struct sock_filter *insns, uint32_t len,
+                    bpf_prog_t **out);
+int bpf_prog_attach_user(const void *optval, size_t optlen, bpf_prog_t **out);
+void bpf_prog_free(bpf_prog_t *prog);
+
+static inline uint32_t bpf_prog_run(const bpf_prog_t *prog,
+                                    const uint8_t *data, uint32_t len) {
+    if (prog->jited)
+        return prog->jited(data, len);
+    return bpf_run(prog->insns, prog->len, data, len);
+}
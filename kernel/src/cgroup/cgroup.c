@@ -1,6 +1,10 @@
 #include <cgroup/cgroup.h>
+#include <block/blkcg.h>
 #include <fs/vfs/vfs.h>
 #include <libs/string_builder.h>
+#include <mm/memcg.h>
+#include <task/psi.h>
+#include <task/sched.h>
 
 typedef struct cgroup_assignment {
     uint64_t pid;
@@ -24,6 +28,10 @@ struct cgroup {
     char *name;
     uint32_t subtree_control;
     bool frozen;
+    psi_group_t *psi; // unified hierarchy below the root only
+    sched_group_t *sched;
+    mem_cgroup_t *memcg;
+    blkcg_t *blkcg;
     volatile int ref_count;
 };
 
@@ -49,6 +57,11 @@ void cgroup_put(cgroup_t *cgroup) {
         return;
     if (__atomic_sub_fetch(&cgroup->ref_count, 1, __ATOMIC_ACQ_REL) != 0)
         return;
+    psi_group_destroy(cgroup->psi);
+    sched_group_destroy(cgroup->sched);
+    mem_cgroup_destroy(cgroup->memcg);
+    blkcg_destroy(cgroup->blkcg);
+    cgroup_put(cgroup->parent);
     free(cgroup->name);
     free(cgroup);
 }
@@ -150,13 +163,32 @@ cgroup_t *cgroup_create(cgroup_t *parent, const char *name) {
     if (!cgroup)
         return NULL;
 
-    cgroup->parent = parent;
     cgroup->name = name ? strdup(name) : strdup("");
     if (!cgroup->name) {
         free(cgroup);
         return NULL;
     }
 
+    // tasks walk up from their cgroup in the scheduler, keep the chain alive
+    if (parent && cgroup_root_node &&
+        cgroup_is_descendant_of(parent, cgroup_root_node)) {
+        cgroup->psi = psi_group_create();
+        cgroup->sched = sched_group_create(parent->sched);
+        cgroup->memcg = mem_cgroup_create(parent->memcg);
+        cgroup->blkcg = blkcg_create(parent->blkcg);
+        if (!cgroup->psi || !cgroup->sched || !cgroup->memcg ||
+            !cgroup->blkcg) {
+            psi_group_destroy(cgroup->psi);
+            sched_group_destroy(cgroup->sched);
+            mem_cgroup_destroy(cgroup->memcg);
+            blkcg_destroy(cgroup->blkcg);
+            free(cgroup->name);
+            free(cgroup);
+            return NULL;
+        }
+    }
+    cgroup->parent = cgroup_get(parent);
+
     llist_init_head(&cgroup->sibling);
     llist_init_head(&cgroup->children);
     cgroup->ref_count = 1;
@@ -171,6 +203,24 @@ cgroup_t *cgroup_parent(cgroup_t *cgroup) {
     return cgroup ? cgroup->parent : NULL;
 }
 
+psi_group_t *cgroup_psi(cgroup_t *cgroup) {
+    if (cgroup && cgroup == cgroup_root_node)
+        return &psi_system;
+    return cgroup ? cgroup->psi : NULL;
+}
+
+sched_group_t *cgroup_sched(cgroup_t *cgroup) {
+    return cgroup ? cgroup->sched : NULL;
+}
+
+mem_cgroup_t *cgroup_memcg(cgroup_t *cgroup) {
+    return cgroup ? cgroup->memcg : NULL;
+}
+
+blkcg_t *cgroup_blkcg(cgroup_t *cgroup) {
+    return cgroup ? cgroup->blkcg : NULL;
+}
+
 struct llist_header *cgroup_children(cgroup_t *cgroup) {
     return cgroup ? &cgroup->children : NULL;
 }
@@ -252,6 +302,34 @@ cgroup_t *cgroup_task_cgroup(task_t *task) {
     return cgroup;
 }
 
+/* Moves the task's pressure counts and its scheduler entity over. */
+static cgroup_t *cgroup_task_switch_locked(task_t *task, cgroup_t *cgroup) {
+    cgroup_t *old = psi_task_move_cgroup(task, cgroup);
+
+    sched_move_task(task, cgroup_sched(cgroup));
+    return old;
+}
+
+/*
+ * task->cgroup mirrors the unified-hierarchy assignment for the hot paths
+ * (pressure accounting, controllers) that cannot take cgroup_lock and do a
+ * hashmap lookup. It holds a reference while set.
+ */
+static void cgroup_task_set_cached_locked(uint64_t pid, cgroup_t *cgroup) {
+    task_t *task = task_find_by_pid(pid);
+    cgroup_t *old;
+
+    if (!task)
+        return;
+    if (cgroup == cgroup_root_node)
+        cgroup = NULL;
+    if (task->cgroup == cgroup)
+        return;
+
+    old = cgroup_task_switch_locked(task, cgroup_get(cgroup));
+    cgroup_put(old);
+}
+
 int cgroup_attach_task_pid_locked(uint64_t pid, cgroup_t *cgroup) {
     cgroup_hierarchy_t *hierarchy = cgroup_unified_hierarchy;
     cgroup_hierarchy_t *pos, *tmp;
@@ -271,11 +349,15 @@ int cgroup_attach_task_pid_locked(uint64_t pid, cgroup_t *cgroup) {
             return 0;
         hashmap_remove(&hierarchy->assignments, pid);
         free(entry);
+        if (hierarchy == cgroup_unified_hierarchy)
+            cgroup_task_set_cached_locked(pid, NULL);
         return 0;
     }
 
     if (entry) {
         entry->cgroup = cgroup;
+        if (hierarchy == cgroup_unified_hierarchy)
+            cgroup_task_set_cached_locked(pid, cgroup);
         return 0;
     }
 
@@ -289,6 +371,8 @@ int cgroup_attach_task_pid_locked(uint64_t pid, cgroup_t *cgroup) {
         free(entry);
         return -ENOMEM;
     }
+    if (hierarchy == cgroup_unified_hierarchy)
+        cgroup_task_set_cached_locked(pid, cgroup);
     return 0;
 }
 
@@ -325,6 +409,7 @@ void cgroup_on_exit_task(task_t *task) {
         if (entry)
             free(entry);
     }
+    cgroup_put(cgroup_task_switch_locked(task, NULL));
     cgroup_unlock();
 }
 
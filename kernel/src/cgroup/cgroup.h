@@ -6,6 +6,10 @@
 
 typedef struct cgroup cgroup_t;
 typedef struct cgroup_hierarchy cgroup_hierarchy_t;
+typedef struct psi_group psi_group_t;
+typedef struct sched_group sched_group_t;
+typedef struct mem_cgroup mem_cgroup_t;
+typedef struct blkcg blkcg_t;
 
 void cgroup_init(void);
 cgroup_hierarchy_t *cgroup_register_hierarchy(const char *controllers,
@@ -19,6 +23,10 @@ void cgroup_put(cgroup_t *cgroup);
 
 const char *cgroup_name(cgroup_t *cgroup);
 cgroup_t *cgroup_parent(cgroup_t *cgroup);
+psi_group_t *cgroup_psi(cgroup_t *cgroup);
+sched_group_t *cgroup_sched(cgroup_t *cgroup);
+mem_cgroup_t *cgroup_memcg(cgroup_t *cgroup);
+blkcg_t *cgroup_blkcg(cgroup_t *cgroup);
 struct llist_header *cgroup_children(cgroup_t *cgroup);
 struct llist_header *cgroup_sibling_node(cgroup_t *cgroup);
 bool cgroup_is_descendant_of(cgroup_t *cgroup, cgroup_t *ancestor);
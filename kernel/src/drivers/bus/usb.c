@@ -6,6 +6,7 @@
 #include <drivers/bus/usb.h>
 #include <mm/mm.h>
 #include <task/task.h>
+#include <task/workqueue.h>
 
 attribute_t usb_bus_subsystem_attr = {
     .name = "SUBSYSTEM",
@@ -63,7 +64,8 @@ static struct llist_header usb_hub_list = {
     .next = &usb_hub_list,
 };
 static spinlock_t usb_hub_list_lock = SPIN_INIT;
-static task_t *usb_hotplug_task;
+static work_struct_t usb_hotplug_work;
+static bool usb_hotplug_ready;
 static spinlock_t usb_hotplug_lock = SPIN_INIT;
 static uint8_t usb_next_busnum = 1;
 
@@ -1043,11 +1045,11 @@ static inline void usb_notify_device_remove(usb_device_t *usbdev) {
 
 static void usb_hotplug_wake(void) {
     spin_lock(&usb_hotplug_lock);
-    task_t *task = usb_hotplug_task;
+    bool ready = usb_hotplug_ready;
     spin_unlock(&usb_hotplug_lock);
 
-    if (task)
-        task_unblock(task, EOK);
+    if (ready)
+        queue_work(system_unbound_wq, &usb_hotplug_work);
 }
 
 static usb_pipe_t *
@@ -1986,12 +1988,10 @@ static void usb_scan_hub(usb_hub_t *hub) {
     hub->enumerating = false;
 }
 
-static void usb_hotplug_thread(uint64_t arg) {
-    (void)arg;
+static void usb_hotplug_work_fn(work_struct_t *work) {
+    (void)work;
 
     for (;;) {
-        arch_enable_interrupt();
-
         usb_hub_t *snapshot[USB_HUB_SNAPSHOT_MAX];
         uint32_t snapshot_count = 0;
 
@@ -2016,34 +2016,19 @@ static void usb_hotplug_thread(uint64_t arg) {
             usb_hub_put(snapshot[i]);
         }
 
-        if (snapshot_count == USB_HUB_SNAPSHOT_MAX)
-            continue;
-
-        task_prepare_block(current_task);
-        bool have_pending = false;
-        spin_lock(&usb_hub_list_lock);
-        for (struct llist_header *node = usb_hub_list.next;
-             node != &usb_hub_list; node = node->next) {
-            usb_hub_t *hub = container_of(node, usb_hub_t, node);
-            if (!hub->removing && hub->needs_rescan) {
-                have_pending = true;
-                break;
-            }
-        }
-        spin_unlock(&usb_hub_list_lock);
-
-        if (have_pending)
-            task_cancel_block_prepare(current_task);
-        else
-            task_block(current_task, TASK_BLOCKING, -1, "usb_hotplug");
+        /* Hubs marked while scanning requeue this work themselves; only a
+         * truncated snapshot needs another pass here. */
+        if (snapshot_count < USB_HUB_SNAPSHOT_MAX)
+            break;
     }
 }
 
 static void usb_hotplug_start(void) {
     spin_lock(&usb_hotplug_lock);
-    if (!usb_hotplug_task)
-        usb_hotplug_task =
-            task_create("usb_hotplug", usb_hotplug_thread, 0, KTHREAD_PRIORITY);
+    if (!usb_hotplug_ready) {
+        INIT_WORK(&usb_hotplug_work, usb_hotplug_work_fn);
+        usb_hotplug_ready = true;
+    }
     spin_unlock(&usb_hotplug_lock);
 }
 
@@ -10,6 +10,7 @@ typedef enum deadline_source_type {
     DEADLINE_SOURCE_TIMERFD_MONO = 3,
     DEADLINE_SOURCE_TIMERFD_REAL = 4,
     DEADLINE_SOURCE_SCHED_WATCHDOG = 5,
+    DEADLINE_SOURCE_PERF = 6,
 } deadline_source_type_t;
 
 typedef struct deadline_source {
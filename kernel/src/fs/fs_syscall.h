@@ -610,7 +610,8 @@ uint64_t sys_read(uint64_t fd, void *buf, uint64_t len);
 uint64_t sys_write(uint64_t fd, const void *buf, uint64_t len);
 /**
  * Linux contract: splice data from an input file into an output file.
- * Current kernel: emulates sendfile(2) with buffered VFS read/write calls.
+ * Current kernel: page-cache-backed input going to a pipe or socket is
+ * passed by page reference; anything else goes through a bounce buffer.
  */
 uint64_t sys_sendfile(uint64_t out_fd, uint64_t in_fd, int *offset_ptr,
                       size_t count);
@@ -2,6 +2,8 @@
 #include <task/task.h>
 #include <task/signal.h>
 #include <fs/pipe.h>
+#include <mm/cache.h>
+#include <net/socket.h>
 #include <fs/vfs/vfs.h>
 #include <init/callbacks.h>
 #include <mm/mm.h>
@@ -1119,13 +1121,22 @@ ssize_t pipefs_splice_to(struct vfs_file *in, struct vfs_file *out,
             spin_unlock(&pipe->lock);
             return moved_total ? (ssize_t)moved_total : -EFAULT;
         }
-        local.page_ref = true;
         spin_unlock(&pipe->lock);
 
-        wr = vfs_write_kernel_file(
-            out,
-            (const void *)((uintptr_t)phys_to_virt(local.phys) + local.offset),
-            chunk, NULL);
+        /*
+         * Referenced pages (page cache, vmsplice) can be handed to a socket
+         * as they are. Pages the pipe owns go back to its page cache once
+         * consumed and get rewritten, so those are copied.
+         */
+        if (local.page_ref && S_ISSOCK(out->f_inode->i_mode))
+            wr = sockfs_sendpage(out, local.phys, local.offset, chunk,
+                                 nonblock ? MSG_DONTWAIT : 0);
+        else
+            wr = vfs_write_kernel_file(
+                out,
+                (const void *)((uintptr_t)phys_to_virt(local.phys) +
+                               local.offset),
+                chunk, NULL);
         address_release(local.phys);
         if (wr <= 0) {
             if (wr < 0)
@@ -1240,6 +1251,96 @@ ssize_t pipefs_splice_from_user(struct vfs_file *file, const struct iovec *iov,
     return (ssize_t)done;
 }
 
+typedef struct pipefs_page_cache_splice {
+    struct vfs_file *file;
+    pipe_info_t *pipe;
+    int err;
+    bool full;
+} pipefs_page_cache_splice_t;
+
+static ssize_t pipefs_page_cache_actor(void *data, uint64_t paddr,
+                                       size_t offset, size_t len) {
+    pipefs_page_cache_splice_t *ctx = data;
+    pipe_info_t *pipe = ctx->pipe;
+    vfs_node_t *read_node = NULL;
+    bool was_empty;
+    ssize_t ret;
+
+    spin_lock(&pipe->lock);
+    if (pipe->read_fds == 0) {
+        spin_unlock(&pipe->lock);
+        ctx->err = -EPIPE;
+        return 0;
+    }
+    if (pipe->ptr >= PIPE_BUFF || pipe->nr_buffers >= PIPE_MAX_BUFFERS) {
+        spin_unlock(&pipe->lock);
+        ctx->full = true;
+        return 0;
+    }
+
+    len = MIN(len, (size_t)PIPE_BUFF - pipe->ptr);
+    was_empty = pipe->ptr == 0;
+    if (!address_ref(paddr)) {
+        spin_unlock(&pipe->lock);
+        return -EFAULT;
+    }
+    ret = pipefs_append_page_locked(pipe, paddr, offset, len, true);
+    if (ret <= 0) {
+        address_release(paddr);
+        spin_unlock(&pipe->lock);
+        if (ret == 0)
+            ctx->full = true;
+        return ret;
+    }
+    pipefs_update_size_locked(pipe, ctx->file);
+    if (was_empty && pipe->read_node)
+        read_node = vfs_igrab(pipe->read_node);
+    spin_unlock(&pipe->lock);
+
+    if (read_node) {
+        pipefs_notify_node(read_node, EPOLLIN | EPOLLRDNORM);
+        vfs_iput(read_node);
+    }
+    return ret;
+}
+
+/*
+ * splice() from a cached file into a pipe: every pipe buffer references the
+ * page cache frame, nothing is copied until the pipe is read. *ppos is the
+ * file position and is advanced by what was queued.
+ */
+ssize_t pipefs_splice_from_page_cache(struct vfs_file *in, loff_t *ppos,
+                                      struct vfs_file *out, size_t count,
+                                      bool nonblock) {
+    pipe_specific_t *spec = pipefs_spec_from_file(out);
+    pipefs_page_cache_splice_t ctx = {.file = out};
+
+    if (!spec || !spec->write || !spec->info)
+        return -EBADF;
+    ctx.pipe = spec->info;
+
+    while (true) {
+        ssize_t ret;
+
+        ctx.err = 0;
+        ctx.full = false;
+        ret = page_cache_splice_read(in, ppos, count,
+                                     pipefs_page_cache_actor, &ctx);
+        if (ret != 0)
+            return ret;
+        if (ctx.err == -EPIPE) {
+            task_commit_signal(current_task, SIGPIPE, NULL);
+            return -EPIPE;
+        }
+        if (!ctx.full)
+            return 0;
+
+        ret = pipefs_wait_writable(out, nonblock);
+        if (ret < 0)
+            return ret;
+    }
+}
+
 uint64_t sys_pipe(int pipefd[2], uint64_t flags) {
     struct vfs_file *read_file = NULL;
     struct vfs_file *write_file = NULL;
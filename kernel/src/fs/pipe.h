@@ -65,3 +65,6 @@ ssize_t pipefs_splice_to(struct vfs_file *in, struct vfs_file *out,
                          size_t count, bool nonblock);
 ssize_t pipefs_splice_from_user(struct vfs_file *file, const struct iovec *iov,
                                 size_t nr_segs, size_t count, bool nonblock);
+ssize_t pipefs_splice_from_page_cache(struct vfs_file *in, loff_t *ppos,
+                                      struct vfs_file *out, size_t count,
+                                      bool nonblock);
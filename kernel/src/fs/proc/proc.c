@@ -1,4 +1,6 @@
 #include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <task/psi.h>
 #include <arch/arch.h>
 #include <boot/boot.h>
 #include <init/callbacks.h>
@@ -12,6 +14,8 @@ typedef enum procfs_inode_kind {
     PROCFS_INO_SYS_KERNEL_DIR,
     PROCFS_INO_SYS_KERNEL_RANDOM_DIR,
     PROCFS_INO_SYS_FS_DIR,
+    PROCFS_INO_SYS_NET_DIR,
+    PROCFS_INO_SYS_NET_CORE_DIR,
     PROCFS_INO_SYSVIPC_DIR,
     PROCFS_INO_PRESSURE_DIR,
     PROCFS_INO_TASK_DIR,
@@ -40,9 +44,11 @@ typedef struct procfs_inode_info {
     bool mount_watch_registered;
 } procfs_inode_info_t;
 
-typedef struct procfs_mount_watch_state {
-    uint64_t seen_seq;
-} procfs_mount_watch_state_t;
+typedef struct procfs_file_state {
+    uint64_t seen_seq;          // mount table generation last reported by poll
+    seq_file_t *seq;            // set for files generated through seq_ops
+    psi_trigger_t *psi_trigger; // written to a /proc/pressure file
+} procfs_file_state_t;
 
 typedef struct procfs_task_snapshot {
     uint64_t pid;
@@ -644,6 +650,8 @@ static char *procfs_fd_target_path(task_t *task, fd_t *fd) {
         snprintf(buf, sizeof(buf), "anon_inode:[timerfd]");
     } else if (fs_name && !strcmp(fs_name, "pidfdfs")) {
         snprintf(buf, sizeof(buf), "anon_inode:[pidfd]");
+    } else if (fs_name && !strcmp(fs_name, "perfeventfs")) {
+        snprintf(buf, sizeof(buf), "anon_inode:[perf_event]");
     } else if (fs_name && !strcmp(fs_name, "memfdfs")) {
         snprintf(buf, sizeof(buf), "memfd:[%llu]",
                  (unsigned long long)fd->f_inode->i_ino);
@@ -963,11 +971,19 @@ static ssize_t procfs_read(struct vfs_file *file, void *addr, size_t count,
     if (!procfs_task_inode_is_valid(info))
         return -ENOENT;
 
+    procfs_file_state_t *state = file->private_data;
+    ssize_t ret;
+    if (state && state->seq) {
+        ret = seq_read(state->seq, addr, count, *ppos);
+        if (ret > 0)
+            *ppos += (loff_t)ret;
+        return ret;
+    }
+
     procfs_fill_handle(&handle, file->f_inode);
     if (!handle.name[0])
         return -EINVAL;
-    ssize_t ret =
-        (ssize_t)procfs_read_dispatch(&handle, addr, (size_t)*ppos, count);
+    ret = (ssize_t)procfs_read_dispatch(&handle, addr, (size_t)*ppos, count);
     if (ret > 0)
         *ppos += (loff_t)ret;
     return ret;
@@ -987,6 +1003,20 @@ static ssize_t procfs_write(struct vfs_file *file, const void *addr,
     if (!handle.name[0])
         return -EINVAL;
 
+    int res = procfs_pressure_resource(handle.name);
+    if (res >= 0) {
+        procfs_file_state_t *state = file->private_data;
+        int err;
+
+        if (!state)
+            return -EINVAL;
+        if (state->psi_trigger)
+            return -EBUSY;
+        err = psi_trigger_create(&psi_system, (psi_res_t)res, addr, count,
+                                 file->f_inode, &state->psi_trigger);
+        return err < 0 ? err : (ssize_t)count;
+    }
+
     ssize_t ret = procfs_write_dispatch(&handle, addr, (size_t)*ppos, count);
     if (ret > 0)
         *ppos += (loff_t)ret;
@@ -1015,6 +1045,8 @@ static int procfs_iterate_task_entries(struct vfs_dir_context *ctx, loff_t *idx,
         {"cmdline", DT_REG, PROCFS_INO_FILE, "proc_cmdline"},
         {"environ", DT_REG, PROCFS_INO_FILE, "proc_environ"},
         {"maps", DT_REG, PROCFS_INO_FILE, "proc_maps"},
+        {"smaps", DT_REG, PROCFS_INO_FILE, "proc_smaps"},
+        {"smaps_rollup", DT_REG, PROCFS_INO_FILE, "proc_smaps_rollup"},
         {"root", DT_LNK, PROCFS_INO_SYMLINK, "proc_root"},
         {"stat", DT_REG, PROCFS_INO_FILE, "proc_stat"},
         {"statm", DT_REG, PROCFS_INO_FILE, "proc_statm"},
@@ -1025,6 +1057,9 @@ static int procfs_iterate_task_entries(struct vfs_dir_context *ctx, loff_t *idx,
         {"gid_map", DT_REG, PROCFS_INO_FILE, "proc_gid_map"},
         {"setgroups", DT_REG, PROCFS_INO_FILE, "proc_setgroups"},
         {"oom_score_adj", DT_REG, PROCFS_INO_FILE, "proc_oom_score_adj"},
+        {"syscall_stats", DT_REG, PROCFS_INO_FILE, "proc_syscall_stats"},
+        {"io", DT_REG, PROCFS_INO_FILE, "proc_io"},
+        {"schedstat", DT_REG, PROCFS_INO_FILE, "proc_schedstat"},
         {"exe", DT_LNK, PROCFS_INO_SYMLINK, "proc_exe"},
         {"ns", DT_DIR, PROCFS_INO_NS_DIR, NULL},
         {"fd", DT_DIR, PROCFS_INO_FD_DIR, NULL},
@@ -1084,6 +1119,33 @@ static int procfs_iterate_shared(struct vfs_file *file,
             procfs_emit_entry(
                 ctx, &index, "stat", DT_REG,
                 procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "stat")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "workqueues", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "workqueues")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "kallsyms", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "kallsyms")) != 0 ||
+            procfs_emit_entry(ctx, &index, "syscall_stats", DT_REG,
+                              procfs_ino_for(PROCFS_INO_FILE, NULL, -1,
+                                             "syscall_stats")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "vmstat", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "vmstat")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "buddyinfo", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "buddyinfo")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "diskstats", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "diskstats")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "interrupts", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "interrupts")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "softirqs", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "softirqs")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "schedstat", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "schedstat")) != 0 ||
             procfs_emit_entry(
                 ctx, &index, "sys", DT_DIR,
                 procfs_ino_for(PROCFS_INO_SYS_DIR, NULL, -1, "sys")) != 0 ||
@@ -1123,7 +1185,10 @@ static int procfs_iterate_shared(struct vfs_file *file,
                                              -1, "kernel")) != 0 ||
             procfs_emit_entry(
                 ctx, &index, "fs", DT_DIR,
-                procfs_ino_for(PROCFS_INO_SYS_FS_DIR, NULL, -1, "fs")) != 0) {
+                procfs_ino_for(PROCFS_INO_SYS_FS_DIR, NULL, -1, "fs")) != 0 ||
+            procfs_emit_entry(
+                ctx, &index, "net", DT_DIR,
+                procfs_ino_for(PROCFS_INO_SYS_NET_DIR, NULL, -1, "net")) != 0) {
             break;
         }
         break;
@@ -1159,7 +1224,11 @@ static int procfs_iterate_shared(struct vfs_file *file,
             procfs_emit_entry(ctx, &index, "threads-max", DT_REG,
                               procfs_ino_for(PROCFS_INO_FILE, NULL, -1,
                                              "proc_sys_kernel_threads_max")) !=
-                0) {
+                0 ||
+            procfs_emit_entry(
+                ctx, &index, "syscall_stats", DT_REG,
+                procfs_ino_for(PROCFS_INO_FILE, NULL, -1,
+                               "proc_sys_kernel_syscall_stats")) != 0) {
             break;
         }
         break;
@@ -1175,12 +1244,28 @@ static int procfs_iterate_shared(struct vfs_file *file,
             ctx, &index, "nr_open", DT_REG,
             procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "proc_sys_fs_nr_open"));
         break;
+    case PROCFS_INO_SYS_NET_DIR:
+        procfs_emit_entry(
+            ctx, &index, "core", DT_DIR,
+            procfs_ino_for(PROCFS_INO_SYS_NET_CORE_DIR, NULL, -1, "core"));
+        break;
+    case PROCFS_INO_SYS_NET_CORE_DIR:
+        procfs_emit_entry(ctx, &index, "bpf_jit_enable", DT_REG,
+                          procfs_ino_for(PROCFS_INO_FILE, NULL, -1,
+                                         "proc_sys_net_core_bpf_jit_enable"));
+        break;
     case PROCFS_INO_SYSVIPC_DIR:
         procfs_emit_entry(
             ctx, &index, "shm", DT_REG,
             procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "proc_sysvipc_shm"));
         break;
     case PROCFS_INO_PRESSURE_DIR:
+        procfs_emit_entry(
+            ctx, &index, "cpu", DT_REG,
+            procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "proc_pressure_cpu"));
+        procfs_emit_entry(
+            ctx, &index, "io", DT_REG,
+            procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "proc_pressure_io"));
         procfs_emit_entry(
             ctx, &index, "memory", DT_REG,
             procfs_ino_for(PROCFS_INO_FILE, NULL, -1, "proc_pressure_memory"));
@@ -1280,24 +1365,49 @@ static int procfs_open_file(struct vfs_inode *inode, struct vfs_file *file) {
     file->f_op = inode->i_fop;
 
     info = procfs_i(inode);
-    if (info && procfs_dispatch_is_mount_watch(info->dispatch_name)) {
-        procfs_mount_watch_state_t *state = calloc(1, sizeof(*state));
+    if (!info || !info->dispatch_name)
+        return 0;
 
-        if (!state)
-            return -ENOMEM;
+    const struct seq_ops *seq_ops = procfs_seq_ops_dispatch(info->dispatch_name);
+    bool mount_watch = procfs_dispatch_is_mount_watch(info->dispatch_name);
+    if (!seq_ops && !mount_watch)
+        return 0;
 
-        state->seen_seq = vfs_mount_seq_read();
-        file->private_data = state;
+    procfs_file_state_t *state = calloc(1, sizeof(*state));
+    if (!state)
+        return -ENOMEM;
+
+    if (seq_ops) {
+        proc_handle_t handle;
+
+        procfs_fill_handle(&handle, inode);
+        state->seq = seq_open(seq_ops, &handle);
+        if (!state->seq) {
+            free(state);
+            return -ENOMEM;
+        }
     }
+    if (mount_watch)
+        state->seen_seq = vfs_mount_seq_read();
+    file->private_data = state;
 
     return 0;
 }
 
 static int procfs_release_file(struct vfs_inode *inode, struct vfs_file *file) {
+    procfs_file_state_t *state;
+
     (void)inode;
-    free(file ? file->private_data : NULL);
-    if (file)
-        file->private_data = NULL;
+    if (!file)
+        return 0;
+
+    state = file->private_data;
+    if (state) {
+        psi_trigger_destroy(state->psi_trigger);
+        seq_release(state->seq);
+        free(state);
+    }
+    file->private_data = NULL;
     return 0;
 }
 
@@ -1314,8 +1424,7 @@ static __poll_t procfs_poll_file(struct vfs_file *file,
     if (!procfs_task_inode_is_valid(info))
         return EPOLLERR;
     if (procfs_dispatch_is_mount_watch(info->dispatch_name)) {
-        procfs_mount_watch_state_t *state =
-            (procfs_mount_watch_state_t *)file->private_data;
+        procfs_file_state_t *state = (procfs_file_state_t *)file->private_data;
         uint64_t seq = vfs_mount_seq_read();
 
         if (!state)
@@ -1326,6 +1435,12 @@ static __poll_t procfs_poll_file(struct vfs_file *file,
         state->seen_seq = seq;
         return EPOLLPRI;
     }
+    if (procfs_pressure_resource(info->dispatch_name) >= 0) {
+        procfs_file_state_t *state = (procfs_file_state_t *)file->private_data;
+
+        return state ? (__poll_t)psi_trigger_poll(state->psi_trigger)
+                     : EPOLLERR;
+    }
 
     procfs_fill_handle(&handle, file->f_inode);
     return (__poll_t)procfs_poll_dispatch(&handle, file->f_inode,
@@ -1346,6 +1461,12 @@ static vfs_node_t *procfs_make_task_child(struct vfs_super_block *sb,
     if (!strcmp(name, "maps"))
         return procfs_new_inode(sb, S_IFREG | 0444, PROCFS_INO_FILE, task, -1,
                                 "proc_maps");
+    if (!strcmp(name, "smaps"))
+        return procfs_new_inode(sb, S_IFREG | 0444, PROCFS_INO_FILE, task, -1,
+                                "proc_smaps");
+    if (!strcmp(name, "smaps_rollup"))
+        return procfs_new_inode(sb, S_IFREG | 0444, PROCFS_INO_FILE, task, -1,
+                                "proc_smaps_rollup");
     if (!strcmp(name, "root"))
         return procfs_new_inode(sb, S_IFLNK | 0777, PROCFS_INO_SYMLINK, task,
                                 -1, "proc_root");
@@ -1379,6 +1500,15 @@ static vfs_node_t *procfs_make_task_child(struct vfs_super_block *sb,
     if (!strcmp(name, "oom_score_adj"))
         return procfs_new_inode(sb, S_IFREG | 0644, PROCFS_INO_FILE, task, -1,
                                 "proc_oom_score_adj");
+    if (!strcmp(name, "syscall_stats"))
+        return procfs_new_inode(sb, S_IFREG | 0444, PROCFS_INO_FILE, task, -1,
+                                "proc_syscall_stats");
+    if (!strcmp(name, "io"))
+        return procfs_new_inode(sb, S_IFREG | 0444, PROCFS_INO_FILE, task, -1,
+                                "proc_io");
+    if (!strcmp(name, "schedstat"))
+        return procfs_new_inode(sb, S_IFREG | 0444, PROCFS_INO_FILE, task, -1,
+                                "proc_schedstat");
     if (!strcmp(name, "exe"))
         return procfs_new_inode(sb, S_IFLNK | 0777, PROCFS_INO_SYMLINK, task,
                                 -1, "proc_exe");
@@ -1437,6 +1567,33 @@ static struct vfs_dentry *procfs_lookup(struct vfs_inode *dir,
         } else if (!strcmp(dentry->d_name.name, "stat")) {
             inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
                                      NULL, -1, "stat");
+        } else if (!strcmp(dentry->d_name.name, "workqueues")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "workqueues");
+        } else if (!strcmp(dentry->d_name.name, "kallsyms")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "kallsyms");
+        } else if (!strcmp(dentry->d_name.name, "syscall_stats")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "syscall_stats");
+        } else if (!strcmp(dentry->d_name.name, "vmstat")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "vmstat");
+        } else if (!strcmp(dentry->d_name.name, "buddyinfo")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "buddyinfo");
+        } else if (!strcmp(dentry->d_name.name, "diskstats")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "diskstats");
+        } else if (!strcmp(dentry->d_name.name, "interrupts")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "interrupts");
+        } else if (!strcmp(dentry->d_name.name, "softirqs")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "softirqs");
+        } else if (!strcmp(dentry->d_name.name, "schedstat")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+                                     NULL, -1, "schedstat");
         } else if (!strcmp(dentry->d_name.name, "sys")) {
             inode = procfs_new_inode(dir->i_sb, S_IFDIR | 0555,
                                      PROCFS_INO_SYS_DIR, NULL, -1, NULL);
@@ -1471,6 +1628,9 @@ static struct vfs_dentry *procfs_lookup(struct vfs_inode *dir,
         } else if (!strcmp(dentry->d_name.name, "fs")) {
             inode = procfs_new_inode(dir->i_sb, S_IFDIR | 0555,
                                      PROCFS_INO_SYS_FS_DIR, NULL, -1, NULL);
+        } else if (!strcmp(dentry->d_name.name, "net")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFDIR | 0555,
+                                     PROCFS_INO_SYS_NET_DIR, NULL, -1, NULL);
         }
         break;
     case PROCFS_INO_SYS_KERNEL_DIR:
@@ -1502,6 +1662,9 @@ static struct vfs_dentry *procfs_lookup(struct vfs_inode *dir,
         } else if (!strcmp(dentry->d_name.name, "threads-max")) {
             inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
                                      NULL, -1, "proc_sys_kernel_threads_max");
+        } else if (!strcmp(dentry->d_name.name, "syscall_stats")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0644, PROCFS_INO_FILE,
+                                     NULL, -1, "proc_sys_kernel_syscall_stats");
         }
         break;
     case PROCFS_INO_SYS_KERNEL_RANDOM_DIR:
@@ -1516,6 +1679,20 @@ static struct vfs_dentry *procfs_lookup(struct vfs_inode *dir,
                                      NULL, -1, "proc_sys_fs_nr_open");
         }
         break;
+    case PROCFS_INO_SYS_NET_DIR:
+        if (!strcmp(dentry->d_name.name, "core")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFDIR | 0555,
+                                     PROCFS_INO_SYS_NET_CORE_DIR, NULL, -1,
+                                     NULL);
+        }
+        break;
+    case PROCFS_INO_SYS_NET_CORE_DIR:
+        if (!strcmp(dentry->d_name.name, "bpf_jit_enable")) {
+            inode =
+                procfs_new_inode(dir->i_sb, S_IFREG | 0644, PROCFS_INO_FILE,
+                                 NULL, -1, "proc_sys_net_core_bpf_jit_enable");
+        }
+        break;
     case PROCFS_INO_SYSVIPC_DIR:
         if (!strcmp(dentry->d_name.name, "shm")) {
             inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
@@ -1523,8 +1700,14 @@ static struct vfs_dentry *procfs_lookup(struct vfs_inode *dir,
         }
         break;
     case PROCFS_INO_PRESSURE_DIR:
-        if (!strcmp(dentry->d_name.name, "memory")) {
-            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0444, PROCFS_INO_FILE,
+        if (!strcmp(dentry->d_name.name, "cpu")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0644, PROCFS_INO_FILE,
+                                     NULL, -1, "proc_pressure_cpu");
+        } else if (!strcmp(dentry->d_name.name, "io")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0644, PROCFS_INO_FILE,
+                                     NULL, -1, "proc_pressure_io");
+        } else if (!strcmp(dentry->d_name.name, "memory")) {
+            inode = procfs_new_inode(dir->i_sb, S_IFREG | 0644, PROCFS_INO_FILE,
                                      NULL, -1, "proc_pressure_memory");
         }
         break;
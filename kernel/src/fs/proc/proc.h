@@ -10,6 +10,7 @@ struct task;
 typedef struct task task_t;
 
 typedef struct proc_handle proc_handle_t;
+struct seq_ops;
 
 typedef size_t (*stat_entry_t)(proc_handle_t *handle);
 typedef int (*poll_entry_t)(proc_handle_t *handle, int events);
@@ -62,6 +63,7 @@ typedef struct proc_handle_node {
     stat_entry_t stat_entry;
     readlink_entry_t readlink_entry;
     poll_entry_t poll_entry;
+    const struct seq_ops *seq_ops; // read through seq_read() when set
 } proc_handle_node_t;
 
 typedef struct procfs_self_handle {
@@ -75,6 +77,7 @@ void procfs_stat_dispatch(proc_handle_t *handle, vfs_node_t *node);
 int procfs_poll_dispatch(proc_handle_t *handle, vfs_node_t *node, int events);
 size_t procfs_read_dispatch(proc_handle_t *handle, void *addr, size_t offset,
                             size_t size);
+const struct seq_ops *procfs_seq_ops_dispatch(const char *name);
 ssize_t procfs_write_dispatch(proc_handle_t *handle, const void *addr,
                               size_t offset, size_t size);
 ssize_t procfs_readlink_dispatch(proc_handle_t *handle, void *addr,
@@ -91,8 +94,7 @@ size_t proc_cmdline_stat(proc_handle_t *handle);
 size_t proc_cmdline_read(proc_handle_t *handle, void *addr, size_t offset,
                          size_t size);
 size_t proc_mounts_stat(proc_handle_t *handle);
-size_t proc_mounts_read(proc_handle_t *handle, void *addr, size_t offset,
-                        size_t size);
+extern const struct seq_ops proc_mounts_seq_ops;
 size_t proc_pcmdline_stat(proc_handle_t *handle);
 size_t proc_pcmdline_read(proc_handle_t *handle, void *addr, size_t offset,
                           size_t size);
@@ -100,26 +102,37 @@ size_t proc_penviron_stat(proc_handle_t *handle);
 size_t proc_penviron_read(proc_handle_t *handle, void *addr, size_t offset,
                           size_t size);
 size_t proc_pmaps_stat(proc_handle_t *handle);
-size_t proc_pmaps_read(proc_handle_t *handle, void *addr, size_t offset,
-                       size_t size);
+extern const struct seq_ops proc_pmaps_seq_ops;
+extern const struct seq_ops proc_psmaps_seq_ops;
+extern const struct seq_ops proc_psmaps_rollup_seq_ops;
 size_t proc_pstat_stat(proc_handle_t *handle);
-size_t proc_pstat_read(proc_handle_t *handle, void *addr, size_t offset,
-                       size_t size);
+extern const struct seq_ops proc_pstat_seq_ops;
 size_t proc_pstatm_stat(proc_handle_t *handle);
 size_t proc_pstatm_read(proc_handle_t *handle, void *addr, size_t offset,
                         size_t size);
 size_t proc_pstatus_stat(proc_handle_t *handle);
-size_t proc_pstatus_read(proc_handle_t *handle, void *addr, size_t offset,
-                         size_t size);
+extern const struct seq_ops proc_pstatus_seq_ops;
 size_t proc_pcgroup_stat(proc_handle_t *handle);
-size_t proc_pcgroup_read(proc_handle_t *handle, void *addr, size_t offset,
-                         size_t size);
+extern const struct seq_ops proc_pcgroup_seq_ops;
 size_t proc_meminfo_stat(proc_handle_t *handle);
 size_t proc_meminfo_read(proc_handle_t *handle, void *addr, size_t offset,
                          size_t size);
 size_t proc_stat_stat(proc_handle_t *handle);
-size_t proc_stat_read(proc_handle_t *handle, void *addr, size_t offset,
-                      size_t size);
+extern const struct seq_ops proc_stat_seq_ops;
+extern const struct seq_ops proc_kallsyms_seq_ops;
+extern const struct seq_ops proc_syscall_stats_seq_ops;
+extern const struct seq_ops proc_psyscall_stats_seq_ops;
+extern const struct seq_ops proc_vmstat_seq_ops;
+extern const struct seq_ops proc_buddyinfo_seq_ops;
+extern const struct seq_ops proc_diskstats_seq_ops;
+extern const struct seq_ops proc_interrupts_seq_ops;
+extern const struct seq_ops proc_softirqs_seq_ops;
+extern const struct seq_ops proc_schedstat_seq_ops;
+extern const struct seq_ops proc_pio_seq_ops;
+extern const struct seq_ops proc_pschedstat_seq_ops;
+size_t proc_workqueues_stat(proc_handle_t *handle);
+size_t proc_workqueues_read(proc_handle_t *handle, void *addr, size_t offset,
+                            size_t size);
 size_t proc_sys_kernel_osrelease_stat(proc_handle_t *handle);
 size_t proc_sys_kernel_osrelease_read(proc_handle_t *handle, void *addr,
                                       size_t offset, size_t size);
@@ -152,12 +165,28 @@ size_t proc_sys_kernel_domainname_read(proc_handle_t *handle, void *addr,
 ssize_t proc_sys_kernel_domainname_write(proc_handle_t *handle,
                                          const void *addr, size_t offset,
                                          size_t size);
+size_t proc_sys_kernel_syscall_stats_stat(proc_handle_t *handle);
+size_t proc_sys_kernel_syscall_stats_read(proc_handle_t *handle, void *addr,
+                                          size_t offset, size_t size);
+ssize_t proc_sys_kernel_syscall_stats_write(proc_handle_t *handle,
+                                            const void *addr, size_t offset,
+                                            size_t size);
 size_t proc_sys_fs_nr_open_stat(proc_handle_t *handle);
 size_t proc_sys_fs_nr_open_read(proc_handle_t *handle, void *addr,
                                 size_t offset, size_t size);
+size_t proc_sys_net_core_bpf_jit_enable_stat(proc_handle_t *handle);
+size_t proc_sys_net_core_bpf_jit_enable_read(proc_handle_t *handle, void *addr,
+                                             size_t offset, size_t size);
+ssize_t proc_sys_net_core_bpf_jit_enable_write(proc_handle_t *handle,
+                                               const void *addr, size_t offset,
+                                               size_t size);
+int procfs_pressure_resource(const char *name);
+size_t proc_pressure_io_stat(proc_handle_t *handle);
 size_t proc_pressure_memory_stat(proc_handle_t *handle);
-size_t proc_pressure_memory_read(proc_handle_t *handle, void *addr,
-                                 size_t offset, size_t size);
+size_t proc_pressure_cpu_stat(proc_handle_t *handle);
+extern const struct seq_ops proc_pressure_io_seq_ops;
+extern const struct seq_ops proc_pressure_memory_seq_ops;
+extern const struct seq_ops proc_pressure_cpu_seq_ops;
 size_t proc_cpuinfo_stat(proc_handle_t *handle);
 size_t proc_cpuinfo_read(proc_handle_t *handle, void *addr, size_t offset,
                          size_t size);
@@ -167,10 +196,8 @@ size_t proc_sysvipc_shm_read(proc_handle_t *handle, void *addr, size_t offset,
 char *procfs_generate_mount_table(task_t *task, bool mountinfo,
                                   size_t *content_len);
 size_t proc_pmountinfo_stat(proc_handle_t *handle);
-size_t proc_pmountinfo_stat(proc_handle_t *handle);
 int proc_pmountinfo_poll(proc_handle_t *handle, int events);
-size_t proc_pmountinfo_read(proc_handle_t *handle, void *addr, size_t offset,
-                            size_t size);
+extern const struct seq_ops proc_pmountinfo_seq_ops;
 size_t proc_puid_map_stat(proc_handle_t *handle);
 size_t proc_puid_map_read(proc_handle_t *handle, void *addr, size_t offset,
                           size_t size);
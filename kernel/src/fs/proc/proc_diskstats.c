@@ -0,0 +1,48 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <block/block.h>
+#include <block/blkcg.h>
+
+static unsigned long long proc_diskstats_ms(uint64_t ns) {
+    return (unsigned long long)(ns / 1000000ULL);
+}
+
+/*
+ * /proc/diskstats in the 14-field Linux layout. Whole devices only: I/O is
+ * accounted where blkdev_read/blkdev_write see it, which is below the
+ * partition layer. Devices have no major:minor of their own, so they show
+ * as 0:<blkdev id>. Nothing merges requests, and time_in_queue is the sum
+ * of every request's time from issue to completion.
+ */
+static int proc_diskstats_show(seq_file_t *m, void *v) {
+    blkdev_t *dev, *n;
+    int ret;
+
+    (void)v;
+    llist_for_each(dev, n, &blk_dev_list, list) {
+        blkdev_stats_t stats;
+
+        blkdev_stats_read(dev, &stats);
+        ret = seq_printf(
+            m,
+            "%4d %7llu %s %llu 0 %llu %llu %llu 0 %llu %llu %llu %llu "
+            "%llu\n",
+            0, (unsigned long long)dev->id, dev->name ? dev->name : "?",
+            (unsigned long long)stats.ios[BLKCG_READ],
+            (unsigned long long)stats.sectors[BLKCG_READ],
+            proc_diskstats_ms(stats.ticks_ns[BLKCG_READ]),
+            (unsigned long long)stats.ios[BLKCG_WRITE],
+            (unsigned long long)stats.sectors[BLKCG_WRITE],
+            proc_diskstats_ms(stats.ticks_ns[BLKCG_WRITE]),
+            (unsigned long long)stats.in_flight,
+            proc_diskstats_ms(stats.io_ticks_ns),
+            proc_diskstats_ms(stats.ticks_ns[BLKCG_READ] +
+                              stats.ticks_ns[BLKCG_WRITE]));
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+const struct seq_ops proc_diskstats_seq_ops =
+    SEQ_SINGLE_OPS(proc_diskstats_show);
@@ -59,7 +59,7 @@ static void create_procfs_handle(char *name, read_entry_t read_entry,
                                  stat_entry_t stat_entry,
                                  readlink_entry_t readlink_entry,
                                  poll_entry_t poll_entry) {
-    proc_handle_node_t *handle = malloc(sizeof(proc_handle_node_t));
+    proc_handle_node_t *handle = calloc(1, sizeof(proc_handle_node_t));
     handle->name = strdup(name);
     handle->hash = hash_dp(handle->name);
     handle->read_entry = read_entry;
@@ -70,6 +70,14 @@ static void create_procfs_handle(char *name, read_entry_t read_entry,
     dispatch_array[dp_index++] = handle;
 }
 
+/* A read-only file generated record by record through seq_ops. */
+static void create_procfs_seq_handle(char *name, const struct seq_ops *seq_ops,
+                                     stat_entry_t stat_entry,
+                                     poll_entry_t poll_entry) {
+    create_procfs_handle(name, NULL, NULL, stat_entry, NULL, poll_entry);
+    dispatch_array[dp_index - 1]->seq_ops = seq_ops;
+}
+
 static void create_procfs_node(char *name, read_entry_t read_entry,
                                stat_entry_t stat_entry,
                                poll_entry_t poll_entry) {
@@ -81,26 +89,42 @@ void procfs_nodes_init() {
                        proc_filesystems_stat, NULL);
     create_procfs_node("cgroups", proc_cgroups_read, proc_cgroups_stat, NULL);
     create_procfs_node("cmdline", proc_cmdline_read, proc_cmdline_stat, NULL);
-    create_procfs_node("mounts", proc_mounts_read, proc_mounts_stat, NULL);
+    create_procfs_seq_handle("mounts", &proc_mounts_seq_ops, proc_mounts_stat,
+                             NULL);
     create_procfs_node("meminfo", proc_meminfo_read, proc_meminfo_stat, NULL);
-    create_procfs_node("stat", proc_stat_read, proc_stat_stat, NULL);
+    create_procfs_seq_handle("stat", &proc_stat_seq_ops, proc_stat_stat, NULL);
     create_procfs_node("cpuinfo", proc_cpuinfo_read, proc_cpuinfo_stat, NULL);
+    create_procfs_node("workqueues", proc_workqueues_read,
+                       proc_workqueues_stat, NULL);
+    create_procfs_seq_handle("kallsyms", &proc_kallsyms_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("syscall_stats", &proc_syscall_stats_seq_ops, NULL,
+                             NULL);
+    create_procfs_seq_handle("vmstat", &proc_vmstat_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("buddyinfo", &proc_buddyinfo_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("diskstats", &proc_diskstats_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("interrupts", &proc_interrupts_seq_ops, NULL,
+                             NULL);
+    create_procfs_seq_handle("softirqs", &proc_softirqs_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("schedstat", &proc_schedstat_seq_ops, NULL, NULL);
 
     create_procfs_handle("proc_cmdline", proc_pcmdline_read, NULL,
                          proc_pcmdline_stat, NULL, NULL);
     create_procfs_handle("proc_environ", proc_penviron_read, NULL,
                          proc_penviron_stat, NULL, NULL);
-    create_procfs_handle("proc_maps", proc_pmaps_read, NULL, NULL, NULL, NULL);
-    create_procfs_handle("proc_stat", proc_pstat_read, NULL, proc_pstat_stat,
-                         NULL, NULL);
+    create_procfs_seq_handle("proc_maps", &proc_pmaps_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("proc_smaps", &proc_psmaps_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("proc_smaps_rollup", &proc_psmaps_rollup_seq_ops,
+                             NULL, NULL);
+    create_procfs_seq_handle("proc_stat", &proc_pstat_seq_ops, proc_pstat_stat,
+                             NULL);
     create_procfs_handle("proc_statm", proc_pstatm_read, NULL, proc_pstatm_stat,
                          NULL, NULL);
-    create_procfs_handle("proc_status", proc_pstatus_read, NULL,
-                         proc_pstatus_stat, NULL, NULL);
-    create_procfs_handle("proc_cgroup", proc_pcgroup_read, NULL,
-                         proc_pcgroup_stat, NULL, NULL);
-    create_procfs_handle("proc_mountinfo", proc_pmountinfo_read, NULL,
-                         proc_pmountinfo_stat, NULL, proc_pmountinfo_poll);
+    create_procfs_seq_handle("proc_status", &proc_pstatus_seq_ops,
+                             proc_pstatus_stat, NULL);
+    create_procfs_seq_handle("proc_cgroup", &proc_pcgroup_seq_ops,
+                             proc_pcgroup_stat, NULL);
+    create_procfs_seq_handle("proc_mountinfo", &proc_pmountinfo_seq_ops,
+                             proc_pmountinfo_stat, proc_pmountinfo_poll);
     create_procfs_handle("proc_uid_map", proc_puid_map_read,
                          proc_puid_map_write, proc_puid_map_stat, NULL, NULL);
     create_procfs_handle("proc_gid_map", proc_pgid_map_read,
@@ -111,6 +135,11 @@ void procfs_nodes_init() {
     create_procfs_handle("proc_oom_score_adj", proc_oom_score_adj_read,
                          proc_oom_score_adj_write, proc_oom_score_adj_stat,
                          NULL, proc_oom_score_adj_poll);
+    create_procfs_seq_handle("proc_syscall_stats", &proc_psyscall_stats_seq_ops,
+                             NULL, NULL);
+    create_procfs_seq_handle("proc_io", &proc_pio_seq_ops, NULL, NULL);
+    create_procfs_seq_handle("proc_schedstat", &proc_pschedstat_seq_ops, NULL,
+                             NULL);
     create_procfs_handle("proc_sys_kernel_osrelease",
                          proc_sys_kernel_osrelease_read, NULL,
                          proc_sys_kernel_osrelease_stat, NULL, NULL);
@@ -139,10 +168,23 @@ void procfs_nodes_init() {
                          proc_sys_kernel_domainname_read,
                          proc_sys_kernel_domainname_write,
                          proc_sys_kernel_domainname_stat, NULL, NULL);
+    create_procfs_handle("proc_sys_kernel_syscall_stats",
+                         proc_sys_kernel_syscall_stats_read,
+                         proc_sys_kernel_syscall_stats_write,
+                         proc_sys_kernel_syscall_stats_stat, NULL, NULL);
     create_procfs_handle("proc_sys_fs_nr_open", proc_sys_fs_nr_open_read, NULL,
                          proc_sys_fs_nr_open_stat, NULL, NULL);
-    create_procfs_handle("proc_pressure_memory", proc_pressure_memory_read,
-                         NULL, proc_pressure_memory_stat, NULL, NULL);
+    create_procfs_handle("proc_sys_net_core_bpf_jit_enable",
+                         proc_sys_net_core_bpf_jit_enable_read,
+                         proc_sys_net_core_bpf_jit_enable_write,
+                         proc_sys_net_core_bpf_jit_enable_stat, NULL, NULL);
+    create_procfs_seq_handle("proc_pressure_io", &proc_pressure_io_seq_ops,
+                             proc_pressure_io_stat, NULL);
+    create_procfs_seq_handle("proc_pressure_memory",
+                             &proc_pressure_memory_seq_ops,
+                             proc_pressure_memory_stat, NULL);
+    create_procfs_seq_handle("proc_pressure_cpu", &proc_pressure_cpu_seq_ops,
+                             proc_pressure_cpu_stat, NULL);
     create_procfs_handle("proc_sysvipc_shm", proc_sysvipc_shm_read, NULL,
                          proc_sysvipc_shm_stat, NULL, NULL);
     create_procfs_handle("proc_root", NULL, NULL, NULL, proc_root_readlink,
@@ -166,6 +208,20 @@ size_t procfs_read_dispatch(proc_handle_t *handle, void *addr, size_t offset,
     return (size_t)-ENOENT;
 }
 
+const struct seq_ops *procfs_seq_ops_dispatch(const char *name) {
+    uint64_t hash;
+
+    if (!name)
+        return NULL;
+
+    hash = hash_dp(name);
+    for (size_t i = 0; i < dp_index; i++) {
+        if (hash == dispatch_array[i]->hash)
+            return dispatch_array[i]->seq_ops;
+    }
+    return NULL;
+}
+
 void procfs_stat_dispatch(proc_handle_t *handle, vfs_node_t *node) {
     uint64_t hash = hash_dp(handle->name);
     for (size_t i = 0; i < dp_index; i++) {
@@ -9,7 +9,8 @@ static const char *proc_filesystems_text = "nodev\tproc\n"
                                            "nodev\tcgroup\n"
                                            "nodev\tcgroup2\n"
                                            "nodev\tsockfs\n"
-                                           "nodev\tnotifyfs\n";
+                                           "nodev\tnotifyfs\n"
+                                           "nodev\ttracefs\n";
 
 size_t proc_filesystems_stat(proc_handle_t *handle) {
     (void)handle;
@@ -0,0 +1,78 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <arch/arch.h>
+#include <irq/irq_manager.h>
+#include <irq/softirq.h>
+
+static uint32_t proc_interrupts_online_cpus(void) {
+    return cpu_count ? (uint32_t)MIN(cpu_count, (uint64_t)MAX_CPU_NUM) : 1;
+}
+
+static int proc_interrupts_header(seq_file_t *m, int indent,
+                                  uint32_t online_cpus) {
+    int ret = seq_printf(m, "%*s", indent, "");
+
+    for (uint32_t cpu = 0; cpu < online_cpus && ret >= 0; cpu++)
+        ret = seq_printf(m, "CPU%-8u", cpu);
+    if (ret < 0)
+        return ret;
+    return seq_puts(m, "\n");
+}
+
+/* /proc/interrupts: one row per registered vector, one column per CPU. */
+static int proc_interrupts_show(seq_file_t *m, void *v) {
+    uint32_t online_cpus = proc_interrupts_online_cpus();
+    int ret;
+
+    (void)v;
+    ret = proc_interrupts_header(m, 5, online_cpus);
+    if (ret < 0)
+        return ret;
+
+    for (uint64_t irq_num = 0; irq_num < ARCH_MAX_IRQ_NUM; irq_num++) {
+        const char *name;
+
+        if (!irq_is_registered(irq_num))
+            continue;
+        name = irq_name(irq_num);
+        ret = seq_printf(m, "%3llu: ", (unsigned long long)irq_num);
+        for (uint32_t cpu = 0; cpu < online_cpus && ret >= 0; cpu++)
+            ret = seq_printf(
+                m, "%10llu ",
+                (unsigned long long)irq_stat_read_cpu(cpu, irq_num));
+        if (ret >= 0)
+            ret = seq_printf(m, " %s\n", name ? name : "");
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+const struct seq_ops proc_interrupts_seq_ops =
+    SEQ_SINGLE_OPS(proc_interrupts_show);
+
+/* /proc/softirqs: handler runs per softirq and CPU. */
+static int proc_softirqs_show(seq_file_t *m, void *v) {
+    uint32_t online_cpus = proc_interrupts_online_cpus();
+    int ret;
+
+    (void)v;
+    ret = proc_interrupts_header(m, 20, online_cpus);
+    if (ret < 0)
+        return ret;
+
+    for (int id = 0; id < SOFTIRQ_MAX; id++) {
+        ret = seq_printf(m, "%12s:", softirq_name(id));
+        for (uint32_t cpu = 0; cpu < online_cpus && ret >= 0; cpu++)
+            ret = seq_printf(m, " %10llu",
+                             (unsigned long long)softirq_stat_read(cpu, id));
+        if (ret >= 0)
+            ret = seq_puts(m, "\n");
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+const struct seq_ops proc_softirqs_seq_ops =
+    SEQ_SINGLE_OPS(proc_softirqs_show);
@@ -0,0 +1,54 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <mod/dlinker.h>
+
+/*
+ * One line per symbol, the way perf and friends parse it. The tables never
+ * shrink, so the record index is all a refill needs to resume.
+ */
+static void *proc_kallsyms_start(seq_file_t *m, loff_t *pos) {
+    dlinker_symbol_t *sym = m->private;
+
+    if (!sym) {
+        sym = calloc(1, sizeof(*sym));
+        if (!sym)
+            return NULL;
+        m->private = sym;
+    }
+
+    if (!dlinker_symbol_at((size_t)*pos, sym)) {
+        free(sym);
+        m->private = NULL;
+        return NULL;
+    }
+    return sym;
+}
+
+static void *proc_kallsyms_next(seq_file_t *m, void *v, loff_t *pos) {
+    ++*pos;
+    return proc_kallsyms_start(m, pos);
+}
+
+static void proc_kallsyms_stop(seq_file_t *m, void *v) {
+    (void)v;
+    free(m->private);
+    m->private = NULL;
+}
+
+static int proc_kallsyms_show(seq_file_t *m, void *v) {
+    dlinker_symbol_t *sym = v;
+
+    if (sym->module_name)
+        return seq_printf(m, "%016llx %c %s\t[%s]\n",
+                          (unsigned long long)sym->addr, sym->type, sym->name,
+                          sym->module_name);
+    return seq_printf(m, "%016llx %c %s\n", (unsigned long long)sym->addr,
+                      sym->type, sym->name);
+}
+
+const struct seq_ops proc_kallsyms_seq_ops = {
+    .start = proc_kallsyms_start,
+    .next = proc_kallsyms_next,
+    .stop = proc_kallsyms_stop,
+    .show = proc_kallsyms_show,
+};
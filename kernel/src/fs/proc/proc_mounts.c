@@ -1,4 +1,5 @@
 #include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
 #include <task/task.h>
 
 size_t proc_mounts_stat(proc_handle_t *handle) {
@@ -9,21 +10,19 @@ size_t proc_mounts_stat(proc_handle_t *handle) {
     return content_len;
 }
 
-size_t proc_mounts_read(proc_handle_t *handle, void *addr, size_t offset,
-                        size_t size) {
-    task_t *task = procfs_handle_task_or_current(handle);
+static int proc_mounts_show(seq_file_t *m, void *v) {
     size_t content_len = 0;
-    char *content = procfs_generate_mount_table(task, false, &content_len);
+    char *content;
+    int ret;
 
+    (void)v;
+    content = procfs_generate_mount_table(
+        procfs_handle_task_or_current(&m->handle), false, &content_len);
     if (!content)
         return 0;
-    if (offset >= content_len) {
-        free(content);
-        return 0;
-    }
-
-    size_t to_copy = MIN(size, content_len - offset);
-    memcpy(addr, content + offset, to_copy);
+    ret = seq_write(m, content, content_len);
     free(content);
-    return to_copy;
+    return ret;
 }
+
+const struct seq_ops proc_mounts_seq_ops = SEQ_SINGLE_OPS(proc_mounts_show);
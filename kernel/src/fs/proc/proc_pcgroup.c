@@ -1,4 +1,5 @@
 #include <fs/proc.h>
+#include <fs/proc/seq_file.h>
 #include <cgroup/cgroup.h>
 #include <task/task.h>
 
@@ -10,20 +11,14 @@ size_t proc_pcgroup_stat(proc_handle_t *handle) {
     return len;
 }
 
-size_t proc_pcgroup_read(proc_handle_t *handle, void *addr, size_t offset,
-                         size_t size) {
-    task_t *task = procfs_handle_task_or_current(handle);
-    char *text = cgroup_task_proc_text(task);
-    const char *content = text ? text : "0::/\n";
-    size_t content_len;
+static int proc_pcgroup_show(seq_file_t *m, void *v) {
+    char *text = cgroup_task_proc_text(procfs_handle_task_or_current(&m->handle));
+    int ret;
 
-    content_len = strlen(content);
-    if (offset >= content_len) {
-        free(text);
-        return 0;
-    }
-    size_t to_copy = MIN(size, content_len - offset);
-    memcpy(addr, content + offset, to_copy);
+    (void)v;
+    ret = seq_puts(m, text ? text : "0::/\n");
     free(text);
-    return to_copy;
+    return ret;
 }
+
+const struct seq_ops proc_pcgroup_seq_ops = SEQ_SINGLE_OPS(proc_pcgroup_show);
@@ -0,0 +1,50 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <task/taskstats.h>
+
+/*
+ * /proc/<pid>/io: a thread group leader reports the whole group, exited
+ * threads included, a thread under task/ only what it did itself.
+ */
+static int proc_pio_show(seq_file_t *m, void *v) {
+    task_t *task = procfs_handle_task_or_current(&m->handle);
+    uint64_t io[NR_TASK_IO];
+
+    (void)v;
+    if (!task)
+        return 0;
+
+    task_io_read(task, task->pid == task_effective_tgid(task), io);
+    return seq_printf(m,
+                      "rchar: %llu\nwchar: %llu\nsyscr: %llu\nsyscw: %llu\n"
+                      "read_bytes: %llu\nwrite_bytes: %llu\n"
+                      "cancelled_write_bytes: %llu\n",
+                      (unsigned long long)io[TASK_IO_RCHAR],
+                      (unsigned long long)io[TASK_IO_WCHAR],
+                      (unsigned long long)io[TASK_IO_SYSCR],
+                      (unsigned long long)io[TASK_IO_SYSCW],
+                      (unsigned long long)io[TASK_IO_READ_BYTES],
+                      (unsigned long long)io[TASK_IO_WRITE_BYTES],
+                      (unsigned long long)io[TASK_IO_CANCELLED_WRITE_BYTES]);
+}
+
+const struct seq_ops proc_pio_seq_ops = SEQ_SINGLE_OPS(proc_pio_show);
+
+/* /proc/<pid>/schedstat: time on CPU, time waiting for one, timeslices. */
+static int proc_pschedstat_show(seq_file_t *m, void *v) {
+    task_t *task = procfs_handle_task_or_current(&m->handle);
+    task_delay_t delays[NR_TASK_DELAYS];
+
+    (void)v;
+    if (!task)
+        return 0;
+
+    task_delay_read(task, false, delays);
+    return seq_printf(m, "%llu %llu %llu\n",
+                      (unsigned long long)task->user_time_ns,
+                      (unsigned long long)delays[TASK_DELAY_CPU].total_ns,
+                      (unsigned long long)delays[TASK_DELAY_CPU].count);
+}
+
+const struct seq_ops proc_pschedstat_seq_ops =
+    SEQ_SINGLE_OPS(proc_pschedstat_show);
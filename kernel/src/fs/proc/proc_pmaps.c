@@ -1,4 +1,7 @@
 #include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <mm/cache.h>
+#include <mm/page.h>
 #include <task/task.h>
 
 static size_t proc_maps_format_prefix(const vma_t *vma, char *buf,
@@ -37,46 +40,6 @@ static size_t proc_maps_vma_line_len(const vma_t *vma) {
     return len + 1;
 }
 
-static size_t proc_maps_copy_piece(char *addr, size_t size, size_t offset,
-                                   size_t *position, const char *data,
-                                   size_t data_len, size_t copied) {
-    if (!position || !data || data_len == 0)
-        return copied;
-
-    if (copied < size && *position + data_len > offset) {
-        size_t piece_offset = offset > *position ? offset - *position : 0;
-        size_t available = data_len - piece_offset;
-        size_t to_copy = MIN(size - copied, available);
-
-        memcpy(addr + copied, data + piece_offset, to_copy);
-        copied += to_copy;
-    }
-
-    *position += data_len;
-    return copied;
-}
-
-static size_t proc_maps_copy_vma_line(const vma_t *vma, char *addr,
-                                      size_t offset, size_t size,
-                                      size_t *position, size_t copied) {
-    static const char pathname_padding[] = "               ";
-    char prefix[128];
-    size_t prefix_len = proc_maps_format_prefix(vma, prefix, sizeof(prefix));
-    const char *pathname = vma ? vma->vm_name : NULL;
-
-    copied = proc_maps_copy_piece(addr, size, offset, position, prefix,
-                                  prefix_len, copied);
-    if (pathname && pathname[0]) {
-        copied = proc_maps_copy_piece(addr, size, offset, position,
-                                      pathname_padding, 15, copied);
-        copied = proc_maps_copy_piece(addr, size, offset, position, pathname,
-                                      strlen(pathname), copied);
-    }
-    copied =
-        proc_maps_copy_piece(addr, size, offset, position, "\n", 1, copied);
-    return copied;
-}
-
 static size_t proc_maps_total_len_locked(vma_manager_t *mgr) {
     size_t total = 0;
     rb_node_t *node;
@@ -108,37 +71,448 @@ size_t proc_pmaps_stat(proc_handle_t *handle) {
     return content_len;
 }
 
-size_t proc_pmaps_read(proc_handle_t *handle, void *addr, size_t offset,
-                       size_t size) {
-    task_t *task = procfs_handle_task_or_current(handle);
-    char buffer[4096];
-    size_t position = 0;
-    size_t copied = 0;
-    size_t window;
+/* First vma still ending above addr, i.e. the one a refill resumes at. */
+static vma_t *proc_maps_vma_after_locked(vma_manager_t *mgr, uint64_t addr) {
+    rb_node_t *node = mgr->vma_tree.rb_node;
+    vma_t *found = NULL;
 
-    if (!task || !task->mm || !addr || size == 0)
-        return 0;
+    while (node) {
+        vma_t *vma = rb_entry(node, vma_t, vm_rb);
 
-    window = MIN(size, sizeof(buffer));
+        if (vma->vm_end > addr) {
+            found = vma;
+            node = node->rb_left;
+        } else {
+            node = node->rb_right;
+        }
+    }
 
-    vma_manager_t *mgr = &task->mm->task_vma_mgr;
+    return found;
+}
+
+/*
+ * Resume by address rather than by line number, so a refill after the
+ * mapping changed neither repeats nor skips a vma that is still there.
+ */
+static void *proc_pmaps_start(seq_file_t *m, loff_t *pos) {
+    task_t *task = procfs_handle_task_or_current(&m->handle);
+    vma_manager_t *mgr;
+    vma_t *vma;
+
+    m->private = NULL;
+    if (!task || !task->mm)
+        return NULL;
+
+    mgr = &task->mm->task_vma_mgr;
     spin_lock(&mgr->lock);
-    rb_node_t *node = rb_first(&mgr->vma_tree);
-    while (node && copied < window) {
-        vma_t *vma = rb_entry(node, vma_t, vm_rb);
-        size_t line_len = proc_maps_vma_line_len(vma);
+    if (*pos == 0) {
+        rb_node_t *node = rb_first(&mgr->vma_tree);
+        vma = node ? rb_entry(node, vma_t, vm_rb) : NULL;
+    } else {
+        vma = proc_maps_vma_after_locked(mgr, m->cursor);
+    }
+
+    if (!vma) {
+        spin_unlock(&mgr->lock);
+        return NULL;
+    }
+
+    m->private = mgr;
+    return vma;
+}
+
+static void *proc_pmaps_next(seq_file_t *m, void *v, loff_t *pos) {
+    vma_t *vma = v;
+    rb_node_t *node = rb_next(&vma->vm_rb);
+
+    m->cursor = vma->vm_end;
+    ++*pos;
+    return node ? rb_entry(node, vma_t, vm_rb) : NULL;
+}
+
+static void proc_pmaps_stop(seq_file_t *m, void *v) {
+    vma_manager_t *mgr = m->private;
+
+    (void)v;
+    if (mgr) {
+        spin_unlock(&mgr->lock);
+        m->private = NULL;
+    }
+}
+
+static int proc_pmaps_show(seq_file_t *m, void *v) {
+    vma_t *vma = v;
+    char prefix[128];
+    size_t prefix_len = proc_maps_format_prefix(vma, prefix, sizeof(prefix));
+
+    seq_write(m, prefix, prefix_len);
+    if (vma->vm_name && vma->vm_name[0]) {
+        seq_puts(m, "               ");
+        seq_puts(m, vma->vm_name);
+    }
+    return seq_write(m, "\n", 1);
+}
+
+const struct seq_ops proc_pmaps_seq_ops = {
+    .start = proc_pmaps_start,
+    .next = proc_pmaps_next,
+    .stop = proc_pmaps_stop,
+    .show = proc_pmaps_show,
+};
+
+/*
+ * smaps and smaps_rollup walk each vma's page table range in batches of
+ * PROC_SMAPS_BATCH leaves. They work on a copy of the vma taken under the
+ * vma manager lock, which is dropped again before the walk, so neither
+ * lock is held for longer than one lookup or one batch. The mm lock is
+ * only held while a batch is collected; its pages are then classified
+ * without it, and those of a shared file mapping with a single page cache
+ * lookup per batch. Absent tables are skipped whole, so the cost follows
+ * what is resident rather than how large the mappings are. A mapping
+ * that changes under the walk is reported as the page tables had it.
+ *
+ * A page is shared when more than one mapping holds it: mmap_count tells
+ * for page cache pages, the page refcount for the rest since every mapping
+ * holds a reference (see page_map_leaf()). Pss divides each page by that
+ * count. Nothing is ever swapped out, so the swap fields stay 0.
+ */
+#define PROC_SMAPS_BATCH 64
+#define PROC_SMAPS_PSS_SHIFT 12
+
+typedef struct proc_smaps_acct {
+    uint64_t rss;
+    uint64_t pss; // bytes << PROC_SMAPS_PSS_SHIFT, as are the pss_* below
+    uint64_t pss_anon;
+    uint64_t pss_file;
+    uint64_t pss_shmem;
+    uint64_t shared_clean;
+    uint64_t shared_dirty;
+    uint64_t private_clean;
+    uint64_t private_dirty;
+    uint64_t referenced;
+    uint64_t anonymous;
+} proc_smaps_acct_t;
+
+typedef struct proc_smaps_batch {
+    size_t count;
+    uint64_t vaddr[PROC_SMAPS_BATCH];
+    uint64_t pte[PROC_SMAPS_BATCH];
+    uint64_t size[PROC_SMAPS_BATCH];
+    uint64_t paddr[PROC_SMAPS_BATCH];
+    uint64_t index[PROC_SMAPS_BATCH];
+    page_cache_map_info_t info[PROC_SMAPS_BATCH];
+} proc_smaps_batch_t;
+
+static bool proc_smaps_collect(void *data, uint64_t vaddr, uint64_t pte,
+                               uint64_t size) {
+    proc_smaps_batch_t *batch = data;
+
+    batch->vaddr[batch->count] = vaddr;
+    batch->pte[batch->count] = pte;
+    batch->size[batch->count] = size;
+    return ++batch->count < PROC_SMAPS_BATCH;
+}
+
+static bool proc_smaps_vma_is_shared_file(const vma_t *vma) {
+    return vma->vm_type == VMA_TYPE_FILE && vma->node &&
+           (vma->vm_flags & VMA_SHARED) && vma->vm_offset >= 0;
+}
+
+static void proc_smaps_add(proc_smaps_acct_t *acct, const vma_t *vma,
+                           uint64_t size, int mapcount, bool dirty, bool young,
+                           bool file) {
+    uint64_t pss;
+
+    if (mapcount < 1)
+        mapcount = 1;
+    pss = (size << PROC_SMAPS_PSS_SHIFT) / (uint64_t)mapcount;
+
+    acct->rss += size;
+    acct->pss += pss;
+    if (file) {
+        acct->pss_file += pss;
+    } else if (vma->vm_type == VMA_TYPE_SHM ||
+               (vma->vm_flags & (VMA_SHM | VMA_SHARED))) {
+        acct->pss_shmem += pss;
+    } else {
+        acct->pss_anon += pss;
+        acct->anonymous += size;
+    }
 
-        if (position + line_len > offset)
-            copied = proc_maps_copy_vma_line(vma, buffer, offset, window,
-                                             &position, copied);
+    if (young)
+        acct->referenced += size;
+    if (mapcount > 1) {
+        if (dirty)
+            acct->shared_dirty += size;
         else
-            position += line_len;
+            acct->shared_clean += size;
+    } else {
+        if (dirty)
+            acct->private_dirty += size;
+        else
+            acct->private_clean += size;
+    }
+}
 
-        node = rb_next(node);
+/*
+ * Private file mappings never map the page cache itself, faults copy the
+ * file into a page of their own, so their pages count as anonymous.
+ */
+static void proc_smaps_account_batch(proc_smaps_acct_t *acct,
+                                     const vma_t *vma,
+                                     proc_smaps_batch_t *batch) {
+    bool shared_file = proc_smaps_vma_is_shared_file(vma);
+
+    for (size_t i = 0; i < batch->count; i++) {
+        batch->paddr[i] = ARCH_READ_PTE(batch->pte[i]);
+        if (shared_file)
+            batch->index[i] = ((uint64_t)vma->vm_offset +
+                               (batch->vaddr[i] - vma->vm_start)) /
+                              PAGE_SIZE;
+    }
+    if (shared_file)
+        page_cache_mapped_info(&vma->node->i_mapping, batch->index,
+                               batch->paddr, batch->count, batch->info);
+    else
+        memset(batch->info, 0, batch->count * sizeof(batch->info[0]));
+
+    for (size_t i = 0; i < batch->count; i++) {
+        page_cache_map_info_t *info = &batch->info[i];
+        uint64_t pte = batch->pte[i];
+
+        if (info->cached) {
+            proc_smaps_add(acct, vma, batch->size[i], info->mmap_count,
+                           info->dirty,
+                           info->referenced || ARCH_PT_IS_YOUNG(pte), true);
+            continue;
+        }
+        if (!address_is_managed(batch->paddr[i]))
+            continue;
+        proc_smaps_add(
+            acct, vma, batch->size[i],
+            page_refcount_read(get_page_by_addr(batch->paddr[i])),
+            ARCH_PT_IS_DIRTY(pte), ARCH_PT_IS_YOUNG(pte), shared_file);
+    }
+}
+
+/*
+ * Copies the first vma ending above addr into copy, holding a reference on
+ * its inode and its own copy of the name. Returns false when there is none.
+ */
+static bool proc_smaps_vma_get(task_mm_info_t *mm, uint64_t addr,
+                               vma_t *copy) {
+    vma_manager_t *mgr = &mm->task_vma_mgr;
+    vma_t *vma;
+
+    spin_lock(&mgr->lock);
+    vma = proc_maps_vma_after_locked(mgr, addr);
+    if (vma) {
+        *copy = *vma;
+        copy->vm_name = vma->vm_name ? strdup(vma->vm_name) : NULL;
+        if (copy->node)
+            vfs_igrab(copy->node);
     }
     spin_unlock(&mgr->lock);
+    return vma != NULL;
+}
 
-    if (copied > 0)
-        memcpy(addr, buffer, copied);
-    return copied;
+static void proc_smaps_vma_put(vma_t *copy) {
+    free(copy->vm_name);
+    if (copy->node)
+        vfs_iput(copy->node);
+    memset(copy, 0, sizeof(*copy));
 }
+
+/* vma is a copy from proc_smaps_vma_get(); no lock is held on entry. */
+static void proc_smaps_walk_vma(task_mm_info_t *mm, const vma_t *vma,
+                                proc_smaps_acct_t *acct,
+                                proc_smaps_batch_t *batch) {
+    uint64_t *pgdir = task_mm_pgdir(mm);
+    uint64_t cursor = vma->vm_start;
+
+    if (!pgdir || (vma->vm_flags & VMA_DEVICE))
+        return;
+
+    while (cursor < vma->vm_end) {
+        batch->count = 0;
+        spin_lock(&mm->lock);
+        cursor = page_table_walk_range(pgdir, cursor, vma->vm_end,
+                                       proc_smaps_collect, batch);
+        spin_unlock(&mm->lock);
+        proc_smaps_account_batch(acct, vma, batch);
+    }
+}
+
+typedef struct proc_smaps_field {
+    const char *name;
+    uint64_t bytes;
+} proc_smaps_field_t;
+
+static int proc_smaps_print(seq_file_t *m, const proc_smaps_field_t *fields,
+                            size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int ret = seq_printf(m, "%-16s%8llu kB\n", fields[i].name,
+                             (unsigned long long)(fields[i].bytes >> 10));
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* What proc_psmaps_start() leaves in m->private for the walk. */
+typedef struct proc_smaps_iter {
+    task_mm_info_t *mm;
+    vma_t vma; // the vma being shown, from proc_smaps_vma_get()
+    bool held;
+} proc_smaps_iter_t;
+
+/* Like proc_pmaps_start(), but hands out copies and keeps no lock. */
+static void *proc_psmaps_start(seq_file_t *m, loff_t *pos) {
+    task_t *task = procfs_handle_task_or_current(&m->handle);
+    proc_smaps_iter_t *iter;
+
+    m->private = NULL;
+    if (!task || !task->mm)
+        return NULL;
+
+    iter = calloc(1, sizeof(*iter));
+    if (!iter) {
+        m->error = -ENOMEM;
+        return NULL;
+    }
+    iter->mm = task->mm;
+    m->private = iter;
+    iter->held = proc_smaps_vma_get(iter->mm, *pos ? m->cursor : 0,
+                                    &iter->vma);
+    return iter->held ? &iter->vma : NULL;
+}
+
+static void *proc_psmaps_next(seq_file_t *m, void *v, loff_t *pos) {
+    proc_smaps_iter_t *iter = m->private;
+    vma_t *vma = v;
+
+    m->cursor = vma->vm_end;
+    ++*pos;
+    proc_smaps_vma_put(&iter->vma);
+    iter->held = proc_smaps_vma_get(iter->mm, m->cursor, &iter->vma);
+    return iter->held ? &iter->vma : NULL;
+}
+
+static void proc_psmaps_stop(seq_file_t *m, void *v) {
+    proc_smaps_iter_t *iter = m->private;
+
+    (void)v;
+    if (!iter)
+        return;
+    if (iter->held)
+        proc_smaps_vma_put(&iter->vma);
+    free(iter);
+    m->private = NULL;
+}
+
+static int proc_psmaps_show(seq_file_t *m, void *v) {
+    vma_t *vma = v;
+    proc_smaps_iter_t *iter = m->private;
+    proc_smaps_acct_t acct = {0};
+    proc_smaps_batch_t *batch;
+    int ret;
+
+    ret = proc_pmaps_show(m, v);
+    if (ret < 0)
+        return ret;
+
+    batch = malloc(sizeof(*batch));
+    if (!batch)
+        return -ENOMEM;
+    proc_smaps_walk_vma(iter->mm, vma, &acct, batch);
+    free(batch);
+
+    const proc_smaps_field_t fields[] = {
+        {"Size:", vma->vm_end - vma->vm_start},
+        {"KernelPageSize:", PAGE_SIZE},
+        {"MMUPageSize:", PAGE_SIZE},
+        {"Rss:", acct.rss},
+        {"Pss:", acct.pss >> PROC_SMAPS_PSS_SHIFT},
+        {"Shared_Clean:", acct.shared_clean},
+        {"Shared_Dirty:", acct.shared_dirty},
+        {"Private_Clean:", acct.private_clean},
+        {"Private_Dirty:", acct.private_dirty},
+        {"Referenced:", acct.referenced},
+        {"Anonymous:", acct.anonymous},
+        {"Swap:", 0},
+        {"SwapPss:", 0},
+        {"Locked:", 0},
+    };
+    return proc_smaps_print(m, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+const struct seq_ops proc_psmaps_seq_ops = {
+    .start = proc_psmaps_start,
+    .next = proc_psmaps_next,
+    .stop = proc_psmaps_stop,
+    .show = proc_psmaps_show,
+};
+
+/*
+ * Each vma is copied out and walked without the vma manager lock, and the
+ * next one is found by address, so a large process does not hold off its
+ * own faults for the whole sum.
+ */
+static int proc_psmaps_rollup_show(seq_file_t *m, void *v) {
+    task_t *task = procfs_handle_task_or_current(&m->handle);
+    proc_smaps_acct_t acct = {0};
+    proc_smaps_batch_t *batch;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    task_mm_info_t *mm;
+    vma_t vma;
+    int ret;
+
+    (void)v;
+    if (!task || !task->mm)
+        return 0;
+
+    mm = task->mm;
+    batch = malloc(sizeof(*batch));
+    if (!batch)
+        return -ENOMEM;
+
+    while (proc_smaps_vma_get(mm, end, &vma)) {
+        if (!end)
+            start = vma.vm_start;
+        proc_smaps_walk_vma(mm, &vma, &acct, batch);
+        end = vma.vm_end;
+        proc_smaps_vma_put(&vma);
+    }
+    free(batch);
+
+    if (!end)
+        return 0;
+
+    ret = seq_printf(m, "%012lx-%012lx ---p 00000000 00:00 0"
+                        "               [rollup]\n",
+                     start, end);
+    if (ret < 0)
+        return ret;
+
+    const proc_smaps_field_t fields[] = {
+        {"Rss:", acct.rss},
+        {"Pss:", acct.pss >> PROC_SMAPS_PSS_SHIFT},
+        {"Pss_Anon:", acct.pss_anon >> PROC_SMAPS_PSS_SHIFT},
+        {"Pss_File:", acct.pss_file >> PROC_SMAPS_PSS_SHIFT},
+        {"Pss_Shmem:", acct.pss_shmem >> PROC_SMAPS_PSS_SHIFT},
+        {"Shared_Clean:", acct.shared_clean},
+        {"Shared_Dirty:", acct.shared_dirty},
+        {"Private_Clean:", acct.private_clean},
+        {"Private_Dirty:", acct.private_dirty},
+        {"Referenced:", acct.referenced},
+        {"Anonymous:", acct.anonymous},
+        {"Swap:", 0},
+        {"SwapPss:", 0},
+        {"Locked:", 0},
+    };
+    return proc_smaps_print(m, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+const struct seq_ops proc_psmaps_rollup_seq_ops =
+    SEQ_SINGLE_OPS(proc_psmaps_rollup_show);
@@ -1,4 +1,5 @@
 #include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
 #include <task/task.h>
 #include <libs/string_builder.h>
 
@@ -229,21 +230,19 @@ int proc_pmountinfo_poll(proc_handle_t *handle, int events) {
     return 0;
 }
 
-size_t proc_pmountinfo_read(proc_handle_t *handle, void *addr, size_t offset,
-                            size_t size) {
-    task_t *task = procfs_handle_task_or_current(handle);
+static int proc_pmountinfo_show(seq_file_t *m, void *v) {
     size_t content_len = 0;
-    char *content = procfs_generate_mount_table(task, true, &content_len);
+    char *content;
+    int ret;
 
+    (void)v;
+    content = procfs_generate_mount_table(
+        procfs_handle_task_or_current(&m->handle), true, &content_len);
     if (!content)
         return 0;
-    if (offset >= content_len) {
-        free(content);
-        return 0;
-    }
-
-    size_t to_copy = MIN(size, content_len - offset);
-    memcpy(addr, content + offset, to_copy);
+    ret = seq_write(m, content, content_len);
     free(content);
-    return to_copy;
+    return ret;
 }
+
+const struct seq_ops proc_pmountinfo_seq_ops = SEQ_SINGLE_OPS(proc_pmountinfo_show);
@@ -0,0 +1,72 @@
+#include <fs/proc.h>
+#include <fs/proc/seq_file.h>
+#include <task/psi.h>
+
+int procfs_pressure_resource(const char *name) {
+    if (!name)
+        return -1;
+    if (!strcmp(name, "proc_pressure_io"))
+        return PSI_IO;
+    if (!strcmp(name, "proc_pressure_memory"))
+        return PSI_MEM;
+    if (!strcmp(name, "proc_pressure_cpu"))
+        return PSI_CPU;
+    return -1;
+}
+
+static size_t proc_pressure_stat(psi_res_t res) {
+    size_t content_len = 0;
+    char *content = psi_show(&psi_system, res, &content_len);
+
+    free(content);
+    return content_len;
+}
+
+static int proc_pressure_show(seq_file_t *m, psi_res_t res) {
+    size_t content_len = 0;
+    char *content = psi_show(&psi_system, res, &content_len);
+    int ret;
+
+    if (!content)
+        return -ENOMEM;
+    ret = seq_write(m, content, content_len);
+    free(content);
+    return ret;
+}
+
+size_t proc_pressure_io_stat(proc_handle_t *handle) {
+    (void)handle;
+    return proc_pressure_stat(PSI_IO);
+}
+
+size_t proc_pressure_memory_stat(proc_handle_t *handle) {
+    (void)handle;
+    return proc_pressure_stat(PSI_MEM);
+}
+
+size_t proc_pressure_cpu_stat(proc_handle_t *handle) {
+    (void)handle;
+    return proc_pressure_stat(PSI_CPU);
+}
+
+static int proc_pressure_io_show(seq_file_t *m, void *v) {
+    (void)v;
+    return proc_pressure_show(m, PSI_IO);
+}
+
+static int proc_pressure_memory_show(seq_file_t *m, void *v) {
+    (void)v;
+    return proc_pressure_show(m, PSI_MEM);
+}
+
+static int proc_pressure_cpu_show(seq_file_t *m, void *v) {
+    (void)v;
+    return proc_pressure_show(m, PSI_CPU);
+}
+
+const struct seq_ops proc_pressure_io_seq_ops =
+    SEQ_SINGLE_OPS(proc_pressure_io_show);
+const struct seq_ops proc_pressure_memory_seq_ops =
+    SEQ_SINGLE_OPS(proc_pressure_memory_show);
+const struct seq_ops proc_pressure_cpu_seq_ops =
+    SEQ_SINGLE_OPS(proc_pressure_cpu_show);
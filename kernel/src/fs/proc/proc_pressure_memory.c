@@ -1,8 +0,0 @@
-#include <fs/proc.h>
-
-size_t proc_pressure_memory_stat(proc_handle_t *handle) { return 0; }
-
-size_t proc_pressure_memory_read(proc_handle_t *handle, void *addr,
-                                 size_t offset, size_t size) {
-    return 0;
-}
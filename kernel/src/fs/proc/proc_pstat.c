@@ -1,4 +1,5 @@
 #include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
 #include <fs/fs_syscall.h>
 #include <task/task.h>
 
@@ -194,20 +195,19 @@ size_t proc_pstat_stat(proc_handle_t *handle) {
     return content_len;
 }
 
-size_t proc_pstat_read(proc_handle_t *handle, void *addr, size_t offset,
-                       size_t size) {
-    task_t *task;
-    task = procfs_handle_task_or_current(handle);
+static int proc_pstat_show(seq_file_t *m, void *v) {
     size_t content_len = 0;
-    char *content = proc_gen_stat_file(task, &content_len);
+    char *content;
+    int ret;
+
+    (void)v;
+    content = proc_gen_stat_file(procfs_handle_task_or_current(&m->handle),
+                                 &content_len);
     if (!content)
         return 0;
-    if (offset >= content_len) {
-        free(content);
-        return 0;
-    }
-    size_t to_copy = MIN(size, content_len - offset);
-    memcpy(addr, content + offset, to_copy);
+    ret = seq_write(m, content, content_len);
     free(content);
-    return to_copy;
+    return ret;
 }
+
+const struct seq_ops proc_pstat_seq_ops = SEQ_SINGLE_OPS(proc_pstat_show);
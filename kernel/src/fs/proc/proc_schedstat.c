@@ -0,0 +1,46 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <task/sched.h>
+
+/*
+ * /proc/schedstat, version 15 layout. Each cpuN line reads: yld_count, a
+ * legacy 0, sched_count, sched_goidle, ttwu_count, ttwu_local, then ns run
+ * by tasks, ns tasks waited on the runqueue and timeslices handed out.
+ * There are no scheduling domains, so no domainN lines follow.
+ */
+static int proc_schedstat_show(seq_file_t *m, void *v) {
+    uint64_t online_cpus =
+        cpu_count ? MIN(cpu_count, (uint64_t)MAX_CPU_NUM) : 1;
+    int ret;
+
+    (void)v;
+    ret = seq_printf(
+        m, "version 15\ntimestamp %llu\n",
+        (unsigned long long)(nano_time() / (1000000000ULL / SCHED_HZ)));
+    if (ret < 0)
+        return ret;
+
+    for (uint64_t cpu = 0; cpu < online_cpus; cpu++) {
+        sched_cpu_stats_t stats;
+
+        sched_cpu_stats_read(cpu, &stats);
+        ret = seq_printf(m,
+                         "cpu%llu %llu 0 %llu %llu %llu %llu %llu %llu "
+                         "%llu\n",
+                         (unsigned long long)cpu,
+                         (unsigned long long)stats.yld_count,
+                         (unsigned long long)stats.sched_count,
+                         (unsigned long long)stats.sched_goidle,
+                         (unsigned long long)stats.ttwu_count,
+                         (unsigned long long)stats.ttwu_local,
+                         (unsigned long long)stats.run_ns,
+                         (unsigned long long)stats.run_delay_ns,
+                         (unsigned long long)stats.pcount);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+const struct seq_ops proc_schedstat_seq_ops =
+    SEQ_SINGLE_OPS(proc_schedstat_show);
@@ -1,8 +1,11 @@
 #include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
 #include <arch/arch.h>
 #include <boot/boot.h>
 #include <irq/irq_manager.h>
+#include <irq/softirq.h>
 #include <libs/string_builder.h>
+#include <task/sched.h>
 #include <task/task.h>
 
 typedef struct proc_stat_cpu_times {
@@ -15,6 +18,8 @@ typedef struct proc_stat_snapshot {
     proc_stat_cpu_times_t cpu_times[MAX_CPU_NUM];
     uint64_t irq_counts[ARCH_MAX_IRQ_NUM];
     uint64_t irq_total;
+    uint64_t softirq_counts[SOFTIRQ_MAX];
+    uint64_t softirq_total;
     size_t processes;
     size_t running;
     size_t blocked;
@@ -82,6 +87,11 @@ static void proc_stat_collect(proc_stat_snapshot_t *stat, size_t cpu_slots,
     spin_unlock(&task_queue_lock);
 
     irq_stat_read(stat->irq_counts, ARCH_MAX_IRQ_NUM, &stat->irq_total);
+    for (int id = 0; id < SOFTIRQ_MAX; id++) {
+        for (size_t cpu = 0; cpu < cpu_slots; cpu++)
+            stat->softirq_counts[id] += softirq_stat_read(cpu, id);
+        stat->softirq_total += stat->softirq_counts[id];
+    }
 }
 
 static void proc_stat_make_cpu_times_monotonic(proc_stat_snapshot_t *stat,
@@ -165,7 +175,8 @@ static char *proc_gen_stat(size_t *content_len) {
                               (unsigned long long)stat->irq_counts[irq_num]);
     }
     string_builder_append(builder, "\n");
-    string_builder_append(builder, "ctxt 0\n");
+    string_builder_append(builder, "ctxt %llu\n",
+                          (unsigned long long)sched_nr_switches());
     string_builder_append(builder, "btime %llu\n",
                           (unsigned long long)boot_get_boottime());
     string_builder_append(builder, "processes %llu\n",
@@ -174,7 +185,13 @@ static char *proc_gen_stat(size_t *content_len) {
                           (unsigned long long)stat->running);
     string_builder_append(builder, "procs_blocked %llu\n",
                           (unsigned long long)stat->blocked);
-    string_builder_append(builder, "softirq 0 0 0 0 0 0 0 0 0 0 0\n");
+    string_builder_append(builder, "softirq %llu",
+                          (unsigned long long)stat->softirq_total);
+    for (int id = 0; id < SOFTIRQ_MAX; id++) {
+        string_builder_append(builder, " %llu",
+                              (unsigned long long)stat->softirq_counts[id]);
+    }
+    string_builder_append(builder, "\n");
 
     *content_len = builder->size;
     char *data = builder->data;
@@ -190,20 +207,18 @@ size_t proc_stat_stat(proc_handle_t *handle) {
     return content_len;
 }
 
-size_t proc_stat_read(proc_handle_t *handle, void *addr, size_t offset,
-                      size_t size) {
+static int proc_stat_show(seq_file_t *m, void *v) {
     size_t content_len = 0;
-    char *content = proc_gen_stat(&content_len);
-    if (!content) {
-        return 0;
-    }
-    if (offset >= content_len) {
-        free(content);
-        return 0;
-    }
+    char *content;
+    int ret;
 
-    size_t to_copy = MIN(size, content_len - offset);
-    memcpy(addr, content + offset, to_copy);
+    (void)v;
+    content = proc_gen_stat(&content_len);
+    if (!content)
+        return 0;
+    ret = seq_write(m, content, content_len);
     free(content);
-    return to_copy;
+    return ret;
 }
+
+const struct seq_ops proc_stat_seq_ops = SEQ_SINGLE_OPS(proc_stat_show);
@@ -0,0 +1,70 @@
+#include <fs/proc.h>
+#include <bpf/jit.h>
+
+static size_t proc_sys_net_int_format(int value, char *buf, size_t size) {
+    int len = snprintf(buf, size, "%d\n", value);
+    return len > 0 ? (size_t)len : 0;
+}
+
+size_t proc_sys_net_core_bpf_jit_enable_stat(proc_handle_t *handle) {
+    char buf[16];
+
+    (void)handle;
+    return proc_sys_net_int_format(
+        __atomic_load_n(&bpf_jit_enable, __ATOMIC_RELAXED), buf, sizeof(buf));
+}
+
+size_t proc_sys_net_core_bpf_jit_enable_read(proc_handle_t *handle, void *addr,
+                                             size_t offset, size_t size) {
+    char buf[16];
+    size_t len;
+
+    (void)handle;
+    len = proc_sys_net_int_format(
+        __atomic_load_n(&bpf_jit_enable, __ATOMIC_RELAXED), buf, sizeof(buf));
+    if (offset >= len)
+        return 0;
+
+    size_t to_copy = MIN(size, len - offset);
+    memcpy(addr, buf + offset, to_copy);
+    return to_copy;
+}
+
+/*
+ * 0 interprets every filter, 1 compiles filters attached from now on, 2 does
+ * the same and dumps each image to the log. Filters already attached keep
+ * whatever they were built with. Without an architecture JIT only 0 sticks.
+ */
+ssize_t proc_sys_net_core_bpf_jit_enable_write(proc_handle_t *handle,
+                                               const void *addr, size_t offset,
+                                               size_t size) {
+    const char *buf = addr;
+    size_t i = 0;
+    int value = 0;
+
+    (void)handle;
+    (void)offset;
+    if (!addr)
+        return -EINVAL;
+
+    while (i < size && (buf[i] == ' ' || buf[i] == '\t'))
+        i++;
+    if (i == size || buf[i] < '0' || buf[i] > '9')
+        return -EINVAL;
+    while (i < size && buf[i] >= '0' && buf[i] <= '9') {
+        value = value * 10 + (buf[i] - '0');
+        if (value > 2)
+            return -EINVAL;
+        i++;
+    }
+    while (i < size && (buf[i] == '\n' || buf[i] == ' ' || buf[i] == '\0'))
+        i++;
+    if (i != size)
+        return -EINVAL;
+
+    if (value && !bpf_jit_arch_supported())
+        return -EINVAL;
+
+    __atomic_store_n(&bpf_jit_enable, value, __ATOMIC_RELAXED);
+    return size;
+}
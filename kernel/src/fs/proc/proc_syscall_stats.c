@@ -0,0 +1,183 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <task/syscall_stats.h>
+#include <task/task.h>
+
+/*
+ * /proc/syscall_stats sums every CPU, /proc/<pid>/syscall_stats shows the
+ * process the pid belongs to. After a header line, one line per syscall
+ * number that was ever counted:
+ *
+ *   <nr> calls=<n> errors=<n> total_ns=<n> avg_ns=<n> max_ns=<n>
+ *        hist=<i:n,...>
+ *
+ * on one line, where hist lists the non-empty log2 buckets. Record n stands
+ * for syscall n - 1 and 0 for the header, so a refill resumes from *pos.
+ */
+typedef struct proc_syscall_stats_iter {
+    task_t *task; // NULL for the system-wide file
+    bool header;
+    uint64_t nr;
+    syscall_stat_t stat;
+} proc_syscall_stats_iter_t;
+
+static void *proc_syscall_stats_seek(seq_file_t *m, loff_t *pos,
+                                     task_t *task) {
+    proc_syscall_stats_iter_t *iter = m->private;
+
+    if (!iter) {
+        iter = calloc(1, sizeof(*iter));
+        if (!iter)
+            return NULL;
+        m->private = iter;
+    }
+    iter->task = task;
+    iter->header = *pos == 0;
+    if (iter->header)
+        return iter;
+
+    for (uint64_t nr = (uint64_t)*pos - 1; nr < SYSCALL_STATS_NR; nr++) {
+        bool found = task ? syscall_stats_read_task(task, nr, &iter->stat)
+                          : syscall_stats_read_global(nr, &iter->stat);
+
+        if (found) {
+            iter->nr = nr;
+            *pos = (loff_t)nr + 1;
+            return iter;
+        }
+    }
+    *pos = SYSCALL_STATS_NR + 1;
+    return NULL;
+}
+
+static void *proc_syscall_stats_start(seq_file_t *m, loff_t *pos) {
+    return proc_syscall_stats_seek(m, pos, NULL);
+}
+
+static void *proc_psyscall_stats_start(seq_file_t *m, loff_t *pos) {
+    task_t *task = procfs_handle_task_or_current(&m->handle);
+
+    if (!task)
+        return NULL;
+    return proc_syscall_stats_seek(m, pos, task);
+}
+
+static void *proc_syscall_stats_next(seq_file_t *m, void *v, loff_t *pos) {
+    proc_syscall_stats_iter_t *iter = v;
+
+    ++*pos;
+    return proc_syscall_stats_seek(m, pos, iter->task);
+}
+
+static void proc_syscall_stats_stop(seq_file_t *m, void *v) {
+    (void)v;
+    free(m->private);
+    m->private = NULL;
+}
+
+static int proc_syscall_stats_show(seq_file_t *m, void *v) {
+    proc_syscall_stats_iter_t *iter = v;
+    syscall_stat_t *stat = &iter->stat;
+    bool first = true;
+    int ret;
+
+    if (iter->header)
+        return seq_printf(
+            m, "# enabled=%d hist bucket i: [2^i, 2^(i+1)) ns\n",
+            __atomic_load_n(&syscall_stats_on, __ATOMIC_RELAXED) ? 1 : 0);
+
+    ret = seq_printf(m,
+                     "%llu calls=%llu errors=%llu total_ns=%llu avg_ns=%llu "
+                     "max_ns=%llu hist=",
+                     (unsigned long long)iter->nr,
+                     (unsigned long long)stat->count,
+                     (unsigned long long)stat->errors,
+                     (unsigned long long)stat->total_ns,
+                     (unsigned long long)(stat->total_ns / stat->count),
+                     (unsigned long long)stat->max_ns);
+    if (ret < 0)
+        return ret;
+
+    for (int i = 0; i < SYSCALL_STATS_BUCKETS; i++) {
+        if (!stat->hist[i])
+            continue;
+        ret = seq_printf(m, "%s%d:%u", first ? "" : ",", i, stat->hist[i]);
+        if (ret < 0)
+            return ret;
+        first = false;
+    }
+    return seq_puts(m, "\n");
+}
+
+const struct seq_ops proc_syscall_stats_seq_ops = {
+    .start = proc_syscall_stats_start,
+    .next = proc_syscall_stats_next,
+    .stop = proc_syscall_stats_stop,
+    .show = proc_syscall_stats_show,
+};
+
+const struct seq_ops proc_psyscall_stats_seq_ops = {
+    .start = proc_psyscall_stats_start,
+    .next = proc_syscall_stats_next,
+    .stop = proc_syscall_stats_stop,
+    .show = proc_syscall_stats_show,
+};
+
+static size_t proc_sys_kernel_syscall_stats_format(char *buf) {
+    buf[0] = __atomic_load_n(&syscall_stats_on, __ATOMIC_RELAXED) ? '1' : '0';
+    buf[1] = '\n';
+    return 2;
+}
+
+size_t proc_sys_kernel_syscall_stats_stat(proc_handle_t *handle) {
+    (void)handle;
+    return 2;
+}
+
+size_t proc_sys_kernel_syscall_stats_read(proc_handle_t *handle, void *addr,
+                                          size_t offset, size_t size) {
+    char buf[2];
+    size_t len;
+
+    (void)handle;
+    len = proc_sys_kernel_syscall_stats_format(buf);
+    if (offset >= len)
+        return 0;
+
+    size_t to_copy = MIN(size, len - offset);
+    memcpy(addr, buf + offset, to_copy);
+    return to_copy;
+}
+
+/*
+ * 1 starts counting, 0 stops it. The numbers are kept across a stop, so
+ * readers diff two snapshots rather than expect a reset.
+ */
+ssize_t proc_sys_kernel_syscall_stats_write(proc_handle_t *handle,
+                                            const void *addr, size_t offset,
+                                            size_t size) {
+    const char *buf = addr;
+    size_t i = 0;
+    int ret;
+    bool on;
+
+    (void)handle;
+    (void)offset;
+    if (!addr)
+        return -EINVAL;
+
+    while (i < size && (buf[i] == ' ' || buf[i] == '\t'))
+        i++;
+    if (i == size || (buf[i] != '0' && buf[i] != '1'))
+        return -EINVAL;
+    on = buf[i++] == '1';
+    while (i < size && (buf[i] == '\n' || buf[i] == ' ' || buf[i] == '\0'))
+        i++;
+    if (i != size)
+        return -EINVAL;
+
+    ret = syscall_stats_set_enabled(on);
+    if (ret < 0)
+        return ret;
+    return size;
+}
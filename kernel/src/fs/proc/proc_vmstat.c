@@ -0,0 +1,85 @@
+#include <fs/proc/proc.h>
+#include <fs/proc/seq_file.h>
+#include <block/block.h>
+#include <block/blkcg.h>
+#include <mm/cache.h>
+#include <mm/mm.h>
+#include <mm/vmstat.h>
+
+/*
+ * /proc/vmstat: the page gauges first, then counters since boot. pgpgin
+ * and pgpgout are KiB moved by the block layer, as on Linux.
+ */
+static int proc_vmstat_show(seq_file_t *m, void *v) {
+    page_cache_stats_t cache = {0};
+    uint64_t free_pages = 0;
+    uint64_t pgpgin = 0, pgpgout = 0;
+    blkdev_t *dev, *n;
+    int ret;
+
+    (void)v;
+    for (int i = 0; i < __MAX_NR_ZONES; i++)
+        free_pages += zone_free_pages(zones[i]);
+    page_cache_stats_snapshot(&cache);
+
+    llist_for_each(dev, n, &blk_dev_list, list) {
+        blkdev_stats_t stats;
+
+        blkdev_stats_read(dev, &stats);
+        pgpgin += stats.sectors[BLKCG_READ] / 2;
+        pgpgout += stats.sectors[BLKCG_WRITE] / 2;
+    }
+
+    ret = seq_printf(m,
+                     "nr_free_pages %llu\nnr_file_pages %llu\n"
+                     "nr_mapped %llu\nnr_dirty %llu\nnr_writeback %llu\n"
+                     "pgpgin %llu\npgpgout %llu\n",
+                     (unsigned long long)free_pages,
+                     (unsigned long long)cache.cached_pages,
+                     (unsigned long long)cache.mapped_pages,
+                     (unsigned long long)cache.dirty_pages,
+                     (unsigned long long)cache.writeback_pages,
+                     (unsigned long long)pgpgin, (unsigned long long)pgpgout);
+    if (ret < 0)
+        return ret;
+
+    for (int item = 0; item < NR_VM_EVENTS; item++) {
+        ret = seq_printf(m, "%s %llu\n", vm_event_name(item),
+                         (unsigned long long)vm_event_read(item));
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+const struct seq_ops proc_vmstat_seq_ops = SEQ_SINGLE_OPS(proc_vmstat_show);
+
+/* /proc/buddyinfo: free blocks of each order, one line per zone. */
+static int proc_buddyinfo_show(seq_file_t *m, void *v) {
+    uint64_t nr_free[ORDER_COUNT];
+    int ret;
+
+    (void)v;
+    for (int i = 0; i < __MAX_NR_ZONES; i++) {
+        zone_t *zone = zones[i];
+
+        if (!zone || !zone_has_memory(zone))
+            continue;
+        zone_free_area_read(zone, nr_free);
+        ret = seq_printf(m, "Node 0, zone %8s", zone->name ? zone->name : "");
+        if (ret < 0)
+            return ret;
+        for (size_t order = 0; order < ORDER_COUNT; order++) {
+            ret = seq_printf(m, " %6llu", (unsigned long long)nr_free[order]);
+            if (ret < 0)
+                return ret;
+        }
+        ret = seq_puts(m, "\n");
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+const struct seq_ops proc_buddyinfo_seq_ops =
+    SEQ_SINGLE_OPS(proc_buddyinfo_show);
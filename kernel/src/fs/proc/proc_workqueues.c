@@ -0,0 +1,15 @@
+#include <fs/proc/proc.h>
+#include <task/workqueue.h>
+
+size_t proc_workqueues_stat(proc_handle_t *handle) { return 0; }
+
+size_t proc_workqueues_read(proc_handle_t *handle, void *addr, size_t offset,
+                            size_t size) {
+    size_t content_len = 0;
+    char *content = workqueue_gen_stats(&content_len);
+
+    if (!content)
+        return 0;
+
+    return procfs_node_read(content_len, offset, size, addr, content);
+}
@@ -0,0 +1,206 @@
+#include <fs/proc/seq_file.h>
+#include <mm/mm.h>
+#include <stdarg.h>
+
+/*
+ * A refill stops at the first record boundary past this many bytes, so a
+ * read() only ever walks the records it returns (plus one), no matter how
+ * far into the file it starts.
+ */
+#define SEQ_FILL_SIZE PAGE_SIZE
+
+seq_file_t *seq_open(const seq_ops_t *op, const proc_handle_t *handle) {
+    seq_file_t *m = calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+
+    m->buf = malloc(SEQ_FILL_SIZE * 2);
+    if (!m->buf) {
+        free(m);
+        return NULL;
+    }
+
+    m->size = SEQ_FILL_SIZE * 2;
+    m->op = op;
+    // not a spinlock: ->show() and the copy out run with interrupts on
+    m->lock.cnt = 1;
+    if (handle)
+        memcpy(&m->handle, handle, sizeof(m->handle));
+    return m;
+}
+
+void seq_release(seq_file_t *m) {
+    if (!m)
+        return;
+
+    free(m->buf);
+    free(m);
+}
+
+static int seq_grow(seq_file_t *m, size_t need) {
+    size_t size = MAX(m->size * 2, need);
+    char *buf = realloc(m->buf, size);
+
+    if (!buf) {
+        m->error = -ENOMEM;
+        return -ENOMEM;
+    }
+
+    m->buf = buf;
+    m->size = size;
+    return 0;
+}
+
+int seq_write(seq_file_t *m, const void *data, size_t len) {
+    if (!len)
+        return 0;
+    if (m->count + len > m->size && seq_grow(m, m->count + len) < 0)
+        return -ENOMEM;
+
+    memcpy(m->buf + m->count, data, len);
+    m->count += len;
+    return 0;
+}
+
+int seq_puts(seq_file_t *m, const char *s) {
+    return seq_write(m, s, strlen(s));
+}
+
+int seq_printf(seq_file_t *m, const char *fmt, ...) {
+    size_t room = m->size - m->count;
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(m->buf + m->count, room, fmt, args);
+    va_end(args);
+    if (len < 0)
+        return len;
+
+    if ((size_t)len >= room) {
+        if (seq_grow(m, m->count + len + 1) < 0)
+            return -ENOMEM;
+        va_start(args, fmt);
+        vsnprintf(m->buf + m->count, m->size - m->count, fmt, args);
+        va_end(args);
+    }
+
+    m->count += len;
+    return 0;
+}
+
+/* Regenerates the next batch of whole records into the empty buffer. */
+static int seq_fill(seq_file_t *m) {
+    int ret = 0;
+    void *v;
+
+    m->count = 0;
+    m->from = 0;
+    m->error = 0;
+
+    v = m->op->start(m, &m->index);
+    while (v) {
+        ret = m->op->show(m, v);
+        if (ret < 0 || m->error < 0)
+            break;
+        v = m->op->next(m, v, &m->index);
+        if (m->count >= SEQ_FILL_SIZE)
+            break;
+    }
+    m->op->stop(m, v);
+
+    if (ret >= 0)
+        ret = m->error;
+    if (ret < 0)
+        m->count = 0;
+    return ret;
+}
+
+/*
+ * Someone seeked: walk from the top again, discarding whole batches until
+ * the one holding pos.
+ */
+static int seq_seek(seq_file_t *m, loff_t pos) {
+    int ret;
+
+    m->index = 0;
+    m->cursor = 0;
+    m->read_pos = 0;
+    m->count = 0;
+    m->from = 0;
+
+    while (true) {
+        ret = seq_fill(m);
+        if (ret < 0)
+            return ret;
+        if (!m->count || m->read_pos + (loff_t)m->count > pos)
+            break;
+        m->read_pos += m->count;
+    }
+
+    m->from = MIN((size_t)(pos - m->read_pos), m->count);
+    m->read_pos = pos;
+    return 0;
+}
+
+static ssize_t seq_read_locked(seq_file_t *m, void *addr, size_t size,
+                               loff_t pos) {
+    size_t copied = 0;
+    int ret;
+
+    if (pos != m->read_pos) {
+        ret = seq_seek(m, pos);
+        if (ret < 0)
+            return ret;
+    }
+
+    while (copied < size) {
+        if (m->from == m->count) {
+            ret = seq_fill(m);
+            if (ret < 0) {
+                // the batch is lost, the next read re-walks from the top
+                m->read_pos = -1;
+                return copied ? (ssize_t)copied : ret;
+            }
+            if (!m->count)
+                break;
+        }
+
+        size_t chunk = MIN(size - copied, m->count - m->from);
+        memcpy((char *)addr + copied, m->buf + m->from, chunk);
+        m->from += chunk;
+        copied += chunk;
+    }
+
+    m->read_pos += copied;
+    return copied;
+}
+
+ssize_t seq_read(seq_file_t *m, void *addr, size_t size, loff_t pos) {
+    ssize_t ret;
+
+    if (!m || !addr)
+        return -EINVAL;
+
+    sem_wait(&m->lock, (uint32_t)-1);
+    ret = seq_read_locked(m, addr, size, pos);
+    sem_post(&m->lock);
+    return ret;
+}
+
+void *seq_single_start(seq_file_t *m, loff_t *pos) {
+    (void)m;
+    return *pos == 0 ? (void *)1 : NULL;
+}
+
+void *seq_single_next(seq_file_t *m, void *v, loff_t *pos) {
+    (void)m;
+    (void)v;
+    ++*pos;
+    return NULL;
+}
+
+void seq_single_stop(seq_file_t *m, void *v) {
+    (void)m;
+    (void)v;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <fs/proc/proc.h>
+
+typedef struct seq_file seq_file_t;
+
+/*
+ * Record iterator behind a procfs file. start() positions at record *pos
+ * and takes whatever locks the walk needs, next() steps past v and bumps
+ * *pos, stop() drops the locks (v is the record not shown yet, or NULL),
+ * show() emits one record. start() runs again for every buffer refill, so
+ * it must be able to resume from *pos on its own; ops may keep a hint for
+ * that in seq_file.cursor.
+ */
+typedef struct seq_ops {
+    void *(*start)(seq_file_t *m, loff_t *pos);
+    void *(*next)(seq_file_t *m, void *v, loff_t *pos);
+    void (*stop)(seq_file_t *m, void *v);
+    int (*show)(seq_file_t *m, void *v);
+} seq_ops_t;
+
+/* Per open file: the text produced so far and where reading left off. */
+struct seq_file {
+    const seq_ops_t *op;
+    sem_t lock;           // serialises readers sharing the open file
+    proc_handle_t handle; // the file being generated
+    char *buf;
+    size_t size;      // bytes allocated at buf
+    size_t count;     // bytes generated into buf
+    size_t from;      // bytes of buf already handed out
+    loff_t index;     // next record to start() from
+    loff_t read_pos;  // file offset of buf[from]
+    uint64_t cursor;  // resume hint owned by the ops
+    void *private;    // whatever start() left for stop()
+    int error;
+};
+
+seq_file_t *seq_open(const seq_ops_t *op, const proc_handle_t *handle);
+void seq_release(seq_file_t *m);
+ssize_t seq_read(seq_file_t *m, void *addr, size_t size, loff_t pos);
+
+int seq_printf(seq_file_t *m, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+int seq_write(seq_file_t *m, const void *data, size_t len);
+int seq_puts(seq_file_t *m, const char *s);
+
+/*
+ * Files that are generated in one go: a single record, shown once per
+ * open and then read back from the buffer at any offset.
+ */
+void *seq_single_start(seq_file_t *m, loff_t *pos);
+void *seq_single_next(seq_file_t *m, void *v, loff_t *pos);
+void seq_single_stop(seq_file_t *m, void *v);
+
+#define SEQ_SINGLE_OPS(show_fn)                                                \
+    {                                                                          \
+        .start = seq_single_start, .next = seq_single_next,                    \
+        .stop = seq_single_stop, .show = (show_fn),                            \
+    }
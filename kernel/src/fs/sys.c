@@ -17,6 +17,8 @@ typedef struct sysfs_entry {
     char *link_target;
     bus_device_t *bin_device;
     bin_attribute_t *bin_attr;
+    const sysfs_attr_t *attr;
+    void *attr_ctx;
 } sysfs_entry_t;
 
 typedef struct sysfs_inode_info {
@@ -341,6 +343,24 @@ static ssize_t sysfs_entry_read(sysfs_entry_t *entry, void *buf, size_t count,
         *ppos += ret;
         return ret;
     }
+    if (entry->attr) {
+        char *page = malloc(PAGE_SIZE);
+        ssize_t len;
+
+        if (!page)
+            return -ENOMEM;
+        len = entry->attr->show(entry->attr, entry->attr_ctx, page, PAGE_SIZE);
+        if (len < 0) {
+            free(page);
+            return len;
+        }
+        offset = (size_t)*ppos;
+        to_copy = offset < (size_t)len ? MIN(count, (size_t)len - offset) : 0;
+        memcpy(buf, page + offset, to_copy);
+        free(page);
+        *ppos += (loff_t)to_copy;
+        return (ssize_t)to_copy;
+    }
 
     offset = (size_t)*ppos;
     if (offset >= entry->size)
@@ -363,6 +383,8 @@ static ssize_t sysfs_entry_write(sysfs_entry_t *entry, const void *buf,
         return entry->bin_attr->write(entry->bin_device, entry->bin_attr, buf,
                                       (uint64_t)*ppos, count);
     }
+    if (entry->attr)
+        return -EACCES;
 
     offset = (size_t)*ppos;
     need = offset + count;
@@ -792,6 +814,25 @@ vfs_node_t *sysfs_child_append_symlink(vfs_node_t *parent, const char *name,
     return inode;
 }
 
+vfs_node_t *sysfs_child_append_attr(vfs_node_t *parent,
+                                    const sysfs_attr_t *attr, void *ctx) {
+    vfs_node_t *inode;
+    sysfs_entry_t *entry;
+
+    if (!attr || !attr->show)
+        return NULL;
+
+    inode = sysfs_child_append(parent, attr->name, false);
+    entry = sysfs_entry_from_inode(inode);
+    if (entry) {
+        entry->mode = S_IFREG | 0444;
+        entry->attr = attr;
+        entry->attr_ctx = ctx;
+        inode->i_mode = entry->mode;
+    }
+    return inode;
+}
+
 vfs_node_t *sysfs_regist_dev(char t, int major, int minor,
                              const char *real_device_path, const char *dev_name,
                              const char *other_uevent_content,
@@ -11,6 +11,14 @@ typedef struct sysfs_node {
     int capability;
 } sysfs_node_t;
 
+/* A read-only file whose content is generated by show() on every read. */
+typedef struct sysfs_attr {
+    const char *name;
+    ssize_t (*show)(const struct sysfs_attr *attr, void *ctx, char *buf,
+                    size_t size);
+    size_t arg;
+} sysfs_attr_t;
+
 void sysfs_init();
 void sysfs_init_umount();
 
@@ -33,6 +41,8 @@ vfs_node_t *sysfs_child_append(vfs_node_t *parent, const char *name,
                                bool is_dir);
 vfs_node_t *sysfs_child_append_symlink(vfs_node_t *parent, const char *name,
                                        const char *target_path);
+vfs_node_t *sysfs_child_append_attr(vfs_node_t *parent,
+                                    const sysfs_attr_t *attr, void *ctx);
 int sysfs_write_node(vfs_node_t *node, const void *buf, size_t len,
                      size_t offset);
 char *sysfs_node_path(vfs_node_t *node);
@@ -1986,11 +1986,101 @@ uint64_t sys_pwrite64(int fd, const void *buf, size_t len, uint64_t offset) {
 // Use a large sendfile buffer to optimize the speed
 #define SENDFILE_BUFFER_SIZE (1 * 1024 * 1024)
 
+typedef struct generic_sendpage_ctx {
+    struct vfs_file *out;
+    int flags;
+} generic_sendpage_ctx_t;
+
+static ssize_t generic_sendpage_actor(void *data, uint64_t paddr,
+                                      size_t offset, size_t len) {
+    generic_sendpage_ctx_t *ctx = data;
+    return sockfs_sendpage(ctx->out, paddr, offset, len, ctx->flags);
+}
+
+static bool generic_can_splice_pages(struct vfs_file *in,
+                                     struct vfs_file *out) {
+    return page_cache_can_splice(in) &&
+           (pipefs_is_pipe(out) || S_ISSOCK(out->f_inode->i_mode));
+}
+
+/*
+ * Moves up to count bytes of a cached file into a pipe or socket by page
+ * reference. Keeps going until count, EOF, or an error after some progress.
+ */
+static ssize_t generic_splice_pages(struct vfs_file *in, loff_t *ppos,
+                                    struct vfs_file *out, size_t count,
+                                    bool nonblock) {
+    generic_sendpage_ctx_t ctx = {
+        .out = out,
+        .flags = nonblock ? MSG_DONTWAIT : 0,
+    };
+    size_t total = 0;
+
+    while (total < count) {
+        ssize_t ret;
+
+        if (pipefs_is_pipe(out))
+            ret = pipefs_splice_from_page_cache(in, ppos, out, count - total,
+                                                nonblock);
+        else
+            ret = page_cache_splice_read(in, ppos, count - total,
+                                         generic_sendpage_actor, &ctx);
+        if (ret < 0)
+            return total ? (ssize_t)total : ret;
+        if (ret == 0)
+            break;
+        total += (size_t)ret;
+    }
+
+    return (ssize_t)total;
+}
+
+static ssize_t sendfile_copy(struct vfs_file *in, struct vfs_file *out,
+                             uint64_t *offset, size_t count) {
+    size_t total_sent = 0;
+    size_t remaining = count;
+    char *buffer = (char *)alloc_frames_bytes(SENDFILE_BUFFER_SIZE);
+
+    if (buffer == NULL)
+        return -ENOMEM;
+
+    while (remaining > 0) {
+        size_t bytes_to_read = MIN(remaining, SENDFILE_BUFFER_SIZE);
+        loff_t read_pos = (loff_t)*offset;
+        ssize_t bytes_read = vfs_read_file(in, buffer, bytes_to_read, &read_pos);
+        ssize_t bytes_written = 0;
+
+        if (bytes_read <= 0) {
+            if (bytes_read < 0 && total_sent == 0) {
+                free_frames_bytes(buffer, SENDFILE_BUFFER_SIZE);
+                return bytes_read;
+            }
+            break;
+        }
+        bytes_written = vfs_write_file(out, buffer, bytes_read, NULL);
+        if (bytes_written <= 0) {
+            if (total_sent == 0) {
+                free_frames_bytes(buffer, SENDFILE_BUFFER_SIZE);
+                return bytes_written < 0 ? bytes_written : 0;
+            }
+            break;
+        }
+        if (bytes_written < bytes_read) {
+            bytes_read = bytes_written;
+        }
+        *offset += bytes_read;
+        total_sent += bytes_read;
+        remaining -= bytes_read;
+    }
+    free_frames_bytes(buffer, SENDFILE_BUFFER_SIZE);
+    return (ssize_t)total_sent;
+}
+
 uint64_t sys_sendfile(uint64_t out_fd, uint64_t in_fd, int *offset_ptr,
                       size_t count) {
     fd_t *out_handle = task_get_file(current_task, (int)out_fd);
     fd_t *in_handle = task_get_file(current_task, (int)in_fd);
-    loff_t read_pos = 0;
+    ssize_t ret;
     if (out_handle == NULL || in_handle == NULL) {
         vfs_file_put(out_handle);
         vfs_file_put(in_handle);
@@ -1998,8 +2088,6 @@ uint64_t sys_sendfile(uint64_t out_fd, uint64_t in_fd, int *offset_ptr,
     }
 
     uint64_t current_offset = fd_get_offset(in_handle);
-    size_t total_sent = 0;
-    size_t remaining = count;
 
     if (offset_ptr != NULL) {
         int user_offset = 0;
@@ -2024,46 +2112,19 @@ uint64_t sys_sendfile(uint64_t out_fd, uint64_t in_fd, int *offset_ptr,
         current_offset = (uint64_t)user_offset;
     }
 
-    char *buffer = (char *)alloc_frames_bytes(SENDFILE_BUFFER_SIZE);
-    if (buffer == NULL) {
+    if (generic_can_splice_pages(in_handle, out_handle)) {
+        loff_t pos = (loff_t)current_offset;
+        ret = generic_splice_pages(in_handle, &pos, out_handle, count, false);
+        current_offset = (uint64_t)pos;
+    } else {
+        ret = sendfile_copy(in_handle, out_handle, &current_offset, count);
+    }
+    if (ret < 0) {
         vfs_file_put(out_handle);
         vfs_file_put(in_handle);
-        return -ENOMEM;
+        return (uint64_t)ret;
     }
 
-    while (remaining > 0) {
-        size_t bytes_to_read = MIN(remaining, SENDFILE_BUFFER_SIZE);
-        ssize_t bytes_read = 0;
-        ssize_t bytes_written = 0;
-        read_pos = (loff_t)current_offset;
-        bytes_read = vfs_read_file(in_handle, buffer, bytes_to_read, &read_pos);
-        if (bytes_read <= 0) {
-            if (bytes_read < 0 && total_sent == 0) {
-                free_frames_bytes(buffer, SENDFILE_BUFFER_SIZE);
-                vfs_file_put(out_handle);
-                vfs_file_put(in_handle);
-                return (uint64_t)bytes_read;
-            }
-            break;
-        }
-        bytes_written = vfs_write_file(out_handle, buffer, bytes_read, NULL);
-        if (bytes_written <= 0) {
-            if (total_sent == 0) {
-                free_frames_bytes(buffer, SENDFILE_BUFFER_SIZE);
-                vfs_file_put(out_handle);
-                vfs_file_put(in_handle);
-                return bytes_written < 0 ? (uint64_t)bytes_written : 0;
-            }
-            break;
-        }
-        if (bytes_written < bytes_read) {
-            bytes_read = bytes_written;
-        }
-        current_offset += bytes_read;
-        total_sent += bytes_read;
-        remaining -= bytes_read;
-    }
-    free_frames_bytes(buffer, SENDFILE_BUFFER_SIZE);
     if (offset_ptr != NULL) {
         int out_offset =
             current_offset > (uint64_t)INT_MAX ? INT_MAX : (int)current_offset;
@@ -2077,7 +2138,7 @@ uint64_t sys_sendfile(uint64_t out_fd, uint64_t in_fd, int *offset_ptr,
     }
     vfs_file_put(out_handle);
     vfs_file_put(in_handle);
-    return total_sent;
+    return (uint64_t)ret;
 }
 
 static ssize_t generic_splice_fallback(struct vfs_file *in,
@@ -2182,8 +2243,20 @@ uint64_t sys_splice(uint64_t fd_in, int64_t *off_in, uint64_t fd_out,
             vfs_file_put(out);
             return -ESPIPE;
         }
-        ret = generic_splice_fallback(
-            in, out, len, in_pos_valid ? &in_pos : NULL, NULL, nonblock);
+        if (page_cache_can_splice(in)) {
+            loff_t pos = in_pos_valid ? in_pos : (loff_t)fd_get_offset(in);
+            ret = pipefs_splice_from_page_cache(in, &pos, out, len, nonblock);
+            if (ret > 0 && !in_pos_valid)
+                fd_set_offset(in, (uint64_t)pos);
+        } else {
+            ret = generic_splice_fallback(
+                in, out, len, in_pos_valid ? &in_pos : NULL, NULL, nonblock);
+        }
+    } else if (!off_out && generic_can_splice_pages(in, out)) {
+        loff_t pos = in_pos_valid ? in_pos : (loff_t)fd_get_offset(in);
+        ret = generic_splice_pages(in, &pos, out, len, nonblock);
+        if (ret > 0 && !in_pos_valid)
+            fd_set_offset(in, (uint64_t)pos);
     } else {
         ret =
             generic_splice_fallback(in, out, len, in_pos_valid ? &in_pos : NULL,
@@ -1,8 +1,12 @@
 #include <fs/vfs/cgroup/cgroupfs.h>
+#include <block/blkcg.h>
 #include <cgroup/cgroup.h>
 #include <fs/fs_syscall.h>
 #include <fs/vfs/vfs.h>
 #include <libs/string_builder.h>
+#include <mm/memcg.h>
+#include <task/psi.h>
+#include <task/sched.h>
 #include <task/task.h>
 
 typedef enum cgroupfs_controller_mask {
@@ -28,6 +32,21 @@ typedef enum cgroupfs_inode_kind {
     CGROUPFS_INODE_CGROUP_MAX_DEPTH,
     CGROUPFS_INODE_CGROUP_MAX_DESCENDANTS,
     CGROUPFS_INODE_CGROUP_STAT,
+    CGROUPFS_INODE_CPU_PRESSURE,
+    CGROUPFS_INODE_IO_PRESSURE,
+    CGROUPFS_INODE_MEMORY_PRESSURE,
+    CGROUPFS_INODE_CPU_WEIGHT,
+    CGROUPFS_INODE_CPU_MAX,
+    CGROUPFS_INODE_CPU_STAT,
+    CGROUPFS_INODE_MEMORY_CURRENT,
+    CGROUPFS_INODE_MEMORY_MAX,
+    CGROUPFS_INODE_MEMORY_HIGH,
+    CGROUPFS_INODE_MEMORY_LOW,
+    CGROUPFS_INODE_MEMORY_STAT,
+    CGROUPFS_INODE_MEMORY_EVENTS,
+    CGROUPFS_INODE_IO_WEIGHT,
+    CGROUPFS_INODE_IO_MAX,
+    CGROUPFS_INODE_IO_STAT,
 } cgroupfs_inode_kind_t;
 
 typedef struct cgroupfs_dirent {
@@ -416,19 +435,69 @@ static char *cgroupfs_build_members_file(cgroup_t *cgroup, bool threads,
     return data;
 }
 
+static int cgroupfs_pressure_resource(cgroupfs_inode_kind_t kind) {
+    switch (kind) {
+    case CGROUPFS_INODE_CPU_PRESSURE:
+        return PSI_CPU;
+    case CGROUPFS_INODE_IO_PRESSURE:
+        return PSI_IO;
+    case CGROUPFS_INODE_MEMORY_PRESSURE:
+        return PSI_MEM;
+    default:
+        return -1;
+    }
+}
+
 static char *cgroupfs_build_file(cgroupfs_inode_info_t *info,
                                  size_t *content_len) {
+    mem_cgroup_t *memcg;
     string_builder_t *builder;
     uint32_t mask;
 
     if (!info || !info->cgroup || !content_len)
         return NULL;
 
+    memcg = cgroup_memcg(info->cgroup);
+
     switch (info->kind) {
     case CGROUPFS_INODE_CGROUP_PROCS:
         return cgroupfs_build_members_file(info->cgroup, false, content_len);
     case CGROUPFS_INODE_CGROUP_THREADS:
         return cgroupfs_build_members_file(info->cgroup, true, content_len);
+    case CGROUPFS_INODE_CPU_PRESSURE:
+    case CGROUPFS_INODE_IO_PRESSURE:
+    case CGROUPFS_INODE_MEMORY_PRESSURE:
+        return psi_show(cgroup_psi(info->cgroup),
+                        (psi_res_t)cgroupfs_pressure_resource(info->kind),
+                        content_len);
+    case CGROUPFS_INODE_CPU_WEIGHT:
+        return sched_group_show_weight(cgroup_sched(info->cgroup),
+                                       content_len);
+    case CGROUPFS_INODE_CPU_MAX:
+        return sched_group_show_max(cgroup_sched(info->cgroup), content_len);
+    case CGROUPFS_INODE_CPU_STAT:
+        return sched_group_show_stat(cgroup_sched(info->cgroup), content_len);
+    case CGROUPFS_INODE_MEMORY_CURRENT:
+        return mem_cgroup_show_current(memcg, content_len);
+    case CGROUPFS_INODE_MEMORY_MAX:
+        return mem_cgroup_show_limit(memcg, memcg ? &memcg->max : NULL,
+                                     content_len);
+    case CGROUPFS_INODE_MEMORY_HIGH:
+        return mem_cgroup_show_limit(memcg, memcg ? &memcg->high : NULL,
+                                     content_len);
+    case CGROUPFS_INODE_MEMORY_LOW:
+        return mem_cgroup_show_limit(memcg, memcg ? &memcg->low : NULL,
+                                     content_len);
+    case CGROUPFS_INODE_MEMORY_STAT:
+        return mem_cgroup_show_stat(memcg, content_len);
+    case CGROUPFS_INODE_MEMORY_EVENTS:
+        return mem_cgroup_show_events(memcg, content_len);
+    case CGROUPFS_INODE_IO_WEIGHT:
+        return blkcg_show_weight(cgroup_blkcg(info->cgroup), content_len);
+    case CGROUPFS_INODE_IO_MAX:
+        return blkcg_show_max(cgroup_blkcg(info->cgroup), content_len);
+    case CGROUPFS_INODE_IO_STAT:
+        return blkcg_show_stat(cgroup_blkcg(info->cgroup), content_len);
     default:
         break;
     }
@@ -509,6 +578,135 @@ static int cgroupfs_parse_u64(const char *buf, uint64_t *value) {
     return 0;
 }
 
+static int cgroupfs_write_cpu_weight(cgroup_t *cgroup, const char *buf) {
+    uint64_t weight;
+    int ret = cgroupfs_parse_u64(buf, &weight);
+
+    if (ret < 0)
+        return ret;
+    return sched_group_set_weight(cgroup_sched(cgroup), weight);
+}
+
+/* "$MAX $PERIOD" in microseconds, MAX may be "max" and PERIOD left out. */
+static int cgroupfs_write_cpu_max(cgroup_t *cgroup, const char *buf) {
+    sched_group_t *group = cgroup_sched(cgroup);
+    uint64_t quota_us = 0;
+    uint64_t period_us;
+    bool unlimited = false;
+    bool digits = false;
+
+    if (!group)
+        return -EINVAL;
+
+    spin_lock(&group->lock);
+    period_us = group->period_ns / 1000;
+    spin_unlock(&group->lock);
+
+    while (*buf == ' ' || *buf == '\t')
+        buf++;
+    if (!strncmp(buf, "max", 3)) {
+        unlimited = true;
+        buf += 3;
+    } else {
+        while (*buf >= '0' && *buf <= '9') {
+            quota_us = quota_us * 10 + (uint64_t)(*buf - '0');
+            digits = true;
+            buf++;
+        }
+        if (!digits)
+            return -EINVAL;
+    }
+
+    if (*buf == ' ' || *buf == '\t') {
+        while (*buf == ' ' || *buf == '\t')
+            buf++;
+        if (*buf && *buf != '\n') {
+            int ret = cgroupfs_parse_u64(buf, &period_us);
+
+            if (ret < 0)
+                return ret;
+            buf = "";
+        }
+    }
+    while (*buf == '\n')
+        buf++;
+    if (*buf)
+        return -EINVAL;
+
+    return sched_group_set_bandwidth(
+        group, unlimited ? SCHED_BW_UNLIMITED : quota_us * 1000,
+        period_us * 1000);
+}
+
+/* "max" or a byte count with an optional K/M/G/T suffix, in pages. */
+static int cgroupfs_parse_memory(const char *buf, uint64_t *pages) {
+    uint64_t bytes = 0;
+    bool digits = false;
+
+    while (*buf == ' ' || *buf == '\t')
+        buf++;
+    if (!strncmp(buf, "max", 3)) {
+        *pages = MEMCG_LIMIT_MAX;
+        buf += 3;
+    } else {
+        while (*buf >= '0' && *buf <= '9') {
+            bytes = bytes * 10 + (uint64_t)(*buf - '0');
+            digits = true;
+            buf++;
+        }
+        if (!digits)
+            return -EINVAL;
+
+        switch (*buf) {
+        case 'T':
+        case 't':
+            bytes <<= 10;
+            // fallthrough
+        case 'G':
+        case 'g':
+            bytes <<= 10;
+            // fallthrough
+        case 'M':
+        case 'm':
+            bytes <<= 10;
+            // fallthrough
+        case 'K':
+        case 'k':
+            bytes <<= 10;
+            buf++;
+            break;
+        default:
+            break;
+        }
+        *pages = bytes / PAGE_SIZE;
+    }
+
+    while (*buf == ' ' || *buf == '\t' || *buf == '\n')
+        buf++;
+    return *buf ? -EINVAL : 0;
+}
+
+static int cgroupfs_write_memory(cgroup_t *cgroup, cgroupfs_inode_kind_t kind,
+                                 const char *buf) {
+    mem_cgroup_t *memcg = cgroup_memcg(cgroup);
+    uint64_t pages;
+    int ret = cgroupfs_parse_memory(buf, &pages);
+
+    if (ret < 0)
+        return ret;
+
+    switch (kind) {
+    case CGROUPFS_INODE_MEMORY_MAX:
+        return mem_cgroup_set_max(memcg, pages);
+    case CGROUPFS_INODE_MEMORY_HIGH:
+        return mem_cgroup_set_high(memcg, pages);
+    case CGROUPFS_INODE_MEMORY_LOW:
+        return mem_cgroup_set_low(memcg, pages);
+    default:
+        return -EINVAL;
+    }
+}
+
 static int cgroupfs_write_procs(cgroup_t *cgroup, uint64_t pid, bool threads) {
     task_t *task = NULL;
     uint64_t *pids = NULL;
@@ -708,6 +906,59 @@ static int cgroupfs_populate_dir(struct vfs_inode *dir) {
     if (cgroupfs_create_control_file(dir, "cgroup.stat",
                                      CGROUPFS_INODE_CGROUP_STAT, 0444) < 0)
         return -ENOMEM;
+    if (!cgroup_psi(cgroupfs_i(dir)->cgroup))
+        return 0;
+    if (cgroupfs_create_control_file(dir, "cpu.pressure",
+                                     CGROUPFS_INODE_CPU_PRESSURE, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "io.pressure",
+                                     CGROUPFS_INODE_IO_PRESSURE, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "memory.pressure",
+                                     CGROUPFS_INODE_MEMORY_PRESSURE, 0644) < 0)
+        return -ENOMEM;
+    if (!cgroup_sched(cgroupfs_i(dir)->cgroup))
+        return 0;
+    if (cgroupfs_create_control_file(dir, "cpu.weight",
+                                     CGROUPFS_INODE_CPU_WEIGHT, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "cpu.max", CGROUPFS_INODE_CPU_MAX,
+                                     0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "cpu.stat", CGROUPFS_INODE_CPU_STAT,
+                                     0444) < 0)
+        return -ENOMEM;
+    if (!cgroup_memcg(cgroupfs_i(dir)->cgroup))
+        return 0;
+    if (cgroupfs_create_control_file(dir, "memory.current",
+                                     CGROUPFS_INODE_MEMORY_CURRENT, 0444) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "memory.max",
+                                     CGROUPFS_INODE_MEMORY_MAX, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "memory.high",
+                                     CGROUPFS_INODE_MEMORY_HIGH, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "memory.low",
+                                     CGROUPFS_INODE_MEMORY_LOW, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "memory.stat",
+                                     CGROUPFS_INODE_MEMORY_STAT, 0444) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "memory.events",
+                                     CGROUPFS_INODE_MEMORY_EVENTS, 0444) < 0)
+        return -ENOMEM;
+    if (!cgroup_blkcg(cgroupfs_i(dir)->cgroup))
+        return 0;
+    if (cgroupfs_create_control_file(dir, "io.weight",
+                                     CGROUPFS_INODE_IO_WEIGHT, 0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "io.max", CGROUPFS_INODE_IO_MAX,
+                                     0644) < 0)
+        return -ENOMEM;
+    if (cgroupfs_create_control_file(dir, "io.stat", CGROUPFS_INODE_IO_STAT,
+                                     0444) < 0)
+        return -ENOMEM;
     return 0;
 }
 
@@ -876,6 +1127,36 @@ static ssize_t cgroupfs_write(struct vfs_file *file, const void *buf,
     case CGROUPFS_INODE_CGROUP_FREEZE:
         ret = cgroupfs_write_freeze(info->cgroup, copy);
         break;
+    case CGROUPFS_INODE_CPU_WEIGHT:
+        ret = cgroupfs_write_cpu_weight(info->cgroup, copy);
+        break;
+    case CGROUPFS_INODE_CPU_MAX:
+        ret = cgroupfs_write_cpu_max(info->cgroup, copy);
+        break;
+    case CGROUPFS_INODE_MEMORY_MAX:
+    case CGROUPFS_INODE_MEMORY_HIGH:
+    case CGROUPFS_INODE_MEMORY_LOW:
+        ret = cgroupfs_write_memory(info->cgroup, info->kind, copy);
+        break;
+    case CGROUPFS_INODE_IO_WEIGHT:
+        ret = blkcg_set_weight(cgroup_blkcg(info->cgroup), copy);
+        break;
+    case CGROUPFS_INODE_IO_MAX:
+        ret = blkcg_set_max(cgroup_blkcg(info->cgroup), copy);
+        break;
+    case CGROUPFS_INODE_CPU_PRESSURE:
+    case CGROUPFS_INODE_IO_PRESSURE:
+    case CGROUPFS_INODE_MEMORY_PRESSURE:
+        // one trigger per open file, dropped on close
+        if (file->private_data) {
+            ret = -EBUSY;
+            break;
+        }
+        ret = psi_trigger_create(
+            cgroup_psi(info->cgroup),
+            (psi_res_t)cgroupfs_pressure_resource(info->kind), copy, count,
+            file->f_inode, (psi_trigger_t **)&file->private_data);
+        break;
     default:
         ret = -EOPNOTSUPP;
         break;
@@ -890,6 +1171,28 @@ static int cgroupfs_open(struct vfs_inode *inode, struct vfs_file *file) {
     return 0;
 }
 
+static int cgroupfs_release(struct vfs_inode *inode, struct vfs_file *file) {
+    (void)inode;
+    if (file && cgroupfs_pressure_resource(cgroupfs_i(file->f_inode)->kind) >=
+                    0) {
+        psi_trigger_destroy(file->private_data);
+        file->private_data = NULL;
+    }
+    return 0;
+}
+
+static __poll_t cgroupfs_poll(struct vfs_file *file,
+                              struct vfs_poll_table *pt) {
+    cgroupfs_inode_info_t *info = cgroupfs_i(file->f_inode);
+
+    (void)pt;
+    if (!info)
+        return EPOLLNVAL;
+    if (cgroupfs_pressure_resource(info->kind) < 0)
+        return EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+    return (__poll_t)psi_trigger_poll(file->private_data);
+}
+
 static int cgroupfs_init_fs_context(struct vfs_fs_context *fc) {
     cgroupfs_fs_info_t *fsi;
 
@@ -994,6 +1297,8 @@ static const struct vfs_file_operations cgroupfs_file_ops = {
     .read = cgroupfs_read,
     .write = cgroupfs_write,
     .open = cgroupfs_open,
+    .release = cgroupfs_release,
+    .poll = cgroupfs_poll,
 };
 
 static struct vfs_file_system_type cgroupfs_fs_type = {
@@ -0,0 +1,1006 @@
+#include <fs/vfs/tracefs/tracefs.h>
+#include <arch/arch.h>
+#include <fs/fs_syscall.h>
+#include <fs/vfs/vfs.h>
+#include <libs/string_builder.h>
+#include <task/task.h>
+#include <task/trace.h>
+
+typedef enum tracefs_inode_kind {
+    TRACEFS_INODE_DIR = 0,
+    TRACEFS_INODE_TRACING_ON,
+    TRACEFS_INODE_BUFFER_SIZE_KB,
+    TRACEFS_INODE_BUFFER_TOTAL_SIZE_KB,
+    TRACEFS_INODE_TRACE,
+    TRACEFS_INODE_TRACE_PIPE,
+    TRACEFS_INODE_AVAILABLE_EVENTS,
+    TRACEFS_INODE_SET_EVENT,
+    TRACEFS_INODE_EVENTS_ENABLE,
+    TRACEFS_INODE_SYSTEM_ENABLE,
+    TRACEFS_INODE_EVENT_ENABLE,
+    TRACEFS_INODE_EVENT_ID,
+    TRACEFS_INODE_EVENT_FORMAT,
+    TRACEFS_INODE_CPU_TRACE,
+    TRACEFS_INODE_CPU_TRACE_PIPE,
+    TRACEFS_INODE_CPU_TRACE_PIPE_RAW,
+    TRACEFS_INODE_CPU_STATS,
+} tracefs_inode_kind_t;
+
+typedef struct tracefs_dirent {
+    struct llist_header node;
+    char *name;
+    struct vfs_inode *inode;
+} tracefs_dirent_t;
+
+typedef struct tracefs_inode_info {
+    struct vfs_inode vfs_inode;
+    struct llist_header children;
+    tracefs_inode_kind_t kind;
+    int arg;            // event id or cpu, -1 when neither
+    const char *system; // for events/<system>/enable
+} tracefs_inode_info_t;
+
+#define TRACEFS_LINE_MAX 512
+
+/* Per open file: the snapshot of trace, or a reader's cursor. */
+typedef struct tracefs_file {
+    struct llist_header node; // in tracefs_readers, for pipes
+    struct vfs_inode *inode;
+    trace_cursor_t cursor;
+    char *text; // whole snapshot for trace, else points into line
+    size_t text_len;
+    size_t text_off;
+    char line[TRACEFS_LINE_MAX];
+} tracefs_file_t;
+
+static struct vfs_file_system_type tracefs_fs_type;
+static const struct vfs_super_operations tracefs_super_ops;
+static const struct vfs_inode_operations tracefs_inode_ops;
+static const struct vfs_file_operations tracefs_dir_file_ops;
+static const struct vfs_file_operations tracefs_file_ops;
+
+static spinlock_t tracefs_readers_lock = SPIN_INIT;
+static struct llist_header tracefs_readers;
+
+static inline tracefs_inode_info_t *tracefs_i(struct vfs_inode *inode) {
+    return inode ? container_of(inode, tracefs_inode_info_t, vfs_inode) : NULL;
+}
+
+static bool tracefs_kind_is_pipe(tracefs_inode_kind_t kind) {
+    return kind == TRACEFS_INODE_TRACE_PIPE ||
+           kind == TRACEFS_INODE_CPU_TRACE_PIPE ||
+           kind == TRACEFS_INODE_CPU_TRACE_PIPE_RAW;
+}
+
+static bool tracefs_kind_is_snapshot(tracefs_inode_kind_t kind) {
+    return kind == TRACEFS_INODE_TRACE || kind == TRACEFS_INODE_CPU_TRACE;
+}
+
+static struct vfs_inode *tracefs_alloc_inode(struct vfs_super_block *sb) {
+    tracefs_inode_info_t *info = calloc(1, sizeof(*info));
+    (void)sb;
+    return info ? &info->vfs_inode : NULL;
+}
+
+static void tracefs_destroy_inode(struct vfs_inode *inode) {
+    free(tracefs_i(inode));
+}
+
+static void tracefs_evict_inode(struct vfs_inode *inode) {
+    tracefs_inode_info_t *info = tracefs_i(inode);
+    tracefs_dirent_t *de, *tmp;
+
+    if (!info || info->kind != TRACEFS_INODE_DIR)
+        return;
+
+    llist_for_each(de, tmp, &info->children, node) {
+        llist_delete(&de->node);
+        if (de->inode)
+            vfs_iput(de->inode);
+        free(de->name);
+        free(de);
+    }
+}
+
+static int tracefs_statfs(struct vfs_path *path, void *buf) {
+    struct statfs *st = (struct statfs *)buf;
+
+    (void)path;
+    if (!st)
+        return -EINVAL;
+
+    memset(st, 0, sizeof(*st));
+    st->f_type = 0x74726163ULL;
+    st->f_bsize = PAGE_SIZE;
+    st->f_frsize = PAGE_SIZE;
+    st->f_namelen = 255;
+    return 0;
+}
+
+static struct vfs_inode *tracefs_new_inode(struct vfs_super_block *sb,
+                                           tracefs_inode_kind_t kind, int arg,
+                                           umode_t mode) {
+    struct vfs_inode *inode = vfs_alloc_inode(sb);
+    tracefs_inode_info_t *info = tracefs_i(inode);
+
+    if (!inode)
+        return NULL;
+
+    llist_init_head(&info->children);
+    info->kind = kind;
+    info->arg = arg;
+
+    inode->i_op = &tracefs_inode_ops;
+    inode->i_fop = kind == TRACEFS_INODE_DIR ? &tracefs_dir_file_ops
+                                             : &tracefs_file_ops;
+    inode->i_mode = mode;
+    inode->i_uid = 0;
+    inode->i_gid = 0;
+    inode->i_nlink = kind == TRACEFS_INODE_DIR ? 2 : 1;
+    inode->i_ino = (ino64_t)(uintptr_t)inode;
+    inode->inode = inode->i_ino;
+    inode->i_blkbits = 12;
+    return inode;
+}
+
+static tracefs_dirent_t *tracefs_find_dirent(struct vfs_inode *dir,
+                                             const char *name) {
+    tracefs_dirent_t *de, *tmp;
+
+    llist_for_each(de, tmp, &tracefs_i(dir)->children, node) {
+        if (de->name && streq(de->name, name))
+            return de;
+    }
+    return NULL;
+}
+
+static int tracefs_add_dirent(struct vfs_inode *dir, const char *name,
+                              struct vfs_inode *inode) {
+    tracefs_dirent_t *de = calloc(1, sizeof(*de));
+
+    if (!de)
+        return -ENOMEM;
+
+    de->name = strdup(name);
+    if (!de->name) {
+        free(de);
+        return -ENOMEM;
+    }
+
+    de->inode = vfs_igrab(inode);
+    llist_init_head(&de->node);
+    llist_append(&tracefs_i(dir)->children, &de->node);
+    return 0;
+}
+
+/* Returns the new inode without a reference of its own; dir keeps one. */
+static struct vfs_inode *tracefs_create(struct vfs_inode *dir,
+                                        const char *name,
+                                        tracefs_inode_kind_t kind, int arg,
+                                        umode_t mode) {
+    struct vfs_inode *inode;
+    int ret;
+
+    inode = tracefs_new_inode(dir->i_sb, kind, arg,
+                              (kind == TRACEFS_INODE_DIR ? S_IFDIR : S_IFREG) |
+                                  mode);
+    if (!inode)
+        return NULL;
+
+    ret = tracefs_add_dirent(dir, name, inode);
+    vfs_iput(inode);
+    if (ret < 0)
+        return NULL;
+    if (kind == TRACEFS_INODE_DIR)
+        dir->i_nlink++;
+    return inode;
+}
+
+/* Events */
+
+static bool tracefs_event_match(trace_event_id_t id, const char *system,
+                                const char *name) {
+    const trace_event_desc_t *desc = &trace_events[id];
+
+    if (system && !streq(system, "*") && !streq(system, desc->system))
+        return false;
+    return !name || streq(name, "*") || streq(name, desc->name);
+}
+
+/* '0', '1', or 'X' when only some of the matching events are on. */
+static char tracefs_enable_state(const char *system) {
+    bool any_on = false, any_off = false;
+
+    for (int id = 0; id < NR_TRACE_EVENTS; id++) {
+        if (!tracefs_event_match(id, system, NULL))
+            continue;
+        if (trace_event_is_enabled(id))
+            any_on = true;
+        else
+            any_off = true;
+    }
+    if (any_on && any_off)
+        return 'X';
+    return any_on ? '1' : '0';
+}
+
+static int tracefs_set_events(const char *system, const char *name,
+                              bool enabled) {
+    int matched = 0;
+
+    for (int id = 0; id < NR_TRACE_EVENTS; id++) {
+        int ret;
+
+        if (!tracefs_event_match(id, system, name))
+            continue;
+        ret = trace_event_set_enabled(id, enabled);
+        if (ret < 0)
+            return ret;
+        matched++;
+    }
+    return matched ? 0 : -EINVAL;
+}
+
+/* "sched:sched_switch", "sched:*", "sched_switch", "!irq:*", ... */
+static int tracefs_write_set_event(char *buf) {
+    char *token = buf;
+
+    while (*token) {
+        char *end, *colon, *system = NULL, *name;
+        bool enabled = true;
+        int ret;
+
+        while (*token == ' ' || *token == '\t' || *token == '\n')
+            token++;
+        if (!*token)
+            break;
+        end = token;
+        while (*end && *end != ' ' && *end != '\t' && *end != '\n')
+            end++;
+        if (*end)
+            *end++ = '\0';
+
+        if (*token == '!') {
+            enabled = false;
+            token++;
+        }
+        name = token;
+        colon = strchr(token, ':');
+        if (colon) {
+            *colon = '\0';
+            system = token;
+            name = colon + 1;
+            if (!*name)
+                name = "*";
+        }
+
+        ret = tracefs_set_events(system, name, enabled);
+        if (ret < 0)
+            return ret;
+        token = end;
+    }
+    return 0;
+}
+
+static void tracefs_append_format(string_builder_t *builder,
+                                  trace_event_id_t id) {
+    const trace_event_desc_t *desc = &trace_events[id];
+
+    string_builder_append(builder, "name: %s\nID: %u\nformat:\n", desc->name,
+                          (uint32_t)id + 1);
+    string_builder_append(
+        builder,
+        "\tfield:unsigned short common_type;\toffset:%u;\tsize:%u;"
+        "\tsigned:0;\n"
+        "\tfield:unsigned short common_size;\toffset:%u;\tsize:%u;"
+        "\tsigned:0;\n"
+        "\tfield:int common_pid;\toffset:%u;\tsize:%u;\tsigned:1;\n"
+        "\tfield:u64 common_ts;\toffset:%u;\tsize:%u;\tsigned:0;\n\n",
+        (uint32_t)offsetof(trace_entry_t, type),
+        (uint32_t)sizeof(((trace_entry_t *)0)->type),
+        (uint32_t)offsetof(trace_entry_t, size),
+        (uint32_t)sizeof(((trace_entry_t *)0)->size),
+        (uint32_t)offsetof(trace_entry_t, pid),
+        (uint32_t)sizeof(((trace_entry_t *)0)->pid),
+        (uint32_t)offsetof(trace_entry_t, ts),
+        (uint32_t)sizeof(((trace_entry_t *)0)->ts));
+
+    for (size_t i = 0; i < desc->nr_fields; i++) {
+        const trace_field_t *field = &desc->fields[i];
+
+        string_builder_append(builder,
+                              "\tfield:%s;\toffset:%u;\tsize:%u;\tsigned:%d;\n",
+                              field->decl, field->offset, field->size,
+                              field->is_signed ? 1 : 0);
+    }
+    string_builder_append(builder, "\nprint fmt: %s\n", desc->print_fmt);
+}
+
+/* Snapshot of one CPU's buffer, or of all of them merged, as text. */
+static void tracefs_append_trace(string_builder_t *builder, int cpu,
+                                 tracefs_file_t *tf) {
+    uint8_t record[TRACE_RECORD_MAX] __attribute__((aligned(8)));
+    char header[512];
+    uint32_t from;
+    size_t size;
+
+    if (trace_format_header(header, sizeof(header)) > 0)
+        string_builder_append(builder, "%s", header);
+
+    trace_cursor_init(&tf->cursor, cpu, false);
+    while (true) {
+        trace_read_lock();
+        size = trace_cursor_peek(&tf->cursor, record, &from);
+        if (size)
+            trace_cursor_advance(&tf->cursor, from, size);
+        trace_read_unlock();
+        if (!size)
+            break;
+        trace_format_record(record, from, tf->line, sizeof(tf->line));
+        string_builder_append(builder, "%s", tf->line);
+    }
+}
+
+static void tracefs_append_stats(string_builder_t *builder, uint32_t cpu) {
+    trace_cpu_stats_t stats;
+    uint64_t now = nano_time();
+
+    trace_cpu_stats(cpu, &stats);
+    string_builder_append(
+        builder,
+        "entries: %llu\noverrun: %llu\ncommit overrun: 0\nbytes: %llu\n"
+        "oldest event ts: %5llu.%06llu\nnow ts: %5llu.%06llu\n"
+        "dropped events: %llu\nread events: %llu\n",
+        (unsigned long long)stats.entries, (unsigned long long)stats.overrun,
+        (unsigned long long)stats.bytes,
+        (unsigned long long)(stats.oldest_ts / 1000000000ULL),
+        (unsigned long long)(stats.oldest_ts % 1000000000ULL / 1000),
+        (unsigned long long)(now / 1000000000ULL),
+        (unsigned long long)(now % 1000000000ULL / 1000),
+        (unsigned long long)stats.dropped,
+        (unsigned long long)stats.read_events);
+}
+
+static char *tracefs_build_file(tracefs_inode_info_t *info,
+                                size_t *content_len) {
+    string_builder_t *builder = create_string_builder(128);
+
+    if (!builder)
+        return NULL;
+
+    switch (info->kind) {
+    case TRACEFS_INODE_TRACING_ON:
+        string_builder_append(builder, "%d\n", trace_is_on() ? 1 : 0);
+        break;
+    case TRACEFS_INODE_BUFFER_SIZE_KB:
+        string_builder_append(builder, "%llu\n",
+                              (unsigned long long)(trace_buffer_size() / 1024));
+        break;
+    case TRACEFS_INODE_BUFFER_TOTAL_SIZE_KB:
+        string_builder_append(
+            builder, "%llu\n",
+            (unsigned long long)(trace_buffer_size() / 1024 *
+                                 MIN((uint64_t)cpu_count, MAX_CPU_NUM)));
+        break;
+    case TRACEFS_INODE_AVAILABLE_EVENTS:
+    case TRACEFS_INODE_SET_EVENT:
+        for (int id = 0; id < NR_TRACE_EVENTS; id++) {
+            if (info->kind == TRACEFS_INODE_SET_EVENT &&
+                !trace_event_is_enabled(id))
+                continue;
+            string_builder_append(builder, "%s:%s\n", trace_events[id].system,
+                                  trace_events[id].name);
+        }
+        break;
+    case TRACEFS_INODE_EVENTS_ENABLE:
+        string_builder_append(builder, "%c\n", tracefs_enable_state(NULL));
+        break;
+    case TRACEFS_INODE_SYSTEM_ENABLE:
+        string_builder_append(builder, "%c\n",
+                              tracefs_enable_state(info->system));
+        break;
+    case TRACEFS_INODE_EVENT_ENABLE:
+        string_builder_append(builder, "%d\n",
+                              trace_event_is_enabled(info->arg) ? 1 : 0);
+        break;
+    case TRACEFS_INODE_EVENT_ID:
+        string_builder_append(builder, "%d\n", info->arg + 1);
+        break;
+    case TRACEFS_INODE_EVENT_FORMAT:
+        tracefs_append_format(builder, info->arg);
+        break;
+    case TRACEFS_INODE_CPU_STATS:
+        tracefs_append_stats(builder, (uint32_t)info->arg);
+        break;
+    default:
+        break;
+    }
+
+    *content_len = builder->size;
+    char *data = builder->data;
+    free(builder);
+    return data;
+}
+
+static int tracefs_parse_u64(const char *buf, uint64_t *value) {
+    uint64_t parsed = 0;
+
+    if (!buf || !buf[0] || !value)
+        return -EINVAL;
+
+    while (*buf == ' ' || *buf == '\t' || *buf == '\n')
+        buf++;
+    if (!*buf)
+        return -EINVAL;
+
+    while (*buf >= '0' && *buf <= '9') {
+        parsed = parsed * 10 + (uint64_t)(*buf - '0');
+        buf++;
+    }
+
+    while (*buf == ' ' || *buf == '\t' || *buf == '\n')
+        buf++;
+    if (*buf)
+        return -EINVAL;
+
+    *value = parsed;
+    return 0;
+}
+
+static int tracefs_parse_bool(const char *buf, bool *value) {
+    uint64_t parsed;
+    int ret = tracefs_parse_u64(buf, &parsed);
+
+    if (ret < 0)
+        return ret;
+    if (parsed > 1)
+        return -EINVAL;
+    *value = parsed != 0;
+    return 0;
+}
+
+static int tracefs_setattr(struct vfs_dentry *dentry,
+                           const struct vfs_kstat *stat) {
+    struct vfs_inode *inode;
+
+    if (!dentry || !dentry->d_inode || !stat)
+        return -EINVAL;
+
+    inode = dentry->d_inode;
+
+    // O_TRUNC on trace and set_event; the clearing is done by open
+    if (!S_ISDIR(inode->i_mode) && stat->size != 0)
+        return -EOPNOTSUPP;
+
+    if (stat->mode)
+        inode->i_mode = (inode->i_mode & S_IFMT) | (stat->mode & 07777);
+    inode->i_uid = stat->uid;
+    inode->i_gid = stat->gid;
+    inode->inode = inode->i_ino;
+    return 0;
+}
+
+static struct vfs_dentry *tracefs_lookup(struct vfs_inode *dir,
+                                         struct vfs_dentry *dentry,
+                                         unsigned int flags) {
+    tracefs_dirent_t *de;
+
+    (void)flags;
+    de = tracefs_find_dirent(dir, dentry->d_name.name);
+    vfs_d_instantiate(dentry, de ? de->inode : NULL);
+    return dentry;
+}
+
+static int tracefs_iterate_shared(struct vfs_file *file,
+                                  struct vfs_dir_context *ctx) {
+    tracefs_dirent_t *de, *tmp;
+    loff_t index = 0;
+
+    llist_for_each(de, tmp, &tracefs_i(file->f_inode)->children, node) {
+        index++;
+        if (index <= ctx->pos)
+            continue;
+        if (ctx->actor(ctx, de->name, (int)strlen(de->name), index,
+                       de->inode->i_ino,
+                       S_ISDIR(de->inode->i_mode) ? DT_DIR : DT_REG)) {
+            break;
+        }
+        ctx->pos = index;
+    }
+    file->f_pos = ctx->pos;
+    return 0;
+}
+
+/* Readers */
+
+static bool tracefs_has_data(tracefs_file_t *tf) {
+    uint8_t record[TRACE_RECORD_MAX] __attribute__((aligned(8)));
+    uint32_t cpu;
+    size_t size;
+
+    trace_read_lock();
+    size = trace_cursor_peek(&tf->cursor, record, &cpu);
+    trace_read_unlock();
+    return size != 0;
+}
+
+/*
+ * Writers only flag new data and the wakeup follows on a later tick, which
+ * a tickless CPU may not take for a while, so sleep in bounded slices.
+ */
+static int tracefs_wait_data(struct vfs_file *file) {
+    vfs_poll_wait_table_t table;
+    int polled;
+
+    if (file->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+    if (task_signal_has_deliverable(current_task))
+        return -EINTR;
+
+    vfs_poll_wait_table_init(&table, current_task);
+    polled = vfs_poll_with_table(file, EPOLLIN, &table.pt);
+    if (polled >= 0 && !(polled & EPOLLIN) &&
+        !vfs_poll_wait_table_error(&table) &&
+        !vfs_poll_wait_table_seq_changed(&table))
+        task_block(current_task, TASK_BLOCKING, TRACE_PIPE_WAIT_NS,
+                   "trace_pipe");
+    vfs_poll_wait_table_cleanup(&table);
+
+    if (task_signal_has_deliverable(current_task))
+        return -EINTR;
+    return polled < 0 ? polled : 0;
+}
+
+static ssize_t tracefs_read_pipe(struct vfs_file *file, tracefs_file_t *tf,
+                                 char *buf, size_t count) {
+    uint8_t record[TRACE_RECORD_MAX] __attribute__((aligned(8)));
+    size_t done = 0;
+
+    while (done < count) {
+        uint32_t cpu;
+        size_t size;
+        int ret;
+
+        if (tf->text_off < tf->text_len) {
+            size_t n = MIN(count - done, tf->text_len - tf->text_off);
+
+            memcpy(buf + done, tf->text + tf->text_off, n);
+            tf->text_off += n;
+            done += n;
+            continue;
+        }
+
+        trace_read_lock();
+        size = trace_cursor_peek(&tf->cursor, record, &cpu);
+        if (size)
+            trace_cursor_advance(&tf->cursor, cpu, size);
+        trace_read_unlock();
+
+        if (size) {
+            ret = trace_format_record(record, cpu, tf->line,
+                                      sizeof(tf->line));
+            tf->text = tf->line;
+            tf->text_len = ret > 0 ? (size_t)ret : 0;
+            tf->text_off = 0;
+            continue;
+        }
+        if (done)
+            break;
+        ret = tracefs_wait_data(file);
+        if (ret < 0)
+            return ret;
+    }
+    return (ssize_t)done;
+}
+
+/* Whole binary records, header included; never splits one. */
+static ssize_t tracefs_read_pipe_raw(struct vfs_file *file, tracefs_file_t *tf,
+                                     char *buf, size_t count) {
+    uint8_t record[TRACE_RECORD_MAX] __attribute__((aligned(8)));
+    size_t done = 0;
+
+    while (true) {
+        uint32_t cpu;
+        size_t size;
+        int ret;
+
+        trace_read_lock();
+        size = trace_cursor_peek(&tf->cursor, record, &cpu);
+        if (size && done + size <= count) {
+            trace_cursor_advance(&tf->cursor, cpu, size);
+            trace_read_unlock();
+            memcpy(buf + done, record, size);
+            done += size;
+            continue;
+        }
+        trace_read_unlock();
+
+        if (size)
+            return done ? (ssize_t)done : -EINVAL;
+        if (done)
+            return (ssize_t)done;
+        ret = tracefs_wait_data(file);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+static ssize_t tracefs_read(struct vfs_file *file, void *buf, size_t count,
+                            loff_t *ppos) {
+    tracefs_inode_info_t *info = tracefs_i(file->f_inode);
+    tracefs_file_t *tf = file->private_data;
+    char *content;
+    size_t size = 0;
+    size_t pos;
+    size_t to_copy;
+
+    if (!info || !ppos)
+        return -EINVAL;
+
+    if (info->kind == TRACEFS_INODE_CPU_TRACE_PIPE_RAW)
+        return tf ? tracefs_read_pipe_raw(file, tf, buf, count) : -EINVAL;
+    if (tracefs_kind_is_pipe(info->kind))
+        return tf ? tracefs_read_pipe(file, tf, buf, count) : -EINVAL;
+
+    if (tracefs_kind_is_snapshot(info->kind)) {
+        if (!tf || !tf->text)
+            return 0;
+        content = tf->text;
+        size = tf->text_len;
+    } else {
+        content = tracefs_build_file(info, &size);
+        if (!content)
+            return -ENOMEM;
+    }
+
+    pos = (size_t)*ppos;
+    to_copy = pos < size ? MIN(count, size - pos) : 0;
+    memcpy(buf, content + pos, to_copy);
+    *ppos += (loff_t)to_copy;
+    if (!tracefs_kind_is_snapshot(info->kind))
+        free(content);
+    return (ssize_t)to_copy;
+}
+
+static ssize_t tracefs_write(struct vfs_file *file, const void *buf,
+                             size_t count, loff_t *ppos) {
+    tracefs_inode_info_t *info = tracefs_i(file->f_inode);
+    char *copy;
+    uint64_t value = 0;
+    bool enabled = false;
+    int ret = -EINVAL;
+
+    (void)ppos;
+    if (!info)
+        return -EINVAL;
+
+    copy = calloc(1, count + 1);
+    if (!copy)
+        return -ENOMEM;
+    memcpy(copy, buf, count);
+
+    switch (info->kind) {
+    case TRACEFS_INODE_TRACING_ON:
+        ret = tracefs_parse_bool(copy, &enabled);
+        if (ret == 0)
+            ret = trace_set_on(enabled);
+        break;
+    case TRACEFS_INODE_BUFFER_SIZE_KB:
+        ret = tracefs_parse_u64(copy, &value);
+        if (ret == 0)
+            ret = value && value <= TRACE_BUF_SIZE_MAX / 1024
+                      ? trace_buffer_resize(value * 1024)
+                      : -EINVAL;
+        break;
+    case TRACEFS_INODE_TRACE:
+    case TRACEFS_INODE_CPU_TRACE:
+        // "echo > trace" clears it through O_TRUNC, the data is ignored
+        ret = 0;
+        break;
+    case TRACEFS_INODE_SET_EVENT:
+        ret = tracefs_write_set_event(copy);
+        break;
+    case TRACEFS_INODE_EVENTS_ENABLE:
+    case TRACEFS_INODE_SYSTEM_ENABLE:
+        ret = tracefs_parse_bool(copy, &enabled);
+        if (ret == 0)
+            ret = tracefs_set_events(info->system, NULL, enabled);
+        break;
+    case TRACEFS_INODE_EVENT_ENABLE:
+        ret = tracefs_parse_bool(copy, &enabled);
+        if (ret == 0)
+            ret = trace_event_set_enabled(info->arg, enabled);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    free(copy);
+    return ret < 0 ? ret : (ssize_t)count;
+}
+
+static int tracefs_open(struct vfs_inode *inode, struct vfs_file *file) {
+    tracefs_inode_info_t *info = tracefs_i(inode);
+    bool truncate = (file->f_flags & O_TRUNC) &&
+                    (file->f_flags & O_ACCMODE_FLAGS) != O_RDONLY;
+    int cpu = info->kind == TRACEFS_INODE_TRACE_PIPE ? -1 : info->arg;
+    tracefs_file_t *tf;
+
+    file->f_op = inode->i_fop;
+    if (truncate) {
+        if (info->kind == TRACEFS_INODE_TRACE)
+            trace_buffer_reset(-1);
+        else if (info->kind == TRACEFS_INODE_CPU_TRACE)
+            trace_buffer_reset(info->arg);
+        else if (info->kind == TRACEFS_INODE_SET_EVENT)
+            tracefs_set_events(NULL, NULL, false);
+    }
+
+    if (tracefs_kind_is_snapshot(info->kind)) {
+        string_builder_t *builder;
+
+        if ((file->f_flags & O_ACCMODE_FLAGS) == O_WRONLY)
+            return 0;
+        tf = calloc(1, sizeof(*tf));
+        builder = create_string_builder(PAGE_SIZE);
+        if (!tf || !builder) {
+            free(tf);
+            free(builder);
+            return -ENOMEM;
+        }
+        tracefs_append_trace(builder, info->kind == TRACEFS_INODE_TRACE
+                                          ? -1
+                                          : info->arg,
+                             tf);
+        tf->text = builder->data;
+        tf->text_len = builder->size;
+        free(builder);
+        file->private_data = tf;
+        return 0;
+    }
+
+    if (!tracefs_kind_is_pipe(info->kind))
+        return 0;
+
+    tf = calloc(1, sizeof(*tf));
+    if (!tf)
+        return -ENOMEM;
+    trace_cursor_init(&tf->cursor, cpu, true);
+    tf->inode = vfs_igrab(inode);
+    llist_init_head(&tf->node);
+
+    spin_lock(&tracefs_readers_lock);
+    llist_append(&tracefs_readers, &tf->node);
+    spin_unlock(&tracefs_readers_lock);
+    trace_readers_add(1);
+
+    file->private_data = tf;
+    return 0;
+}
+
+static int tracefs_release(struct vfs_inode *inode, struct vfs_file *file) {
+    tracefs_inode_info_t *info = tracefs_i(file->f_inode);
+    tracefs_file_t *tf = file->private_data;
+
+    (void)inode;
+    if (!tf)
+        return 0;
+
+    if (tracefs_kind_is_pipe(info->kind)) {
+        trace_readers_add(-1);
+        spin_lock(&tracefs_readers_lock);
+        llist_delete(&tf->node);
+        spin_unlock(&tracefs_readers_lock);
+        vfs_iput(tf->inode);
+    } else {
+        free(tf->text);
+    }
+    free(tf);
+    file->private_data = NULL;
+    return 0;
+}
+
+static __poll_t tracefs_poll(struct vfs_file *file,
+                             struct vfs_poll_table *pt) {
+    tracefs_inode_info_t *info = tracefs_i(file->f_inode);
+    tracefs_file_t *tf = file->private_data;
+
+    (void)pt;
+    if (!info)
+        return EPOLLNVAL;
+    if (!tracefs_kind_is_pipe(info->kind))
+        return EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+    if (tf && (tf->text_off < tf->text_len || tracefs_has_data(tf)))
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+void tracefs_notify_readers(void) {
+    tracefs_file_t *tf, *tmp;
+
+    // release unlinks under the same lock, so the inodes stay alive here
+    spin_lock(&tracefs_readers_lock);
+    llist_for_each(tf, tmp, &tracefs_readers, node) {
+        vfs_poll_notify_inode(tf->inode, EPOLLIN | EPOLLRDNORM);
+    }
+    spin_unlock(&tracefs_readers_lock);
+}
+
+/* Tree */
+
+static int tracefs_populate_events(struct vfs_inode *events) {
+    if (!tracefs_create(events, "enable", TRACEFS_INODE_EVENTS_ENABLE, -1,
+                        0644))
+        return -ENOMEM;
+
+    for (int id = 0; id < NR_TRACE_EVENTS; id++) {
+        const trace_event_desc_t *desc = &trace_events[id];
+        tracefs_dirent_t *de = tracefs_find_dirent(events, desc->system);
+        struct vfs_inode *system, *event, *enable;
+
+        if (de) {
+            system = de->inode;
+        } else {
+            system = tracefs_create(events, desc->system, TRACEFS_INODE_DIR,
+                                    -1, 0755);
+            if (!system)
+                return -ENOMEM;
+            enable = tracefs_create(system, "enable",
+                                    TRACEFS_INODE_SYSTEM_ENABLE, -1, 0644);
+            if (!enable)
+                return -ENOMEM;
+            tracefs_i(enable)->system = desc->system;
+        }
+
+        event = tracefs_create(system, desc->name, TRACEFS_INODE_DIR, id, 0755);
+        if (!event ||
+            !tracefs_create(event, "enable", TRACEFS_INODE_EVENT_ENABLE, id,
+                            0644) ||
+            !tracefs_create(event, "id", TRACEFS_INODE_EVENT_ID, id, 0444) ||
+            !tracefs_create(event, "format", TRACEFS_INODE_EVENT_FORMAT, id,
+                            0444))
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+static int tracefs_populate_per_cpu(struct vfs_inode *per_cpu) {
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        struct vfs_inode *dir;
+        char name[16];
+
+        snprintf(name, sizeof(name), "cpu%u", cpu);
+        dir = tracefs_create(per_cpu, name, TRACEFS_INODE_DIR, (int)cpu, 0755);
+        if (!dir ||
+            !tracefs_create(dir, "trace", TRACEFS_INODE_CPU_TRACE, (int)cpu,
+                            0644) ||
+            !tracefs_create(dir, "trace_pipe", TRACEFS_INODE_CPU_TRACE_PIPE,
+                            (int)cpu, 0444) ||
+            !tracefs_create(dir, "trace_pipe_raw",
+                            TRACEFS_INODE_CPU_TRACE_PIPE_RAW, (int)cpu, 0444) ||
+            !tracefs_create(dir, "stats", TRACEFS_INODE_CPU_STATS, (int)cpu,
+                            0444))
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+static int tracefs_populate_root(struct vfs_inode *root) {
+    static const struct {
+        const char *name;
+        tracefs_inode_kind_t kind;
+        umode_t mode;
+    } files[] = {
+        {"tracing_on", TRACEFS_INODE_TRACING_ON, 0644},
+        {"buffer_size_kb", TRACEFS_INODE_BUFFER_SIZE_KB, 0644},
+        {"buffer_total_size_kb", TRACEFS_INODE_BUFFER_TOTAL_SIZE_KB, 0444},
+        {"trace", TRACEFS_INODE_TRACE, 0644},
+        {"trace_pipe", TRACEFS_INODE_TRACE_PIPE, 0444},
+        {"available_events", TRACEFS_INODE_AVAILABLE_EVENTS, 0444},
+        {"set_event", TRACEFS_INODE_SET_EVENT, 0644},
+    };
+    struct vfs_inode *dir;
+    int ret;
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (!tracefs_create(root, files[i].name, files[i].kind, -1,
+                            files[i].mode))
+            return -ENOMEM;
+    }
+
+    dir = tracefs_create(root, "events", TRACEFS_INODE_DIR, -1, 0755);
+    if (!dir)
+        return -ENOMEM;
+    ret = tracefs_populate_events(dir);
+    if (ret < 0)
+        return ret;
+
+    dir = tracefs_create(root, "per_cpu", TRACEFS_INODE_DIR, -1, 0755);
+    if (!dir)
+        return -ENOMEM;
+    return tracefs_populate_per_cpu(dir);
+}
+
+static int tracefs_init_fs_context(struct vfs_fs_context *fc) {
+    (void)fc;
+    return 0;
+}
+
+static int tracefs_get_tree(struct vfs_fs_context *fc) {
+    struct vfs_super_block *sb = vfs_alloc_super(fc->fs_type, fc->sb_flags);
+    struct vfs_inode *root_inode;
+    struct vfs_dentry *root_dentry;
+    struct vfs_qstr root_name = {.name = "", .len = 0, .hash = 0};
+    int ret;
+
+    if (!sb)
+        return -ENOMEM;
+
+    sb->s_op = &tracefs_super_ops;
+    sb->s_magic = 0x74726163;
+    sb->s_type = &tracefs_fs_type;
+
+    root_inode = tracefs_new_inode(sb, TRACEFS_INODE_DIR, -1, S_IFDIR | 0755);
+    if (!root_inode) {
+        vfs_put_super(sb);
+        return -ENOMEM;
+    }
+
+    ret = tracefs_populate_root(root_inode);
+    if (ret < 0) {
+        vfs_iput(root_inode);
+        vfs_put_super(sb);
+        return ret;
+    }
+
+    root_dentry = vfs_d_alloc(sb, NULL, &root_name);
+    if (!root_dentry) {
+        vfs_iput(root_inode);
+        vfs_put_super(sb);
+        return -ENOMEM;
+    }
+
+    vfs_d_instantiate(root_dentry, root_inode);
+    sb->s_root = root_dentry;
+    fc->sb = sb;
+    vfs_iput(root_inode);
+    return 0;
+}
+
+static const struct vfs_super_operations tracefs_super_ops = {
+    .alloc_inode = tracefs_alloc_inode,
+    .destroy_inode = tracefs_destroy_inode,
+    .evict_inode = tracefs_evict_inode,
+    .statfs = tracefs_statfs,
+};
+
+static const struct vfs_inode_operations tracefs_inode_ops = {
+    .lookup = tracefs_lookup,
+    .setattr = tracefs_setattr,
+};
+
+static const struct vfs_file_operations tracefs_dir_file_ops = {
+    .iterate_shared = tracefs_iterate_shared,
+    .open = tracefs_open,
+};
+
+static const struct vfs_file_operations tracefs_file_ops = {
+    .read = tracefs_read,
+    .write = tracefs_write,
+    .open = tracefs_open,
+    .release = tracefs_release,
+    .poll = tracefs_poll,
+};
+
+static struct vfs_file_system_type tracefs_fs_type = {
+    .name = "tracefs",
+    .fs_flags = VFS_FS_VIRTUAL,
+    .init_fs_context = tracefs_init_fs_context,
+    .get_tree = tracefs_get_tree,
+};
+
+void tracefs_init(void) {
+    llist_init_head(&tracefs_readers);
+    vfs_register_filesystem(&tracefs_fs_type);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <fs/vfs/vfs.h>
+
+void tracefs_init(void);
+/* Wakes trace_pipe and trace_pipe_raw readers; from SOFTIRQ_TRACE. */
+void tracefs_notify_readers(void);
@@ -6,6 +6,7 @@
 #include <fs/fs_syscall.h>
 #include <mm/mm.h>
 #include <task/signal.h>
+#include <task/taskstats.h>
 
 static inline uint32_t vfs_poll_expand_events(uint32_t events) {
     if (events & EPOLLIN)
@@ -605,6 +606,7 @@ ssize_t vfs_read_file(struct vfs_file *file, void *buf, size_t count,
 
     new_pos = pos;
     ret = file->f_op->read(file, buf, count, &new_pos);
+    task_io_account_read(ret);
 
     if (ret >= 0) {
         if (ppos)
@@ -641,6 +643,7 @@ ssize_t vfs_write_file(struct vfs_file *file, const void *buf, size_t count,
 
     new_pos = pos;
     ret = file->f_op->write(file, buf, count, &new_pos);
+    task_io_account_write(ret);
 
     if (ret >= 0) {
         if (ppos)
@@ -1,4 +1,5 @@
 #include <libs/klibc.h>
+#include <libs/crc32c.h>
 #include <boot/boot.h>
 #include <init/callbacks.h>
 #include <drivers/logger.h>
@@ -94,6 +95,8 @@ void kmain(void) {
 
     arch_early_init();
 
+    crc32c_init();
+
     device_init();
 
     vfs_init();
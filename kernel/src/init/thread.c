@@ -1,10 +1,14 @@
 #include <arch/arch.h>
 #include <task/task.h>
+#include <task/psi.h>
+#include <task/perf_event.h>
+#include <task/trace.h>
 #include <drivers/bus/pci.h>
 #include <drivers/fdt/fdt.h>
 #include <fs/dev.h>
 #include <fs/sys.h>
 #include <fs/vfs/notify.h>
+#include <mm/extable.h>
 #include <block/partition.h>
 #include <net/real_socket.h>
 #include <drivers/fb.h>
@@ -24,6 +28,7 @@ extern void cgroupfs_init();
 extern void socketfs_init();
 extern void pipefs_init();
 extern void configfs_init();
+extern void tracefs_init();
 
 extern void epoll_init();
 extern void eventfd_init();
@@ -57,6 +62,11 @@ void init_thread(uint64_t arg) {
     pipefs_init();
     fsfdfs_init();
     cgroupfs_init();
+    psi_init();
+    perf_event_init();
+    trace_init();
+    tracefs_init();
+    uaccess_bench_init();
 
     pci_init();
 
@@ -7,6 +7,8 @@
 #include <irq/softirq.h>
 #include <init/callbacks.h>
 #include <drivers/deadline.h>
+#include <task/perf_event.h>
+#include <task/trace.h>
 
 irq_action_t actions[ARCH_MAX_IRQ_NUM] = {0};
 irq_ipi_send_fn_t ipi_send_fns[ARCH_MAX_IRQ_NUM] = {0};
@@ -65,6 +67,8 @@ void do_irq(struct pt_regs *regs, uint64_t irq_num) {
     uint64_t now_ns = nano_time();
 
     if (irq_num == ARCH_TIMER_IRQ && self) {
+        perf_event_tick(regs);
+        trace_tick();
         sched_check_wakeup();
         if (cpu_id == 0) {
             on_sched_update_call();
@@ -207,6 +211,18 @@ void irq_stat_read(uint64_t *counts, size_t count, uint64_t *total) {
         *total = sum;
 }
 
+uint64_t irq_stat_read_cpu(uint32_t cpu, uint64_t irq_num) {
+    if (cpu >= MAX_CPU_NUM || irq_num >= ARCH_MAX_IRQ_NUM)
+        return 0;
+    return __atomic_load_n(&irq_counts[cpu][irq_num], __ATOMIC_RELAXED);
+}
+
+const char *irq_name(uint64_t irq_num) {
+    if (!irq_is_registered(irq_num))
+        return NULL;
+    return actions[irq_num].name;
+}
+
 void irq_manager_init() { softirq_init(); }
 
 int irq_allocate_irqnum() {
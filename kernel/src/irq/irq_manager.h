@@ -43,6 +43,8 @@ void irq_set_sched_ipi(uint64_t irq_num);
 bool irq_trigger_sched_ipi(uint32_t cpu_id);
 bool irq_is_registered(uint64_t irq_num);
 void irq_stat_read(uint64_t *counts, size_t count, uint64_t *total);
+uint64_t irq_stat_read_cpu(uint32_t cpu, uint64_t irq_num);
+const char *irq_name(uint64_t irq_num);
 
 void irq_manager_init();
 
@@ -1,7 +1,20 @@
 #include <irq/softirq.h>
+#include <arch/arch.h>
+#include <task/trace.h>
 
 static softirq_handler_t softirq_handlers[SOFTIRQ_MAX] = {0};
 static uint64_t softirq_pending = 0;
+typedef struct softirq_cpu_counts {
+    uint64_t count[SOFTIRQ_MAX];
+} __cacheline_aligned_smp softirq_cpu_counts_t;
+
+static softirq_cpu_counts_t softirq_counts[MAX_CPU_NUM];
+
+static const char *const softirq_names[SOFTIRQ_MAX] = {
+    [SOFTIRQ_TIMER] = "TIMER",         [SOFTIRQ_TIMERFD] = "TIMERFD",
+    [SOFTIRQ_TASK_REAP] = "TASK_REAP", [SOFTIRQ_PERF] = "PERF",
+    [SOFTIRQ_TRACE] = "TRACE",
+};
 
 void softirq_init(void) {
     memset(softirq_handlers, 0, sizeof(softirq_handlers));
@@ -47,8 +60,26 @@ void softirq_handle_pending(void) {
             softirq_handler_t handler =
                 __atomic_load_n(&softirq_handlers[id], __ATOMIC_ACQUIRE);
             if (handler) {
+                uint64_t cpu_id = current_cpu_id;
+
+                __atomic_fetch_add(
+                    &softirq_counts[cpu_id < MAX_CPU_NUM ? cpu_id : 0]
+                         .count[id],
+                    1, __ATOMIC_RELAXED);
+                trace_softirq_entry(id);
                 handler();
+                trace_softirq_exit(id);
             }
         }
     }
 }
+
+const char *softirq_name(softirq_id_t id) {
+    return id < SOFTIRQ_MAX ? softirq_names[id] : NULL;
+}
+
+uint64_t softirq_stat_read(uint32_t cpu, softirq_id_t id) {
+    if (cpu >= MAX_CPU_NUM || id >= SOFTIRQ_MAX)
+        return 0;
+    return __atomic_load_n(&softirq_counts[cpu].count[id], __ATOMIC_RELAXED);
+}
@@ -6,6 +6,8 @@ typedef enum softirq_id {
     SOFTIRQ_TIMER = 0,
     SOFTIRQ_TIMERFD = 1,
     SOFTIRQ_TASK_REAP = 2,
+    SOFTIRQ_PERF = 3,
+    SOFTIRQ_TRACE = 4,
     // 不能超过 64
     SOFTIRQ_MAX,
 } softirq_id_t;
@@ -17,3 +19,7 @@ void softirq_register(softirq_id_t id, softirq_handler_t handler);
 bool softirq_raise(softirq_id_t id);
 bool softirq_has_pending(void);
 void softirq_handle_pending(void);
+
+/* Handler runs of id on cpu since boot, for /proc/softirqs. */
+uint64_t softirq_stat_read(uint32_t cpu, softirq_id_t id);
+const char *softirq_name(softirq_id_t id);
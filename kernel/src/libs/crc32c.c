@@ -0,0 +1,209 @@
+#include <libs/crc32c.h>
+#include <drivers/logger.h>
+#include <arch/arch.h>
+
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc32c_table[8][256];
+static bool crc32c_table_ready = false;
+static bool crc32c_use_hw = false;
+
+static void crc32c_build_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t v = i;
+        for (uint32_t bit = 0; bit < 8; bit++)
+            v = (v & 1) ? (v >> 1) ^ CRC32C_POLY : (v >> 1);
+        crc32c_table[0][i] = v;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t v = crc32c_table[0][i];
+        for (uint32_t t = 1; t < 8; t++) {
+            v = crc32c_table[0][v & 0xFF] ^ (v >> 8);
+            crc32c_table[t][i] = v;
+        }
+    }
+    __atomic_store_n(&crc32c_table_ready, true, __ATOMIC_RELEASE);
+}
+
+/* Slicing-by-8: one table lookup per input byte, but eight independent
+ * lookups per iteration instead of a serial byte chain. */
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    if (!__atomic_load_n(&crc32c_table_ready, __ATOMIC_ACQUIRE))
+        crc32c_build_table();
+
+    while (len && ((uintptr_t)p & 7)) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                             ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        uint32_t hi = (uint32_t)p[4] | ((uint32_t)p[5] << 8) |
+                      ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+static bool crc32c_cpu_has_hw(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+    return (ecx & (1U << 20)) != 0; /* SSE4.2 */
+}
+
+static uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint64_t crc64;
+
+    while (len && ((uintptr_t)p & 7)) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+        len--;
+    }
+
+    crc64 = crc;
+    while (len >= 8) {
+        asm("crc32q %1, %0" : "+r"(crc64) : "rm"(*(const uint64_t *)p));
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+
+    while (len--) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+    }
+    return crc;
+}
+
+#elif defined(__aarch64__)
+
+static bool crc32c_cpu_has_hw(void) {
+    uint64_t isar0;
+    asm volatile("mrs %0, id_aa64isar0_el1" : "=r"(isar0));
+    return ((isar0 >> 16) & 0xf) != 0;
+}
+
+static uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    while (len && ((uintptr_t)p & 7)) {
+        asm(".arch_extension crc\n\tcrc32cb %w0, %w0, %w1"
+            : "+r"(crc)
+            : "r"((uint32_t)*p));
+        p++;
+        len--;
+    }
+
+    while (len >= 8) {
+        asm(".arch_extension crc\n\tcrc32cx %w0, %w0, %x1"
+            : "+r"(crc)
+            : "r"(*(const uint64_t *)p));
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        asm(".arch_extension crc\n\tcrc32cb %w0, %w0, %w1"
+            : "+r"(crc)
+            : "r"((uint32_t)*p));
+        p++;
+    }
+    return crc;
+}
+
+#else
+
+static bool crc32c_cpu_has_hw(void) { return false; }
+
+static uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    return crc32c_sw(crc, data, len);
+}
+
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    if (crc32c_use_hw)
+        return crc32c_hw(crc, data, len);
+    return crc32c_sw(crc, data, len);
+}
+
+bool crc32c_hw_available(void) { return crc32c_use_hw; }
+
+static bool crc32c_self_test(uint32_t (*fn)(uint32_t, const void *, size_t)) {
+    static const uint8_t zeros[32];
+    static const char check[] = "123456789";
+
+    if ((fn(0xFFFFFFFFu, check, 9) ^ 0xFFFFFFFFu) != 0xE3069283u)
+        return false;
+    if ((fn(0xFFFFFFFFu, zeros, sizeof(zeros)) ^ 0xFFFFFFFFu) != 0x8A9136AAu)
+        return false;
+    return true;
+}
+
+#define CRC32C_BENCH_BYTES 4096
+#define CRC32C_BENCH_ROUNDS 64
+
+static uint64_t crc32c_bench(uint32_t (*fn)(uint32_t, const void *, size_t),
+                             const uint8_t *buf) {
+    uint32_t crc = 0xFFFFFFFFu;
+    uint64_t start = nano_time();
+    for (int i = 0; i < CRC32C_BENCH_ROUNDS; i++)
+        crc = fn(crc, buf, CRC32C_BENCH_BYTES);
+    uint64_t elapsed = nano_time() - start;
+    (void)crc;
+    if (!elapsed)
+        return 0;
+    /* bytes per ns * 1000 == MB/s */
+    return (uint64_t)CRC32C_BENCH_BYTES * CRC32C_BENCH_ROUNDS * 1000 /
+           elapsed;
+}
+
+void crc32c_init(void) {
+    static uint8_t buf[CRC32C_BENCH_BYTES];
+
+    crc32c_build_table();
+
+    if (!crc32c_self_test(crc32c_sw)) {
+        printk("crc32c: software self-test failed\n");
+        return;
+    }
+
+    if (!crc32c_cpu_has_hw())
+        return;
+
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+
+    bool ok = crc32c_self_test(crc32c_hw);
+    for (size_t off = 0; ok && off < 8; off++) {
+        size_t len = sizeof(buf) - off - 3;
+        ok = crc32c_hw(0xFFFFFFFFu, buf + off, len) ==
+             crc32c_sw(0xFFFFFFFFu, buf + off, len);
+    }
+    if (!ok) {
+        printk("crc32c: hardware self-test failed, using software\n");
+        return;
+    }
+
+    crc32c_use_hw = true;
+    printk("crc32c: hardware %llu MB/s, software %llu MB/s\n",
+           (unsigned long long)crc32c_bench(crc32c_hw, buf),
+           (unsigned long long)crc32c_bench(crc32c_sw, buf));
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+/* Castagnoli CRC (poly 0x82F63B78, reflected). The value is continued as-is:
+ * callers seed with ~0 (or a stored seed) and apply any final inversion
+ * themselves, matching what ext4 and iSCSI-style users expect. */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len);
+
+bool crc32c_hw_available(void);
+
+void crc32c_init(void);
@@ -229,7 +229,8 @@ uint64_t user_translate_no_fault(uint64_t *pgdir, uint64_t uaddr, bool write) {
     return user_translate_access(pgdir, uaddr, write);
 }
 
-void *memcpy(void *restrict dest, const void *restrict src, size_t n) {
+void *memcpy_generic(void *restrict dest, const void *restrict src,
+                     size_t n) {
     unsigned char *d = dest;
     const unsigned char *s = src;
 
@@ -276,7 +277,7 @@ void *memcpy(void *restrict dest, const void *restrict src, size_t n) {
     return dest;
 }
 
-void *memset(void *dest, int c, size_t n) {
+void *memset_generic(void *dest, int c, size_t n) {
     unsigned char *s = dest;
     size_t k;
 
@@ -364,6 +365,22 @@ void *memset(void *dest, int c, size_t n) {
     return dest;
 }
 
+/* Architectures with a tuned string.S override these; the generic versions
+ * stay reachable by name so the assembly can fall back on awkward
+ * alignments. */
+void *memcpy(void *restrict dest, const void *restrict src, size_t n)
+    __attribute__((weak, alias("memcpy_generic")));
+void *memset(void *dest, int c, size_t n)
+    __attribute__((weak, alias("memset_generic")));
+
+__attribute__((weak)) void clear_page(void *page) {
+    memset(page, 0, PAGE_SIZE);
+}
+
+__attribute__((weak)) void copy_page(void *dst, const void *src) {
+    memcpy(dst, src, PAGE_SIZE);
+}
+
 void *memmove(void *dest, const void *src, size_t n) {
     typedef __attribute__((__may_alias__)) size_t WT;
 #define WS (sizeof(WT))
@@ -132,6 +132,10 @@ typedef void *timer_t;
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
+// per-CPU rows aligned to this never share a cache line
+#define SMP_CACHE_BYTES 64
+#define __cacheline_aligned_smp __attribute__((aligned(SMP_CACHE_BYTES)))
+
 #define PADDING_DOWN(size, to) ((size_t)(size) & ~((size_t)(to) - (size_t)1))
 #define PADDING_UP(size, to)                                                   \
     PADDING_DOWN((size_t)(size) + (size_t)(to) - (size_t)1, to)
@@ -156,6 +160,10 @@ static inline uint64_t round(double x) { return (uint64_t)(x + 0.5); }
 
 void *memset(void *s, int c, size_t n);
 void *memcpy(void *dest, const void *src, size_t n);
+void *memset_generic(void *s, int c, size_t n);
+void *memcpy_generic(void *dest, const void *src, size_t n);
+void clear_page(void *page);
+void copy_page(void *dst, const void *src);
 void *memmove(void *dest, const void *src, size_t n);
 void *memchr(const void *src, int c, size_t n);
 int memcmp(const void *s1, const void *s2, size_t n);
@@ -433,15 +441,15 @@ static inline void *user_virt_from_paddr(uint64_t paddr) {
 uint64_t user_translate_or_fault(uint64_t *pgdir, uint64_t uaddr, bool write);
 uint64_t user_translate_no_fault(uint64_t *pgdir, uint64_t uaddr, bool write);
 
-static inline bool copy_to_user(void *dst, const void *src, size_t size) {
-    if (size == 0)
-        return false;
-    if (!src)
-        return true;
-
-    if (check_user_overflow((uint64_t)dst, size))
-        return true;
+/*
+ * Direct copy between kernel and user memory. Each user access is listed in
+ * the exception table, so a fault that cannot be resolved resumes at a fixup
+ * and the routine returns the number of bytes left uncopied.
+ */
+size_t arch_copy_user_raw(void *dst, const void *src, size_t size);
+extern bool uaccess_walk_only;
 
+static inline bool copy_to_user_walk(void *dst, const void *src, size_t size) {
     uint64_t *pgdir = get_current_page_dir(true);
     uint64_t uaddr = (uint64_t)dst;
     const uint8_t *in = (const uint8_t *)src;
@@ -463,15 +471,8 @@ static inline bool copy_to_user(void *dst, const void *src, size_t size) {
     return false;
 }
 
-static inline bool copy_from_user(void *dst, const void *src, size_t size) {
-    if (size == 0)
-        return false;
-    if (!dst)
-        return true;
-
-    if (check_user_overflow((uint64_t)src, size))
-        return true;
-
+static inline bool copy_from_user_walk(void *dst, const void *src,
+                                       size_t size) {
     uint64_t *pgdir = get_current_page_dir(true);
     uint64_t uaddr = (uint64_t)src;
     uint8_t *out = (uint8_t *)dst;
@@ -493,6 +494,46 @@ static inline bool copy_from_user(void *dst, const void *src, size_t size) {
     return false;
 }
 
+/* Both helpers try the direct copy first. If it stops on a fault, the rest
+ * is retried through the page-table walk, which keeps the old error
+ * semantics for mappings the fault handler cannot populate in place.
+ * uaccess_walk_only skips the direct copy, for benchmarking the walk. */
+static inline bool copy_to_user(void *dst, const void *src, size_t size) {
+    if (size == 0)
+        return false;
+    if (!src)
+        return true;
+
+    if (check_user_overflow((uint64_t)dst, size))
+        return true;
+
+    size_t left = uaccess_walk_only ? size : arch_copy_user_raw(dst, src, size);
+    if (!left)
+        return false;
+
+    size_t done = size - left;
+    return copy_to_user_walk((uint8_t *)dst + done, (const uint8_t *)src + done,
+                             left);
+}
+
+static inline bool copy_from_user(void *dst, const void *src, size_t size) {
+    if (size == 0)
+        return false;
+    if (!dst)
+        return true;
+
+    if (check_user_overflow((uint64_t)src, size))
+        return true;
+
+    size_t left = uaccess_walk_only ? size : arch_copy_user_raw(dst, src, size);
+    if (!left)
+        return false;
+
+    size_t done = size - left;
+    return copy_from_user_walk((uint8_t *)dst + done,
+                               (const uint8_t *)src + done, left);
+}
+
 static inline bool copy_from_user_str(char *dst, const char *src,
                                       size_t limit) {
     if (!src || !dst || limit == 0)
@@ -1,5 +1,6 @@
 #include <libs/skb_buff.h>
 #include <mm/mm.h>
+#include <mm/page.h>
 
 void skb_queue_init(skb_queue_t *queue, size_t byte_limit,
                     skb_priv_destructor_t priv_destructor) {
@@ -50,6 +51,54 @@ skb_buff_t *skb_alloc(size_t len) {
     return skb;
 }
 
+/*
+ * An skb whose payload is len bytes at data inside the frame at page, which
+ * it keeps alive with a frame reference instead of copying.
+ */
+skb_buff_t *skb_alloc_page_ref(uint64_t page, const void *data, size_t len) {
+    skb_buff_t *skb = calloc(1, sizeof(*skb));
+    if (!skb)
+        return NULL;
+
+    if (!address_ref(page)) {
+        free(skb);
+        return NULL;
+    }
+
+    skb->data = (uint8_t *)data;
+    skb->len = len;
+    skb->page = page;
+    return skb;
+}
+
+/*
+ * An empty skb spanning the whole frame at page, which it owns: data is
+ * appended with skb_append() and destructor gets the frame back on free.
+ */
+skb_buff_t *skb_alloc_frame(uint64_t page, skb_destructor_t destructor,
+                            void *arg) {
+    skb_buff_t *skb = calloc(1, sizeof(*skb));
+    if (!skb)
+        return NULL;
+
+    skb->data = (uint8_t *)phys_to_virt(page);
+    skb->size = PAGE_SIZE;
+    skb->page = page;
+    skb->destructor = destructor;
+    skb->destructor_arg = arg;
+    return skb;
+}
+
+size_t skb_append(skb_buff_t *skb, const void *data, size_t len) {
+    if (!skb || !data || skb->len >= skb->size)
+        return 0;
+
+    size_t to_copy = MIN(len, skb->size - skb->len);
+    memcpy(skb->data + skb->len, data, to_copy);
+    skb->len += to_copy;
+    return to_copy;
+}
+
 void skb_free(skb_buff_t *skb, skb_priv_destructor_t priv_destructor) {
     if (!skb)
         return;
@@ -57,7 +106,12 @@ void skb_free(skb_buff_t *skb, skb_priv_destructor_t priv_destructor) {
     if (priv_destructor && skb->priv)
         priv_destructor(skb->priv);
 
-    free(skb->data);
+    if (skb->destructor)
+        skb->destructor(skb);
+    else if (skb->page)
+        address_release(skb->page);
+    else
+        free(skb->data);
     free(skb);
 }
 
@@ -117,6 +171,23 @@ bool skb_queue_push(skb_queue_t *queue, skb_buff_t *skb) {
     return true;
 }
 
+/*
+ * Grows the tail skb in place when it has room left and no priv attached,
+ * so back-to-back small writes share one buffer. Charged against the queue
+ * limit like a push; returns how many bytes were taken.
+ */
+size_t skb_queue_append_tail(skb_queue_t *queue, const void *data,
+                             size_t len) {
+    skb_buff_t *tail = queue ? queue->tail : NULL;
+
+    if (!tail || tail->priv || !len)
+        return 0;
+
+    size_t taken = skb_append(tail, data, MIN(len, skb_queue_space(queue)));
+    queue->byte_count += taken;
+    return taken;
+}
+
 skb_buff_t *skb_queue_peek(const skb_queue_t *queue) {
     return queue ? queue->head : NULL;
 }
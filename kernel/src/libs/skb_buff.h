@@ -4,6 +4,9 @@
 
 typedef void (*skb_priv_destructor_t)(void *priv);
 
+struct skb_buff;
+typedef void (*skb_destructor_t)(struct skb_buff *skb);
+
 typedef struct skb_buff {
     struct skb_buff *next;
     uint8_t *data;
@@ -11,6 +14,11 @@ typedef struct skb_buff {
     size_t offset;
     uint32_t flags;
     void *priv;
+    uint64_t page; // frame data points into, held by reference; 0 if owned
+    size_t size;   // bytes data can hold, 0 if the skb cannot grow in place
+    // releases data instead of the default free()/address_release()
+    skb_destructor_t destructor;
+    void *destructor_arg;
 } skb_buff_t;
 
 typedef struct skb_queue {
@@ -31,6 +39,10 @@ size_t skb_queue_packets(const skb_queue_t *queue);
 size_t skb_queue_space(const skb_queue_t *queue);
 
 skb_buff_t *skb_alloc(size_t len);
+skb_buff_t *skb_alloc_page_ref(uint64_t page, const void *data, size_t len);
+skb_buff_t *skb_alloc_frame(uint64_t page, skb_destructor_t destructor,
+                            void *arg);
+size_t skb_append(skb_buff_t *skb, const void *data, size_t len);
 void skb_free(skb_buff_t *skb, skb_priv_destructor_t priv_destructor);
 size_t skb_unread_len(const skb_buff_t *skb);
 size_t skb_copy_data(const skb_buff_t *skb, size_t start, void *out,
@@ -38,6 +50,7 @@ size_t skb_copy_data(const skb_buff_t *skb, size_t start, void *out,
 void *skb_detach_priv(skb_buff_t *skb);
 
 bool skb_queue_push(skb_queue_t *queue, skb_buff_t *skb);
+size_t skb_queue_append_tail(skb_queue_t *queue, const void *data, size_t len);
 skb_buff_t *skb_queue_peek(const skb_queue_t *queue);
 skb_buff_t *skb_queue_pop(skb_queue_t *queue);
 void skb_queue_drop_head(skb_queue_t *queue);
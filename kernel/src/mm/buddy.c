@@ -1,8 +1,10 @@
 #include <mm/buddy.h>
 #include <mm/bitmap.h>
 #include <mm/cache.h>
+#include <mm/memcg.h>
 #include <mm/page.h>
 #include <task/task.h>
+#include <task/taskstats.h>
 
 extern Bitmap usable_regions;
 extern void *early_alloc(size_t size);
@@ -58,6 +60,7 @@ static inline void page_clear_owner(page_t *page) {
     page->slab_cache = NULL;
     page->freelist = NULL;
     page->slab_state = 0;
+    page->memcg = NULL;
 }
 
 static inline void page_mark_free(page_t *page, enum zone_type type,
@@ -391,6 +394,17 @@ uint64_t zone_free_pages(zone_t *zone) {
     return pages;
 }
 
+void zone_free_area_read(zone_t *zone, uint64_t nr_free[ORDER_COUNT]) {
+    memset(nr_free, 0, sizeof(uint64_t) * ORDER_COUNT);
+    if (!zone)
+        return;
+
+    spin_lock(&zone->allocator.lock);
+    for (size_t order = 0; order < ORDER_COUNT; order++)
+        nr_free[order] = zone->allocator.free_area[order].nr_free;
+    spin_unlock(&zone->allocator.lock);
+}
+
 void buddy_free_zone(zone_t *zone, uintptr_t addr, size_t order) {
     if (!zone_block_valid(zone, addr, order))
         return;
@@ -587,8 +601,12 @@ uintptr_t alloc_frames(size_t count) {
 
         if (attempt == 0)
             task_reap_deferred(512);
-        else if (attempt == 1)
+        else if (attempt == 1) {
+            uint64_t start_ns = nano_time();
+
             (void)page_cache_reclaim_half();
+            task_delay_end(TASK_DELAY_RECLAIM, start_ns);
+        }
     }
 
     if (!addr)
@@ -646,6 +664,8 @@ static void free_frames_common(uintptr_t addr, size_t count,
         return;
     }
 
+    mem_cgroup_uncharge_page(head);
+
     if (order == 0 && pcp_free_order0(zone, head))
         return;
 
@@ -63,4 +63,6 @@ void buddy_free_zone_claimed(zone_t *zone, uintptr_t addr, size_t order);
 zone_t *get_zone(enum zone_type type);
 bool zone_has_memory(zone_t *zone);
 uint64_t zone_free_pages(zone_t *zone);
+/* Free blocks of each order, per-CPU page lists not included. */
+void zone_free_area_read(zone_t *zone, uint64_t nr_free[ORDER_COUNT]);
 enum zone_type phys_to_zone_type(uintptr_t phys);
@@ -1,14 +1,16 @@
 #include <mm/cache.h>
+#include <mm/memcg.h>
 #include <mm/page.h>
+#include <mm/vmstat.h>
 #include <task/task.h>
+#include <task/trace.h>
+#include <task/taskstats.h>
 #include <arch/arch.h>
 
 #define PAGE_CACHE_MIN_READAHEAD 2ULL
 #define PAGE_CACHE_MAX_READAHEAD 32ULL
 #define PAGE_CACHE_UNMAP_LOCK_BATCH_MAX 64ULL
 
-static DEFINE_LLIST(pcache_lru);
-static spinlock_t pcache_lru_lock = SPIN_INIT;
 static volatile int pcache_reclaim_active;
 
 static uint64_t pcache_cached_pages;
@@ -67,19 +69,30 @@ static bool pcache_user_buffer(struct vfs_file *file, const void *buf,
 
 static void pcache_remove_locked_lru(page_cache_page_t *page, bool remove_lru);
 
+/* Each page sits on the LRU of the memcg its frame is charged to. */
+static mem_cgroup_t *pcache_page_memcg(page_cache_page_t *page) {
+    return page->memcg ? page->memcg : &root_mem_cgroup;
+}
+
 static void pcache_lru_add_tail_locked(page_cache_page_t *page) {
+    mem_cgroup_t *memcg;
+
     if (!page || page->on_lru || page->reclaiming)
         return;
 
-    llist_append(&pcache_lru, &page->lru);
+    memcg = pcache_page_memcg(page);
+    llist_append(&memcg->lru, &page->lru);
     page->on_lru = true;
+    pcache_stat_add(&memcg->lru_pages, 1);
     pcache_stat_add(&pcache_lru_pages, 1);
 }
 
 static void pcache_lru_add_tail(page_cache_page_t *page) {
-    spin_lock(&pcache_lru_lock);
+    mem_cgroup_t *memcg = pcache_page_memcg(page);
+
+    spin_lock(&memcg->lru_lock);
     pcache_lru_add_tail_locked(page);
-    spin_unlock(&pcache_lru_lock);
+    spin_unlock(&memcg->lru_lock);
 }
 
 static void pcache_lru_remove_locked(page_cache_page_t *page) {
@@ -88,13 +101,16 @@ static void pcache_lru_remove_locked(page_cache_page_t *page) {
 
     llist_delete(&page->lru);
     page->on_lru = false;
+    pcache_stat_sub(&pcache_page_memcg(page)->lru_pages, 1);
     pcache_stat_sub(&pcache_lru_pages, 1);
 }
 
 static void pcache_lru_remove(page_cache_page_t *page) {
-    spin_lock(&pcache_lru_lock);
+    mem_cgroup_t *memcg = pcache_page_memcg(page);
+
+    spin_lock(&memcg->lru_lock);
     pcache_lru_remove_locked(page);
-    spin_unlock(&pcache_lru_lock);
+    spin_unlock(&memcg->lru_lock);
 }
 
 static void pcache_lru_touch(page_cache_page_t *page) {
@@ -111,7 +127,7 @@ static void pcache_lru_move_tail_locked(page_cache_page_t *page) {
         return;
 
     llist_delete(&page->lru);
-    llist_append(&pcache_lru, &page->lru);
+    llist_append(&pcache_page_memcg(page)->lru, &page->lru);
 }
 
 static page_cache_page_t *
@@ -207,6 +223,7 @@ static void pcache_remove_locked_lru(page_cache_page_t *page, bool remove_lru) {
             mapping->dirty_pages--;
         pcache_stat_sub(&pcache_dirty_pages, 1);
         page->dirty = false;
+        task_io_add(current_task, TASK_IO_CANCELLED_WRITE_BYTES, PAGE_SIZE);
     }
     if (page->writeback) {
         pcache_stat_sub(&pcache_writeback_pages, 1);
@@ -309,6 +326,7 @@ static void pcache_finish_update(page_cache_page_t *page, bool uptodate,
             page->dirty = true;
             mapping->dirty_pages++;
             pcache_stat_add(&pcache_dirty_pages, 1);
+            task_io_add(current_task, TASK_IO_WRITE_BYTES, PAGE_SIZE);
         }
         page->loading = false;
     }
@@ -320,9 +338,18 @@ void page_cache_zap_inode_shared_mappings(vfs_node_t *node,
                                           uint64_t file_start,
                                           uint64_t file_end);
 
+/* Lets the fault path tell a major fault from a minor one. */
+static inline void pcache_count_miss(void) {
+    task_t *self = current_task;
+
+    if (self)
+        self->pcache_misses++;
+}
+
 static int pcache_load_page(struct vfs_file *file,
                             struct vfs_address_space *mapping,
                             page_cache_page_t *page) {
+    uint64_t start_ns;
     int ret;
 
     if (!page || page->uptodate)
@@ -341,14 +368,20 @@ static int pcache_load_page(struct vfs_file *file,
     }
     if (page->loading) {
         spin_unlock(&mapping->lock);
+        pcache_count_miss();
+        start_ns = nano_time();
         pcache_wait_unlocked(page);
+        task_delay_end(TASK_DELAY_PCACHE, start_ns);
         return page->uptodate ? 0 : -EIO;
     }
     page->loading = true;
     spin_unlock(&mapping->lock);
+    pcache_count_miss();
 
+    start_ns = nano_time();
     ret = mapping->a_ops->readpage(file, mapping, page->index,
                                    (void *)phys_to_virt(page->paddr));
+    task_delay_end(TASK_DELAY_PCACHE, start_ns);
     bool valid = false;
     spin_lock(&mapping->lock);
     if (page->mapping == mapping) {
@@ -483,7 +516,10 @@ retry:
     if (!new_page) {
         new_page = calloc(1, sizeof(*new_page));
         if (!new_page) {
+            uint64_t start_ns = nano_time();
+
             (void)page_cache_reclaim_half();
+            task_delay_end(TASK_DELAY_RECLAIM, start_ns);
             new_page = calloc(1, sizeof(*new_page));
             if (!new_page)
                 return -ENOMEM;
@@ -495,6 +531,12 @@ retry:
             pcache_free(new_page);
             return -ENOMEM;
         }
+        ret = mem_cgroup_charge_page(new_page->paddr, MEMCG_FILE);
+        if (ret < 0) {
+            pcache_free(new_page);
+            return ret;
+        }
+        new_page->memcg = mem_cgroup_from_paddr(new_page->paddr);
         memset((void *)phys_to_virt(new_page->paddr), 0, PAGE_SIZE);
         new_page->index = index;
         new_page->ref_count = 1;
@@ -549,16 +591,17 @@ retry:
 
 void page_cache_page_put(page_cache_page_t *page) { pcache_drop_ref(page); }
 
-static bool pcache_lru_reclaim_oldest(uint64_t *scanned_out) {
+static bool pcache_lru_reclaim_oldest(mem_cgroup_t *memcg,
+                                      uint64_t *scanned_out) {
     page_cache_page_t *reclaimed_page = NULL;
     bool reclaimed = false;
 
     if (scanned_out)
         *scanned_out = 0;
 
-    spin_lock(&pcache_lru_lock);
-    struct llist_header *pos = pcache_lru.next;
-    while (pos != &pcache_lru) {
+    spin_lock(&memcg->lru_lock);
+    struct llist_header *pos = memcg->lru.next;
+    while (pos != &memcg->lru) {
         page_cache_page_t *candidate = list_entry(pos, page_cache_page_t, lru);
         struct vfs_address_space *mapping = candidate->mapping;
         pos = pos->next;
@@ -596,31 +639,26 @@ static bool pcache_lru_reclaim_oldest(uint64_t *scanned_out) {
         pcache_lru_move_tail_locked(candidate);
         spin_unlock(&mapping->lock);
     }
-    spin_unlock(&pcache_lru_lock);
+    spin_unlock(&memcg->lru_lock);
 
     if (reclaimed_page) {
         reclaimed_page->reclaiming = false;
         pcache_free(reclaimed_page);
         pcache_stat_add(&pcache_reclaimed_pages, 1);
+        vm_event_count(VM_PGSTEAL_DIRECT);
     }
     return reclaimed;
 }
 
-uint64_t page_cache_reclaim_half(void) {
-    uint64_t lru_pages;
-    uint64_t target;
+uint64_t page_cache_reclaim_memcg(mem_cgroup_t *memcg, uint64_t nr_pages,
+                                  uint64_t *scanned_out) {
+    uint64_t lru_pages = __atomic_load_n(&memcg->lru_pages, __ATOMIC_ACQUIRE);
     uint64_t scanned = 0;
     uint64_t reclaimed = 0;
 
-    if (__atomic_exchange_n(&pcache_reclaim_active, 1, __ATOMIC_ACQ_REL))
-        return 0;
-
-    lru_pages = __atomic_load_n(&pcache_lru_pages, __ATOMIC_ACQUIRE);
-    target = lru_pages ? MAX(1ULL, (lru_pages + 1) / 2) : 0;
-
-    while (scanned < lru_pages && reclaimed < target) {
+    while (scanned < lru_pages && reclaimed < nr_pages) {
         uint64_t pass_scanned = 0;
-        bool did_reclaim = pcache_lru_reclaim_oldest(&pass_scanned);
+        bool did_reclaim = pcache_lru_reclaim_oldest(memcg, &pass_scanned);
         if (!pass_scanned)
             break;
         scanned += pass_scanned;
@@ -629,6 +667,74 @@ uint64_t page_cache_reclaim_half(void) {
     }
 
     pcache_stat_add(&pcache_reclaim_scanned_pages, scanned);
+    vm_event_add(VM_PGSCAN_DIRECT, scanned);
+    trace_pagecache_reclaim(nr_pages, scanned, reclaimed);
+    if (scanned_out)
+        *scanned_out = scanned;
+    return reclaimed;
+}
+
+uint64_t page_cache_writeback_memcg(mem_cgroup_t *memcg, uint64_t nr_pages) {
+    uint64_t lru_pages = __atomic_load_n(&memcg->lru_pages, __ATOMIC_ACQUIRE);
+    uint64_t scanned = 0;
+    uint64_t written = 0;
+
+    while (written < nr_pages && scanned < lru_pages) {
+        struct vfs_address_space *mapping = NULL;
+        page_cache_page_t *page = NULL;
+        struct vfs_inode *host = NULL;
+
+        spin_lock(&memcg->lru_lock);
+        struct llist_header *pos = memcg->lru.next;
+        while (pos != &memcg->lru && scanned < lru_pages) {
+            page_cache_page_t *candidate =
+                list_entry(pos, page_cache_page_t, lru);
+            mapping = candidate->mapping;
+            pos = pos->next;
+            scanned++;
+            if (!mapping || candidate->reclaiming || !candidate->dirty ||
+                candidate->writeback || !mapping->a_ops ||
+                !mapping->a_ops->writepage)
+                continue;
+            if (!spin_trylock(&mapping->lock))
+                continue;
+            // the inode reference keeps mapping valid once we unlock
+            if (candidate->mapping == mapping && candidate->dirty &&
+                pcache_take_ref(candidate)) {
+                host = vfs_igrab(mapping->host);
+                if (host)
+                    page = candidate;
+                else
+                    candidate->ref_count--;
+            }
+            spin_unlock(&mapping->lock);
+            if (page)
+                break;
+        }
+        spin_unlock(&memcg->lru_lock);
+
+        if (!page)
+            break;
+        int ret = pcache_write_page(mapping, page);
+        page_cache_page_put(page);
+        vfs_iput(host);
+        if (ret < 0)
+            break;
+        written++;
+    }
+    return written;
+}
+
+/* Halves every memcg's LRU, sparing those under memory.low if it can. */
+uint64_t page_cache_reclaim_half(void) {
+    uint64_t reclaimed;
+
+    // every caller is an allocation that just failed
+    vm_event_count(VM_ALLOCSTALL);
+    if (__atomic_exchange_n(&pcache_reclaim_active, 1, __ATOMIC_ACQ_REL))
+        return 0;
+
+    reclaimed = mem_cgroup_reclaim(&root_mem_cgroup, 0);
     __atomic_store_n(&pcache_reclaim_active, 0, __ATOMIC_RELEASE);
     return reclaimed;
 }
@@ -651,6 +757,7 @@ void page_cache_mark_dirty(page_cache_page_t *page) {
         page->dirty = true;
         mapping->dirty_pages++;
         pcache_stat_add(&pcache_dirty_pages, 1);
+        task_io_add(current_task, TASK_IO_WRITE_BYTES, PAGE_SIZE);
     }
     spin_unlock(&mapping->lock);
 }
@@ -764,6 +871,88 @@ int page_cache_read(struct vfs_file *file, void *buf, size_t count,
     return (int)done;
 }
 
+bool page_cache_can_splice(struct vfs_file *file) {
+    struct vfs_inode *inode = file ? file->f_inode : NULL;
+
+    return inode && S_ISREG(inode->i_mode) && inode->i_mapping.a_ops &&
+           inode->i_mapping.a_ops->readpage;
+}
+
+/*
+ * Hands [*ppos, *ppos + count) of a cached file to actor one page at a time,
+ * without copying. The page is only pinned for the duration of the call, so
+ * an actor that keeps the data must address_ref() the frame itself. Stops at
+ * EOF or as soon as actor takes less than it was offered, and advances *ppos
+ * by what was taken. Readahead is driven the same way as page_cache_read().
+ */
+ssize_t page_cache_splice_read(struct vfs_file *file, loff_t *ppos,
+                               size_t count, page_cache_actor_t actor,
+                               void *data) {
+    struct vfs_inode *inode;
+    struct vfs_address_space *mapping;
+    uint64_t file_size;
+    uint64_t pos;
+    size_t len;
+    size_t done = 0;
+
+    if (!file || !file->f_inode || !ppos || !actor)
+        return -EINVAL;
+    if (*ppos < 0)
+        return -EINVAL;
+    if (!page_cache_can_splice(file))
+        return -EINVAL;
+    if (count == 0)
+        return 0;
+
+    inode = file->f_inode;
+    mapping = &inode->i_mapping;
+    file_size = inode->i_size;
+    pos = (uint64_t)*ppos;
+    if (pos >= file_size)
+        return 0;
+
+    len = (size_t)MIN((uint64_t)count, file_size - pos);
+    while (done < len) {
+        uint64_t off = pos + done;
+        uint64_t index = off / PAGE_SIZE;
+        size_t in_page = (size_t)(off & (PAGE_SIZE - 1));
+        size_t chunk = MIN(len - done, PAGE_SIZE - in_page);
+        page_cache_page_t *page = NULL;
+        ssize_t taken;
+        int ret = page_cache_get_page(file, mapping, index, true, true, &page);
+        if (ret < 0) {
+            if (done)
+                break;
+            return ret;
+        }
+
+        taken = actor(data, page_cache_page_paddr(page), in_page, chunk);
+        page_cache_page_put(page);
+        if (taken < 0) {
+            if (done)
+                break;
+            return taken;
+        }
+        done += (size_t)taken;
+        pcache_update_readahead(mapping, index, (size_t)taken);
+        if ((size_t)taken < chunk)
+            break;
+    }
+
+    *ppos += (loff_t)done;
+    if (!done)
+        return 0;
+
+    uint64_t ra_window;
+    spin_lock(&mapping->lock);
+    ra_window = mapping->readahead_window;
+    spin_unlock(&mapping->lock);
+    if (ra_window)
+        (void)page_cache_readahead(file, (uint64_t)*ppos,
+                                   ra_window * PAGE_SIZE);
+    return (ssize_t)done;
+}
+
 int page_cache_write(struct vfs_file *file, const void *buf, size_t count,
                      loff_t *ppos) {
     struct vfs_inode *inode;
@@ -793,6 +982,8 @@ int page_cache_write(struct vfs_file *file, const void *buf, size_t count,
         page_cache_page_t *page = NULL;
         int ret =
             page_cache_get_page(file, mapping, index, true, need_read, &page);
+        if (ret == -ENOMEM && mem_cgroup_oom_synchronize())
+            continue;
         if (ret < 0)
             return done ? (int)done : ret;
 
@@ -816,6 +1007,8 @@ int page_cache_write(struct vfs_file *file, const void *buf, size_t count,
     *ppos += (loff_t)done;
     if ((uint64_t)*ppos > inode->i_size)
         inode->i_size = (uint64_t)*ppos;
+    if (user_src)
+        mem_cgroup_handle_over_high();
     return (int)done;
 }
 
@@ -956,6 +1149,30 @@ void page_cache_mmap_dec_page(struct vfs_address_space *mapping,
     spin_unlock(&mapping->lock);
 }
 
+void page_cache_mapped_info(struct vfs_address_space *mapping,
+                            const uint64_t *indices, const uint64_t *paddrs,
+                            size_t count, page_cache_map_info_t *out) {
+    if (!out || !count)
+        return;
+
+    memset(out, 0, count * sizeof(*out));
+    if (!mapping || !indices || !paddrs)
+        return;
+
+    spin_lock(&mapping->lock);
+    for (size_t i = 0; i < count; i++) {
+        page_cache_page_t *page = pcache_lookup_locked(mapping, indices[i]);
+
+        if (!page || page->paddr != paddrs[i])
+            continue;
+        out[i].cached = true;
+        out[i].mmap_count = page->mmap_count;
+        out[i].dirty = page->dirty || page->writeback;
+        out[i].referenced = page->referenced;
+    }
+    spin_unlock(&mapping->lock);
+}
+
 static void pcache_sub_resident_pages(task_mm_info_t *mm, uint64_t pages) {
     if (!mm || !pages)
         return;
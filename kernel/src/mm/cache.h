@@ -3,10 +3,13 @@
 #include <fs/vfs/vfs.h>
 #include <mm/mm.h>
 
+struct mem_cgroup;
+
 typedef struct page_cache_page {
     rb_node_t node;
     struct llist_header lru;
     struct vfs_address_space *mapping;
+    struct mem_cgroup *memcg; // owner of the frame and of the LRU we sit on
     uint64_t index;
     uint64_t paddr;
     int ref_count;
@@ -35,8 +38,28 @@ void page_cache_mapping_init(struct vfs_address_space *mapping,
                              struct vfs_inode *host);
 void page_cache_stats_snapshot(page_cache_stats_t *stats);
 uint64_t page_cache_reclaim_half(void);
+/* Reclaims up to nr_pages clean, unmapped pages off memcg's own LRU. */
+uint64_t page_cache_reclaim_memcg(struct mem_cgroup *memcg, uint64_t nr_pages,
+                                  uint64_t *scanned_out);
+/*
+ * Writes back up to nr_pages dirty pages off memcg's own LRU, oldest
+ * first, so that reclaim can take them next. Returns how many it wrote.
+ */
+uint64_t page_cache_writeback_memcg(struct mem_cgroup *memcg,
+                                    uint64_t nr_pages);
 int page_cache_read(struct vfs_file *file, void *buf, size_t count,
                     loff_t *ppos);
+/*
+ * Called with a pinned page cache frame; returns how many of len bytes at
+ * paddr + offset it took, or a negative errno.
+ */
+typedef ssize_t (*page_cache_actor_t)(void *data, uint64_t paddr,
+                                      size_t offset, size_t len);
+
+bool page_cache_can_splice(struct vfs_file *file);
+ssize_t page_cache_splice_read(struct vfs_file *file, loff_t *ppos,
+                               size_t count, page_cache_actor_t actor,
+                               void *data);
 int page_cache_write(struct vfs_file *file, const void *buf, size_t count,
                      loff_t *ppos);
 int page_cache_get_page(struct vfs_file *file,
@@ -58,6 +81,23 @@ void page_cache_mmap_inc_page(struct vfs_address_space *mapping,
                               uint64_t index);
 void page_cache_mmap_dec_page(struct vfs_address_space *mapping,
                               uint64_t index);
+
+typedef struct page_cache_map_info {
+    bool cached; // the index is cached at the paddr asked about
+    bool dirty;
+    bool referenced;
+    int mmap_count;
+} page_cache_map_info_t;
+
+/*
+ * State of count pages of a shared file mapping, looked up under one hold
+ * of the mapping lock. paddrs[i] is what the page table maps for
+ * indices[i]; a page that since moved or went away reads as not cached.
+ */
+void page_cache_mapped_info(struct vfs_address_space *mapping,
+                            const uint64_t *indices, const uint64_t *paddrs,
+                            size_t count, page_cache_map_info_t *out);
+
 void page_cache_unmap_shared_range(struct vfs_address_space *mapping,
                                    task_mm_info_t *mm, uint64_t vaddr,
                                    uint64_t file_start, uint64_t len);
@@ -0,0 +1,125 @@
+#include <mm/extable.h>
+#include <boot/boot.h>
+#include <fs/fs_syscall.h>
+#include <mm/mm.h>
+#include <task/task.h>
+
+extern const exception_table_entry_t __start___ex_table[];
+extern const exception_table_entry_t __stop___ex_table[];
+
+const exception_table_entry_t *search_exception_tables(uint64_t addr) {
+    for (const exception_table_entry_t *entry = __start___ex_table;
+         entry < __stop___ex_table; entry++) {
+        if (entry->insn == addr)
+            return entry;
+    }
+
+    return NULL;
+}
+
+bool fixup_exception(uint64_t *pc) {
+    if (!pc)
+        return false;
+
+    const exception_table_entry_t *entry = search_exception_tables(*pc);
+    if (!entry)
+        return false;
+
+    *pc = entry->fixup;
+    return true;
+}
+
+bool uaccess_strict_requested(void) {
+    const char *cmdline = boot_get_cmdline();
+    return cmdline && strstr(cmdline, "uaccess=strict") != NULL;
+}
+
+bool uaccess_walk_only = false;
+
+/*
+ * "uaccess_bench" on the command line: pwrite()s and pread()s a memfd from
+ * a buffer at a fixed user address mapped into the bench thread's page
+ * table, at a few sizes, once with every user copy forced through the
+ * page-table walk (the old path) and once with the direct copy. A memfd
+ * rather than a pipe because the page cache copies with copy_to_user() and
+ * copy_from_user() while pipes memcpy. Boot with and without
+ * "uaccess=strict" to see what SMAP/PAN add on top. Results go to the log.
+ */
+#define UACCESS_BENCH_UADDR 0x40000000ULL
+#define UACCESS_BENCH_PAGES 17 // the memfd name, then the data buffer
+#define UACCESS_BENCH_BYTES (64ULL * 1024 * 1024)
+#define UACCESS_BENCH_MAX_ITERS 100000ULL
+
+static const size_t uaccess_bench_sizes[] = {64, 512, 4096, 65536};
+
+/* Nanoseconds per pwrite()+pread() round, or 0 if a syscall came up short. */
+static uint64_t uaccess_bench_memfd(int fd, void *ubuf, size_t size,
+                                    bool walk) {
+    uint64_t iters = MIN(UACCESS_BENCH_BYTES / size, UACCESS_BENCH_MAX_ITERS);
+    uint64_t start, elapsed;
+
+    uaccess_walk_only = walk;
+    start = nano_time();
+    for (uint64_t i = 0; i < iters; i++) {
+        if (sys_pwrite64(fd, ubuf, size, 0) != size ||
+            sys_pread64(fd, ubuf, size, 0) != size) {
+            uaccess_walk_only = false;
+            return 0;
+        }
+    }
+    elapsed = nano_time() - start;
+    uaccess_walk_only = false;
+    return MAX(elapsed / iters, 1ULL);
+}
+
+static void uaccess_bench_thread(uint64_t arg) {
+    uint64_t *pgdir = get_current_page_dir(true);
+    size_t len = UACCESS_BENCH_PAGES * PAGE_SIZE;
+    void *ubuf = (void *)(UACCESS_BENCH_UADDR + PAGE_SIZE);
+    uintptr_t paddr = alloc_frames(UACCESS_BENCH_PAGES);
+    int64_t fd;
+
+    (void)arg;
+    if (!paddr) {
+        printk("uaccess bench: out of memory\n");
+        return;
+    }
+    memset((void *)phys_to_virt(paddr), 0x5A, len);
+    strcpy((char *)phys_to_virt(paddr), "uaccess-bench");
+    if (map_page_range(pgdir, UACCESS_BENCH_UADDR, paddr, len,
+                       PT_FLAG_R | PT_FLAG_W | PT_FLAG_U) != 0) {
+        printk("uaccess bench: cannot map the user buffer\n");
+        goto out_unmap;
+    }
+    fd = (int64_t)sys_memfd_create((const char *)UACCESS_BENCH_UADDR, 0);
+    if (fd < 0) {
+        printk("uaccess bench: cannot create a memfd\n");
+        goto out_unmap;
+    }
+
+    for (size_t i = 0; i < sizeof(uaccess_bench_sizes) / sizeof(size_t);
+         i++) {
+        size_t size = uaccess_bench_sizes[i];
+        uint64_t walk_ns = uaccess_bench_memfd(fd, ubuf, size, true);
+        uint64_t raw_ns = uaccess_bench_memfd(fd, ubuf, size, false);
+
+        printk("uaccess bench: uaccess=%s memfd pwrite+pread %6u bytes: "
+               "walk %llu ns, direct %llu ns (%llu MB/s)\n",
+               uaccess_strict_requested() ? "strict" : "relaxed",
+               (unsigned)size, walk_ns, raw_ns,
+               raw_ns ? (uint64_t)size * 1000ULL / raw_ns : 0);
+    }
+
+    sys_close(fd);
+out_unmap:
+    unmap_page_range(pgdir, UACCESS_BENCH_UADDR, len);
+    free_frames(paddr, UACCESS_BENCH_PAGES);
+}
+
+void uaccess_bench_init(void) {
+    const char *cmdline = boot_get_cmdline();
+
+    if (cmdline && strstr(cmdline, "uaccess_bench"))
+        task_create("uaccess-bench", uaccess_bench_thread, 0,
+                    KTHREAD_PRIORITY);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+/*
+ * Exception table: every kernel instruction that may touch user memory
+ * directly records itself together with a fixup address in the __ex_table
+ * section. When such an instruction faults and the page fault cannot be
+ * resolved, the arch fault handler resumes execution at the fixup instead of
+ * treating it as a kernel bug.
+ */
+typedef struct exception_table_entry {
+    uint64_t insn;
+    uint64_t fixup;
+} exception_table_entry_t;
+
+const exception_table_entry_t *search_exception_tables(uint64_t addr);
+
+/* Redirect *pc to its fixup. Returns false if *pc has no table entry. */
+bool fixup_exception(uint64_t *pc);
+
+/* SMAP/PAN enforcement is opt-in ("uaccess=strict" on the command line)
+ * until every direct user access goes through the copy helpers. */
+bool uaccess_strict_requested(void);
+
+/* Starts the user copy benchmark when "uaccess_bench" is on the command
+ * line. */
+void uaccess_bench_init(void);
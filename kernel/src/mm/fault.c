@@ -1,8 +1,11 @@
 #include <mm/fault.h>
 #include <mm/mm.h>
 #include <mm/cache.h>
+#include <mm/memcg.h>
 #include <mm/page.h>
 #include <mm/shm.h>
+#include <mm/vmstat.h>
+#include <task/trace.h>
 #include <fs/vfs/vfs.h>
 
 static inline bool fault_page_table_levels_valid(uint64_t levels) {
@@ -139,8 +142,12 @@ map_anon_fault_page_snapshot(task_t *task, const fault_vma_snapshot_t *snapshot,
     uint64_t page_paddr = alloc_frames(1);
     if (!page_paddr)
         return PF_RES_NOMEM;
+    if (mem_cgroup_charge_page(page_paddr, MEMCG_ANON) < 0) {
+        address_release(page_paddr);
+        return PF_RES_NOMEM;
+    }
 
-    memset((void *)phys_to_virt(page_paddr), 0, PAGE_SIZE);
+    clear_page((void *)phys_to_virt(page_paddr));
     fault_sync_page_before_user_map(snapshot, page_paddr);
 
     vma_manager_t *mgr = &task->mm->task_vma_mgr;
@@ -218,6 +225,10 @@ map_file_fault_page_snapshot(task_t *task, const fault_vma_snapshot_t *snapshot,
     uint64_t page_paddr = alloc_frames(1);
     if (!page_paddr)
         return PF_RES_NOMEM;
+    if (mem_cgroup_charge_page(page_paddr, MEMCG_ANON) < 0) {
+        address_release(page_paddr);
+        return PF_RES_NOMEM;
+    }
 
     size_t loaded = 0;
     fd_t fd = {
@@ -353,8 +364,14 @@ map_cow_fault_page_snapshot(task_t *task, const fault_vma_snapshot_t *snapshot,
         spin_unlock(&mgr->lock);
         return PF_RES_NOMEM;
     }
-    memcpy((void *)phys_to_virt(new_paddr),
-           (const void *)phys_to_virt(old_paddr), PAGE_SIZE);
+    if (mem_cgroup_charge_page(new_paddr, MEMCG_ANON) < 0) {
+        spin_unlock(&task->mm->lock);
+        spin_unlock(&mgr->lock);
+        address_release(new_paddr);
+        return PF_RES_NOMEM;
+    }
+    copy_page((void *)phys_to_virt(new_paddr),
+              (const void *)phys_to_virt(old_paddr));
     fault_sync_page_before_user_map(snapshot, new_paddr);
 
     uint64_t flags = ARCH_READ_PTE_FLAG(current_entry);
@@ -543,11 +560,27 @@ static page_fault_result_t handle_page_fault_flags_once(task_t *task,
 
 page_fault_result_t handle_page_fault_flags(task_t *task, uint64_t vaddr,
                                             uint64_t fault_flags) {
+    task_t *self = current_task;
+    uint64_t misses = self ? self->pcache_misses : 0;
+
     while (true) {
         page_fault_result_t result =
             handle_page_fault_flags_once(task, vaddr, fault_flags);
-        if (result != PF_RES_RETRY)
+        // a memcg charge failed under the VMA locks, handle its OOM here
+        if (result == PF_RES_NOMEM && task == current_task &&
+            mem_cgroup_oom_synchronize())
+            continue;
+        if (result == PF_RES_OK && task == current_task)
+            mem_cgroup_handle_over_high();
+        if (result != PF_RES_RETRY) {
+            if (result == PF_RES_OK) {
+                vm_event_count(VM_PGFAULT);
+                if (self && self->pcache_misses != misses)
+                    vm_event_count(VM_PGMAJFAULT);
+            }
+            trace_page_fault(vaddr, fault_flags, result);
             return result;
+        }
         arch_pause();
     }
 }
@@ -0,0 +1,613 @@
+#include <mm/memcg.h>
+#include <mm/cache.h>
+#include <mm/page.h>
+#include <mm/vmstat.h>
+#include <cgroup/cgroup.h>
+#include <libs/string_builder.h>
+#include <task/psi.h>
+#include <task/task.h>
+#include <task/taskstats.h>
+
+mem_cgroup_t root_mem_cgroup = {
+    .ref_count = 1,
+    .max = MEMCG_LIMIT_MAX,
+    .high = MEMCG_LIMIT_MAX,
+    .lru = {.prev = &root_mem_cgroup.lru, .next = &root_mem_cgroup.lru},
+};
+
+/* Every memcg but the root, so reclaim can find a removed cgroup's pages. */
+static DEFINE_LLIST(memcg_list);
+static spinlock_t memcg_list_lock;
+
+static void mem_cgroup_stat_add(mem_cgroup_t *memcg,
+                                mem_cgroup_stat_item_t item, uint64_t delta) {
+    if (delta)
+        __atomic_add_fetch(&memcg->stat[item], delta, __ATOMIC_RELAXED);
+}
+
+static void mem_cgroup_event(mem_cgroup_t *memcg, mem_cgroup_event_t event) {
+    __atomic_add_fetch(&memcg->events[event], 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t mem_cgroup_usage(mem_cgroup_t *memcg) {
+    return __atomic_load_n(&memcg->usage, __ATOMIC_ACQUIRE);
+}
+
+static bool mem_cgroup_is_descendant(mem_cgroup_t *memcg,
+                                     mem_cgroup_t *ancestor) {
+    for (; memcg; memcg = memcg->parent) {
+        if (memcg == ancestor)
+            return true;
+    }
+    return false;
+}
+
+mem_cgroup_t *mem_cgroup_create(mem_cgroup_t *parent) {
+    mem_cgroup_t *memcg = calloc(1, sizeof(*memcg));
+
+    if (!memcg)
+        return NULL;
+
+    memcg->parent = mem_cgroup_get(parent ? parent : &root_mem_cgroup);
+    memcg->ref_count = 1;
+    memcg->max = MEMCG_LIMIT_MAX;
+    memcg->high = MEMCG_LIMIT_MAX;
+    spin_init(&memcg->lru_lock);
+    llist_init_head(&memcg->lru);
+
+    spin_lock(&memcg_list_lock);
+    llist_append(&memcg_list, &memcg->node);
+    spin_unlock(&memcg_list_lock);
+    return memcg;
+}
+
+void mem_cgroup_destroy(mem_cgroup_t *memcg) { mem_cgroup_put(memcg); }
+
+mem_cgroup_t *mem_cgroup_get(mem_cgroup_t *memcg) {
+    if (memcg && memcg != &root_mem_cgroup)
+        __atomic_add_fetch(&memcg->ref_count, 1, __ATOMIC_ACQ_REL);
+    return memcg;
+}
+
+/* For list walkers: the final put may be waiting on memcg_list_lock. */
+static bool mem_cgroup_tryget_locked(mem_cgroup_t *memcg) {
+    int refs = __atomic_load_n(&memcg->ref_count, __ATOMIC_ACQUIRE);
+
+    do {
+        if (refs <= 0)
+            return false;
+    } while (!__atomic_compare_exchange_n(&memcg->ref_count, &refs, refs + 1,
+                                          false, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+    return true;
+}
+
+void mem_cgroup_put(mem_cgroup_t *memcg) {
+    mem_cgroup_t *parent;
+
+    if (!memcg || memcg == &root_mem_cgroup)
+        return;
+    if (__atomic_sub_fetch(&memcg->ref_count, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    spin_lock(&memcg_list_lock);
+    llist_delete(&memcg->node);
+    spin_unlock(&memcg_list_lock);
+
+    parent = memcg->parent;
+    free(memcg);
+    mem_cgroup_put(parent);
+}
+
+mem_cgroup_t *mem_cgroup_iter(mem_cgroup_t *root, mem_cgroup_t *prev) {
+    mem_cgroup_t *next = NULL;
+    struct llist_header *pos;
+
+    if (!root)
+        root = &root_mem_cgroup;
+    if (!prev)
+        return mem_cgroup_get(root);
+
+    // parents are created first, so the subtree follows its root
+    spin_lock(&memcg_list_lock);
+    pos = prev == &root_mem_cgroup ? memcg_list.next : prev->node.next;
+    for (; pos != &memcg_list; pos = pos->next) {
+        mem_cgroup_t *memcg = list_entry(pos, mem_cgroup_t, node);
+
+        if (mem_cgroup_is_descendant(memcg, root) &&
+            mem_cgroup_tryget_locked(memcg)) {
+            next = memcg;
+            break;
+        }
+    }
+    spin_unlock(&memcg_list_lock);
+
+    mem_cgroup_put(prev);
+    return next;
+}
+
+/*
+ * task->cgroup holds a reference on the cgroup (and so on its memcg) for
+ * as long as it points there; psi_lock keeps it from being swapped under us.
+ */
+static mem_cgroup_t *mem_cgroup_get_task(task_t *task) {
+    mem_cgroup_t *memcg = NULL;
+
+    if (!task)
+        return &root_mem_cgroup;
+
+    spin_lock(&task->psi_lock);
+    if (task->cgroup)
+        memcg = mem_cgroup_get(cgroup_memcg(task->cgroup));
+    spin_unlock(&task->psi_lock);
+    return memcg ? memcg : &root_mem_cgroup;
+}
+
+static bool mem_cgroup_task_dying(task_t *task) {
+    return task->signal && task->signal->sighand &&
+           task->signal->sighand->group_exit;
+}
+
+/* Returns the ancestor whose memory.max the charge would cross, if any. */
+static mem_cgroup_t *mem_cgroup_try_charge_counters(mem_cgroup_t *memcg,
+                                                    uint64_t nr_pages) {
+    for (mem_cgroup_t *pos = memcg; pos; pos = pos->parent) {
+        uint64_t usage =
+            __atomic_add_fetch(&pos->usage, nr_pages, __ATOMIC_ACQ_REL);
+
+        if (usage <= __atomic_load_n(&pos->max, __ATOMIC_RELAXED))
+            continue;
+
+        for (mem_cgroup_t *undo = memcg;; undo = undo->parent) {
+            __atomic_sub_fetch(&undo->usage, nr_pages, __ATOMIC_ACQ_REL);
+            if (undo == pos)
+                break;
+        }
+        return pos;
+    }
+    return NULL;
+}
+
+int mem_cgroup_charge_page(uint64_t paddr, mem_cgroup_stat_item_t item) {
+    page_t *page = get_page_by_addr(paddr);
+    task_t *task = current_task;
+    int retries = MEMCG_RECLAIM_RETRIES;
+    mem_cgroup_t *memcg, *over;
+    uint64_t start_ns;
+
+    if (!page)
+        return 0;
+
+    memcg = mem_cgroup_get_task(task);
+    while ((over = mem_cgroup_try_charge_counters(memcg, 1))) {
+        mem_cgroup_event(over, MEMCG_MAX);
+        if (!retries--) {
+            mem_cgroup_event(over, MEMCG_OOM);
+            if (task)
+                task->memcg_in_oom = true;
+            mem_cgroup_put(memcg);
+            return -ENOMEM;
+        }
+        start_ns = nano_time();
+        (void)mem_cgroup_reclaim(over, MEMCG_CHARGE_BATCH);
+        task_delay_end(TASK_DELAY_RECLAIM, start_ns);
+    }
+
+    page->memcg = memcg;
+    if (item == MEMCG_FILE)
+        page->flags |= PAGE_FLAG_MEMCG_FILE;
+    mem_cgroup_stat_add(memcg, item, 1);
+
+    for (mem_cgroup_t *pos = memcg; pos; pos = pos->parent) {
+        if (mem_cgroup_usage(pos) <=
+            __atomic_load_n(&pos->high, __ATOMIC_RELAXED))
+            continue;
+        mem_cgroup_event(pos, MEMCG_HIGH);
+        if (task)
+            task->memcg_nr_pages_over_high++;
+        break;
+    }
+    return 0;
+}
+
+void mem_cgroup_uncharge_page(page_t *page) {
+    mem_cgroup_t *memcg = page ? page->memcg : NULL;
+    mem_cgroup_stat_item_t item;
+
+    if (!memcg)
+        return;
+
+    item = (page->flags & PAGE_FLAG_MEMCG_FILE) ? MEMCG_FILE : MEMCG_ANON;
+    page->memcg = NULL;
+    page->flags &= ~PAGE_FLAG_MEMCG_FILE;
+
+    __atomic_sub_fetch(&memcg->stat[item], 1, __ATOMIC_RELAXED);
+    for (mem_cgroup_t *pos = memcg; pos; pos = pos->parent)
+        __atomic_sub_fetch(&pos->usage, 1, __ATOMIC_ACQ_REL);
+    mem_cgroup_put(memcg);
+}
+
+mem_cgroup_t *mem_cgroup_from_paddr(uint64_t paddr) {
+    page_t *page = get_page_by_addr(paddr);
+
+    return page ? page->memcg : NULL;
+}
+
+static bool mem_cgroup_below_low(mem_cgroup_t *memcg) {
+    uint64_t low = __atomic_load_n(&memcg->low, __ATOMIC_RELAXED);
+
+    return low && mem_cgroup_usage(memcg) <= low;
+}
+
+/*
+ * memory.low is best effort: groups under it are skipped unless nobody
+ * else below root had anything left to give back.
+ */
+uint64_t mem_cgroup_reclaim(mem_cgroup_t *root, uint64_t nr_pages) {
+    uint64_t reclaimed = 0;
+    unsigned long pflags;
+
+    if (!root)
+        root = &root_mem_cgroup;
+
+    psi_memstall_enter(&pflags);
+    for (int pass = 0; pass < 2 && !reclaimed; pass++) {
+        mem_cgroup_t *memcg = NULL;
+
+        while ((memcg = mem_cgroup_iter(root, memcg))) {
+            uint64_t scanned = 0;
+            uint64_t want, got;
+
+            if (memcg != root && mem_cgroup_below_low(memcg)) {
+                if (!pass)
+                    continue;
+                mem_cgroup_event(memcg, MEMCG_LOW);
+            }
+
+            if (nr_pages)
+                want = nr_pages - reclaimed;
+            else
+                want = (__atomic_load_n(&memcg->lru_pages, __ATOMIC_ACQUIRE) +
+                        1) /
+                       2;
+            got = page_cache_reclaim_memcg(memcg, want, &scanned);
+            mem_cgroup_stat_add(memcg, MEMCG_PGSCAN, scanned);
+            mem_cgroup_stat_add(memcg, MEMCG_PGSTEAL, got);
+            reclaimed += got;
+
+            if (nr_pages && reclaimed >= nr_pages) {
+                mem_cgroup_put(memcg);
+                goto out;
+            }
+        }
+    }
+out:
+    psi_memstall_leave(&pflags);
+    return reclaimed;
+}
+
+/*
+ * Quadratic in how far past memory.high the group is: a group a little
+ * over hardly notices, one at twice its high sleeps the full 2s.
+ */
+static uint64_t mem_cgroup_high_delay(mem_cgroup_t *memcg) {
+    uint64_t high = __atomic_load_n(&memcg->high, __ATOMIC_RELAXED);
+    uint64_t usage = mem_cgroup_usage(memcg);
+    uint64_t overage;
+
+    if (usage <= high)
+        return 0;
+
+    overage = ((usage - high) << 20) / MAX(high, 1ULL);
+    overage = MIN(overage, 1ULL << 20);
+    return (((overage * overage) >> 20) * MEMCG_MAX_HIGH_DELAY_NS) >> 20;
+}
+
+void mem_cgroup_handle_over_high(void) {
+    task_t *task = current_task;
+    uint64_t delay_ns = 0;
+    uint64_t nr_pages;
+    mem_cgroup_t *memcg;
+    unsigned long pflags;
+
+    if (!task || !task->memcg_nr_pages_over_high)
+        return;
+
+    nr_pages = task->memcg_nr_pages_over_high;
+    task->memcg_nr_pages_over_high = 0;
+
+    memcg = mem_cgroup_get_task(task);
+    for (mem_cgroup_t *pos = memcg; pos; pos = pos->parent) {
+        uint64_t high = __atomic_load_n(&pos->high, __ATOMIC_RELAXED);
+        uint64_t usage = mem_cgroup_usage(pos);
+
+        if (usage > high) {
+            uint64_t start_ns = nano_time();
+
+            (void)mem_cgroup_reclaim(
+                pos, MIN(usage - high, MAX(nr_pages, MEMCG_CHARGE_BATCH)));
+            task_delay_end(TASK_DELAY_RECLAIM, start_ns);
+        }
+    }
+    for (mem_cgroup_t *pos = memcg; pos; pos = pos->parent)
+        delay_ns = MAX(delay_ns, mem_cgroup_high_delay(pos));
+    mem_cgroup_put(memcg);
+
+    // a single page over pays a fraction of what a whole batch would
+    delay_ns = delay_ns * MIN(nr_pages, MEMCG_CHARGE_BATCH) /
+               MEMCG_CHARGE_BATCH;
+    delay_ns = MIN(delay_ns, MEMCG_MAX_HIGH_DELAY_NS);
+    if (!delay_ns)
+        return;
+
+    psi_memstall_enter(&pflags);
+    task_block(task, TASK_BLOCKING, (int64_t)delay_ns, "memcg_high");
+    psi_memstall_leave(&pflags);
+}
+
+/*
+ * Kills the process with the most resident pages below memcg and returns
+ * its tgid. A process already on its way out counts as the victim, so
+ * chargers racing into the same OOM wait for it rather than kill another.
+ */
+static uint64_t mem_cgroup_oom_kill(mem_cgroup_t *memcg) {
+    uint64_t victim = 0;
+    uint64_t victim_pages = 0;
+    bool dying = false;
+
+    cgroup_lock();
+    spin_lock(&task_queue_lock);
+    if (task_pid_map.buckets) {
+        for (size_t i = 0; i < task_pid_map.bucket_count; ++i) {
+            hashmap_entry_t *entry = &task_pid_map.buckets[i];
+            mem_cgroup_t *owner = NULL;
+            task_t *task;
+            uint64_t pages;
+
+            if (!hashmap_entry_is_occupied(entry))
+                continue;
+
+            task = (task_t *)entry->value;
+            if (!task || task->state == TASK_DIED || task->is_kernel ||
+                !task->mm)
+                continue;
+            if (task->cgroup)
+                owner = cgroup_memcg(task->cgroup);
+            if (!mem_cgroup_is_descendant(owner ? owner : &root_mem_cgroup,
+                                          memcg))
+                continue;
+
+            if (mem_cgroup_task_dying(task)) {
+                victim = task_effective_tgid(task);
+                dying = true;
+                break;
+            }
+
+            pages = task_mm_resident_pages(task->mm);
+            if (!victim || pages > victim_pages) {
+                victim = task_effective_tgid(task);
+                victim_pages = pages;
+            }
+        }
+    }
+    spin_unlock(&task_queue_lock);
+    cgroup_unlock();
+
+    if (!victim || dying)
+        return victim;
+
+    mem_cgroup_event(memcg, MEMCG_OOM_KILL);
+    vm_event_count(VM_OOM_KILL);
+    printk("memcg: out of memory, killing process %llu (%llu pages)\n",
+           (unsigned long long)victim, (unsigned long long)victim_pages);
+    task_kill_thread_group(victim, SIGKILL);
+    return victim;
+}
+
+/*
+ * Reclaim skips dirty pages and nothing else is bound to clean them in
+ * time for a writer at memory.max, so write a batch back from the subtree
+ * before calling it an OOM.
+ */
+static uint64_t mem_cgroup_writeback(mem_cgroup_t *root, uint64_t nr_pages) {
+    mem_cgroup_t *memcg = NULL;
+    uint64_t written = 0;
+
+    while ((memcg = mem_cgroup_iter(root, memcg))) {
+        written += page_cache_writeback_memcg(memcg, nr_pages - written);
+        if (written >= nr_pages) {
+            mem_cgroup_put(memcg);
+            break;
+        }
+    }
+    return written;
+}
+
+bool mem_cgroup_oom_synchronize(void) {
+    task_t *task = current_task;
+    mem_cgroup_t *memcg, *over = NULL;
+    uint64_t victim;
+
+    if (!task || !task->memcg_in_oom)
+        return false;
+    task->memcg_in_oom = false;
+    if (mem_cgroup_task_dying(task))
+        return false;
+
+    memcg = mem_cgroup_get_task(task);
+    for (mem_cgroup_t *pos = memcg; pos; pos = pos->parent) {
+        if (mem_cgroup_usage(pos) >=
+            __atomic_load_n(&pos->max, __ATOMIC_RELAXED)) {
+            over = pos;
+            break;
+        }
+    }
+    if (!over) {
+        // somebody freed memory in the meantime
+        mem_cgroup_put(memcg);
+        return true;
+    }
+    if (mem_cgroup_writeback(over, MEMCG_CHARGE_BATCH)) {
+        // the retried charge reclaims what just became clean
+        mem_cgroup_put(memcg);
+        return true;
+    }
+
+    victim = mem_cgroup_oom_kill(over);
+    mem_cgroup_put(memcg);
+    if (!victim || victim == task_effective_tgid(task))
+        return false;
+
+    task_block(task, TASK_BLOCKING, MEMCG_OOM_WAIT_NS, "memcg_oom");
+    return true;
+}
+
+int mem_cgroup_set_max(mem_cgroup_t *memcg, uint64_t pages) {
+    int retries = MEMCG_RECLAIM_RETRIES;
+
+    if (!memcg || memcg == &root_mem_cgroup)
+        return -EINVAL;
+
+    __atomic_store_n(&memcg->max, pages, __ATOMIC_RELEASE);
+    while (mem_cgroup_usage(memcg) > pages) {
+        uint64_t usage = mem_cgroup_usage(memcg);
+
+        if (mem_cgroup_reclaim(memcg, usage - pages))
+            continue;
+        if (retries--)
+            continue;
+
+        mem_cgroup_event(memcg, MEMCG_OOM);
+        (void)mem_cgroup_oom_kill(memcg);
+        break;
+    }
+    return 0;
+}
+
+int mem_cgroup_set_high(mem_cgroup_t *memcg, uint64_t pages) {
+    uint64_t usage;
+
+    if (!memcg || memcg == &root_mem_cgroup)
+        return -EINVAL;
+
+    __atomic_store_n(&memcg->high, pages, __ATOMIC_RELEASE);
+    usage = mem_cgroup_usage(memcg);
+    if (usage > pages)
+        (void)mem_cgroup_reclaim(memcg, usage - pages);
+    return 0;
+}
+
+int mem_cgroup_set_low(mem_cgroup_t *memcg, uint64_t pages) {
+    if (!memcg || memcg == &root_mem_cgroup)
+        return -EINVAL;
+
+    __atomic_store_n(&memcg->low, pages, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static char *mem_cgroup_finish(string_builder_t *builder,
+                               size_t *content_len) {
+    char *data = builder->data;
+
+    *content_len = builder->size;
+    free(builder);
+    return data;
+}
+
+char *mem_cgroup_show_current(mem_cgroup_t *memcg, size_t *content_len) {
+    string_builder_t *builder;
+
+    *content_len = 0;
+    if (!memcg)
+        return NULL;
+    builder = create_string_builder(32);
+    if (!builder)
+        return NULL;
+
+    string_builder_append(
+        builder, "%llu\n",
+        (unsigned long long)(mem_cgroup_usage(memcg) * PAGE_SIZE));
+    return mem_cgroup_finish(builder, content_len);
+}
+
+char *mem_cgroup_show_limit(mem_cgroup_t *memcg, const uint64_t *limit,
+                            size_t *content_len) {
+    string_builder_t *builder;
+    uint64_t pages;
+
+    *content_len = 0;
+    if (!memcg || !limit)
+        return NULL;
+    builder = create_string_builder(32);
+    if (!builder)
+        return NULL;
+
+    pages = __atomic_load_n(limit, __ATOMIC_ACQUIRE);
+    if (pages == MEMCG_LIMIT_MAX)
+        string_builder_append(builder, "max\n");
+    else
+        string_builder_append(builder, "%llu\n",
+                              (unsigned long long)(pages * PAGE_SIZE));
+    return mem_cgroup_finish(builder, content_len);
+}
+
+char *mem_cgroup_show_stat(mem_cgroup_t *memcg, size_t *content_len) {
+    uint64_t stat[NR_MEMCG_STATS] = {0};
+    string_builder_t *builder;
+    mem_cgroup_t *pos = NULL;
+
+    *content_len = 0;
+    if (!memcg)
+        return NULL;
+    builder = create_string_builder(128);
+    if (!builder)
+        return NULL;
+
+    while ((pos = mem_cgroup_iter(memcg, pos))) {
+        for (int i = 0; i < NR_MEMCG_STATS; i++)
+            stat[i] += __atomic_load_n(&pos->stat[i], __ATOMIC_RELAXED);
+    }
+
+    string_builder_append(
+        builder,
+        "anon %llu\n"
+        "file %llu\n"
+        "pgscan %llu\n"
+        "pgsteal %llu\n",
+        (unsigned long long)(stat[MEMCG_ANON] * PAGE_SIZE),
+        (unsigned long long)(stat[MEMCG_FILE] * PAGE_SIZE),
+        (unsigned long long)stat[MEMCG_PGSCAN],
+        (unsigned long long)stat[MEMCG_PGSTEAL]);
+    return mem_cgroup_finish(builder, content_len);
+}
+
+char *mem_cgroup_show_events(mem_cgroup_t *memcg, size_t *content_len) {
+    uint64_t events[NR_MEMCG_EVENTS] = {0};
+    string_builder_t *builder;
+    mem_cgroup_t *pos = NULL;
+
+    *content_len = 0;
+    if (!memcg)
+        return NULL;
+    builder = create_string_builder(96);
+    if (!builder)
+        return NULL;
+
+    while ((pos = mem_cgroup_iter(memcg, pos))) {
+        for (int i = 0; i < NR_MEMCG_EVENTS; i++)
+            events[i] += __atomic_load_n(&pos->events[i], __ATOMIC_RELAXED);
+    }
+
+    string_builder_append(builder,
+                          "low %llu\n"
+                          "high %llu\n"
+                          "max %llu\n"
+                          "oom %llu\n"
+                          "oom_kill %llu\n",
+                          (unsigned long long)events[MEMCG_LOW],
+                          (unsigned long long)events[MEMCG_HIGH],
+                          (unsigned long long)events[MEMCG_MAX],
+                          (unsigned long long)events[MEMCG_OOM],
+                          (unsigned long long)events[MEMCG_OOM_KILL]);
+    return mem_cgroup_finish(builder, content_len);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <libs/llist.h>
+
+struct page;
+struct task;
+
+/*
+ * Memory controller. Every user page (anonymous fault pages and page cache
+ * frames) is charged to the memcg of the task that brought it in; page_t
+ * keeps the owner and a reference on it until the frame is freed. Usage is
+ * hierarchical: a charge counts against every ancestor's memory.max.
+ *
+ * Page cache frames also sit on their owner's LRU, so reclaim can be aimed
+ * at one subtree. Limit reclaim runs inline in the charge; memory.high
+ * overage is paid back by the charging task (reclaim plus a sleep) at the
+ * next safe point, and a charge that still fails at memory.max leaves the
+ * task to pick and kill an OOM victim inside the subtree, again outside
+ * any locks.
+ *
+ * Tasks in the root cgroup charge root_mem_cgroup, which has no limits but
+ * owns the LRU for their page cache.
+ */
+
+typedef enum mem_cgroup_stat_item {
+    MEMCG_ANON,
+    MEMCG_FILE,
+    MEMCG_PGSCAN,
+    MEMCG_PGSTEAL,
+    NR_MEMCG_STATS,
+} mem_cgroup_stat_item_t;
+
+typedef enum mem_cgroup_event {
+    MEMCG_LOW,
+    MEMCG_HIGH,
+    MEMCG_MAX,
+    MEMCG_OOM,
+    MEMCG_OOM_KILL,
+    NR_MEMCG_EVENTS,
+} mem_cgroup_event_t;
+
+#define MEMCG_LIMIT_MAX UINT64_MAX // pages
+#define MEMCG_CHARGE_BATCH 32ULL   // pages reclaimed per failed charge
+#define MEMCG_RECLAIM_RETRIES 5
+#define MEMCG_MAX_HIGH_DELAY_NS (2ULL * 1000000000ULL)
+#define MEMCG_OOM_WAIT_NS (10ULL * 1000000ULL)
+
+typedef struct mem_cgroup {
+    struct llist_header node; // memcg_list, parents before children
+    struct mem_cgroup *parent;
+    volatile int ref_count;
+    uint64_t usage; // pages charged here and below
+    uint64_t max;
+    uint64_t high;
+    uint64_t low;
+    spinlock_t lru_lock;
+    struct llist_header lru; // page cache pages, oldest first
+    uint64_t lru_pages;
+    uint64_t stat[NR_MEMCG_STATS];    // this group only
+    uint64_t events[NR_MEMCG_EVENTS]; // this group only
+} mem_cgroup_t;
+
+extern mem_cgroup_t root_mem_cgroup;
+
+mem_cgroup_t *mem_cgroup_create(mem_cgroup_t *parent);
+/* The cgroup is gone; charged pages keep the memcg around until freed. */
+void mem_cgroup_destroy(mem_cgroup_t *memcg);
+mem_cgroup_t *mem_cgroup_get(mem_cgroup_t *memcg);
+void mem_cgroup_put(mem_cgroup_t *memcg);
+
+/*
+ * Walks root and every memcg below it, root first. Returns each with a
+ * reference held and drops the one on prev; mem_cgroup_put() the last
+ * one when leaving early.
+ */
+mem_cgroup_t *mem_cgroup_iter(mem_cgroup_t *root, mem_cgroup_t *prev);
+
+/* Charges a freshly allocated order-0 frame to current's memcg. */
+int mem_cgroup_charge_page(uint64_t paddr, mem_cgroup_stat_item_t item);
+/* Called by the page allocator once the last reference is gone. */
+void mem_cgroup_uncharge_page(struct page *page);
+mem_cgroup_t *mem_cgroup_from_paddr(uint64_t paddr);
+
+/*
+ * Reclaims up to nr_pages below root, 0 means half of every LRU. The
+ * caller charges the stall to TASK_DELAY_RECLAIM.
+ */
+uint64_t mem_cgroup_reclaim(mem_cgroup_t *root, uint64_t nr_pages);
+
+/*
+ * Safe points for the charging task, with no locks held: pay back
+ * memory.high overage, and after a charge failed at memory.max kill a
+ * victim in the subtree. The latter returns true if the charge is worth
+ * retrying.
+ */
+void mem_cgroup_handle_over_high(void);
+bool mem_cgroup_oom_synchronize(void);
+
+int mem_cgroup_set_max(mem_cgroup_t *memcg, uint64_t pages);
+int mem_cgroup_set_high(mem_cgroup_t *memcg, uint64_t pages);
+int mem_cgroup_set_low(mem_cgroup_t *memcg, uint64_t pages);
+
+char *mem_cgroup_show_current(mem_cgroup_t *memcg, size_t *content_len);
+char *mem_cgroup_show_limit(mem_cgroup_t *memcg, const uint64_t *limit,
+                            size_t *content_len);
+char *mem_cgroup_show_stat(mem_cgroup_t *memcg, size_t *content_len);
+char *mem_cgroup_show_events(mem_cgroup_t *memcg, size_t *content_len);
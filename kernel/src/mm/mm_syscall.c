@@ -5,6 +5,7 @@
 #include <fs/vfs/vfs.h>
 #include <irq/irq_manager.h>
 #include <task/task.h>
+#include <task/perf_event.h>
 
 #define NUMA_NODE_COUNT 1
 #define MM_PTE_ATTR_BATCH_PAGES 65536
@@ -967,6 +968,7 @@ uint64_t sys_mmap(uint64_t addr, uint64_t len, uint64_t prot, uint64_t flags,
     }
 
     spin_lock(&mgr->lock);
+    perf_event_mmap(vma);
     vma_try_merge_around(mgr, &vma);
     spin_unlock(&mgr->lock);
 
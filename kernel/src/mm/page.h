@@ -3,6 +3,7 @@
 #include <libs/klibc.h>
 
 struct kmem_cache;
+struct mem_cgroup;
 
 typedef struct page {
     int refcount;
@@ -18,6 +19,7 @@ typedef struct page {
         size_t requested_size;
     };
     uint32_t slab_state;
+    struct mem_cgroup *memcg; // charged owner, see mm/memcg.h
 } page_t;
 
 #define PAGE_FLAG_BUDDY 0x01
@@ -25,6 +27,7 @@ typedef struct page {
 #define PAGE_FLAG_LARGE 0x04
 #define PAGE_FLAG_PCP 0x08
 #define PAGE_FLAG_FREEING 0x10
+#define PAGE_FLAG_MEMCG_FILE 0x20 // charged as page cache, not anon
 
 #define PAGE_LIST_NONE UINT64_MAX
 
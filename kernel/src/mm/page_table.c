@@ -543,6 +543,93 @@ uint64_t unmap_page_range_defer_release(uint64_t *pgdir, uint64_t vaddr,
     return cursor;
 }
 
+static uint64_t walk_present_range(uint64_t *table, uint64_t level,
+                                   uint64_t table_base, uint64_t start,
+                                   uint64_t end, page_table_walk_fn_t fn,
+                                   void *data, bool *stopped, uint64_t levels) {
+    if (!table || start >= end || level == 0 || level > levels)
+        return end;
+
+    uint64_t span = PAGE_TABLE_LEVEL_SIZE(level, levels);
+    if (!span)
+        return end;
+
+    uint64_t entries = page_table_entries_per_level();
+    uint64_t first = PAGE_TABLE_LEVEL_INDEX(start, level, levels);
+    uint64_t last = PAGE_TABLE_LEVEL_INDEX(end - 1, level, levels);
+    if (first >= entries)
+        first = entries - 1;
+    if (last >= entries)
+        last = entries - 1;
+
+    for (uint64_t index = first; index <= last; index++) {
+        uint64_t entry_base = table_base + index * span;
+        uint64_t entry_end = entry_base + span;
+        if (entry_end < entry_base)
+            entry_end = UINT64_MAX;
+        if (entry_end <= start || entry_base >= end)
+            continue;
+
+        uint64_t from = pt_range_max(start, entry_base);
+        uint64_t to = pt_range_min(end, entry_end);
+        uint64_t entry = table[index];
+
+        if (level == levels || ARCH_PT_IS_LARGE(entry)) {
+            if (level == levels && !(entry & ARCH_PT_FLAG_VALID))
+                continue;
+            if (!fn(data, from, entry, to - from)) {
+                *stopped = true;
+                return to;
+            }
+            continue;
+        }
+        if (!ARCH_PT_IS_TABLE(entry))
+            continue;
+
+        uint64_t *child = (uint64_t *)phys_to_virt(ARCH_READ_PTE(entry));
+        uint64_t ret = walk_present_range(child, level + 1, entry_base, from,
+                                          to, fn, data, stopped, levels);
+        if (*stopped)
+            return ret;
+    }
+
+    return end;
+}
+
+uint64_t page_table_walk_range(uint64_t *pgdir, uint64_t start, uint64_t end,
+                               page_table_walk_fn_t fn, void *data) {
+    if (!pgdir || !fn || start >= end)
+        return end;
+
+    uint64_t levels = arch_page_table_levels();
+    if (!page_table_levels_valid(levels))
+        return end;
+
+    uint64_t region_size = page_table_region_size(1, levels);
+    uint64_t cursor = start;
+    bool stopped = false;
+
+    while (cursor < end) {
+        uint64_t table_base =
+            region_size == UINT64_MAX ? 0 : (cursor & ~(region_size - 1));
+        uint64_t table_end = table_base + region_size;
+        if (table_end < table_base)
+            table_end = UINT64_MAX;
+        uint64_t chunk_end = pt_range_min(end, table_end);
+        if (chunk_end <= cursor)
+            chunk_end = end;
+
+        uint64_t next = walk_present_range(pgdir, 1, table_base, cursor,
+                                           chunk_end, fn, data, &stopped,
+                                           levels);
+        if (stopped)
+            return next;
+        cursor = chunk_end;
+    }
+
+    return end;
+}
+
 uint64_t map_change_attribute(uint64_t *pgdir, uint64_t vaddr, uint64_t flags,
                               bool flush) {
     uint64_t levels = arch_page_table_levels();
@@ -67,6 +67,22 @@ uint64_t unmap_page_range_defer_release(uint64_t *pgdir, uint64_t vaddr,
                                         unmap_release_batch_t *batch,
                                         uint64_t max_scan, uint64_t *unmapped);
 void unmap_release_batch_commit(unmap_release_batch_t *batch);
+
+/*
+ * Called for each present leaf in a walked range; huge leaves come once,
+ * clipped to the range, with size covering the part inside it. Returning
+ * false stops the walk after this leaf.
+ */
+typedef bool (*page_table_walk_fn_t)(void *data, uint64_t vaddr, uint64_t pte,
+                                     uint64_t size);
+
+/*
+ * Visits the present leaves in [start, end) in address order, skipping
+ * absent tables without touching their entries. Returns where a stopped
+ * walk resumes, or end. Callers hold the mm lock so tables stay put.
+ */
+uint64_t page_table_walk_range(uint64_t *pgdir, uint64_t start, uint64_t end,
+                               page_table_walk_fn_t fn, void *data);
 void unmap_release_deferred_drain(void);
 
 void page_table_init();
@@ -4,6 +4,8 @@
 #include <mm/hhdm.h>
 #include <mm/mm.h>
 #include <mm/page.h>
+#include <task/psi.h>
+#include <task/taskstats.h>
 
 #define KMALLOC_ALIGN 16UL
 #define SLAB_INUSE_SHIFT 16
@@ -293,6 +295,8 @@ static page_t *cache_grow(kmem_cache_t *cache) {
 static void *cache_alloc(size_t size, size_t cache_index) {
     kmem_cache_t *cache = &kmalloc_caches[cache_index];
     bool reclaimed = false;
+    unsigned long pflags;
+    uint64_t start_ns;
 
 retry:
     spin_lock(&cache->lock);
@@ -304,14 +308,21 @@ retry:
             spin_unlock(&cache->lock);
             if (!reclaimed) {
                 reclaimed = true;
+                // stalled on memory from here until the retry resolves
+                psi_memstall_enter(&pflags);
+                start_ns = nano_time();
                 (void)malloc_trim(0);
                 (void)page_cache_reclaim_half();
+                task_delay_end(TASK_DELAY_RECLAIM, start_ns);
                 goto retry;
             }
+            psi_memstall_leave(&pflags);
             return NULL;
         }
         list_push(cache, slab);
     }
+    if (reclaimed)
+        psi_memstall_leave(&pflags);
 
     if (cache->empty_slab_pfn != PAGE_LIST_NONE &&
         cache->empty_slab_pfn == page_to_pfn(slab))
@@ -460,8 +471,11 @@ static void *large_alloc_aligned(size_t size, size_t alignment) {
     uintptr_t phys =
         buddy_alloc_zone_pages(zone, order_pages(order), &allocated_pages);
     if (!phys || allocated_pages != order_pages(order)) {
+        uint64_t start_ns = nano_time();
+
         (void)malloc_trim(0);
         (void)page_cache_reclaim_half();
+        task_delay_end(TASK_DELAY_RECLAIM, start_ns);
         phys =
             buddy_alloc_zone_pages(zone, order_pages(order), &allocated_pages);
     }
@@ -0,0 +1,29 @@
+#include <mm/vmstat.h>
+
+vm_event_row_t vm_event_counts[MAX_CPU_NUM];
+
+static const char *const vm_event_names[NR_VM_EVENTS] = {
+    [VM_PGFAULT] = "pgfault",
+    [VM_PGMAJFAULT] = "pgmajfault",
+    [VM_PGSCAN_DIRECT] = "pgscan_direct",
+    [VM_PGSTEAL_DIRECT] = "pgsteal_direct",
+    [VM_ALLOCSTALL] = "allocstall",
+    [VM_OOM_KILL] = "oom_kill",
+};
+
+uint64_t vm_event_read(vm_event_item_t item) {
+    size_t online_cpus = cpu_count ? MIN(cpu_count, (uint64_t)MAX_CPU_NUM) : 1;
+    uint64_t sum = 0;
+
+    if (item >= NR_VM_EVENTS)
+        return 0;
+
+    for (size_t cpu = 0; cpu < online_cpus; cpu++)
+        sum += __atomic_load_n(&vm_event_counts[cpu].count[item],
+                               __ATOMIC_RELAXED);
+    return sum;
+}
+
+const char *vm_event_name(vm_event_item_t item) {
+    return item < NR_VM_EVENTS ? vm_event_names[item] : NULL;
+}
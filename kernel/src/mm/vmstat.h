@@ -0,0 +1,41 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <arch/arch.h>
+
+/*
+ * VM event counters behind /proc/vmstat. Each CPU adds to its own
+ * cache-line aligned row with a relaxed atomic, so counting costs no shared
+ * cache line; a reader sums
+ * the rows and may see an event on one CPU before one that came first on
+ * another. Counts only grow.
+ */
+typedef enum vm_event_item {
+    VM_PGFAULT,        // faults that resolved, major ones included
+    VM_PGMAJFAULT,     // ... that waited for a page cache read
+    VM_PGSCAN_DIRECT,  // LRU pages looked at by reclaim
+    VM_PGSTEAL_DIRECT, // ... and freed
+    VM_ALLOCSTALL,     // allocations that fell back to reclaim
+    VM_OOM_KILL,
+    NR_VM_EVENTS,
+} vm_event_item_t;
+
+typedef struct vm_event_row {
+    uint64_t count[NR_VM_EVENTS];
+} __cacheline_aligned_smp vm_event_row_t;
+
+extern vm_event_row_t vm_event_counts[MAX_CPU_NUM];
+
+static inline void vm_event_add(vm_event_item_t item, uint64_t delta) {
+    uint64_t cpu_id = current_cpu_id;
+    uint64_t *row = vm_event_counts[cpu_id < MAX_CPU_NUM ? cpu_id : 0].count;
+
+    __atomic_fetch_add(&row[item], delta, __ATOMIC_RELAXED);
+}
+
+static inline void vm_event_count(vm_event_item_t item) {
+    vm_event_add(item, 1);
+}
+
+uint64_t vm_event_read(vm_event_item_t item);
+const char *vm_event_name(vm_event_item_t item);
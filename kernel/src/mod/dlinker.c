@@ -1099,6 +1099,41 @@ bool dlinker_lookup_symbol_by_addr(uint64_t addr,
     return found_module || found_kernel;
 }
 
+static char module_symbol_nm_type(const module_symbol_t *sym) {
+    char type = sym->type == STT_FUNC || sym->type == STT_NOTYPE ? 't' : 'd';
+
+    return sym->exported ? type - 'a' + 'A' : type;
+}
+
+bool dlinker_symbol_at(size_t index, dlinker_symbol_t *sym) {
+    size_t nr_kernel = kernel_symbol_table_available() ? kallsyms_num : 0;
+
+    if (sym == NULL) {
+        return false;
+    }
+
+    if (index < nr_kernel) {
+        const kernel_builtin_symbol_t *ksym = &kallsyms_symbols[index];
+
+        sym->name = ksym->name ? ksym->name : "";
+        sym->module_name = NULL;
+        sym->addr = ksym->addr;
+        sym->type = (char)ksym->nm_type;
+        return true;
+    }
+
+    index -= nr_kernel;
+    if (index >= loaded_module_symbol_count) {
+        return false;
+    }
+
+    sym->name = loaded_module_symbols[index].name;
+    sym->module_name = loaded_module_symbols[index].module_name;
+    sym->addr = loaded_module_symbols[index].addr;
+    sym->type = module_symbol_nm_type(&loaded_module_symbols[index]);
+    return true;
+}
+
 void dlinker_init() {
     struct vfs_file *modules_root = NULL;
     struct vfs_open_how dir_how = {
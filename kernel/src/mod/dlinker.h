@@ -5,7 +5,7 @@
 #include <libs/elf.h>
 
 #define KERNEL_MODULES_SPACE_START 0xffffffffd0000000
-#define KERNEL_MODULES_SPACE_END 0xfffffffff0000000
+#define KERNEL_MODULES_SPACE_END 0xffffffffec000000
 
 typedef int (*dlinit_t)(void);
 
@@ -34,6 +34,14 @@ typedef struct module_symbol {
     bool exported;
 } module_symbol_t;
 
+/* One line of /proc/kallsyms: module_name is NULL for the kernel image. */
+typedef struct dlinker_symbol {
+    const char *name;
+    const char *module_name;
+    uint64_t addr;
+    char type; // nm(1) letter
+} dlinker_symbol_t;
+
 typedef struct symbol_lookup_result {
     const char *name;
     const char *module_name;
@@ -55,6 +63,9 @@ dlfunc_t *find_func(const char *name);
 bool dlinker_lookup_symbol_by_addr(uint64_t addr,
                                    symbol_lookup_result_t *result);
 
+/* Kernel image symbols first, then module symbols; false past the end. */
+bool dlinker_symbol_at(size_t index, dlinker_symbol_t *sym);
+
 void find_kernel_symbol();
 
 void dlinker_init();
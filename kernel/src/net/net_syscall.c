@@ -861,6 +861,57 @@ uint64_t sys_connect(int sockfd, const struct sockaddr_un *addr,
     return 0;
 }
 
+/*
+ * MSG_ZEROCOPY skips the bounce buffers when the transport can pin the
+ * caller's pages itself. Sends with an address or control data, and any the
+ * transport declines with -EOPNOTSUPP, are copied as usual.
+ */
+static int64_t socket_sendmsg_zerocopy(fd_t *node, socket_handle_t *handle,
+                                       const struct msghdr *user_msg,
+                                       int flags) {
+    struct msghdr shadow;
+    struct iovec *iov = NULL;
+    size_t iov_bytes, total = 0;
+    int64_t ret;
+
+    if (!(flags & MSG_ZEROCOPY) || !handle || !handle->sendmsg_zerocopy_op)
+        return -EOPNOTSUPP;
+    if (socket_validate_user_struct(user_msg, sizeof(*user_msg)) < 0 ||
+        copy_from_user(&shadow, user_msg, sizeof(shadow)))
+        return -EFAULT;
+    if (shadow.msg_namelen || shadow.msg_controllen || !shadow.msg_iovlen ||
+        shadow.msg_iovlen > SOCKET_IOV_MAX)
+        return -EOPNOTSUPP;
+
+    iov_bytes = shadow.msg_iovlen * sizeof(struct iovec);
+    if (socket_validate_user_struct(shadow.msg_iov, iov_bytes) < 0)
+        return -EFAULT;
+    iov = malloc(iov_bytes);
+    if (!iov)
+        return -ENOMEM;
+    if (copy_from_user(iov, shadow.msg_iov, iov_bytes)) {
+        free(iov);
+        return -EFAULT;
+    }
+
+    for (size_t i = 0; i < shadow.msg_iovlen; i++) {
+        if (socket_validate_user_mapped_buffer(iov[i].iov_base, iov[i].len) <
+            0) {
+            free(iov);
+            return -EFAULT;
+        }
+        total += iov[i].len;
+    }
+    if (total > SOCKET_MSG_PAYLOAD_MAX) {
+        free(iov);
+        return -EMSGSIZE;
+    }
+
+    ret = handle->sendmsg_zerocopy_op(node, iov, shadow.msg_iovlen, flags);
+    free(iov);
+    return ret;
+}
+
 int64_t sys_send(int sockfd, void *buff, size_t len, int flags,
                  struct sockaddr_un *dest_addr, socklen_t addrlen) {
     if (sockfd < 0)
@@ -879,6 +930,15 @@ int64_t sys_send(int sockfd, void *buff, size_t len, int flags,
     }
 
     socket_handle_t *handle = (socket_handle_t *)node->node->i_private;
+    if ((flags & MSG_ZEROCOPY) && !dest_addr && len && handle &&
+        handle->sendmsg_zerocopy_op) {
+        struct iovec iov = {.iov_base = buff, .len = len};
+        int64_t out = handle->sendmsg_zerocopy_op(node, &iov, 1, flags);
+        if (out != -EOPNOTSUPP) {
+            vfs_file_put(node);
+            return out;
+        }
+    }
     if (handle && handle->op && handle->op->sendto) {
         void *kbuf = NULL;
         int ret = socket_alloc_copy_from_user(buff, len, &kbuf);
@@ -1005,6 +1065,11 @@ int64_t sys_sendmsg(int sockfd, const struct msghdr *msg, int flags) {
     }
 
     socket_handle_t *handle = (socket_handle_t *)node->node->i_private;
+    int64_t zc_out = socket_sendmsg_zerocopy(node, handle, msg, flags);
+    if (zc_out != -EOPNOTSUPP) {
+        vfs_file_put(node);
+        return zc_out;
+    }
     if (handle && handle->op && handle->op->sendmsg) {
         socket_msghdr_copy_t msg_copy;
         int ret = socket_prepare_msghdr_from_user(msg, &msg_copy, true);
@@ -1,5 +1,6 @@
 #include <net/netdev.h>
 #include <net/netlink.h>
+#include <net/packet.h>
 #include <mm/mm.h>
 #include <task/task.h>
 #include <task/signal.h>
@@ -8,6 +9,11 @@
 netdev_t *netdevs[MAX_NETDEV_NUM] = {NULL};
 static spinlock_t netdevs_lock = SPIN_INIT;
 
+/* Listeners registered with dev == NULL hear events from every netdev,
+ * including NETDEV_EVENT_REGISTERED for devices that appear later. */
+static netdev_listener_t netdev_global_listeners[NETDEV_MAX_EVENT_LISTENERS];
+static spinlock_t netdev_global_listeners_lock = SPIN_INIT;
+
 #define NETDEV_RX_POLL_FALLBACK_NS (20ULL * 1000ULL * 1000ULL)
 
 static void netdev_default_name(char *name, uint32_t type, uint32_t id) {
@@ -19,10 +25,42 @@ static void netdev_default_name(char *name, uint32_t type, uint32_t id) {
         snprintf(name, NETDEV_NAME_LEN, "wlan%u", id);
         return;
     }
+    if (type == NETDEV_TYPE_LOOPBACK) {
+        snprintf(name, NETDEV_NAME_LEN, "lo");
+        return;
+    }
 
     snprintf(name, NETDEV_NAME_LEN, "net%u", id);
 }
 
+static ssize_t netdev_stat_show(const sysfs_attr_t *attr, void *ctx,
+                                char *buf, size_t size) {
+    netdev_t *dev = netdev_get_by_index((uint32_t)(uintptr_t)ctx);
+    netdev_stats_t stats;
+    uint64_t value;
+
+    if (!dev)
+        return -ENODEV;
+
+    netdev_get_stats(dev, &stats);
+    netdev_put(dev);
+    memcpy(&value, (uint8_t *)&stats + attr->arg, sizeof(value));
+    return snprintf(buf, size, "%llu\n", (unsigned long long)value);
+}
+
+#define NETDEV_STAT_ATTR(field)                                                \
+    {#field, netdev_stat_show, offsetof(netdev_stats_t, field)}
+
+static const sysfs_attr_t netdev_stat_attrs[] = {
+    NETDEV_STAT_ATTR(rx_packets),       NETDEV_STAT_ATTR(tx_packets),
+    NETDEV_STAT_ATTR(rx_bytes),         NETDEV_STAT_ATTR(tx_bytes),
+    NETDEV_STAT_ATTR(rx_errors),        NETDEV_STAT_ATTR(tx_errors),
+    NETDEV_STAT_ATTR(rx_dropped),       NETDEV_STAT_ATTR(tx_dropped),
+    NETDEV_STAT_ATTR(multicast),        NETDEV_STAT_ATTR(collisions),
+    NETDEV_STAT_ATTR(rx_crc_errors),    NETDEV_STAT_ATTR(rx_fifo_errors),
+    NETDEV_STAT_ATTR(rx_missed_errors), NETDEV_STAT_ATTR(tx_fifo_errors),
+};
+
 static void netdev_create_sysfs(netdev_t *dev) {
     char path[256];
     char buf[512];
@@ -59,6 +97,22 @@ static void netdev_create_sysfs(netdev_t *dev) {
         vfs_iput(node);
     }
 
+    // The files look the device up by ifindex, so reads after unregister
+    // fail with -ENODEV instead of touching freed memory
+    node = sysfs_child_append(net_dir, "statistics", true);
+    if (node) {
+        for (size_t i = 0;
+             i < sizeof(netdev_stat_attrs) / sizeof(netdev_stat_attrs[0]);
+             i++) {
+            vfs_node_t *child = sysfs_child_append_attr(
+                node, &netdev_stat_attrs[i],
+                (void *)(uintptr_t)(dev->id + 1));
+            if (child)
+                vfs_iput(child);
+        }
+        vfs_iput(node);
+    }
+
     if (dev->type == NETDEV_TYPE_WIFI) {
         node = sysfs_child_append(net_dir, "phy80211", true);
         if (node)
@@ -232,7 +286,8 @@ netdev_t *get_default_netdev() {
 
     spin_lock(&netdevs_lock);
     for (uint32_t i = 0; i < MAX_NETDEV_NUM; i++) {
-        if (netdevs[i] && !netdevs[i]->unregistering) {
+        if (netdevs[i] && !netdevs[i]->unregistering &&
+            netdevs[i]->type != NETDEV_TYPE_LOOPBACK) {
             if (!fallback) {
                 fallback = netdevs[i];
             }
@@ -455,6 +510,127 @@ bool netdev_get_ipv4_info(netdev_t *dev, netdev_ipv4_info_t *info) {
     return info->present;
 }
 
+int netdev_set_offloads(netdev_t *dev, uint32_t offloads,
+                        uint32_t gro_max_len) {
+    if (!dev) {
+        return -EINVAL;
+    }
+
+    spin_lock(&dev->lock);
+    if (dev->unregistering) {
+        spin_unlock(&dev->lock);
+        return -ENODEV;
+    }
+    dev->offloads = offloads;
+    dev->gro_max_len = (offloads & NETDEV_OFFLOAD_GRO) ? gro_max_len : 0;
+    spin_unlock(&dev->lock);
+
+    netdev_notify(dev, NETDEV_EVENT_CONFIG_CHANGED);
+    return 0;
+}
+
+uint32_t netdev_get_offloads(netdev_t *dev) {
+    return dev ? __atomic_load_n(&dev->offloads, __ATOMIC_ACQUIRE) : 0;
+}
+
+/* Largest frame recv() can hand back: the MTU-sized frame, or a coalesced
+ * super-frame for devices doing GRO. */
+uint32_t netdev_rx_buffer_len(netdev_t *dev) {
+    uint32_t len;
+    uint32_t gro_len;
+
+    if (!dev) {
+        return 0;
+    }
+
+    len = netdev_max_frame_len(dev->mtu);
+    gro_len = __atomic_load_n(&dev->gro_max_len, __ATOMIC_ACQUIRE);
+    return gro_len > len ? gro_len : len;
+}
+
+int netdev_set_zc_ops(netdev_t *dev, const netdev_zc_ops_t *ops) {
+    if (!dev) {
+        return -EINVAL;
+    }
+
+    spin_lock(&dev->lock);
+    if (dev->unregistering) {
+        spin_unlock(&dev->lock);
+        return -ENODEV;
+    }
+    __atomic_store_n(&dev->zc_ops, ops, __ATOMIC_RELEASE);
+    spin_unlock(&dev->lock);
+    return 0;
+}
+
+bool netdev_has_zc_rx(netdev_t *dev) {
+    const netdev_zc_ops_t *ops;
+
+    if (!dev) {
+        return false;
+    }
+    ops = __atomic_load_n(&dev->zc_ops, __ATOMIC_ACQUIRE);
+    return ops && ops->rx_take;
+}
+
+int netdev_set_update_stats(netdev_t *dev,
+                            netdev_update_stats_t update_stats) {
+    if (!dev) {
+        return -EINVAL;
+    }
+
+    spin_lock(&dev->lock);
+    if (dev->unregistering) {
+        spin_unlock(&dev->lock);
+        return -ENODEV;
+    }
+    dev->update_stats = update_stats;
+    spin_unlock(&dev->lock);
+    return 0;
+}
+
+int netdev_set_rx_irq(netdev_t *dev, bool rx_irq) {
+    if (!dev) {
+        return -EINVAL;
+    }
+
+    spin_lock(&dev->lock);
+    if (dev->unregistering) {
+        spin_unlock(&dev->lock);
+        return -ENODEV;
+    }
+    dev->rx_irq = rx_irq;
+    spin_unlock(&dev->lock);
+
+    // Wake waiters already sleeping on the old timeout
+    netdev_notify_rx(dev);
+    return 0;
+}
+
+/* Caller holds a reference. */
+void netdev_get_stats(netdev_t *dev, netdev_stats_t *stats) {
+    netdev_update_stats_t update_stats;
+    const uint64_t *src;
+    uint64_t *dst;
+
+    if (!dev || !stats) {
+        return;
+    }
+
+    spin_lock(&dev->lock);
+    update_stats = dev->update_stats;
+    spin_unlock(&dev->lock);
+    if (update_stats) {
+        update_stats(dev->desc);
+    }
+
+    src = (const uint64_t *)&dev->stats;
+    dst = (uint64_t *)stats;
+    for (size_t i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
 int netdev_trigger_scan(netdev_t *dev, const netdev_scan_params_t *params,
                         uint32_t request_portid) {
     netdev_trigger_scan_t trigger_scan;
@@ -805,10 +981,28 @@ int netdev_unregister(netdev_t *dev) {
     return 0;
 }
 
+static int netdev_register_global_listener(netdev_event_cb_t cb, void *ctx) {
+    spin_lock(&netdev_global_listeners_lock);
+    for (uint32_t i = 0; i < NETDEV_MAX_EVENT_LISTENERS; i++) {
+        if (netdev_global_listeners[i].cb == NULL) {
+            netdev_global_listeners[i].cb = cb;
+            netdev_global_listeners[i].ctx = ctx;
+            spin_unlock(&netdev_global_listeners_lock);
+            return 0;
+        }
+    }
+    spin_unlock(&netdev_global_listeners_lock);
+
+    return -ENOSPC;
+}
+
 int netdev_register_listener(netdev_t *dev, netdev_event_cb_t cb, void *ctx) {
-    if (!dev || !cb) {
+    if (!cb) {
         return -EINVAL;
     }
+    if (!dev) {
+        return netdev_register_global_listener(cb, ctx);
+    }
 
     spin_lock(&dev->lock);
     if (dev->unregistering) {
@@ -830,7 +1024,20 @@ int netdev_register_listener(netdev_t *dev, netdev_event_cb_t cb, void *ctx) {
 
 void netdev_unregister_listener(netdev_t *dev, netdev_event_cb_t cb,
                                 void *ctx) {
-    if (!dev || !cb) {
+    if (!cb) {
+        return;
+    }
+    if (!dev) {
+        spin_lock(&netdev_global_listeners_lock);
+        for (uint32_t i = 0; i < NETDEV_MAX_EVENT_LISTENERS; i++) {
+            if (netdev_global_listeners[i].cb == cb &&
+                netdev_global_listeners[i].ctx == ctx) {
+                netdev_global_listeners[i].cb = NULL;
+                netdev_global_listeners[i].ctx = NULL;
+                break;
+            }
+        }
+        spin_unlock(&netdev_global_listeners_lock);
         return;
     }
 
@@ -862,6 +1069,16 @@ void netdev_notify(netdev_t *dev, uint32_t events) {
         }
     }
 
+    spin_lock(&netdev_global_listeners_lock);
+    memcpy(listeners, netdev_global_listeners, sizeof(listeners));
+    spin_unlock(&netdev_global_listeners_lock);
+
+    for (uint32_t i = 0; i < NETDEV_MAX_EVENT_LISTENERS; i++) {
+        if (listeners[i].cb) {
+            listeners[i].cb(dev, events, listeners[i].ctx);
+        }
+    }
+
     netlink_publish_netdev_event(dev, events);
 }
 
@@ -894,6 +1111,7 @@ int netdev_wait_rx(netdev_t *dev, uint64_t observed_seq) {
     void *desc = NULL;
     bool ready = false;
     bool gone = false;
+    bool rx_irq = false;
     int reason;
 
     if (!dev)
@@ -908,6 +1126,7 @@ int netdev_wait_rx(netdev_t *dev, uint64_t observed_seq) {
     gone = dev->unregistering;
     poll_rx = dev->poll_rx;
     desc = dev->desc;
+    rx_irq = dev->rx_irq;
     spin_unlock(&dev->lock);
 
     if (!ready && !gone && poll_rx && poll_rx(desc)) {
@@ -927,8 +1146,8 @@ int netdev_wait_rx(netdev_t *dev, uint64_t observed_seq) {
         return -EINTR;
     }
 
-    reason = task_block(current_task, TASK_BLOCKING, NETDEV_RX_POLL_FALLBACK_NS,
-                        "netdev_rx");
+    reason = task_block(current_task, TASK_BLOCKING,
+                        rx_irq ? -1 : NETDEV_RX_POLL_FALLBACK_NS, "netdev_rx");
 
     wait_queue_remove(&dev->rx_wait, &wait);
     task_cancel_block_prepare(current_task);
@@ -942,6 +1161,23 @@ int netdev_wait_rx(netdev_t *dev, uint64_t observed_seq) {
     return reason == EOK ? EOK : -EINTR;
 }
 
+static void netdev_count_tx(netdev_t *dev, int ret, uint32_t len) {
+    if (ret < 0) {
+        NETDEV_STATS_ADD(dev, tx_dropped, 1);
+        return;
+    }
+    NETDEV_STATS_ADD(dev, tx_packets, 1);
+    NETDEV_STATS_ADD(dev, tx_bytes, len);
+}
+
+static void netdev_count_rx(netdev_t *dev, int ret) {
+    if (ret <= 0) {
+        return;
+    }
+    NETDEV_STATS_ADD(dev, rx_packets, 1);
+    NETDEV_STATS_ADD(dev, rx_bytes, ret);
+}
+
 int netdev_send(netdev_t *dev, void *data, uint32_t len) {
     if (dev == NULL || data == NULL) {
         return -EINVAL;
@@ -955,7 +1191,11 @@ int netdev_send(netdev_t *dev, void *data, uint32_t len) {
         return 0;
     }
 
+    netdev_frag_t frag = {.data = data, .len = len};
+    packet_tap(dev, &frag, 1, len, true);
+
     int ret = dev->send(dev->desc, data, len);
+    netdev_count_tx(dev, ret, len);
     netdev_put(dev);
     return ret;
 }
@@ -975,6 +1215,180 @@ int netdev_recv(netdev_t *dev, void *data, uint32_t len) {
 
     int ret = dev->recv(dev->desc, data, len);
 
+    netdev_count_rx(dev, ret);
+    if (ret > 0) {
+        netdev_frag_t frag = {.data = data, .len = (uint32_t)ret};
+        packet_tap(dev, &frag, 1, (uint32_t)ret, false);
+    }
+    netdev_put(dev);
+    return ret;
+}
+
+uint32_t netdev_frags_copy(const netdev_frag_t *frags, uint32_t nr_frags,
+                           uint32_t skip, void *dst, uint32_t len) {
+    uint8_t *out = dst;
+    uint32_t copied = 0;
+
+    for (uint32_t i = 0; i < nr_frags && copied < len; i++) {
+        uint32_t flen = frags[i].len;
+        uint32_t chunk;
+
+        if (skip >= flen) {
+            skip -= flen;
+            continue;
+        }
+        chunk = MIN(flen - skip, len - copied);
+        memcpy(out + copied, (const uint8_t *)frags[i].data + skip, chunk);
+        copied += chunk;
+        skip = 0;
+    }
+    return copied;
+}
+
+int netdev_dma_split(const netdev_frag_t *frags, uint32_t nr_frags,
+                     uint32_t skip, netdev_frag_t *segs, uint32_t max_segs) {
+    uint32_t nr = 0;
+    uint64_t last_end = 0;
+
+    for (uint32_t i = 0; i < nr_frags; i++) {
+        const uint8_t *p = frags[i].data;
+        uint32_t left = frags[i].len;
+
+        if (skip >= left) {
+            skip -= left;
+            continue;
+        }
+        p += skip;
+        left -= skip;
+        skip = 0;
+
+        while (left) {
+            uint32_t chunk = MIN(left, (uint32_t)(PAGE_SIZE -
+                                                  ((uintptr_t)p &
+                                                   (PAGE_SIZE - 1))));
+            uint64_t phys = virt_to_phys(p);
+
+            // Module memory is only virtually contiguous, so merge page by page
+            if (nr && phys == last_end &&
+                (const uint8_t *)segs[nr - 1].data + segs[nr - 1].len == p) {
+                segs[nr - 1].len += chunk;
+            } else {
+                if (nr == max_segs) {
+                    return -E2BIG;
+                }
+                segs[nr].data = p;
+                segs[nr].len = chunk;
+                nr++;
+            }
+            last_end = phys + chunk;
+            p += chunk;
+            left -= chunk;
+        }
+    }
+    return (int)nr;
+}
+
+int netdev_xmit(netdev_t *dev, const netdev_tx_req_t *req) {
+    const netdev_zc_ops_t *ops;
+    void *flat;
+    int ret;
+
+    if (!dev || !req || !req->frags || req->nr_frags == 0) {
+        return -EINVAL;
+    }
+    if (!netdev_get(dev)) {
+        return -ENODEV;
+    }
+
+    packet_tap(dev, req->frags, req->nr_frags, req->len, true);
+
+    ops = __atomic_load_n(&dev->zc_ops, __ATOMIC_ACQUIRE);
+    if (ops && ops->xmit) {
+        ret = ops->xmit(dev->desc, req);
+        netdev_count_tx(dev, ret, req->len);
+        netdev_put(dev);
+        return ret;
+    }
+
+    if (req->nr_frags == 1) {
+        ret = dev->send(dev->desc, (void *)req->frags[0].data, req->len);
+    } else {
+        flat = malloc(req->len);
+        if (!flat) {
+            netdev_put(dev);
+            return -ENOMEM;
+        }
+        netdev_frags_copy(req->frags, req->nr_frags, 0, flat, req->len);
+        ret = dev->send(dev->desc, flat, req->len);
+        free(flat);
+    }
+    netdev_count_tx(dev, ret, req->len);
     netdev_put(dev);
+
+    if (ret < 0) {
+        return ret;
+    }
+    if (req->done) {
+        req->done(req->ctx);
+    }
     return ret;
 }
+
+void netdev_xmit_flush(netdev_t *dev) {
+    const netdev_zc_ops_t *ops;
+
+    if (!dev || !netdev_get(dev)) {
+        return;
+    }
+    ops = __atomic_load_n(&dev->zc_ops, __ATOMIC_ACQUIRE);
+    if (ops && ops->xmit_flush) {
+        ops->xmit_flush(dev->desc);
+    }
+    netdev_put(dev);
+}
+
+int netdev_rx_take(netdev_t *dev, netdev_rx_buf_t *rx) {
+    const netdev_zc_ops_t *ops;
+    int ret;
+
+    if (!dev || !rx) {
+        return -EINVAL;
+    }
+    if (!netdev_get(dev)) {
+        return -ENODEV;
+    }
+
+    ops = __atomic_load_n(&dev->zc_ops, __ATOMIC_ACQUIRE);
+    if (!ops || !ops->rx_take) {
+        netdev_put(dev);
+        return -EOPNOTSUPP;
+    }
+
+    rx->pool = NULL;
+    rx->nr_frags = 0;
+    rx->len = 0;
+    ret = ops->rx_take(dev->desc, rx);
+    netdev_count_rx(dev, ret);
+    if (ret > 0 && __atomic_load_n(&packet_nr_running, __ATOMIC_RELAXED)) {
+        netdev_frag_t frags[NETDEV_RX_MAX_FRAGS];
+
+        for (uint32_t i = 0; i < rx->nr_frags; i++) {
+            frags[i].data = rx->frags[i].data;
+            frags[i].len = rx->frags[i].len;
+        }
+        packet_tap(dev, frags, rx->nr_frags, rx->len, false);
+    }
+    netdev_put(dev);
+    return ret;
+}
+
+void netdev_rx_buf_release(netdev_rx_buf_t *rx) {
+    if (!rx) {
+        return;
+    }
+    for (uint32_t i = 0; i < rx->nr_frags; i++) {
+        netdev_pool_put(rx->pool, rx->frags[i].buf);
+    }
+    rx->nr_frags = 0;
+    rx->len = 0;
+}
@@ -2,6 +2,7 @@
 
 #include <libs/klibc.h>
 #include <task/wait.h>
+#include <net/netdev_pool.h>
 
 typedef int (*netdev_send_t)(void *dev, void *data, uint32_t len);
 typedef int (*netdev_recv_t)(void *dev, void *data, uint32_t len);
@@ -18,10 +19,15 @@ typedef void (*netdev_event_cb_t)(struct netdev *dev, uint32_t events,
 #define NETDEV_MAX_SCAN_SSIDS 4
 #define NETDEV_MAX_SCAN_RESULTS 64
 #define NETDEV_MAX_SCAN_IE_LEN 768
+/* Frames a receive loop may take back to back before yielding the CPU.
+ * Interrupt-driven drivers keep their interrupt masked across the yield
+ * and only unmask once the ring is empty. */
+#define NETDEV_RX_BUDGET 64
 
 enum netdev_type {
     NETDEV_TYPE_ETHERNET = 0,
     NETDEV_TYPE_WIFI = 1,
+    NETDEV_TYPE_LOOPBACK = 2,
 };
 
 enum netdev_event {
@@ -35,6 +41,99 @@ enum netdev_event {
     NETDEV_EVENT_UNREGISTERED = 1U << 7,
 };
 
+/* Offloads a driver advertises through netdev_set_offloads(). */
+enum netdev_offload {
+    /* send() fills in TCP/UDP checksums left zero by the stack. */
+    NETDEV_OFFLOAD_TX_CSUM = 1U << 0,
+    /* recv() may coalesce in-order TCP segments of one flow into a single
+     * frame of up to gro_max_len bytes when given a buffer that large. */
+    NETDEV_OFFLOAD_GRO = 1U << 1,
+};
+
+/*
+ * Zero-copy interface. Drivers that implement it take transmit frames as
+ * scatter-gather lists and hand received frames up in the pool buffers the
+ * hardware wrote them to; the copying send()/recv() pair stays available for
+ * everyone else.
+ */
+#define NETDEV_MAX_FRAGS 16
+#define NETDEV_RX_MAX_FRAGS 16
+
+/* More frames follow immediately; the driver may delay its doorbell until a
+ * frame without this flag or netdev_xmit_flush(). */
+#define NETDEV_XMIT_MORE (1U << 0)
+
+typedef struct netdev_frag {
+    const void *data;
+    uint32_t len;
+} netdev_frag_t;
+
+typedef void (*netdev_tx_done_t)(void *ctx);
+
+/* The frag array only needs to live for the duration of the xmit call; the
+ * data it points to must stay untouched until done(ctx) runs. A driver that
+ * returns an error never calls done. */
+typedef struct netdev_tx_req {
+    const netdev_frag_t *frags;
+    uint32_t nr_frags;
+    uint32_t len;
+    uint32_t flags;
+    netdev_tx_done_t done;
+    void *ctx;
+} netdev_tx_req_t;
+
+typedef struct netdev_rx_frag {
+    void *buf; /* pool buffer owning data */
+    uint8_t *data;
+    uint32_t len;
+} netdev_rx_frag_t;
+
+/* One received frame, possibly spread over several buffers of the same pool
+ * when the driver coalesced segments. The taker owns every buffer and
+ * returns them with netdev_rx_buf_release() or netdev_pool_put(). */
+typedef struct netdev_rx_buf {
+    netdev_pool_t *pool;
+    uint32_t nr_frags;
+    uint32_t len;
+    netdev_rx_frag_t frags[NETDEV_RX_MAX_FRAGS];
+} netdev_rx_buf_t;
+
+typedef struct netdev_zc_ops {
+    int (*xmit)(void *desc, const netdev_tx_req_t *req);
+    void (*xmit_flush)(void *desc);
+    /* Returns the frame length, 0 when nothing is pending. */
+    int (*rx_take)(void *desc, netdev_rx_buf_t *rx);
+} netdev_zc_ops_t;
+
+/*
+ * Interface counters, exported under /sys/class/net/<name>/statistics. The
+ * core counts every frame that goes through netdev_send(), netdev_xmit(),
+ * netdev_recv() and netdev_rx_take(); drivers add what only the hardware
+ * sees (missed frames, CRC errors, ...) from their update_stats hook, which
+ * runs before the counters are read.
+ */
+typedef struct netdev_stats {
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t multicast;
+    uint64_t collisions;
+    uint64_t rx_crc_errors;
+    uint64_t rx_fifo_errors;
+    uint64_t rx_missed_errors;
+    uint64_t tx_fifo_errors;
+} netdev_stats_t;
+
+typedef void (*netdev_update_stats_t)(void *desc);
+
+#define NETDEV_STATS_ADD(dev, field, n)                                        \
+    __atomic_fetch_add(&(dev)->stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+
 typedef struct netdev_listener {
     netdev_event_cb_t cb;
     void *ctx;
@@ -123,6 +222,8 @@ typedef struct netdev {
     uint32_t id;
     uint32_t type;
     uint32_t refcount;
+    uint32_t offloads;
+    uint32_t gro_max_len;
     bool admin_up;
     bool link_up;
     bool unregistering;
@@ -130,6 +231,8 @@ typedef struct netdev {
     netdev_send_t send;
     netdev_recv_t recv;
     netdev_poll_rx_t poll_rx;
+    const netdev_zc_ops_t *zc_ops;
+    netdev_update_stats_t update_stats;
     netdev_trigger_scan_t trigger_scan;
     netdev_trigger_connect_t trigger_connect;
     netdev_trigger_disconnect_t trigger_disconnect;
@@ -140,6 +243,10 @@ typedef struct netdev {
     netdev_listener_t listeners[NETDEV_MAX_EVENT_LISTENERS];
     wait_queue_head_t rx_wait;
     uint64_t rx_seq;
+    /* The driver raises netdev_notify_rx() from its interrupt handler, so
+     * waiters need no periodic poll. */
+    bool rx_irq;
+    netdev_stats_t stats;
 } netdev_t;
 
 netdev_t *netdev_register_full(const char *name, uint32_t type, void *desc,
@@ -177,6 +284,14 @@ int netdev_scan_begin(netdev_t *dev, uint32_t request_portid);
 int netdev_scan_store_result(netdev_t *dev, const netdev_scan_result_t *result);
 int netdev_scan_complete(netdev_t *dev, bool aborted);
 bool netdev_get_scan_state(netdev_t *dev, netdev_scan_state_t *state);
+int netdev_set_offloads(netdev_t *dev, uint32_t offloads, uint32_t gro_max_len);
+uint32_t netdev_get_offloads(netdev_t *dev);
+uint32_t netdev_rx_buffer_len(netdev_t *dev);
+int netdev_set_zc_ops(netdev_t *dev, const netdev_zc_ops_t *ops);
+bool netdev_has_zc_rx(netdev_t *dev);
+int netdev_set_update_stats(netdev_t *dev, netdev_update_stats_t update_stats);
+int netdev_set_rx_irq(netdev_t *dev, bool rx_irq);
+void netdev_get_stats(netdev_t *dev, netdev_stats_t *stats);
 int netdev_set_link_state(netdev_t *dev, bool link_up);
 int netdev_set_admin_state(netdev_t *dev, bool admin_up);
 int netdev_unregister(netdev_t *dev);
@@ -185,6 +300,7 @@ bool netdev_admin_is_up(const netdev_t *dev);
 bool netdev_get(netdev_t *dev);
 void netdev_put(netdev_t *dev);
 
+/* dev == NULL registers a listener for events from every netdev. */
 int netdev_register_listener(netdev_t *dev, netdev_event_cb_t cb, void *ctx);
 void netdev_unregister_listener(netdev_t *dev, netdev_event_cb_t cb, void *ctx);
 void netdev_notify(netdev_t *dev, uint32_t events);
@@ -194,3 +310,16 @@ int netdev_wait_rx(netdev_t *dev, uint64_t observed_seq);
 
 int netdev_send(netdev_t *dev, void *data, uint32_t len);
 int netdev_recv(netdev_t *dev, void *data, uint32_t len);
+/* Falls back to flattening the frags through send() on drivers without
+ * zero-copy transmit, in which case done runs before this returns. */
+int netdev_xmit(netdev_t *dev, const netdev_tx_req_t *req);
+void netdev_xmit_flush(netdev_t *dev);
+int netdev_rx_take(netdev_t *dev, netdev_rx_buf_t *rx);
+void netdev_rx_buf_release(netdev_rx_buf_t *rx);
+
+/* Splits frags, minus their first skip bytes, into pieces that are each
+ * physically contiguous. Returns the number of pieces or -E2BIG. */
+int netdev_dma_split(const netdev_frag_t *frags, uint32_t nr_frags,
+                     uint32_t skip, netdev_frag_t *segs, uint32_t max_segs);
+uint32_t netdev_frags_copy(const netdev_frag_t *frags, uint32_t nr_frags,
+                           uint32_t skip, void *dst, uint32_t len);
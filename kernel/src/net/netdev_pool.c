@@ -0,0 +1,111 @@
+#include <net/netdev_pool.h>
+#include <mm/mm.h>
+
+netdev_pool_t *netdev_pool_create(uint32_t buf_size, uint32_t max_cached) {
+    netdev_pool_t *pool = NULL;
+
+    if (buf_size <= NETDEV_POOL_HEADROOM) {
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->lock = SPIN_INIT;
+    pool->buf_size = PADDING_UP(buf_size, PAGE_SIZE);
+    pool->max_cached = max_cached;
+    return pool;
+}
+
+static void netdev_pool_free_cache(netdev_pool_entry_t *entry,
+                                   uint32_t buf_size) {
+    while (entry) {
+        netdev_pool_entry_t *next = entry->next;
+        free_frames_bytes(entry, buf_size);
+        entry = next;
+    }
+}
+
+void netdev_pool_destroy(netdev_pool_t *pool) {
+    netdev_pool_entry_t *cache = NULL;
+    bool release = false;
+
+    if (!pool) {
+        return;
+    }
+
+    spin_lock(&pool->lock);
+    pool->dying = true;
+    cache = pool->cache;
+    pool->cache = NULL;
+    pool->nr_cached = 0;
+    release = pool->nr_out == 0;
+    spin_unlock(&pool->lock);
+
+    netdev_pool_free_cache(cache, pool->buf_size);
+    if (release) {
+        free(pool);
+    }
+}
+
+void *netdev_pool_get(netdev_pool_t *pool) {
+    netdev_pool_entry_t *entry = NULL;
+
+    if (!pool) {
+        return NULL;
+    }
+
+    spin_lock(&pool->lock);
+    if (pool->dying) {
+        spin_unlock(&pool->lock);
+        return NULL;
+    }
+    entry = pool->cache;
+    if (entry) {
+        pool->cache = entry->next;
+        pool->nr_cached--;
+    }
+    pool->nr_out++;
+    spin_unlock(&pool->lock);
+
+    if (entry) {
+        return entry;
+    }
+
+    entry = alloc_frames_bytes(pool->buf_size);
+    if (!entry) {
+        netdev_pool_put(pool, NULL);
+    }
+    return entry;
+}
+
+void netdev_pool_put(netdev_pool_t *pool, void *buf) {
+    netdev_pool_entry_t *entry = (netdev_pool_entry_t *)buf;
+    bool release = false;
+
+    if (!pool) {
+        return;
+    }
+
+    spin_lock(&pool->lock);
+    if (entry && !pool->dying && pool->nr_cached < pool->max_cached) {
+        entry->next = pool->cache;
+        pool->cache = entry;
+        pool->nr_cached++;
+        entry = NULL;
+    }
+    if (pool->nr_out > 0) {
+        pool->nr_out--;
+    }
+    release = pool->dying && pool->nr_out == 0;
+    spin_unlock(&pool->lock);
+
+    if (entry) {
+        free_frames_bytes(entry, pool->buf_size);
+    }
+    if (release) {
+        free(pool);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+/*
+ * Fixed-size DMA buffers that drivers post to their receive rings and hand up
+ * to the stack without copying. Whoever holds a buffer returns it with
+ * netdev_pool_put(); the pool keeps a bounded cache of free buffers so steady
+ * traffic does not go back to the page allocator.
+ *
+ * The first NETDEV_POOL_HEADROOM bytes of every buffer are never given to
+ * the hardware and belong to the current holder, e.g. for a pbuf wrapper.
+ */
+#define NETDEV_POOL_HEADROOM 64
+
+typedef struct netdev_pool_entry {
+    struct netdev_pool_entry *next;
+} netdev_pool_entry_t;
+
+typedef struct netdev_pool {
+    spinlock_t lock;
+    uint32_t buf_size;
+    uint32_t max_cached;
+    uint32_t nr_cached;
+    uint32_t nr_out;
+    bool dying;
+    netdev_pool_entry_t *cache;
+} netdev_pool_t;
+
+netdev_pool_t *netdev_pool_create(uint32_t buf_size, uint32_t max_cached);
+/* Frees the cached buffers now and the pool itself once every outstanding
+ * buffer has been put back. */
+void netdev_pool_destroy(netdev_pool_t *pool);
+void *netdev_pool_get(netdev_pool_t *pool);
+void netdev_pool_put(netdev_pool_t *pool, void *buf);
+
+static inline void *netdev_pool_data(void *buf) {
+    return (uint8_t *)buf + NETDEV_POOL_HEADROOM;
+}
+
+static inline uint32_t netdev_pool_data_size(const netdev_pool_t *pool) {
+    return pool->buf_size - NETDEV_POOL_HEADROOM;
+}
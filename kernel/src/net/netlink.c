@@ -1,5 +1,6 @@
 #include <net/netlink.h>
 #include <task/task.h>
+#include <task/taskstats.h>
 #include <mm/mm.h>
 #include <arch/arch.h>
 #include <libs/klibc.h>
@@ -44,13 +45,6 @@ static struct netlink_msg_pool_entry
 static uint32_t netlink_msg_pool_next = 0;
 static spinlock_t netlink_msg_pool_lock = SPIN_INIT;
 
-static void netlink_filter_free(struct sock_fprog *filter) {
-    if (!filter)
-        return;
-    free(filter->filter);
-    free(filter);
-}
-
 static void netlink_handle_release(socket_handle_t *handle);
 static ssize_t netlink_read_op(fd_t *fd, void *buf, size_t offset,
                                size_t count);
@@ -224,6 +218,8 @@ static uint32_t rtnetlink_dev_flags(const netdev_t *dev) {
 
     if (!dev)
         return flags;
+    if (dev->type == NETDEV_TYPE_LOOPBACK)
+        flags = IFF_LOOPBACK;
     if (dev->admin_up)
         flags |= IFF_UP;
     if (dev->link_up)
@@ -264,7 +260,8 @@ static int rtnetlink_append_link_msg(char *buf, size_t *offset, size_t capacity,
     nlh = (struct nlmsghdr *)(buf + start);
     ifi = (struct ifinfomsg *)NLMSG_DATA(nlh);
     memset(ifi, 0, sizeof(*ifi));
-    ifi->ifi_type = ARPHRD_ETHER;
+    ifi->ifi_type =
+        dev->type == NETDEV_TYPE_LOOPBACK ? ARPHRD_LOOPBACK : ARPHRD_ETHER;
     ifi->ifi_index = (int32_t)(dev->id + 1);
     ifi->ifi_flags = rtnetlink_dev_flags(dev);
     ifi->ifi_change = 0xFFFFFFFFU;
@@ -838,6 +835,13 @@ static const struct naos_genl_family_desc naos_genl_nl80211_family = {
     .maxattr = NL80211_ATTR_BSSID,
 };
 
+static const struct naos_genl_family_desc naos_genl_taskstats_family = {
+    .id = NAOS_GENL_ID_TASKSTATS,
+    .name = TASKSTATS_GENL_NAME,
+    .version = TASKSTATS_GENL_VERSION,
+    .maxattr = TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK,
+};
+
 static const struct rtattr *netlink_find_attr(const void *data, size_t len,
                                               uint16_t type) {
     const struct rtattr *rta = (const struct rtattr *)data;
@@ -941,6 +945,8 @@ static const struct naos_genl_family_desc *naos_genl_family_by_id(uint16_t id) {
         return &naos_genl_ctrl_family;
     if (id == naos_genl_nl80211_family.id)
         return &naos_genl_nl80211_family;
+    if (id == naos_genl_taskstats_family.id)
+        return &naos_genl_taskstats_family;
     return NULL;
 }
 
@@ -952,6 +958,8 @@ naos_genl_family_by_name(const char *name) {
         return &naos_genl_ctrl_family;
     if (strcmp(name, naos_genl_nl80211_family.name) == 0)
         return &naos_genl_nl80211_family;
+    if (strcmp(name, naos_genl_taskstats_family.name) == 0)
+        return &naos_genl_taskstats_family;
     return NULL;
 }
 
@@ -2169,6 +2177,92 @@ static int genl_handle_nl80211_disconnect(struct netlink_sock *sender_sock,
     return 0;
 }
 
+/*
+ * TASKSTATS_CMD_GET for one pid or tgid, answered like Linux with a
+ * TASKSTATS_CMD_NEW holding {PID|TGID, STATS} nested in AGGR_PID or
+ * AGGR_TGID. Per-cpu exit notifications are not implemented.
+ */
+static int genl_handle_taskstats_get(struct netlink_sock *sender_sock,
+                                     const struct nlmsghdr *req,
+                                     const void *attrs, size_t attr_len) {
+    const struct rtattr *pid_attr;
+    const struct rtattr *tgid_attr;
+    struct taskstats stats;
+    char reply[NETLINK_BUFFER_SIZE];
+    size_t offset = 0;
+    size_t nested_start;
+    struct nlmsghdr *nlh;
+    struct genlmsghdr *genlh;
+    uint32_t id;
+    bool tgid;
+    size_t cur;
+    int ret;
+
+    if (!sender_sock || !req)
+        return -EINVAL;
+
+    if (netlink_find_attr(attrs, attr_len,
+                          TASKSTATS_CMD_ATTR_REGISTER_CPUMASK) ||
+        netlink_find_attr(attrs, attr_len,
+                          TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK))
+        return -EOPNOTSUPP;
+
+    pid_attr = netlink_find_attr(attrs, attr_len, TASKSTATS_CMD_ATTR_PID);
+    tgid_attr = netlink_find_attr(attrs, attr_len, TASKSTATS_CMD_ATTR_TGID);
+    if (pid_attr && pid_attr->rta_len >= RTA_LENGTH(sizeof(uint32_t))) {
+        id = *(const uint32_t *)RTA_DATA(pid_attr);
+        tgid = false;
+    } else if (tgid_attr &&
+               tgid_attr->rta_len >= RTA_LENGTH(sizeof(uint32_t))) {
+        id = *(const uint32_t *)RTA_DATA(tgid_attr);
+        tgid = true;
+    } else {
+        return -EINVAL;
+    }
+
+    ret = taskstats_fill(id, tgid, &stats);
+    if (ret < 0)
+        return ret;
+
+    memset(reply, 0, sizeof(reply));
+    ret = netlink_append_raw_message(reply, &offset, sizeof(reply),
+                                     NAOS_GENL_ID_TASKSTATS, 0, req->nlmsg_seq,
+                                     NULL, sizeof(struct genlmsghdr));
+    if (ret < 0)
+        return ret;
+
+    nlh = (struct nlmsghdr *)reply;
+    genlh = (struct genlmsghdr *)NLMSG_DATA(nlh);
+    memset(genlh, 0, sizeof(*genlh));
+    genlh->cmd = TASKSTATS_CMD_NEW;
+    genlh->version = TASKSTATS_GENL_VERSION;
+
+    cur = NLMSG_ALIGN(nlh->nlmsg_len);
+    ret = netlink_start_nested_attr(reply, &cur, sizeof(reply),
+                                    tgid ? TASKSTATS_TYPE_AGGR_TGID
+                                         : TASKSTATS_TYPE_AGGR_PID,
+                                    &nested_start);
+    if (ret < 0)
+        return ret;
+    ret = netlink_append_attr(reply, &cur, sizeof(reply),
+                              tgid ? TASKSTATS_TYPE_TGID : TASKSTATS_TYPE_PID,
+                              &id, sizeof(id));
+    if (ret < 0)
+        return ret;
+    ret = netlink_append_attr(reply, &cur, sizeof(reply), TASKSTATS_TYPE_STATS,
+                              &stats, sizeof(stats));
+    if (ret < 0)
+        return ret;
+    netlink_end_nested_attr(reply, cur, nested_start);
+
+    nlh->nlmsg_len = (uint32_t)cur;
+
+    if (!netlink_deliver_to_socket(sender_sock, reply, cur, 0, 0))
+        return -ENOBUFS;
+
+    return 0;
+}
+
 static int genl_handle_request(struct netlink_sock *sender_sock,
                                const struct nlmsghdr *req) {
     const struct genlmsghdr *genlh;
@@ -2246,6 +2340,15 @@ static int genl_handle_request(struct netlink_sock *sender_sock,
         }
     }
 
+    if (req->nlmsg_type == NAOS_GENL_ID_TASKSTATS) {
+        if (genlh->cmd == TASKSTATS_CMD_GET)
+            return genl_handle_taskstats_get(sender_sock, req, attrs,
+                                             attr_len);
+        printk("Unsupported NAOS_GENL_ID_TASKSTATS genlh->cmd = %d\n",
+               genlh->cmd);
+        return -EOPNOTSUPP;
+    }
+
     return -ENOENT;
 }
 
@@ -2691,8 +2794,8 @@ size_t netlink_buffer_write_packet(struct netlink_sock *sock, const char *data,
 
     spin_lock(&sock->lock);
     if (sock->filter) {
-        uint32_t accept_bytes = bpf_run(sock->filter->filter, sock->filter->len,
-                                        (const uint8_t *)data, (uint32_t)len);
+        uint32_t accept_bytes = bpf_prog_run(
+            sock->filter, (const uint8_t *)data, (uint32_t)len);
         if (!accept_bytes) {
             spin_unlock(&sock->lock);
             return 0;
@@ -2733,9 +2836,8 @@ static size_t netlink_defer_to_socket(struct netlink_sock *target,
 
     spin_lock(&target->lock);
     if (target->filter) {
-        uint32_t accept_bytes =
-            bpf_run(target->filter->filter, target->filter->len,
-                    (const uint8_t *)data, (uint32_t)len);
+        uint32_t accept_bytes = bpf_prog_run(
+            target->filter, (const uint8_t *)data, (uint32_t)len);
         if (!accept_bytes) {
             spin_unlock(&target->lock);
             return 0;
@@ -3147,58 +3249,29 @@ size_t netlink_setsockopt(uint64_t fd, int level, int optname,
     if (level == SOL_SOCKET) {
         switch (optname) {
         case SO_ATTACH_FILTER: {
-            struct sock_fprog fprog;
-            struct sock_fprog *new_filter = NULL;
-            struct sock_fprog *old_filter = NULL;
-            size_t filter_bytes;
-
-            if (!optval || optlen < sizeof(fprog))
-                NETLINK_SETSOCKOPT_RETURN((size_t)-EINVAL);
-            memcpy(&fprog, optval, sizeof(fprog));
-            if (!fprog.len || !fprog.filter)
-                NETLINK_SETSOCKOPT_RETURN((size_t)-EINVAL);
-            if (check_user_array_overflow((uint64_t)fprog.filter, fprog.len,
-                                          sizeof(struct sock_filter),
-                                          &filter_bytes)) {
-                NETLINK_SETSOCKOPT_RETURN((size_t)-EFAULT);
-            }
+            bpf_prog_t *new_filter = NULL;
+            bpf_prog_t *old_filter = NULL;
+            int err = bpf_prog_attach_user(optval, optlen, &new_filter);
 
-            new_filter = calloc(1, sizeof(*new_filter));
-            if (!new_filter)
-                NETLINK_SETSOCKOPT_RETURN((size_t)-ENOMEM);
-            new_filter->filter = malloc(filter_bytes);
-            if (!new_filter->filter) {
-                netlink_filter_free(new_filter);
-                NETLINK_SETSOCKOPT_RETURN((size_t)-ENOMEM);
-            }
-            new_filter->len = fprog.len;
-
-            if (copy_from_user(new_filter->filter, fprog.filter,
-                               filter_bytes)) {
-                netlink_filter_free(new_filter);
-                NETLINK_SETSOCKOPT_RETURN((size_t)-EFAULT);
-            }
-            if (bpf_validate(new_filter->filter, new_filter->len) < 0) {
-                netlink_filter_free(new_filter);
-                NETLINK_SETSOCKOPT_RETURN((size_t)-EINVAL);
-            }
+            if (err < 0)
+                NETLINK_SETSOCKOPT_RETURN((size_t)err);
 
             spin_lock(&nl_sk->lock);
             old_filter = nl_sk->filter;
             nl_sk->filter = new_filter;
             spin_unlock(&nl_sk->lock);
-            netlink_filter_free(old_filter);
+            bpf_prog_free(old_filter);
             break;
         }
         case SO_DETACH_FILTER: {
-            struct sock_fprog *old_filter = NULL;
+            bpf_prog_t *old_filter = NULL;
             spin_lock(&nl_sk->lock);
             if (nl_sk->filter) {
                 old_filter = nl_sk->filter;
                 nl_sk->filter = NULL;
             }
             spin_unlock(&nl_sk->lock);
-            netlink_filter_free(old_filter);
+            bpf_prog_free(old_filter);
             break;
         }
         case SO_REUSEADDR:
@@ -3858,7 +3931,7 @@ static void netlink_handle_release(socket_handle_t *handle) {
             free(nl_sk->bind_addr);
         }
         task_simple_namespace_put(nl_sk->net_ns);
-        netlink_filter_free(nl_sk->filter);
+        bpf_prog_free(nl_sk->filter);
         skb_queue_purge(&nl_sk->deferred_queue);
         free(nl_sk);
     }
@@ -234,6 +234,28 @@ struct fib_rule_hdr {
 #define CTRL_ATTR_MCAST_GRP_NAME 1
 #define CTRL_ATTR_MCAST_GRP_ID 2
 
+#define NAOS_GENL_ID_TASKSTATS (GENL_START_ALLOC + 1)
+#define TASKSTATS_GENL_NAME "TASKSTATS"
+#define TASKSTATS_GENL_VERSION 1
+
+#define TASKSTATS_CMD_UNSPEC 0
+#define TASKSTATS_CMD_GET 1
+#define TASKSTATS_CMD_NEW 2
+
+#define TASKSTATS_CMD_ATTR_UNSPEC 0
+#define TASKSTATS_CMD_ATTR_PID 1
+#define TASKSTATS_CMD_ATTR_TGID 2
+#define TASKSTATS_CMD_ATTR_REGISTER_CPUMASK 3
+#define TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK 4
+
+#define TASKSTATS_TYPE_UNSPEC 0
+#define TASKSTATS_TYPE_PID 1
+#define TASKSTATS_TYPE_TGID 2
+#define TASKSTATS_TYPE_STATS 3
+#define TASKSTATS_TYPE_AGGR_PID 4
+#define TASKSTATS_TYPE_AGGR_TGID 5
+#define TASKSTATS_TYPE_NULL 6
+
 #define NAOS_GENL_ID_NL80211 GENL_START_ALLOC
 #define NL80211_GENL_NAME "nl80211"
 #define NL80211_GENL_VERSION 1
@@ -355,9 +377,11 @@ struct fib_rule_hdr {
 #define WLAN_CIPHER_SUITE_WEP104 0x000FAC05
 
 #define ARPHRD_ETHER 1
+#define ARPHRD_LOOPBACK 772
 
 #define IFF_UP 0x1
 #define IFF_BROADCAST 0x2
+#define IFF_LOOPBACK 0x8
 #define IFF_RUNNING 0x40
 #define IFF_MULTICAST 0x1000
 #define IFF_LOWER_UP 0x10000
@@ -400,7 +424,7 @@ struct netlink_sock {
     vfs_node_t *node;
     struct sockaddr_nl *bind_addr;
     struct netlink_buffer *buffer; // skb-backed receive queue
-    struct sock_fprog *filter;
+    struct bpf_prog *filter;
     skb_queue_t deferred_queue;
     spinlock_t lock;
 };
@@ -0,0 +1,1828 @@
+#include <net/packet.h>
+#include <net/socket.h>
+#include <net/real_socket.h>
+#include <bpf/socket_filter.h>
+#include <boot/boot.h>
+#include <task/task.h>
+#include <task/workqueue.h>
+#include <mm/mm.h>
+#include <mm/page.h>
+#include <arch/arch.h>
+
+/*
+ * AF_PACKET sockets. Every frame that crosses netdev_send(), netdev_xmit(),
+ * netdev_recv() or netdev_rx_take() is offered to the open sockets through
+ * packet_tap(); a socket either queues a copy for recvmsg() or, once it has a
+ * PACKET_RX_RING, writes it straight into a TPACKET_V3 block ring that the
+ * process has mmap()ed. Transmit rings work the other way round: the process
+ * fills frames, marks them TP_STATUS_SEND_REQUEST and kicks send().
+ */
+
+#define MAX_PACKET_SOCKETS 128
+#define MAX_PACKET_FANOUTS 16
+#define PACKET_FANOUT_MAX 64
+
+#define PACKET_RCVBUF_DEFAULT (256 * 1024)
+#define PACKET_RCVBUF_MIN 2048
+#define PACKET_RCVBUF_MAX (16 * 1024 * 1024)
+#define PACKET_RING_MAX_BYTES (256ULL * 1024 * 1024)
+#define PACKET_RETIRE_TOV_DEFAULT_MS 8
+
+#define ARPHRD_ETHER 1
+#define ARPHRD_LOOPBACK 772
+
+#define PACKET_BLK_HDR_LEN                                                     \
+    PADDING_UP(sizeof(struct tpacket_block_desc), 8)
+#define PACKET_TX_DATA_OFF TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+typedef struct packet_ring {
+    uint64_t *blocks; /* physical address of each block */
+    uint32_t block_size;
+    uint32_t block_nr;
+    uint32_t frame_size;
+    uint32_t frame_nr;
+    uint32_t frames_per_block;
+    uint32_t first_pkt_off;
+    uint64_t retire_tov_ns;
+
+    /* Receive side: the block being filled, if any. */
+    uint32_t cur_block;
+    bool cur_open;
+    uint32_t cur_offset;
+    uint32_t cur_pkts;
+    uint32_t last_pkt_off;
+    uint64_t cur_opened_ns;
+    uint64_t next_seq;
+    bool wake; /* a block was retired since the last wakeup */
+
+    /* Transmit side: next frame to look at. */
+    uint32_t head;
+} packet_ring_t;
+
+struct packet_fanout;
+
+typedef struct packet_sock {
+    int type;
+    uint16_t protocol; /* host order, 0 until bound to one */
+    int ifindex;
+    spinlock_t lock;
+    vfs_node_t *node;
+    bpf_prog_t *filter;
+    skb_queue_t queue;
+    uint32_t rcvbuf;
+    int version;
+    uint32_t reserve;
+    bool auxdata;
+    bool ignore_outgoing;
+    bool running;
+    uint32_t mapping; /* packet_mmap() calls still mapping the rings */
+    uint32_t taps;    /* __packet_tap() deliveries in flight */
+    bool dying;
+    int err;
+    packet_ring_t rx_ring;
+    packet_ring_t tx_ring;
+    delayed_work_t retire_work;
+    struct packet_fanout *fanout;
+    uint32_t stat_packets;
+    uint32_t stat_drops;
+    uint32_t stat_freeze;
+} packet_sock_t;
+
+typedef struct packet_fanout {
+    uint16_t id;
+    uint16_t mode;
+    uint16_t flags;
+    uint16_t protocol;
+    int ifindex;
+    uint32_t nr;
+    uint32_t next;
+    uint32_t rnd;
+    packet_sock_t *members[PACKET_FANOUT_MAX];
+} packet_fanout_t;
+
+typedef struct packet_skb_meta {
+    struct sockaddr_ll addr;
+    uint32_t len;
+    uint16_t net;
+    uint64_t ts_ns;
+} packet_skb_meta_t;
+
+static packet_sock_t *packet_sockets[MAX_PACKET_SOCKETS];
+static packet_fanout_t *packet_fanouts[MAX_PACKET_FANOUTS];
+static spinlock_t packet_sockets_lock = SPIN_INIT;
+
+/* Sockets bound to a protocol; the taps skip all work while this is zero. */
+uint32_t packet_nr_running = 0;
+
+static void packet_skb_meta_destroy(void *priv) { free(priv); }
+
+static fd_t *packet_file_from_fd(uint64_t fd, packet_sock_t **sock_out) {
+    fd_t *file = task_get_file(current_task, (int)fd);
+    if (!file || !file->node) {
+        vfs_file_put(file);
+        return NULL;
+    }
+
+    socket_handle_t *handle = sockfs_file_handle(file);
+    if (handle == NULL || handle->sock == NULL) {
+        vfs_file_put(file);
+        return NULL;
+    }
+
+    if (sock_out)
+        *sock_out = handle->sock;
+    return file;
+}
+
+static inline uint64_t packet_realtime_ns(void) {
+    return boot_get_boottime() * 1000000000ULL + nano_time();
+}
+
+static inline void packet_notify_sock(packet_sock_t *sk, uint32_t events) {
+    if (!sk || !sk->node || !events)
+        return;
+
+    vfs_poll_notify_inode(sk->node, events);
+}
+
+static uint16_t packet_hatype(const netdev_t *dev) {
+    return dev && dev->type == NETDEV_TYPE_LOOPBACK ? ARPHRD_LOOPBACK
+                                                    : ARPHRD_ETHER;
+}
+
+static void packet_set_running_locked(packet_sock_t *sk, bool running) {
+    if (sk->running == running)
+        return;
+    sk->running = running;
+    if (running)
+        __atomic_add_fetch(&packet_nr_running, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_sub_fetch(&packet_nr_running, 1, __ATOMIC_RELAXED);
+}
+
+/* Ring memory */
+
+static inline uint8_t *packet_ring_block(const packet_ring_t *ring,
+                                         uint32_t idx) {
+    return (uint8_t *)phys_to_virt(ring->blocks[idx]);
+}
+
+static inline struct tpacket_block_desc *
+packet_ring_desc(const packet_ring_t *ring, uint32_t idx) {
+    return (struct tpacket_block_desc *)packet_ring_block(ring, idx);
+}
+
+static inline uint8_t *packet_ring_frame(const packet_ring_t *ring,
+                                         uint32_t idx) {
+    return packet_ring_block(ring, idx / ring->frames_per_block) +
+           (idx % ring->frames_per_block) * ring->frame_size;
+}
+
+static inline uint64_t packet_ring_bytes(const packet_ring_t *ring) {
+    return (uint64_t)ring->block_size * ring->block_nr;
+}
+
+static void packet_ring_free(packet_ring_t *ring) {
+    if (ring->blocks) {
+        for (uint32_t i = 0; i < ring->block_nr; i++) {
+            if (ring->blocks[i])
+                free_frames(ring->blocks[i], ring->block_size / PAGE_SIZE);
+        }
+        free(ring->blocks);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* A page the ring alone owns has one reference; each mapping adds one. */
+static bool packet_ring_mapped(const packet_ring_t *ring) {
+    for (uint32_t i = 0; ring->blocks && i < ring->block_nr; i++) {
+        for (uint32_t off = 0; off < ring->block_size; off += PAGE_SIZE) {
+            page_t *page = phys_to_page(ring->blocks[i] + off);
+
+            if (page && page_refcount_read(page) > 1)
+                return true;
+        }
+    }
+    return false;
+}
+
+static int packet_ring_alloc(packet_ring_t *ring,
+                             const struct tpacket_req3 *req, bool rx) {
+    uint32_t frames_per_block;
+
+    if (!req->tp_block_size || req->tp_block_size % PAGE_SIZE)
+        return -EINVAL;
+    if (req->tp_frame_size < TPACKET3_HDRLEN ||
+        req->tp_frame_size % TPACKET_ALIGNMENT)
+        return -EINVAL;
+    frames_per_block = req->tp_block_size / req->tp_frame_size;
+    if (!frames_per_block ||
+        (uint64_t)frames_per_block * req->tp_block_nr != req->tp_frame_nr)
+        return -EINVAL;
+    if ((uint64_t)req->tp_block_size * req->tp_block_nr >
+        PACKET_RING_MAX_BYTES)
+        return -ENOMEM;
+    if (rx && PACKET_BLK_HDR_LEN + PADDING_UP(req->tp_sizeof_priv, 8) +
+                      TPACKET3_HDRLEN >=
+                  req->tp_block_size)
+        return -EINVAL;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->blocks = calloc(req->tp_block_nr, sizeof(uint64_t));
+    if (!ring->blocks)
+        return -ENOMEM;
+    ring->block_size = req->tp_block_size;
+    ring->block_nr = req->tp_block_nr;
+    ring->frame_size = req->tp_frame_size;
+    ring->frame_nr = req->tp_frame_nr;
+    ring->frames_per_block = frames_per_block;
+
+    for (uint32_t i = 0; i < ring->block_nr; i++) {
+        ring->blocks[i] = alloc_frames(ring->block_size / PAGE_SIZE);
+        if (!ring->blocks[i]) {
+            packet_ring_free(ring);
+            return -ENOMEM;
+        }
+        memset(packet_ring_block(ring, i), 0, ring->block_size);
+    }
+
+    if (rx) {
+        uint32_t tov_ms = req->tp_retire_blk_tov
+                              ? req->tp_retire_blk_tov
+                              : PACKET_RETIRE_TOV_DEFAULT_MS;
+
+        ring->first_pkt_off =
+            PACKET_BLK_HDR_LEN + PADDING_UP(req->tp_sizeof_priv, 8);
+        ring->retire_tov_ns = (uint64_t)tov_ms * 1000000ULL;
+        ring->next_seq = 1;
+        for (uint32_t i = 0; i < ring->block_nr; i++) {
+            struct tpacket_block_desc *desc = packet_ring_desc(ring, i);
+            desc->version = TPACKET_V3;
+            desc->offset_to_priv = PACKET_BLK_HDR_LEN;
+            desc->hdr.offset_to_first_pkt = ring->first_pkt_off;
+        }
+    }
+    return 0;
+}
+
+/* Receive ring (TPACKET_V3) */
+
+static inline uint32_t packet_block_status(const packet_ring_t *ring,
+                                           uint32_t idx) {
+    return __atomic_load_n(&packet_ring_desc(ring, idx)->hdr.block_status,
+                           __ATOMIC_ACQUIRE);
+}
+
+/* Hands the block being filled to user space. */
+static void packet_rx_ring_retire_locked(packet_sock_t *sk, bool timeout) {
+    packet_ring_t *ring = &sk->rx_ring;
+    struct tpacket_block_desc *desc;
+
+    if (!ring->cur_open)
+        return;
+
+    desc = packet_ring_desc(ring, ring->cur_block);
+    if (ring->cur_pkts) {
+        struct tpacket3_hdr *last =
+            (struct tpacket3_hdr *)((uint8_t *)desc + ring->last_pkt_off);
+        last->tp_next_offset = 0;
+    }
+    desc->hdr.num_pkts = ring->cur_pkts;
+    desc->hdr.blk_len = ring->cur_offset;
+    __atomic_store_n(&desc->hdr.block_status,
+                     TP_STATUS_USER | (timeout ? TP_STATUS_BLK_TMO : 0),
+                     __ATOMIC_RELEASE);
+
+    ring->cur_open = false;
+    ring->cur_block = (ring->cur_block + 1) % ring->block_nr;
+    ring->wake = true;
+}
+
+static bool packet_rx_ring_open_locked(packet_sock_t *sk) {
+    packet_ring_t *ring = &sk->rx_ring;
+    struct tpacket_block_desc *desc;
+
+    if (packet_block_status(ring, ring->cur_block) != TP_STATUS_KERNEL)
+        return false;
+
+    desc = packet_ring_desc(ring, ring->cur_block);
+    desc->version = TPACKET_V3;
+    desc->offset_to_priv = PACKET_BLK_HDR_LEN;
+    desc->hdr.num_pkts = 0;
+    desc->hdr.offset_to_first_pkt = ring->first_pkt_off;
+    desc->hdr.blk_len = 0;
+    desc->hdr.seq_num = ring->next_seq++;
+
+    ring->cur_open = true;
+    ring->cur_offset = ring->first_pkt_off;
+    ring->cur_pkts = 0;
+    ring->last_pkt_off = 0;
+    ring->cur_opened_ns = nano_time();
+    if (ring->retire_tov_ns && !sk->dying)
+        schedule_delayed_work(&sk->retire_work, ring->retire_tov_ns);
+    return true;
+}
+
+static void packet_rx_ring_offsets(const packet_sock_t *sk, uint32_t *macoff,
+                                   uint32_t *netoff) {
+    if (sk->type == SOCK_DGRAM) {
+        *macoff = *netoff = TPACKET_ALIGN(TPACKET3_HDRLEN) + 16 + sk->reserve;
+    } else {
+        *netoff = TPACKET_ALIGN(TPACKET3_HDRLEN + 16) + sk->reserve;
+        *macoff = *netoff - PACKET_ETH_HLEN;
+    }
+}
+
+/* Returns false when the frame had to be dropped because user space still
+ * owns the block it would go into. */
+static bool packet_rx_ring_put_locked(packet_sock_t *sk, const uint8_t *data,
+                                      uint32_t snaplen, uint32_t len,
+                                      const struct sockaddr_ll *addr,
+                                      uint64_t ts_ns) {
+    packet_ring_t *ring = &sk->rx_ring;
+    uint32_t macoff, netoff, room, total;
+    struct tpacket_block_desc *desc;
+    struct tpacket3_hdr *hdr;
+    uint8_t *block;
+
+    packet_rx_ring_offsets(sk, &macoff, &netoff);
+    room = ring->block_size - ring->first_pkt_off;
+    if (macoff >= room)
+        return false;
+    snaplen = MIN(snaplen, room - macoff);
+    total = PADDING_UP(macoff + snaplen, 8);
+
+    if (ring->cur_open && ring->cur_offset + total > ring->block_size)
+        packet_rx_ring_retire_locked(sk, false);
+    if (!ring->cur_open && !packet_rx_ring_open_locked(sk)) {
+        sk->stat_freeze++;
+        return false;
+    }
+
+    block = packet_ring_block(ring, ring->cur_block);
+    desc = (struct tpacket_block_desc *)block;
+    hdr = (struct tpacket3_hdr *)(block + ring->cur_offset);
+    memset(hdr, 0, TPACKET_ALIGN(sizeof(*hdr)));
+    memcpy((uint8_t *)hdr + TPACKET_ALIGN(sizeof(*hdr)), addr, sizeof(*addr));
+    memcpy((uint8_t *)hdr + macoff, data, snaplen);
+
+    hdr->tp_next_offset = total;
+    hdr->tp_sec = (uint32_t)(ts_ns / 1000000000ULL);
+    hdr->tp_nsec = (uint32_t)(ts_ns % 1000000000ULL);
+    hdr->tp_snaplen = snaplen;
+    hdr->tp_len = len;
+    hdr->tp_status = TP_STATUS_USER;
+    hdr->tp_mac = (uint16_t)macoff;
+    hdr->tp_net = (uint16_t)netoff;
+
+    if (!ring->cur_pkts) {
+        desc->hdr.ts_first_pkt.ts_sec = hdr->tp_sec;
+        desc->hdr.ts_first_pkt.ts_nsec = hdr->tp_nsec;
+    }
+    desc->hdr.ts_last_pkt.ts_sec = hdr->tp_sec;
+    desc->hdr.ts_last_pkt.ts_nsec = hdr->tp_nsec;
+
+    ring->last_pkt_off = ring->cur_offset;
+    ring->cur_offset += total;
+    ring->cur_pkts++;
+
+    /* A full block goes to user space right away instead of waiting for
+     * the retire timer. */
+    if (ring->cur_offset + PADDING_UP(macoff + 1, 8) > ring->block_size)
+        packet_rx_ring_retire_locked(sk, false);
+    return true;
+}
+
+static bool packet_rx_ring_expired_locked(packet_sock_t *sk, uint64_t now) {
+    packet_ring_t *ring = &sk->rx_ring;
+
+    return ring->cur_open && ring->retire_tov_ns &&
+           now - ring->cur_opened_ns >= ring->retire_tov_ns;
+}
+
+static bool packet_rx_ring_readable_locked(packet_sock_t *sk) {
+    packet_ring_t *ring = &sk->rx_ring;
+    uint32_t prev = (ring->cur_block + ring->block_nr - 1) % ring->block_nr;
+
+    if (packet_block_status(ring, prev) != TP_STATUS_KERNEL)
+        return true;
+    return packet_block_status(ring, ring->cur_block) != TP_STATUS_KERNEL &&
+           !ring->cur_open;
+}
+
+static void packet_retire_work(work_struct_t *work) {
+    packet_sock_t *sk =
+        container_of(to_delayed_work(work), packet_sock_t, retire_work);
+    bool retired = false;
+    uint64_t now = nano_time();
+
+    spin_lock(&sk->lock);
+    if (!sk->dying && sk->rx_ring.blocks && sk->rx_ring.cur_open) {
+        if (packet_rx_ring_expired_locked(sk, now)) {
+            packet_rx_ring_retire_locked(sk, true);
+            sk->rx_ring.wake = false;
+            retired = true;
+        } else {
+            schedule_delayed_work(&sk->retire_work,
+                                  sk->rx_ring.cur_opened_ns +
+                                      sk->rx_ring.retire_tov_ns - now);
+        }
+    }
+    spin_unlock(&sk->lock);
+
+    if (retired)
+        packet_notify_sock(sk, EPOLLIN | EPOLLRDNORM);
+}
+
+/* Frame delivery */
+
+static bool packet_rcv_has_room_locked(packet_sock_t *sk, uint32_t len) {
+    packet_ring_t *ring = &sk->rx_ring;
+
+    if (!ring->blocks)
+        return skb_queue_space(&sk->queue) >= len;
+    if (ring->cur_open &&
+        ring->cur_offset + PADDING_UP(TPACKET3_HDRLEN + 32 + len, 8) <=
+            ring->block_size)
+        return true;
+    if (ring->cur_open)
+        return packet_block_status(ring, (ring->cur_block + 1) %
+                                             ring->block_nr) ==
+               TP_STATUS_KERNEL;
+    return packet_block_status(ring, ring->cur_block) == TP_STATUS_KERNEL;
+}
+
+static bool packet_sock_wants(const packet_sock_t *sk, int ifindex,
+                              uint16_t proto, bool outgoing) {
+    if (!sk->running || sk->dying)
+        return false;
+    if (outgoing && sk->ignore_outgoing)
+        return false;
+    if (sk->ifindex && sk->ifindex != ifindex)
+        return false;
+    return sk->protocol == ETH_P_ALL || sk->protocol == proto;
+}
+
+static void packet_fill_addr(struct sockaddr_ll *addr, const netdev_t *dev,
+                             const uint8_t *frame, uint32_t len,
+                             bool outgoing) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sll_family = AF_PACKET;
+    addr->sll_ifindex = (int32_t)(dev->id + 1);
+    addr->sll_hatype = packet_hatype(dev);
+    if (len < PACKET_ETH_HLEN)
+        return;
+
+    memcpy(&addr->sll_protocol, frame + 12, sizeof(addr->sll_protocol));
+    addr->sll_halen = 6;
+    memcpy(addr->sll_addr, frame + 6, 6);
+
+    if (outgoing) {
+        addr->sll_pkttype = PACKET_OUTGOING;
+    } else if (frame[0] & 1) {
+        static const uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+        addr->sll_pkttype = memcmp(frame, bcast, 6) == 0 ? PACKET_BROADCAST
+                                                         : PACKET_MULTICAST;
+    } else {
+        addr->sll_pkttype = memcmp(frame, dev->mac, 6) == 0 ? PACKET_HOST
+                                                            : PACKET_OTHERHOST;
+    }
+}
+
+/* Returns false only when the frame was dropped for lack of room. */
+static bool packet_deliver_locked(packet_sock_t *sk, const uint8_t *frame,
+                                  uint32_t len, const struct sockaddr_ll *addr,
+                                  uint64_t ts_ns) {
+    uint32_t off = 0;
+    uint32_t snaplen;
+    const uint8_t *data;
+    skb_buff_t *skb;
+    packet_skb_meta_t *meta;
+    bool queued = false;
+
+    if (sk->type == SOCK_DGRAM && len >= PACKET_ETH_HLEN)
+        off = PACKET_ETH_HLEN;
+    data = frame + off;
+    len -= off;
+
+    snaplen = len;
+    if (sk->filter) {
+        snaplen = bpf_prog_run(sk->filter, data, len);
+        if (!snaplen)
+            return true;
+        snaplen = MIN(snaplen, len);
+    }
+
+    sk->stat_packets++;
+    if (sk->rx_ring.blocks) {
+        if (!packet_rx_ring_put_locked(sk, data, snaplen, len, addr, ts_ns)) {
+            sk->stat_drops++;
+            return false;
+        }
+        return true;
+    }
+
+    if (skb_queue_space(&sk->queue) < snaplen)
+        goto drop;
+    skb = skb_alloc(snaplen);
+    if (!skb)
+        goto drop;
+    meta = malloc(sizeof(*meta));
+    if (!meta) {
+        skb_free(skb, NULL);
+        goto drop;
+    }
+    memcpy(skb->data, data, snaplen);
+    meta->addr = *addr;
+    meta->len = len;
+    meta->net = off ? 0 : PACKET_ETH_HLEN;
+    meta->ts_ns = ts_ns;
+    skb->priv = meta;
+    queued = skb_queue_push(&sk->queue, skb);
+    if (!queued) {
+        skb_free(skb, packet_skb_meta_destroy);
+        goto drop;
+    }
+    return true;
+
+drop:
+    sk->stat_drops++;
+    return false;
+}
+
+static bool packet_deliver(packet_sock_t *sk, const uint8_t *frame,
+                           uint32_t len, const struct sockaddr_ll *addr,
+                           uint64_t ts_ns) {
+    bool delivered;
+    bool wake;
+
+    spin_lock(&sk->lock);
+    if (sk->dying) {
+        spin_unlock(&sk->lock);
+        return true;
+    }
+    delivered = packet_deliver_locked(sk, frame, len, addr, ts_ns);
+    /* Ring readers are woken when a block retires, not for every frame. */
+    wake = sk->rx_ring.blocks ? sk->rx_ring.wake : delivered;
+    sk->rx_ring.wake = false;
+    spin_unlock(&sk->lock);
+
+    if (wake)
+        packet_notify_sock(sk, EPOLLIN | EPOLLRDNORM);
+    return delivered;
+}
+
+/* Fanout */
+
+static inline uint32_t packet_mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Flow hash that gives both directions of a connection the same value, so
+ * a flow and its replies land on the same fanout member. */
+static uint32_t packet_flow_hash(const uint8_t *frame, uint32_t len) {
+    uint16_t proto;
+    uint32_t hash = 0;
+    uint32_t l4 = 0;
+    uint8_t ipproto = 0;
+
+    if (len < PACKET_ETH_HLEN)
+        return 0;
+    proto = (uint16_t)((frame[12] << 8) | frame[13]);
+
+    if (proto == ETH_P_IP && len >= PACKET_ETH_HLEN + 20) {
+        const uint8_t *ip = frame + PACKET_ETH_HLEN;
+        uint32_t ihl = (ip[0] & 0x0f) * 4U;
+        uint32_t saddr, daddr;
+
+        memcpy(&saddr, ip + 12, 4);
+        memcpy(&daddr, ip + 16, 4);
+        hash = saddr ^ daddr;
+        ipproto = ip[9];
+        /* Only the first fragment carries ports. */
+        if (!(((ip[6] & 0x1f) << 8) | ip[7]))
+            l4 = PACKET_ETH_HLEN + ihl;
+    } else if (proto == ETH_P_IPV6 && len >= PACKET_ETH_HLEN + 40) {
+        const uint8_t *ip6 = frame + PACKET_ETH_HLEN;
+
+        for (uint32_t i = 0; i < 8; i++) {
+            uint32_t word;
+            memcpy(&word, ip6 + 8 + i * 4, 4);
+            hash ^= word;
+        }
+        ipproto = ip6[6];
+        l4 = PACKET_ETH_HLEN + 40;
+    } else {
+        return packet_mix32(proto);
+    }
+
+    hash ^= ipproto;
+    if (l4 && (ipproto == 6 || ipproto == 17) && len >= l4 + 4) {
+        uint16_t sport, dport;
+
+        memcpy(&sport, frame + l4, 2);
+        memcpy(&dport, frame + l4 + 2, 2);
+        hash ^= (uint32_t)(sport ^ dport) << 16 | (uint32_t)(sport ^ dport);
+    }
+    return packet_mix32(hash);
+}
+
+static uint32_t packet_fanout_pick(packet_fanout_t *f, const uint8_t *frame,
+                                   uint32_t len) {
+    uint32_t x;
+
+    switch (f->mode) {
+    case PACKET_FANOUT_HASH:
+        return (uint32_t)(((uint64_t)packet_flow_hash(frame, len) * f->nr) >>
+                          32);
+    case PACKET_FANOUT_LB:
+        return f->next++ % f->nr;
+    case PACKET_FANOUT_CPU:
+        return current_cpu_id % f->nr;
+    case PACKET_FANOUT_RND:
+        x = f->rnd;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        f->rnd = x;
+        return x % f->nr;
+    case PACKET_FANOUT_ROLLOVER:
+    default:
+        return f->next % f->nr;
+    }
+}
+
+static packet_sock_t *packet_fanout_member_locked(packet_fanout_t *f,
+                                                 const uint8_t *frame,
+                                                 uint32_t len) {
+    bool rollover = f->mode == PACKET_FANOUT_ROLLOVER ||
+                    (f->flags & PACKET_FANOUT_FLAG_ROLLOVER);
+    uint32_t idx = packet_fanout_pick(f, frame, len);
+
+    if (rollover) {
+        for (uint32_t i = 0; i < f->nr; i++) {
+            uint32_t cand = (idx + i) % f->nr;
+            packet_sock_t *sk = f->members[cand];
+            bool room;
+
+            spin_lock(&sk->lock);
+            room = packet_rcv_has_room_locked(sk, len);
+            spin_unlock(&sk->lock);
+            if (room) {
+                idx = cand;
+                break;
+            }
+        }
+        if (f->mode == PACKET_FANOUT_ROLLOVER)
+            f->next = idx;
+    }
+    return f->members[idx];
+}
+
+static packet_fanout_t *packet_fanout_find_locked(uint16_t id) {
+    for (int i = 0; i < MAX_PACKET_FANOUTS; i++) {
+        if (packet_fanouts[i] && packet_fanouts[i]->id == id)
+            return packet_fanouts[i];
+    }
+    return NULL;
+}
+
+static int packet_fanout_join(packet_sock_t *sk, uint32_t val) {
+    uint16_t id = (uint16_t)(val & 0xffff);
+    uint16_t mode = (uint16_t)((val >> 16) & 0xff);
+    uint16_t flags = (uint16_t)((val >> 16) & 0xff00);
+    packet_fanout_t *f;
+    int ret = 0;
+
+    if (mode > PACKET_FANOUT_RND || (flags & ~PACKET_FANOUT_FLAG_ROLLOVER))
+        return -EINVAL;
+
+    spin_lock(&packet_sockets_lock);
+    if (sk->fanout) {
+        ret = -EALREADY;
+        goto out;
+    }
+    if (!sk->running) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    f = packet_fanout_find_locked(id);
+    if (f) {
+        if (f->mode != mode || f->flags != flags ||
+            f->protocol != sk->protocol || f->ifindex != sk->ifindex) {
+            ret = -EINVAL;
+            goto out;
+        }
+        if (f->nr >= PACKET_FANOUT_MAX) {
+            ret = -ENOSPC;
+            goto out;
+        }
+    } else {
+        int slot = -1;
+
+        for (int i = 0; i < MAX_PACKET_FANOUTS; i++) {
+            if (!packet_fanouts[i]) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0) {
+            ret = -ENOSPC;
+            goto out;
+        }
+        f = calloc(1, sizeof(*f));
+        if (!f) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        f->id = id;
+        f->mode = mode;
+        f->flags = flags;
+        f->protocol = sk->protocol;
+        f->ifindex = sk->ifindex;
+        f->rnd = (uint32_t)nano_time() | 1;
+        packet_fanouts[slot] = f;
+    }
+
+    f->members[f->nr++] = sk;
+    sk->fanout = f;
+out:
+    spin_unlock(&packet_sockets_lock);
+    return ret;
+}
+
+static void packet_fanout_leave_locked(packet_sock_t *sk) {
+    packet_fanout_t *f = sk->fanout;
+
+    if (!f)
+        return;
+
+    for (uint32_t i = 0; i < f->nr; i++) {
+        if (f->members[i] != sk)
+            continue;
+        f->members[i] = f->members[--f->nr];
+        f->members[f->nr] = NULL;
+        break;
+    }
+    sk->fanout = NULL;
+
+    if (f->nr)
+        return;
+    for (int i = 0; i < MAX_PACKET_FANOUTS; i++) {
+        if (packet_fanouts[i] == f) {
+            packet_fanouts[i] = NULL;
+            break;
+        }
+    }
+    free(f);
+}
+
+void __packet_tap(netdev_t *dev, const netdev_frag_t *frags, uint32_t nr_frags,
+                  uint32_t len, bool outgoing) {
+    packet_sock_t *targets[MAX_PACKET_SOCKETS + MAX_PACKET_FANOUTS];
+    uint32_t nr_targets = 0;
+    const uint8_t *frame;
+    uint8_t *flat = NULL;
+    struct sockaddr_ll addr;
+    uint64_t ts_ns;
+    uint16_t proto = 0;
+    int ifindex;
+
+    if (!dev || !frags || !nr_frags || !len)
+        return;
+
+    if (nr_frags == 1) {
+        frame = frags[0].data;
+        len = MIN(len, frags[0].len);
+    } else {
+        flat = malloc(len);
+        if (!flat)
+            return;
+        len = netdev_frags_copy(frags, nr_frags, 0, flat, len);
+        frame = flat;
+    }
+
+    if (len >= PACKET_ETH_HLEN)
+        proto = (uint16_t)((frame[12] << 8) | frame[13]);
+    ifindex = (int)(dev->id + 1);
+    ts_ns = packet_realtime_ns();
+    packet_fill_addr(&addr, dev, frame, len, outgoing);
+
+    /*
+     * Only pick the receivers under the global lock; filtering and copying
+     * run without it. Each pick pins its socket through sk->taps, which
+     * packet_handle_release() waits out before tearing the socket down.
+     */
+    spin_lock(&packet_sockets_lock);
+    for (int i = 0; i < MAX_PACKET_SOCKETS; i++) {
+        packet_sock_t *sk = packet_sockets[i];
+
+        if (!sk || sk->fanout ||
+            !packet_sock_wants(sk, ifindex, proto, outgoing))
+            continue;
+        __atomic_add_fetch(&sk->taps, 1, __ATOMIC_RELAXED);
+        targets[nr_targets++] = sk;
+    }
+    for (int i = 0; i < MAX_PACKET_FANOUTS; i++) {
+        packet_fanout_t *f = packet_fanouts[i];
+        packet_sock_t *sk;
+
+        if (!f || !f->nr)
+            continue;
+        if (f->ifindex && f->ifindex != ifindex)
+            continue;
+        if (f->protocol != ETH_P_ALL && f->protocol != proto)
+            continue;
+        if (outgoing && f->members[0]->ignore_outgoing)
+            continue;
+        sk = packet_fanout_member_locked(f, frame, len);
+        __atomic_add_fetch(&sk->taps, 1, __ATOMIC_RELAXED);
+        targets[nr_targets++] = sk;
+    }
+    spin_unlock(&packet_sockets_lock);
+
+    for (uint32_t i = 0; i < nr_targets; i++) {
+        packet_deliver(targets[i], frame, len, &addr, ts_ns);
+        __atomic_sub_fetch(&targets[i]->taps, 1, __ATOMIC_RELEASE);
+    }
+
+    free(flat);
+}
+
+/* Transmit */
+
+static int packet_wait_file(fd_t *file, uint32_t events) {
+    const uint32_t want = events | EPOLLERR | EPOLLHUP | EPOLLNVAL;
+
+    while (true) {
+        int polled = vfs_poll(file, want);
+        if (polled < 0)
+            return polled;
+        if (polled & want)
+            return EOK;
+
+        int reason = vfs_poll_wait_interruptible(file, want);
+        if (reason < 0)
+            return reason;
+    }
+}
+
+static int packet_resolve_dev(packet_sock_t *sk,
+                              const struct sockaddr_ll *addr, netdev_t **out) {
+    int ifindex = addr ? addr->sll_ifindex : sk->ifindex;
+    netdev_t *dev;
+
+    if (!ifindex)
+        return -ENXIO;
+    dev = netdev_get_by_index((uint32_t)ifindex);
+    if (!dev)
+        return -ENXIO;
+    *out = dev;
+    return 0;
+}
+
+/* Sends one frame; for SOCK_DGRAM data is the payload and the Ethernet
+ * header is built from addr. */
+static int packet_xmit_one(packet_sock_t *sk, netdev_t *dev,
+                           const struct sockaddr_ll *addr, const uint8_t *data,
+                           uint32_t len) {
+    uint32_t max = dev->mtu + PACKET_ETH_HLEN;
+    uint8_t *frame;
+    uint16_t proto;
+    int ret;
+
+    if (sk->type == SOCK_RAW) {
+        if (len < PACKET_ETH_HLEN || len > max)
+            return -EMSGSIZE;
+        return netdev_send(dev, (void *)data, len);
+    }
+
+    if (!addr || addr->sll_halen < 6)
+        return -EDESTADDRREQ;
+    if (len + PACKET_ETH_HLEN > max)
+        return -EMSGSIZE;
+
+    frame = malloc(len + PACKET_ETH_HLEN);
+    if (!frame)
+        return -ENOMEM;
+    proto = addr->sll_protocol ? addr->sll_protocol : htons(sk->protocol);
+    memcpy(frame, addr->sll_addr, 6);
+    memcpy(frame + 6, dev->mac, 6);
+    memcpy(frame + 12, &proto, 2);
+    memcpy(frame + PACKET_ETH_HLEN, data, len);
+    ret = netdev_send(dev, frame, len + PACKET_ETH_HLEN);
+    free(frame);
+    return ret < 0 ? ret : (int)len;
+}
+
+/* Sends every frame user space has queued on the transmit ring. Frames are
+ * claimed one at a time under the socket lock so concurrent senders never
+ * pick the same one, and the device is called without the lock held. */
+static ssize_t packet_tx_ring_send(packet_sock_t *sk,
+                                   const struct sockaddr_ll *addr) {
+    packet_ring_t *ring = &sk->tx_ring;
+    netdev_t *dev = NULL;
+    ssize_t total = 0;
+    int ret;
+
+    ret = packet_resolve_dev(sk, addr, &dev);
+    if (ret < 0)
+        return ret;
+
+    while (true) {
+        struct tpacket3_hdr *hdr;
+        uint32_t len;
+
+        spin_lock(&sk->lock);
+        hdr = (struct tpacket3_hdr *)packet_ring_frame(ring, ring->head);
+        if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) !=
+            TP_STATUS_SEND_REQUEST) {
+            spin_unlock(&sk->lock);
+            break;
+        }
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SENDING,
+                         __ATOMIC_RELAXED);
+        ring->head = (ring->head + 1) % ring->frame_nr;
+        spin_unlock(&sk->lock);
+
+        len = hdr->tp_len;
+        if (len > ring->frame_size - PACKET_TX_DATA_OFF) {
+            ret = -EMSGSIZE;
+        } else {
+            ret = packet_xmit_one(sk, dev, addr,
+                                  (const uint8_t *)hdr + PACKET_TX_DATA_OFF,
+                                  len);
+        }
+        if (ret < 0) {
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_WRONG_FORMAT,
+                             __ATOMIC_RELEASE);
+            if (!total)
+                total = ret;
+            break;
+        }
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE,
+                         __ATOMIC_RELEASE);
+        total += len;
+    }
+
+    netdev_put(dev);
+    packet_notify_sock(sk, EPOLLOUT | EPOLLWRNORM);
+    return total;
+}
+
+static ssize_t packet_do_send(packet_sock_t *sk, const struct sockaddr_ll *addr,
+                              const struct iovec *iov, size_t iovlen) {
+    netdev_t *dev = NULL;
+    size_t total = 0;
+    uint8_t *buf;
+    size_t off = 0;
+    int ret;
+
+    if (addr && addr->sll_family != AF_PACKET)
+        return -EINVAL;
+    if (sk->tx_ring.blocks)
+        return packet_tx_ring_send(sk, addr);
+
+    for (size_t i = 0; i < iovlen; i++) {
+        if (!iov[i].iov_base && iov[i].len)
+            return -EFAULT;
+        total += iov[i].len;
+    }
+    if (total > UINT16_MAX)
+        return -EMSGSIZE;
+
+    ret = packet_resolve_dev(sk, addr, &dev);
+    if (ret < 0)
+        return ret;
+
+    buf = malloc(total ? total : 1);
+    if (!buf) {
+        netdev_put(dev);
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < iovlen; i++) {
+        if (!iov[i].len)
+            continue;
+        memcpy(buf + off, iov[i].iov_base, iov[i].len);
+        off += iov[i].len;
+    }
+
+    ret = packet_xmit_one(sk, dev, addr, buf, (uint32_t)total);
+    free(buf);
+    netdev_put(dev);
+    return ret < 0 ? ret : (ssize_t)total;
+}
+
+/* Receive */
+
+static size_t packet_copy_to_iov(struct iovec *iov, size_t iovlen,
+                                 const uint8_t *src, size_t len) {
+    size_t copied = 0;
+
+    for (size_t i = 0; i < iovlen && copied < len; i++) {
+        size_t to_copy = MIN(iov[i].len, len - copied);
+        if (!to_copy)
+            continue;
+        memcpy(iov[i].iov_base, src + copied, to_copy);
+        copied += to_copy;
+    }
+    return copied;
+}
+
+static ssize_t packet_do_recv(packet_sock_t *sk, fd_t *file,
+                              struct msghdr *msg, int flags) {
+    bool nonblock =
+        !!(flags & MSG_DONTWAIT) || !!(fd_get_flags(file) & O_NONBLOCK);
+    skb_buff_t *skb;
+    packet_skb_meta_t *meta;
+    size_t copied;
+    size_t skb_len;
+
+    while (true) {
+        spin_lock(&sk->lock);
+        if (sk->err) {
+            int err = sk->err;
+            sk->err = 0;
+            spin_unlock(&sk->lock);
+            return -err;
+        }
+        skb = (flags & MSG_PEEK) ? skb_queue_peek(&sk->queue)
+                                 : skb_queue_pop(&sk->queue);
+        if (skb)
+            break;
+        spin_unlock(&sk->lock);
+
+        if (nonblock)
+            return -EAGAIN;
+        int ret = packet_wait_file(file, EPOLLIN);
+        if (ret != EOK)
+            return ret < 0 ? ret : -EINTR;
+    }
+
+    /* A peeked skb stays on the queue, so copy out before dropping the
+     * lock. */
+    meta = skb->priv;
+    skb_len = skb->len;
+    copied = packet_copy_to_iov(msg->msg_iov, msg->msg_iovlen, skb->data,
+                                skb_len);
+    msg->msg_flags = copied < skb_len ? MSG_TRUNC : 0;
+
+    if (msg->msg_name && msg->msg_namelen > 0) {
+        size_t name_len =
+            MIN((size_t)msg->msg_namelen, sizeof(struct sockaddr_ll));
+        memcpy(msg->msg_name, &meta->addr, name_len);
+        msg->msg_namelen = sizeof(struct sockaddr_ll);
+    } else {
+        msg->msg_namelen = 0;
+    }
+
+    if (msg->msg_control && msg->msg_controllen > 0 && sk->auxdata) {
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+        if (cmsg &&
+            msg->msg_controllen >= CMSG_LEN(sizeof(struct tpacket_auxdata))) {
+            struct tpacket_auxdata aux = {
+                .tp_status = TP_STATUS_USER,
+                .tp_len = meta->len,
+                .tp_snaplen = (uint32_t)skb_len,
+                .tp_mac = 0,
+                .tp_net = meta->net,
+            };
+
+            cmsg->cmsg_len = CMSG_LEN(sizeof(aux));
+            cmsg->cmsg_level = SOL_PACKET;
+            cmsg->cmsg_type = PACKET_AUXDATA;
+            memcpy(CMSG_DATA(cmsg), &aux, sizeof(aux));
+            msg->msg_controllen = cmsg->cmsg_len;
+        } else {
+            msg->msg_flags |= MSG_CTRUNC;
+            msg->msg_controllen = 0;
+        }
+    } else {
+        msg->msg_controllen = 0;
+    }
+    spin_unlock(&sk->lock);
+
+    if (!(flags & MSG_PEEK))
+        skb_free(skb, packet_skb_meta_destroy);
+    return (flags & MSG_TRUNC) ? (ssize_t)skb_len : (ssize_t)copied;
+}
+
+/* Socket operations */
+
+int packet_bind(uint64_t fd, const struct sockaddr_un *addr,
+                socklen_t addrlen) {
+    const struct sockaddr_ll *sll = (const struct sockaddr_ll *)addr;
+    packet_sock_t *sk = NULL;
+    fd_t *file;
+    uint16_t proto;
+    int ret = 0;
+
+    if (!addr || addrlen < sizeof(struct sockaddr_ll))
+        return -EINVAL;
+    if (sll->sll_family != AF_PACKET)
+        return -EINVAL;
+
+    file = packet_file_from_fd(fd, &sk);
+    if (!file)
+        return -EBADF;
+
+    if (sll->sll_ifindex) {
+        netdev_t *dev = netdev_get_by_index((uint32_t)sll->sll_ifindex);
+        if (!dev) {
+            vfs_file_put(file);
+            return -ENODEV;
+        }
+        netdev_put(dev);
+    }
+
+    spin_lock(&packet_sockets_lock);
+    proto = sll->sll_protocol ? ntohs(sll->sll_protocol) : sk->protocol;
+    if (sk->fanout &&
+        (proto != sk->protocol || sll->sll_ifindex != sk->ifindex)) {
+        ret = -EINVAL;
+    } else {
+        spin_lock(&sk->lock);
+        sk->protocol = proto;
+        sk->ifindex = sll->sll_ifindex;
+        spin_unlock(&sk->lock);
+        packet_set_running_locked(sk, proto != 0);
+    }
+    spin_unlock(&packet_sockets_lock);
+
+    vfs_file_put(file);
+    return ret;
+}
+
+int packet_getsockname(uint64_t fd, struct sockaddr_un *addr,
+                       socklen_t *addrlen) {
+    struct sockaddr_ll sll;
+    packet_sock_t *sk = NULL;
+    fd_t *file = packet_file_from_fd(fd, &sk);
+    netdev_t *dev;
+
+    if (!file)
+        return -EBADF;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(sk->protocol);
+    sll.sll_ifindex = sk->ifindex;
+    dev = sk->ifindex ? netdev_get_by_index((uint32_t)sk->ifindex) : NULL;
+    if (dev) {
+        sll.sll_hatype = packet_hatype(dev);
+        sll.sll_halen = 6;
+        memcpy(sll.sll_addr, dev->mac, 6);
+        netdev_put(dev);
+    }
+
+    if (addr && addrlen) {
+        memcpy(addr, &sll, MIN((size_t)*addrlen, sizeof(sll)));
+        *addrlen = sizeof(sll);
+    }
+    vfs_file_put(file);
+    return 0;
+}
+
+size_t packet_sendmsg(uint64_t fd, const struct msghdr *msg, int flags) {
+    packet_sock_t *sk = NULL;
+    const struct sockaddr_ll *addr = NULL;
+    fd_t *file;
+    ssize_t ret;
+
+    (void)flags;
+    if (!msg)
+        return -EINVAL;
+    if (msg->msg_name) {
+        if (msg->msg_namelen < offsetof(struct sockaddr_ll, sll_addr))
+            return -EINVAL;
+        addr = msg->msg_name;
+    }
+
+    file = packet_file_from_fd(fd, &sk);
+    if (!file)
+        return -EBADF;
+    ret = packet_do_send(sk, addr, msg->msg_iov, msg->msg_iovlen);
+    vfs_file_put(file);
+    return (size_t)ret;
+}
+
+size_t packet_sendto(uint64_t fd, uint8_t *in, size_t limit, int flags,
+                     struct sockaddr_un *addr, uint32_t len) {
+    struct iovec iov = {.iov_base = in, .len = limit};
+    struct msghdr msg = {
+        .msg_name = addr,
+        .msg_namelen = addr ? len : 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+
+    return packet_sendmsg(fd, &msg, flags);
+}
+
+size_t packet_recvmsg(uint64_t fd, struct msghdr *msg, int flags) {
+    packet_sock_t *sk = NULL;
+    fd_t *file;
+    ssize_t ret;
+
+    if (!msg)
+        return -EINVAL;
+    file = packet_file_from_fd(fd, &sk);
+    if (!file)
+        return -EBADF;
+    ret = packet_do_recv(sk, file, msg, flags);
+    vfs_file_put(file);
+    return (size_t)ret;
+}
+
+size_t packet_recvfrom(uint64_t fd, uint8_t *out, size_t limit, int flags,
+                       struct sockaddr_un *addr, uint32_t *len) {
+    struct iovec iov = {.iov_base = out, .len = limit};
+    struct msghdr msg = {
+        .msg_name = addr,
+        .msg_namelen = (addr && len) ? *len : 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+    size_t ret = packet_recvmsg(fd, &msg, flags);
+
+    if ((ssize_t)ret >= 0 && addr && len)
+        *len = msg.msg_namelen;
+    return ret;
+}
+
+static int packet_set_ring(packet_sock_t *sk, const struct tpacket_req3 *req,
+                           bool rx) {
+    packet_ring_t ring;
+    packet_ring_t old;
+    int ret;
+
+    if (sk->version != TPACKET_V3)
+        return -EINVAL;
+
+    memset(&ring, 0, sizeof(ring));
+    if (req->tp_block_nr) {
+        ret = packet_ring_alloc(&ring, req, rx);
+        if (ret < 0)
+            return ret;
+    }
+
+    spin_lock(&sk->lock);
+    if (sk->mapping || packet_ring_mapped(&sk->rx_ring) ||
+        packet_ring_mapped(&sk->tx_ring)) {
+        spin_unlock(&sk->lock);
+        packet_ring_free(&ring);
+        return -EBUSY;
+    }
+    if (rx) {
+        old = sk->rx_ring;
+        sk->rx_ring = ring;
+    } else {
+        old = sk->tx_ring;
+        sk->tx_ring = ring;
+    }
+    spin_unlock(&sk->lock);
+
+    if (rx && old.blocks) {
+        cancel_delayed_work(&sk->retire_work);
+        flush_delayed_work(&sk->retire_work);
+        /* The cancel may have hit a timer armed for the new ring. */
+        spin_lock(&sk->lock);
+        if (sk->rx_ring.cur_open && !sk->dying)
+            schedule_delayed_work(&sk->retire_work,
+                                  sk->rx_ring.retire_tov_ns);
+        spin_unlock(&sk->lock);
+    }
+    packet_ring_free(&old);
+    return 0;
+}
+
+static void packet_stats_take(packet_sock_t *sk, struct tpacket_stats_v3 *st) {
+    spin_lock(&sk->lock);
+    st->tp_packets = sk->stat_packets + sk->stat_drops;
+    st->tp_drops = sk->stat_drops;
+    st->tp_freeze_q_cnt = sk->stat_freeze;
+    sk->stat_packets = 0;
+    sk->stat_drops = 0;
+    sk->stat_freeze = 0;
+    spin_unlock(&sk->lock);
+}
+
+size_t packet_getsockopt(uint64_t fd, int level, int optname, void *optval,
+                         socklen_t *optlen) {
+    packet_sock_t *sk = NULL;
+    fd_t *file = packet_file_from_fd(fd, &sk);
+    int val = 0;
+    int ret = 0;
+
+    if (!file)
+        return -EBADF;
+    if (!optval || !optlen) {
+        vfs_file_put(file);
+        return -EINVAL;
+    }
+#define PACKET_GETSOCKOPT_RETURN(value)                                        \
+    do {                                                                       \
+        vfs_file_put(file);                                                    \
+        return (value);                                                        \
+    } while (0)
+
+    if (level == SOL_SOCKET) {
+        switch (optname) {
+        case SO_TYPE:
+            val = sk->type;
+            break;
+        case SO_DOMAIN:
+            val = AF_PACKET;
+            break;
+        case SO_PROTOCOL:
+            val = htons(sk->protocol);
+            break;
+        case SO_RCVBUF:
+        case SO_RCVBUFFORCE:
+            val = (int)sk->rcvbuf;
+            break;
+        case SO_ERROR:
+            spin_lock(&sk->lock);
+            val = sk->err;
+            sk->err = 0;
+            spin_unlock(&sk->lock);
+            break;
+        default:
+            PACKET_GETSOCKOPT_RETURN(-ENOPROTOOPT);
+        }
+    } else if (level == SOL_PACKET) {
+        switch (optname) {
+        case PACKET_STATISTICS: {
+            struct tpacket_stats_v3 st;
+            size_t len = sk->version == TPACKET_V3
+                             ? sizeof(struct tpacket_stats_v3)
+                             : sizeof(struct tpacket_stats);
+
+            packet_stats_take(sk, &st);
+            len = MIN(len, (size_t)*optlen);
+            memcpy(optval, &st, len);
+            *optlen = len;
+            PACKET_GETSOCKOPT_RETURN(0);
+        }
+        case PACKET_VERSION:
+            val = sk->version;
+            break;
+        case PACKET_HDRLEN:
+            if (*optlen < sizeof(int))
+                PACKET_GETSOCKOPT_RETURN(-EINVAL);
+            if (*(int *)optval != TPACKET_V3)
+                PACKET_GETSOCKOPT_RETURN(-EINVAL);
+            val = TPACKET3_HDRLEN;
+            break;
+        case PACKET_RESERVE:
+            val = (int)sk->reserve;
+            break;
+        case PACKET_AUXDATA:
+            val = sk->auxdata;
+            break;
+        case PACKET_IGNORE_OUTGOING:
+            val = sk->ignore_outgoing;
+            break;
+        case PACKET_FANOUT:
+            spin_lock(&packet_sockets_lock);
+            if (sk->fanout)
+                val = sk->fanout->id |
+                      ((sk->fanout->mode | sk->fanout->flags) << 16);
+            spin_unlock(&packet_sockets_lock);
+            break;
+        default:
+            PACKET_GETSOCKOPT_RETURN(-ENOPROTOOPT);
+        }
+    } else {
+        PACKET_GETSOCKOPT_RETURN(-ENOPROTOOPT);
+    }
+
+    if (*optlen < sizeof(int))
+        ret = -EINVAL;
+    else {
+        memcpy(optval, &val, sizeof(val));
+        *optlen = sizeof(int);
+    }
+    vfs_file_put(file);
+#undef PACKET_GETSOCKOPT_RETURN
+    return ret;
+}
+
+size_t packet_setsockopt(uint64_t fd, int level, int optname,
+                         const void *optval, socklen_t optlen) {
+    packet_sock_t *sk = NULL;
+    fd_t *file = packet_file_from_fd(fd, &sk);
+    int val = 0;
+    int ret = 0;
+
+    if (!file)
+        return -EBADF;
+#define PACKET_SETSOCKOPT_RETURN(value)                                        \
+    do {                                                                       \
+        vfs_file_put(file);                                                    \
+        return (value);                                                        \
+    } while (0)
+
+    if (optval && optlen >= sizeof(int))
+        memcpy(&val, optval, sizeof(int));
+
+    if (level == SOL_SOCKET) {
+        switch (optname) {
+        case SO_ATTACH_FILTER: {
+            bpf_prog_t *new_filter = NULL;
+            bpf_prog_t *old_filter = NULL;
+            int err = bpf_prog_attach_user(optval, optlen, &new_filter);
+
+            if (err < 0)
+                PACKET_SETSOCKOPT_RETURN((size_t)err);
+
+            spin_lock(&sk->lock);
+            old_filter = sk->filter;
+            sk->filter = new_filter;
+            spin_unlock(&sk->lock);
+            bpf_prog_free(old_filter);
+            break;
+        }
+        case SO_DETACH_FILTER: {
+            bpf_prog_t *old_filter = NULL;
+
+            spin_lock(&sk->lock);
+            old_filter = sk->filter;
+            sk->filter = NULL;
+            spin_unlock(&sk->lock);
+            bpf_prog_free(old_filter);
+            break;
+        }
+        case SO_RCVBUF:
+        case SO_RCVBUFFORCE:
+            if (!optval || optlen < sizeof(int))
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            spin_lock(&sk->lock);
+            sk->rcvbuf = MIN(MAX((uint32_t)MAX(val, 0) * 2,
+                                 (uint32_t)PACKET_RCVBUF_MIN),
+                             (uint32_t)PACKET_RCVBUF_MAX);
+            skb_queue_set_limit(&sk->queue, sk->rcvbuf);
+            spin_unlock(&sk->lock);
+            break;
+        case SO_SNDBUF:
+        case SO_SNDBUFFORCE:
+        case SO_REUSEADDR:
+        case SO_TIMESTAMP_OLD:
+        case SO_TIMESTAMPNS_OLD:
+            break;
+        default:
+            PACKET_SETSOCKOPT_RETURN(-ENOPROTOOPT);
+        }
+    } else if (level == SOL_PACKET) {
+        switch (optname) {
+        case PACKET_RX_RING:
+        case PACKET_TX_RING: {
+            struct tpacket_req3 req;
+
+            if (!optval || optlen < sizeof(struct tpacket_req3))
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            memcpy(&req, optval, sizeof(req));
+            ret = packet_set_ring(sk, &req, optname == PACKET_RX_RING);
+            break;
+        }
+        case PACKET_VERSION:
+            if (!optval || optlen < sizeof(int))
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            if (val < TPACKET_V1 || val > TPACKET_V3)
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            spin_lock(&sk->lock);
+            if (sk->rx_ring.blocks || sk->tx_ring.blocks)
+                ret = -EBUSY;
+            else
+                sk->version = val;
+            spin_unlock(&sk->lock);
+            break;
+        case PACKET_RESERVE:
+            if (!optval || optlen < sizeof(int) || val < 0 ||
+                val > INT16_MAX)
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            spin_lock(&sk->lock);
+            if (sk->rx_ring.blocks || sk->tx_ring.blocks)
+                ret = -EBUSY;
+            else
+                sk->reserve = (uint32_t)val;
+            spin_unlock(&sk->lock);
+            break;
+        case PACKET_AUXDATA:
+            if (!optval || optlen < sizeof(int))
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            sk->auxdata = val != 0;
+            break;
+        case PACKET_IGNORE_OUTGOING:
+            if (!optval || optlen < sizeof(int))
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            sk->ignore_outgoing = val != 0;
+            break;
+        case PACKET_FANOUT:
+            if (!optval || optlen < sizeof(int))
+                PACKET_SETSOCKOPT_RETURN(-EINVAL);
+            ret = packet_fanout_join(sk, (uint32_t)val);
+            break;
+        case PACKET_ADD_MEMBERSHIP:
+        case PACKET_DROP_MEMBERSHIP:
+            /* Drivers hand up every frame they receive, so promiscuous and
+             * multicast membership need no programming here. */
+            break;
+        default:
+            PACKET_SETSOCKOPT_RETURN(-ENOPROTOOPT);
+        }
+    } else {
+        PACKET_SETSOCKOPT_RETURN(-ENOPROTOOPT);
+    }
+
+    vfs_file_put(file);
+#undef PACKET_SETSOCKOPT_RETURN
+    return (size_t)ret;
+}
+
+static socket_op_t packet_ops = {
+    .bind = packet_bind,
+    .getsockname = packet_getsockname,
+    .sendto = packet_sendto,
+    .recvfrom = packet_recvfrom,
+    .sendmsg = packet_sendmsg,
+    .recvmsg = packet_recvmsg,
+    .getsockopt = packet_getsockopt,
+    .setsockopt = packet_setsockopt,
+};
+
+static ssize_t packet_read_op(fd_t *fd, void *buf, size_t offset,
+                              size_t count) {
+    socket_handle_t *handle = sockfs_file_handle(fd);
+    struct iovec iov = {.iov_base = buf, .len = count};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+
+    (void)offset;
+    if (!handle || !handle->sock)
+        return -EBADF;
+    return packet_do_recv(handle->sock, fd, &msg, 0);
+}
+
+static ssize_t packet_write_op(fd_t *fd, const void *buf, size_t offset,
+                               size_t count) {
+    socket_handle_t *handle = sockfs_file_handle(fd);
+    struct iovec iov = {.iov_base = (void *)buf, .len = count};
+
+    (void)offset;
+    if (!handle || !handle->sock)
+        return -EBADF;
+    return packet_do_send(handle->sock, NULL, &iov, 1);
+}
+
+static int packet_poll(fd_t *fd, size_t events) {
+    socket_handle_t *handle = sockfs_file_handle(fd);
+    packet_sock_t *sk;
+    int revents = 0;
+
+    if (!handle || !handle->sock)
+        return EPOLLERR;
+    sk = handle->sock;
+
+    spin_lock(&sk->lock);
+    if (sk->err)
+        revents |= EPOLLERR;
+    if (events & (EPOLLIN | EPOLLRDNORM)) {
+        bool readable = skb_queue_packets(&sk->queue) > 0;
+
+        if (sk->rx_ring.blocks) {
+            if (packet_rx_ring_expired_locked(sk, nano_time())) {
+                packet_rx_ring_retire_locked(sk, true);
+                sk->rx_ring.wake = false;
+            }
+            readable = readable || packet_rx_ring_readable_locked(sk);
+        }
+        if (readable)
+            revents |= EPOLLIN | EPOLLRDNORM;
+    }
+    if (events & (EPOLLOUT | EPOLLWRNORM)) {
+        bool writable = true;
+
+        if (sk->tx_ring.blocks) {
+            struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)packet_ring_frame(
+                &sk->tx_ring, sk->tx_ring.head);
+            writable = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) ==
+                       TP_STATUS_AVAILABLE;
+        }
+        if (writable)
+            revents |= EPOLLOUT | EPOLLWRNORM;
+    }
+    spin_unlock(&sk->lock);
+
+    return revents;
+}
+
+static int packet_ioctl(fd_t *fd, ssize_t cmd, ssize_t arg) {
+    socket_handle_t *handle = sockfs_file_handle(fd);
+    packet_sock_t *sk = handle ? handle->sock : NULL;
+
+    if (!sk)
+        return -EBADF;
+
+    switch (cmd & 0xFFFFFFFF) {
+    case FIONREAD: {
+        skb_buff_t *skb;
+        int value = 0;
+
+        if (!arg)
+            return -EFAULT;
+        spin_lock(&sk->lock);
+        skb = skb_queue_peek(&sk->queue);
+        if (skb)
+            value = (int)skb->len;
+        spin_unlock(&sk->lock);
+        if (copy_to_user((void *)arg, &value, sizeof(value)))
+            return -EFAULT;
+        return 0;
+    }
+    case FIONBIO:
+        return 0;
+    default:
+        return socket_netdev_ioctl(cmd, arg);
+    }
+}
+
+/* Maps the receive ring followed by the transmit ring, the layout libpcap
+ * and friends expect from a single mmap() at offset 0. */
+static void *packet_mmap(fd_t *fd, void *addr, size_t offset, size_t size,
+                         size_t prot, uint64_t flags) {
+    socket_handle_t *handle = sockfs_file_handle(fd);
+    packet_sock_t *sk = handle ? handle->sock : NULL;
+    packet_ring_t *rings[2];
+    uint64_t vaddr = (uint64_t)addr;
+    uint64_t expected;
+
+    (void)prot;
+    (void)flags;
+    if (!sk || !addr || !current_task || !current_task->mm)
+        return (void *)(int64_t)-EINVAL;
+    if (offset)
+        return (void *)(int64_t)-EINVAL;
+
+    spin_lock(&sk->lock);
+    rings[0] = &sk->rx_ring;
+    rings[1] = &sk->tx_ring;
+    expected = packet_ring_bytes(rings[0]) + packet_ring_bytes(rings[1]);
+    if (!expected || size != expected) {
+        spin_unlock(&sk->lock);
+        return (void *)(int64_t)-EINVAL;
+    }
+    /* Rings cannot change from here on, so the lock is not needed while
+     * the pages are being mapped. Once they are, their page references keep
+     * packet_set_ring() away until the last mapping of them is gone. */
+    sk->mapping++;
+    spin_unlock(&sk->lock);
+
+    for (int r = 0; r < 2; r++) {
+        packet_ring_t *ring = rings[r];
+
+        for (uint32_t i = 0; i < ring->block_nr; i++) {
+            if (map_page_range(task_mm_pgdir(current_task->mm), vaddr,
+                               ring->blocks[i], ring->block_size,
+                               PT_FLAG_R | PT_FLAG_W | PT_FLAG_U) != 0) {
+                /* The failed block may be partly mapped too. */
+                unmap_page_range(task_mm_pgdir(current_task->mm),
+                                 (uint64_t)addr, expected);
+                addr = (void *)(int64_t)-ENOMEM;
+                goto out;
+            }
+            vaddr += ring->block_size;
+        }
+    }
+out:
+    spin_lock(&sk->lock);
+    sk->mapping--;
+    spin_unlock(&sk->lock);
+    return addr;
+}
+
+static void packet_handle_release(socket_handle_t *handle) {
+    packet_sock_t *sk;
+
+    if (handle == NULL)
+        return;
+
+    sk = handle->sock;
+    if (sk != NULL) {
+        spin_lock(&packet_sockets_lock);
+        for (int i = 0; i < MAX_PACKET_SOCKETS; i++) {
+            if (packet_sockets[i] == sk) {
+                packet_sockets[i] = NULL;
+                break;
+            }
+        }
+        packet_fanout_leave_locked(sk);
+        packet_set_running_locked(sk, false);
+        spin_lock(&sk->lock);
+        sk->dying = true;
+        spin_unlock(&sk->lock);
+        spin_unlock(&packet_sockets_lock);
+
+        /* Unlinked, so no new tap can pick it; wait out the ones that did. */
+        while (__atomic_load_n(&sk->taps, __ATOMIC_ACQUIRE))
+            arch_pause();
+
+        cancel_delayed_work(&sk->retire_work);
+        flush_delayed_work(&sk->retire_work);
+
+        if (sk->node) {
+            vfs_node_t *node = sk->node;
+            sk->node = NULL;
+            vfs_iput(node);
+        }
+        skb_queue_purge(&sk->queue);
+        bpf_prog_free(sk->filter);
+        /* Pages still mapped into a process keep their own reference. */
+        packet_ring_free(&sk->rx_ring);
+        packet_ring_free(&sk->tx_ring);
+        free(sk);
+    }
+
+    free(handle);
+}
+
+int packet_socket(int domain, int type, int protocol) {
+    int sock_type = type & SOCK_TYPE_MASK;
+    packet_sock_t *sk;
+    socket_handle_t *handle;
+    struct vfs_file *file = NULL;
+    uint64_t flags = 0;
+    int slot = -1;
+    int ret;
+
+    if (domain != AF_PACKET)
+        return -EAFNOSUPPORT;
+    if (sock_type != SOCK_RAW && sock_type != SOCK_DGRAM)
+        return -ESOCKTNOSUPPORT;
+
+    sk = calloc(1, sizeof(*sk));
+    if (!sk)
+        return -ENOMEM;
+    sk->type = sock_type;
+    sk->protocol = ntohs((uint16_t)protocol);
+    sk->lock = SPIN_INIT;
+    sk->rcvbuf = PACKET_RCVBUF_DEFAULT;
+    sk->version = TPACKET_V1;
+    skb_queue_init(&sk->queue, sk->rcvbuf, packet_skb_meta_destroy);
+    init_delayed_work(&sk->retire_work, packet_retire_work);
+
+    handle = calloc(1, sizeof(socket_handle_t));
+    if (!handle) {
+        free(sk);
+        return -ENOMEM;
+    }
+    handle->op = &packet_ops;
+    handle->sock = sk;
+    handle->read_op = packet_read_op;
+    handle->write_op = packet_write_op;
+    handle->ioctl_op = packet_ioctl;
+    handle->poll_op = packet_poll;
+    handle->mmap_op = packet_mmap;
+    handle->release = packet_handle_release;
+
+    if (type & SOCK_NONBLOCK_FLAG)
+        flags |= O_NONBLOCK;
+
+    ret = sockfs_create_handle_file(handle, flags, &file);
+    if (ret < 0) {
+        free(handle);
+        free(sk);
+        return ret;
+    }
+    sk->node = vfs_igrab(file->f_inode);
+
+    spin_lock(&packet_sockets_lock);
+    for (int i = 0; i < MAX_PACKET_SOCKETS; i++) {
+        if (packet_sockets[i] == NULL) {
+            packet_sockets[i] = sk;
+            slot = i;
+            break;
+        }
+    }
+    if (slot >= 0)
+        packet_set_running_locked(sk, sk->protocol != 0);
+    spin_unlock(&packet_sockets_lock);
+
+    if (slot < 0) {
+        /* The file owns handle and sock now; dropping it releases both. */
+        vfs_file_put(file);
+        return -ENOMEM;
+    }
+
+    ret = task_install_file(current_task, file,
+                            (type & SOCK_CLOEXEC_FLAG) ? FD_CLOEXEC : 0, 0);
+    vfs_file_put(file);
+    return ret;
+}
+
+void packet_init() { regist_socket(AF_PACKET, NULL, packet_socket, NULL); }
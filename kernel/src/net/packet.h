@@ -0,0 +1,167 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <net/netdev.h>
+
+#define AF_PACKET 17
+#define PF_PACKET AF_PACKET
+#define SOL_PACKET 263
+
+#define ETH_P_ALL 0x0003
+#define ETH_P_IP 0x0800
+#define ETH_P_IPV6 0x86DD
+#define PACKET_ETH_HLEN 14
+
+/* sll_pkttype */
+#define PACKET_HOST 0
+#define PACKET_BROADCAST 1
+#define PACKET_MULTICAST 2
+#define PACKET_OTHERHOST 3
+#define PACKET_OUTGOING 4
+
+/* SOL_PACKET options */
+#define PACKET_ADD_MEMBERSHIP 1
+#define PACKET_DROP_MEMBERSHIP 2
+#define PACKET_RX_RING 5
+#define PACKET_STATISTICS 6
+#define PACKET_AUXDATA 8
+#define PACKET_VERSION 10
+#define PACKET_HDRLEN 11
+#define PACKET_RESERVE 12
+#define PACKET_TX_RING 13
+#define PACKET_FANOUT 18
+#define PACKET_IGNORE_OUTGOING 23
+
+#define PACKET_FANOUT_HASH 0
+#define PACKET_FANOUT_LB 1
+#define PACKET_FANOUT_CPU 2
+#define PACKET_FANOUT_ROLLOVER 3
+#define PACKET_FANOUT_RND 4
+#define PACKET_FANOUT_FLAG_ROLLOVER 0x1000
+
+enum tpacket_versions {
+    TPACKET_V1,
+    TPACKET_V2,
+    TPACKET_V3,
+};
+
+/* Receive ring block and frame status, owned by whoever holds the bit. */
+#define TP_STATUS_KERNEL 0
+#define TP_STATUS_USER (1 << 0)
+#define TP_STATUS_COPY (1 << 1)
+#define TP_STATUS_LOSING (1 << 2)
+#define TP_STATUS_CSUMNOTREADY (1 << 3)
+#define TP_STATUS_BLK_TMO (1 << 5)
+
+/* Transmit ring frame status. */
+#define TP_STATUS_AVAILABLE 0
+#define TP_STATUS_SEND_REQUEST (1 << 0)
+#define TP_STATUS_SENDING (1 << 1)
+#define TP_STATUS_WRONG_FORMAT (1 << 2)
+
+#define TPACKET_ALIGNMENT 16
+#define TPACKET_ALIGN(x)                                                       \
+    (((x) + TPACKET_ALIGNMENT - 1) & ~(TPACKET_ALIGNMENT - 1))
+
+struct sockaddr_ll {
+    uint16_t sll_family;
+    uint16_t sll_protocol;
+    int32_t sll_ifindex;
+    uint16_t sll_hatype;
+    uint8_t sll_pkttype;
+    uint8_t sll_halen;
+    uint8_t sll_addr[8];
+};
+
+struct tpacket_stats {
+    uint32_t tp_packets;
+    uint32_t tp_drops;
+};
+
+struct tpacket_stats_v3 {
+    uint32_t tp_packets;
+    uint32_t tp_drops;
+    uint32_t tp_freeze_q_cnt;
+};
+
+struct tpacket_auxdata {
+    uint32_t tp_status;
+    uint32_t tp_len;
+    uint32_t tp_snaplen;
+    uint16_t tp_mac;
+    uint16_t tp_net;
+    uint16_t tp_vlan_tci;
+    uint16_t tp_vlan_tpid;
+};
+
+struct tpacket_req3 {
+    uint32_t tp_block_size;
+    uint32_t tp_block_nr;
+    uint32_t tp_frame_size;
+    uint32_t tp_frame_nr;
+    uint32_t tp_retire_blk_tov; /* ms */
+    uint32_t tp_sizeof_priv;
+    uint32_t tp_feature_req_word;
+};
+
+struct tpacket_hdr_variant1 {
+    uint32_t tp_rxhash;
+    uint32_t tp_vlan_tci;
+    uint16_t tp_vlan_tpid;
+    uint16_t tp_padding;
+};
+
+struct tpacket3_hdr {
+    uint32_t tp_next_offset;
+    uint32_t tp_sec;
+    uint32_t tp_nsec;
+    uint32_t tp_snaplen;
+    uint32_t tp_len;
+    uint32_t tp_status;
+    uint16_t tp_mac;
+    uint16_t tp_net;
+    struct tpacket_hdr_variant1 hv1;
+    uint8_t tp_padding[8];
+};
+
+struct tpacket_bd_ts {
+    uint32_t ts_sec;
+    uint32_t ts_nsec;
+};
+
+struct tpacket_hdr_v1 {
+    uint32_t block_status;
+    uint32_t num_pkts;
+    uint32_t offset_to_first_pkt;
+    uint32_t blk_len;
+    uint64_t seq_num __attribute__((aligned(8)));
+    struct tpacket_bd_ts ts_first_pkt;
+    struct tpacket_bd_ts ts_last_pkt;
+};
+
+struct tpacket_block_desc {
+    uint32_t version;
+    uint32_t offset_to_priv;
+    struct tpacket_hdr_v1 hdr;
+};
+
+#define TPACKET3_HDRLEN                                                        \
+    (TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) + sizeof(struct sockaddr_ll))
+
+void packet_init();
+
+extern uint32_t packet_nr_running;
+
+void __packet_tap(netdev_t *dev, const netdev_frag_t *frags, uint32_t nr_frags,
+                  uint32_t len, bool outgoing);
+
+/*
+ * Hands a frame crossing the netdev layer to every AF_PACKET socket that
+ * wants it. The frame is copied before this returns, so callers keep
+ * ownership of the buffers; with no socket open it costs one load.
+ */
+static inline void packet_tap(netdev_t *dev, const netdev_frag_t *frags,
+                              uint32_t nr_frags, uint32_t len, bool outgoing) {
+    if (__atomic_load_n(&packet_nr_running, __ATOMIC_RELAXED))
+        __packet_tap(dev, frags, nr_frags, len, outgoing);
+}
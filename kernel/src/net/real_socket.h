@@ -13,6 +13,7 @@ struct sockaddr_un {
 };
 
 struct msghdr;
+struct iovec;
 
 typedef struct socket_op {
     uint64_t (*shutdown)(uint64_t fd, uint64_t how);
@@ -46,6 +47,24 @@ typedef struct socket_handle {
     ssize_t (*write_op)(fd_t *fd, const void *buf, size_t offset, size_t limit);
     int (*ioctl_op)(fd_t *fd, ssize_t cmd, ssize_t arg);
     int (*poll_op)(fd_t *fd, size_t events);
+    void *(*mmap_op)(fd_t *fd, void *addr, size_t offset, size_t size,
+                     size_t prot, uint64_t flags);
+    /*
+     * Queues len bytes at offset inside the frame at page without copying
+     * them; the transport takes its own frame reference for as long as it
+     * needs the data. Optional, sockfs_sendpage() copies through write_op
+     * when it is missing.
+     */
+    ssize_t (*sendpage_op)(fd_t *fd, uint64_t page, size_t offset,
+                           size_t len, int flags);
+    /*
+     * MSG_ZEROCOPY send of user memory: iov holds the caller's own
+     * addresses, and the transport pins the pages behind them rather than
+     * being handed a kernel copy. Returns -EOPNOTSUPP to have the syscall
+     * copy as usual. Optional.
+     */
+    ssize_t (*sendmsg_zerocopy_op)(fd_t *fd, const struct iovec *iov,
+                                   size_t iovlen, int flags);
     void (*release)(struct socket_handle *handle);
 } socket_handle_t;
 
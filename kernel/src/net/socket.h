@@ -70,6 +70,14 @@ typedef struct unix_socket_ancillary {
     bool has_timestamp;
 } unix_socket_ancillary_t;
 
+/* Free frames kept per socket for page-backed stream skbs. */
+#define UNIX_SOCKET_PAGE_POOL_SIZE 16
+
+/* MSG_ZEROCOPY sends shorter than this are copied and reported as such. */
+#define UNIX_SOCKET_ZEROCOPY_MIN (16 * 1024)
+
+struct unix_socket_errqueue;
+
 typedef struct socket {
     struct socket *next;
     struct socket *bind_next;
@@ -127,12 +135,25 @@ typedef struct socket {
     struct linger linger_opt;
     struct sock_filter *filter;
     size_t filter_len;
+
+    // 流式接收页池 (page-backed skb 使用)
+    spinlock_t page_pool_lock;
+    uint32_t page_pool_count;
+    uint64_t page_pool[UNIX_SOCKET_PAGE_POOL_SIZE];
+
+    // MSG_ZEROCOPY
+    int zerocopy;
+    uint32_t zc_next_id;
+    struct unix_socket_errqueue *errqueue;
 } socket_t;
 
 int sockfs_create_handle_file(socket_handle_t *handle, unsigned int open_flags,
                               struct vfs_file **out_file);
 socket_handle_t *sockfs_file_handle(fd_t *file);
 socket_handle_t *sockfs_inode_socket_handle(vfs_node_t *node);
+ssize_t sockfs_sendpage(struct vfs_file *file, uint64_t page, size_t offset,
+                        size_t len, int flags);
+int socket_netdev_ioctl(ssize_t cmd, ssize_t arg);
 
 // 套接字层级
 #define SOL_SOCKET 1
@@ -298,6 +319,27 @@ struct msghdr {
     int msg_flags;
 };
 
+/* MSG_ERRQUEUE payload, delivered as an IP_RECVERR control message. */
+struct sock_extended_err {
+    uint32_t ee_errno;
+    uint8_t ee_origin;
+    uint8_t ee_type;
+    uint8_t ee_code;
+    uint8_t ee_pad;
+    uint32_t ee_info;
+    uint32_t ee_data;
+};
+
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+
+#ifndef SOL_IP
+#define SOL_IP 0
+#endif
+#ifndef IP_RECVERR
+#define IP_RECVERR 11
+#endif
+
 struct mmsghdr {
     struct msghdr msg_hdr;
     unsigned int msg_len;
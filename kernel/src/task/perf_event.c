@@ -0,0 +1,1916 @@
+#include <arch/arch.h>
+#include <drivers/deadline.h>
+#include <fs/fs_syscall.h>
+#include <fs/vfs/vfs.h>
+#include <irq/softirq.h>
+#include <mm/mm.h>
+#include <mm/mm_syscall.h>
+#include <mm/vma.h>
+#include <task/perf_event.h>
+#include <task/task.h>
+
+#define PERFEVENTFS_MAGIC 0x70657266ULL
+
+#define PERF_SAMPLE_SUPPORTED                                                  \
+    (PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_ADDR |  \
+     PERF_SAMPLE_READ | PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_ID |               \
+     PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD | PERF_SAMPLE_STREAM_ID |            \
+     PERF_SAMPLE_IDENTIFIER)
+#define PERF_FORMAT_SUPPORTED                                                  \
+    (PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING |         \
+     PERF_FORMAT_ID | PERF_FORMAT_LOST)
+#define PERF_READ_MAX 5
+#define PERF_COMM_LEN 16
+
+/*
+ * Shared by every event that writes here: the one mmap() created it for
+ * and any redirected to it with PERF_EVENT_IOC_SET_OUTPUT.
+ */
+typedef struct perf_buffer {
+    int refcount;
+    struct llist_header events; // perf_event_t.rb_node
+    struct perf_event_mmap_page *user_page;
+    uint64_t user_paddr;
+    uint8_t *data;
+    uint64_t data_paddr;
+    uint64_t nr_pages; // data pages, a power of two
+    uint64_t size;
+    uint64_t head;
+    uint64_t wakeup_head; // head at the last wakeup
+    uint64_t watermark;   // bytes between wakeups
+    uint32_t wakeup_events;
+    uint32_t nr_samples; // since the last wakeup
+    uint64_t lost;       // records dropped since the last LOST record
+    uint64_t lost_id;
+    uint32_t poll; // EPOLL* bits not handed out by poll() yet
+    bool overwrite; // mapped read-only, data_tail is never written
+    bool paused;
+} perf_buffer_t;
+
+typedef struct perf_event perf_event_t;
+
+struct perf_event {
+    struct perf_event_attr attr;
+    uint64_t id;
+    task_t *task; // NULL for CPU-wide events and once the task exited
+    int cpu;      // -1 follows the task to every CPU
+    struct llist_header node; // task->perf_events or perf_cpu_events[cpu]
+    bool attached;
+    perf_event_t *parent; // inherited copies count and write for it
+    struct llist_header children;
+    struct llist_header child_node;
+    perf_buffer_t *rb;
+    struct llist_header rb_node;
+    bool rb_mapped; // rb came from mmap() on this event, not SET_OUTPUT
+    struct vfs_inode *inode; // NULL for inherited copies
+    struct llist_header wakeup_node;
+    bool wakeup_queued;
+    bool enabled;
+    bool exited;
+    uint64_t count;
+    uint64_t child_count; // folded in from inherited copies that exited
+    uint64_t time_active;
+    uint64_t child_time_active;
+    uint64_t active_since; // 0 while not counting
+    uint64_t period;       // 0 when only counting
+    uint64_t period_left;  // events until the next sample
+    uint64_t sample_next;  // clock count due for the next sample
+    uint64_t sample_last;
+    uint64_t lost_samples;
+};
+
+/* Where a sample was taken and on whose behalf. */
+typedef struct perf_sample_ctx {
+    task_t *task;
+    uint64_t ip;
+    uint64_t fp;
+    bool user;
+    uint64_t addr;
+    uint64_t period;
+} perf_sample_ctx_t;
+
+typedef struct perf_output {
+    perf_buffer_t *rb;
+    uint64_t head;
+} perf_output_t;
+
+typedef struct perf_mmap_info {
+    task_t *task;
+    uint64_t start;
+    uint64_t len;
+    uint64_t pgoff;
+    uint32_t maj;
+    uint32_t min;
+    uint64_t ino;
+    uint32_t prot;
+    uint32_t flags;
+    const char *name;
+    bool exec;
+} perf_mmap_info_t;
+
+typedef struct perf_task_info {
+    task_t *task;
+    task_t *parent;
+    bool fork;
+} perf_task_info_t;
+
+typedef struct perf_comm_info {
+    task_t *task;
+    const char *comm;
+} perf_comm_info_t;
+
+/*
+ * One lock for every event, buffer and list: it is taken with interrupts
+ * off from the timer tick, the context switch and the fault path, and
+ * nests inside task_queue_lock and a vma manager's lock.
+ */
+static spinlock_t perf_lock = SPIN_INIT;
+static uint64_t perf_nr_events;
+static uint64_t perf_next_id;
+static struct llist_header perf_cpu_events[MAX_CPU_NUM];
+static task_t *perf_cpu_curr[MAX_CPU_NUM];
+static deadline_source_t perf_deadline_sources[MAX_CPU_NUM];
+static DEFINE_LLIST(perf_wakeup_list);
+static uint64_t perf_callchain[PERF_MAX_STACK_DEPTH + 2];
+
+static struct vfs_file_system_type perfeventfs_fs_type;
+static const struct vfs_super_operations perfeventfs_super_ops;
+static const struct vfs_file_operations perfeventfs_dir_file_ops;
+static const struct vfs_file_operations perfeventfs_file_ops;
+static spinlock_t perfeventfs_mount_lock;
+static struct vfs_mount *perfeventfs_internal_mnt;
+static spinlock_t perfeventfs_ino_lock;
+static ino64_t perfeventfs_next_ino = 1;
+
+static inline bool perf_active(void) {
+    return __atomic_load_n(&perf_nr_events, __ATOMIC_ACQUIRE) != 0;
+}
+
+static inline bool perf_is_clock(const struct perf_event_attr *attr) {
+    return attr->type == PERF_TYPE_SOFTWARE &&
+           (attr->config == PERF_COUNT_SW_CPU_CLOCK ||
+            attr->config == PERF_COUNT_SW_TASK_CLOCK);
+}
+
+static inline perf_event_t *perf_primary(perf_event_t *event) {
+    return event->parent ? event->parent : event;
+}
+
+static inline perf_buffer_t *perf_event_rb(perf_event_t *event) {
+    return perf_primary(event)->rb;
+}
+
+static inline uint32_t perf_task_pid(task_t *task) {
+    return task ? (uint32_t)task_effective_tgid(task) : (uint32_t)-1;
+}
+
+static inline uint32_t perf_task_tid(task_t *task) {
+    return task ? (uint32_t)task->pid : (uint32_t)-1;
+}
+
+/* Counting and time keeping */
+
+static void perf_event_update_locked(perf_event_t *event, uint64_t now) {
+    uint64_t delta;
+
+    if (!event->active_since)
+        return;
+
+    delta = now > event->active_since ? now - event->active_since : 0;
+    event->time_active += delta;
+    if (perf_is_clock(&event->attr))
+        event->count += delta;
+    event->active_since = now;
+}
+
+static void perf_event_sched_in_locked(perf_event_t *event, uint32_t cpu,
+                                       uint64_t now) {
+    if (!event->enabled || event->active_since)
+        return;
+    if (event->cpu >= 0 && (uint32_t)event->cpu != cpu)
+        return;
+    event->active_since = now ? now : 1;
+}
+
+static void perf_event_sched_out_locked(perf_event_t *event, uint64_t now) {
+    perf_event_update_locked(event, now);
+    event->active_since = 0;
+}
+
+static int perf_task_cpu_locked(task_t *task) {
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        if (__atomic_load_n(&perf_cpu_curr[cpu], __ATOMIC_ACQUIRE) == task)
+            return (int)cpu;
+    }
+    return -1;
+}
+
+static uint64_t perf_event_due_locked(perf_event_t *event, uint64_t now) {
+    uint64_t count;
+
+    if (!event->active_since || !event->period ||
+        !perf_is_clock(&event->attr))
+        return UINT64_MAX;
+
+    count = event->count +
+            (now > event->active_since ? now - event->active_since : 0);
+    return count >= event->sample_next ? now
+                                       : now + (event->sample_next - count);
+}
+
+/*
+ * Points this CPU's deadline at the next clock sample due on it, or at a
+ * short delay while readers are still waiting to be woken.
+ */
+static void perf_cpu_rearm_locked(uint32_t cpu, uint64_t now) {
+    uint64_t next = UINT64_MAX;
+    task_t *curr;
+    perf_event_t *event, *tmp;
+
+    if (cpu >= MAX_CPU_NUM)
+        return;
+
+    curr = __atomic_load_n(&perf_cpu_curr[cpu], __ATOMIC_ACQUIRE);
+    if (curr) {
+        llist_for_each(event, tmp, &curr->perf_events, node) {
+            next = MIN(next, perf_event_due_locked(event, now));
+        }
+    }
+    llist_for_each(event, tmp, &perf_cpu_events[cpu], node) {
+        next = MIN(next, perf_event_due_locked(event, now));
+    }
+    if (!llist_empty(&perf_wakeup_list))
+        next = MIN(next, now + PERF_WAKEUP_DELAY_NS);
+
+    deadline_source_update(&perf_deadline_sources[cpu], next);
+}
+
+static void perf_event_set_period_locked(perf_event_t *event) {
+    const struct perf_event_attr *attr = &event->attr;
+    uint64_t period = attr->sample_period;
+
+    if (attr->type != PERF_TYPE_SOFTWARE ||
+        attr->config == PERF_COUNT_SW_DUMMY) {
+        period = 0;
+    } else if (attr->freq) {
+        period = perf_is_clock(attr)
+                     ? MAX(1000000000ULL / attr->sample_freq,
+                           PERF_MIN_CLOCK_PERIOD_NS)
+                     : 1;
+    } else if (perf_is_clock(attr) && period) {
+        period = MAX(period, PERF_MIN_CLOCK_PERIOD_NS);
+    }
+
+    event->period = period;
+    event->period_left = period;
+    event->sample_last = event->count;
+    event->sample_next = event->count + period;
+}
+
+static void perf_event_enable_locked(perf_event_t *event, uint64_t now) {
+    int cpu;
+
+    if (event->enabled || event->exited)
+        return;
+
+    event->enabled = true;
+    if (!event->attached)
+        return;
+
+    cpu = event->task ? perf_task_cpu_locked(event->task) : event->cpu;
+    if (cpu < 0)
+        return;
+    perf_event_sched_in_locked(event, (uint32_t)cpu, now);
+    perf_cpu_rearm_locked((uint32_t)cpu, now);
+}
+
+static void perf_event_disable_locked(perf_event_t *event, uint64_t now) {
+    if (!event->enabled)
+        return;
+    perf_event_sched_out_locked(event, now);
+    event->enabled = false;
+}
+
+static size_t perf_read_values_locked(perf_event_t *event, uint64_t format,
+                                      uint64_t now, uint64_t *values,
+                                      bool children) {
+    uint64_t count, time;
+    size_t n = 0;
+
+    perf_event_update_locked(event, now);
+    count = event->count;
+    time = event->time_active;
+    if (children) {
+        perf_event_t *child, *tmp;
+
+        count += event->child_count;
+        time += event->child_time_active;
+        llist_for_each(child, tmp, &event->children, child_node) {
+            perf_event_update_locked(child, now);
+            count += child->count;
+            time += child->time_active;
+        }
+    }
+
+    values[n++] = count;
+    if (format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+        values[n++] = time;
+    if (format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+        values[n++] = time;
+    if (format & PERF_FORMAT_ID)
+        values[n++] = perf_primary(event)->id;
+    if (format & PERF_FORMAT_LOST)
+        values[n++] = event->lost_samples;
+    return n;
+}
+
+/* Wakeups */
+
+static void perf_event_wakeup_locked(perf_event_t *event) {
+    if (!event->inode || event->wakeup_queued)
+        return;
+    event->wakeup_queued = true;
+    llist_append(&perf_wakeup_list, &event->wakeup_node);
+}
+
+static void perf_rb_wakeup_locked(perf_buffer_t *rb) {
+    perf_event_t *event, *tmp;
+
+    rb->poll |= EPOLLIN | EPOLLRDNORM;
+    llist_for_each(event, tmp, &rb->events, rb_node) {
+        perf_event_wakeup_locked(event);
+    }
+}
+
+/* Arms the deadline that gets perf_event_tick() to raise SOFTIRQ_PERF. */
+static void perf_kick_locked(uint64_t now) {
+    if (!llist_empty(&perf_wakeup_list))
+        perf_cpu_rearm_locked(current_cpu_id, now);
+}
+
+static void perf_softirq(void) {
+    while (true) {
+        perf_event_t *event;
+        struct vfs_inode *node;
+        uint32_t events;
+
+        spin_lock(&perf_lock);
+        if (llist_empty(&perf_wakeup_list)) {
+            spin_unlock(&perf_lock);
+            return;
+        }
+        event = list_entry(perf_wakeup_list.next, perf_event_t, wakeup_node);
+        llist_delete(&event->wakeup_node);
+        event->wakeup_queued = false;
+        node = vfs_igrab(event->inode);
+        events = event->rb ? event->rb->poll : 0;
+        if (event->exited)
+            events |= EPOLLHUP;
+        spin_unlock(&perf_lock);
+
+        if (!node)
+            continue;
+        vfs_poll_notify_inode(node, events ? events : EPOLLIN | EPOLLRDNORM);
+        vfs_iput(node);
+    }
+}
+
+/* Ring buffer output */
+
+static perf_buffer_t *perf_buffer_alloc(uint64_t nr_pages,
+                                        const struct perf_event_attr *attr,
+                                        bool overwrite) {
+    perf_buffer_t *rb = calloc(1, sizeof(*rb));
+
+    if (!rb)
+        return NULL;
+
+    rb->user_paddr = alloc_frames(1);
+    if (!rb->user_paddr) {
+        free(rb);
+        return NULL;
+    }
+    if (nr_pages) {
+        rb->data_paddr = alloc_frames(nr_pages);
+        if (!rb->data_paddr) {
+            free_frames(rb->user_paddr, 1);
+            free(rb);
+            return NULL;
+        }
+        rb->data = phys_to_virt(rb->data_paddr);
+        memset(rb->data, 0, nr_pages * PAGE_SIZE);
+    }
+
+    rb->user_page = phys_to_virt(rb->user_paddr);
+    memset(rb->user_page, 0, PAGE_SIZE);
+    rb->nr_pages = nr_pages;
+    rb->size = nr_pages * PAGE_SIZE;
+    rb->user_page->size = sizeof(*rb->user_page);
+    rb->user_page->data_offset = PAGE_SIZE;
+    rb->user_page->data_size = rb->size;
+    rb->overwrite = overwrite;
+    llist_init_head(&rb->events);
+
+    rb->watermark = rb->size / 2;
+    if (attr->watermark) {
+        if (attr->wakeup_watermark)
+            rb->watermark = MIN((uint64_t)attr->wakeup_watermark, rb->size);
+    } else {
+        rb->wakeup_events = attr->wakeup_events;
+    }
+    return rb;
+}
+
+/* Pages still mapped into a process keep their own reference. */
+static void perf_buffer_free(perf_buffer_t *rb) {
+    if (!rb)
+        return;
+    if (rb->nr_pages)
+        free_frames(rb->data_paddr, rb->nr_pages);
+    free_frames(rb->user_paddr, 1);
+    free(rb);
+}
+
+/* Returns the old buffer when this was its last user. */
+static perf_buffer_t *perf_event_set_rb_locked(perf_event_t *event,
+                                               perf_buffer_t *rb) {
+    perf_buffer_t *old = event->rb;
+
+    if (old == rb)
+        return NULL;
+    if (old) {
+        llist_delete(&event->rb_node);
+        if (--old->refcount > 0)
+            old = NULL;
+    }
+    event->rb = rb;
+    event->rb_mapped = false;
+    if (rb) {
+        rb->refcount++;
+        llist_append(&rb->events, &event->rb_node);
+    }
+    return old;
+}
+
+static size_t perf_sample_id_size(const perf_event_t *event) {
+    uint64_t type = event->attr.sample_type;
+    size_t size = 0;
+
+    if (!event->attr.sample_id_all)
+        return 0;
+    if (type & PERF_SAMPLE_TID)
+        size += 8;
+    if (type & PERF_SAMPLE_TIME)
+        size += 8;
+    if (type & PERF_SAMPLE_ID)
+        size += 8;
+    if (type & PERF_SAMPLE_STREAM_ID)
+        size += 8;
+    if (type & PERF_SAMPLE_CPU)
+        size += 8;
+    if (type & PERF_SAMPLE_IDENTIFIER)
+        size += 8;
+    return size;
+}
+
+static void perf_output_put(perf_output_t *out, const void *src, size_t len) {
+    perf_buffer_t *rb = out->rb;
+    const uint8_t *in = src;
+
+    while (len) {
+        uint64_t off = out->head & (rb->size - 1);
+        size_t chunk = MIN(len, rb->size - off);
+
+        memcpy(rb->data + off, in, chunk);
+        out->head += chunk;
+        in += chunk;
+        len -= chunk;
+    }
+}
+
+static inline void perf_output_u64(perf_output_t *out, uint64_t value) {
+    perf_output_put(out, &value, sizeof(value));
+}
+
+static inline void perf_output_u32x2(perf_output_t *out, uint32_t lo,
+                                     uint32_t hi) {
+    uint32_t pair[2] = {lo, hi};
+    perf_output_put(out, pair, sizeof(pair));
+}
+
+static void perf_output_sample_id(perf_output_t *out, perf_event_t *event,
+                                  task_t *task, uint64_t now) {
+    uint64_t type = event->attr.sample_type;
+
+    if (!event->attr.sample_id_all)
+        return;
+    if (type & PERF_SAMPLE_TID)
+        perf_output_u32x2(out, perf_task_pid(task), perf_task_tid(task));
+    if (type & PERF_SAMPLE_TIME)
+        perf_output_u64(out, now);
+    if (type & PERF_SAMPLE_ID)
+        perf_output_u64(out, perf_primary(event)->id);
+    if (type & PERF_SAMPLE_STREAM_ID)
+        perf_output_u64(out, event->id);
+    if (type & PERF_SAMPLE_CPU)
+        perf_output_u32x2(out, current_cpu_id, 0);
+    if (type & PERF_SAMPLE_IDENTIFIER)
+        perf_output_u64(out, perf_primary(event)->id);
+}
+
+/*
+ * Reserves size bytes, writing a LOST record first when earlier records
+ * were dropped. A full buffer drops the record and counts it instead.
+ */
+static bool perf_output_begin_locked(perf_output_t *out, perf_event_t *event,
+                                     task_t *task, size_t size,
+                                     uint64_t now) {
+    perf_buffer_t *rb = perf_event_rb(event);
+    size_t lost_size = 0;
+    uint64_t space;
+
+    if (!rb || !rb->size || rb->paused)
+        return false;
+
+    if (rb->lost)
+        lost_size = sizeof(struct perf_event_header) + 16 +
+                    perf_sample_id_size(event);
+
+    space = rb->size;
+    if (!rb->overwrite) {
+        uint64_t tail =
+            __atomic_load_n(&rb->user_page->data_tail, __ATOMIC_ACQUIRE);
+        uint64_t used = rb->head - tail;
+
+        space = used < rb->size ? rb->size - used : 0;
+    }
+    if (lost_size + size > space) {
+        if (!rb->lost)
+            rb->lost_id = perf_primary(event)->id;
+        rb->lost++;
+        return false;
+    }
+
+    out->rb = rb;
+    out->head = rb->head;
+    if (rb->lost) {
+        struct perf_event_header header = {
+            .type = PERF_RECORD_LOST,
+            .size = (uint16_t)lost_size,
+        };
+
+        perf_output_put(out, &header, sizeof(header));
+        perf_output_u64(out, rb->lost_id);
+        perf_output_u64(out, rb->lost);
+        perf_output_sample_id(out, event, task, now);
+        rb->lost = 0;
+    }
+    return true;
+}
+
+static void perf_output_end_locked(perf_output_t *out, bool sample) {
+    perf_buffer_t *rb = out->rb;
+
+    rb->head = out->head;
+    __atomic_store_n(&rb->user_page->data_head, rb->head, __ATOMIC_RELEASE);
+
+    if (sample)
+        rb->nr_samples++;
+    if ((rb->wakeup_events && rb->nr_samples >= rb->wakeup_events) ||
+        rb->head - rb->wakeup_head >= rb->watermark) {
+        rb->nr_samples = 0;
+        rb->wakeup_head = rb->head;
+        perf_rb_wakeup_locked(rb);
+    }
+}
+
+/* Samples and callchains */
+
+static bool perf_kernel_stack_ok(task_t *task, uint64_t addr) {
+    uint64_t base;
+
+    if (!task)
+        return false;
+
+    base = (uint64_t)task->kernel_stack_base;
+    if (base && addr >= base && addr + sizeof(uint64_t) <= task->kernel_stack)
+        return true;
+    base = (uint64_t)task->syscall_stack_base;
+    return base && addr >= base &&
+           addr + sizeof(uint64_t) <= task->syscall_stack;
+}
+
+/* Never faults: user words are read through the page tables. */
+static bool perf_read_word(task_t *task, uint64_t addr, bool user,
+                           uint64_t *value) {
+    if (addr & (sizeof(uint64_t) - 1))
+        return false;
+
+    if (user) {
+        uint64_t pa = user_translate_no_fault(get_current_page_dir(true),
+                                              addr, false);
+        if (!pa)
+            return false;
+        *value = *(uint64_t *)user_virt_from_paddr(pa);
+        return true;
+    }
+
+    if (!perf_kernel_stack_ok(task, addr))
+        return false;
+    *value = *(uint64_t *)addr;
+    return true;
+}
+
+static size_t perf_unwind(task_t *task, uint64_t fp, bool user, uint64_t *ips,
+                          size_t max) {
+    int64_t link_off = arch_perf_frame_link_offset();
+    int64_t ret_off = arch_perf_frame_ret_offset();
+    size_t nr = 0;
+
+    while (nr < max && fp) {
+        uint64_t next_fp, ret;
+
+        if (!perf_read_word(task, fp + link_off, user, &next_fp) ||
+            !perf_read_word(task, fp + ret_off, user, &ret) || !ret)
+            break;
+        ips[nr++] = ret;
+        if (next_fp <= fp)
+            break;
+        fp = next_fp;
+    }
+    return nr;
+}
+
+/*
+ * Frame-pointer walk of the sampled context. A sample taken in the kernel
+ * on behalf of the running task also gets the user part, from the frame
+ * saved on its syscall stack at kernel entry.
+ */
+static size_t perf_callchain_locked(perf_event_t *event,
+                                    const perf_sample_ctx_t *ctx,
+                                    uint64_t *ips) {
+    size_t max = event->attr.sample_max_stack ? event->attr.sample_max_stack
+                                              : PERF_MAX_STACK_DEPTH;
+    task_t *task = ctx->task;
+    size_t nr = 0, depth = 0;
+
+    if (!ctx->user && !event->attr.exclude_callchain_kernel && max) {
+        ips[nr++] = PERF_CONTEXT_KERNEL;
+        ips[nr++] = ctx->ip;
+        depth = 1 + perf_unwind(task, ctx->fp, false, ips + nr, max - 1);
+        nr += depth - 1;
+    }
+
+    if (!event->attr.exclude_callchain_user && depth < max && task &&
+        task == current_task && !task->is_kernel) {
+        uint64_t ip = ctx->ip, fp = ctx->fp;
+        bool have = ctx->user;
+
+        if (!have && task->syscall_stack) {
+            struct pt_regs *uregs = (struct pt_regs *)task->syscall_stack - 1;
+
+            if (arch_perf_user_mode(uregs)) {
+                ip = arch_perf_instruction_pointer(uregs);
+                fp = arch_perf_frame_pointer(uregs);
+                have = true;
+            }
+        }
+        if (have) {
+            ips[nr++] = PERF_CONTEXT_USER;
+            ips[nr++] = ip;
+            nr += perf_unwind(task, fp, true, ips + nr, max - depth - 1);
+        }
+    }
+    return nr;
+}
+
+static bool perf_exclude_locked(perf_event_t *event,
+                                const perf_sample_ctx_t *ctx) {
+    uint32_t cpu = current_cpu_id;
+
+    if (ctx->user ? event->attr.exclude_user : event->attr.exclude_kernel)
+        return true;
+    return event->attr.exclude_idle && cpu < MAX_CPU_NUM &&
+           ctx->task == idle_tasks[cpu];
+}
+
+static void perf_output_sample_locked(perf_event_t *event,
+                                      const perf_sample_ctx_t *ctx) {
+    uint64_t type = event->attr.sample_type;
+    perf_event_t *primary = perf_primary(event);
+    struct perf_event_header header;
+    uint64_t values[PERF_READ_MAX];
+    size_t nr_values = 0, nr_ips = 0;
+    uint64_t now = nano_time();
+    perf_output_t out;
+    size_t size = sizeof(header);
+
+    if (perf_exclude_locked(event, ctx))
+        return;
+
+    if (type & PERF_SAMPLE_IDENTIFIER)
+        size += 8;
+    if (type & PERF_SAMPLE_IP)
+        size += 8;
+    if (type & PERF_SAMPLE_TID)
+        size += 8;
+    if (type & PERF_SAMPLE_TIME)
+        size += 8;
+    if (type & PERF_SAMPLE_ADDR)
+        size += 8;
+    if (type & PERF_SAMPLE_ID)
+        size += 8;
+    if (type & PERF_SAMPLE_STREAM_ID)
+        size += 8;
+    if (type & PERF_SAMPLE_CPU)
+        size += 8;
+    if (type & PERF_SAMPLE_PERIOD)
+        size += 8;
+    if (type & PERF_SAMPLE_READ) {
+        nr_values = perf_read_values_locked(event, event->attr.read_format,
+                                            now, values, false);
+        size += nr_values * sizeof(uint64_t);
+    }
+    if (type & PERF_SAMPLE_CALLCHAIN) {
+        nr_ips = perf_callchain_locked(event, ctx, perf_callchain);
+        size += (1 + nr_ips) * sizeof(uint64_t);
+    }
+
+    if (!perf_output_begin_locked(&out, event, ctx->task, size, now)) {
+        event->lost_samples++;
+        return;
+    }
+
+    header.type = PERF_RECORD_SAMPLE;
+    header.misc = ctx->user ? PERF_RECORD_MISC_USER : PERF_RECORD_MISC_KERNEL;
+    header.size = (uint16_t)size;
+    perf_output_put(&out, &header, sizeof(header));
+    if (type & PERF_SAMPLE_IDENTIFIER)
+        perf_output_u64(&out, primary->id);
+    if (type & PERF_SAMPLE_IP)
+        perf_output_u64(&out, ctx->ip);
+    if (type & PERF_SAMPLE_TID)
+        perf_output_u32x2(&out, perf_task_pid(ctx->task),
+                          perf_task_tid(ctx->task));
+    if (type & PERF_SAMPLE_TIME)
+        perf_output_u64(&out, now);
+    if (type & PERF_SAMPLE_ADDR)
+        perf_output_u64(&out, ctx->addr);
+    if (type & PERF_SAMPLE_ID)
+        perf_output_u64(&out, primary->id);
+    if (type & PERF_SAMPLE_STREAM_ID)
+        perf_output_u64(&out, event->id);
+    if (type & PERF_SAMPLE_CPU)
+        perf_output_u32x2(&out, current_cpu_id, 0);
+    if (type & PERF_SAMPLE_PERIOD)
+        perf_output_u64(&out, ctx->period);
+    if (type & PERF_SAMPLE_READ)
+        perf_output_put(&out, values, nr_values * sizeof(uint64_t));
+    if (type & PERF_SAMPLE_CALLCHAIN) {
+        perf_output_u64(&out, nr_ips);
+        perf_output_put(&out, perf_callchain, nr_ips * sizeof(uint64_t));
+    }
+    perf_output_end_locked(&out, true);
+}
+
+static void perf_sample_ctx_from_regs(perf_sample_ctx_t *ctx,
+                                      struct pt_regs *regs) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->task = current_task;
+    ctx->ip = arch_perf_instruction_pointer(regs);
+    ctx->fp = arch_perf_frame_pointer(regs);
+    ctx->user = arch_perf_user_mode(regs);
+}
+
+/* Software counters: one event happened at ctx. */
+static void perf_swevent_locked(perf_event_t *event, uint64_t config,
+                                perf_sample_ctx_t *ctx) {
+    if (event->attr.type != PERF_TYPE_SOFTWARE ||
+        event->attr.config != config || !event->active_since)
+        return;
+    if (perf_exclude_locked(event, ctx))
+        return;
+
+    event->count++;
+    if (!event->period || --event->period_left)
+        return;
+    event->period_left = event->period;
+    ctx->period = event->period;
+    perf_output_sample_locked(event, ctx);
+}
+
+static void perf_swevent_all_locked(task_t *task, uint32_t cpu,
+                                    uint64_t config, perf_sample_ctx_t *ctx) {
+    perf_event_t *event, *tmp;
+
+    if (task) {
+        llist_for_each(event, tmp, &task->perf_events, node) {
+            perf_swevent_locked(event, config, ctx);
+        }
+    }
+    if (cpu < MAX_CPU_NUM) {
+        llist_for_each(event, tmp, &perf_cpu_events[cpu], node) {
+            perf_swevent_locked(event, config, ctx);
+        }
+    }
+}
+
+static void perf_clock_tick_locked(perf_event_t *event,
+                                   perf_sample_ctx_t *ctx, uint64_t now) {
+    if (!perf_is_clock(&event->attr) || !event->active_since)
+        return;
+
+    perf_event_update_locked(event, now);
+    if (!event->period || event->count < event->sample_next)
+        return;
+
+    ctx->period = event->count - event->sample_last;
+    event->sample_last = event->count;
+    event->sample_next = event->count + event->period;
+    perf_output_sample_locked(event, ctx);
+}
+
+/* Side-band records */
+
+typedef void (*perf_sideband_fn_t)(perf_event_t *event, const void *data,
+                                   uint64_t now);
+
+/* Enabled events of task and of the current CPU get the record. */
+static void perf_sideband_locked(task_t *task, perf_sideband_fn_t output,
+                                 const void *data, uint64_t now) {
+    uint32_t cpu = current_cpu_id;
+    perf_event_t *event, *tmp;
+
+    if (task) {
+        llist_for_each(event, tmp, &task->perf_events, node) {
+            if (event->enabled)
+                output(event, data, now);
+        }
+    }
+    if (cpu < MAX_CPU_NUM) {
+        llist_for_each(event, tmp, &perf_cpu_events[cpu], node) {
+            if (event->enabled)
+                output(event, data, now);
+        }
+    }
+}
+
+static void perf_output_mmap(perf_event_t *event, const void *data,
+                             uint64_t now) {
+    const perf_mmap_info_t *info = data;
+    struct perf_event_header header;
+    size_t name_len = strlen(info->name) + 1;
+    size_t name_size = PADDING_UP(name_len, sizeof(uint64_t));
+    bool mmap2 = event->attr.mmap2;
+    perf_output_t out;
+    size_t size;
+
+    if (info->exec ? !(event->attr.mmap || mmap2) : !event->attr.mmap_data)
+        return;
+
+    size = sizeof(header) + 8 + 24 + (mmap2 ? 32 : 0) + name_size +
+           perf_sample_id_size(event);
+    if (size > UINT16_MAX ||
+        !perf_output_begin_locked(&out, event, info->task, size, now))
+        return;
+
+    header.type = mmap2 ? PERF_RECORD_MMAP2 : PERF_RECORD_MMAP;
+    header.misc = PERF_RECORD_MISC_USER |
+                  (info->exec ? 0 : PERF_RECORD_MISC_MMAP_DATA);
+    header.size = (uint16_t)size;
+    perf_output_put(&out, &header, sizeof(header));
+    perf_output_u32x2(&out, perf_task_pid(info->task),
+                      perf_task_tid(info->task));
+    perf_output_u64(&out, info->start);
+    perf_output_u64(&out, info->len);
+    perf_output_u64(&out, info->pgoff);
+    if (mmap2) {
+        perf_output_u32x2(&out, info->maj, info->min);
+        perf_output_u64(&out, info->ino);
+        perf_output_u64(&out, 0); // ino_generation
+        perf_output_u32x2(&out, info->prot, info->flags);
+    }
+    perf_output_put(&out, info->name, name_len);
+    perf_output_put(&out, (const uint8_t[8]){0}, name_size - name_len);
+    perf_output_sample_id(&out, event, info->task, now);
+    perf_output_end_locked(&out, false);
+}
+
+static void perf_output_comm(perf_event_t *event, const void *data,
+                             uint64_t now) {
+    const perf_comm_info_t *info = data;
+    struct perf_event_header header;
+    size_t name_len = strlen(info->comm) + 1;
+    size_t name_size = PADDING_UP(name_len, sizeof(uint64_t));
+    perf_output_t out;
+    size_t size;
+
+    if (!event->attr.comm)
+        return;
+
+    size = sizeof(header) + 8 + name_size + perf_sample_id_size(event);
+    if (!perf_output_begin_locked(&out, event, info->task, size, now))
+        return;
+
+    header.type = PERF_RECORD_COMM;
+    header.misc = PERF_RECORD_MISC_COMM_EXEC;
+    header.size = (uint16_t)size;
+    perf_output_put(&out, &header, sizeof(header));
+    perf_output_u32x2(&out, perf_task_pid(info->task),
+                      perf_task_tid(info->task));
+    perf_output_put(&out, info->comm, name_len);
+    perf_output_put(&out, (const uint8_t[8]){0}, name_size - name_len);
+    perf_output_sample_id(&out, event, info->task, now);
+    perf_output_end_locked(&out, false);
+}
+
+static void perf_output_task(perf_event_t *event, const void *data,
+                             uint64_t now) {
+    const perf_task_info_t *info = data;
+    struct perf_event_header header;
+    perf_output_t out;
+    size_t size;
+
+    if (!event->attr.task)
+        return;
+
+    size = sizeof(header) + 24 + perf_sample_id_size(event);
+    if (!perf_output_begin_locked(&out, event, info->task, size, now))
+        return;
+
+    header.type = info->fork ? PERF_RECORD_FORK : PERF_RECORD_EXIT;
+    header.misc = 0;
+    header.size = (uint16_t)size;
+    perf_output_put(&out, &header, sizeof(header));
+    perf_output_u32x2(&out, perf_task_pid(info->task),
+                      perf_task_pid(info->parent));
+    perf_output_u32x2(&out, perf_task_tid(info->task),
+                      perf_task_tid(info->parent));
+    perf_output_u64(&out, now);
+    perf_output_sample_id(&out, event, info->task, now);
+    perf_output_end_locked(&out, false);
+}
+
+static bool perf_mmap_info_from_vma(perf_mmap_info_t *info, task_t *task,
+                                    vma_t *vma) {
+    memset(info, 0, sizeof(*info));
+    info->task = task;
+    info->start = vma->vm_start;
+    info->len = vma->vm_end - vma->vm_start;
+    info->exec = !!(vma->vm_flags & VMA_EXEC);
+    info->prot = vma->vm_flags & (VMA_READ | VMA_WRITE | VMA_EXEC);
+    info->flags = (vma->vm_flags & VMA_SHARED) ? MAP_SHARED : MAP_PRIVATE;
+
+    if (vma->vm_name && vma->vm_name[0]) {
+        info->name = vma->vm_name;
+    } else if (info->exec) {
+        info->name = "//anon";
+    } else {
+        return false;
+    }
+
+    if (vma->node) {
+        dev64_t dev = vma->node->i_sb ? vma->node->i_sb->s_dev : 0;
+
+        info->pgoff = (uint64_t)vma->vm_offset;
+        info->maj = (uint32_t)((dev >> 8) & 0xFF);
+        info->min = (uint32_t)(dev & 0xFF);
+        info->ino = vma->node->i_ino;
+    }
+    return true;
+}
+
+/* Hooks */
+
+void perf_event_tick(struct pt_regs *regs) {
+    uint32_t cpu = current_cpu_id;
+    task_t *self = current_task;
+    perf_sample_ctx_t ctx;
+    perf_event_t *event, *tmp;
+    uint64_t now;
+    bool kick;
+
+    if (!regs || cpu >= MAX_CPU_NUM)
+        return;
+    if (!perf_active()) {
+        /* The last event went away after arming this CPU. */
+        if (__atomic_load_n(&perf_deadline_sources[cpu].queued,
+                            __ATOMIC_ACQUIRE))
+            deadline_source_update(&perf_deadline_sources[cpu], UINT64_MAX);
+        return;
+    }
+
+    now = nano_time();
+    perf_sample_ctx_from_regs(&ctx, regs);
+
+    spin_lock(&perf_lock);
+    if (self) {
+        llist_for_each(event, tmp, &self->perf_events, node) {
+            perf_clock_tick_locked(event, &ctx, now);
+        }
+    }
+    llist_for_each(event, tmp, &perf_cpu_events[cpu], node) {
+        perf_clock_tick_locked(event, &ctx, now);
+    }
+    kick = !llist_empty(&perf_wakeup_list);
+    perf_cpu_rearm_locked(cpu, now);
+    spin_unlock(&perf_lock);
+
+    if (kick && softirq_raise(SOFTIRQ_PERF))
+        sched_wake_softirqd(cpu);
+}
+
+/* Called by schedule() with interrupts off, before switching to next. */
+void perf_event_task_switch(task_t *prev, task_t *next, uint64_t now_ns) {
+    uint32_t cpu = current_cpu_id;
+    uint32_t last_cpu;
+    perf_sample_ctx_t ctx;
+    perf_event_t *event, *tmp;
+
+    if (cpu >= MAX_CPU_NUM)
+        return;
+
+    __atomic_store_n(&perf_cpu_curr[cpu], next, __ATOMIC_RELEASE);
+    last_cpu = next->perf_last_cpu;
+    next->perf_last_cpu = cpu;
+    if (!perf_active())
+        return;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.task = prev;
+    ctx.ip = (uint64_t)__builtin_return_address(0);
+    ctx.fp = (uint64_t)__builtin_frame_address(0);
+
+    spin_lock(&perf_lock);
+    perf_swevent_all_locked(prev, cpu, PERF_COUNT_SW_CONTEXT_SWITCHES, &ctx);
+    llist_for_each(event, tmp, &prev->perf_events, node) {
+        perf_event_sched_out_locked(event, now_ns);
+    }
+    llist_for_each(event, tmp, &next->perf_events, node) {
+        perf_event_sched_in_locked(event, cpu, now_ns);
+    }
+    if (last_cpu != cpu) {
+        ctx.task = next;
+        perf_swevent_all_locked(next, cpu, PERF_COUNT_SW_CPU_MIGRATIONS,
+                                &ctx);
+    }
+    perf_cpu_rearm_locked(cpu, now_ns);
+    spin_unlock(&perf_lock);
+}
+
+void perf_event_page_fault(struct pt_regs *regs, uint64_t addr) {
+    perf_sample_ctx_t ctx;
+
+    if (!perf_active() || !regs || !current_task)
+        return;
+
+    perf_sample_ctx_from_regs(&ctx, regs);
+    ctx.addr = addr;
+
+    spin_lock(&perf_lock);
+    perf_swevent_all_locked(current_task, current_cpu_id,
+                            PERF_COUNT_SW_PAGE_FAULTS, &ctx);
+    perf_kick_locked(nano_time());
+    spin_unlock(&perf_lock);
+}
+
+static void perf_event_free_child_locked(perf_event_t *child) {
+    if (child->attached)
+        llist_delete(&child->node);
+    llist_delete(&child->child_node);
+    if (child->wakeup_queued)
+        llist_delete(&child->wakeup_node);
+    __atomic_sub_fetch(&perf_nr_events, 1, __ATOMIC_RELEASE);
+    free(child);
+}
+
+static void perf_event_inherit_locked(perf_event_t *event, task_t *child) {
+    perf_event_t *root = perf_primary(event);
+    perf_event_t *copy;
+
+    if (root->exited)
+        return;
+
+    copy = calloc(1, sizeof(*copy));
+    if (!copy)
+        return;
+
+    copy->attr = event->attr;
+    copy->id = ++perf_next_id;
+    copy->task = child;
+    copy->cpu = event->cpu;
+    copy->parent = root;
+    copy->enabled = event->enabled;
+    llist_init_head(&copy->children);
+    llist_init_head(&copy->rb_node);
+    llist_init_head(&copy->wakeup_node);
+    perf_event_set_period_locked(copy);
+
+    llist_append(&root->children, &copy->child_node);
+    llist_append(&child->perf_events, &copy->node);
+    copy->attached = true;
+    __atomic_add_fetch(&perf_nr_events, 1, __ATOMIC_RELEASE);
+}
+
+void perf_event_fork(task_t *parent, task_t *child) {
+    perf_event_t *event, *tmp;
+    perf_task_info_t info;
+    uint64_t now;
+
+    child->perf_last_cpu = child->cpu_id;
+    if (!perf_active() || !parent)
+        return;
+
+    now = nano_time();
+    info.task = child;
+    info.parent = parent;
+    info.fork = true;
+
+    spin_lock(&perf_lock);
+    llist_for_each(event, tmp, &parent->perf_events, node) {
+        if (event->attr.inherit)
+            perf_event_inherit_locked(event, child);
+    }
+    perf_sideband_locked(child, perf_output_task, &info, now);
+    perf_kick_locked(now);
+    spin_unlock(&perf_lock);
+}
+
+void perf_event_exec(task_t *task) {
+    perf_event_t *event, *tmp;
+    perf_comm_info_t comm;
+    char name[PERF_COMM_LEN];
+    const char *base;
+    uint64_t now;
+
+    if (!perf_active() || !task)
+        return;
+
+    base = strrchr(task->name, '/');
+    base = base ? base + 1 : task->name;
+    strncpy(name, base, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    comm.task = task;
+    comm.comm = name;
+    now = nano_time();
+
+    spin_lock(&perf_lock);
+    llist_for_each(event, tmp, &task->perf_events, node) {
+        if (event->attr.enable_on_exec)
+            perf_event_enable_locked(event, now);
+    }
+    perf_sideband_locked(task, perf_output_comm, &comm, now);
+    spin_unlock(&perf_lock);
+
+    /* The new image is mapped already; report what perf needs to see. */
+    if (task->mm) {
+        vma_manager_t *mgr = &task->mm->task_vma_mgr;
+        perf_mmap_info_t info;
+
+        spin_lock(&mgr->lock);
+        spin_lock(&perf_lock);
+        for (rb_node_t *node = rb_first(&mgr->vma_tree); node;
+             node = rb_next(node)) {
+            vma_t *vma = rb_entry(node, vma_t, vm_rb);
+
+            if (vma->node && perf_mmap_info_from_vma(&info, task, vma))
+                perf_sideband_locked(task, perf_output_mmap, &info, now);
+        }
+        perf_kick_locked(now);
+        spin_unlock(&perf_lock);
+        spin_unlock(&mgr->lock);
+    }
+}
+
+void perf_event_mmap(vma_t *vma) {
+    task_t *task = current_task;
+    perf_mmap_info_t info;
+    uint64_t now;
+
+    if (!perf_active() || !task || !vma ||
+        !perf_mmap_info_from_vma(&info, task, vma))
+        return;
+
+    now = nano_time();
+    spin_lock(&perf_lock);
+    perf_sideband_locked(task, perf_output_mmap, &info, now);
+    perf_kick_locked(now);
+    spin_unlock(&perf_lock);
+}
+
+/*
+ * Inherited copies fold their counts into the event they came from; the
+ * task's own events stay readable and report EPOLLHUP.
+ */
+void perf_event_exit_task(task_t *task) {
+    perf_event_t *event, *tmp;
+    perf_task_info_t info;
+    uint64_t now = nano_time();
+
+    info.task = task;
+    info.parent = task->parent;
+    info.fork = false;
+
+    spin_lock(&perf_lock);
+    task->perf_exited = true;
+    if (perf_active())
+        perf_sideband_locked(task, perf_output_task, &info, now);
+
+    llist_for_each(event, tmp, &task->perf_events, node) {
+        perf_event_sched_out_locked(event, now);
+        llist_delete(&event->node);
+        event->attached = false;
+        event->task = NULL;
+
+        if (event->parent) {
+            event->parent->child_count += event->count;
+            event->parent->child_time_active += event->time_active;
+            event->parent->lost_samples += event->lost_samples;
+            perf_event_free_child_locked(event);
+        } else {
+            event->exited = true;
+            perf_event_wakeup_locked(event);
+        }
+    }
+    perf_kick_locked(now);
+    spin_unlock(&perf_lock);
+}
+
+/* perf_event files */
+
+static perf_event_t *perf_event_file_handle(struct vfs_file *file) {
+    if (!file || !file->f_inode || !file->f_inode->i_sb ||
+        file->f_inode->i_sb->s_type != &perfeventfs_fs_type)
+        return NULL;
+    if (file->private_data)
+        return (perf_event_t *)file->private_data;
+    return (perf_event_t *)file->f_inode->i_private;
+}
+
+static void perf_event_release(perf_event_t *event) {
+    perf_event_t *child, *tmp;
+    perf_buffer_t *rb;
+    uint64_t now = nano_time();
+
+    spin_lock(&perf_lock);
+    llist_for_each(child, tmp, &event->children, child_node) {
+        perf_event_free_child_locked(child);
+    }
+    if (event->attached) {
+        perf_event_sched_out_locked(event, now);
+        llist_delete(&event->node);
+        event->attached = false;
+    }
+    if (event->wakeup_queued) {
+        llist_delete(&event->wakeup_node);
+        event->wakeup_queued = false;
+    }
+    rb = perf_event_set_rb_locked(event, NULL);
+    event->inode = NULL;
+    __atomic_sub_fetch(&perf_nr_events, 1, __ATOMIC_RELEASE);
+    spin_unlock(&perf_lock);
+
+    perf_buffer_free(rb);
+    free(event);
+}
+
+static ssize_t perfeventfs_read(struct vfs_file *file, void *buf, size_t count,
+                                loff_t *ppos) {
+    perf_event_t *event = perf_event_file_handle(file);
+    uint64_t values[PERF_READ_MAX];
+    size_t size;
+
+    (void)ppos;
+    if (!event)
+        return -EINVAL;
+
+    spin_lock(&perf_lock);
+    size = perf_read_values_locked(event, event->attr.read_format,
+                                   nano_time(), values, true) *
+           sizeof(uint64_t);
+    spin_unlock(&perf_lock);
+
+    if (count < size)
+        return -ENOSPC;
+    memcpy(buf, values, size);
+    return (ssize_t)size;
+}
+
+static __poll_t perfeventfs_poll(struct vfs_file *file,
+                                 struct vfs_poll_table *pt) {
+    perf_event_t *event = perf_event_file_handle(file);
+    __poll_t revents = 0;
+
+    (void)pt;
+    if (!event)
+        return EPOLLNVAL;
+
+    spin_lock(&perf_lock);
+    if (event->rb) {
+        revents = event->rb->poll;
+        event->rb->poll = 0;
+    }
+    if (event->exited)
+        revents |= EPOLLHUP;
+    spin_unlock(&perf_lock);
+    return revents;
+}
+
+static int perf_event_set_output(perf_event_t *event, int fd) {
+    struct vfs_file *file = NULL;
+    perf_event_t *output = NULL;
+    perf_buffer_t *old = NULL;
+    int ret = 0;
+
+    if (fd != -1) {
+        file = task_get_file(current_task, fd);
+        if (!file)
+            return -EBADF;
+        output = perf_event_file_handle(file);
+        if (!output) {
+            vfs_file_put(file);
+            return -EINVAL;
+        }
+    }
+
+    spin_lock(&perf_lock);
+    if (output == event) {
+        ret = -EINVAL;
+    } else if (output &&
+               (output->cpu != event->cpu ||
+                (event->cpu == -1 && output->task != event->task) ||
+                !output->rb)) {
+        ret = -EINVAL;
+    } else if (event->rb_mapped) {
+        ret = -EBUSY;
+    } else {
+        old = perf_event_set_rb_locked(event, output ? output->rb : NULL);
+    }
+    spin_unlock(&perf_lock);
+
+    if (file)
+        vfs_file_put(file);
+    perf_buffer_free(old);
+    return ret;
+}
+
+static long perfeventfs_ioctl(struct vfs_file *file, unsigned long cmd,
+                              unsigned long arg) {
+    perf_event_t *event = perf_event_file_handle(file);
+    perf_event_t *child, *tmp;
+    uint64_t now = nano_time();
+    uint64_t value;
+    long ret = 0;
+
+    if (!event)
+        return -EBADF;
+
+    switch (cmd) {
+    case PERF_EVENT_IOC_ENABLE:
+    case PERF_EVENT_IOC_DISABLE:
+        spin_lock(&perf_lock);
+        if (cmd == PERF_EVENT_IOC_ENABLE) {
+            perf_event_enable_locked(event, now);
+            llist_for_each(child, tmp, &event->children, child_node) {
+                perf_event_enable_locked(child, now);
+            }
+        } else {
+            perf_event_disable_locked(event, now);
+            llist_for_each(child, tmp, &event->children, child_node) {
+                perf_event_disable_locked(child, now);
+            }
+        }
+        spin_unlock(&perf_lock);
+        return 0;
+    case PERF_EVENT_IOC_RESET:
+        spin_lock(&perf_lock);
+        perf_event_update_locked(event, now);
+        event->count = 0;
+        event->child_count = 0;
+        perf_event_set_period_locked(event);
+        llist_for_each(child, tmp, &event->children, child_node) {
+            perf_event_update_locked(child, now);
+            child->count = 0;
+            perf_event_set_period_locked(child);
+        }
+        spin_unlock(&perf_lock);
+        return 0;
+    case PERF_EVENT_IOC_PERIOD:
+        if (copy_from_user(&value, (void *)arg, sizeof(value)))
+            return -EFAULT;
+        if (!value || (event->attr.freq && value > PERF_MAX_SAMPLE_RATE) ||
+            (value & (1ULL << 63)))
+            return -EINVAL;
+        spin_lock(&perf_lock);
+        perf_event_update_locked(event, now);
+        event->attr.sample_period = value;
+        perf_event_set_period_locked(event);
+        llist_for_each(child, tmp, &event->children, child_node) {
+            perf_event_update_locked(child, now);
+            child->attr.sample_period = value;
+            perf_event_set_period_locked(child);
+        }
+        spin_unlock(&perf_lock);
+        return 0;
+    case PERF_EVENT_IOC_ID:
+        if (copy_to_user((void *)arg, &event->id, sizeof(event->id)))
+            return -EFAULT;
+        return 0;
+    case PERF_EVENT_IOC_SET_OUTPUT:
+        return perf_event_set_output(event, (int)arg);
+    case PERF_EVENT_IOC_PAUSE_OUTPUT:
+        spin_lock(&perf_lock);
+        if (event->rb)
+            event->rb->paused = !!arg;
+        else
+            ret = -EINVAL;
+        spin_unlock(&perf_lock);
+        return ret;
+    case PERF_EVENT_IOC_REFRESH:
+    case PERF_EVENT_IOC_SET_FILTER:
+    case PERF_EVENT_IOC_SET_BPF:
+        return -EINVAL;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/*
+ * The first page holds perf_event_mmap_page, then 2^n data pages. Every
+ * mmap() of an event maps the same buffer, which must keep its size.
+ */
+static void *perfeventfs_mmap(struct vfs_file *file, void *addr,
+                              size_t offset, size_t size, size_t prot,
+                              uint64_t flags) {
+    perf_event_t *event = perf_event_file_handle(file);
+    perf_buffer_t *rb, *new_rb = NULL;
+    uint64_t vaddr = (uint64_t)addr;
+    uint64_t nr_pages, user_paddr, data_paddr;
+    uint64_t pt_flags = PT_FLAG_R | PT_FLAG_U;
+    uint64_t *pgdir;
+    bool attached = false;
+
+    if (!event || !addr || !current_task || !current_task->mm)
+        return (void *)(int64_t)-EINVAL;
+    if (offset || size < PAGE_SIZE || (size & (PAGE_SIZE - 1)) ||
+        !(flags & MAP_SHARED))
+        return (void *)(int64_t)-EINVAL;
+
+    nr_pages = size / PAGE_SIZE - 1;
+    if (nr_pages & (nr_pages - 1))
+        return (void *)(int64_t)-EINVAL;
+    if (nr_pages > PERF_MAX_DATA_PAGES)
+        return (void *)(int64_t)-ENOMEM;
+
+    spin_lock(&perf_lock);
+    rb = event->rb;
+    spin_unlock(&perf_lock);
+    if (!rb) {
+        new_rb = perf_buffer_alloc(nr_pages, &event->attr,
+                                   !(prot & PROT_WRITE));
+        if (!new_rb)
+            return (void *)(int64_t)-ENOMEM;
+    }
+
+    spin_lock(&perf_lock);
+    rb = event->rb;
+    if (rb && (!event->rb_mapped || rb->nr_pages != nr_pages)) {
+        spin_unlock(&perf_lock);
+        perf_buffer_free(new_rb);
+        return (void *)(int64_t)-EINVAL;
+    }
+    if (!rb) {
+        if (!new_rb) {
+            spin_unlock(&perf_lock);
+            return (void *)(int64_t)-EAGAIN;
+        }
+        rb = new_rb;
+        new_rb = NULL;
+        perf_event_set_rb_locked(event, rb);
+        event->rb_mapped = true;
+        attached = true;
+    }
+    user_paddr = rb->user_paddr;
+    data_paddr = rb->data_paddr;
+    spin_unlock(&perf_lock);
+    perf_buffer_free(new_rb);
+
+    if (prot & PROT_WRITE)
+        pt_flags |= PT_FLAG_W;
+    pgdir = task_mm_pgdir(current_task->mm);
+    if (map_page_range(pgdir, vaddr, user_paddr, PAGE_SIZE, pt_flags) != 0 ||
+        (nr_pages &&
+         map_page_range(pgdir, vaddr + PAGE_SIZE, data_paddr,
+                        nr_pages * PAGE_SIZE, pt_flags & ~PT_FLAG_W) != 0)) {
+        unmap_page_range(pgdir, vaddr, size);
+        /* Detach the buffer this call attached so mmap() can be retried. */
+        if (attached) {
+            spin_lock(&perf_lock);
+            rb = event->rb == rb ? perf_event_set_rb_locked(event, NULL)
+                                 : NULL;
+            spin_unlock(&perf_lock);
+            perf_buffer_free(rb);
+        }
+        return (void *)(int64_t)-ENOMEM;
+    }
+    return addr;
+}
+
+static int perfeventfs_open(struct vfs_inode *inode, struct vfs_file *file) {
+    if (!inode || !file)
+        return -EINVAL;
+    file->f_op = inode->i_fop;
+    file->private_data = inode->i_private;
+    return 0;
+}
+
+static int perfeventfs_release(struct vfs_inode *inode, struct vfs_file *file) {
+    perf_event_t *event = perf_event_file_handle(file);
+
+    if (inode)
+        inode->i_private = NULL;
+    if (file)
+        file->private_data = NULL;
+    if (event)
+        perf_event_release(event);
+    return 0;
+}
+
+static const struct vfs_file_operations perfeventfs_dir_file_ops = {
+    .open = perfeventfs_open,
+};
+
+static const struct vfs_file_operations perfeventfs_file_ops = {
+    .read = perfeventfs_read,
+    .unlocked_ioctl = perfeventfs_ioctl,
+    .poll = perfeventfs_poll,
+    .mmap = perfeventfs_mmap,
+    .open = perfeventfs_open,
+    .release = perfeventfs_release,
+};
+
+static struct vfs_inode *perfeventfs_alloc_inode(struct vfs_super_block *sb) {
+    struct vfs_inode *inode = calloc(1, sizeof(*inode));
+
+    (void)sb;
+    return inode;
+}
+
+static void perfeventfs_destroy_inode(struct vfs_inode *inode) {
+    free(inode);
+}
+
+static int perfeventfs_init_fs_context(struct vfs_fs_context *fc) {
+    (void)fc;
+    return 0;
+}
+
+static int perfeventfs_get_tree(struct vfs_fs_context *fc) {
+    struct vfs_super_block *sb;
+    struct vfs_inode *inode;
+    struct vfs_dentry *root;
+
+    if (!fc)
+        return -EINVAL;
+
+    sb = vfs_alloc_super(fc->fs_type, fc->sb_flags);
+    if (!sb)
+        return -ENOMEM;
+
+    sb->s_magic = PERFEVENTFS_MAGIC;
+    sb->s_op = &perfeventfs_super_ops;
+    sb->s_type = &perfeventfs_fs_type;
+
+    inode = vfs_alloc_inode(sb);
+    if (!inode) {
+        vfs_put_super(sb);
+        return -ENOMEM;
+    }
+
+    inode->i_ino = 1;
+    inode->inode = 1;
+    inode->i_mode = S_IFDIR | 0700;
+    inode->i_nlink = 2;
+    inode->i_fop = &perfeventfs_dir_file_ops;
+
+    root = vfs_d_alloc(sb, NULL, NULL);
+    if (!root) {
+        vfs_iput(inode);
+        vfs_put_super(sb);
+        return -ENOMEM;
+    }
+
+    vfs_d_instantiate(root, inode);
+    sb->s_root = root;
+    fc->sb = sb;
+    return 0;
+}
+
+static const struct vfs_super_operations perfeventfs_super_ops = {
+    .alloc_inode = perfeventfs_alloc_inode,
+    .destroy_inode = perfeventfs_destroy_inode,
+};
+
+static struct vfs_file_system_type perfeventfs_fs_type = {
+    .name = "perfeventfs",
+    .fs_flags = VFS_FS_VIRTUAL,
+    .init_fs_context = perfeventfs_init_fs_context,
+    .get_tree = perfeventfs_get_tree,
+};
+
+static struct vfs_mount *perfeventfs_get_internal_mount(void) {
+    int ret;
+
+    spin_lock(&perfeventfs_mount_lock);
+    if (!perfeventfs_internal_mnt) {
+        ret = vfs_kern_mount("perfeventfs", 0, NULL, NULL,
+                             &perfeventfs_internal_mnt);
+        if (ret < 0)
+            perfeventfs_internal_mnt = NULL;
+    }
+    if (perfeventfs_internal_mnt)
+        vfs_mntget(perfeventfs_internal_mnt);
+    spin_unlock(&perfeventfs_mount_lock);
+    return perfeventfs_internal_mnt;
+}
+
+static int perf_event_create_file(perf_event_t *event, uint64_t flags,
+                                  struct vfs_file **out_file) {
+    struct vfs_mount *mnt;
+    struct vfs_super_block *sb;
+    struct vfs_inode *inode;
+    struct vfs_dentry *dentry;
+    struct vfs_qstr name = {0};
+    struct vfs_file *file;
+    char namebuf[32];
+
+    mnt = perfeventfs_get_internal_mount();
+    if (!mnt)
+        return -ENODEV;
+    sb = mnt->mnt_sb;
+
+    inode = vfs_alloc_inode(sb);
+    if (!inode) {
+        vfs_mntput(mnt);
+        return -ENOMEM;
+    }
+
+    spin_lock(&perfeventfs_ino_lock);
+    inode->i_ino = ++perfeventfs_next_ino;
+    spin_unlock(&perfeventfs_ino_lock);
+    inode->inode = inode->i_ino;
+    inode->i_mode = S_IFCHR | 0600;
+    inode->i_nlink = 1;
+    inode->i_fop = &perfeventfs_file_ops;
+    inode->i_private = event;
+
+    snprintf(namebuf, sizeof(namebuf), "perf_event-%llu",
+             (unsigned long long)inode->i_ino);
+    vfs_qstr_make(&name, namebuf);
+    dentry = vfs_d_alloc(sb, sb->s_root, &name);
+    if (!dentry) {
+        inode->i_private = NULL;
+        vfs_iput(inode);
+        vfs_mntput(mnt);
+        return -ENOMEM;
+    }
+
+    vfs_d_instantiate(dentry, inode);
+    file = vfs_alloc_file(&(struct vfs_path){.mnt = mnt, .dentry = dentry},
+                          O_RDWR);
+    if (!file) {
+        vfs_dput(dentry);
+        inode->i_private = NULL;
+        vfs_iput(inode);
+        vfs_mntput(mnt);
+        return -ENOMEM;
+    }
+
+    file->private_data = event;
+    file->f_mode |= VFS_FMODE_NO_POS_LOCK;
+    event->inode = inode;
+    *out_file = file;
+
+    vfs_dput(dentry);
+    vfs_iput(inode);
+    vfs_mntput(mnt);
+    return 0;
+}
+
+/* perf_event_open() */
+
+static int perf_copy_attr(const struct perf_event_attr *uattr,
+                          struct perf_event_attr *attr) {
+    uint8_t extra[64];
+    uint32_t size;
+
+    memset(attr, 0, sizeof(*attr));
+    if (!uattr || copy_from_user(&size, &uattr->size, sizeof(size)))
+        return -EFAULT;
+    if (!size)
+        size = PERF_ATTR_SIZE_VER0;
+    if (size < PERF_ATTR_SIZE_VER0 || size > PAGE_SIZE)
+        goto too_big;
+
+    /* A newer perf may pass a larger attr, as long as we ignore nothing. */
+    for (uint32_t off = sizeof(*attr); off < size;) {
+        uint32_t chunk = MIN(size - off, (uint32_t)sizeof(extra));
+
+        if (copy_from_user(extra, (const uint8_t *)uattr + off, chunk))
+            return -EFAULT;
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (extra[i])
+                goto too_big;
+        }
+        off += chunk;
+    }
+
+    if (copy_from_user(attr, uattr, MIN(size, (uint32_t)sizeof(*attr))))
+        return -EFAULT;
+    attr->size = size;
+    return 0;
+
+too_big:
+    size = sizeof(*attr);
+    copy_to_user((void *)&uattr->size, &size, sizeof(size));
+    return -E2BIG;
+}
+
+/*
+ * Only software events exist. Anything this implementation would silently
+ * get wrong is refused, so perf's feature probing backs off on its own.
+ */
+static int perf_check_attr(const struct perf_event_attr *attr) {
+    if (attr->type != PERF_TYPE_SOFTWARE)
+        return -ENOENT;
+    if (attr->config > PERF_COUNT_SW_CPU_MIGRATIONS &&
+        attr->config != PERF_COUNT_SW_DUMMY)
+        return -ENOENT;
+
+    if ((attr->sample_type & ~(uint64_t)PERF_SAMPLE_SUPPORTED) ||
+        (attr->read_format & ~(uint64_t)PERF_FORMAT_SUPPORTED))
+        return -EINVAL;
+    if (attr->precise_ip)
+        return -EOPNOTSUPP;
+    if (attr->context_switch || attr->write_backward || attr->namespaces ||
+        attr->aux_output || attr->build_id || attr->inherit_thread ||
+        attr->remove_on_exec || attr->sigtrap || attr->__reserved_1)
+        return -EINVAL;
+    if (attr->branch_sample_type || attr->sample_regs_user ||
+        attr->sample_stack_user || attr->sample_regs_intr ||
+        attr->aux_watermark || attr->aux_sample_size || attr->sig_data ||
+        attr->__reserved_2 || attr->__reserved_3)
+        return -EINVAL;
+    if (attr->use_clockid && attr->clockid != CLOCK_MONOTONIC &&
+        attr->clockid != CLOCK_MONOTONIC_RAW &&
+        attr->clockid != CLOCK_BOOTTIME)
+        return -EINVAL;
+
+    if (attr->freq) {
+        if (!attr->sample_freq || attr->sample_freq > PERF_MAX_SAMPLE_RATE)
+            return -EINVAL;
+    } else if (attr->sample_period & (1ULL << 63)) {
+        return -EINVAL;
+    }
+    if (attr->sample_max_stack > PERF_MAX_STACK_DEPTH)
+        return -EOVERFLOW;
+    return 0;
+}
+
+static bool perf_task_access_ok(task_t *self, task_t *target) {
+    if (self == target || self->euid == 0)
+        return true;
+    return self->euid == target->euid && self->uid == target->uid;
+}
+
+static int perf_event_attach(perf_event_t *event, task_t *self, int pid) {
+    uint64_t now = nano_time();
+    task_t *task;
+    bool enable = event->enabled;
+    int ret = 0;
+
+    event->enabled = false;
+    if (pid == -1) {
+        spin_lock(&perf_lock);
+        llist_append(&perf_cpu_events[event->cpu], &event->node);
+        event->attached = true;
+        if (enable)
+            perf_event_enable_locked(event, now);
+        spin_unlock(&perf_lock);
+        return 0;
+    }
+
+    spin_lock(&task_queue_lock);
+    task = pid ? task_lookup_by_pid_nolock((uint64_t)pid) : self;
+    if (!task || task->state == TASK_DIED) {
+        ret = -ESRCH;
+    } else if (!perf_task_access_ok(self, task)) {
+        ret = -EACCES;
+    } else {
+        spin_lock(&perf_lock);
+        if (task->perf_exited) {
+            ret = -ESRCH;
+        } else {
+            event->task = task;
+            llist_append(&task->perf_events, &event->node);
+            event->attached = true;
+            if (enable)
+                perf_event_enable_locked(event, now);
+        }
+        spin_unlock(&perf_lock);
+    }
+    spin_unlock(&task_queue_lock);
+    return ret;
+}
+
+uint64_t sys_perf_event_open(const struct perf_event_attr *uattr, int pid,
+                             int cpu, int group_fd, uint64_t flags) {
+    struct perf_event_attr attr;
+    task_t *self = current_task;
+    struct vfs_file *file = NULL;
+    perf_event_t *event;
+    int ret;
+
+    if (flags & ~(PERF_FLAG_FD_NO_GROUP | PERF_FLAG_FD_CLOEXEC))
+        return (uint64_t)-EINVAL;
+
+    ret = perf_copy_attr(uattr, &attr);
+    if (ret < 0)
+        return (uint64_t)ret;
+    ret = perf_check_attr(&attr);
+    if (ret < 0)
+        return (uint64_t)ret;
+
+    if (pid < -1 || cpu < -1 || (pid == -1 && cpu == -1))
+        return (uint64_t)-EINVAL;
+    if (cpu >= 0 && ((uint64_t)cpu >= cpu_count || cpu >= MAX_CPU_NUM))
+        return (uint64_t)-EINVAL;
+    if (pid == -1 && self->euid != 0)
+        return (uint64_t)-EACCES;
+
+    /* Nothing is ever multiplexed, so a group needs no more than a leader
+     * that exists. */
+    if (group_fd != -1) {
+        struct vfs_file *leader = task_get_file(self, group_fd);
+
+        if (!leader)
+            return (uint64_t)-EBADF;
+        ret = perf_event_file_handle(leader) ? 0 : -EINVAL;
+        vfs_file_put(leader);
+        if (ret < 0)
+            return (uint64_t)ret;
+    }
+
+    event = calloc(1, sizeof(*event));
+    if (!event)
+        return (uint64_t)-ENOMEM;
+
+    event->attr = attr;
+    event->cpu = cpu;
+    event->enabled = !attr.disabled;
+    if (pid == -1)
+        event->attr.inherit = 0;
+    llist_init_head(&event->node);
+    llist_init_head(&event->children);
+    llist_init_head(&event->child_node);
+    llist_init_head(&event->rb_node);
+    llist_init_head(&event->wakeup_node);
+
+    spin_lock(&perf_lock);
+    event->id = ++perf_next_id;
+    perf_event_set_period_locked(event);
+    spin_unlock(&perf_lock);
+    __atomic_add_fetch(&perf_nr_events, 1, __ATOMIC_RELEASE);
+
+    ret = perf_event_create_file(event, flags, &file);
+    if (ret < 0) {
+        __atomic_sub_fetch(&perf_nr_events, 1, __ATOMIC_RELEASE);
+        free(event);
+        return (uint64_t)ret;
+    }
+
+    /* From here on the file owns the event. */
+    ret = perf_event_attach(event, self, pid);
+    if (ret < 0) {
+        vfs_file_put(file);
+        return (uint64_t)ret;
+    }
+
+    ret = task_install_file(self, file,
+                            (flags & PERF_FLAG_FD_CLOEXEC) ? FD_CLOEXEC : 0,
+                            0);
+    vfs_file_put(file);
+    return (uint64_t)ret;
+}
+
+void perf_event_init(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPU_NUM; cpu++) {
+        llist_init_head(&perf_cpu_events[cpu]);
+        deadline_source_init(&perf_deadline_sources[cpu],
+                             DEADLINE_SOURCE_PERF, cpu);
+    }
+    spin_init(&perfeventfs_mount_lock);
+    spin_init(&perfeventfs_ino_lock);
+    softirq_register(SOFTIRQ_PERF, perf_softirq);
+    vfs_register_filesystem(&perfeventfs_fs_type);
+}
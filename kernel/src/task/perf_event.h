@@ -0,0 +1,206 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+struct task;
+struct pt_regs;
+struct vma;
+
+/*
+ * perf_event_open(2) for software events. There is no PMU to program, so
+ * the clocks count a task's (or a CPU's) time on CPU and sample from a
+ * per-CPU deadline, while page faults, context switches and migrations are
+ * counted where they happen. Samples and side-band records (comm, mmap,
+ * fork, exit) go to a ring buffer mapped the way perf record expects it.
+ * Hardware events are refused with ENOENT, which makes perf fall back to
+ * cpu-clock on its own.
+ */
+
+#define PERF_TYPE_HARDWARE 0
+#define PERF_TYPE_SOFTWARE 1
+#define PERF_TYPE_TRACEPOINT 2
+#define PERF_TYPE_HW_CACHE 3
+#define PERF_TYPE_RAW 4
+#define PERF_TYPE_BREAKPOINT 5
+
+#define PERF_COUNT_SW_CPU_CLOCK 0
+#define PERF_COUNT_SW_TASK_CLOCK 1
+#define PERF_COUNT_SW_PAGE_FAULTS 2
+#define PERF_COUNT_SW_CONTEXT_SWITCHES 3
+#define PERF_COUNT_SW_CPU_MIGRATIONS 4
+#define PERF_COUNT_SW_PAGE_FAULTS_MIN 5
+#define PERF_COUNT_SW_PAGE_FAULTS_MAJ 6
+#define PERF_COUNT_SW_ALIGNMENT_FAULTS 7
+#define PERF_COUNT_SW_EMULATION_FAULTS 8
+#define PERF_COUNT_SW_DUMMY 9
+
+#define PERF_SAMPLE_IP (1U << 0)
+#define PERF_SAMPLE_TID (1U << 1)
+#define PERF_SAMPLE_TIME (1U << 2)
+#define PERF_SAMPLE_ADDR (1U << 3)
+#define PERF_SAMPLE_READ (1U << 4)
+#define PERF_SAMPLE_CALLCHAIN (1U << 5)
+#define PERF_SAMPLE_ID (1U << 6)
+#define PERF_SAMPLE_CPU (1U << 7)
+#define PERF_SAMPLE_PERIOD (1U << 8)
+#define PERF_SAMPLE_STREAM_ID (1U << 9)
+#define PERF_SAMPLE_IDENTIFIER (1U << 16)
+
+#define PERF_FORMAT_TOTAL_TIME_ENABLED (1U << 0)
+#define PERF_FORMAT_TOTAL_TIME_RUNNING (1U << 1)
+#define PERF_FORMAT_ID (1U << 2)
+#define PERF_FORMAT_GROUP (1U << 3)
+#define PERF_FORMAT_LOST (1U << 4)
+
+#define PERF_FLAG_FD_NO_GROUP (1UL << 0)
+#define PERF_FLAG_FD_OUTPUT (1UL << 1)
+#define PERF_FLAG_PID_CGROUP (1UL << 2)
+#define PERF_FLAG_FD_CLOEXEC (1UL << 3)
+
+#define PERF_ATTR_SIZE_VER0 64
+#define PERF_ATTR_SIZE_VER8 136
+
+struct perf_event_attr {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    union {
+        uint64_t sample_period;
+        uint64_t sample_freq;
+    };
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t disabled : 1, inherit : 1, pinned : 1, exclusive : 1,
+        exclude_user : 1, exclude_kernel : 1, exclude_hv : 1, exclude_idle : 1,
+        mmap : 1, comm : 1, freq : 1, inherit_stat : 1, enable_on_exec : 1,
+        task : 1, watermark : 1, precise_ip : 2, mmap_data : 1,
+        sample_id_all : 1, exclude_host : 1, exclude_guest : 1,
+        exclude_callchain_kernel : 1, exclude_callchain_user : 1, mmap2 : 1,
+        comm_exec : 1, use_clockid : 1, context_switch : 1,
+        write_backward : 1, namespaces : 1, ksymbol : 1, bpf_event : 1,
+        aux_output : 1, cgroup : 1, text_poke : 1, build_id : 1,
+        inherit_thread : 1, remove_on_exec : 1, sigtrap : 1, __reserved_1 : 26;
+    union {
+        uint32_t wakeup_events;
+        uint32_t wakeup_watermark;
+    };
+    uint32_t bp_type;
+    uint64_t config1;
+    uint64_t config2;
+    uint64_t branch_sample_type;
+    uint64_t sample_regs_user;
+    uint32_t sample_stack_user;
+    int32_t clockid;
+    uint64_t sample_regs_intr;
+    uint32_t aux_watermark;
+    uint16_t sample_max_stack;
+    uint16_t __reserved_2;
+    uint32_t aux_sample_size;
+    uint32_t __reserved_3;
+    uint64_t sig_data;
+    uint64_t config3;
+};
+
+_Static_assert(sizeof(struct perf_event_attr) == PERF_ATTR_SIZE_VER8,
+               "perf_event_attr must match the Linux UAPI");
+
+/* First page of the mapping; the data pages follow it. */
+struct perf_event_mmap_page {
+    uint32_t version;
+    uint32_t compat_version;
+    uint32_t lock;
+    uint32_t index;
+    int64_t offset;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t capabilities;
+    uint16_t pmc_width;
+    uint16_t time_shift;
+    uint32_t time_mult;
+    uint64_t time_offset;
+    uint64_t time_zero;
+    uint32_t size;
+    uint32_t __reserved_1;
+    uint64_t time_cycles;
+    uint64_t time_mask;
+    uint8_t __reserved[116 * 8];
+    uint64_t data_head;
+    uint64_t data_tail;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t aux_head;
+    uint64_t aux_tail;
+    uint64_t aux_offset;
+    uint64_t aux_size;
+};
+
+_Static_assert(offsetof(struct perf_event_mmap_page, data_head) == 1024,
+               "perf_event_mmap_page must match the Linux UAPI");
+
+struct perf_event_header {
+    uint32_t type;
+    uint16_t misc;
+    uint16_t size;
+};
+
+#define PERF_RECORD_MMAP 1
+#define PERF_RECORD_LOST 2
+#define PERF_RECORD_COMM 3
+#define PERF_RECORD_EXIT 4
+#define PERF_RECORD_FORK 7
+#define PERF_RECORD_SAMPLE 9
+#define PERF_RECORD_MMAP2 10
+
+#define PERF_RECORD_MISC_KERNEL (1U << 0)
+#define PERF_RECORD_MISC_USER (2U << 0)
+#define PERF_RECORD_MISC_MMAP_DATA (1U << 13)
+#define PERF_RECORD_MISC_COMM_EXEC (1U << 13)
+
+#define PERF_CONTEXT_KERNEL ((uint64_t)-128)
+#define PERF_CONTEXT_USER ((uint64_t)-512)
+
+#define PERF_EVENT_IOC_ENABLE _IO('$', 0)
+#define PERF_EVENT_IOC_DISABLE _IO('$', 1)
+#define PERF_EVENT_IOC_REFRESH _IO('$', 2)
+#define PERF_EVENT_IOC_RESET _IO('$', 3)
+#define PERF_EVENT_IOC_PERIOD _IOW('$', 4, uint64_t)
+#define PERF_EVENT_IOC_SET_OUTPUT _IO('$', 5)
+#define PERF_EVENT_IOC_SET_FILTER _IOW('$', 6, char *)
+#define PERF_EVENT_IOC_ID _IOR('$', 7, uint64_t *)
+#define PERF_EVENT_IOC_SET_BPF _IOW('$', 8, uint32_t)
+#define PERF_EVENT_IOC_PAUSE_OUTPUT _IOW('$', 9, uint32_t)
+
+#define PERF_MAX_STACK_DEPTH 127
+#define PERF_MAX_SAMPLE_RATE 100000
+#define PERF_MIN_CLOCK_PERIOD_NS 10000ULL
+#define PERF_MAX_DATA_PAGES 16384
+#define PERF_WAKEUP_DELAY_NS 1000000ULL // bounds wakeups deferred to the tick
+
+uint64_t sys_perf_event_open(const struct perf_event_attr *uattr, int pid,
+                             int cpu, int group_fd, uint64_t flags);
+
+/*
+ * Hooks. Each returns straight away while no event exists. None of them
+ * wakes anybody: readers are woken from SOFTIRQ_PERF, raised by the next
+ * perf_event_tick() on the CPU that produced the data.
+ */
+void perf_event_tick(struct pt_regs *regs);
+void perf_event_task_switch(struct task *prev, struct task *next,
+                            uint64_t now_ns);
+void perf_event_page_fault(struct pt_regs *regs, uint64_t addr);
+void perf_event_fork(struct task *parent, struct task *child);
+void perf_event_exec(struct task *task);
+void perf_event_exit_task(struct task *task);
+/* A new mapping in current's address space, under its vma lock. */
+void perf_event_mmap(struct vma *vma);
+
+void perf_event_init(void);
+
+/* Per arch, for samples and frame-pointer callchains. */
+uint64_t arch_perf_instruction_pointer(const struct pt_regs *regs);
+uint64_t arch_perf_frame_pointer(const struct pt_regs *regs);
+bool arch_perf_user_mode(const struct pt_regs *regs);
+/* Where a frame record keeps the caller's frame pointer and the return
+ * address, relative to the frame pointer. */
+int64_t arch_perf_frame_link_offset(void);
+int64_t arch_perf_frame_ret_offset(void);
@@ -0,0 +1,600 @@
+#include <task/psi.h>
+#include <task/task.h>
+#include <task/workqueue.h>
+#include <cgroup/cgroup.h>
+#include <fs/vfs/vfs.h>
+#include <libs/string_builder.h>
+
+/* Fixed-point running averages, same constants as the load average. */
+#define PSI_FSHIFT 11
+#define PSI_FIXED_1 (1UL << PSI_FSHIFT)
+#define PSI_LOAD_INT(x) ((x) >> PSI_FSHIFT)
+#define PSI_LOAD_FRAC(x) PSI_LOAD_INT(((x) & (PSI_FIXED_1 - 1)) * 100)
+
+/* 1/exp(2s/10s), 1/exp(2s/60s), 1/exp(2s/300s) */
+static const unsigned long psi_avg_exp[PSI_AVG_NR] = {1677, 1981, 2034};
+
+#define PSI_AVG_MAX_MISSED 300
+
+#define PSI_TRIG_MIN_WIN_US 500000ULL
+#define PSI_TRIG_MAX_WIN_US 10000000ULL
+/* Triggers are checked at a tenth of the shortest window they may use. */
+#define PSI_POLL_NS (PSI_TRIG_MIN_WIN_US * 1000ULL / 10)
+
+struct psi_trigger {
+    struct llist_header node;
+    psi_group_t *group;
+    enum psi_states state;
+    uint64_t threshold_ns;
+    uint64_t win_ns;
+    uint64_t win_start;
+    uint64_t win_value;
+    uint64_t last_event;
+    bool event;
+    struct vfs_inode *inode;
+};
+
+static psi_group_cpu_t psi_system_pcpu[MAX_CPU_NUM];
+
+psi_group_t psi_system = {
+    .node = {&psi_system.node, &psi_system.node},
+    .pcpu = psi_system_pcpu,
+    .triggers = {&psi_system.triggers, &psi_system.triggers},
+    .is_system = true,
+};
+
+static DEFINE_LLIST(psi_groups);
+static spinlock_t psi_groups_lock;
+static delayed_work_t psi_avgs_work;
+static delayed_work_t psi_poll_work;
+static uint64_t psi_nr_triggers;
+static bool psi_ready;
+
+static void psi_group_cpu_account(psi_group_cpu_t *gc, uint32_t flags,
+                                  int delta) {
+    static const struct {
+        uint32_t flag;
+        enum psi_task_count count;
+    } map[] = {
+        {TSK_IOWAIT, NR_IOWAIT},
+        {TSK_MEMSTALL, NR_MEMSTALL},
+        {TSK_RUNNING, NR_RUNNING},
+        {TSK_ONCPU, NR_ONCPU},
+    };
+
+    for (size_t i = 0; i < sizeof(map) / sizeof(map[0]); i++) {
+        if (!(flags & map[i].flag))
+            continue;
+        if (delta > 0 || gc->tasks[map[i].count])
+            gc->tasks[map[i].count] += delta;
+    }
+
+    if ((flags & TSK_RUNNING) && (flags & (TSK_IOWAIT | TSK_MEMSTALL))) {
+        if (delta > 0 || gc->tasks[NR_STALL_RUNNING])
+            gc->tasks[NR_STALL_RUNNING] += delta;
+    }
+}
+
+static uint32_t psi_state_mask(const uint32_t *tasks) {
+    bool productive = tasks[NR_RUNNING] > tasks[NR_STALL_RUNNING];
+    uint32_t mask = 0;
+
+    if (tasks[NR_IOWAIT]) {
+        mask |= 1U << PSI_IO_SOME;
+        if (!productive)
+            mask |= 1U << PSI_IO_FULL;
+    }
+    if (tasks[NR_MEMSTALL]) {
+        mask |= 1U << PSI_MEM_SOME;
+        if (!productive)
+            mask |= 1U << PSI_MEM_FULL;
+    }
+    if (tasks[NR_RUNNING] > tasks[NR_ONCPU])
+        mask |= 1U << PSI_CPU_SOME;
+    if (tasks[NR_RUNNING] && !tasks[NR_ONCPU])
+        mask |= 1U << PSI_CPU_FULL;
+    if (tasks[NR_RUNNING] || tasks[NR_IOWAIT] || tasks[NR_MEMSTALL])
+        mask |= 1U << PSI_NONIDLE;
+
+    return mask;
+}
+
+static void psi_record_times(psi_group_cpu_t *gc, uint64_t now) {
+    uint64_t delta;
+
+    if (now <= gc->state_start)
+        return;
+
+    delta = now - gc->state_start;
+    gc->state_start = now;
+    for (int s = 0; s < NR_PSI_STATES; s++) {
+        if (gc->state_mask & (1U << s))
+            gc->times[s] += delta;
+    }
+}
+
+static void psi_group_change(psi_group_t *group, uint32_t cpu, uint32_t old,
+                             uint32_t new, uint64_t now) {
+    psi_group_cpu_t *gc = &group->pcpu[cpu];
+
+    spin_lock(&gc->lock);
+    psi_record_times(gc, now);
+    psi_group_cpu_account(gc, old, -1);
+    psi_group_cpu_account(gc, new, 1);
+    gc->state_mask = psi_state_mask(gc->tasks);
+    spin_unlock(&gc->lock);
+}
+
+static void psi_groups_change(task_t *task, uint32_t cpu, uint32_t old,
+                              uint32_t new, uint64_t now) {
+    for (cgroup_t *cgroup = task->cgroup; cgroup;
+         cgroup = cgroup_parent(cgroup)) {
+        psi_group_t *group = cgroup_psi(cgroup);
+
+        if (group && group != &psi_system)
+            psi_group_change(group, cpu, old, new, now);
+    }
+    psi_group_change(&psi_system, cpu, old, new, now);
+}
+
+static void psi_task_change_locked(task_t *task, uint32_t clear, uint32_t set) {
+    uint32_t old = task->psi_flags;
+    uint32_t new = (old & ~clear) | set;
+    uint64_t now;
+
+    if (old == new)
+        return;
+
+    now = nano_time();
+    // counts stay on the CPU they were added on until the task is idle
+    if (old && task->psi_cpu != task->cpu_id) {
+        psi_groups_change(task, task->psi_cpu, old, 0, now);
+        old = 0;
+    }
+    task->psi_cpu = task->cpu_id;
+    psi_groups_change(task, task->psi_cpu, old, new, now);
+    task->psi_flags = new;
+}
+
+void psi_task_change(task_t *task, uint32_t clear, uint32_t set) {
+    if (!task || task->cpu_id >= MAX_CPU_NUM)
+        return;
+
+    spin_lock(&task->psi_lock);
+    psi_task_change_locked(task, clear, set);
+    spin_unlock(&task->psi_lock);
+}
+
+cgroup_t *psi_task_move_cgroup(task_t *task, cgroup_t *to) {
+    cgroup_t *from;
+    uint64_t now = nano_time();
+
+    spin_lock(&task->psi_lock);
+    from = task->cgroup;
+    if (from != to && task->psi_flags) {
+        uint32_t flags = task->psi_flags;
+
+        // take the counts out of the old chain, the system group keeps them
+        for (cgroup_t *cgroup = from; cgroup; cgroup = cgroup_parent(cgroup)) {
+            psi_group_t *group = cgroup_psi(cgroup);
+            if (group && group != &psi_system)
+                psi_group_change(group, task->psi_cpu, flags, 0, now);
+        }
+        for (cgroup_t *cgroup = to; cgroup; cgroup = cgroup_parent(cgroup)) {
+            psi_group_t *group = cgroup_psi(cgroup);
+            if (group && group != &psi_system)
+                psi_group_change(group, task->psi_cpu, 0, flags, now);
+        }
+    }
+    task->cgroup = to;
+    spin_unlock(&task->psi_lock);
+    return from;
+}
+
+void psi_task_exit(task_t *task) {
+    psi_task_change(task, TSK_IOWAIT | TSK_MEMSTALL | TSK_RUNNING | TSK_ONCPU,
+                    0);
+}
+
+static void psi_stall_enter(unsigned long *flags, uint32_t bit) {
+    task_t *task = current_task;
+
+    *flags = 1;
+    if (!task || task->cpu_id >= MAX_CPU_NUM)
+        return;
+
+    spin_lock(&task->psi_lock);
+    if (!(task->psi_flags & bit)) {
+        psi_task_change_locked(task, 0, bit);
+        *flags = 0;
+    }
+    spin_unlock(&task->psi_lock);
+}
+
+static void psi_stall_leave(unsigned long *flags, uint32_t bit) {
+    task_t *task = current_task;
+
+    if (*flags || !task)
+        return;
+
+    spin_lock(&task->psi_lock);
+    psi_task_change_locked(task, bit, 0);
+    spin_unlock(&task->psi_lock);
+}
+
+void psi_memstall_enter(unsigned long *flags) {
+    psi_stall_enter(flags, TSK_MEMSTALL);
+}
+
+void psi_memstall_leave(unsigned long *flags) {
+    psi_stall_leave(flags, TSK_MEMSTALL);
+}
+
+void psi_iowait_enter(unsigned long *flags) {
+    psi_stall_enter(flags, TSK_IOWAIT);
+}
+
+void psi_iowait_leave(unsigned long *flags) {
+    psi_stall_leave(flags, TSK_IOWAIT);
+}
+
+/*
+ * Folds the per-CPU stall times accumulated since the last call into the
+ * group totals. Each CPU counts in proportion to the time it was busy, so
+ * an idle CPU does not dilute a stall on a loaded one.
+ */
+static void psi_collect_locked(psi_group_t *group, uint64_t now) {
+    uint64_t deltas[NR_PSI_STALL_STATES] = {0};
+    uint64_t nonidle_total = 0;
+
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        psi_group_cpu_t *gc = &group->pcpu[cpu];
+        uint64_t times[NR_PSI_STATES];
+        uint64_t nonidle_us;
+
+        spin_lock(&gc->lock);
+        memcpy(times, gc->times, sizeof(times));
+        if (now > gc->state_start) {
+            for (int s = 0; s < NR_PSI_STATES; s++) {
+                if (gc->state_mask & (1U << s))
+                    times[s] += now - gc->state_start;
+            }
+        }
+        spin_unlock(&gc->lock);
+
+        for (int s = 0; s < NR_PSI_STATES; s++) {
+            uint64_t delta = times[s] - gc->times_prev[s];
+            gc->times_prev[s] = times[s];
+            times[s] = delta;
+        }
+
+        nonidle_us = times[PSI_NONIDLE] / 1000;
+        if (!nonidle_us)
+            continue;
+        nonidle_total += nonidle_us;
+        for (int s = 0; s < NR_PSI_STALL_STATES; s++)
+            deltas[s] += times[s] * nonidle_us;
+    }
+
+    if (!nonidle_total)
+        return;
+    for (int s = 0; s < NR_PSI_STALL_STATES; s++)
+        group->total[s] += deltas[s] / nonidle_total;
+}
+
+static unsigned long psi_calc_load(unsigned long load, unsigned long exp,
+                                   unsigned long active) {
+    unsigned long newload = load * exp + active * (PSI_FIXED_1 - exp);
+
+    if (active >= load)
+        newload += PSI_FIXED_1 - 1;
+    return newload / PSI_FIXED_1;
+}
+
+static void psi_update_averages_locked(psi_group_t *group, uint64_t now) {
+    uint64_t missed;
+    uint64_t period;
+
+    if (!group->avg_next_update) {
+        group->avg_last_update = now;
+        group->avg_next_update = now + PSI_FREQ_NS;
+        return;
+    }
+    if (now < group->avg_next_update)
+        return;
+
+    missed = (now - group->avg_next_update) / PSI_FREQ_NS;
+    period = now - group->avg_last_update;
+    group->avg_last_update = now;
+    group->avg_next_update += (missed + 1) * PSI_FREQ_NS;
+
+    for (int s = 0; s < NR_PSI_STALL_STATES; s++) {
+        uint64_t sample = group->total[s] - group->avg_total[s];
+        unsigned long pct;
+
+        // a stall straddling two periods may overshoot by a little
+        if (sample > period)
+            sample = period;
+        group->avg_total[s] += sample;
+
+        for (uint64_t i = 0; i < MIN(missed, PSI_AVG_MAX_MISSED); i++) {
+            for (int j = 0; j < PSI_AVG_NR; j++)
+                group->avg[s][j] =
+                    psi_calc_load(group->avg[s][j], psi_avg_exp[j], 0);
+        }
+
+        pct = (unsigned long)(sample * 100 / period) * PSI_FIXED_1;
+        for (int j = 0; j < PSI_AVG_NR; j++)
+            group->avg[s][j] =
+                psi_calc_load(group->avg[s][j], psi_avg_exp[j], pct);
+    }
+}
+
+char *psi_show(psi_group_t *group, psi_res_t res, size_t *content_len) {
+    unsigned long avg[2][PSI_AVG_NR];
+    uint64_t total[2];
+    string_builder_t *builder;
+    uint64_t now = nano_time();
+
+    *content_len = 0;
+    if (!group || res >= NR_PSI_RESOURCES)
+        return NULL;
+
+    spin_lock(&group->lock);
+    psi_collect_locked(group, now);
+    psi_update_averages_locked(group, now);
+    for (int full = 0; full < 2; full++) {
+        int s = res * 2 + full;
+        memcpy(avg[full], group->avg[s], sizeof(avg[full]));
+        total[full] = group->total[s];
+    }
+    spin_unlock(&group->lock);
+
+    // at system level some CPU always runs something, cpu full is noise
+    if (group->is_system && res == PSI_CPU) {
+        memset(avg[1], 0, sizeof(avg[1]));
+        total[1] = 0;
+    }
+
+    builder = create_string_builder(160);
+    if (!builder)
+        return NULL;
+
+    for (int full = 0; full < 2; full++) {
+        string_builder_append(
+            builder,
+            "%s avg10=%lu.%02lu avg60=%lu.%02lu avg300=%lu.%02lu total=%llu\n",
+            full ? "full" : "some", PSI_LOAD_INT(avg[full][0]),
+            PSI_LOAD_FRAC(avg[full][0]), PSI_LOAD_INT(avg[full][1]),
+            PSI_LOAD_FRAC(avg[full][1]), PSI_LOAD_INT(avg[full][2]),
+            PSI_LOAD_FRAC(avg[full][2]),
+            (unsigned long long)(total[full] / 1000));
+    }
+
+    *content_len = builder->size;
+    char *data = builder->data;
+    free(builder);
+    return data;
+}
+
+static void psi_avgs_fn(work_struct_t *work) {
+    psi_group_t *group, *tmp;
+    uint64_t now = nano_time();
+
+    (void)work;
+    spin_lock(&psi_groups_lock);
+    llist_for_each(group, tmp, &psi_groups, node) {
+        spin_lock(&group->lock);
+        psi_collect_locked(group, now);
+        psi_update_averages_locked(group, now);
+        spin_unlock(&group->lock);
+    }
+    spin_unlock(&psi_groups_lock);
+
+    schedule_delayed_work(&psi_avgs_work, PSI_FREQ_NS);
+}
+
+static void psi_trigger_check_locked(psi_trigger_t *trigger, uint64_t now) {
+    psi_group_t *group = trigger->group;
+    uint64_t value = group->total[trigger->state];
+    uint64_t growth = value - trigger->win_value;
+
+    if (growth >= trigger->threshold_ns &&
+        (!trigger->last_event || now - trigger->last_event >= trigger->win_ns)) {
+        trigger->last_event = now;
+        trigger->event = true;
+        if (trigger->inode)
+            vfs_poll_notify_inode(trigger->inode, EPOLLPRI);
+    }
+
+    if (now - trigger->win_start >= trigger->win_ns) {
+        trigger->win_start = now;
+        trigger->win_value = value;
+    }
+}
+
+static void psi_poll_fn(work_struct_t *work) {
+    psi_group_t *group, *tmp;
+    psi_trigger_t *trigger, *ttmp;
+    uint64_t now = nano_time();
+
+    (void)work;
+    spin_lock(&psi_groups_lock);
+    llist_for_each(group, tmp, &psi_groups, node) {
+        spin_lock(&group->lock);
+        if (!llist_empty(&group->triggers)) {
+            psi_collect_locked(group, now);
+            llist_for_each(trigger, ttmp, &group->triggers, node) {
+                psi_trigger_check_locked(trigger, now);
+            }
+        }
+        spin_unlock(&group->lock);
+    }
+    spin_unlock(&psi_groups_lock);
+
+    if (__atomic_load_n(&psi_nr_triggers, __ATOMIC_ACQUIRE))
+        schedule_delayed_work(&psi_poll_work, PSI_POLL_NS);
+}
+
+static int psi_parse_u64(const char **cursor, const char *end,
+                         uint64_t *value) {
+    const char *p = *cursor;
+    uint64_t parsed = 0;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p == end || *p < '0' || *p > '9')
+        return -EINVAL;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (parsed > (UINT64_MAX - 9) / 10)
+            return -EINVAL;
+        parsed = parsed * 10 + (uint64_t)(*p - '0');
+        p++;
+    }
+
+    *cursor = p;
+    *value = parsed;
+    return 0;
+}
+
+int psi_trigger_create(psi_group_t *group, psi_res_t res, const char *buf,
+                       size_t len, struct vfs_inode *inode,
+                       psi_trigger_t **ret) {
+    const char *p = buf;
+    const char *end = buf + len;
+    uint64_t threshold_us, win_us;
+    psi_trigger_t *trigger;
+    bool full;
+    uint64_t now;
+
+    if (!group || !buf || !ret || res >= NR_PSI_RESOURCES)
+        return -EINVAL;
+
+    if (len >= 5 && !memcmp(p, "some ", 5))
+        full = false;
+    else if (len >= 5 && !memcmp(p, "full ", 5))
+        full = true;
+    else
+        return -EINVAL;
+    p += 5;
+
+    if (psi_parse_u64(&p, end, &threshold_us) < 0 ||
+        psi_parse_u64(&p, end, &win_us) < 0)
+        return -EINVAL;
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\0'))
+        p++;
+    if (p != end)
+        return -EINVAL;
+
+    if (win_us < PSI_TRIG_MIN_WIN_US || win_us > PSI_TRIG_MAX_WIN_US)
+        return -EINVAL;
+    if (!threshold_us || threshold_us > win_us)
+        return -EINVAL;
+    if (group->is_system && res == PSI_CPU && full)
+        return -EINVAL;
+
+    trigger = calloc(1, sizeof(*trigger));
+    if (!trigger)
+        return -ENOMEM;
+
+    llist_init_head(&trigger->node);
+    trigger->group = group;
+    trigger->state = (enum psi_states)(res * 2 + (full ? 1 : 0));
+    trigger->threshold_ns = threshold_us * 1000;
+    trigger->win_ns = win_us * 1000;
+    trigger->inode = inode;
+
+    now = nano_time();
+    spin_lock(&group->lock);
+    psi_collect_locked(group, now);
+    trigger->win_start = now;
+    trigger->win_value = group->total[trigger->state];
+    llist_append(&group->triggers, &trigger->node);
+    spin_unlock(&group->lock);
+
+    if (__atomic_add_fetch(&psi_nr_triggers, 1, __ATOMIC_ACQ_REL) == 1 &&
+        psi_ready)
+        schedule_delayed_work(&psi_poll_work, PSI_POLL_NS);
+
+    *ret = trigger;
+    return 0;
+}
+
+void psi_trigger_destroy(psi_trigger_t *trigger) {
+    psi_group_t *group;
+
+    if (!trigger)
+        return;
+
+    group = trigger->group;
+    spin_lock(&group->lock);
+    llist_delete(&trigger->node);
+    spin_unlock(&group->lock);
+
+    __atomic_sub_fetch(&psi_nr_triggers, 1, __ATOMIC_ACQ_REL);
+    free(trigger);
+}
+
+uint32_t psi_trigger_poll(psi_trigger_t *trigger) {
+    uint32_t events = EPOLLIN | EPOLLRDNORM;
+
+    if (!trigger)
+        return events | EPOLLERR | EPOLLPRI;
+
+    spin_lock(&trigger->group->lock);
+    if (trigger->event) {
+        trigger->event = false;
+        events |= EPOLLPRI;
+    }
+    spin_unlock(&trigger->group->lock);
+    return events;
+}
+
+psi_group_t *psi_group_create(void) {
+    psi_group_t *group = calloc(1, sizeof(*group));
+
+    if (!group)
+        return NULL;
+
+    group->pcpu = calloc(MAX_CPU_NUM, sizeof(psi_group_cpu_t));
+    if (!group->pcpu) {
+        free(group);
+        return NULL;
+    }
+
+    llist_init_head(&group->node);
+    llist_init_head(&group->triggers);
+
+    spin_lock(&psi_groups_lock);
+    llist_append(&psi_groups, &group->node);
+    spin_unlock(&psi_groups_lock);
+    return group;
+}
+
+/* The cgroup is gone, so no task can reach the group any more. */
+void psi_group_destroy(psi_group_t *group) {
+    if (!group || group == &psi_system)
+        return;
+
+    spin_lock(&psi_groups_lock);
+    llist_delete(&group->node);
+    spin_unlock(&psi_groups_lock);
+
+    free(group->pcpu);
+    free(group);
+}
+
+void psi_init(void) {
+    spin_lock(&psi_groups_lock);
+    if (llist_empty(&psi_system.node))
+        llist_prepend(&psi_groups, &psi_system.node);
+    spin_unlock(&psi_groups_lock);
+
+    INIT_DELAYED_WORK(&psi_avgs_work, psi_avgs_fn);
+    INIT_DELAYED_WORK(&psi_poll_work, psi_poll_fn);
+    psi_ready = true;
+
+    schedule_delayed_work(&psi_avgs_work, PSI_FREQ_NS);
+    if (__atomic_load_n(&psi_nr_triggers, __ATOMIC_ACQUIRE))
+        schedule_delayed_work(&psi_poll_work, PSI_POLL_NS);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <libs/llist.h>
+
+struct task;
+struct cgroup;
+struct vfs_inode;
+
+/*
+ * Pressure stall information. Every task carries a few TSK_* bits saying
+ * what it is doing right now; each CPU of each group (the system and every
+ * cgroup above the task) counts those bits and times how long the counts
+ * spent in each stall state. Readers fold the per-CPU times into totals
+ * weighted by how busy each CPU was, and a 2s worker turns the totals into
+ * the avg10/avg60/avg300 running averages.
+ */
+
+typedef enum psi_res {
+    PSI_IO,
+    PSI_MEM,
+    PSI_CPU,
+    NR_PSI_RESOURCES,
+} psi_res_t;
+
+enum psi_states {
+    PSI_IO_SOME,
+    PSI_IO_FULL,
+    PSI_MEM_SOME,
+    PSI_MEM_FULL,
+    PSI_CPU_SOME,
+    PSI_CPU_FULL,
+    PSI_NONIDLE,
+    NR_PSI_STATES,
+};
+
+#define NR_PSI_STALL_STATES PSI_NONIDLE
+
+/* Task state bits, kept in task->psi_flags. */
+#define TSK_IOWAIT (1U << 0)
+#define TSK_MEMSTALL (1U << 1)
+#define TSK_RUNNING (1U << 2)
+#define TSK_ONCPU (1U << 3)
+
+enum psi_task_count {
+    NR_IOWAIT,
+    NR_MEMSTALL,
+    NR_RUNNING,
+    NR_ONCPU,
+    NR_STALL_RUNNING, // runnable, but stalled on memory or io
+    NR_PSI_TASK_COUNTS,
+};
+
+#define PSI_FREQ_NS (2ULL * 1000000000ULL)
+#define PSI_AVG_NR 3
+
+typedef struct psi_group_cpu {
+    spinlock_t lock;
+    uint32_t tasks[NR_PSI_TASK_COUNTS];
+    uint32_t state_mask;
+    uint64_t state_start;
+    uint64_t times[NR_PSI_STATES];
+    uint64_t times_prev[NR_PSI_STATES]; // last collected, under group lock
+} psi_group_cpu_t;
+
+typedef struct psi_group {
+    struct llist_header node;
+    psi_group_cpu_t *pcpu;
+    spinlock_t lock; // totals, averages and triggers
+    uint64_t total[NR_PSI_STALL_STATES];
+    uint64_t avg_total[NR_PSI_STALL_STATES];
+    unsigned long avg[NR_PSI_STALL_STATES][PSI_AVG_NR];
+    uint64_t avg_last_update;
+    uint64_t avg_next_update;
+    struct llist_header triggers;
+    bool is_system;
+} psi_group_t;
+
+typedef struct psi_trigger psi_trigger_t;
+
+extern psi_group_t psi_system;
+
+void psi_init(void);
+psi_group_t *psi_group_create(void);
+void psi_group_destroy(psi_group_t *group);
+
+/*
+ * Moves task's bits from its current flags to (flags & ~clear) | set.
+ * task->psi_lock keeps psi_flags, psi_cpu and cgroup consistent; it nests
+ * inside the runqueue locks and never allocates.
+ */
+void psi_task_change(struct task *task, uint32_t clear, uint32_t set);
+/* Swaps task->cgroup and carries the task's live counts across. */
+struct cgroup *psi_task_move_cgroup(struct task *task, struct cgroup *to);
+void psi_task_exit(struct task *task);
+
+/* Nest freely; only the outermost enter/leave pair changes state. */
+void psi_memstall_enter(unsigned long *flags);
+void psi_memstall_leave(unsigned long *flags);
+void psi_iowait_enter(unsigned long *flags);
+void psi_iowait_leave(unsigned long *flags);
+
+char *psi_show(psi_group_t *group, psi_res_t res, size_t *content_len);
+
+/*
+ * "some|full <threshold us> <window us>": the inode gets EPOLLPRI whenever
+ * the group stalled for threshold within one window, at most once a window.
+ */
+int psi_trigger_create(psi_group_t *group, psi_res_t res, const char *buf,
+                       size_t len, struct vfs_inode *inode,
+                       psi_trigger_t **ret);
+void psi_trigger_destroy(psi_trigger_t *trigger);
+uint32_t psi_trigger_poll(psi_trigger_t *trigger);
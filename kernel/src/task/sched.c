@@ -1,8 +1,12 @@
 #include "task/sched.h"
 #include <irq/irq_manager.h>
+#include <task/psi.h>
+#include <task/taskstats.h>
 
 extern sched_rq_t schedulers[MAX_CPU_NUM];
 
+sched_cpu_stats_t sched_cpu_stats[MAX_CPU_NUM];
+
 #define SCHED_NICE_MIN (-20)
 #define SCHED_NICE_MAX 19
 #define SCHED_NICE_0_LOAD 1024ULL
@@ -10,6 +14,7 @@ extern sched_rq_t schedulers[MAX_CPU_NUM];
 #define SCHED_LATENCY_NS 6000000ULL
 #define SCHED_MIN_GRANULARITY_NS 750000ULL
 #define SCHED_MAX_GRANULARITY_NS 4000000ULL
+#define SCHED_GROUP_MIN_LOAD 2ULL
 
 static const uint32_t sched_prio_to_weight[40] = {
     88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
@@ -32,16 +37,19 @@ static inline uint64_t sched_task_weight(task_t *task) {
     return sched_prio_to_weight[sched_task_nice(task) - SCHED_NICE_MIN];
 }
 
-static inline uint64_t sched_nice_weight(int nice) {
-    if (nice < SCHED_NICE_MIN)
-        nice = SCHED_NICE_MIN;
-    if (nice > SCHED_NICE_MAX)
-        nice = SCHED_NICE_MAX;
-    return sched_prio_to_weight[nice - SCHED_NICE_MIN];
+static inline uint64_t sched_entity_weight(struct sched_entity *se) {
+    if (se && se->weight)
+        return se->weight;
+    return sched_task_weight(se ? se->task : NULL);
 }
 
-static inline uint64_t sched_calc_delta_fair(uint64_t delta_ns, task_t *task) {
-    uint64_t weight = sched_task_weight(task);
+static inline uint32_t sched_rq_cpu(sched_rq_t *scheduler) {
+    return (uint32_t)(scheduler - schedulers);
+}
+
+static inline uint64_t sched_calc_delta_fair(uint64_t delta_ns,
+                                             struct sched_entity *se) {
+    uint64_t weight = sched_entity_weight(se);
 
     if (!delta_ns || weight == SCHED_NICE_0_LOAD)
         return delta_ns;
@@ -51,7 +59,7 @@ static inline uint64_t sched_calc_delta_fair(uint64_t delta_ns, task_t *task) {
 
 static inline uint64_t sched_entity_slice_locked(sched_rq_t *scheduler,
                                                  struct sched_entity *entity) {
-    uint64_t weight = sched_task_weight(entity ? entity->task : NULL);
+    uint64_t weight = sched_entity_weight(entity);
     uint64_t total_weight = scheduler ? scheduler->load_weight : weight;
     uint64_t slice = SCHED_LATENCY_NS;
 
@@ -73,7 +81,7 @@ static inline uint64_t sched_entity_deadline_locked(sched_rq_t *scheduler,
     uint64_t slice = sched_entity_slice_locked(scheduler, se);
 
     se->slice_ns = slice;
-    return se->vruntime + sched_calc_delta_fair(slice, se->task);
+    return se->vruntime + sched_calc_delta_fair(slice, se);
 }
 
 static inline bool sched_entity_eligible_locked(uint64_t min_vruntime,
@@ -172,7 +180,7 @@ static bool sched_entity_preempts_curr_locked(sched_rq_t *scheduler,
     uint64_t curr_deadline = curr->deadline;
     if (curr->account_start_ns && now_ns > curr->account_start_ns) {
         uint64_t runtime =
-            sched_calc_delta_fair(now_ns - curr->account_start_ns, curr->task);
+            sched_calc_delta_fair(now_ns - curr->account_start_ns, curr);
 
         curr_vruntime += runtime;
         curr_deadline += runtime;
@@ -186,11 +194,74 @@ static bool sched_entity_preempts_curr_locked(sched_rq_t *scheduler,
     return false;
 }
 
+/*
+ * Charges a runnable task's nice weight to its group's load on this CPU and
+ * activates every group above it that had nothing runnable here yet.
+ */
+static void sched_group_enqueue_locked(sched_rq_t *scheduler,
+                                       struct sched_entity *se) {
+    uint32_t cpu = sched_rq_cpu(scheduler);
+    uint64_t load = sched_task_weight(se->task);
+
+    se->group_load = load;
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        sched_group_cpu_t *gc = &group->pcpu[cpu];
+
+        gc->load += load;
+        if (gc->nr_running++)
+            break;
+        gc->contrib = group->load_weight;
+        load = gc->contrib;
+    }
+}
+
+static void sched_group_dequeue_locked(sched_rq_t *scheduler,
+                                       struct sched_entity *se) {
+    uint32_t cpu = sched_rq_cpu(scheduler);
+    uint64_t load = se->group_load;
+
+    if (!load)
+        return;
+
+    se->group_load = 0;
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        sched_group_cpu_t *gc = &group->pcpu[cpu];
+
+        gc->load = gc->load > load ? gc->load - load : 0;
+        if (gc->nr_running)
+            gc->nr_running--;
+        if (gc->nr_running)
+            break;
+        load = gc->contrib;
+        gc->contrib = 0;
+        gc->load = 0;
+    }
+}
+
+/* The task's share of its group, of the group's share of its parent, ... */
+static uint64_t sched_entity_calc_weight_locked(sched_rq_t *scheduler,
+                                                struct sched_entity *se) {
+    uint32_t cpu = sched_rq_cpu(scheduler);
+    uint64_t weight = sched_task_weight(se->task);
+
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        sched_group_cpu_t *gc = &group->pcpu[cpu];
+
+        if (!gc->load)
+            break;
+        weight = weight * gc->contrib / gc->load;
+    }
+
+    return weight < SCHED_GROUP_MIN_LOAD ? SCHED_GROUP_MIN_LOAD : weight;
+}
+
 static void sched_entity_enqueue_locked(sched_rq_t *scheduler,
                                         struct sched_entity *entity) {
     rb_node_t **slot = &scheduler->run_tree.rb_node;
     rb_node_t *parent = NULL;
 
+    sched_group_enqueue_locked(scheduler, entity);
+    entity->weight = sched_entity_calc_weight_locked(scheduler, entity);
     entity->deadline = sched_entity_deadline_locked(scheduler, entity);
     entity->subtree_min_vruntime = entity->vruntime;
 
@@ -219,7 +290,9 @@ static void sched_entity_enqueue_locked(sched_rq_t *scheduler,
     scheduler->nr_running++;
     __atomic_store_n(&scheduler->nr_running_snapshot, scheduler->nr_running,
                      __ATOMIC_RELAXED);
-    scheduler->load_weight += sched_task_weight(entity->task);
+    scheduler->load_weight += entity->weight;
+    if (entity->task)
+        psi_task_change(entity->task, 0, TSK_RUNNING);
 }
 
 static void sched_entity_dequeue_locked(sched_rq_t *scheduler,
@@ -231,6 +304,8 @@ static void sched_entity_dequeue_locked(sched_rq_t *scheduler,
 
     entity->on_rq = false;
     entity->rq = NULL;
+    if (entity->task)
+        psi_task_change(entity->task, TSK_RUNNING, 0);
     if (scheduler->nr_queued)
         scheduler->nr_queued--;
     if (scheduler->nr_running)
@@ -238,16 +313,42 @@ static void sched_entity_dequeue_locked(sched_rq_t *scheduler,
     __atomic_store_n(&scheduler->nr_running_snapshot, scheduler->nr_running,
                      __ATOMIC_RELAXED);
 
-    uint64_t weight = sched_task_weight(entity->task);
+    uint64_t weight = entity->weight;
     scheduler->load_weight =
         scheduler->load_weight > weight ? scheduler->load_weight - weight : 0;
+    sched_group_dequeue_locked(scheduler, entity);
     if (update_min_vruntime)
         sched_update_min_vruntime_locked(scheduler);
 }
 
+/*
+ * Re-derives the running entity's weight after its nice value, its group or
+ * its group's load changed; runtime so far is charged at the old weight.
+ */
+static void sched_curr_reweight_locked(sched_rq_t *scheduler,
+                                       struct sched_entity *entity,
+                                       uint64_t now_ns) {
+    if (entity->account_start_ns && now_ns > entity->account_start_ns) {
+        uint64_t delta_ns = now_ns - entity->account_start_ns;
+
+        entity->account_start_ns = now_ns;
+        entity->vruntime += sched_calc_delta_fair(delta_ns, entity);
+    }
+
+    uint64_t weight = sched_entity_calc_weight_locked(scheduler, entity);
+
+    scheduler->load_weight = scheduler->load_weight > entity->weight
+                                 ? scheduler->load_weight - entity->weight
+                                 : 0;
+    scheduler->load_weight += weight;
+    entity->weight = weight;
+
+    entity->slice_ns = sched_entity_slice_locked(scheduler, entity);
+    entity->deadline = sched_entity_deadline_locked(scheduler, entity);
+}
+
 static void sched_entity_reweight_current_locked(sched_rq_t *scheduler,
                                                  struct sched_entity *entity,
-                                                 uint64_t old_weight,
                                                  int new_nice,
                                                  uint64_t now_ns) {
     if (!scheduler || !entity)
@@ -257,26 +358,10 @@ static void sched_entity_reweight_current_locked(sched_rq_t *scheduler,
     if (!task)
         return;
 
-    if (entity->account_start_ns && now_ns > entity->account_start_ns) {
-        uint64_t delta_ns = now_ns - entity->account_start_ns;
-
-        entity->account_start_ns = now_ns;
-        if (old_weight == SCHED_NICE_0_LOAD)
-            entity->vruntime += delta_ns;
-        else
-            entity->vruntime += (delta_ns * SCHED_NICE_0_LOAD) / old_weight;
-    }
-
+    sched_group_dequeue_locked(scheduler, entity);
     task->nice = new_nice;
-    uint64_t new_weight = sched_task_weight(entity->task);
-
-    scheduler->load_weight = scheduler->load_weight > old_weight
-                                 ? scheduler->load_weight - old_weight
-                                 : 0;
-    scheduler->load_weight += new_weight;
-
-    entity->slice_ns = sched_entity_slice_locked(scheduler, entity);
-    entity->deadline = sched_entity_deadline_locked(scheduler, entity);
+    sched_group_enqueue_locked(scheduler, entity);
+    sched_curr_reweight_locked(scheduler, entity, now_ns);
 }
 
 static void sched_curr_attach_locked(sched_rq_t *scheduler,
@@ -288,11 +373,15 @@ static void sched_curr_attach_locked(sched_rq_t *scheduler,
     scheduler->nr_running++;
     __atomic_store_n(&scheduler->nr_running_snapshot, scheduler->nr_running,
                      __ATOMIC_RELAXED);
-    scheduler->load_weight += sched_task_weight(entity->task);
+    sched_group_enqueue_locked(scheduler, entity);
+    entity->weight = sched_entity_calc_weight_locked(scheduler, entity);
+    scheduler->load_weight += entity->weight;
     entity->exec_start_ns = now_ns;
     entity->account_start_ns = now_ns;
     entity->slice_ns = sched_entity_slice_locked(scheduler, entity);
     entity->deadline = sched_entity_deadline_locked(scheduler, entity);
+    if (entity->task)
+        psi_task_change(entity->task, 0, TSK_RUNNING | TSK_ONCPU);
 }
 
 static void sched_curr_detach_locked(sched_rq_t *scheduler,
@@ -305,11 +394,14 @@ static void sched_curr_detach_locked(sched_rq_t *scheduler,
     __atomic_store_n(&scheduler->nr_running_snapshot, scheduler->nr_running,
                      __ATOMIC_RELAXED);
 
-    uint64_t weight = sched_task_weight(entity->task);
+    uint64_t weight = entity->weight;
     scheduler->load_weight =
         scheduler->load_weight > weight ? scheduler->load_weight - weight : 0;
+    sched_group_dequeue_locked(scheduler, entity);
     entity->rq = NULL;
     entity->on_rq = false;
+    if (entity->task)
+        psi_task_change(entity->task, TSK_RUNNING | TSK_ONCPU, 0);
     sched_update_min_vruntime_locked(scheduler);
 }
 
@@ -319,6 +411,170 @@ static bool sched_entity_is_current_locked(sched_rq_t *scheduler,
            entity->rq == scheduler;
 }
 
+static sched_group_t *
+sched_entity_throttled_group_locked(sched_rq_t *scheduler,
+                                    struct sched_entity *se) {
+    uint32_t cpu = sched_rq_cpu(scheduler);
+
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        if (group->pcpu[cpu].throttled)
+            return group;
+    }
+    return NULL;
+}
+
+static bool sched_entity_in_group(struct sched_entity *se,
+                                  sched_group_t *ancestor) {
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        if (group == ancestor)
+            return true;
+    }
+    return false;
+}
+
+/* Parked entities stay bound to the runqueue but are never picked. */
+static void sched_entity_park_locked(sched_rq_t *scheduler,
+                                     struct sched_entity *se,
+                                     sched_group_t *group) {
+    se->throttled_by = group;
+    se->rq = scheduler;
+    se->on_rq = false;
+    llist_append(&group->pcpu[sched_rq_cpu(scheduler)].throttled_list,
+                 &se->throttle_node);
+    // still runnable as far as cpu pressure is concerned
+    if (se->task)
+        psi_task_change(se->task, 0, TSK_RUNNING);
+}
+
+static void sched_entity_unpark_locked(struct sched_entity *se) {
+    llist_delete(&se->throttle_node);
+    se->throttled_by = NULL;
+    se->rq = NULL;
+    if (se->task)
+        psi_task_change(se->task, TSK_RUNNING, 0);
+}
+
+static void sched_entity_place_locked(sched_rq_t *scheduler,
+                                      struct sched_entity *se) {
+    sched_group_t *throttled =
+        sched_entity_throttled_group_locked(scheduler, se);
+
+    if (throttled)
+        sched_entity_park_locked(scheduler, se, throttled);
+    else
+        sched_entity_enqueue_locked(scheduler, se);
+}
+
+static void sched_group_throttle_locked(sched_rq_t *scheduler,
+                                        sched_group_t *group,
+                                        uint64_t now_ns) {
+    sched_group_cpu_t *gc = &group->pcpu[sched_rq_cpu(scheduler)];
+    rb_node_t *node = rb_first(&scheduler->run_tree);
+
+    gc->throttled = true;
+    gc->throttled_at = now_ns;
+    __atomic_store_n(&group->throttled_in_period, true, __ATOMIC_RELAXED);
+
+    // the running entity gets parked when it comes off the CPU
+    while (node) {
+        struct sched_entity *se = rb_entry(node, struct sched_entity, run_node);
+
+        node = rb_next(node);
+        if (!sched_entity_in_group(se, group))
+            continue;
+        sched_entity_dequeue_locked(scheduler, se, false);
+        sched_entity_park_locked(scheduler, se, group);
+    }
+    sched_update_min_vruntime_locked(scheduler);
+}
+
+/* Tops the CPU's slice up from the period pool; false if the pool is dry. */
+static bool sched_group_acquire_runtime(sched_group_t *group,
+                                        sched_group_cpu_t *gc) {
+    spin_lock(&group->lock);
+    if (group->quota_ns == SCHED_BW_UNLIMITED) {
+        gc->runtime_ns = SCHED_BW_SLICE_NS;
+    } else {
+        uint64_t want = (uint64_t)((int64_t)SCHED_BW_SLICE_NS - gc->runtime_ns);
+        uint64_t grant = MIN(want, group->pool_ns);
+
+        group->pool_ns -= grant;
+        gc->runtime_ns += (int64_t)grant;
+    }
+    spin_unlock(&group->lock);
+    return gc->runtime_ns > 0;
+}
+
+/*
+ * Charges the running entity's last stretch to every group above it and
+ * throttles the first one that runs out of bandwidth. Returns true when
+ * the entity has to come off the CPU.
+ */
+static bool sched_group_charge_locked(sched_rq_t *scheduler,
+                                      struct sched_entity *se,
+                                      uint64_t delta_ns, uint64_t now_ns) {
+    uint32_t cpu = sched_rq_cpu(scheduler);
+    task_t *task = se->task;
+    uint64_t user_ns = 0;
+    uint64_t system_ns = 0;
+    bool throttled = false;
+
+    if (!se->group || !task)
+        return false;
+
+    if (task->user_time_ns > se->user_ns_seen)
+        user_ns = task->user_time_ns - se->user_ns_seen;
+    if (task->system_time_ns > se->system_ns_seen)
+        system_ns = task->system_time_ns - se->system_ns_seen;
+    se->user_ns_seen = task->user_time_ns;
+    se->system_ns_seen = task->system_time_ns;
+
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        sched_group_cpu_t *gc = &group->pcpu[cpu];
+
+        __atomic_add_fetch(&group->usage_ns, delta_ns, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&group->user_ns, user_ns, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&group->system_ns, system_ns, __ATOMIC_RELAXED);
+
+        if (__atomic_load_n(&group->quota_ns, __ATOMIC_RELAXED) ==
+                SCHED_BW_UNLIMITED ||
+            gc->throttled)
+            continue;
+
+        gc->runtime_ns -= (int64_t)delta_ns;
+        if (gc->runtime_ns > 0 || sched_group_acquire_runtime(group, gc))
+            continue;
+
+        sched_group_throttle_locked(scheduler, group, now_ns);
+        throttled = true;
+    }
+
+    return throttled;
+}
+
+/* When the running entity will have used up the slice of some group. */
+static uint64_t
+sched_entity_bandwidth_deadline_locked(sched_rq_t *scheduler,
+                                       struct sched_entity *se) {
+    uint32_t cpu = sched_rq_cpu(scheduler);
+    uint64_t left = UINT64_MAX;
+
+    for (sched_group_t *group = se->group; group; group = group->parent) {
+        sched_group_cpu_t *gc = &group->pcpu[cpu];
+
+        if (gc->throttled)
+            return 0;
+        if (__atomic_load_n(&group->quota_ns, __ATOMIC_RELAXED) ==
+            SCHED_BW_UNLIMITED)
+            continue;
+        left = MIN(left, gc->runtime_ns > 0 ? (uint64_t)gc->runtime_ns : 0);
+    }
+
+    if (left == UINT64_MAX)
+        return UINT64_MAX;
+    return se->account_start_ns + left;
+}
+
 static void sched_add_entity(task_t *task, sched_rq_t *scheduler, bool wakeup) {
     if (__builtin_expect(!task || !scheduler || !task->sched_info, 0))
         return;
@@ -344,7 +600,8 @@ static void sched_add_entity(task_t *task, sched_rq_t *scheduler, bool wakeup) {
         return;
     }
 
-    if (entity->on_rq || sched_entity_is_current_locked(scheduler, entity)) {
+    if (entity->on_rq || entity->throttled_by ||
+        sched_entity_is_current_locked(scheduler, entity)) {
         spin_unlock(&scheduler->lock);
         return;
     }
@@ -362,8 +619,22 @@ static void sched_add_entity(task_t *task, sched_rq_t *scheduler, bool wakeup) {
     if (entity->vruntime < placement)
         entity->vruntime = placement;
 
+    sched_group_t *throttled =
+        sched_entity_throttled_group_locked(scheduler, entity);
+    if (throttled) {
+        sched_entity_park_locked(scheduler, entity, throttled);
+        spin_unlock(&scheduler->lock);
+        return;
+    }
+
     sched_entity_enqueue_locked(scheduler, entity);
     sched_update_min_vruntime_locked(scheduler);
+    task->sched_enqueued_ns = now_ns;
+    if (wakeup && target_cpu < MAX_CPU_NUM) {
+        sched_stat_add(&sched_cpu_stats[target_cpu].ttwu_count, 1);
+        if (target_cpu == current_cpu_id)
+            sched_stat_add(&sched_cpu_stats[target_cpu].ttwu_local, 1);
+    }
 
     if (scheduler->curr && scheduler->curr->task &&
         scheduler->curr->task != task &&
@@ -402,6 +673,8 @@ void remove_sched_entity(task_t *task, sched_rq_t *scheduler) {
         sched_entity_dequeue_locked(scheduler, entity, true);
     } else if (sched_entity_is_current_locked(scheduler, entity)) {
         sched_curr_detach_locked(scheduler, entity);
+    } else if (entity->throttled_by && entity->rq == scheduler) {
+        sched_entity_unpark_locked(entity);
     }
 
     spin_unlock(&scheduler->lock);
@@ -419,6 +692,8 @@ void sched_account_runtime_until(task_t *task, uint64_t now_ns) {
     if (!scheduler)
         return;
 
+    bool throttled = false;
+
     spin_lock(&scheduler->lock);
 
     bool was_queued = entity->on_rq && entity->rq == scheduler;
@@ -429,12 +704,19 @@ void sched_account_runtime_until(task_t *task, uint64_t now_ns) {
         entity->account_start_ns && now_ns > entity->account_start_ns
             ? now_ns - entity->account_start_ns
             : 0;
-    entity->vruntime += sched_calc_delta_fair(delta_ns, task);
+    entity->vruntime += sched_calc_delta_fair(delta_ns, entity);
 
     if (sched_entity_is_current_locked(scheduler, entity)) {
         entity->account_start_ns = now_ns;
-        entity->slice_ns = sched_entity_slice_locked(scheduler, entity);
-        entity->deadline = sched_entity_deadline_locked(scheduler, entity);
+        if (entity != scheduler->idle) {
+            throttled =
+                sched_group_charge_locked(scheduler, entity, delta_ns, now_ns);
+            // group loads around it may have moved since it was picked
+            sched_curr_reweight_locked(scheduler, entity, now_ns);
+        } else {
+            entity->slice_ns = sched_entity_slice_locked(scheduler, entity);
+            entity->deadline = sched_entity_deadline_locked(scheduler, entity);
+        }
     }
 
     if (was_queued)
@@ -443,6 +725,9 @@ void sched_account_runtime_until(task_t *task, uint64_t now_ns) {
     sched_update_min_vruntime_locked(scheduler);
 
     spin_unlock(&scheduler->lock);
+
+    if (throttled)
+        task_set_need_resched_once(task);
 }
 
 void sched_set_task_nice(task_t *task, int niceval) {
@@ -480,9 +765,8 @@ void sched_set_task_nice(task_t *task, int niceval) {
         task->nice = niceval;
         sched_entity_enqueue_locked(scheduler, entity);
     } else if (sched_entity_is_current_locked(scheduler, entity)) {
-        uint64_t old_weight = sched_nice_weight(task->nice);
-        sched_entity_reweight_current_locked(scheduler, entity, old_weight,
-                                             niceval, now_ns);
+        sched_entity_reweight_current_locked(scheduler, entity, niceval,
+                                             now_ns);
     } else {
         task->nice = niceval;
     }
@@ -492,6 +776,154 @@ void sched_set_task_nice(task_t *task, int niceval) {
     spin_unlock(&scheduler->lock);
 }
 
+void sched_move_task(task_t *task, sched_group_t *group) {
+    if (!task || !task->sched_info)
+        return;
+
+    struct sched_entity *entity = task->sched_info;
+    sched_rq_t *scheduler = entity->rq;
+    bool throttled = false;
+
+    if (!scheduler && task->cpu_id < MAX_CPU_NUM)
+        scheduler = &schedulers[task->cpu_id];
+    if (!scheduler) {
+        entity->group = group;
+        return;
+    }
+
+    spin_lock(&scheduler->lock);
+
+    if (entity->group == group)
+        goto out;
+
+    if (entity->on_rq && entity->rq == scheduler) {
+        sched_entity_dequeue_locked(scheduler, entity, false);
+        entity->group = group;
+        sched_entity_place_locked(scheduler, entity);
+    } else if (sched_entity_is_current_locked(scheduler, entity)) {
+        sched_group_dequeue_locked(scheduler, entity);
+        entity->group = group;
+        sched_group_enqueue_locked(scheduler, entity);
+        sched_curr_reweight_locked(scheduler, entity, nano_time());
+        throttled =
+            sched_entity_throttled_group_locked(scheduler, entity) != NULL;
+    } else if (entity->throttled_by && entity->rq == scheduler) {
+        sched_entity_unpark_locked(entity);
+        entity->group = group;
+        sched_entity_place_locked(scheduler, entity);
+    } else {
+        entity->group = group;
+    }
+
+    // cpu.stat of the new group starts from here
+    entity->user_ns_seen = task->user_time_ns;
+    entity->system_ns_seen = task->system_time_ns;
+    sched_update_min_vruntime_locked(scheduler);
+
+out:
+    spin_unlock(&scheduler->lock);
+
+    if (throttled)
+        task_set_need_resched_once(task);
+}
+
+/*
+ * cpu.weight changed: fix up what the group adds to its parent here, then
+ * reweight every entity whose share came from either, so the change holds
+ * for tasks that stay runnable instead of at their next wakeup.
+ */
+void sched_group_refresh_cpu(sched_group_t *group, uint32_t cpu) {
+    sched_rq_t *scheduler = &schedulers[cpu];
+    sched_group_cpu_t *gc = &group->pcpu[cpu];
+    sched_group_t *scope = group->parent ? group->parent : group;
+    struct sched_entity *se, *tmp;
+    struct llist_header requeue;
+    rb_node_t *node;
+
+    llist_init_head(&requeue);
+    spin_lock(&scheduler->lock);
+    if (!gc->nr_running)
+        goto out;
+
+    uint64_t weight = group->load_weight;
+
+    if (group->parent) {
+        sched_group_cpu_t *pgc = &group->parent->pcpu[cpu];
+
+        pgc->load = pgc->load > gc->contrib ? pgc->load - gc->contrib : 0;
+        pgc->load += weight;
+    }
+    gc->contrib = weight;
+
+    // queued entities are never parked, so throttle_node is free to use
+    node = rb_first(&scheduler->run_tree);
+    while (node) {
+        se = rb_entry(node, struct sched_entity, run_node);
+        node = rb_next(node);
+        if (!sched_entity_in_group(se, scope))
+            continue;
+        sched_entity_dequeue_locked(scheduler, se, false);
+        llist_append(&requeue, &se->throttle_node);
+    }
+    llist_for_each(se, tmp, &requeue, throttle_node) {
+        llist_delete(&se->throttle_node);
+        sched_entity_enqueue_locked(scheduler, se);
+    }
+
+    se = scheduler->curr;
+    if (se && se != scheduler->idle &&
+        sched_entity_is_current_locked(scheduler, se) &&
+        sched_entity_in_group(se, scope))
+        sched_curr_reweight_locked(scheduler, se, nano_time());
+    sched_update_min_vruntime_locked(scheduler);
+
+out:
+    spin_unlock(&scheduler->lock);
+}
+
+/* The period timer refilled the pool: put the parked entities back. */
+void sched_group_unthrottle_cpu(sched_group_t *group, uint32_t cpu) {
+    sched_rq_t *scheduler = &schedulers[cpu];
+    sched_group_cpu_t *gc = &group->pcpu[cpu];
+    struct sched_entity *se, *tmp;
+    task_t *resched_task = NULL;
+    uint64_t now_ns = nano_time();
+    bool preempt = false;
+
+    spin_lock(&scheduler->lock);
+
+    if (!gc->throttled)
+        goto out;
+    if (gc->runtime_ns <= 0 && !sched_group_acquire_runtime(group, gc))
+        goto out;
+
+    gc->throttled = false;
+    if (now_ns > gc->throttled_at)
+        __atomic_add_fetch(&group->throttled_ns, now_ns - gc->throttled_at,
+                           __ATOMIC_RELAXED);
+
+    llist_for_each(se, tmp, &gc->throttled_list, throttle_node) {
+        sched_entity_unpark_locked(se);
+        if (se->vruntime < scheduler->min_vruntime)
+            se->vruntime = scheduler->min_vruntime;
+        sched_entity_place_locked(scheduler, se);
+        if (se->on_rq &&
+            sched_entity_preempts_curr_locked(scheduler, se, now_ns))
+            preempt = true;
+    }
+    sched_update_min_vruntime_locked(scheduler);
+
+    if (preempt && scheduler->curr)
+        resched_task = scheduler->curr->task;
+
+out:
+    spin_unlock(&scheduler->lock);
+
+    if (resched_task && task_set_need_resched_once(resched_task) &&
+        cpu != current_cpu_id)
+        irq_trigger_sched_ipi(cpu);
+}
+
 static struct sched_entity *sched_first_eligible_locked(sched_rq_t *scheduler,
                                                         rb_node_t *node,
                                                         uint64_t max_vruntime,
@@ -614,6 +1046,13 @@ bool sched_should_preempt(sched_rq_t *scheduler, task_t *curr_task,
         goto out;
     }
 
+    // out of cpu.max runtime: go fetch more, or get throttled
+    if (sched_entity_is_current_locked(scheduler, curr) &&
+        sched_entity_bandwidth_deadline_locked(scheduler, curr) <= now_ns) {
+        should_preempt = true;
+        goto out;
+    }
+
     if (!scheduler->nr_queued)
         goto out;
 
@@ -672,7 +1111,7 @@ uint64_t sched_next_preempt_deadline(sched_rq_t *scheduler, task_t *curr_task,
         curr_task->current_state != TASK_RUNNING)
         goto out_now;
     if (!scheduler->nr_queued)
-        goto out;
+        goto out_bandwidth;
 
     uint64_t slice_ns = curr->slice_ns
                             ? curr->slice_ns
@@ -682,6 +1121,12 @@ uint64_t sched_next_preempt_deadline(sched_rq_t *scheduler, task_t *curr_task,
     if (now_ns >= start_ns + slice_ns)
         goto out_now;
     deadline = start_ns + slice_ns;
+
+out_bandwidth:
+    deadline = MIN(deadline, sched_entity_bandwidth_deadline_locked(
+                                 scheduler, curr));
+    if (deadline < now_ns)
+        deadline = now_ns;
     goto out;
 
 out_now:
@@ -709,7 +1154,10 @@ static task_t *sched_pick_next_task_internal(sched_rq_t *scheduler,
 
         if (scheduler->idle != entity &&
             sched_entity_is_current_locked(scheduler, entity)) {
-            if (yielded && !scheduler->nr_queued) {
+            bool throttled =
+                sched_entity_throttled_group_locked(scheduler, entity) != NULL;
+
+            if (yielded && !scheduler->nr_queued && !throttled) {
                 next_task = requeue_task;
                 goto out;
             }
@@ -720,10 +1168,10 @@ static task_t *sched_pick_next_task_internal(sched_rq_t *scheduler,
             if (yielded && scheduler->nr_queued &&
                 entity->vruntime != UINT64_MAX)
                 entity->vruntime++;
-            if (yielded)
+            if (yielded && !throttled)
                 deferred_enqueue = entity;
             else
-                sched_entity_enqueue_locked(scheduler, entity);
+                sched_entity_place_locked(scheduler, entity);
         }
     }
 
@@ -815,3 +1263,71 @@ size_t sched_rq_nr_running_snapshot(sched_rq_t *scheduler) {
 
     return __atomic_load_n(&scheduler->nr_running_snapshot, __ATOMIC_RELAXED);
 }
+
+/*
+ * Called by schedule() with interrupts off, right before it switches from
+ * prev to next on cpu. A prev that stays runnable was requeued without
+ * going through sched_add_entity(), so its wait starts here.
+ */
+void sched_stats_account_switch(uint32_t cpu, task_t *prev, task_t *next,
+                                uint64_t now_ns) {
+    sched_cpu_stats_t *stats;
+    task_t *idle;
+
+    if (cpu >= MAX_CPU_NUM)
+        return;
+
+    stats = &sched_cpu_stats[cpu];
+    idle = idle_tasks[cpu];
+    if (prev != idle && stats->switch_in_ns && now_ns > stats->switch_in_ns)
+        sched_stat_add(&stats->run_ns, now_ns - stats->switch_in_ns);
+    stats->switch_in_ns = now_ns;
+    if (prev != idle && prev->state == TASK_READY)
+        prev->sched_enqueued_ns = now_ns;
+
+    if (next == idle) {
+        sched_stat_add(&stats->sched_goidle, 1);
+    } else {
+        uint64_t wait_ns = 0;
+
+        if (next->sched_enqueued_ns && now_ns > next->sched_enqueued_ns)
+            wait_ns = now_ns - next->sched_enqueued_ns;
+        sched_stat_add(&stats->run_delay_ns, wait_ns);
+        sched_stat_add(&stats->pcount, 1);
+        task_delay_add(next, TASK_DELAY_CPU, wait_ns);
+    }
+    next->sched_enqueued_ns = 0;
+    sched_stat_add(&stats->nr_switches, 1);
+}
+
+void sched_cpu_stats_read(uint32_t cpu, sched_cpu_stats_t *out) {
+    sched_cpu_stats_t *stats;
+
+    memset(out, 0, sizeof(*out));
+    if (cpu >= MAX_CPU_NUM)
+        return;
+
+    stats = &sched_cpu_stats[cpu];
+    out->yld_count = __atomic_load_n(&stats->yld_count, __ATOMIC_RELAXED);
+    out->sched_count = __atomic_load_n(&stats->sched_count, __ATOMIC_RELAXED);
+    out->sched_goidle =
+        __atomic_load_n(&stats->sched_goidle, __ATOMIC_RELAXED);
+    out->ttwu_count = __atomic_load_n(&stats->ttwu_count, __ATOMIC_RELAXED);
+    out->ttwu_local = __atomic_load_n(&stats->ttwu_local, __ATOMIC_RELAXED);
+    out->run_ns = __atomic_load_n(&stats->run_ns, __ATOMIC_RELAXED);
+    out->run_delay_ns =
+        __atomic_load_n(&stats->run_delay_ns, __ATOMIC_RELAXED);
+    out->pcount = __atomic_load_n(&stats->pcount, __ATOMIC_RELAXED);
+    out->nr_switches = __atomic_load_n(&stats->nr_switches, __ATOMIC_RELAXED);
+}
+
+uint64_t sched_nr_switches(void) {
+    uint64_t online_cpus =
+        cpu_count ? MIN(cpu_count, (uint64_t)MAX_CPU_NUM) : 1;
+    uint64_t sum = 0;
+
+    for (uint64_t cpu = 0; cpu < online_cpus; cpu++)
+        sum += __atomic_load_n(&sched_cpu_stats[cpu].nr_switches,
+                               __ATOMIC_RELAXED);
+    return sum;
+}
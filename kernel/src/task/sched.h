@@ -1,10 +1,12 @@
 #pragma once
 
 #include <libs/klibc.h>
+#include <libs/llist.h>
 #include <libs/rbtree.h>
 #include <task/task.h>
 
 struct sched_rq;
+struct sched_group;
 
 struct sched_entity {
     task_t *task;
@@ -16,9 +18,69 @@ struct sched_entity {
     uint64_t exec_start_ns;
     uint64_t account_start_ns;
     uint64_t subtree_min_vruntime;
+    uint64_t weight;       // share of the CPU charged to rq->load_weight
+    uint64_t group_load;   // nice weight charged to the group's CPU load
+    uint64_t user_ns_seen; // task times already folded into cpu.stat
+    uint64_t system_ns_seen;
+    struct sched_group *group;        // NULL in the root cgroup
+    struct sched_group *throttled_by; // parked on its throttled list
+    struct llist_header throttle_node;
     bool on_rq;
 };
 
+/*
+ * cgroup cpu controller. The run tree stays flat: a task's weight is its
+ * nice weight scaled, level by level, by its group's cpu.weight over
+ * everything runnable beside it on that CPU, so a group with ten busy
+ * tasks gets what a single task of the same weight would. Each level keeps
+ * per-CPU loads under the runqueue lock to make that a short walk up.
+ *
+ * cpu.max hands out runtime from a per-period pool in slices; a CPU that
+ * runs out of slice and finds the pool dry parks the group's entities on
+ * a per-CPU list until the period timer refills the pool.
+ */
+#define SCHED_GROUP_WEIGHT_DFL 100ULL
+#define SCHED_GROUP_WEIGHT_MIN 1ULL
+#define SCHED_GROUP_WEIGHT_MAX 10000ULL
+#define SCHED_BW_UNLIMITED UINT64_MAX
+#define SCHED_BW_PERIOD_DFL_NS 100000000ULL
+#define SCHED_BW_PERIOD_MIN_NS 1000000ULL
+#define SCHED_BW_PERIOD_MAX_NS 1000000000ULL
+#define SCHED_BW_QUOTA_MIN_NS 1000000ULL
+#define SCHED_BW_SLICE_NS 5000000ULL
+
+typedef struct sched_group_cpu {
+    uint64_t load;       // runnable own tasks plus active child groups
+    uint64_t contrib;    // weight this group adds to its parent's load
+    uint32_t nr_running; // runnable own tasks plus active child groups
+    int64_t runtime_ns;  // bandwidth slice left on this CPU
+    uint64_t throttled_at;
+    bool throttled;
+    struct llist_header throttled_list;
+} sched_group_cpu_t;
+
+typedef struct sched_group {
+    struct sched_group *parent; // NULL below the root cgroup
+    sched_group_cpu_t *pcpu;    // under each CPU's runqueue lock
+    uint64_t weight;            // cpu.weight
+    uint64_t load_weight;       // cpu.weight on the nice-0 = 1024 scale
+
+    spinlock_t lock; // the bandwidth pool and its period
+    struct llist_header bw_node;
+    uint64_t quota_ns;
+    uint64_t period_ns;
+    uint64_t pool_ns;
+    uint64_t period_end_ns;
+    bool throttled_in_period;
+
+    uint64_t usage_ns; // hierarchical, atomics
+    uint64_t user_ns;
+    uint64_t system_ns;
+    uint64_t nr_periods;
+    uint64_t nr_throttled;
+    uint64_t throttled_ns;
+} sched_group_t;
+
 typedef struct sched_rq {
     rb_root_t run_tree;
     struct sched_entity *idle;
@@ -32,6 +94,34 @@ typedef struct sched_rq {
     spinlock_t lock;
 } sched_rq_t;
 
+/*
+ * Per-CPU counters behind /proc/schedstat, named after the fields of its
+ * cpuN lines. The owning CPU and wakers elsewhere add with relaxed atomics.
+ */
+typedef struct sched_cpu_stats {
+    uint64_t yld_count;    // schedule() calls from sched_yield
+    uint64_t sched_count;  // schedule() calls that looked for a task
+    uint64_t sched_goidle; // switches to the idle task
+    uint64_t ttwu_count;   // wakeups queued here
+    uint64_t ttwu_local;   // ... by a waker running here
+    uint64_t run_ns;       // time non-idle tasks ran here
+    uint64_t run_delay_ns; // time tasks sat runnable on this runqueue
+    uint64_t pcount;       // timeslices handed to non-idle tasks
+    uint64_t nr_switches;
+    uint64_t switch_in_ns; // when curr came on, owner only
+} __cacheline_aligned_smp sched_cpu_stats_t;
+
+extern sched_cpu_stats_t sched_cpu_stats[MAX_CPU_NUM];
+
+static inline void sched_stat_add(uint64_t *counter, uint64_t delta) {
+    __atomic_fetch_add(counter, delta, __ATOMIC_RELAXED);
+}
+
+void sched_stats_account_switch(uint32_t cpu, task_t *prev, task_t *next,
+                                uint64_t now_ns);
+void sched_cpu_stats_read(uint32_t cpu, sched_cpu_stats_t *out);
+uint64_t sched_nr_switches(void);
+
 void add_sched_entity(task_t *task, sched_rq_t *scheduler);
 void add_sched_entity_wakeup(task_t *task, sched_rq_t *scheduler);
 void remove_sched_entity(task_t *task, sched_rq_t *scheduler);
@@ -48,3 +138,17 @@ task_t *sched_pick_next_task_excluding(sched_rq_t *scheduler, task_t *excluded);
 size_t sched_rq_nr_running(sched_rq_t *scheduler);
 size_t sched_rq_nr_queued(sched_rq_t *scheduler);
 size_t sched_rq_nr_running_snapshot(sched_rq_t *scheduler);
+
+/* Makes task's entity follow it into group (NULL for the root cgroup). */
+void sched_move_task(task_t *task, sched_group_t *group);
+void sched_group_refresh_cpu(sched_group_t *group, uint32_t cpu);
+void sched_group_unthrottle_cpu(sched_group_t *group, uint32_t cpu);
+
+sched_group_t *sched_group_create(sched_group_t *parent);
+void sched_group_destroy(sched_group_t *group);
+int sched_group_set_weight(sched_group_t *group, uint64_t weight);
+int sched_group_set_bandwidth(sched_group_t *group, uint64_t quota_ns,
+                              uint64_t period_ns);
+char *sched_group_show_weight(sched_group_t *group, size_t *content_len);
+char *sched_group_show_max(sched_group_t *group, size_t *content_len);
+char *sched_group_show_stat(sched_group_t *group, size_t *content_len);
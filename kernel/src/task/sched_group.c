@@ -0,0 +1,268 @@
+#include <task/sched.h>
+#include <task/workqueue.h>
+#include <libs/string_builder.h>
+
+/* Groups with a cpu.max quota, refilled by one timer at each period end. */
+static DEFINE_LLIST(sched_bw_groups);
+static spinlock_t sched_bw_lock;
+static delayed_work_t sched_bw_work;
+static bool sched_bw_ready;
+
+static uint64_t sched_group_weight_to_load(uint64_t weight) {
+    return weight * 1024ULL / SCHED_GROUP_WEIGHT_DFL;
+}
+
+sched_group_t *sched_group_create(sched_group_t *parent) {
+    sched_group_t *group = calloc(1, sizeof(*group));
+
+    if (!group)
+        return NULL;
+
+    group->pcpu = calloc(MAX_CPU_NUM, sizeof(sched_group_cpu_t));
+    if (!group->pcpu) {
+        free(group);
+        return NULL;
+    }
+    for (uint32_t cpu = 0; cpu < MAX_CPU_NUM; cpu++)
+        llist_init_head(&group->pcpu[cpu].throttled_list);
+
+    group->parent = parent;
+    group->weight = SCHED_GROUP_WEIGHT_DFL;
+    group->load_weight = sched_group_weight_to_load(group->weight);
+    spin_init(&group->lock);
+    llist_init_head(&group->bw_node);
+    group->quota_ns = SCHED_BW_UNLIMITED;
+    group->period_ns = SCHED_BW_PERIOD_DFL_NS;
+    return group;
+}
+
+static void sched_group_unthrottle(sched_group_t *group) {
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        if (__atomic_load_n(&group->pcpu[cpu].throttled, __ATOMIC_RELAXED))
+            sched_group_unthrottle_cpu(group, cpu);
+    }
+}
+
+/* The cgroup is gone, so no task is left to run under the group. */
+void sched_group_destroy(sched_group_t *group) {
+    if (!group)
+        return;
+
+    /*
+     * The period work walks the list and unthrottles under sched_bw_lock,
+     * so once the group is off the list no callback can still be on it.
+     */
+    spin_lock(&sched_bw_lock);
+    if (!llist_empty(&group->bw_node))
+        llist_delete(&group->bw_node);
+    spin_unlock(&sched_bw_lock);
+
+    // an unlimited pool always has a slice, so every CPU lets go
+    spin_lock(&group->lock);
+    group->quota_ns = SCHED_BW_UNLIMITED;
+    spin_unlock(&group->lock);
+    sched_group_unthrottle(group);
+
+    for (uint32_t cpu = 0; cpu < MAX_CPU_NUM; cpu++) {
+        ASSERT(!group->pcpu[cpu].throttled);
+        ASSERT(llist_empty(&group->pcpu[cpu].throttled_list));
+    }
+
+    free(group->pcpu);
+    free(group);
+}
+
+static uint64_t sched_bw_next_locked(void) {
+    sched_group_t *group, *tmp;
+    uint64_t next = UINT64_MAX;
+
+    llist_for_each(group, tmp, &sched_bw_groups, bw_node) {
+        next = MIN(next, group->period_end_ns);
+    }
+    return next;
+}
+
+static void sched_bw_period_fn(work_struct_t *work) {
+    sched_group_t *group, *tmp;
+    uint64_t now = nano_time();
+    uint64_t next;
+
+    (void)work;
+
+    spin_lock(&sched_bw_lock);
+    llist_for_each(group, tmp, &sched_bw_groups, bw_node) {
+        if (now < group->period_end_ns)
+            continue;
+
+        spin_lock(&group->lock);
+        // periods nobody ran in are not counted
+        if (group->pool_ns != group->quota_ns || group->throttled_in_period)
+            group->nr_periods++;
+        if (group->throttled_in_period)
+            group->nr_throttled++;
+        group->throttled_in_period = false;
+        group->pool_ns = group->quota_ns;
+        group->period_end_ns +=
+            ((now - group->period_end_ns) / group->period_ns + 1) *
+            group->period_ns;
+        spin_unlock(&group->lock);
+
+        sched_group_unthrottle(group);
+    }
+    next = sched_bw_next_locked();
+    spin_unlock(&sched_bw_lock);
+
+    if (next != UINT64_MAX)
+        schedule_delayed_work(&sched_bw_work, next > now ? next - now : 0);
+}
+
+int sched_group_set_weight(sched_group_t *group, uint64_t weight) {
+    if (!group)
+        return -EINVAL;
+    if (weight < SCHED_GROUP_WEIGHT_MIN || weight > SCHED_GROUP_WEIGHT_MAX)
+        return -ERANGE;
+
+    group->weight = weight;
+    __atomic_store_n(&group->load_weight, sched_group_weight_to_load(weight),
+                     __ATOMIC_RELAXED);
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++)
+        sched_group_refresh_cpu(group, cpu);
+    return 0;
+}
+
+int sched_group_set_bandwidth(sched_group_t *group, uint64_t quota_ns,
+                              uint64_t period_ns) {
+    uint64_t now = nano_time();
+    uint64_t next;
+
+    if (!group)
+        return -EINVAL;
+    if (period_ns < SCHED_BW_PERIOD_MIN_NS ||
+        period_ns > SCHED_BW_PERIOD_MAX_NS)
+        return -EINVAL;
+    if (quota_ns != SCHED_BW_UNLIMITED && quota_ns < SCHED_BW_QUOTA_MIN_NS)
+        return -EINVAL;
+
+    spin_lock(&sched_bw_lock);
+
+    spin_lock(&group->lock);
+    group->quota_ns = quota_ns;
+    group->period_ns = period_ns;
+    group->pool_ns = quota_ns == SCHED_BW_UNLIMITED ? 0 : quota_ns;
+    group->period_end_ns = now + period_ns;
+    group->throttled_in_period = false;
+    spin_unlock(&group->lock);
+
+    if (quota_ns == SCHED_BW_UNLIMITED) {
+        if (!llist_empty(&group->bw_node))
+            llist_delete(&group->bw_node);
+    } else if (llist_empty(&group->bw_node)) {
+        llist_append(&sched_bw_groups, &group->bw_node);
+    }
+
+    if (!sched_bw_ready) {
+        INIT_DELAYED_WORK(&sched_bw_work, sched_bw_period_fn);
+        sched_bw_ready = true;
+    }
+    next = sched_bw_next_locked();
+
+    spin_unlock(&sched_bw_lock);
+
+    // the pool is full again, whatever it held back may run
+    sched_group_unthrottle(group);
+
+    if (next != UINT64_MAX) {
+        cancel_delayed_work(&sched_bw_work);
+        schedule_delayed_work(&sched_bw_work, next > now ? next - now : 0);
+    }
+    return 0;
+}
+
+static char *sched_group_finish(string_builder_t *builder,
+                                size_t *content_len) {
+    char *data = builder->data;
+
+    *content_len = builder->size;
+    free(builder);
+    return data;
+}
+
+char *sched_group_show_weight(sched_group_t *group, size_t *content_len) {
+    string_builder_t *builder;
+
+    *content_len = 0;
+    if (!group)
+        return NULL;
+    builder = create_string_builder(16);
+    if (!builder)
+        return NULL;
+
+    string_builder_append(builder, "%llu\n", (unsigned long long)group->weight);
+    return sched_group_finish(builder, content_len);
+}
+
+char *sched_group_show_max(sched_group_t *group, size_t *content_len) {
+    string_builder_t *builder;
+    uint64_t quota_ns, period_ns;
+
+    *content_len = 0;
+    if (!group)
+        return NULL;
+    builder = create_string_builder(32);
+    if (!builder)
+        return NULL;
+
+    spin_lock(&group->lock);
+    quota_ns = group->quota_ns;
+    period_ns = group->period_ns;
+    spin_unlock(&group->lock);
+
+    if (quota_ns == SCHED_BW_UNLIMITED)
+        string_builder_append(builder, "max %llu\n",
+                              (unsigned long long)(period_ns / 1000));
+    else
+        string_builder_append(builder, "%llu %llu\n",
+                              (unsigned long long)(quota_ns / 1000),
+                              (unsigned long long)(period_ns / 1000));
+    return sched_group_finish(builder, content_len);
+}
+
+char *sched_group_show_stat(sched_group_t *group, size_t *content_len) {
+    string_builder_t *builder;
+    uint64_t nr_periods, nr_throttled;
+
+    *content_len = 0;
+    if (!group)
+        return NULL;
+    builder = create_string_builder(192);
+    if (!builder)
+        return NULL;
+
+    spin_lock(&group->lock);
+    nr_periods = group->nr_periods;
+    nr_throttled = group->nr_throttled;
+    spin_unlock(&group->lock);
+
+    string_builder_append(
+        builder,
+        "usage_usec %llu\n"
+        "user_usec %llu\n"
+        "system_usec %llu\n"
+        "nr_periods %llu\n"
+        "nr_throttled %llu\n"
+        "throttled_usec %llu\n",
+        (unsigned long long)(__atomic_load_n(&group->usage_ns,
+                                             __ATOMIC_RELAXED) /
+                             1000),
+        (unsigned long long)(__atomic_load_n(&group->user_ns,
+                                             __ATOMIC_RELAXED) /
+                             1000),
+        (unsigned long long)(__atomic_load_n(&group->system_ns,
+                                             __ATOMIC_RELAXED) /
+                             1000),
+        (unsigned long long)nr_periods, (unsigned long long)nr_throttled,
+        (unsigned long long)(__atomic_load_n(&group->throttled_ns,
+                                             __ATOMIC_RELAXED) /
+                             1000));
+    return sched_group_finish(builder, content_len);
+}
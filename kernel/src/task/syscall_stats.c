@@ -0,0 +1,198 @@
+#include <arch/arch.h>
+#include <task/syscall_stats.h>
+#include <task/task.h>
+
+bool syscall_stats_on;
+
+static syscall_stat_t *syscall_stats_percpu[MAX_CPU_NUM];
+
+static inline uint32_t syscall_stats_bucket(uint64_t ns) {
+    uint32_t bucket = ns ? 63 - (uint32_t)__builtin_clzll(ns) : 0;
+
+    return MIN(bucket, (uint32_t)SYSCALL_STATS_BUCKETS - 1);
+}
+
+static inline bool syscall_stats_is_error(uint64_t ret) {
+    return (int64_t)ret < 0 && (int64_t)ret >= -4095;
+}
+
+/* Only the owning CPU writes its table, with interrupts off. */
+static void syscall_stats_add_percpu(uint64_t nr, uint64_t ns, bool error) {
+    bool irq_state = arch_interrupt_enabled();
+    syscall_stat_t *stat;
+
+    arch_disable_interrupt();
+    stat = syscall_stats_percpu[current_cpu_id];
+    if (stat) {
+        stat += nr;
+        stat->count++;
+        stat->errors += error;
+        stat->total_ns += ns;
+        if (ns > stat->max_ns)
+            stat->max_ns = ns;
+        stat->hist[syscall_stats_bucket(ns)]++;
+    }
+    if (irq_state)
+        arch_enable_interrupt();
+}
+
+static syscall_stat_t *syscall_stats_task_entry(task_cpu_account_t *account,
+                                                uint64_t nr) {
+    syscall_stats_t *stats =
+        __atomic_load_n(&account->syscall_stats, __ATOMIC_ACQUIRE);
+    syscall_stat_t *entry;
+
+    if (!stats) {
+        syscall_stats_t *fresh = calloc(1, sizeof(*fresh));
+        syscall_stats_t *expected = NULL;
+
+        if (!fresh)
+            return NULL;
+        if (__atomic_compare_exchange_n(&account->syscall_stats, &expected,
+                                        fresh, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            stats = fresh;
+        } else {
+            free(fresh);
+            stats = expected;
+        }
+    }
+
+    entry = __atomic_load_n(&stats->entries[nr], __ATOMIC_ACQUIRE);
+    if (!entry) {
+        syscall_stat_t *fresh = calloc(1, sizeof(*fresh));
+        syscall_stat_t *expected = NULL;
+
+        if (!fresh)
+            return NULL;
+        if (__atomic_compare_exchange_n(&stats->entries[nr], &expected, fresh,
+                                        false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            entry = fresh;
+        } else {
+            free(fresh);
+            entry = expected;
+        }
+    }
+    return entry;
+}
+
+/* Threads of one process may add to the same entry from several CPUs. */
+static void syscall_stats_add_task(task_t *task, uint64_t nr, uint64_t ns,
+                                   bool error) {
+    syscall_stat_t *stat;
+    uint64_t max;
+
+    if (!task->signal || !task->signal->cpu_account)
+        return;
+    stat = syscall_stats_task_entry(task->signal->cpu_account, nr);
+    if (!stat)
+        return;
+
+    __atomic_add_fetch(&stat->count, 1, __ATOMIC_RELAXED);
+    if (error)
+        __atomic_add_fetch(&stat->errors, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat->hist[syscall_stats_bucket(ns)], 1,
+                       __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&stat->max_ns, __ATOMIC_RELAXED);
+    while (ns > max &&
+           !__atomic_compare_exchange_n(&stat->max_ns, &max, ns, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void syscall_stats_account(task_t *task, uint64_t nr, uint64_t start_ns,
+                           uint64_t ret) {
+    uint64_t now = nano_time();
+    uint64_t ns = now > start_ns ? now - start_ns : 0;
+    bool error = syscall_stats_is_error(ret);
+
+    if (nr >= SYSCALL_STATS_NR)
+        return;
+
+    syscall_stats_add_percpu(nr, ns, error);
+    if (task)
+        syscall_stats_add_task(task, nr, ns, error);
+}
+
+/*
+ * The per-CPU tables are allocated on first enable and kept: turning the
+ * stats off only stops the counting, so totals keep growing since boot the
+ * way /proc/stat does and readers diff snapshots.
+ */
+int syscall_stats_set_enabled(bool on) {
+    uint32_t nr_cpus = MIN((uint32_t)cpu_count, (uint32_t)MAX_CPU_NUM);
+
+    for (uint32_t cpu = 0; on && cpu < nr_cpus; cpu++) {
+        syscall_stat_t *table, *expected = NULL;
+
+        if (__atomic_load_n(&syscall_stats_percpu[cpu], __ATOMIC_ACQUIRE))
+            continue;
+        table = calloc(SYSCALL_STATS_NR, sizeof(syscall_stat_t));
+        if (!table)
+            return -ENOMEM;
+        if (!__atomic_compare_exchange_n(&syscall_stats_percpu[cpu], &expected,
+                                         table, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE))
+            free(table);
+    }
+    __atomic_store_n(&syscall_stats_on, on, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void syscall_stats_free(syscall_stats_t *stats) {
+    if (!stats)
+        return;
+    for (size_t nr = 0; nr < SYSCALL_STATS_NR; nr++)
+        free(stats->entries[nr]);
+    free(stats);
+}
+
+static void syscall_stat_sum(syscall_stat_t *out, const syscall_stat_t *stat) {
+    uint64_t max = __atomic_load_n(&stat->max_ns, __ATOMIC_RELAXED);
+
+    out->count += __atomic_load_n(&stat->count, __ATOMIC_RELAXED);
+    out->errors += __atomic_load_n(&stat->errors, __ATOMIC_RELAXED);
+    out->total_ns += __atomic_load_n(&stat->total_ns, __ATOMIC_RELAXED);
+    if (max > out->max_ns)
+        out->max_ns = max;
+    for (int i = 0; i < SYSCALL_STATS_BUCKETS; i++)
+        out->hist[i] += __atomic_load_n(&stat->hist[i], __ATOMIC_RELAXED);
+}
+
+bool syscall_stats_read_global(uint64_t nr, syscall_stat_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (nr >= SYSCALL_STATS_NR)
+        return false;
+
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        syscall_stat_t *table =
+            __atomic_load_n(&syscall_stats_percpu[cpu], __ATOMIC_ACQUIRE);
+
+        if (table)
+            syscall_stat_sum(out, &table[nr]);
+    }
+    return out->count != 0;
+}
+
+bool syscall_stats_read_task(task_t *task, uint64_t nr, syscall_stat_t *out) {
+    syscall_stats_t *stats;
+    syscall_stat_t *stat;
+
+    memset(out, 0, sizeof(*out));
+    if (!task || nr >= SYSCALL_STATS_NR || !task->signal ||
+        !task->signal->cpu_account)
+        return false;
+
+    stats = __atomic_load_n(&task->signal->cpu_account->syscall_stats,
+                            __ATOMIC_ACQUIRE);
+    if (!stats)
+        return false;
+    stat = __atomic_load_n(&stats->entries[nr], __ATOMIC_ACQUIRE);
+    if (!stat)
+        return false;
+    syscall_stat_sum(out, stat);
+    return out->count != 0;
+}
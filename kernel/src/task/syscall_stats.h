@@ -0,0 +1,60 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+struct task;
+
+/*
+ * Per-syscall counters and latency histograms, off by default and toggled
+ * through /proc/sys/kernel/syscall_stats. While off, a dispatcher pays one
+ * predicted branch per syscall. While on, it reads the clock twice and adds
+ * the sample to the current CPU's table (system-wide, summed on read) and
+ * to its process's table (shared by the thread group, atomics only).
+ *
+ * Latency is wall time from entry to exit, sleeping included. Histogram
+ * bucket i counts syscalls that took [2^i, 2^(i+1)) ns; the last one also
+ * takes everything slower.
+ */
+
+#define SYSCALL_STATS_NR 512
+#define SYSCALL_STATS_BUCKETS 32
+
+typedef struct syscall_stat {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t hist[SYSCALL_STATS_BUCKETS];
+} syscall_stat_t;
+
+/* A process's table; entries appear on a syscall's first use. */
+typedef struct syscall_stats {
+    syscall_stat_t *entries[SYSCALL_STATS_NR];
+} syscall_stats_t;
+
+extern bool syscall_stats_on;
+
+static inline uint64_t syscall_stats_enter(void) {
+    if (__builtin_expect(!__atomic_load_n(&syscall_stats_on, __ATOMIC_RELAXED),
+                         1))
+        return 0;
+    return nano_time();
+}
+
+void syscall_stats_account(struct task *task, uint64_t nr, uint64_t start_ns,
+                           uint64_t ret);
+
+/* start_ns is what syscall_stats_enter() returned. */
+static inline void syscall_stats_exit(struct task *task, uint64_t nr,
+                                      uint64_t start_ns, uint64_t ret) {
+    if (__builtin_expect(start_ns != 0, 0))
+        syscall_stats_account(task, nr, start_ns, ret);
+}
+
+int syscall_stats_set_enabled(bool on);
+void syscall_stats_free(syscall_stats_t *stats);
+
+/* Copies out one syscall's numbers; false when it was never called. */
+bool syscall_stats_read_global(uint64_t nr, syscall_stat_t *out);
+bool syscall_stats_read_task(struct task *task, uint64_t nr,
+                             syscall_stat_t *out);
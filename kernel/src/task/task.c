@@ -4,7 +4,12 @@
 #include <task/task.h>
 #include <task/futex.h>
 #include <task/ptrace.h>
+#include <task/workqueue.h>
 #include <task/sched.h>
+#include <task/psi.h>
+#include <task/perf_event.h>
+#include <task/syscall_stats.h>
+#include <task/trace.h>
 #include <drivers/logger.h>
 #include <drivers/clockevent.h>
 #include <drivers/deadline.h>
@@ -567,8 +572,10 @@ static void task_cpu_account_get(task_cpu_account_t *account) {
 static void task_cpu_account_put(task_cpu_account_t *account) {
     if (!account)
         return;
-    if (__atomic_sub_fetch(&account->ref_count, 1, __ATOMIC_ACQ_REL) == 0)
+    if (__atomic_sub_fetch(&account->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+        syscall_stats_free(account->syscall_stats);
         free(account);
+    }
 }
 
 task_signal_info_t *task_signal_create_empty(void) {
@@ -1763,6 +1770,7 @@ task_t *get_free_task() {
             llist_init_head(&task->pgid_node);
             llist_init_head(&task->tgid_node);
             llist_init_head(&task->tick_work_node);
+            llist_init_head(&task->perf_events);
             spin_init(&task->block_lock);
             spin_init(&task->fd_info_lock);
             wait_queue_init(&task->child_wait);
@@ -1786,6 +1794,7 @@ task_t *get_free_task() {
     llist_init_head(&task->pgid_node);
     llist_init_head(&task->tgid_node);
     llist_init_head(&task->tick_work_node);
+    llist_init_head(&task->perf_events);
     spin_init(&task->block_lock);
     spin_init(&task->fd_info_lock);
     wait_queue_init(&task->child_wait);
@@ -1801,8 +1810,8 @@ task_t *get_free_task() {
     return task;
 }
 
-task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg,
-                    int priority) {
+task_t *task_create_on_cpu(const char *name, void (*entry)(uint64_t),
+                           uint64_t arg, int priority, uint32_t cpu) {
     bool irq_state = arch_interrupt_enabled();
 
     arch_disable_interrupt();
@@ -1936,6 +1945,11 @@ task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg,
     task_tgid_index_attach_locked(task);
     spin_unlock(&task_queue_lock);
 
+    if (cpu < cpu_count) {
+        task->cpu_id = cpu;
+        task_set_flag(task, TASK_FLAG_CPU_PINNED);
+    }
+
     task->sched_info = calloc(1, sizeof(struct sched_entity));
     if (!task->sched_info)
         goto fail;
@@ -1957,6 +1971,11 @@ fail:
     return NULL;
 }
 
+task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg,
+                    int priority) {
+    return task_create_on_cpu(name, entry, arg, priority, UINT32_MAX);
+}
+
 extern void init_thread(uint64_t arg);
 
 extern bool system_initialized;
@@ -2049,6 +2068,8 @@ void task_init() {
     softirqd_task->state = TASK_BLOCKING;
     softirqd_task->blocking_reason = "waiting_for_softirq";
 
+    workqueue_init();
+
     arch_set_current(idle_tasks[current_cpu_id]);
     task_mark_on_cpu(idle_tasks[current_cpu_id], true);
     task_mm_mark_cpu_active(idle_tasks[current_cpu_id]->mm, current_cpu_id);
@@ -2232,7 +2253,11 @@ int task_block(task_t *task, task_state_t state, int64_t timeout_ns,
     arch_enable_interrupt();
 
     if (task == current_task) {
+        if (task->wq_worker)
+            workqueue_worker_sleeping(task);
         schedule(0);
+        if (task->wq_worker)
+            workqueue_worker_waking(task);
     }
 
     if (!lock_irq_state)
@@ -2327,6 +2352,7 @@ void task_unblock_finish(task_unblock_token_t *token) {
      * working set and shared mm between CPUs, multiplying cache coherency,
      * scheduler IPI and TLB shootdown costs.  New tasks are still distributed
      * by alloc_cpu_id(); periodic balancing can be added separately. */
+    trace_sched_wakeup(task, task->cpu_id);
     add_sched_entity_wakeup(task, &schedulers[task->cpu_id]);
 }
 
@@ -2361,6 +2387,8 @@ void task_exit_inner(task_t *task, int64_t code) {
     if (entity) {
         entity->task = NULL;
     }
+    psi_task_exit(task);
+    perf_event_exit_task(task);
 
     task_timeout_cancel(task);
     task_signal_timer_cancel(task);
@@ -2688,6 +2716,12 @@ void schedule(uint64_t sched_flags) {
 
     int cpu_id = prev->cpu_id;
 
+    if (cpu_id < MAX_CPU_NUM) {
+        sched_stat_add(&sched_cpu_stats[cpu_id].sched_count, 1);
+        if (sched_flags & SCHED_FLAG_YIELD)
+            sched_stat_add(&sched_cpu_stats[cpu_id].yld_count, 1);
+    }
+
     if (!prev->last_sched_in_ns && prev->current_state == TASK_RUNNING)
         prev->last_sched_in_ns = now_ns;
 
@@ -2729,6 +2763,9 @@ void schedule(uint64_t sched_flags) {
     next->current_state = TASK_RUNNING;
     next->last_sched_in_ns = now_ns;
     sched_update_preempt_deadline(cpu_id, next, now_ns);
+    sched_stats_account_switch(cpu_id, prev, next, now_ns);
+    perf_event_task_switch(prev, next, now_ns);
+    trace_sched_switch(prev, next);
 
     arch_set_current(next);
     switch_mm(prev, next);
@@ -337,6 +337,8 @@ void task_detach_children_from_parent(task_t *owner);
 
 task_t *task_create(const char *name, void (*entry)(uint64_t), uint64_t arg,
                     int priority);
+task_t *task_create_on_cpu(const char *name, void (*entry)(uint64_t),
+                           uint64_t arg, int priority, uint32_t cpu);
 void task_cleanup_partial(task_t *task, bool kernel_mm);
 void task_init();
 task_signal_info_t *task_signal_create_empty(void);
@@ -26,6 +26,8 @@ typedef struct task_mm_info task_mm_info_t;
 
 struct vfs_file;
 struct vfs_path;
+struct workqueue_worker;
+struct cgroup;
 
 struct rlimit {
     size_t rlim_cur;
@@ -307,9 +309,38 @@ typedef struct pending_signal {
     siginfo_t info[MAXSIG];
 } pending_signal_t;
 
+/* I/O counters behind /proc/<pid>/io, see task/taskstats.h. */
+typedef enum task_io_item {
+    TASK_IO_RCHAR,
+    TASK_IO_WCHAR,
+    TASK_IO_SYSCR,
+    TASK_IO_SYSCW,
+    TASK_IO_READ_BYTES,
+    TASK_IO_WRITE_BYTES,
+    TASK_IO_CANCELLED_WRITE_BYTES,
+    NR_TASK_IO,
+} task_io_item_t;
+
+/* What a task waited for, see task/taskstats.h. */
+typedef enum task_delay_item {
+    TASK_DELAY_CPU,     // runnable on a runqueue
+    TASK_DELAY_BLKIO,   // in a synchronous block request
+    TASK_DELAY_PCACHE,  // reading in a page cache page, or waiting for it
+    TASK_DELAY_RECLAIM, // reclaiming memory
+    NR_TASK_DELAYS,
+} task_delay_item_t;
+
+typedef struct task_delay {
+    uint64_t count;
+    uint64_t total_ns;
+} task_delay_t;
+
 typedef struct task_cpu_account {
     volatile uint64_t runtime_ns;
     volatile int ref_count;
+    struct syscall_stats *syscall_stats; // per process, NULL until used
+    uint64_t ioac[NR_TASK_IO];           // thread group totals, atomics
+    task_delay_t delays[NR_TASK_DELAYS];
 } task_cpu_account_t;
 
 typedef struct task_sighand {
@@ -369,6 +400,7 @@ typedef struct task {
     rb_node_t timeout_node;
     rb_node_t signal_timer_node;
     uint64_t last_sched_in_ns;
+    uint64_t sched_enqueued_ns; // went on a runqueue, 0 once it ran
     uint64_t start_time_ns;
     uint64_t user_time_ns;
     uint64_t system_time_ns;
@@ -452,4 +484,17 @@ typedef struct task {
     bool timeout_queued;
     bool signal_timer_queued;
     bool exited_by_signal;
+    struct workqueue_worker *wq_worker;
+    spinlock_t psi_lock;
+    uint32_t psi_flags; // TSK_* pressure state, see task/psi.h
+    uint32_t psi_cpu;   // CPU whose pressure counts include this task
+    struct cgroup *cgroup; // unified hierarchy; NULL while in the root
+    uint32_t memcg_nr_pages_over_high; // charged past memory.high
+    bool memcg_in_oom; // a charge failed at memory.max
+    struct llist_header perf_events; // perf_event_t attached to this task
+    uint32_t perf_last_cpu;          // CPU it last ran on, for migrations
+    bool perf_exited;                // no events may attach any more
+    uint64_t pcache_misses; // page cache reads it issued or waited for
+    uint64_t ioac[NR_TASK_IO]; // this thread; the group's are in cpu_account
+    task_delay_t delays[NR_TASK_DELAYS];
 } task_t;
@@ -9,6 +9,7 @@
 #include <irq/irq_manager.h>
 #include <task/sched.h>
 #include <task/keyring.h>
+#include <task/perf_event.h>
 #include <task/ptrace.h>
 #include <task/task_syscall.h>
 #include <task/wait.h>
@@ -2671,6 +2672,7 @@ shell_fallback_done:
         vfs_close_file(self->exec_file);
     self->exec_file = exec_file;
     task_execve_commit_creds(self, &exec_creds);
+    perf_event_exec(self);
     ptrace_stop_for_exec(self);
     ptrace_stop_for_exec_syscall_exit(self);
 
@@ -3529,20 +3531,22 @@ static uint64_t sys_clone_internal(struct pt_regs *regs, uint64_t flags,
 
     self->child_vfork_done = false;
 
+    // before the cgroup move, so the entity picks up the cpu controller
+    child->sched_info = calloc(1, sizeof(struct sched_entity));
+    if (!child->sched_info) {
+        ret = (uint64_t)-ENOMEM;
+        goto fail;
+    }
+
     if (cgroup_fd >= 0) {
         ret = (uint64_t)cgroupfs_set_task_cgroup_by_fd(child, cgroup_fd);
         if ((int64_t)ret < 0)
             goto fail;
     }
 
+    perf_event_fork(self, child);
     child->state = ptrace_trace_fork ? TASK_BLOCKING : TASK_READY;
     child->current_state = ptrace_trace_fork ? TASK_BLOCKING : TASK_READY;
-
-    child->sched_info = calloc(1, sizeof(struct sched_entity));
-    if (!child->sched_info) {
-        ret = (uint64_t)-ENOMEM;
-        goto fail;
-    }
     if (!ptrace_trace_fork) {
         add_sched_entity(child, &schedulers[child->cpu_id]);
     }
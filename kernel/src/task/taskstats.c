@@ -0,0 +1,176 @@
+#include <task/taskstats.h>
+#include <boot/boot.h>
+
+static task_cpu_account_t *task_group_account(task_t *task) {
+    return task && task->signal ? task->signal->cpu_account : NULL;
+}
+
+void task_io_add(task_t *task, task_io_item_t item, uint64_t n) {
+    task_cpu_account_t *account;
+
+    if (!task || item >= NR_TASK_IO)
+        return;
+
+    __atomic_store_n(&task->ioac[item], task->ioac[item] + n,
+                     __ATOMIC_RELAXED);
+    account = task_group_account(task);
+    if (account)
+        __atomic_add_fetch(&account->ioac[item], n, __ATOMIC_RELAXED);
+}
+
+void task_delay_add(task_t *task, task_delay_item_t item, uint64_t ns) {
+    task_cpu_account_t *account;
+    task_delay_t *delay;
+
+    if (!task || item >= NR_TASK_DELAYS)
+        return;
+
+    delay = &task->delays[item];
+    __atomic_store_n(&delay->count, delay->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&delay->total_ns, delay->total_ns + ns, __ATOMIC_RELAXED);
+    account = task_group_account(task);
+    if (account) {
+        delay = &account->delays[item];
+        __atomic_add_fetch(&delay->count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&delay->total_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+void task_io_read(task_t *task, bool group, uint64_t out[NR_TASK_IO]) {
+    task_cpu_account_t *account = group ? task_group_account(task) : NULL;
+    uint64_t *ioac = account ? account->ioac : task ? task->ioac : NULL;
+
+    for (int item = 0; item < NR_TASK_IO; item++)
+        out[item] = ioac ? __atomic_load_n(&ioac[item], __ATOMIC_RELAXED) : 0;
+}
+
+void task_delay_read(task_t *task, bool group,
+                     task_delay_t out[NR_TASK_DELAYS]) {
+    task_cpu_account_t *account = group ? task_group_account(task) : NULL;
+    task_delay_t *delays = account ? account->delays
+                           : task  ? task->delays
+                                   : NULL;
+
+    for (int item = 0; item < NR_TASK_DELAYS; item++) {
+        out[item].count =
+            delays ? __atomic_load_n(&delays[item].count, __ATOMIC_RELAXED)
+                   : 0;
+        out[item].total_ns =
+            delays ? __atomic_load_n(&delays[item].total_ns, __ATOMIC_RELAXED)
+                   : 0;
+    }
+}
+
+/* Adds up the CPU times of every live thread in task's group. */
+static void taskstats_group_times_locked(task_t *task, uint64_t *user_ns,
+                                         uint64_t *system_ns) {
+    task_index_bucket_t *bucket =
+        task_index_bucket_lookup(&task_tgid_map, task_effective_tgid(task));
+
+    *user_ns = 0;
+    *system_ns = 0;
+    if (!bucket) {
+        *user_ns = task_self_user_ns(task);
+        *system_ns = task->system_time_ns;
+        return;
+    }
+
+    struct llist_header *node = bucket->tasks.next;
+    while (node != &bucket->tasks) {
+        task_t *thread = list_entry(node, task_t, tgid_node);
+        node = node->next;
+        if (!thread || thread->state == TASK_DIED)
+            continue;
+        *user_ns += task_self_user_ns(thread);
+        *system_ns += thread->system_time_ns;
+    }
+}
+
+/* Root reads anyone's numbers, everybody else only those of their own uid. */
+static bool taskstats_access_ok(task_t *self, task_t *target) {
+    if (!self || self == target || self->euid == 0)
+        return true;
+    return self->euid == target->euid && self->uid == target->uid;
+}
+
+int taskstats_fill(uint64_t pid, bool tgid, struct taskstats *stats) {
+    uint64_t io[NR_TASK_IO];
+    task_delay_t delays[NR_TASK_DELAYS];
+    task_cpu_account_t *account;
+    uint64_t now_ns = nano_time();
+    uint64_t user_ns, system_ns, elapsed_ns;
+    task_t *task;
+
+    memset(stats, 0, sizeof(*stats));
+
+    spin_lock(&task_queue_lock);
+    task = task_lookup_by_pid_nolock(pid);
+    if (task && tgid && task_effective_tgid(task) != pid)
+        task = NULL;
+    if (!task || task->state == TASK_DIED) {
+        spin_unlock(&task_queue_lock);
+        return -ESRCH;
+    }
+    if (!taskstats_access_ok(current_task, task)) {
+        spin_unlock(&task_queue_lock);
+        return -EACCES;
+    }
+
+    task_io_read(task, tgid, io);
+    task_delay_read(task, tgid, delays);
+    account = task_group_account(task);
+    if (tgid) {
+        taskstats_group_times_locked(task, &user_ns, &system_ns);
+    } else {
+        user_ns = task_self_user_ns(task);
+        system_ns = task->system_time_ns;
+    }
+    elapsed_ns = now_ns > task->start_time_ns ? now_ns - task->start_time_ns
+                                              : 0;
+
+    stats->version = TASKSTATS_VERSION;
+    stats->ac_nice = (uint8_t)task->nice;
+    stats->ac_sched = (uint8_t)task->sched_policy;
+    strncpy(stats->ac_comm, task->name, TS_COMM_LEN - 1);
+    stats->ac_uid = (uint32_t)task->uid;
+    stats->ac_gid = (uint32_t)task->gid;
+    stats->ac_pid = (uint32_t)task->pid;
+    stats->ac_tgid = (uint32_t)task_effective_tgid(task);
+    stats->ac_ppid = (uint32_t)task_parent_pid(task);
+    stats->ac_btime64 =
+        boot_get_boottime() + task->start_time_ns / 1000000000ULL;
+    stats->ac_btime = (uint32_t)stats->ac_btime64;
+    stats->ac_etime = elapsed_ns / 1000;
+    stats->ac_tgetime = elapsed_ns / 1000;
+    stats->ac_utime = user_ns / 1000;
+    stats->ac_stime = system_ns / 1000;
+    stats->ac_utimescaled = stats->ac_utime;
+    stats->ac_stimescaled = stats->ac_stime;
+    stats->cpu_run_real_total =
+        tgid && account
+            ? __atomic_load_n(&account->runtime_ns, __ATOMIC_RELAXED)
+            : task->user_time_ns;
+    spin_unlock(&task_queue_lock);
+
+    stats->cpu_run_virtual_total = stats->cpu_run_real_total;
+    stats->cpu_scaled_run_real_total = stats->cpu_run_real_total;
+
+    stats->cpu_count = delays[TASK_DELAY_CPU].count;
+    stats->cpu_delay_total = delays[TASK_DELAY_CPU].total_ns;
+    stats->blkio_count = delays[TASK_DELAY_BLKIO].count;
+    stats->blkio_delay_total = delays[TASK_DELAY_BLKIO].total_ns;
+    stats->freepages_count = delays[TASK_DELAY_RECLAIM].count;
+    stats->freepages_delay_total = delays[TASK_DELAY_RECLAIM].total_ns;
+    // nearest Linux field: waiting for a file page to be read (back) in
+    stats->thrashing_count = delays[TASK_DELAY_PCACHE].count;
+    stats->thrashing_delay_total = delays[TASK_DELAY_PCACHE].total_ns;
+
+    stats->read_char = io[TASK_IO_RCHAR];
+    stats->write_char = io[TASK_IO_WCHAR];
+    stats->read_syscalls = io[TASK_IO_SYSCR];
+    stats->write_syscalls = io[TASK_IO_SYSCW];
+    stats->read_bytes = io[TASK_IO_READ_BYTES];
+    stats->write_bytes = io[TASK_IO_WRITE_BYTES];
+    stats->cancelled_write_bytes = io[TASK_IO_CANCELLED_WRITE_BYTES];
+    return 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <task/task.h>
+
+/*
+ * Per-task I/O and delay accounting.
+ *
+ * I/O follows /proc/<pid>/io on Linux: rchar/wchar and syscr/syscw count
+ * every vfs_read_file()/vfs_write_file() call and the bytes it moved,
+ * read_bytes is what the block layer read for the task, write_bytes is
+ * charged when the task dirties a page cache page and cancelled_write_bytes
+ * when it truncates one away before writeback.
+ *
+ * Delays add up the wall time a task spent waiting, by cause: on a
+ * runqueue (charged when it is switched in), in a block request, reading
+ * a page cache page in (its own miss or one it found in flight, so this
+ * overlaps blkio) and in memory reclaim.
+ *
+ * A task's own counters have one writer at a time, itself or the CPU
+ * switching it in, so those are plain stores read with relaxed loads.
+ * Each add is mirrored into the thread group's task_cpu_account_t with an
+ * atomic, which is what /proc/<pid>/io and TGID taskstats report and which
+ * outlives exited threads.
+ */
+
+void task_io_add(task_t *task, task_io_item_t item, uint64_t n);
+void task_delay_add(task_t *task, task_delay_item_t item, uint64_t ns);
+
+static inline void task_io_account_read(ssize_t ret) {
+    task_io_add(current_task, TASK_IO_SYSCR, 1);
+    if (ret > 0)
+        task_io_add(current_task, TASK_IO_RCHAR, (uint64_t)ret);
+}
+
+static inline void task_io_account_write(ssize_t ret) {
+    task_io_add(current_task, TASK_IO_SYSCW, 1);
+    if (ret > 0)
+        task_io_add(current_task, TASK_IO_WCHAR, (uint64_t)ret);
+}
+
+/* Brackets a wait of the current task; start is what nano_time() said. */
+static inline void task_delay_end(task_delay_item_t item, uint64_t start_ns) {
+    uint64_t now_ns = nano_time();
+
+    task_delay_add(current_task, item,
+                   now_ns > start_ns ? now_ns - start_ns : 0);
+}
+
+/* Copies out one thread's numbers, or its thread group's. */
+void task_io_read(task_t *task, bool group, uint64_t out[NR_TASK_IO]);
+void task_delay_read(task_t *task, bool group,
+                     task_delay_t out[NR_TASK_DELAYS]);
+
+/*
+ * struct taskstats as Linux defines it up to version 13, so getdelays and
+ * iotop can read the replies of the TASKSTATS generic netlink family.
+ */
+#define TASKSTATS_VERSION 13
+#define TS_COMM_LEN 32
+
+struct taskstats {
+    uint16_t version;
+    uint32_t ac_exitcode;
+    uint8_t ac_flag;
+    uint8_t ac_nice;
+    uint64_t cpu_count __attribute__((aligned(8)));
+    uint64_t cpu_delay_total;
+    uint64_t blkio_count;
+    uint64_t blkio_delay_total;
+    uint64_t swapin_count;
+    uint64_t swapin_delay_total;
+    uint64_t cpu_run_real_total;
+    uint64_t cpu_run_virtual_total;
+    char ac_comm[TS_COMM_LEN];
+    uint8_t ac_sched __attribute__((aligned(8)));
+    uint8_t ac_pad[3];
+    uint32_t ac_uid __attribute__((aligned(8)));
+    uint32_t ac_gid;
+    uint32_t ac_pid;
+    uint32_t ac_ppid;
+    uint32_t ac_btime;
+    uint64_t ac_etime __attribute__((aligned(8)));
+    uint64_t ac_utime;
+    uint64_t ac_stime;
+    uint64_t ac_minflt;
+    uint64_t ac_majflt;
+    uint64_t coremem;
+    uint64_t virtmem;
+    uint64_t hiwater_rss;
+    uint64_t hiwater_vm;
+    uint64_t read_char;
+    uint64_t write_char;
+    uint64_t read_syscalls;
+    uint64_t write_syscalls;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t cancelled_write_bytes;
+    uint64_t nvcsw;
+    uint64_t nivcsw;
+    uint64_t ac_utimescaled;
+    uint64_t ac_stimescaled;
+    uint64_t cpu_scaled_run_real_total;
+    uint64_t freepages_count;
+    uint64_t freepages_delay_total;
+    uint64_t thrashing_count;
+    uint64_t thrashing_delay_total;
+    uint64_t ac_btime64;
+    uint64_t compact_count;
+    uint64_t compact_delay_total;
+    uint32_t ac_tgid;
+    uint64_t ac_tgetime __attribute__((aligned(8)));
+    uint64_t ac_exe_dev;
+    uint64_t ac_exe_inode;
+    uint64_t wpcopy_count;
+    uint64_t wpcopy_delay_total;
+};
+
+/*
+ * Fills stats for pid, or for the thread group led by pid when tgid is
+ * set. Returns -ESRCH when there is no such task and -EACCES when the
+ * caller is neither root nor running as the task's uid.
+ */
+int taskstats_fill(uint64_t pid, bool tgid, struct taskstats *stats);
@@ -0,0 +1,899 @@
+#include <arch/arch.h>
+#include <fs/vfs/tracefs/tracefs.h>
+#include <irq/softirq.h>
+#include <mm/fault.h>
+#include <mm/mm.h>
+#include <task/task.h>
+#include <task/trace.h>
+
+typedef struct trace_buffer {
+    uint8_t *data;
+    uint64_t size;  // a power of two
+    uint64_t head;  // end of the newest record
+    uint64_t tail;  // start of the oldest record still kept
+    uint64_t read;  // where consuming readers go on, under trace_read_lock_
+    uint64_t written;
+    uint64_t overrun;
+    uint64_t dropped;
+    uint64_t read_events;
+    uint32_t writing; // set by the owning CPU while it writes
+} trace_buffer_t;
+
+uint64_t trace_active_mask;
+
+static trace_buffer_t trace_buffers[MAX_CPU_NUM];
+static uint64_t trace_buf_size = TRACE_BUF_SIZE_DFL;
+static bool trace_buffers_allocated;
+static uint32_t trace_buffers_frozen;
+static uint64_t trace_event_mask;
+static bool trace_on = true;
+static spinlock_t trace_ctl_lock = SPIN_INIT;   // settings, resize, reset
+static spinlock_t trace_read_lock_ = SPIN_INIT; // readers
+static int trace_nr_readers;
+static bool trace_wakeup_pending;
+
+/* Ring buffer */
+
+static void trace_ring_copy_in(trace_buffer_t *buf, uint64_t pos,
+                               const void *src, size_t len) {
+    uint64_t off = pos & (buf->size - 1);
+    size_t first = MIN(len, buf->size - off);
+
+    memcpy(buf->data + off, src, first);
+    if (first < len)
+        memcpy(buf->data, (const uint8_t *)src + first, len - first);
+}
+
+static void trace_ring_copy_out(trace_buffer_t *buf, uint64_t pos, void *dst,
+                                size_t len) {
+    uint64_t off = pos & (buf->size - 1);
+    size_t first = MIN(len, buf->size - off);
+
+    memcpy(dst, buf->data + off, first);
+    if (first < len)
+        memcpy((uint8_t *)dst + first, buf->data, len - first);
+}
+
+static uint16_t trace_ring_size_at(trace_buffer_t *buf, uint64_t pos) {
+    trace_entry_t entry;
+
+    trace_ring_copy_out(buf, pos, &entry, sizeof(entry));
+    return entry.size;
+}
+
+/*
+ * Called with interrupts off on the buffer's own CPU. The tail moves past
+ * whatever is about to be overwritten before the new bytes land, so a
+ * reader that copied from there sees the move once it is done.
+ */
+static void trace_buffer_write(trace_buffer_t *buf, const void *record,
+                               size_t size) {
+    uint64_t head = buf->head;
+    uint64_t tail = buf->tail;
+
+    if (head + size - tail > buf->size) {
+        uint64_t read = __atomic_load_n(&buf->read, __ATOMIC_RELAXED);
+
+        while (head + size - tail > buf->size) {
+            if (tail >= read)
+                buf->overrun++;
+            tail += trace_ring_size_at(buf, tail);
+        }
+        __atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    trace_ring_copy_in(buf, head, record, size);
+    __atomic_store_n(&buf->head, head + size, __ATOMIC_RELEASE);
+    buf->written++;
+}
+
+static void trace_commit(trace_event_id_t id, void *record, size_t size) {
+    trace_entry_t *entry = record;
+    task_t *self = current_task;
+    trace_buffer_t *buf;
+    bool irq_state;
+
+    entry->type = (uint16_t)(id + 1);
+    entry->size = (uint16_t)size;
+    entry->pid = self ? (uint32_t)self->pid : 0;
+    entry->ts = nano_time();
+
+    irq_state = arch_interrupt_enabled();
+    arch_disable_interrupt();
+
+    buf = &trace_buffers[current_cpu_id];
+    __atomic_store_n(&buf->writing, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&trace_buffers_frozen, __ATOMIC_SEQ_CST) ||
+        !buf->data)
+        __atomic_add_fetch(&buf->dropped, 1, __ATOMIC_RELAXED);
+    else
+        trace_buffer_write(buf, record, size);
+    __atomic_store_n(&buf->writing, 0, __ATOMIC_RELEASE);
+
+    if (irq_state)
+        arch_enable_interrupt();
+
+    if (__atomic_load_n(&trace_nr_readers, __ATOMIC_RELAXED))
+        __atomic_store_n(&trace_wakeup_pending, true, __ATOMIC_RELAXED);
+}
+
+/* Keeps writers out while the buffers change under them. */
+static void trace_buffers_freeze(void) {
+    __atomic_store_n(&trace_buffers_frozen, 1, __ATOMIC_SEQ_CST);
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        while (__atomic_load_n(&trace_buffers[cpu].writing, __ATOMIC_SEQ_CST))
+            arch_pause();
+    }
+}
+
+static void trace_buffers_thaw(void) {
+    __atomic_store_n(&trace_buffers_frozen, 0, __ATOMIC_SEQ_CST);
+}
+
+static void trace_buffer_clear(trace_buffer_t *buf) {
+    buf->head = 0;
+    buf->tail = 0;
+    buf->read = 0;
+    buf->written = 0;
+    buf->overrun = 0;
+    buf->read_events = 0;
+    __atomic_store_n(&buf->dropped, 0, __ATOMIC_RELAXED);
+}
+
+static void trace_free_data(uint8_t **data, uint32_t nr, uint64_t size) {
+    for (uint32_t cpu = 0; cpu < nr; cpu++) {
+        if (data[cpu])
+            free_frames_bytes(data[cpu], size);
+    }
+}
+
+/* Takes trace_ctl_lock itself; size is a power of two. */
+static int trace_buffers_replace(uint64_t size) {
+    uint32_t nr = MIN((uint32_t)cpu_count, (uint32_t)MAX_CPU_NUM);
+    uint8_t **data = calloc(nr, sizeof(*data));
+    uint64_t old_size;
+
+    if (!data)
+        return -ENOMEM;
+    for (uint32_t cpu = 0; cpu < nr; cpu++) {
+        data[cpu] = alloc_frames_bytes(size);
+        if (!data[cpu]) {
+            trace_free_data(data, nr, size);
+            free(data);
+            return -ENOMEM;
+        }
+    }
+
+    spin_lock(&trace_ctl_lock);
+    spin_lock(&trace_read_lock_);
+    trace_buffers_freeze();
+    old_size = trace_buffers_allocated ? trace_buf_size : 0;
+    for (uint32_t cpu = 0; cpu < nr; cpu++) {
+        uint8_t *old = trace_buffers[cpu].data;
+
+        trace_buffers[cpu].data = data[cpu];
+        trace_buffers[cpu].size = size;
+        trace_buffer_clear(&trace_buffers[cpu]);
+        data[cpu] = old;
+    }
+    trace_buf_size = size;
+    trace_buffers_allocated = true;
+    trace_buffers_thaw();
+    spin_unlock(&trace_read_lock_);
+    spin_unlock(&trace_ctl_lock);
+
+    if (old_size)
+        trace_free_data(data, nr, old_size);
+    free(data);
+    return 0;
+}
+
+/* Buffers only get memory once something is traced for the first time. */
+static int trace_buffers_ensure(void) {
+    if (__atomic_load_n(&trace_buffers_allocated, __ATOMIC_ACQUIRE))
+        return 0;
+    return trace_buffers_replace(trace_buf_size);
+}
+
+static void trace_update_mask_locked(void) {
+    __atomic_store_n(&trace_active_mask, trace_on ? trace_event_mask : 0,
+                     __ATOMIC_RELEASE);
+}
+
+bool trace_is_on(void) { return __atomic_load_n(&trace_on, __ATOMIC_ACQUIRE); }
+
+int trace_set_on(bool on) {
+    spin_lock(&trace_ctl_lock);
+    trace_on = on;
+    trace_update_mask_locked();
+    spin_unlock(&trace_ctl_lock);
+    return 0;
+}
+
+bool trace_event_is_enabled(trace_event_id_t id) {
+    if (id >= NR_TRACE_EVENTS)
+        return false;
+    return (__atomic_load_n(&trace_event_mask, __ATOMIC_ACQUIRE) >> id) & 1;
+}
+
+int trace_event_set_enabled(trace_event_id_t id, bool enabled) {
+    int ret;
+
+    if (id >= NR_TRACE_EVENTS)
+        return -EINVAL;
+    if (enabled) {
+        ret = trace_buffers_ensure();
+        if (ret < 0)
+            return ret;
+    }
+
+    spin_lock(&trace_ctl_lock);
+    if (enabled)
+        trace_event_mask |= 1ULL << id;
+    else
+        trace_event_mask &= ~(1ULL << id);
+    trace_update_mask_locked();
+    spin_unlock(&trace_ctl_lock);
+    return 0;
+}
+
+uint64_t trace_buffer_size(void) {
+    return __atomic_load_n(&trace_buf_size, __ATOMIC_ACQUIRE);
+}
+
+int trace_buffer_resize(uint64_t size) {
+    uint64_t pow2 = TRACE_BUF_SIZE_MIN;
+
+    if (!size || size > TRACE_BUF_SIZE_MAX)
+        return -EINVAL;
+    while (pow2 < size)
+        pow2 <<= 1;
+
+    if (!__atomic_load_n(&trace_buffers_allocated, __ATOMIC_ACQUIRE)) {
+        spin_lock(&trace_ctl_lock);
+        trace_buf_size = pow2;
+        spin_unlock(&trace_ctl_lock);
+        return 0;
+    }
+    return trace_buffers_replace(pow2);
+}
+
+void trace_buffer_reset(int cpu) {
+    spin_lock(&trace_ctl_lock);
+    spin_lock(&trace_read_lock_);
+    trace_buffers_freeze();
+    for (uint32_t i = 0; i < cpu_count && i < MAX_CPU_NUM; i++) {
+        if (cpu < 0 || (uint32_t)cpu == i)
+            trace_buffer_clear(&trace_buffers[i]);
+    }
+    trace_buffers_thaw();
+    spin_unlock(&trace_read_lock_);
+    spin_unlock(&trace_ctl_lock);
+}
+
+void trace_cpu_stats(uint32_t cpu, trace_cpu_stats_t *stats) {
+    trace_buffer_t *buf;
+    trace_entry_t entry;
+    uint64_t head, start;
+
+    memset(stats, 0, sizeof(*stats));
+    if (cpu >= cpu_count || cpu >= MAX_CPU_NUM)
+        return;
+    buf = &trace_buffers[cpu];
+
+    spin_lock(&trace_read_lock_);
+    head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    start = MAX(buf->read, __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE));
+    stats->overrun = __atomic_load_n(&buf->overrun, __ATOMIC_RELAXED);
+    stats->read_events = buf->read_events;
+    stats->entries = __atomic_load_n(&buf->written, __ATOMIC_RELAXED) -
+                     stats->overrun - stats->read_events;
+    stats->bytes = head > start ? head - start : 0;
+    stats->dropped = __atomic_load_n(&buf->dropped, __ATOMIC_RELAXED);
+    if (buf->data && head > start) {
+        trace_ring_copy_out(buf, start, &entry, sizeof(entry));
+        stats->oldest_ts = entry.ts;
+    }
+    spin_unlock(&trace_read_lock_);
+}
+
+/* Readers */
+
+void trace_read_lock(void) { spin_lock(&trace_read_lock_); }
+
+void trace_read_unlock(void) { spin_unlock(&trace_read_lock_); }
+
+/*
+ * Copies the record at *pos, or at the tail if the writer already moved
+ * past *pos, and leaves *pos where the record starts. Returns its size, 0
+ * when there is nothing left.
+ */
+static size_t trace_buffer_copy_record(trace_buffer_t *buf, uint64_t *pos,
+                                       void *out) {
+    trace_entry_t *entry = out;
+
+    if (!buf->data)
+        return 0;
+
+    while (true) {
+        uint64_t tail = __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+        uint64_t p = MAX(*pos, tail);
+        bool sane;
+
+        *pos = p;
+        if (p >= head)
+            return 0;
+
+        trace_ring_copy_out(buf, p, entry, sizeof(*entry));
+        sane = entry->size >= sizeof(*entry) &&
+               entry->size <= TRACE_RECORD_MAX && !(entry->size & 7) &&
+               p + entry->size <= head;
+        if (sane)
+            trace_ring_copy_out(buf, p + sizeof(*entry), entry + 1,
+                                entry->size - sizeof(*entry));
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&buf->tail, __ATOMIC_RELAXED) > p)
+            continue; // overwritten while we copied it
+        if (!sane) {
+            *pos = head;
+            return 0;
+        }
+        return entry->size;
+    }
+}
+
+void trace_cursor_init(trace_cursor_t *cursor, int cpu, bool consume) {
+    cursor->cpu = cpu;
+    cursor->consume = consume;
+
+    spin_lock(&trace_read_lock_);
+    for (uint32_t i = 0; i < cpu_count && i < MAX_CPU_NUM; i++) {
+        trace_buffer_t *buf = &trace_buffers[i];
+
+        cursor->pos[i] =
+            MAX(buf->read, __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE));
+    }
+    spin_unlock(&trace_read_lock_);
+}
+
+/* Under trace_read_lock(). */
+size_t trace_cursor_peek(trace_cursor_t *cursor, void *buf, uint32_t *cpu) {
+    uint8_t record[TRACE_RECORD_MAX] __attribute__((aligned(8)));
+    uint64_t best_ts = UINT64_MAX;
+    size_t best_size = 0;
+
+    for (uint32_t i = 0; i < cpu_count && i < MAX_CPU_NUM; i++) {
+        trace_buffer_t *tb = &trace_buffers[i];
+        uint64_t *pos = cursor->consume ? &tb->read : &cursor->pos[i];
+        size_t size;
+
+        if (cursor->cpu >= 0 && (uint32_t)cursor->cpu != i)
+            continue;
+
+        size = trace_buffer_copy_record(tb, pos, record);
+        if (!size || ((trace_entry_t *)record)->ts >= best_ts)
+            continue;
+        best_ts = ((trace_entry_t *)record)->ts;
+        best_size = size;
+        *cpu = i;
+        memcpy(buf, record, size);
+    }
+    return best_size;
+}
+
+/* Under trace_read_lock(), after a peek that returned cpu and size. */
+void trace_cursor_advance(trace_cursor_t *cursor, uint32_t cpu, size_t size) {
+    trace_buffer_t *buf;
+
+    if (cpu >= MAX_CPU_NUM)
+        return;
+    buf = &trace_buffers[cpu];
+    if (cursor->consume) {
+        __atomic_store_n(&buf->read, buf->read + size, __ATOMIC_RELAXED);
+        buf->read_events++;
+    } else {
+        cursor->pos[cpu] += size;
+    }
+}
+
+void trace_readers_add(int delta) {
+    __atomic_add_fetch(&trace_nr_readers, delta, __ATOMIC_RELAXED);
+}
+
+static void trace_softirq(void) { tracefs_notify_readers(); }
+
+void trace_tick(void) {
+    if (!__atomic_load_n(&trace_wakeup_pending, __ATOMIC_RELAXED) ||
+        !__atomic_exchange_n(&trace_wakeup_pending, false, __ATOMIC_ACQ_REL))
+        return;
+    if (softirq_raise(SOFTIRQ_TRACE))
+        sched_wake_softirqd(current_cpu_id);
+}
+
+/* Events */
+
+typedef struct trace_sched_switch_rec {
+    trace_entry_t ent;
+    char prev_comm[TRACE_COMM_LEN];
+    int32_t prev_pid;
+    int32_t prev_prio;
+    int64_t prev_state;
+    char next_comm[TRACE_COMM_LEN];
+    int32_t next_pid;
+    int32_t next_prio;
+} trace_sched_switch_rec_t;
+
+typedef struct trace_sched_wakeup_rec {
+    trace_entry_t ent;
+    char comm[TRACE_COMM_LEN];
+    int32_t pid;
+    int32_t prio;
+    int32_t target_cpu;
+    int32_t __pad;
+} trace_sched_wakeup_rec_t;
+
+typedef struct trace_sys_enter_rec {
+    trace_entry_t ent;
+    int64_t id;
+    uint64_t args[6];
+} trace_sys_enter_rec_t;
+
+typedef struct trace_sys_exit_rec {
+    trace_entry_t ent;
+    int64_t id;
+    int64_t ret;
+} trace_sys_exit_rec_t;
+
+typedef struct trace_page_fault_rec {
+    trace_entry_t ent;
+    uint64_t address;
+    uint32_t flags;
+    int32_t result;
+} trace_page_fault_rec_t;
+
+typedef struct trace_block_rq_rec {
+    trace_entry_t ent;
+    uint64_t dev;
+    uint64_t sector;
+    uint32_t nr_sector;
+    int32_t error;
+    uint64_t bytes;
+    char rwbs[8];
+} trace_block_rq_rec_t;
+
+typedef struct trace_softirq_rec {
+    trace_entry_t ent;
+    uint32_t vec;
+    uint32_t __pad;
+} trace_softirq_rec_t;
+
+typedef struct trace_reclaim_rec {
+    trace_entry_t ent;
+    uint64_t nr_requested;
+    uint64_t nr_scanned;
+    uint64_t nr_reclaimed;
+} trace_reclaim_rec_t;
+
+static void trace_task_comm(task_t *task, char *comm) {
+    const char *base = strrchr(task->name, '/');
+
+    base = base ? base + 1 : task->name;
+    strncpy(comm, base, TRACE_COMM_LEN - 1);
+    comm[TRACE_COMM_LEN - 1] = '\0';
+}
+
+static int64_t trace_task_state(task_t *task) {
+    switch (task->state) {
+    case TASK_BLOCKING:
+        return 1;
+    case TASK_UNINTERRUPTABLE:
+        return 2;
+    case TASK_DIED:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+void trace_emit_sched_switch(task_t *prev, task_t *next) {
+    trace_sched_switch_rec_t rec = {0};
+
+    trace_task_comm(prev, rec.prev_comm);
+    rec.prev_pid = (int32_t)prev->pid;
+    rec.prev_prio = prev->sched_priority;
+    rec.prev_state = trace_task_state(prev);
+    trace_task_comm(next, rec.next_comm);
+    rec.next_pid = (int32_t)next->pid;
+    rec.next_prio = next->sched_priority;
+    trace_commit(TRACE_SCHED_SWITCH, &rec, sizeof(rec));
+}
+
+void trace_emit_sched_wakeup(task_t *task, uint32_t target_cpu) {
+    trace_sched_wakeup_rec_t rec = {0};
+
+    trace_task_comm(task, rec.comm);
+    rec.pid = (int32_t)task->pid;
+    rec.prio = task->sched_priority;
+    rec.target_cpu = (int32_t)target_cpu;
+    trace_commit(TRACE_SCHED_WAKEUP, &rec, sizeof(rec));
+}
+
+void trace_emit_sys_enter(uint64_t nr, uint64_t arg1, uint64_t arg2,
+                          uint64_t arg3, uint64_t arg4, uint64_t arg5,
+                          uint64_t arg6) {
+    trace_sys_enter_rec_t rec = {0};
+
+    rec.id = (int64_t)nr;
+    rec.args[0] = arg1;
+    rec.args[1] = arg2;
+    rec.args[2] = arg3;
+    rec.args[3] = arg4;
+    rec.args[4] = arg5;
+    rec.args[5] = arg6;
+    trace_commit(TRACE_SYS_ENTER, &rec, sizeof(rec));
+}
+
+void trace_emit_sys_exit(uint64_t nr, uint64_t ret) {
+    trace_sys_exit_rec_t rec = {0};
+
+    rec.id = (int64_t)nr;
+    rec.ret = (int64_t)ret;
+    trace_commit(TRACE_SYS_EXIT, &rec, sizeof(rec));
+}
+
+void trace_emit_page_fault(uint64_t address, uint64_t flags, int result) {
+    trace_page_fault_rec_t rec = {0};
+
+    rec.address = address;
+    rec.flags = (uint32_t)flags;
+    rec.result = result;
+    trace_commit(TRACE_PAGE_FAULT, &rec, sizeof(rec));
+}
+
+void trace_emit_block_rq(trace_event_id_t id, uint64_t dev, uint64_t offset,
+                         uint64_t len, int dir, uint64_t ret) {
+    trace_block_rq_rec_t rec = {0};
+
+    rec.dev = dev;
+    rec.sector = offset / 512;
+    rec.nr_sector = (uint32_t)MIN(len / 512, (uint64_t)UINT32_MAX);
+    rec.bytes = len;
+    rec.error = (int64_t)ret < 0 ? -EIO : 0;
+    rec.rwbs[0] = dir ? 'W' : 'R';
+    trace_commit(id, &rec, sizeof(rec));
+}
+
+void trace_emit_softirq(trace_event_id_t id, uint32_t vec) {
+    trace_softirq_rec_t rec = {0};
+
+    rec.vec = vec;
+    trace_commit(id, &rec, sizeof(rec));
+}
+
+void trace_emit_pagecache_reclaim(uint64_t nr_requested, uint64_t nr_scanned,
+                                  uint64_t nr_reclaimed) {
+    trace_reclaim_rec_t rec = {0};
+
+    rec.nr_requested = nr_requested;
+    rec.nr_scanned = nr_scanned;
+    rec.nr_reclaimed = nr_reclaimed;
+    trace_commit(TRACE_PAGECACHE_RECLAIM, &rec, sizeof(rec));
+}
+
+/* Output */
+
+static const char *trace_softirq_name(uint32_t vec) {
+    switch (vec) {
+    case SOFTIRQ_TIMER:
+        return "TIMER";
+    case SOFTIRQ_TIMERFD:
+        return "TIMERFD";
+    case SOFTIRQ_TASK_REAP:
+        return "TASK_REAP";
+    case SOFTIRQ_PERF:
+        return "PERF";
+    case SOFTIRQ_TRACE:
+        return "TRACE";
+    default:
+        return "?";
+    }
+}
+
+static const char *trace_fault_result_name(int result) {
+    switch (result) {
+    case PF_RES_OK:
+        return "ok";
+    case PF_RES_SEGF:
+        return "segv";
+    case PF_RES_NOMEM:
+        return "nomem";
+    default:
+        return "?";
+    }
+}
+
+static char trace_state_char(int64_t state) {
+    switch (state) {
+    case 1:
+        return 'S';
+    case 2:
+        return 'D';
+    case 16:
+        return 'X';
+    default:
+        return 'R';
+    }
+}
+
+static int trace_print_sched_switch(char *buf, size_t size, const void *p) {
+    const trace_sched_switch_rec_t *rec = p;
+
+    return snprintf(buf, size,
+                    "prev_comm=%s prev_pid=%d prev_prio=%d prev_state=%c ==> "
+                    "next_comm=%s next_pid=%d next_prio=%d",
+                    rec->prev_comm, rec->prev_pid, rec->prev_prio,
+                    trace_state_char(rec->prev_state), rec->next_comm,
+                    rec->next_pid, rec->next_prio);
+}
+
+static int trace_print_sched_wakeup(char *buf, size_t size, const void *p) {
+    const trace_sched_wakeup_rec_t *rec = p;
+
+    return snprintf(buf, size, "comm=%s pid=%d prio=%d target_cpu=%03d",
+                    rec->comm, rec->pid, rec->prio, rec->target_cpu);
+}
+
+static int trace_print_sys_enter(char *buf, size_t size, const void *p) {
+    const trace_sys_enter_rec_t *rec = p;
+
+    return snprintf(buf, size,
+                    "NR %lld (%llx, %llx, %llx, %llx, %llx, %llx)",
+                    (long long)rec->id, (unsigned long long)rec->args[0],
+                    (unsigned long long)rec->args[1],
+                    (unsigned long long)rec->args[2],
+                    (unsigned long long)rec->args[3],
+                    (unsigned long long)rec->args[4],
+                    (unsigned long long)rec->args[5]);
+}
+
+static int trace_print_sys_exit(char *buf, size_t size, const void *p) {
+    const trace_sys_exit_rec_t *rec = p;
+
+    return snprintf(buf, size, "NR %lld = %lld", (long long)rec->id,
+                    (long long)rec->ret);
+}
+
+static int trace_print_page_fault(char *buf, size_t size, const void *p) {
+    const trace_page_fault_rec_t *rec = p;
+
+    return snprintf(buf, size, "address=%#llx flags=%c%c%c%c%c result=%s",
+                    (unsigned long long)rec->address,
+                    (rec->flags & PF_ACCESS_WRITE)     ? 'w'
+                    : (rec->flags & PF_ACCESS_EXEC)    ? 'x'
+                                                       : 'r',
+                    (rec->flags & PF_ACCESS_USER) ? 'u' : 'k',
+                    (rec->flags & PF_ACCESS_PRESENT) ? 'p' : '-',
+                    (rec->flags & PF_ACCESS_EXEC) ? 'x' : '-',
+                    (rec->flags & PF_ACCESS_WRITE) ? 'w' : '-',
+                    trace_fault_result_name(rec->result));
+}
+
+static int trace_print_block_rq_issue(char *buf, size_t size, const void *p) {
+    const trace_block_rq_rec_t *rec = p;
+
+    return snprintf(buf, size, "dev=%llu %s %llu + %u bytes=%llu",
+                    (unsigned long long)rec->dev, rec->rwbs,
+                    (unsigned long long)rec->sector, rec->nr_sector,
+                    (unsigned long long)rec->bytes);
+}
+
+static int trace_print_block_rq_complete(char *buf, size_t size,
+                                         const void *p) {
+    const trace_block_rq_rec_t *rec = p;
+
+    return snprintf(buf, size, "dev=%llu %s %llu + %u [%d]",
+                    (unsigned long long)rec->dev, rec->rwbs,
+                    (unsigned long long)rec->sector, rec->nr_sector,
+                    rec->error);
+}
+
+static int trace_print_softirq(char *buf, size_t size, const void *p) {
+    const trace_softirq_rec_t *rec = p;
+
+    return snprintf(buf, size, "vec=%u [action=%s]", rec->vec,
+                    trace_softirq_name(rec->vec));
+}
+
+static int trace_print_reclaim(char *buf, size_t size, const void *p) {
+    const trace_reclaim_rec_t *rec = p;
+
+    return snprintf(buf, size,
+                    "nr_requested=%llu nr_scanned=%llu nr_reclaimed=%llu",
+                    (unsigned long long)rec->nr_requested,
+                    (unsigned long long)rec->nr_scanned,
+                    (unsigned long long)rec->nr_reclaimed);
+}
+
+#define TRACE_FIELD(type, decl, member, sign)                                  \
+    {decl, offsetof(type, member), sizeof(((type *)0)->member), sign}
+#define TRACE_FIELDS(fields) fields, sizeof(fields) / sizeof(fields[0])
+
+static const trace_field_t trace_sched_switch_fields[] = {
+    TRACE_FIELD(trace_sched_switch_rec_t, "char prev_comm[16]", prev_comm,
+                false),
+    TRACE_FIELD(trace_sched_switch_rec_t, "int prev_pid", prev_pid, true),
+    TRACE_FIELD(trace_sched_switch_rec_t, "int prev_prio", prev_prio, true),
+    TRACE_FIELD(trace_sched_switch_rec_t, "long prev_state", prev_state, true),
+    TRACE_FIELD(trace_sched_switch_rec_t, "char next_comm[16]", next_comm,
+                false),
+    TRACE_FIELD(trace_sched_switch_rec_t, "int next_pid", next_pid, true),
+    TRACE_FIELD(trace_sched_switch_rec_t, "int next_prio", next_prio, true),
+};
+
+static const trace_field_t trace_sched_wakeup_fields[] = {
+    TRACE_FIELD(trace_sched_wakeup_rec_t, "char comm[16]", comm, false),
+    TRACE_FIELD(trace_sched_wakeup_rec_t, "int pid", pid, true),
+    TRACE_FIELD(trace_sched_wakeup_rec_t, "int prio", prio, true),
+    TRACE_FIELD(trace_sched_wakeup_rec_t, "int target_cpu", target_cpu, true),
+};
+
+static const trace_field_t trace_sys_enter_fields[] = {
+    TRACE_FIELD(trace_sys_enter_rec_t, "long id", id, true),
+    TRACE_FIELD(trace_sys_enter_rec_t, "unsigned long args[6]", args, false),
+};
+
+static const trace_field_t trace_sys_exit_fields[] = {
+    TRACE_FIELD(trace_sys_exit_rec_t, "long id", id, true),
+    TRACE_FIELD(trace_sys_exit_rec_t, "long ret", ret, true),
+};
+
+static const trace_field_t trace_page_fault_fields[] = {
+    TRACE_FIELD(trace_page_fault_rec_t, "unsigned long address", address,
+                false),
+    TRACE_FIELD(trace_page_fault_rec_t, "unsigned int flags", flags, false),
+    TRACE_FIELD(trace_page_fault_rec_t, "int result", result, true),
+};
+
+static const trace_field_t trace_block_rq_fields[] = {
+    TRACE_FIELD(trace_block_rq_rec_t, "u64 dev", dev, false),
+    TRACE_FIELD(trace_block_rq_rec_t, "u64 sector", sector, false),
+    TRACE_FIELD(trace_block_rq_rec_t, "unsigned int nr_sector", nr_sector,
+                false),
+    TRACE_FIELD(trace_block_rq_rec_t, "int error", error, true),
+    TRACE_FIELD(trace_block_rq_rec_t, "u64 bytes", bytes, false),
+    TRACE_FIELD(trace_block_rq_rec_t, "char rwbs[8]", rwbs, false),
+};
+
+static const trace_field_t trace_softirq_fields[] = {
+    TRACE_FIELD(trace_softirq_rec_t, "unsigned int vec", vec, false),
+};
+
+static const trace_field_t trace_reclaim_fields[] = {
+    TRACE_FIELD(trace_reclaim_rec_t, "u64 nr_requested", nr_requested, false),
+    TRACE_FIELD(trace_reclaim_rec_t, "u64 nr_scanned", nr_scanned, false),
+    TRACE_FIELD(trace_reclaim_rec_t, "u64 nr_reclaimed", nr_reclaimed, false),
+};
+
+const trace_event_desc_t trace_events[NR_TRACE_EVENTS] = {
+    [TRACE_SCHED_SWITCH] =
+        {"sched", "sched_switch", TRACE_FIELDS(trace_sched_switch_fields),
+         "\"prev_comm=%s prev_pid=%d prev_prio=%d prev_state=%ld ==> "
+         "next_comm=%s next_pid=%d next_prio=%d\", REC->prev_comm, "
+         "REC->prev_pid, REC->prev_prio, REC->prev_state, REC->next_comm, "
+         "REC->next_pid, REC->next_prio",
+         trace_print_sched_switch},
+    [TRACE_SCHED_WAKEUP] =
+        {"sched", "sched_wakeup", TRACE_FIELDS(trace_sched_wakeup_fields),
+         "\"comm=%s pid=%d prio=%d target_cpu=%03d\", REC->comm, REC->pid, "
+         "REC->prio, REC->target_cpu",
+         trace_print_sched_wakeup},
+    [TRACE_SYS_ENTER] =
+        {"raw_syscalls", "sys_enter", TRACE_FIELDS(trace_sys_enter_fields),
+         "\"NR %ld (%lx, %lx, %lx, %lx, %lx, %lx)\", REC->id, REC->args[0], "
+         "REC->args[1], REC->args[2], REC->args[3], REC->args[4], "
+         "REC->args[5]",
+         trace_print_sys_enter},
+    [TRACE_SYS_EXIT] = {"raw_syscalls", "sys_exit",
+                        TRACE_FIELDS(trace_sys_exit_fields),
+                        "\"NR %ld = %ld\", REC->id, REC->ret",
+                        trace_print_sys_exit},
+    [TRACE_PAGE_FAULT] = {"mm", "page_fault",
+                          TRACE_FIELDS(trace_page_fault_fields),
+                          "\"address=%#lx flags=%#x result=%d\", "
+                          "REC->address, REC->flags, REC->result",
+                          trace_print_page_fault},
+    [TRACE_BLOCK_RQ_ISSUE] = {"block", "block_rq_issue",
+                              TRACE_FIELDS(trace_block_rq_fields),
+                              "\"dev=%llu %s %llu + %u bytes=%llu\", "
+                              "REC->dev, REC->rwbs, REC->sector, "
+                              "REC->nr_sector, REC->bytes",
+                              trace_print_block_rq_issue},
+    [TRACE_BLOCK_RQ_COMPLETE] = {"block", "block_rq_complete",
+                                 TRACE_FIELDS(trace_block_rq_fields),
+                                 "\"dev=%llu %s %llu + %u [%d]\", REC->dev, "
+                                 "REC->rwbs, REC->sector, REC->nr_sector, "
+                                 "REC->error",
+                                 trace_print_block_rq_complete},
+    [TRACE_SOFTIRQ_ENTRY] = {"irq", "softirq_entry",
+                             TRACE_FIELDS(trace_softirq_fields),
+                             "\"vec=%u\", REC->vec", trace_print_softirq},
+    [TRACE_SOFTIRQ_EXIT] = {"irq", "softirq_exit",
+                            TRACE_FIELDS(trace_softirq_fields),
+                            "\"vec=%u\", REC->vec", trace_print_softirq},
+    [TRACE_PAGECACHE_RECLAIM] =
+        {"mm", "pagecache_reclaim", TRACE_FIELDS(trace_reclaim_fields),
+         "\"nr_requested=%llu nr_scanned=%llu nr_reclaimed=%llu\", "
+         "REC->nr_requested, REC->nr_scanned, REC->nr_reclaimed",
+         trace_print_reclaim},
+};
+
+static void trace_lookup_comm(uint32_t pid, char *comm) {
+    task_t *task;
+
+    spin_lock(&task_queue_lock);
+    task = task_lookup_by_pid_nolock(pid);
+    if (task)
+        trace_task_comm(task, comm);
+    else
+        strcpy(comm, "<...>");
+    spin_unlock(&task_queue_lock);
+}
+
+int trace_format_record(const void *record, uint32_t cpu, char *buf,
+                        size_t size) {
+    const trace_entry_t *entry = record;
+    const trace_event_desc_t *desc;
+    char comm[TRACE_COMM_LEN];
+    int len, n;
+
+    if (!entry->type || entry->type > NR_TRACE_EVENTS)
+        return snprintf(buf, size, "Unknown type %u\n", entry->type);
+    desc = &trace_events[entry->type - 1];
+
+    trace_lookup_comm(entry->pid, comm);
+    len = snprintf(buf, size, "%16s-%-7u [%03u] %6llu.%06llu: %s: ", comm,
+                   entry->pid, cpu,
+                   (unsigned long long)(entry->ts / 1000000000ULL),
+                   (unsigned long long)(entry->ts % 1000000000ULL / 1000),
+                   desc->name);
+    if (len < 0 || (size_t)len >= size)
+        return (int)size - 1;
+    n = desc->print(buf + len, size - len, record);
+    if (n < 0 || (size_t)(len + n) >= size - 1)
+        len = (int)size - 2;
+    else
+        len += n;
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    return len;
+}
+
+int trace_format_header(char *buf, size_t size) {
+    uint64_t entries = 0, written = 0;
+
+    for (uint32_t cpu = 0; cpu < cpu_count && cpu < MAX_CPU_NUM; cpu++) {
+        trace_cpu_stats_t stats;
+
+        trace_cpu_stats(cpu, &stats);
+        entries += stats.entries;
+        written += __atomic_load_n(&trace_buffers[cpu].written,
+                                   __ATOMIC_RELAXED);
+    }
+
+    return snprintf(buf, size,
+                    "# tracer: nop\n"
+                    "#\n"
+                    "# entries-in-buffer/entries-written: %llu/%llu   #P:%u\n"
+                    "#\n"
+                    "#           TASK-PID     CPU#     TIMESTAMP  FUNCTION\n"
+                    "#              | |         |         |         |\n",
+                    (unsigned long long)entries, (unsigned long long)written,
+                    (uint32_t)cpu_count);
+}
+
+void trace_init(void) {
+    softirq_register(SOFTIRQ_TRACE, trace_softirq);
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <libs/klibc.h>
+
+struct task;
+
+/*
+ * Static tracepoints. A call site costs one load of trace_active_mask and a
+ * branch that is not taken while its event is off; only enabled events
+ * reach the out-of-line trace_emit_*() functions.
+ *
+ * Records go to a ring buffer per CPU. A writer only ever touches the buffer
+ * of the CPU it runs on, with interrupts off, so it takes no lock. When the
+ * buffer is full the oldest records are overwritten and counted as overrun.
+ * Readers check after copying a record that the writer did not overwrite it
+ * meanwhile, and skip ahead if it did.
+ *
+ * tracefs shows the buffers formatted (trace, trace_pipe) and as the raw
+ * records below (per_cpu/cpuN/trace_pipe_raw), whose payload layout the
+ * events/<system>/<event>/format files describe.
+ */
+
+typedef enum trace_event_id {
+    TRACE_SCHED_SWITCH = 0,
+    TRACE_SCHED_WAKEUP,
+    TRACE_SYS_ENTER,
+    TRACE_SYS_EXIT,
+    TRACE_PAGE_FAULT,
+    TRACE_BLOCK_RQ_ISSUE,
+    TRACE_BLOCK_RQ_COMPLETE,
+    TRACE_SOFTIRQ_ENTRY,
+    TRACE_SOFTIRQ_EXIT,
+    TRACE_PAGECACHE_RECLAIM,
+    NR_TRACE_EVENTS,
+} trace_event_id_t;
+
+/* Record header; the event payload follows, padded to 8 bytes. */
+typedef struct trace_entry {
+    uint16_t type; // trace_event_id_t + 1, 0 is never written
+    uint16_t size; // header and payload
+    uint32_t pid;
+    uint64_t ts; // nano_time()
+} trace_entry_t;
+
+#define TRACE_RECORD_MAX 256
+#define TRACE_COMM_LEN 16
+#define TRACE_BUF_SIZE_DFL (256ULL * 1024)
+#define TRACE_BUF_SIZE_MIN (4ULL * 1024)
+#define TRACE_BUF_SIZE_MAX (64ULL * 1024 * 1024)
+#define TRACE_PIPE_WAIT_NS (10ULL * 1000000ULL)
+
+/* Enabled events while tracing_on is set, 0 otherwise. */
+extern uint64_t trace_active_mask;
+
+static inline bool trace_enabled(trace_event_id_t id) {
+    return __builtin_expect(
+        (__atomic_load_n(&trace_active_mask, __ATOMIC_RELAXED) >> id) & 1, 0);
+}
+
+void trace_emit_sched_switch(struct task *prev, struct task *next);
+void trace_emit_sched_wakeup(struct task *task, uint32_t target_cpu);
+void trace_emit_sys_enter(uint64_t nr, uint64_t arg1, uint64_t arg2,
+                          uint64_t arg3, uint64_t arg4, uint64_t arg5,
+                          uint64_t arg6);
+void trace_emit_sys_exit(uint64_t nr, uint64_t ret);
+void trace_emit_page_fault(uint64_t address, uint64_t flags, int result);
+void trace_emit_block_rq(trace_event_id_t id, uint64_t dev, uint64_t offset,
+                         uint64_t len, int dir, uint64_t ret);
+void trace_emit_softirq(trace_event_id_t id, uint32_t vec);
+void trace_emit_pagecache_reclaim(uint64_t nr_requested, uint64_t nr_scanned,
+                                  uint64_t nr_reclaimed);
+
+static inline void trace_sched_switch(struct task *prev, struct task *next) {
+    if (trace_enabled(TRACE_SCHED_SWITCH))
+        trace_emit_sched_switch(prev, next);
+}
+
+static inline void trace_sched_wakeup(struct task *task, uint32_t target_cpu) {
+    if (trace_enabled(TRACE_SCHED_WAKEUP))
+        trace_emit_sched_wakeup(task, target_cpu);
+}
+
+static inline void trace_sys_enter(uint64_t nr, uint64_t arg1, uint64_t arg2,
+                                   uint64_t arg3, uint64_t arg4, uint64_t arg5,
+                                   uint64_t arg6) {
+    if (trace_enabled(TRACE_SYS_ENTER))
+        trace_emit_sys_enter(nr, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+static inline void trace_sys_exit(uint64_t nr, uint64_t ret) {
+    if (trace_enabled(TRACE_SYS_EXIT))
+        trace_emit_sys_exit(nr, ret);
+}
+
+static inline void trace_page_fault(uint64_t address, uint64_t flags,
+                                    int result) {
+    if (trace_enabled(TRACE_PAGE_FAULT))
+        trace_emit_page_fault(address, flags, result);
+}
+
+static inline void trace_block_rq_issue(uint64_t dev, uint64_t offset,
+                                        uint64_t len, int dir) {
+    if (trace_enabled(TRACE_BLOCK_RQ_ISSUE))
+        trace_emit_block_rq(TRACE_BLOCK_RQ_ISSUE, dev, offset, len, dir, 0);
+}
+
+static inline void trace_block_rq_complete(uint64_t dev, uint64_t offset,
+                                           uint64_t len, int dir,
+                                           uint64_t ret) {
+    if (trace_enabled(TRACE_BLOCK_RQ_COMPLETE))
+        trace_emit_block_rq(TRACE_BLOCK_RQ_COMPLETE, dev, offset, len, dir,
+                            ret);
+}
+
+static inline void trace_softirq_entry(uint32_t vec) {
+    if (trace_enabled(TRACE_SOFTIRQ_ENTRY))
+        trace_emit_softirq(TRACE_SOFTIRQ_ENTRY, vec);
+}
+
+static inline void trace_softirq_exit(uint32_t vec) {
+    if (trace_enabled(TRACE_SOFTIRQ_EXIT))
+        trace_emit_softirq(TRACE_SOFTIRQ_EXIT, vec);
+}
+
+static inline void trace_pagecache_reclaim(uint64_t nr_requested,
+                                           uint64_t nr_scanned,
+                                           uint64_t nr_reclaimed) {
+    if (trace_enabled(TRACE_PAGECACHE_RECLAIM))
+        trace_emit_pagecache_reclaim(nr_requested, nr_scanned, nr_reclaimed);
+}
+
+/* Event table, for tracefs. */
+typedef struct trace_field {
+    const char *decl; // "int prev_pid", "char prev_comm[16]"
+    uint16_t offset;  // from the start of the record
+    uint16_t size;
+    bool is_signed;
+} trace_field_t;
+
+typedef struct trace_event_desc {
+    const char *system;
+    const char *name;
+    const trace_field_t *fields;
+    size_t nr_fields;
+    const char *print_fmt;
+    int (*print)(char *buf, size_t size, const void *payload);
+} trace_event_desc_t;
+
+extern const trace_event_desc_t trace_events[NR_TRACE_EVENTS];
+
+typedef struct trace_cpu_stats {
+    uint64_t entries;  // records nobody has consumed yet
+    uint64_t overrun;  // overwritten before anybody consumed them
+    uint64_t bytes;    // unread bytes
+    uint64_t oldest_ts;
+    uint64_t dropped;  // lost while the buffer was being reset
+    uint64_t read_events;
+} trace_cpu_stats_t;
+
+bool trace_is_on(void);
+int trace_set_on(bool on);
+bool trace_event_is_enabled(trace_event_id_t id);
+int trace_event_set_enabled(trace_event_id_t id, bool enabled);
+uint64_t trace_buffer_size(void);
+int trace_buffer_resize(uint64_t size);
+void trace_buffer_reset(int cpu); // -1 for every CPU
+void trace_cpu_stats(uint32_t cpu, trace_cpu_stats_t *stats);
+
+/*
+ * Readers. A cursor walks one CPU's buffer (or all of them merged by
+ * timestamp when cpu is -1). Consuming cursors share the position of
+ * trace_pipe; the others only see a snapshot.
+ */
+typedef struct trace_cursor {
+    int cpu;
+    bool consume;
+    uint64_t pos[MAX_CPU_NUM];
+} trace_cursor_t;
+
+void trace_cursor_init(trace_cursor_t *cursor, int cpu, bool consume);
+/* Copies the next record into buf, TRACE_RECORD_MAX bytes, or returns 0. */
+size_t trace_cursor_peek(trace_cursor_t *cursor, void *buf, uint32_t *cpu);
+void trace_cursor_advance(trace_cursor_t *cursor, uint32_t cpu, size_t size);
+void trace_read_lock(void);
+void trace_read_unlock(void);
+
+/* One line as trace and trace_pipe print it, NUL-terminated. */
+int trace_format_record(const void *record, uint32_t cpu, char *buf,
+                        size_t size);
+int trace_format_header(char *buf, size_t size);
+
+/*
+ * Writers cannot wake anybody from where tracepoints sit, so while readers
+ * are open they only flag new data; the next timer interrupt raises
+ * SOFTIRQ_TRACE, which calls tracefs_notify_readers().
+ */
+void trace_readers_add(int delta);
+void trace_tick(void);
+void trace_init(void);
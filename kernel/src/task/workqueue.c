@@ -0,0 +1,765 @@
+#include <task/workqueue.h>
+#include <task/task.h>
+#include <libs/string_builder.h>
+#include <drivers/logger.h>
+
+/*
+ * Deferred work runs on kernel worker threads grouped into pools. Each CPU has
+ * a bound pool whose workers stay on that CPU, plus one unbound pool shared by
+ * WQ_UNBOUND queues. A bound pool normally runs one work item at a time; when
+ * that item blocks, task_block() reports it through workqueue_worker_sleeping()
+ * and the pool wakes (or asks the manager to create) another worker so the
+ * remaining items keep making progress.
+ *
+ * Workers are created lazily by a single manager thread, which also fires the
+ * timers of delayed work. Idle workers beyond the first exit after
+ * WQ_IDLE_TIMEOUT_NS.
+ */
+
+#define WQ_IDLE_TIMEOUT_NS (5ULL * 1000000000ULL)
+#define WQ_MAX_WORKERS_PER_POOL 32
+#define WQ_TIMER_BATCH 32
+
+typedef struct worker_pool {
+    spinlock_t lock;
+    uint32_t cpu;
+    uint32_t max_active;
+    struct llist_header worklist;
+    struct llist_header idle_list;
+    struct llist_header workers;
+    uint32_t nr_workers;
+    uint32_t nr_idle;
+    uint32_t nr_running;
+    uint32_t nr_starting;
+    uint32_t next_worker_id;
+    uint64_t nr_pending;
+    bool need_worker;
+} worker_pool_t;
+
+typedef struct workqueue_worker {
+    struct llist_header node;
+    struct llist_header idle_node;
+    worker_pool_t *pool;
+    task_t *task;
+    work_struct_t *current_work;
+    workqueue_t *current_wq;
+    uint32_t id;
+    bool idle;
+    bool sleeping;
+} workqueue_worker_t;
+
+workqueue_t *system_wq = NULL;
+workqueue_t *system_unbound_wq = NULL;
+
+static worker_pool_t bound_pools[MAX_CPU_NUM];
+static worker_pool_t unbound_pool;
+static bool workqueue_ready = false;
+
+static DEFINE_LLIST(workqueue_list);
+static spinlock_t workqueue_list_lock = SPIN_INIT;
+
+static task_t *workqueue_manager_task = NULL;
+static bool workqueue_manager_pending = false;
+
+static rb_root_t workqueue_timer_root = RB_ROOT_INIT;
+static spinlock_t workqueue_timer_lock = SPIN_INIT;
+
+static wait_queue_head_t workqueue_flush_wait;
+static uint32_t workqueue_flush_waiters = 0;
+
+static inline void workqueue_stat_max(uint64_t *slot, uint64_t value) {
+    uint64_t old = __atomic_load_n(slot, __ATOMIC_RELAXED);
+
+    while (value > old &&
+           !__atomic_compare_exchange_n(slot, &old, value, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void workqueue_wake_manager() {
+    __atomic_store_n(&workqueue_manager_pending, true, __ATOMIC_RELEASE);
+    if (workqueue_manager_task)
+        task_unblock(workqueue_manager_task, EOK);
+}
+
+static void workqueue_wake_flushers() {
+    if (__atomic_load_n(&workqueue_flush_waiters, __ATOMIC_ACQUIRE))
+        wait_queue_wake_all(&workqueue_flush_wait, 0, EOK);
+}
+
+static worker_pool_t *workqueue_select_pool(workqueue_t *wq, uint32_t cpu) {
+    if (wq->flags & WQ_UNBOUND)
+        return &unbound_pool;
+    if (cpu == WORK_CPU_UNBOUND || cpu >= cpu_count)
+        cpu = current_cpu_id;
+    return &bound_pools[cpu];
+}
+
+/* Make sure enough workers are runnable for the pending items. Returns an
+ * idle worker task to wake once the pool lock has been dropped. */
+static task_t *workqueue_pool_kick_locked(worker_pool_t *pool) {
+    if (llist_empty(&pool->worklist))
+        return NULL;
+    if (pool->nr_running + pool->nr_starting >= pool->max_active)
+        return NULL;
+
+    if (!llist_empty(&pool->idle_list)) {
+        workqueue_worker_t *worker = list_entry(
+            pool->idle_list.next, workqueue_worker_t, idle_node);
+        llist_delete(&worker->idle_node);
+        worker->idle = false;
+        pool->nr_idle--;
+        pool->nr_running++;
+        return worker->task;
+    }
+
+    if (pool->nr_workers + pool->nr_starting < WQ_MAX_WORKERS_PER_POOL &&
+        !pool->need_worker) {
+        pool->need_worker = true;
+        workqueue_wake_manager();
+    }
+    return NULL;
+}
+
+static void workqueue_insert_work(workqueue_t *wq, uint32_t cpu,
+                                  work_struct_t *work) {
+    worker_pool_t *pool = workqueue_select_pool(wq, cpu);
+
+    spin_lock(&pool->lock);
+    work->wq = wq;
+    work->queued_ns = nano_time();
+    __atomic_store_n(&work->pool, pool, __ATOMIC_RELEASE);
+    llist_append(&pool->worklist, &work->entry);
+    pool->nr_pending++;
+    __atomic_fetch_add(&wq->nr_active, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&wq->stats.queued, 1, __ATOMIC_RELAXED);
+    task_t *wake = workqueue_pool_kick_locked(pool);
+    spin_unlock(&pool->lock);
+
+    if (wake)
+        task_unblock(wake, EOK);
+}
+
+static void workqueue_work_done(workqueue_t *wq) {
+    __atomic_fetch_sub(&wq->nr_active, 1, __ATOMIC_RELEASE);
+    workqueue_wake_flushers();
+}
+
+void init_work(work_struct_t *work, work_func_t func) {
+    memset(work, 0, sizeof(*work));
+    llist_init_head(&work->entry);
+    work->func = func;
+}
+
+void init_delayed_work(delayed_work_t *dwork, work_func_t func) {
+    memset(dwork, 0, sizeof(*dwork));
+    init_work(&dwork->work, func);
+    dwork->cpu = WORK_CPU_UNBOUND;
+}
+
+bool work_pending(work_struct_t *work) {
+    return __atomic_load_n(&work->pending, __ATOMIC_ACQUIRE) != 0;
+}
+
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_struct_t *work) {
+    uint32_t expected = 0;
+
+    if (!wq || !work || !work->func || !workqueue_ready)
+        return false;
+    if (!__atomic_compare_exchange_n(&work->pending, &expected, 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return false;
+
+    workqueue_insert_work(wq, cpu, work);
+    return true;
+}
+
+bool queue_work(workqueue_t *wq, work_struct_t *work) {
+    return queue_work_on(WORK_CPU_UNBOUND, wq, work);
+}
+
+bool schedule_work(work_struct_t *work) { return queue_work(system_wq, work); }
+
+static void workqueue_timer_add_locked(delayed_work_t *dwork) {
+    rb_node_t **slot = &workqueue_timer_root.rb_node;
+    rb_node_t *parent = NULL;
+
+    while (*slot) {
+        delayed_work_t *curr = rb_entry(*slot, delayed_work_t, timer_node);
+        parent = *slot;
+        if (dwork->expires_ns < curr->expires_ns)
+            slot = &(*slot)->rb_left;
+        else
+            slot = &(*slot)->rb_right;
+    }
+
+    dwork->timer_node.rb_left = NULL;
+    dwork->timer_node.rb_right = NULL;
+    rb_set_parent(&dwork->timer_node, parent);
+    rb_set_color(&dwork->timer_node, KRB_RED);
+    *slot = &dwork->timer_node;
+    rb_insert_color(&dwork->timer_node, &workqueue_timer_root);
+    dwork->timer_queued = true;
+}
+
+static void workqueue_timer_remove_locked(delayed_work_t *dwork) {
+    rb_erase(&dwork->timer_node, &workqueue_timer_root);
+    memset(&dwork->timer_node, 0, sizeof(dwork->timer_node));
+    dwork->timer_queued = false;
+}
+
+bool queue_delayed_work_on(uint32_t cpu, workqueue_t *wq,
+                           delayed_work_t *dwork, uint64_t delay_ns) {
+    uint32_t expected = 0;
+
+    if (!dwork)
+        return false;
+    if (!delay_ns)
+        return queue_work_on(cpu, wq, &dwork->work);
+    if (!wq || !dwork->work.func || !workqueue_ready)
+        return false;
+    if (!__atomic_compare_exchange_n(&dwork->work.pending, &expected, 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return false;
+
+    spin_lock(&workqueue_timer_lock);
+    dwork->wq = wq;
+    dwork->cpu = cpu;
+    dwork->expires_ns = nano_time() + delay_ns;
+    workqueue_timer_add_locked(dwork);
+    bool first = rb_first(&workqueue_timer_root) == &dwork->timer_node;
+    spin_unlock(&workqueue_timer_lock);
+
+    if (first)
+        workqueue_wake_manager();
+    return true;
+}
+
+bool queue_delayed_work(workqueue_t *wq, delayed_work_t *dwork,
+                        uint64_t delay_ns) {
+    return queue_delayed_work_on(WORK_CPU_UNBOUND, wq, dwork, delay_ns);
+}
+
+bool schedule_delayed_work(delayed_work_t *dwork, uint64_t delay_ns) {
+    return queue_delayed_work(system_wq, dwork, delay_ns);
+}
+
+/* Move expired delayed work onto its pool. Returns the next expiry. */
+static uint64_t workqueue_run_timers() {
+    delayed_work_t *expired[WQ_TIMER_BATCH];
+
+    while (true) {
+        size_t count = 0;
+        uint64_t next = UINT64_MAX;
+        uint64_t now = nano_time();
+
+        spin_lock(&workqueue_timer_lock);
+        while (count < WQ_TIMER_BATCH) {
+            rb_node_t *node = rb_first(&workqueue_timer_root);
+            if (!node)
+                break;
+            delayed_work_t *dwork = rb_entry(node, delayed_work_t, timer_node);
+            if (dwork->expires_ns > now) {
+                next = dwork->expires_ns;
+                break;
+            }
+            workqueue_timer_remove_locked(dwork);
+            expired[count++] = dwork;
+        }
+        spin_unlock(&workqueue_timer_lock);
+
+        for (size_t i = 0; i < count; i++)
+            workqueue_insert_work(expired[i]->wq, expired[i]->cpu,
+                                  &expired[i]->work);
+
+        if (count < WQ_TIMER_BATCH)
+            return next;
+    }
+}
+
+bool cancel_work(work_struct_t *work) {
+    if (!work)
+        return false;
+
+    while (true) {
+        worker_pool_t *pool = __atomic_load_n(&work->pool, __ATOMIC_ACQUIRE);
+        if (!pool)
+            return false;
+
+        spin_lock(&pool->lock);
+        if (work->pool != pool) {
+            spin_unlock(&pool->lock);
+            continue;
+        }
+        if (llist_empty(&work->entry)) {
+            spin_unlock(&pool->lock);
+            return false;
+        }
+
+        workqueue_t *wq = work->wq;
+        llist_delete(&work->entry);
+        pool->nr_pending--;
+        __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+        spin_unlock(&pool->lock);
+
+        __atomic_fetch_add(&wq->stats.cancelled, 1, __ATOMIC_RELAXED);
+        workqueue_work_done(wq);
+        return true;
+    }
+}
+
+bool cancel_delayed_work(delayed_work_t *dwork) {
+    if (!dwork)
+        return false;
+
+    spin_lock(&workqueue_timer_lock);
+    if (dwork->timer_queued) {
+        workqueue_timer_remove_locked(dwork);
+        __atomic_store_n(&dwork->work.pending, 0, __ATOMIC_RELEASE);
+        spin_unlock(&workqueue_timer_lock);
+        __atomic_fetch_add(&dwork->wq->stats.cancelled, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    spin_unlock(&workqueue_timer_lock);
+
+    return cancel_work(&dwork->work);
+}
+
+static bool workqueue_work_running(work_struct_t *work) {
+    worker_pool_t *pool = __atomic_load_n(&work->pool, __ATOMIC_ACQUIRE);
+    bool running = false;
+
+    if (!pool)
+        return false;
+
+    spin_lock(&pool->lock);
+    struct llist_header *pos = pool->workers.next;
+    while (pos != &pool->workers) {
+        workqueue_worker_t *worker = list_entry(pos, workqueue_worker_t, node);
+        if (worker->current_work == work) {
+            running = true;
+            break;
+        }
+        pos = pos->next;
+    }
+    spin_unlock(&pool->lock);
+
+    return running;
+}
+
+static bool workqueue_wait_until(bool (*done)(void *arg), void *arg,
+                                 const char *reason) {
+    wait_queue_entry_t wait;
+    bool waited = false;
+
+    while (!done(arg)) {
+        waited = true;
+        __atomic_fetch_add(&workqueue_flush_waiters, 1, __ATOMIC_ACQ_REL);
+        task_prepare_block(current_task);
+        wait_queue_entry_init(&wait, current_task, 0, NULL, NULL);
+        wait_queue_add(&workqueue_flush_wait, &wait);
+
+        if (!done(arg)) {
+            task_block(current_task, TASK_BLOCKING, -1, reason);
+        }
+
+        wait_queue_remove(&workqueue_flush_wait, &wait);
+        task_cancel_block_prepare(current_task);
+        __atomic_fetch_sub(&workqueue_flush_waiters, 1, __ATOMIC_ACQ_REL);
+    }
+
+    return waited;
+}
+
+static bool workqueue_work_idle(void *arg) {
+    work_struct_t *work = arg;
+    return !work_pending(work) && !workqueue_work_running(work);
+}
+
+bool flush_work(work_struct_t *work) {
+    if (!work || !workqueue_ready)
+        return false;
+    return workqueue_wait_until(workqueue_work_idle, work, "flush_work");
+}
+
+bool flush_delayed_work(delayed_work_t *dwork) {
+    if (!dwork)
+        return false;
+
+    spin_lock(&workqueue_timer_lock);
+    bool was_timer = dwork->timer_queued;
+    if (was_timer)
+        workqueue_timer_remove_locked(dwork);
+    spin_unlock(&workqueue_timer_lock);
+
+    if (was_timer)
+        workqueue_insert_work(dwork->wq, dwork->cpu, &dwork->work);
+
+    return flush_work(&dwork->work);
+}
+
+static bool workqueue_drained(void *arg) {
+    workqueue_t *wq = arg;
+    return __atomic_load_n(&wq->nr_active, __ATOMIC_ACQUIRE) == 0;
+}
+
+void flush_workqueue(workqueue_t *wq) {
+    if (!wq || !workqueue_ready)
+        return;
+    workqueue_wait_until(workqueue_drained, wq, "flush_workqueue");
+}
+
+workqueue_t *alloc_workqueue(const char *name, uint32_t flags) {
+    workqueue_t *wq = calloc(1, sizeof(workqueue_t));
+    if (!wq)
+        return NULL;
+
+    strncpy(wq->name, name ? name : "unnamed", WQ_NAME_MAX - 1);
+    wq->flags = flags;
+    llist_init_head(&wq->node);
+
+    spin_lock(&workqueue_list_lock);
+    llist_append(&workqueue_list, &wq->node);
+    spin_unlock(&workqueue_list_lock);
+
+    return wq;
+}
+
+void destroy_workqueue(workqueue_t *wq) {
+    if (!wq)
+        return;
+
+    flush_workqueue(wq);
+
+    spin_lock(&workqueue_list_lock);
+    llist_delete(&wq->node);
+    spin_unlock(&workqueue_list_lock);
+
+    free(wq);
+}
+
+void workqueue_worker_sleeping(task_t *task) {
+    workqueue_worker_t *worker = task ? task->wq_worker : NULL;
+
+    if (!worker || !worker->current_work || worker->sleeping)
+        return;
+
+    worker_pool_t *pool = worker->pool;
+    spin_lock(&pool->lock);
+    worker->sleeping = true;
+    pool->nr_running--;
+    task_t *wake = workqueue_pool_kick_locked(pool);
+    spin_unlock(&pool->lock);
+
+    if (wake)
+        task_unblock(wake, EOK);
+}
+
+void workqueue_worker_waking(task_t *task) {
+    workqueue_worker_t *worker = task ? task->wq_worker : NULL;
+
+    if (!worker || !worker->sleeping)
+        return;
+
+    worker_pool_t *pool = worker->pool;
+    spin_lock(&pool->lock);
+    worker->sleeping = false;
+    pool->nr_running++;
+    spin_unlock(&pool->lock);
+}
+
+static void workqueue_process_one(workqueue_worker_t *worker,
+                                  work_struct_t *work) {
+    worker_pool_t *pool = worker->pool;
+    workqueue_t *wq = work->wq;
+    work_func_t func = work->func;
+    uint64_t start_ns = nano_time();
+    uint64_t latency_ns =
+        start_ns > work->queued_ns ? start_ns - work->queued_ns : 0;
+
+    worker->current_work = work;
+    worker->current_wq = wq;
+    /* Clear pending before running so the item can requeue itself. */
+    __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+    task_t *wake = workqueue_pool_kick_locked(pool);
+    spin_unlock(&pool->lock);
+
+    if (wake)
+        task_unblock(wake, EOK);
+
+    __atomic_fetch_add(&wq->stats.latency_total_ns, latency_ns,
+                       __ATOMIC_RELAXED);
+    workqueue_stat_max(&wq->stats.latency_max_ns, latency_ns);
+
+    func(work);
+
+    /* The item may have been freed by func; only wq and worker are safe. */
+    uint64_t exec_ns = nano_time() - start_ns;
+    __atomic_fetch_add(&wq->stats.executed, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&wq->stats.exec_total_ns, exec_ns, __ATOMIC_RELAXED);
+    workqueue_stat_max(&wq->stats.exec_max_ns, exec_ns);
+
+    spin_lock(&pool->lock);
+    worker->current_work = NULL;
+    worker->current_wq = NULL;
+    spin_unlock(&pool->lock);
+
+    workqueue_work_done(wq);
+
+    spin_lock(&pool->lock);
+}
+
+static void workqueue_worker_thread(uint64_t arg) {
+    workqueue_worker_t *worker = (workqueue_worker_t *)arg;
+    worker_pool_t *pool = worker->pool;
+
+    arch_enable_interrupt();
+
+    worker->task = current_task;
+    current_task->wq_worker = worker;
+
+    spin_lock(&pool->lock);
+    pool->nr_starting--;
+    pool->nr_workers++;
+    pool->nr_running++;
+    llist_append(&pool->workers, &worker->node);
+
+    while (true) {
+        if (!llist_empty(&pool->worklist) &&
+            pool->nr_running <= pool->max_active) {
+            work_struct_t *work =
+                list_entry(pool->worklist.next, work_struct_t, entry);
+            llist_delete(&work->entry);
+            pool->nr_pending--;
+            workqueue_process_one(worker, work);
+            continue;
+        }
+
+        pool->nr_running--;
+        worker->idle = true;
+        pool->nr_idle++;
+        llist_prepend(&pool->idle_list, &worker->idle_node);
+        task_prepare_block(current_task);
+        spin_unlock(&pool->lock);
+
+        int reason = task_block(current_task, TASK_BLOCKING,
+                                WQ_IDLE_TIMEOUT_NS, "workqueue_idle");
+        task_cancel_block_prepare(current_task);
+
+        spin_lock(&pool->lock);
+        if (!worker->idle)
+            continue;
+
+        /* Not handed work by a waker: timed out or woke spuriously. */
+        llist_delete(&worker->idle_node);
+        worker->idle = false;
+        pool->nr_idle--;
+
+        if (reason == ETIMEDOUT && pool->nr_idle > 0 &&
+            llist_empty(&pool->worklist)) {
+            llist_delete(&worker->node);
+            pool->nr_workers--;
+            spin_unlock(&pool->lock);
+
+            current_task->wq_worker = NULL;
+            free(worker);
+            task_exit_thread(0);
+        }
+
+        pool->nr_running++;
+    }
+}
+
+static void workqueue_create_worker(worker_pool_t *pool) {
+    char name[TASK_NAME_MAX];
+    workqueue_worker_t *worker = calloc(1, sizeof(workqueue_worker_t));
+
+    spin_lock(&pool->lock);
+    if (!worker || !pool->need_worker) {
+        pool->need_worker = false;
+        spin_unlock(&pool->lock);
+        free(worker);
+        return;
+    }
+    pool->need_worker = false;
+    if (llist_empty(&pool->worklist) || !llist_empty(&pool->idle_list) ||
+        pool->nr_running + pool->nr_starting >= pool->max_active ||
+        pool->nr_workers + pool->nr_starting >= WQ_MAX_WORKERS_PER_POOL) {
+        spin_unlock(&pool->lock);
+        free(worker);
+        return;
+    }
+    pool->nr_starting++;
+    worker->id = pool->next_worker_id++;
+    spin_unlock(&pool->lock);
+
+    llist_init_head(&worker->node);
+    llist_init_head(&worker->idle_node);
+    worker->pool = pool;
+
+    task_t *task;
+    if (pool->cpu == WORK_CPU_UNBOUND) {
+        snprintf(name, sizeof(name), "kworker/u:%u", worker->id);
+        task = task_create(name, workqueue_worker_thread, (uint64_t)worker,
+                           KTHREAD_PRIORITY);
+    } else {
+        snprintf(name, sizeof(name), "kworker/%u:%u", pool->cpu, worker->id);
+        task = task_create_on_cpu(name, workqueue_worker_thread,
+                                  (uint64_t)worker, KTHREAD_PRIORITY,
+                                  pool->cpu);
+    }
+
+    if (!task) {
+        spin_lock(&pool->lock);
+        pool->nr_starting--;
+        spin_unlock(&pool->lock);
+        free(worker);
+    }
+}
+
+static void workqueue_manage_pools() {
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++) {
+        if (__atomic_load_n(&bound_pools[cpu].need_worker, __ATOMIC_ACQUIRE))
+            workqueue_create_worker(&bound_pools[cpu]);
+    }
+    if (__atomic_load_n(&unbound_pool.need_worker, __ATOMIC_ACQUIRE))
+        workqueue_create_worker(&unbound_pool);
+}
+
+static void workqueue_manager_thread(uint64_t arg) {
+    (void)arg;
+
+    while (true) {
+        arch_enable_interrupt();
+
+        __atomic_store_n(&workqueue_manager_pending, false, __ATOMIC_RELEASE);
+
+        workqueue_manage_pools();
+        uint64_t next = workqueue_run_timers();
+
+        task_prepare_block(current_task);
+        if (__atomic_load_n(&workqueue_manager_pending, __ATOMIC_ACQUIRE)) {
+            task_cancel_block_prepare(current_task);
+            continue;
+        }
+
+        int64_t timeout = -1;
+        if (next != UINT64_MAX) {
+            uint64_t now = nano_time();
+            timeout = next > now ? (int64_t)(next - now) : 0;
+        }
+        if (timeout == 0) {
+            task_cancel_block_prepare(current_task);
+            continue;
+        }
+
+        task_block(current_task, TASK_BLOCKING, timeout, "workqueue_manager");
+        task_cancel_block_prepare(current_task);
+    }
+}
+
+static void workqueue_pool_init(worker_pool_t *pool, uint32_t cpu,
+                                uint32_t max_active) {
+    memset(pool, 0, sizeof(*pool));
+    spin_init(&pool->lock);
+    pool->cpu = cpu;
+    pool->max_active = max_active;
+    llist_init_head(&pool->worklist);
+    llist_init_head(&pool->idle_list);
+    llist_init_head(&pool->workers);
+}
+
+static void workqueue_gen_pool(string_builder_t *builder, const char *name,
+                               worker_pool_t *pool) {
+    spin_lock(&pool->lock);
+    uint32_t workers = pool->nr_workers;
+    uint32_t idle = pool->nr_idle;
+    uint32_t running = pool->nr_running;
+    uint64_t pending = pool->nr_pending;
+    spin_unlock(&pool->lock);
+
+    if (!workers && !pending)
+        return;
+    string_builder_append(builder, "%-10s %7u %5u %7u %7llu\n", name, workers,
+                          idle, running, (unsigned long long)pending);
+}
+
+char *workqueue_gen_stats(size_t *content_len) {
+    string_builder_t *builder = create_string_builder(1024);
+    if (!builder)
+        return NULL;
+
+    string_builder_append(builder,
+                          "%-24s %5s %6s %10s %10s %9s %11s %11s %11s %11s\n",
+                          "workqueue", "flags", "active", "queued", "executed",
+                          "cancelled", "avg_lat_us", "max_lat_us",
+                          "avg_exec_us", "max_exec_us");
+
+    spin_lock(&workqueue_list_lock);
+    struct llist_header *pos = workqueue_list.next;
+    while (pos != &workqueue_list) {
+        workqueue_t *wq = list_entry(pos, workqueue_t, node);
+        workqueue_stats_t *stats = &wq->stats;
+        uint64_t executed = __atomic_load_n(&stats->executed, __ATOMIC_RELAXED);
+        uint64_t latency_total =
+            __atomic_load_n(&stats->latency_total_ns, __ATOMIC_RELAXED);
+        uint64_t exec_total =
+            __atomic_load_n(&stats->exec_total_ns, __ATOMIC_RELAXED);
+
+        string_builder_append(
+            builder, "%-24s %5s %6llu %10llu %10llu %9llu %11llu %11llu %11llu "
+                     "%11llu\n",
+            wq->name, (wq->flags & WQ_UNBOUND) ? "U" : "B",
+            (unsigned long long)__atomic_load_n(&wq->nr_active,
+                                                __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&stats->queued,
+                                                __ATOMIC_RELAXED),
+            (unsigned long long)executed,
+            (unsigned long long)__atomic_load_n(&stats->cancelled,
+                                                __ATOMIC_RELAXED),
+            (unsigned long long)(executed ? latency_total / executed / 1000
+                                          : 0),
+            (unsigned long long)(__atomic_load_n(&stats->latency_max_ns,
+                                                 __ATOMIC_RELAXED) /
+                                 1000),
+            (unsigned long long)(executed ? exec_total / executed / 1000 : 0),
+            (unsigned long long)(__atomic_load_n(&stats->exec_max_ns,
+                                                 __ATOMIC_RELAXED) /
+                                 1000));
+        pos = pos->next;
+    }
+    spin_unlock(&workqueue_list_lock);
+
+    string_builder_append(builder, "\n%-10s %7s %5s %7s %7s\n", "pool",
+                          "workers", "idle", "running", "pending");
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++) {
+        char name[16];
+        snprintf(name, sizeof(name), "cpu%u", cpu);
+        workqueue_gen_pool(builder, name, &bound_pools[cpu]);
+    }
+    workqueue_gen_pool(builder, "unbound", &unbound_pool);
+
+    char *data = builder->data;
+    *content_len = builder->size;
+    free(builder);
+    return data;
+}
+
+void workqueue_init() {
+    for (uint32_t cpu = 0; cpu < MAX_CPU_NUM; cpu++)
+        workqueue_pool_init(&bound_pools[cpu], cpu, 1);
+    workqueue_pool_init(&unbound_pool, WORK_CPU_UNBOUND,
+                        cpu_count ? (uint32_t)cpu_count : 1);
+    wait_queue_init(&workqueue_flush_wait);
+
+    system_wq = alloc_workqueue("events", 0);
+    system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND);
+    ASSERT(system_wq && system_unbound_wq);
+
+    workqueue_manager_task = task_create("kworker_manager",
+                                         workqueue_manager_thread, 0,
+                                         KTHREAD_PRIORITY);
+    ASSERT(workqueue_manager_task);
+
+    __atomic_store_n(&workqueue_ready, true, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <libs/klibc.h>
+#include <libs/llist.h>
+#include <libs/rbtree.h>
+
+struct work_struct;
+struct workqueue;
+struct worker_pool;
+
+typedef void (*work_func_t)(struct work_struct *work);
+
+typedef struct work_struct {
+    struct llist_header entry;
+    work_func_t func;
+    struct workqueue *wq;
+    struct worker_pool *pool;
+    uint64_t queued_ns;
+    uint32_t pending;
+} work_struct_t;
+
+typedef struct delayed_work {
+    work_struct_t work;
+    rb_node_t timer_node;
+    uint64_t expires_ns;
+    struct workqueue *wq;
+    uint32_t cpu;
+    bool timer_queued;
+} delayed_work_t;
+
+#define WQ_UNBOUND (1U << 0)
+
+#define WQ_NAME_MAX 32
+#define WORK_CPU_UNBOUND UINT32_MAX
+
+typedef struct workqueue_stats {
+    uint64_t queued;
+    uint64_t executed;
+    uint64_t cancelled;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    uint64_t exec_total_ns;
+    uint64_t exec_max_ns;
+} workqueue_stats_t;
+
+typedef struct workqueue {
+    char name[WQ_NAME_MAX];
+    uint32_t flags;
+    struct llist_header node;
+    uint64_t nr_active;
+    workqueue_stats_t stats;
+} workqueue_t;
+
+extern workqueue_t *system_wq;
+extern workqueue_t *system_unbound_wq;
+
+void init_work(work_struct_t *work, work_func_t func);
+void init_delayed_work(delayed_work_t *dwork, work_func_t func);
+
+#define INIT_WORK(work, fn) init_work((work), (fn))
+#define INIT_DELAYED_WORK(dwork, fn) init_delayed_work((dwork), (fn))
+
+static inline delayed_work_t *to_delayed_work(work_struct_t *work) {
+    return container_of(work, delayed_work_t, work);
+}
+
+workqueue_t *alloc_workqueue(const char *name, uint32_t flags);
+void destroy_workqueue(workqueue_t *wq);
+
+/* All queue_* helpers return false if the work was already pending. A work
+ * item that is currently executing may be queued again; it will run once more
+ * after the current invocation returns. */
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_struct_t *work);
+bool queue_work(workqueue_t *wq, work_struct_t *work);
+bool queue_delayed_work_on(uint32_t cpu, workqueue_t *wq,
+                           delayed_work_t *dwork, uint64_t delay_ns);
+bool queue_delayed_work(workqueue_t *wq, delayed_work_t *dwork,
+                        uint64_t delay_ns);
+bool schedule_work(work_struct_t *work);
+bool schedule_delayed_work(delayed_work_t *dwork, uint64_t delay_ns);
+
+/* Cancel helpers only remove pending work; they do not wait for a running
+ * instance. Pair them with flush_work() when the caller is about to free the
+ * item. */
+bool cancel_work(work_struct_t *work);
+bool cancel_delayed_work(delayed_work_t *dwork);
+bool flush_work(work_struct_t *work);
+bool flush_delayed_work(delayed_work_t *dwork);
+void flush_workqueue(workqueue_t *wq);
+
+bool work_pending(work_struct_t *work);
+
+struct task;
+void workqueue_worker_sleeping(struct task *task);
+void workqueue_worker_waking(struct task *task);
+
+char *workqueue_gen_stats(size_t *content_len);
+
+void workqueue_init();
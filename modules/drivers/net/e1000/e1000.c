@@ -3,6 +3,9 @@
 #include <mm/mm.h>
 #include <drivers/bus/pci.h>
 #include <libs/klibc.h>
+#include <arch/arch.h>
+#include <boot/boot.h>
+#include <irq/irq_manager.h>
 
 // Global device array
 e1000_device_t *e1000_devices[MAX_E1000_DEVICES];
@@ -18,19 +21,43 @@ static inline void e1000_write32(e1000_device_t *dev, uint32_t reg,
     *((volatile uint32_t *)(dev->mmio_base + reg)) = value;
 }
 
-static void e1000_tx_reclaim(e1000_device_t *dev) {
-    while (dev->tx_head != dev->tx_tail) {
+#define E1000_TX_KICK_BATCH 32
+#define E1000_TX_DONE_BATCH 32
+#define E1000_TX_RING_WAIT_NS 1000000ULL
+#define E1000_IRQ_CAUSES                                                       \
+    (E1000_ICR_TXDW | E1000_ICR_LSC | E1000_ICR_RXDMT0 | E1000_ICR_RXO |       \
+     E1000_ICR_RXT0)
+
+typedef struct e1000_tx_done {
+    netdev_tx_done_t done;
+    void *ctx;
+} e1000_tx_done_t;
+
+/* Recycles finished TX descriptors with tx_lock held. Completion callbacks
+ * are collected, at most E1000_TX_DONE_BATCH of them, so they can run after
+ * the lock is dropped. */
+static void e1000_tx_reclaim(e1000_device_t *dev, e1000_tx_done_t *done,
+                             uint32_t *nr_done) {
+    while (dev->tx_head != dev->tx_tail && *nr_done < E1000_TX_DONE_BATCH) {
         uint16_t idx = dev->tx_head;
         struct e1000_tx_desc *desc = &dev->tx_descs[idx];
+        e1000_tx_slot_t *slot = &dev->tx_slots[idx];
 
         dma_sync_device_to_cpu(desc, sizeof(*desc));
         if (!(desc->status & E1000_TXD_STAT_DD))
             break;
 
-        if (dev->tx_buffers[idx]) {
-            free_frames_bytes(dev->tx_buffers[idx], dev->tx_lengths[idx]);
-            dev->tx_buffers[idx] = NULL;
-            dev->tx_lengths[idx] = 0;
+        if (slot->buffer) {
+            free_frames_bytes(slot->buffer, slot->length);
+            slot->buffer = NULL;
+            slot->length = 0;
+        }
+        if (slot->done) {
+            done[*nr_done].done = slot->done;
+            done[*nr_done].ctx = slot->ctx;
+            (*nr_done)++;
+            slot->done = NULL;
+            slot->ctx = NULL;
         }
 
         desc->buffer_addr = 0;
@@ -39,10 +66,42 @@ static void e1000_tx_reclaim(e1000_device_t *dev) {
         desc->status = 0;
         dma_sync_cpu_to_device(desc, sizeof(*desc));
 
-        dev->tx_head = (idx + 1) % E1000_NUM_TX_DESC;
+        dev->tx_head = (idx + 1) % dev->num_tx_desc;
     }
 }
 
+static void e1000_tx_complete(e1000_tx_done_t *done, uint32_t nr_done) {
+    for (uint32_t i = 0; i < nr_done; i++) {
+        done[i].done(done[i].ctx);
+    }
+}
+
+static uint16_t e1000_tx_free_descs(e1000_device_t *dev) {
+    return (dev->tx_head + dev->num_tx_desc - dev->tx_tail - 1) %
+           dev->num_tx_desc;
+}
+
+static void e1000_tx_kick(e1000_device_t *dev) {
+    dma_wmb();
+    e1000_write32(dev, E1000_TDT, dev->tx_tail);
+    dev->tx_unkicked = 0;
+}
+
+static uint32_t e1000_ring_param(const char *key) {
+    const char *cmdline = boot_get_cmdline();
+    const char *opt = cmdline ? strstr(cmdline, key) : NULL;
+    uint64_t size;
+
+    if (!opt) {
+        return E1000_DEFAULT_RING_SIZE;
+    }
+
+    size = strtoul(opt + strlen(key), NULL, 0);
+    size = MAX(size, E1000_MIN_RING_SIZE);
+    size = MIN(size, E1000_MAX_RING_SIZE);
+    return (uint32_t)(size & ~(uint64_t)(E1000_RING_ALIGN - 1));
+}
+
 // Read from EEPROM
 static int e1000_read_eeprom(e1000_device_t *dev, uint16_t offset,
                              uint16_t *data) {
@@ -96,9 +155,10 @@ static int e1000_get_mac_address(e1000_device_t *dev) {
 
 // Initialize RX descriptors and buffers
 static int e1000_init_rx(e1000_device_t *dev) {
+    size_t ring_bytes = dev->num_rx_desc * sizeof(struct e1000_rx_desc);
+
     // Allocate RX descriptors (must be 16-byte aligned)
-    dev->rx_descs_raw = alloc_frames_bytes(
-        E1000_NUM_RX_DESC * sizeof(struct e1000_rx_desc) + 15);
+    dev->rx_descs_raw = alloc_frames_bytes(ring_bytes + 15);
     if (!dev->rx_descs_raw) {
         return -1;
     }
@@ -108,31 +168,41 @@ static int e1000_init_rx(e1000_device_t *dev) {
         (struct e1000_rx_desc *)(((uintptr_t)dev->rx_descs_raw + 15) &
                                  ~((uintptr_t)15));
 
+    dev->rx_buffers = calloc(dev->num_rx_desc, sizeof(void *));
+    if (!dev->rx_buffers) {
+        return -1;
+    }
+
+    dev->rx_pool = netdev_pool_create(E1000_RX_BUFFER_SIZE +
+                                          NETDEV_POOL_HEADROOM,
+                                      2 * dev->num_rx_desc);
+    if (!dev->rx_pool) {
+        return -1;
+    }
+
     // Initialize RX descriptors and buffers
-    for (int i = 0; i < E1000_NUM_RX_DESC; i++) {
-        dev->rx_buffers[i] = alloc_frames_bytes(E1000_RX_BUFFER_SIZE);
+    for (uint32_t i = 0; i < dev->num_rx_desc; i++) {
+        dev->rx_buffers[i] = netdev_pool_get(dev->rx_pool);
         if (!dev->rx_buffers[i]) {
             return -1;
         }
 
         dev->rx_descs[i].buffer_addr =
-            (uint64_t)virt_to_phys(dev->rx_buffers[i]);
+            (uint64_t)virt_to_phys(netdev_pool_data(dev->rx_buffers[i]));
         dev->rx_descs[i].status = 0;
         dev->rx_descs[i].errors = 0;
         dev->rx_descs[i].length = 0;
     }
-    dma_sync_cpu_to_device(dev->rx_descs,
-                           E1000_NUM_RX_DESC * sizeof(struct e1000_rx_desc));
+    dma_sync_cpu_to_device(dev->rx_descs, ring_bytes);
 
     // Program RX descriptor registers
     uint64_t rx_desc_phys = (uint64_t)virt_to_phys(dev->rx_descs);
     e1000_write32(dev, E1000_RDBAL, rx_desc_phys & 0xFFFFFFFF);
     e1000_write32(dev, E1000_RDBAH, rx_desc_phys >> 32);
-    e1000_write32(dev, E1000_RDLEN,
-                  E1000_NUM_RX_DESC * sizeof(struct e1000_rx_desc));
+    e1000_write32(dev, E1000_RDLEN, ring_bytes);
     e1000_write32(dev, E1000_RDH, 0);
-    e1000_write32(dev, E1000_RDT, E1000_NUM_RX_DESC - 1);
-    dev->rx_tail = E1000_NUM_RX_DESC - 1;
+    e1000_write32(dev, E1000_RDT, dev->num_rx_desc - 1);
+    dev->rx_tail = dev->num_rx_desc - 1;
 
     // Configure RX control
     uint32_t rctl = e1000_read32(dev, E1000_RCTL);
@@ -144,9 +214,10 @@ static int e1000_init_rx(e1000_device_t *dev) {
 
 // Initialize TX descriptors and buffers
 static int e1000_init_tx(e1000_device_t *dev) {
+    size_t ring_bytes = dev->num_tx_desc * sizeof(struct e1000_tx_desc);
+
     // Allocate TX descriptors (must be 16-byte aligned)
-    dev->tx_descs_raw = alloc_frames_bytes(
-        E1000_NUM_TX_DESC * sizeof(struct e1000_tx_desc) + 15);
+    dev->tx_descs_raw = alloc_frames_bytes(ring_bytes + 15);
     if (!dev->tx_descs_raw) {
         return -1;
     }
@@ -156,25 +227,26 @@ static int e1000_init_tx(e1000_device_t *dev) {
         (struct e1000_tx_desc *)(((uintptr_t)dev->tx_descs_raw + 15) &
                                  ~((uintptr_t)15));
 
-    // Initialize TX descriptors
-    memset(dev->tx_descs, 0, E1000_NUM_TX_DESC * sizeof(struct e1000_tx_desc));
-    for (int i = 0; i < E1000_NUM_TX_DESC; i++) {
-        dev->tx_buffers[i] = NULL;
-        dev->tx_lengths[i] = 0;
+    dev->tx_slots = calloc(dev->num_tx_desc, sizeof(e1000_tx_slot_t));
+    if (!dev->tx_slots) {
+        return -1;
     }
-    dma_sync_cpu_to_device(dev->tx_descs,
-                           E1000_NUM_TX_DESC * sizeof(struct e1000_tx_desc));
+
+    // Initialize TX descriptors
+    memset(dev->tx_descs, 0, ring_bytes);
+    dma_sync_cpu_to_device(dev->tx_descs, ring_bytes);
 
     // Program TX descriptor registers
     uint64_t tx_desc_phys = (uint64_t)virt_to_phys(dev->tx_descs);
     e1000_write32(dev, E1000_TDBAL, tx_desc_phys & 0xFFFFFFFF);
     e1000_write32(dev, E1000_TDBAH, tx_desc_phys >> 32);
-    e1000_write32(dev, E1000_TDLEN,
-                  E1000_NUM_TX_DESC * sizeof(struct e1000_tx_desc));
+    e1000_write32(dev, E1000_TDLEN, ring_bytes);
     e1000_write32(dev, E1000_TDH, 0);
     e1000_write32(dev, E1000_TDT, 0);
     dev->tx_head = 0;
     dev->tx_tail = 0;
+    dev->tx_unkicked = 0;
+    dev->tx_lock = SPIN_INIT;
 
     // Configure TX control
     uint32_t tctl = e1000_read32(dev, E1000_TCTL);
@@ -188,6 +260,45 @@ static int e1000_init_tx(e1000_device_t *dev) {
     return 0;
 }
 
+// Free rings and buffers; frames still held by the stack keep the pool
+static void e1000_free_rings(e1000_device_t *dev) {
+    if (dev->rx_buffers) {
+        for (uint32_t i = 0; i < dev->num_rx_desc; i++) {
+            if (dev->rx_buffers[i]) {
+                netdev_pool_put(dev->rx_pool, dev->rx_buffers[i]);
+            }
+        }
+        free(dev->rx_buffers);
+        dev->rx_buffers = NULL;
+    }
+    netdev_pool_destroy(dev->rx_pool);
+    dev->rx_pool = NULL;
+
+    if (dev->tx_slots) {
+        for (uint32_t i = 0; i < dev->num_tx_desc; i++) {
+            if (dev->tx_slots[i].buffer) {
+                free_frames_bytes(dev->tx_slots[i].buffer,
+                                  dev->tx_slots[i].length);
+            }
+        }
+        free(dev->tx_slots);
+        dev->tx_slots = NULL;
+    }
+
+    if (dev->rx_descs_raw) {
+        free_frames_bytes(dev->rx_descs_raw,
+                          dev->num_rx_desc * sizeof(struct e1000_rx_desc) +
+                              15);
+        dev->rx_descs_raw = NULL;
+    }
+    if (dev->tx_descs_raw) {
+        free_frames_bytes(dev->tx_descs_raw,
+                          dev->num_tx_desc * sizeof(struct e1000_tx_desc) +
+                              15);
+        dev->tx_descs_raw = NULL;
+    }
+}
+
 // Reset the E1000 device
 static void e1000_reset(e1000_device_t *dev) {
     // Set reset bit
@@ -202,8 +313,107 @@ static void e1000_reset(e1000_device_t *dev) {
     }
 }
 
+/*
+ * NAPI-style interrupt: acknowledge, mask the device and wake the receive
+ * path, which drains the ring at its own pace and unmasks once it is empty.
+ * Under load the device therefore stays quiet instead of interrupting for
+ * every frame.
+ */
+static void e1000_irq_handler(uint64_t irq_num, void *data,
+                              struct pt_regs *regs) {
+    e1000_device_t *dev = (e1000_device_t *)data;
+    uint32_t icr;
+
+    if (!dev || __atomic_load_n(&dev->removed, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    // Reading ICR clears the causes and deasserts INTx
+    icr = e1000_read32(dev, E1000_ICR);
+    if (!(icr & E1000_IRQ_CAUSES)) {
+        return;
+    }
+
+    if (icr & E1000_ICR_LSC) {
+        __atomic_store_n(&dev->link_check, true, __ATOMIC_RELEASE);
+    }
+    e1000_write32(dev, E1000_IMC, E1000_IRQ_CAUSES);
+    __atomic_store_n(&dev->napi_scheduled, true, __ATOMIC_RELEASE);
+
+    if (dev->netdev) {
+        netdev_notify_rx(dev->netdev);
+    }
+}
+
+/* Ends a poll round. A frame that lands after the ring was found empty has
+ * raised its cause again, and fires as soon as IMS unmasks it. */
+static void e1000_irq_rearm(e1000_device_t *dev) {
+    if (!dev->irq_enabled ||
+        !__atomic_exchange_n(&dev->napi_scheduled, false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    e1000_write32(dev, E1000_IMS, E1000_IRQ_CAUSES);
+}
+
+static void e1000_check_link(e1000_device_t *dev) {
+    if (!__atomic_exchange_n(&dev->link_check, false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    netdev_set_link_state(dev->netdev, (e1000_read32(dev, E1000_STATUS) &
+                                        E1000_STATUS_LU) != 0);
+}
+
+static int e1000_setup_irq(e1000_device_t *dev) {
+    if (msi_setup_irq(&dev->msi, dev->pci_dev, 0, false, e1000_irq_handler,
+                      dev, "e1000") == 0) {
+        dev->msi_enabled = true;
+        return 0;
+    }
+
+#if defined(__x86_64__)
+    // The 82540EM has no MSI capability; route its INTx pin instead
+    if (dev->pci_dev->irq_pin && dev->pci_dev->irq_line &&
+        dev->pci_dev->irq_line != 0xFF) {
+        int vector = irq_allocate_irqnum();
+
+        if (vector >= 0 && vector < ARCH_MAX_IRQ_NUM &&
+            irq_regist_irq(vector, e1000_irq_handler, dev->pci_dev->irq_line,
+                           dev, &apic_controller, "e1000", 0)) {
+            return 0;
+        }
+    }
+#endif
+
+    return -ENOSYS;
+}
+
+// The statistics registers clear on read, so fold them into the netdev
+// counters whenever someone looks at those
+static void e1000_update_stats(void *dev_desc) {
+    e1000_device_t *dev = (e1000_device_t *)dev_desc;
+    uint32_t crcerrs = e1000_read32(dev, E1000_CRCERRS);
+    uint32_t mpc = e1000_read32(dev, E1000_MPC);
+    uint32_t rnbc = e1000_read32(dev, E1000_RNBC);
+
+    NETDEV_STATS_ADD(dev->netdev, rx_crc_errors, crcerrs);
+    NETDEV_STATS_ADD(dev->netdev, rx_errors, crcerrs);
+    // Frames dropped because every RX descriptor was in use
+    NETDEV_STATS_ADD(dev->netdev, rx_missed_errors, mpc);
+    NETDEV_STATS_ADD(dev->netdev, rx_fifo_errors, rnbc);
+    NETDEV_STATS_ADD(dev->netdev, multicast,
+                     e1000_read32(dev, E1000_MPRC));
+    NETDEV_STATS_ADD(dev->netdev, collisions,
+                     e1000_read32(dev, E1000_COLC));
+}
+
+static const netdev_zc_ops_t e1000_zc_ops = {
+    .xmit = e1000_xmit,
+    .xmit_flush = e1000_xmit_flush,
+    .rx_take = e1000_rx_take,
+};
+
 // Initialize E1000 device
-int e1000_init(void *mmio_base) {
+int e1000_init(pci_device_t *pci_dev, void *mmio_base) {
     e1000_device_t *dev = (e1000_device_t *)malloc(sizeof(e1000_device_t));
     if (!dev) {
         printk("e1000: Failed to allocate device structure\n");
@@ -212,11 +422,18 @@ int e1000_init(void *mmio_base) {
 
     memset(dev, 0, sizeof(e1000_device_t));
     dev->mmio_base = mmio_base;
+    dev->pci_dev = pci_dev;
     dev->mtu = E1000_MTU;
+    dev->num_rx_desc = e1000_ring_param("e1000.rx_ring=");
+    dev->num_tx_desc = e1000_ring_param("e1000.tx_ring=");
 
     // Reset device
     e1000_reset(dev);
 
+    // Keep the device quiet until the handler is in place
+    e1000_write32(dev, E1000_IMC, 0xFFFFFFFF);
+    e1000_read32(dev, E1000_ICR);
+
     // Get MAC address
     if (e1000_get_mac_address(dev) != 0) {
         printk("e1000: Failed to get MAC address\n");
@@ -230,18 +447,24 @@ int e1000_init(void *mmio_base) {
     // Initialize RX and TX
     if (e1000_init_rx(dev) != 0) {
         printk("e1000: Failed to initialize RX\n");
+        e1000_free_rings(dev);
         free(dev);
         return -1;
     }
 
     if (e1000_init_tx(dev) != 0) {
         printk("e1000: Failed to initialize TX\n");
+        e1000_free_rings(dev);
         free(dev);
         return -1;
     }
 
-    // Disable interrupts (polling mode)
-    e1000_write32(dev, E1000_IMC, 0xFFFFFFFF);
+    // Start the clear-on-read counters from zero
+    e1000_read32(dev, E1000_CRCERRS);
+    e1000_read32(dev, E1000_MPC);
+    e1000_read32(dev, E1000_RNBC);
+    e1000_read32(dev, E1000_MPRC);
+    e1000_read32(dev, E1000_COLC);
 
     // Store device and register with network framework
     dev->netdev = netdev_register_full(NULL, NETDEV_TYPE_ETHERNET, dev,
@@ -250,118 +473,263 @@ int e1000_init(void *mmio_base) {
 
     if (!dev->netdev) {
         printk("e1000: Failed to register netdev\n");
+        e1000_free_rings(dev);
         free(dev);
         return -1;
     }
+    netdev_set_zc_ops(dev->netdev, &e1000_zc_ops);
+    netdev_set_update_stats(dev->netdev, e1000_update_stats);
     e1000_devices[e1000_device_count++] = dev;
 
+    if (e1000_setup_irq(dev) == 0) {
+        dev->irq_enabled = true;
+        e1000_write32(dev, E1000_ITR, E1000_ITR_DEFAULT);
+        e1000_write32(dev, E1000_IMS, E1000_IRQ_CAUSES);
+        netdev_set_rx_irq(dev->netdev, true);
+        printk("e1000: using %s interrupts, rings %u/%u\n",
+               dev->msi_enabled ? "MSI" : "INTx", dev->num_rx_desc,
+               dev->num_tx_desc);
+    } else {
+        printk("e1000: no usable interrupt, polling; rings %u/%u\n",
+               dev->num_rx_desc, dev->num_tx_desc);
+    }
+
     return 0;
 }
 
-// Send packet (polling mode)
-int e1000_send(void *dev_desc, void *data, uint32_t len) {
-    e1000_device_t *dev = (e1000_device_t *)dev_desc;
+/*
+ * Queues one frame with a descriptor per physically contiguous piece. With
+ * copy set, or when the frame is too fragmented, it goes through a bounce
+ * buffer instead and the caller's memory is free once this returns.
+ */
+static int e1000_queue_xmit(e1000_device_t *dev, const netdev_tx_req_t *req,
+                            bool copy) {
+    netdev_frag_t segs[E1000_TX_MAX_SEGS];
+    e1000_tx_done_t done[E1000_TX_DONE_BATCH];
+    uint32_t nr_done = 0;
+    uint64_t deadline = 0;
+    void *bounce = NULL;
+    uint16_t idx = 0;
+    int nr_segs;
+
+    if (req->len == 0 || req->nr_frags == 0 ||
+        req->nr_frags > NETDEV_MAX_FRAGS ||
+        req->len > netdev_max_frame_len(E1000_MTU)) {
+        return -EINVAL;
+    }
 
-    if (len == 0 || len > netdev_max_frame_len(E1000_MTU)) {
-        return -1;
+    nr_segs = copy ? -E2BIG
+                   : netdev_dma_split(req->frags, req->nr_frags, 0, segs,
+                                      E1000_TX_MAX_SEGS);
+    if (nr_segs < 0) {
+        bounce = alloc_frames_bytes(req->len);
+        if (!bounce) {
+            return -ENOMEM;
+        }
+        netdev_frags_copy(req->frags, req->nr_frags, 0, bounce, req->len);
+        segs[0].data = bounce;
+        segs[0].len = req->len;
+        nr_segs = 1;
+    }
+    for (int i = 0; i < nr_segs; i++) {
+        dma_sync_cpu_to_device((void *)segs[i].data, segs[i].len);
     }
 
-    e1000_tx_reclaim(dev);
+    spin_lock(&dev->tx_lock);
+    for (;;) {
+        e1000_tx_reclaim(dev, done, &nr_done);
+        if (e1000_tx_free_descs(dev) >= nr_segs) {
+            break;
+        }
+        if (nr_done == E1000_TX_DONE_BATCH) {
+            // Reclaim stopped early; run the callbacks and look again
+            spin_unlock(&dev->tx_lock);
+            e1000_tx_complete(done, nr_done);
+            nr_done = 0;
+            spin_lock(&dev->tx_lock);
+            continue;
+        }
 
-    // Check if we have a free TX descriptor
-    uint16_t next_tail = (dev->tx_tail + 1) % E1000_NUM_TX_DESC;
-    if (next_tail == dev->tx_head) {
-        // TX queue full
-        return -1;
+        // Ring full: make sure the hardware has seen everything queued
+        if (dev->tx_unkicked) {
+            e1000_tx_kick(dev);
+        }
+        if (!deadline) {
+            deadline = nano_time() + E1000_TX_RING_WAIT_NS;
+        } else if (nano_time() >= deadline) {
+            spin_unlock(&dev->tx_lock);
+            if (bounce) {
+                free_frames_bytes(bounce, req->len);
+            }
+            e1000_tx_complete(done, nr_done);
+            return -ENOBUFS;
+        }
+        arch_pause();
     }
 
-    // Allocate buffer for packet
-    void *tx_buffer = alloc_frames_bytes(len);
-    if (!tx_buffer) {
-        return -1;
+    for (int i = 0; i < nr_segs; i++) {
+        struct e1000_tx_desc *desc;
+
+        idx = dev->tx_tail;
+        desc = &dev->tx_descs[idx];
+        desc->buffer_addr = (uint64_t)virt_to_phys(segs[i].data);
+        desc->length = segs[i].len;
+        desc->cmd = E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
+        if (i == nr_segs - 1) {
+            desc->cmd |= E1000_TXD_CMD_EOP;
+        }
+        desc->status = 0;
+        dma_sync_cpu_to_device(desc, sizeof(*desc));
+        dev->tx_tail = (idx + 1) % dev->num_tx_desc;
     }
 
-    // Copy data to buffer
-    memcpy(tx_buffer, data, len);
+    // Everything attached to the frame is released with its last descriptor
+    dev->tx_slots[idx].buffer = bounce;
+    dev->tx_slots[idx].length = bounce ? req->len : 0;
+    dev->tx_slots[idx].done = copy ? NULL : req->done;
+    dev->tx_slots[idx].ctx = req->ctx;
 
-    // Setup TX descriptor
-    struct e1000_tx_desc *desc = &dev->tx_descs[dev->tx_tail];
-    desc->buffer_addr = (uint64_t)virt_to_phys(tx_buffer);
-    desc->length = len;
-    desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
-    desc->status = 0;
+    if (!(req->flags & NETDEV_XMIT_MORE) ||
+        ++dev->tx_unkicked >= E1000_TX_KICK_BATCH) {
+        e1000_tx_kick(dev);
+    }
+    spin_unlock(&dev->tx_lock);
 
-    // Store buffer pointer for later cleanup
-    dev->tx_buffers[dev->tx_tail] = tx_buffer;
-    dev->tx_lengths[dev->tx_tail] = len;
-    dma_sync_cpu_to_device(tx_buffer, len);
-    dma_sync_cpu_to_device(desc, sizeof(*desc));
+    e1000_tx_complete(done, nr_done);
+    return req->len;
+}
 
-    // Update tail pointer
-    dev->tx_tail = next_tail;
-    dma_wmb();
-    e1000_write32(dev, E1000_TDT, dev->tx_tail);
+int e1000_xmit(void *dev_desc, const netdev_tx_req_t *req) {
+    return e1000_queue_xmit((e1000_device_t *)dev_desc, req, false);
+}
 
-    // Poll for completion
-    while (dev->tx_head != dev->tx_tail) {
-        e1000_tx_reclaim(dev);
-        if (dev->tx_head != dev->tx_tail) {
-            arch_pause();
+void e1000_xmit_flush(void *dev_desc) {
+    e1000_device_t *dev = (e1000_device_t *)dev_desc;
+    e1000_tx_done_t done[E1000_TX_DONE_BATCH];
+    uint32_t nr_done;
+
+    do {
+        nr_done = 0;
+        spin_lock(&dev->tx_lock);
+        if (dev->tx_unkicked) {
+            e1000_tx_kick(dev);
         }
+        e1000_tx_reclaim(dev, done, &nr_done);
+        spin_unlock(&dev->tx_lock);
+
+        e1000_tx_complete(done, nr_done);
+    } while (nr_done == E1000_TX_DONE_BATCH);
+}
+
+// Opportunistic completion processing for callers on the receive path
+static void e1000_poll_tx(e1000_device_t *dev) {
+    e1000_tx_done_t done[E1000_TX_DONE_BATCH];
+    uint32_t nr_done = 0;
+
+    if (!spin_trylock(&dev->tx_lock)) {
+        return;
     }
+    e1000_tx_reclaim(dev, done, &nr_done);
+    spin_unlock(&dev->tx_lock);
 
-    return len;
+    e1000_tx_complete(done, nr_done);
 }
 
-// Receive packet (polling mode)
-int e1000_receive(void *dev_desc, void *buffer, uint32_t buffer_size) {
+int e1000_send(void *dev_desc, void *data, uint32_t len) {
+    netdev_frag_t frag = {.data = data, .len = len};
+    netdev_tx_req_t req = {.frags = &frag, .nr_frags = 1, .len = len};
+    int ret = e1000_queue_xmit((e1000_device_t *)dev_desc, &req, true);
+
+    return ret < 0 ? -1 : ret;
+}
+
+/*
+ * Hands the next frame up in the pool buffer the hardware wrote it to and
+ * puts a fresh pool buffer on the ring in its place. Bad frames, and frames
+ * arriving while the pool is dry, are dropped and their buffer reused.
+ */
+int e1000_rx_take(void *dev_desc, netdev_rx_buf_t *rx) {
     e1000_device_t *dev = (e1000_device_t *)dev_desc;
 
-    uint16_t next_rx = (dev->rx_tail + 1) % E1000_NUM_RX_DESC;
-    struct e1000_rx_desc *desc = &dev->rx_descs[next_rx];
-    dma_sync_device_to_cpu(desc, sizeof(*desc));
+    e1000_check_link(dev);
+    e1000_poll_tx(dev);
 
-    bool have_data = !!(desc->status & E1000_RXD_STAT_DD);
+    for (;;) {
+        uint16_t next_rx = (dev->rx_tail + 1) % dev->num_rx_desc;
+        struct e1000_rx_desc *desc = &dev->rx_descs[next_rx];
+        void *fresh = NULL;
+        int ret = 0;
 
-    if (!have_data) {
-        // No packet available
-        return 0;
-    }
+        dma_sync_device_to_cpu(desc, sizeof(*desc));
+        if (!(desc->status & E1000_RXD_STAT_DD)) {
+            // No packet available
+            e1000_irq_rearm(dev);
+            return 0;
+        }
 
-    if (desc->errors &
-        (E1000_RXD_ERR_CE | E1000_RXD_ERR_SE | E1000_RXD_ERR_SEQ |
-         E1000_RXD_ERR_CXE | E1000_RXD_ERR_RXE)) {
-        // Packet has errors, discard it
-        goto cleanup;
-    }
+        if (desc->errors &
+            (E1000_RXD_ERR_CE | E1000_RXD_ERR_SE | E1000_RXD_ERR_SEQ |
+             E1000_RXD_ERR_CXE | E1000_RXD_ERR_RXE)) {
+            NETDEV_STATS_ADD(dev->netdev, rx_errors, 1);
+        } else if (desc->length > 0 &&
+                   !(fresh = netdev_pool_get(dev->rx_pool))) {
+            NETDEV_STATS_ADD(dev->netdev, rx_dropped, 1);
+        }
+
+        if (fresh) {
+            void *rx_buffer = dev->rx_buffers[next_rx];
+
+            dma_sync_device_to_cpu(netdev_pool_data(rx_buffer),
+                                   desc->length);
+            rx->pool = dev->rx_pool;
+            rx->frags[0].buf = rx_buffer;
+            rx->frags[0].data = netdev_pool_data(rx_buffer);
+            rx->frags[0].len = desc->length;
+            rx->nr_frags = 1;
+            rx->len = desc->length;
+            ret = desc->length;
+
+            dev->rx_buffers[next_rx] = fresh;
+            desc->buffer_addr =
+                (uint64_t)virt_to_phys(netdev_pool_data(fresh));
+        }
+
+        // Recycle the descriptor
+        desc->status = 0;
+        desc->errors = 0;
+        desc->length = 0;
+        dma_sync_cpu_to_device(desc, sizeof(*desc));
+        dev->rx_tail = next_rx;
+        e1000_write32(dev, E1000_RDT, dev->rx_tail);
 
-    uint32_t packet_len = desc->length;
-    if (packet_len > buffer_size) {
-        packet_len = buffer_size;
+        if (ret > 0) {
+            if (dev->netdev && e1000_has_packets(dev))
+                netdev_notify_rx(dev->netdev);
+            return ret;
+        }
     }
+}
 
-    // Copy packet data to user buffer
-    dma_sync_device_to_cpu(phys_to_virt(desc->buffer_addr), desc->length);
-    memcpy(buffer, phys_to_virt(desc->buffer_addr), packet_len);
+// Receive packet (polling mode)
+int e1000_receive(void *dev_desc, void *buffer, uint32_t buffer_size) {
+    netdev_rx_buf_t rx;
+    uint32_t packet_len;
+    int ret = e1000_rx_take(dev_desc, &rx);
 
-cleanup:
-    // Recycle the descriptor
-    desc->status = 0;
-    desc->errors = 0;
-    desc->length = 0;
-    dma_sync_cpu_to_device(desc, sizeof(*desc));
-    dev->rx_tail = next_rx;
-    e1000_write32(dev, E1000_RDT, dev->rx_tail);
+    if (ret <= 0) {
+        return ret;
+    }
 
-    if (dev->netdev && e1000_has_packets(dev))
-        netdev_notify_rx(dev->netdev);
-    return have_data ? packet_len : 0;
+    packet_len = MIN(rx.len, buffer_size);
+    memcpy(buffer, rx.frags[0].data, packet_len);
+    netdev_rx_buf_release(&rx);
+    return packet_len;
 }
 
 // Check if packets are available
 bool e1000_has_packets(void *dev_desc) {
     e1000_device_t *dev = (e1000_device_t *)dev_desc;
-    uint16_t next_rx = (dev->rx_tail + 1) % E1000_NUM_RX_DESC;
+    uint16_t next_rx = (dev->rx_tail + 1) % dev->num_rx_desc;
     struct e1000_rx_desc *desc = &dev->rx_descs[next_rx];
 
     dma_sync_device_to_cpu(desc, sizeof(*desc));
@@ -423,7 +791,7 @@ static int e1000_pci_probe(pci_device_t *pci_dev) {
                    mmio_size, PT_FLAG_R | PT_FLAG_W | PT_FLAG_UNCACHEABLE);
 
     // Initialize E1000 device
-    return e1000_init(mmio_vaddr);
+    return e1000_init(pci_dev, mmio_vaddr);
 }
 
 static void e1000_pci_remove(pci_device_t *pci_dev) {
@@ -435,35 +803,23 @@ static void e1000_pci_remove(pci_device_t *pci_dev) {
             (uint64_t)dev->mmio_base <
                 pci_dev->bars[0].address + pci_dev->bars[0].size) {
             // Disable device
+            e1000_write32(dev, E1000_IMC, 0xFFFFFFFF);
             e1000_write32(dev, E1000_RCTL, 0);
             e1000_write32(dev, E1000_TCTL, 0);
 
-            // Free buffers
-            for (int j = 0; j < E1000_NUM_RX_DESC; j++) {
-                if (dev->rx_buffers[j]) {
-                    free_frames_bytes(dev->rx_buffers[j], E1000_RX_BUFFER_SIZE);
-                }
-            }
-            for (int j = 0; j < E1000_NUM_TX_DESC; j++) {
-                if (dev->tx_buffers[j]) {
-                    free_frames_bytes(dev->tx_buffers[j], dev->tx_lengths[j]);
-                }
+            e1000_free_rings(dev);
+            if (dev->msi_enabled) {
+                msi_release_desc(&dev->msi);
             }
 
-            // Free descriptors
-            if (dev->rx_descs_raw) {
-                free_frames_bytes(
-                    dev->rx_descs_raw,
-                    E1000_NUM_RX_DESC * sizeof(struct e1000_rx_desc) + 15);
+            // Remove from device array. A registered interrupt handler cannot
+            // be taken back, so in that case the structure stays behind and
+            // the handler ignores it
+            if (dev->irq_enabled) {
+                __atomic_store_n(&dev->removed, true, __ATOMIC_RELEASE);
+            } else {
+                free(dev);
             }
-            if (dev->tx_descs_raw) {
-                free_frames_bytes(
-                    dev->tx_descs_raw,
-                    E1000_NUM_TX_DESC * sizeof(struct e1000_tx_desc) + 15);
-            }
-
-            // Remove from device array
-            free(dev);
             e1000_devices[i] = NULL;
 
             // Shift remaining devices
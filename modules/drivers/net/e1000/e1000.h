@@ -3,6 +3,7 @@
 #include <mm/mm.h>
 #include <libs/klibc.h>
 #include <net/netdev.h>
+#include <drivers/bus/pci_msi.h>
 
 // E1000 Device IDs
 #define E1000_DEVICE_ID_82540EM 0x100E
@@ -13,6 +14,7 @@
 #define E1000_EERD 0x0014     // EEPROM Read
 #define E1000_CTRL_EXT 0x0018 // Extended Device Control
 #define E1000_ICR 0x00C0      // Interrupt Cause Read
+#define E1000_ITR 0x00C4      // Interrupt Throttling Rate
 #define E1000_IMS 0x00D0      // Interrupt Mask Set
 #define E1000_IMC 0x00D8      // Interrupt Mask Clear
 #define E1000_RCTL 0x0100     // RX Control
@@ -32,6 +34,23 @@
 #define E1000_TIDV 0x3820     // TX Interrupt Delay Value
 #define E1000_RA 0x5400       // Receive Address (MAC)
 
+// Statistics Registers (clear on read)
+#define E1000_CRCERRS 0x4000 // CRC Error Count
+#define E1000_MPC 0x4010     // Missed Packets Count
+#define E1000_COLC 0x4028    // Collision Count
+#define E1000_RNBC 0x40A0    // Receive No Buffers Count
+#define E1000_MPRC 0x407C    // Multicast Packets Received Count
+
+// Interrupt Cause Bits (ICR/IMS/IMC)
+#define E1000_ICR_TXDW (1 << 0)   // TX Descriptor Written Back
+#define E1000_ICR_LSC (1 << 2)    // Link Status Change
+#define E1000_ICR_RXDMT0 (1 << 4) // RX Descriptor Minimum Threshold
+#define E1000_ICR_RXO (1 << 6)    // Receiver Overrun
+#define E1000_ICR_RXT0 (1 << 7)   // Receiver Timer Interrupt
+
+// Status Register Bits
+#define E1000_STATUS_LU (1 << 1) // Link Up
+
 // Control Register Bits
 #define E1000_CTRL_RST (1 << 26)     // Reset
 #define E1000_CTRL_ASDE (1 << 5)     // Auto-Speed Detection Enable
@@ -82,10 +101,17 @@
 #define E1000_TXD_STAT_DD (1 << 0) // Descriptor Done
 
 // Constants
-#define E1000_NUM_RX_DESC 32
-#define E1000_NUM_TX_DESC 32
+// Ring sizes come from "e1000.rx_ring=" / "e1000.tx_ring=" on the command
+// line; RDLEN/TDLEN must be multiples of 128 bytes, i.e. of 8 descriptors
+#define E1000_DEFAULT_RING_SIZE 256
+#define E1000_MIN_RING_SIZE 256
+#define E1000_MAX_RING_SIZE 4096
+#define E1000_RING_ALIGN 8
+// ITR counts in 256ns units: 488 caps the device at ~8000 interrupts/s
+#define E1000_ITR_DEFAULT 488
 #define E1000_RX_BUFFER_SIZE 2048
 #define E1000_TX_BUFFER_SIZE 2048
+#define E1000_TX_MAX_SEGS 16
 #define E1000_MTU 1500
 
 // RX Descriptor Structure
@@ -109,32 +135,59 @@ struct e1000_tx_desc {
     uint16_t special;
 } __attribute__((packed));
 
+// Per-descriptor TX bookkeeping, attached to the last descriptor of a frame
+typedef struct e1000_tx_slot {
+    void *buffer; // bounce buffer, if any
+    uint16_t length;
+    netdev_tx_done_t done;
+    void *ctx;
+} e1000_tx_slot_t;
+
 // E1000 Device Structure
 typedef struct e1000_device {
     void *mmio_base;
+    pci_device_t *pci_dev;
     uint8_t mac[6];
     uint32_t mtu;
 
-    // RX descriptors and buffers
+    // Interrupts: MSI when the function has it, legacy INTx otherwise
+    struct msi_desc_t msi;
+    bool irq_enabled;
+    bool msi_enabled;
+    // Set by the IRQ handler, which masks the device until the receive
+    // path has drained the ring
+    bool napi_scheduled;
+    bool link_check;
+    bool removed;
+
+    // RX descriptors and pool buffers
     struct e1000_rx_desc *rx_descs;
     void *rx_descs_raw;
-    void *rx_buffers[E1000_NUM_RX_DESC];
+    void **rx_buffers;
+    uint32_t num_rx_desc;
+    netdev_pool_t *rx_pool;
     uint16_t rx_tail;
 
-    // TX descriptors and buffers
+    // TX descriptors, bounce buffers and completions
     struct e1000_tx_desc *tx_descs;
     void *tx_descs_raw;
-    void *tx_buffers[E1000_NUM_TX_DESC];
-    uint16_t tx_lengths[E1000_NUM_TX_DESC];
+    e1000_tx_slot_t *tx_slots;
+    uint32_t num_tx_desc;
     uint16_t tx_head;
     uint16_t tx_tail;
+    // Frames queued under NETDEV_XMIT_MORE whose TDT write is still pending
+    uint16_t tx_unkicked;
+    spinlock_t tx_lock;
     netdev_t *netdev;
 } e1000_device_t;
 
 // Function prototypes
-int e1000_init(void *mmio_base);
+int e1000_init(pci_device_t *pci_dev, void *mmio_base);
 int e1000_send(void *dev_desc, void *data, uint32_t len);
 int e1000_receive(void *dev_desc, void *buffer, uint32_t buffer_size);
+int e1000_xmit(void *dev_desc, const netdev_tx_req_t *req);
+void e1000_xmit_flush(void *dev_desc);
+int e1000_rx_take(void *dev_desc, netdev_rx_buf_t *rx);
 bool e1000_has_packets(void *dev_desc);
 void e1000_poll(void *dev_desc);
 
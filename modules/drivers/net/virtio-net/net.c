@@ -7,21 +7,120 @@ int virtio_net_idx = 0;
 
 #define RX_BUFFER_SIZE 8192
 #define RX_BUFFER_COUNT 32
-
-static void virtio_net_reap_tx(virtio_net_device_t *net_dev) {
+#define CTRL_TIMEOUT_NS 1000000000ULL
+// Frames queued with NETDEV_XMIT_MORE before the device is notified anyway
+#define TX_KICK_BATCH (SIZE / 4)
+#define TX_RING_WAIT_NS 1000000ULL
+
+typedef struct virtio_net_tx_done {
+    netdev_tx_done_t done;
+    void *ctx;
+} virtio_net_tx_done_t;
+
+/* Recycles finished TX chains. Completion callbacks are collected rather
+ * than run, so callers can invoke them after dropping tx_lock. */
+static void virtio_net_reap_tx(virtio_net_queue_t *q, virtio_net_tx_done_t *done,
+                               uint32_t *nr_done) {
     uint32_t used_len = 0;
     uint16_t used_desc_idx = 0;
 
-    while ((used_desc_idx = virt_queue_get_used_buf(net_dev->send_queue,
-                                                    &used_len)) != 0xFFFF) {
-        if (used_desc_idx < SIZE && net_dev->tx_buffers[used_desc_idx]) {
-            free_frames_bytes(net_dev->tx_buffers[used_desc_idx],
-                              net_dev->tx_buffer_sizes[used_desc_idx]);
-            net_dev->tx_buffers[used_desc_idx] = NULL;
-            net_dev->tx_buffer_sizes[used_desc_idx] = 0;
+    while ((used_desc_idx = virt_queue_get_used_buf(q->tx, &used_len)) !=
+           0xFFFF) {
+        if (used_desc_idx < SIZE) {
+            virtio_net_tx_info_t *info = &q->tx_info[used_desc_idx];
+
+            if (info->slot >= 0) {
+                q->tx_slot_free[q->tx_slot_top++] = (uint8_t)info->slot;
+            }
+            if (info->bounce) {
+                free_frames_bytes(info->bounce, info->bounce_size);
+            }
+            if (info->done) {
+                done[*nr_done].done = info->done;
+                done[*nr_done].ctx = info->ctx;
+                (*nr_done)++;
+            }
+            memset(info, 0, sizeof(*info));
+            info->slot = -1;
         }
-        virt_queue_free_desc(net_dev->send_queue, used_desc_idx);
+        virt_queue_free_desc(q->tx, used_desc_idx);
+    }
+}
+
+static void virtio_net_tx_complete(virtio_net_tx_done_t *done,
+                                   uint32_t nr_done) {
+    for (uint32_t i = 0; i < nr_done; i++) {
+        done[i].done(done[i].ctx);
+    }
+}
+
+static bool virtio_net_rx_post(virtio_net_device_t *net_dev,
+                               virtio_net_queue_t *q, void *rx_buffer) {
+    uint8_t *data = netdev_pool_data(rx_buffer);
+    uint32_t size = netdev_pool_data_size(net_dev->rx_pool);
+    virtio_buffer_t buf = {.addr = (uint64_t)data, .size = size};
+    bool writable = true;
+
+    dma_sync_cpu_to_device(data, size);
+    uint16_t desc_idx = virt_queue_add_buf(q->rx, &buf, 1, &writable);
+    if (desc_idx == 0xFFFF) {
+        netdev_pool_put(net_dev->rx_pool, rx_buffer);
+        return false;
+    }
+
+    q->rx_buffers[desc_idx] = rx_buffer;
+    q->rx_posted++;
+    virt_queue_submit_buf(q->rx, desc_idx);
+    return true;
+}
+
+/* Tops the ring back up to RX_BUFFER_COUNT pool buffers. Returns false when
+ * the pool is dry and the device has nothing left to receive into. */
+static bool virtio_net_rx_topup(virtio_net_device_t *net_dev,
+                                virtio_net_queue_t *q, bool *refilled) {
+    while (q->rx_posted < RX_BUFFER_COUNT) {
+        void *rx_buffer = netdev_pool_get(net_dev->rx_pool);
+
+        if (!rx_buffer || !virtio_net_rx_post(net_dev, q, rx_buffer)) {
+            break;
+        }
+        *refilled = true;
+    }
+    return q->rx_posted > 0;
+}
+
+/* Returns the pool buffer (not its data) of the next used RX descriptor. */
+static void *virtio_net_rx_pop(virtio_net_queue_t *q, uint32_t *len) {
+    void *rx_buffer;
+    uint16_t desc_idx;
+
+    if (q->held_buf) {
+        rx_buffer = q->held_buf;
+        *len = q->held_len;
+        q->held_buf = NULL;
+        return rx_buffer;
+    }
+
+    desc_idx = virt_queue_get_used_buf(q->rx, len);
+    if (desc_idx == 0xFFFF) {
+        return NULL;
+    }
+
+    rx_buffer = q->rx_buffers[desc_idx];
+    if (!rx_buffer) {
+        rx_buffer = (uint8_t *)phys_to_virt(q->rx->desc[desc_idx].addr) -
+                    NETDEV_POOL_HEADROOM;
     }
+    q->rx_buffers[desc_idx] = NULL;
+    q->rx_posted--;
+    virt_queue_free_desc(q->rx, desc_idx);
+
+    dma_sync_device_to_cpu(netdev_pool_data(rx_buffer), *len);
+    return rx_buffer;
+}
+
+static bool virtio_net_queue_has_rx(virtio_net_queue_t *q) {
+    return q->held_buf || virt_queue_can_pop(q->rx);
 }
 
 static void virtio_net_irq_handler(void *opaque, uint8_t isr_status) {
@@ -33,11 +132,93 @@ static void virtio_net_irq_handler(void *opaque, uint8_t isr_status) {
         netdev_notify_rx(net_dev->netdev);
 }
 
+static int virtio_net_ctrl_cmd(virtio_net_device_t *net_dev, uint8_t class,
+                               uint8_t cmd, const void *data,
+                               uint32_t data_len) {
+    virtio_buffer_t bufs[3];
+    bool writable[3] = {false, false, true};
+    virtio_net_ctrl_hdr_t *hdr;
+    uint8_t *page, *ack;
+    uint32_t used_len = 0;
+    uint16_t desc_idx, used_idx;
+    uint64_t deadline;
+    int ret;
+
+    if (!net_dev->ctrl_queue) {
+        return -ENODEV;
+    }
+    if (data_len > 48) {
+        return -EINVAL;
+    }
+
+    page = alloc_frames_bytes(PAGE_SIZE);
+    if (!page) {
+        return -ENOMEM;
+    }
+
+    hdr = (virtio_net_ctrl_hdr_t *)page;
+    hdr->class = class;
+    hdr->cmd = cmd;
+    memcpy(page + 16, data, data_len);
+    ack = page + 64;
+    *ack = 0xFF;
+
+    bufs[0].addr = (uint64_t)hdr;
+    bufs[0].size = sizeof(*hdr);
+    bufs[1].addr = (uint64_t)(page + 16);
+    bufs[1].size = data_len;
+    bufs[2].addr = (uint64_t)ack;
+    bufs[2].size = 1;
+    dma_sync_cpu_to_device(page, PAGE_SIZE);
+
+    spin_lock(&net_dev->ctrl_lock);
+    desc_idx = virt_queue_add_buf(net_dev->ctrl_queue, bufs, 3, writable);
+    if (desc_idx == 0xFFFF) {
+        spin_unlock(&net_dev->ctrl_lock);
+        free_frames_bytes(page, PAGE_SIZE);
+        return -EIO;
+    }
+
+    virt_queue_submit_buf(net_dev->ctrl_queue, desc_idx);
+    virt_queue_notify(net_dev->driver, net_dev->ctrl_queue);
+
+    deadline = nano_time() + CTRL_TIMEOUT_NS;
+    while ((used_idx = virt_queue_get_used_buf(net_dev->ctrl_queue,
+                                               &used_len)) == 0xFFFF) {
+        if (nano_time() >= deadline) {
+            spin_unlock(&net_dev->ctrl_lock);
+            // The device still owns the buffers, so the page is leaked.
+            printk("virtio_net: control command %u/%u timed out\n", class,
+                   cmd);
+            return -ETIMEDOUT;
+        }
+        arch_pause();
+    }
+    virt_queue_free_desc(net_dev->ctrl_queue, used_idx);
+    spin_unlock(&net_dev->ctrl_lock);
+
+    dma_sync_device_to_cpu(page, PAGE_SIZE);
+    ret = *ack == VIRTIO_NET_OK ? 0 : -EIO;
+    free_frames_bytes(page, PAGE_SIZE);
+    return ret;
+}
+
+static const netdev_zc_ops_t virtio_net_zc_ops = {
+    .xmit = (int (*)(void *, const netdev_tx_req_t *))virtio_net_xmit,
+    .xmit_flush = (void (*)(void *))virtio_net_xmit_flush,
+    .rx_take = (int (*)(void *, netdev_rx_buf_t *))virtio_net_rx_take,
+};
+
 int virtio_net_init(virtio_driver_t *driver) {
     uint64_t features = virtio_begin_init(
-        driver, VIRTIO_NET_F_MTU | VIRTIO_NET_F_MAC | VIRTIO_NET_F_MRG_RXBUF |
-                    VIRTIO_NET_F_STATUS | VIRTIO_F_RING_INDIRECT_DESC |
-                    VIRTIO_F_RING_EVENT_IDX | VIRTIO_F_VERSION_1);
+        driver, VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM |
+                    VIRTIO_NET_F_MTU | VIRTIO_NET_F_MAC |
+                    VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS |
+                    VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ |
+                    VIRTIO_F_RING_INDIRECT_DESC | VIRTIO_F_RING_EVENT_IDX |
+                    VIRTIO_F_VERSION_1);
+    bool indirect = !!(features & VIRTIO_F_RING_INDIRECT_DESC);
+    bool event_idx = !!(features & VIRTIO_F_RING_EVENT_IDX);
 
     uint32_t mac_low = driver->op->read_config_space(
         driver->data, offsetof(virtio_net_config_t, mac));
@@ -66,14 +247,17 @@ int virtio_net_init(virtio_driver_t *driver) {
         }
     }
 
+    uint16_t queue_pairs = 1;
+    if ((features & VIRTIO_NET_F_MQ) && (features & VIRTIO_NET_F_CTRL_VQ) &&
+        max_virtqueue_pairs > 1) {
+        queue_pairs = MIN(max_virtqueue_pairs, VIRTIO_NET_MAX_QUEUE_PAIRS);
+        queue_pairs = MIN(queue_pairs, cpu_count);
+    } else {
+        max_virtqueue_pairs = 1;
+    }
+
     printk("virtio_net: Got mac address: %02x:%02x:%02x:%02x:%02x:%02x\n",
            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-    virtqueue_t *recv_queue =
-        virt_queue_new(driver, 0, !!(features & VIRTIO_F_RING_INDIRECT_DESC),
-                       !!(features & VIRTIO_F_RING_EVENT_IDX));
-    virtqueue_t *send_queue =
-        virt_queue_new(driver, 1, !!(features & VIRTIO_F_RING_INDIRECT_DESC),
-                       !!(features & VIRTIO_F_RING_EVENT_IDX));
 
     virtio_net_device_t *net_device =
         (virtio_net_device_t *)malloc(sizeof(virtio_net_device_t));
@@ -82,14 +266,46 @@ int virtio_net_init(virtio_driver_t *driver) {
     net_device->driver = driver;
     memcpy(net_device->mac, mac, 6);
     net_device->mtu = mtu;
+    net_device->features = features;
     net_device->net_hdr_size =
         (!driver->op->requires_legacy_layout(driver->data) &&
          (features & VIRTIO_F_VERSION_1)) ||
                 (features & VIRTIO_NET_F_MRG_RXBUF)
             ? sizeof(virtio_net_hdr_v1_t)
             : sizeof(virtio_net_hdr_t);
-    net_device->send_queue = send_queue;
-    net_device->recv_queue = recv_queue;
+    net_device->ctrl_lock = SPIN_INIT;
+
+    // Queue pair N uses virtqueues 2N (receive) and 2N + 1 (transmit)
+    for (uint16_t i = 0; i < queue_pairs; i++) {
+        virtio_net_queue_t *q = &net_device->queues[i];
+
+        q->rx = virt_queue_new(driver, 2 * i, indirect, event_idx);
+        q->tx = virt_queue_new(driver, 2 * i + 1, indirect, event_idx);
+        q->rx_lock = SPIN_INIT;
+        q->tx_lock = SPIN_INIT;
+        q->tx_slots = alloc_frames_bytes(SIZE * VIRTIO_NET_TX_SLOT_SIZE);
+        for (uint16_t j = 0; j < SIZE; j++) {
+            q->tx_info[j].slot = -1;
+            q->tx_slot_free[j] = (uint8_t)j;
+        }
+        q->tx_slot_top = q->tx_slots ? SIZE : 0;
+        if (!q->rx || !q->tx || !q->tx_slots) {
+            if (i == 0) {
+                printk("virtio_net: Failed to create virtqueues\n");
+                free(net_device);
+                return -EIO;
+            }
+            queue_pairs = i;
+            break;
+        }
+    }
+    net_device->num_queue_pairs = queue_pairs;
+
+    // The control queue follows the last queue pair the device offers
+    if (features & VIRTIO_NET_F_CTRL_VQ) {
+        net_device->ctrl_queue = virt_queue_new(
+            driver, 2 * max_virtqueue_pairs, indirect, event_idx);
+    }
 
     if (driver->op->supports_interrupts &&
         driver->op->supports_interrupts(driver->data) &&
@@ -98,32 +314,38 @@ int virtio_net_init(virtio_driver_t *driver) {
                                           net_device);
     }
 
-    // Pre-allocate and populate receive buffers for polling mode
-    for (int i = 0; i < RX_BUFFER_COUNT; i++) {
-        void *rx_buffer = alloc_frames_bytes(RX_BUFFER_SIZE);
-        if (!rx_buffer) {
-            continue;
-        }
-
-        // Add receive buffer to receive queue
-        virtio_buffer_t buf = {.addr = (uint64_t)rx_buffer,
-                               .size = RX_BUFFER_SIZE};
-        bool writable = true;
-        dma_sync_cpu_to_device(rx_buffer, RX_BUFFER_SIZE);
-        uint16_t desc_idx = virt_queue_add_buf(recv_queue, &buf, 1, &writable);
-        if (desc_idx != 0xFFFF) {
-            net_device->rx_buffers[desc_idx] = rx_buffer;
-            virt_queue_submit_buf(recv_queue, desc_idx);
-        } else {
-            free_frames_bytes(rx_buffer, RX_BUFFER_SIZE);
-        }
+    // Receive buffers come from a pool shared by all queue pairs, sized so
+    // the rings can be refilled while the stack still holds a ring's worth
+    net_device->rx_pool =
+        netdev_pool_create(RX_BUFFER_SIZE, 2 * RX_BUFFER_COUNT * queue_pairs);
+    if (!net_device->rx_pool) {
+        printk("virtio_net: Failed to create receive buffer pool\n");
+        free(net_device);
+        return -ENOMEM;
     }
 
-    // Notify device about the receive buffers
-    virt_queue_notify(driver, recv_queue);
+    for (uint16_t i = 0; i < queue_pairs; i++) {
+        virtio_net_queue_t *q = &net_device->queues[i];
+        bool refilled = false;
+
+        virtio_net_rx_topup(net_device, q, &refilled);
+
+        // Notify device about the receive buffers
+        virt_queue_notify(driver, q->rx);
+    }
 
     virtio_finish_init(driver);
 
+    if (queue_pairs > 1) {
+        uint16_t pairs = queue_pairs;
+        if (virtio_net_ctrl_cmd(net_device, VIRTIO_NET_CTRL_MQ,
+                                VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, &pairs,
+                                sizeof(pairs)) != 0) {
+            printk("virtio_net: Failed to enable %u queue pairs\n", pairs);
+            net_device->num_queue_pairs = 1;
+        }
+    }
+
     net_device->netdev = netdev_register_full(
         NULL, NETDEV_TYPE_ETHERNET, net_device, net_device->mac,
         net_device->mtu, (netdev_send_t)virtio_net_send,
@@ -134,135 +356,370 @@ int virtio_net_init(virtio_driver_t *driver) {
         printk("virtio_net: Failed to register netdev\n");
         return -ENOMEM;
     }
+    netdev_set_zc_ops(net_device->netdev, &virtio_net_zc_ops);
+
+    uint32_t offloads = 0;
+    if (features & VIRTIO_NET_F_CSUM) {
+        offloads |= NETDEV_OFFLOAD_TX_CSUM;
+    }
+    // Coalescing relies on the device vouching for receive checksums
+    if (features & VIRTIO_NET_F_GUEST_CSUM) {
+        offloads |= NETDEV_OFFLOAD_GRO;
+    }
+    netdev_set_offloads(net_device->netdev, offloads, VIRTIO_NET_GRO_MAX_LEN);
+
+    printk("virtio_net: %s: %u queue pair(s), tx csum %s, rx csum %s\n",
+           net_device->netdev->name, net_device->num_queue_pairs,
+           (features & VIRTIO_NET_F_CSUM) ? "on" : "off",
+           (features & VIRTIO_NET_F_GUEST_CSUM) ? "on" : "off");
 
     virtio_net_devices[virtio_net_idx++] = net_device;
 
     return 0;
 }
 
-int virtio_net_send(virtio_net_device_t *net_dev, void *data, uint32_t len) {
-    if (!net_dev || !data || len == 0 ||
-        len > netdev_max_frame_len(net_dev->mtu)) {
-        return -1;
+/*
+ * Queues one frame as [slot: header + first bytes][segments...]. With copy
+ * set, or when the rest of the frame spans too many physical segments, the
+ * remainder goes through a bounce buffer instead, so the caller's memory is
+ * free as soon as this returns.
+ */
+static int virtio_net_queue_xmit(virtio_net_device_t *net_dev,
+                                 virtio_net_queue_t *q,
+                                 const netdev_tx_req_t *req, bool copy) {
+    uint32_t hdr_size = net_dev->net_hdr_size;
+    netdev_frag_t segs[VIRTIO_NET_TX_MAX_SEGS];
+    virtio_buffer_t bufs[VIRTIO_NET_TX_MAX_SEGS + 1];
+    bool writable[VIRTIO_NET_TX_MAX_SEGS + 1] = {0};
+    virtio_net_tx_done_t done[SIZE];
+    uint32_t nr_done = 0, head_len, bounce_size = 0;
+    uint64_t deadline = 0;
+    uint16_t desc_idx = 0xFFFF;
+    void *bounce = NULL;
+    uint8_t *head = NULL;
+    int nr_segs = 0, slot = -1;
+
+    head_len = req->len <= VIRTIO_NET_TX_SLOT_SIZE - hdr_size
+                   ? req->len
+                   : VIRTIO_NET_TX_HEAD_LEN;
+    if (head_len < req->len) {
+        nr_segs = copy ? -E2BIG
+                       : netdev_dma_split(req->frags, req->nr_frags, head_len,
+                                          segs, VIRTIO_NET_TX_MAX_SEGS);
+        if (nr_segs < 0) {
+            bounce_size = req->len - head_len;
+            bounce = alloc_frames_bytes(bounce_size);
+            if (!bounce) {
+                return -ENOMEM;
+            }
+            netdev_frags_copy(req->frags, req->nr_frags, head_len, bounce,
+                              bounce_size);
+            segs[0].data = bounce;
+            segs[0].len = bounce_size;
+            nr_segs = 1;
+        }
+        for (int i = 0; i < nr_segs; i++) {
+            bufs[i + 1].addr = (uint64_t)segs[i].data;
+            bufs[i + 1].size = segs[i].len;
+            dma_sync_cpu_to_device((void *)segs[i].data, segs[i].len);
+        }
     }
 
-    uint32_t total_len = net_dev->net_hdr_size + len;
-    void *send_buffer = alloc_frames_bytes(total_len);
-    if (!send_buffer) {
-        return -1;
+    spin_lock(&q->tx_lock);
+    for (;;) {
+        virtio_net_reap_tx(q, done, &nr_done);
+        if (q->tx_slot_top) {
+            slot = q->tx_slot_free[q->tx_slot_top - 1];
+            head = q->tx_slots + slot * VIRTIO_NET_TX_SLOT_SIZE;
+            bufs[0].addr = (uint64_t)head;
+            bufs[0].size = hdr_size + head_len;
+            desc_idx = virt_queue_add_buf(q->tx, bufs, nr_segs + 1, writable);
+            if (desc_idx != 0xFFFF) {
+                q->tx_slot_top--;
+                break;
+            }
+        }
+
+        // Ring full: make sure the device is working on what we queued
+        if (q->tx_unkicked) {
+            virt_queue_notify(net_dev->driver, q->tx);
+            q->tx_unkicked = 0;
+        }
+        if (!deadline) {
+            deadline = nano_time() + TX_RING_WAIT_NS;
+        } else if (nano_time() >= deadline) {
+            spin_unlock(&q->tx_lock);
+            if (bounce) {
+                free_frames_bytes(bounce, bounce_size);
+            }
+            virtio_net_tx_complete(done, nr_done);
+            return -ENOBUFS;
+        }
+        arch_pause();
     }
 
-    spin_lock(&net_dev->send_recv_lock);
-    virtio_net_reap_tx(net_dev);
+    memset(head, 0, hdr_size);
+    netdev_frags_copy(req->frags, req->nr_frags, 0, head + hdr_size,
+                      head_len);
+    if (net_dev->features & VIRTIO_NET_F_CSUM) {
+        virtio_net_tx_csum((virtio_net_hdr_t *)head, head + hdr_size, head_len,
+                           req->len);
+    }
+    dma_sync_cpu_to_device(head, hdr_size + head_len);
+
+    q->tx_info[desc_idx].done = copy ? NULL : req->done;
+    q->tx_info[desc_idx].ctx = req->ctx;
+    q->tx_info[desc_idx].bounce = bounce;
+    q->tx_info[desc_idx].bounce_size = bounce_size;
+    q->tx_info[desc_idx].slot = (int16_t)slot;
+    virt_queue_submit_buf(q->tx, desc_idx);
+
+    if (!(req->flags & NETDEV_XMIT_MORE) || ++q->tx_unkicked >= TX_KICK_BATCH) {
+        virt_queue_notify(net_dev->driver, q->tx);
+        q->tx_unkicked = 0;
+    }
+    spin_unlock(&q->tx_lock);
 
-    memset(send_buffer, 0, net_dev->net_hdr_size);
+    virtio_net_tx_complete(done, nr_done);
+    return req->len;
+}
 
-    memcpy((uint8_t *)send_buffer + net_dev->net_hdr_size, data, len);
-    dma_sync_cpu_to_device(send_buffer, total_len);
+static virtio_net_queue_t *virtio_net_tx_queue(virtio_net_device_t *net_dev) {
+    return &net_dev->queues[current_cpu_id % net_dev->num_queue_pairs];
+}
 
-    virtio_buffer_t buf = {.addr = (uint64_t)send_buffer, .size = total_len};
-    bool writable = false;
-    uint16_t desc_idx =
-        virt_queue_add_buf(net_dev->send_queue, &buf, 1, &writable);
-    if (desc_idx == 0xFFFF) {
-        free_frames_bytes(send_buffer, total_len);
-        spin_unlock(&net_dev->send_recv_lock);
-        return -1;
+int virtio_net_xmit(virtio_net_device_t *net_dev, const netdev_tx_req_t *req) {
+    if (!net_dev || !req || req->len == 0 || req->nr_frags == 0 ||
+        req->nr_frags > NETDEV_MAX_FRAGS ||
+        req->len > netdev_max_frame_len(net_dev->mtu)) {
+        return -EINVAL;
+    }
+
+    return virtio_net_queue_xmit(net_dev, virtio_net_tx_queue(net_dev), req,
+                                 false);
+}
+
+void virtio_net_xmit_flush(virtio_net_device_t *net_dev) {
+    virtio_net_tx_done_t done[SIZE];
+    uint32_t nr_done = 0;
+
+    if (!net_dev) {
+        return;
     }
 
-    net_dev->tx_buffers[desc_idx] = send_buffer;
-    net_dev->tx_buffer_sizes[desc_idx] = total_len;
+    for (uint16_t i = 0; i < net_dev->num_queue_pairs; i++) {
+        virtio_net_queue_t *q = &net_dev->queues[i];
+
+        if (!__atomic_load_n(&q->tx_unkicked, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        spin_lock(&q->tx_lock);
+        if (q->tx_unkicked) {
+            virt_queue_notify(net_dev->driver, q->tx);
+            q->tx_unkicked = 0;
+        }
+        virtio_net_reap_tx(q, done, &nr_done);
+        spin_unlock(&q->tx_lock);
+
+        virtio_net_tx_complete(done, nr_done);
+        nr_done = 0;
+    }
+}
 
-    virt_queue_submit_buf(net_dev->send_queue, desc_idx);
-    virt_queue_notify(net_dev->driver, net_dev->send_queue);
+// Opportunistic completion processing for callers on the receive path
+static void virtio_net_poll_tx(virtio_net_device_t *net_dev) {
+    virtio_net_tx_done_t done[SIZE];
+    uint32_t nr_done = 0;
 
-    spin_unlock(&net_dev->send_recv_lock);
+    for (uint16_t i = 0; i < net_dev->num_queue_pairs; i++) {
+        virtio_net_queue_t *q = &net_dev->queues[i];
 
-    return len;
+        if (!spin_trylock(&q->tx_lock)) {
+            continue;
+        }
+        virtio_net_reap_tx(q, done, &nr_done);
+        spin_unlock(&q->tx_lock);
+
+        virtio_net_tx_complete(done, nr_done);
+        nr_done = 0;
+    }
 }
 
-int virtio_net_receive(virtio_net_device_t *net_dev, void *buffer,
-                       uint32_t buffer_size) {
-    if (!net_dev || !buffer || buffer_size == 0) {
+int virtio_net_send(virtio_net_device_t *net_dev, void *data, uint32_t len) {
+    netdev_frag_t frag = {.data = data, .len = len};
+    netdev_tx_req_t req = {.frags = &frag, .nr_frags = 1, .len = len};
+    int ret;
+
+    if (!net_dev || !data || len == 0 ||
+        len > netdev_max_frame_len(net_dev->mtu)) {
         return -1;
     }
 
-    if (!virtio_net_has_packets(net_dev)) {
-        return 0;
+    ret = virtio_net_queue_xmit(net_dev, virtio_net_tx_queue(net_dev), &req,
+                                true);
+    return ret < 0 ? -1 : ret;
+}
+
+/*
+ * Hands the next frame up in the pool buffer the device wrote it to. In-order
+ * TCP segments following it are chained behind it, up to cap bytes, with
+ * only the first buffer's headers rewritten. Buffers taken off the ring are
+ * replaced from the pool; if the pool runs dry with the ring empty the frame
+ * is dropped and its buffer reposted.
+ */
+static int virtio_net_queue_take(virtio_net_device_t *net_dev,
+                                 virtio_net_queue_t *q, netdev_rx_buf_t *rx,
+                                 uint32_t cap, bool *refilled) {
+    uint32_t hdr_size = net_dev->net_hdr_size;
+    uint32_t len = 0, frame_len, prev_len;
+    virtio_net_gro_t gro;
+    uint8_t *data, *head;
+    void *rx_buffer;
+    bool valid;
+
+    for (;;) {
+        rx_buffer = virtio_net_rx_pop(q, &len);
+        if (!rx_buffer) {
+            return 0; // No packets available
+        }
+        if (len > hdr_size &&
+            (q->rx_posted > 0 || virtio_net_rx_topup(net_dev, q, refilled))) {
+            break;
+        }
+        virtio_net_rx_post(net_dev, q, rx_buffer);
+        *refilled = true;
     }
 
-    spin_lock(&net_dev->send_recv_lock);
-    virtio_net_reap_tx(net_dev);
+    data = netdev_pool_data(rx_buffer);
+    head = data + hdr_size;
+    frame_len = len - hdr_size;
+    valid = virtio_net_rx_csum((virtio_net_hdr_t *)data, head, frame_len);
+
+    rx->pool = net_dev->rx_pool;
+    rx->frags[0].buf = rx_buffer;
+    rx->frags[0].data = head;
+    rx->frags[0].len = frame_len;
+    rx->nr_frags = 1;
+    rx->len = frame_len;
+
+    if (!valid || cap <= netdev_max_frame_len(net_dev->mtu) ||
+        !virtio_net_gro_begin(&gro, head, frame_len)) {
+        return frame_len;
+    }
+    // Trailing Ethernet padding is not part of the coalesced frame
+    rx->frags[0].len = gro.len;
 
-    uint32_t len;
-    uint16_t desc_idx = virt_queue_get_used_buf(net_dev->recv_queue, &len);
-    if (desc_idx == 0xFFFF) {
-        spin_unlock(&net_dev->send_recv_lock);
-        return 0; // No packets available
-    }
-
-    void *rx_data = net_dev->rx_buffers[desc_idx];
-    if (!rx_data) {
-        virtio_descriptor_t *desc = &net_dev->recv_queue->desc[desc_idx];
-        rx_data = phys_to_virt(desc->addr);
-    }
-    dma_sync_device_to_cpu(rx_data, len);
-
-    if (len <= net_dev->net_hdr_size) {
-        net_dev->rx_buffers[desc_idx] = NULL;
-        virt_queue_free_desc(net_dev->recv_queue, desc_idx);
-
-        virtio_buffer_t buf = {.addr = (uint64_t)rx_data,
-                               .size = RX_BUFFER_SIZE};
-        bool writable = true;
-        dma_sync_cpu_to_device(rx_data, RX_BUFFER_SIZE);
-        uint16_t new_desc_idx =
-            virt_queue_add_buf(net_dev->recv_queue, &buf, 1, &writable);
-        if (new_desc_idx != 0xFFFF) {
-            net_dev->rx_buffers[new_desc_idx] = rx_data;
-            virt_queue_submit_buf(net_dev->recv_queue, new_desc_idx);
-            virt_queue_notify(net_dev->driver, net_dev->recv_queue);
+    while (!gro.push && rx->nr_frags < NETDEV_RX_MAX_FRAGS &&
+           (rx_buffer = virtio_net_rx_pop(q, &len))) {
+        uint8_t *frame;
+
+        if (len <= hdr_size) {
+            virtio_net_rx_post(net_dev, q, rx_buffer);
+            *refilled = true;
+            continue;
         }
-        spin_unlock(&net_dev->send_recv_lock);
-        if (net_dev->netdev && virtio_net_has_packets(net_dev))
-            netdev_notify_rx(net_dev->netdev);
-        return 0;
+
+        data = netdev_pool_data(rx_buffer);
+        frame = data + hdr_size;
+        prev_len = gro.len;
+        if ((q->rx_posted == 0 && !virtio_net_rx_topup(net_dev, q, refilled)) ||
+            !virtio_net_rx_csum((virtio_net_hdr_t *)data, frame,
+                                len - hdr_size) ||
+            !virtio_net_gro_merge(&gro, head, cap, frame, len - hdr_size,
+                                  false)) {
+            q->held_buf = rx_buffer;
+            q->held_len = len;
+            break;
+        }
+
+        rx->frags[rx->nr_frags].buf = rx_buffer;
+        rx->frags[rx->nr_frags].data = frame + gro.payload_off;
+        rx->frags[rx->nr_frags].len = gro.len - prev_len;
+        rx->nr_frags++;
     }
 
-    uint32_t data_len = len - net_dev->net_hdr_size;
+    rx->len = virtio_net_gro_finish(&gro, head);
+    return rx->len;
+}
 
-    if (data_len > buffer_size) {
-        data_len = buffer_size;
+static int virtio_net_take(virtio_net_device_t *net_dev, netdev_rx_buf_t *rx,
+                           uint32_t cap) {
+    for (uint16_t n = 0; n < net_dev->num_queue_pairs; n++) {
+        uint16_t idx = (net_dev->rx_next + n) % net_dev->num_queue_pairs;
+        virtio_net_queue_t *q = &net_dev->queues[idx];
+        bool refilled = false;
+        int ret;
+
+        if (!virtio_net_queue_has_rx(q)) {
+            continue;
+        }
+
+        spin_lock(&q->rx_lock);
+        ret = virtio_net_queue_take(net_dev, q, rx, cap, &refilled);
+        virtio_net_rx_topup(net_dev, q, &refilled);
+        if (refilled) {
+            virt_queue_notify(net_dev->driver, q->rx);
+        }
+        spin_unlock(&q->rx_lock);
+
+        if (ret > 0) {
+            // Rotate the starting queue so one busy flow cannot starve others
+            net_dev->rx_next = (idx + 1) % net_dev->num_queue_pairs;
+            if (net_dev->netdev && virtio_net_has_packets(net_dev))
+                netdev_notify_rx(net_dev->netdev);
+            return ret;
+        }
     }
 
-    memcpy(buffer, (uint8_t *)rx_data + net_dev->net_hdr_size, data_len);
+    return 0;
+}
 
-    net_dev->rx_buffers[desc_idx] = NULL;
-    virt_queue_free_desc(net_dev->recv_queue, desc_idx);
+int virtio_net_rx_take(virtio_net_device_t *net_dev, netdev_rx_buf_t *rx) {
+    if (!net_dev || !rx) {
+        return -EINVAL;
+    }
 
-    virtio_buffer_t buf = {.addr = (uint64_t)rx_data, .size = RX_BUFFER_SIZE};
-    bool writable = true;
-    dma_sync_cpu_to_device(rx_data, RX_BUFFER_SIZE);
-    uint16_t new_desc_idx =
-        virt_queue_add_buf(net_dev->recv_queue, &buf, 1, &writable);
-    if (new_desc_idx != 0xFFFF) {
-        net_dev->rx_buffers[new_desc_idx] = rx_data;
-        virt_queue_submit_buf(net_dev->recv_queue, new_desc_idx);
-        virt_queue_notify(net_dev->driver, net_dev->recv_queue);
+    virtio_net_poll_tx(net_dev);
+    return virtio_net_take(net_dev, rx, VIRTIO_NET_GRO_MAX_LEN);
+}
+
+int virtio_net_receive(virtio_net_device_t *net_dev, void *buffer,
+                       uint32_t buffer_size) {
+    netdev_rx_buf_t rx;
+    uint32_t copied = 0;
+    int ret;
+
+    if (!net_dev || !buffer || buffer_size == 0) {
+        return -1;
     }
 
-    spin_unlock(&net_dev->send_recv_lock);
+    virtio_net_poll_tx(net_dev);
+    ret = virtio_net_take(net_dev, &rx,
+                          MIN(buffer_size, VIRTIO_NET_GRO_MAX_LEN));
+    if (ret <= 0) {
+        return ret;
+    }
 
-    if (net_dev->netdev && virtio_net_has_packets(net_dev))
-        netdev_notify_rx(net_dev->netdev);
-    return data_len;
+    for (uint32_t i = 0; i < rx.nr_frags && copied < buffer_size; i++) {
+        uint32_t chunk = MIN(rx.frags[i].len, buffer_size - copied);
+
+        memcpy((uint8_t *)buffer + copied, rx.frags[i].data, chunk);
+        copied += chunk;
+    }
+    netdev_rx_buf_release(&rx);
+    return copied;
 }
 
 bool virtio_net_has_packets(virtio_net_device_t *net_dev) {
     if (!net_dev) {
         return false;
     }
-    return virt_queue_can_pop(net_dev->recv_queue);
+    for (uint16_t i = 0; i < net_dev->num_queue_pairs; i++) {
+        if (virtio_net_queue_has_rx(&net_dev->queues[i])) {
+            return true;
+        }
+    }
+    return false;
 }
 
 virtio_net_device_t *virtio_net_get_device(uint32_t index) {
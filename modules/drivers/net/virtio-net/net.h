@@ -3,18 +3,60 @@
 #include <drivers/virtio/queue.h>
 #include <drivers/virtio/virtio.h>
 #include <net/netdev.h>
+#include <arch/arch.h>
+
+#define VIRTIO_NET_MAX_QUEUE_PAIRS 8
+#define VIRTIO_NET_GRO_MAX_LEN 16384
+
+/* Each TX chain starts with a slot holding the virtio header followed by a
+ * copy of the frame's first bytes, so checksum setup never writes into the
+ * caller's buffers and small frames need a single descriptor. */
+#define VIRTIO_NET_TX_SLOT_SIZE 256
+#define VIRTIO_NET_TX_HEAD_LEN 192
+#define VIRTIO_NET_TX_MAX_SEGS 16
+
+/* Completion state of one in-flight TX chain, indexed by its head
+ * descriptor. */
+typedef struct virtio_net_tx_info {
+    netdev_tx_done_t done;
+    void *ctx;
+    void *bounce;
+    uint32_t bounce_size;
+    int16_t slot;
+} virtio_net_tx_info_t;
+
+/* One RX/TX virtqueue pair. Senders pick a pair by CPU, so each TX ring is
+ * normally only contended by tasks running on the same CPU. */
+typedef struct virtio_net_queue {
+    virtqueue_t *rx;
+    virtqueue_t *tx;
+    void *rx_buffers[SIZE];
+    uint16_t rx_posted;
+    virtio_net_tx_info_t tx_info[SIZE];
+    uint8_t *tx_slots;
+    uint8_t tx_slot_free[SIZE];
+    uint16_t tx_slot_top;
+    /* Chains submitted under NETDEV_XMIT_MORE without a notify yet. */
+    uint16_t tx_unkicked;
+    /* A used RX buffer that ended a GRO run; it is returned next time. */
+    void *held_buf;
+    uint32_t held_len;
+    spinlock_t rx_lock;
+    spinlock_t tx_lock;
+} virtio_net_queue_t;
 
 typedef struct virtio_net_device {
     virtio_driver_t *driver;
     uint8_t mac[6];
     uint16_t mtu;
     uint16_t net_hdr_size;
-    virtqueue_t *send_queue;
-    virtqueue_t *recv_queue;
-    void *rx_buffers[64];
-    void *tx_buffers[64];
-    uint32_t tx_buffer_sizes[64];
-    spinlock_t send_recv_lock;
+    uint64_t features;
+    uint16_t num_queue_pairs;
+    uint16_t rx_next;
+    virtio_net_queue_t queues[VIRTIO_NET_MAX_QUEUE_PAIRS];
+    virtqueue_t *ctrl_queue;
+    spinlock_t ctrl_lock;
+    netdev_pool_t *rx_pool;
     netdev_t *netdev;
 } virtio_net_device_t;
 
@@ -34,6 +76,10 @@ typedef struct virtio_net_hdr {
     uint16_t csum_offset;
 } virtio_net_hdr_t;
 
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+#define VIRTIO_NET_HDR_GSO_NONE 0
+
 typedef struct virtio_net_hdr_v1 {
     uint8_t flags;
     uint8_t gso_type;
@@ -44,16 +90,55 @@ typedef struct virtio_net_hdr_v1 {
     uint16_t num_buffers;
 } virtio_net_hdr_v1_t;
 
+typedef struct virtio_net_ctrl_hdr {
+    uint8_t class;
+    uint8_t cmd;
+} __attribute__((packed)) virtio_net_ctrl_hdr_t;
+
+#define VIRTIO_NET_CTRL_MQ 4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_OK 0
+
+#define VIRTIO_NET_F_CSUM (1ULL << 0)
+#define VIRTIO_NET_F_GUEST_CSUM (1ULL << 1)
 #define VIRTIO_NET_F_MTU (1ULL << 3)
 #define VIRTIO_NET_F_MAC (1ULL << 5)
 #define VIRTIO_NET_F_MRG_RXBUF (1ULL << 15)
 #define VIRTIO_NET_F_STATUS (1ULL << 16)
+#define VIRTIO_NET_F_CTRL_VQ (1ULL << 17)
+#define VIRTIO_NET_F_MQ (1ULL << 22)
 #define VIRTIO_NET_DEFAULT_MTU 1500
 
+/* Receive-side coalescing state for one super-frame being built in the
+ * caller's buffer. */
+typedef struct virtio_net_gro {
+    uint32_t len;
+    uint32_t tcp_off;
+    uint32_t payload_off;
+    uint32_t payload_len;
+    uint32_t next_seq;
+    uint32_t payload_sum;
+    uint16_t segs;
+    bool push;
+} virtio_net_gro_t;
+
+void virtio_net_tx_csum(virtio_net_hdr_t *hdr, uint8_t *head, uint32_t head_len,
+                       uint32_t len);
+bool virtio_net_rx_csum(virtio_net_hdr_t *hdr, uint8_t *frame, uint32_t len);
+bool virtio_net_gro_begin(virtio_net_gro_t *gro, uint8_t *buf, uint32_t len);
+/* With copy unset the payload stays where it is and only the length
+ * bookkeeping advances; the caller chains frame + gro->payload_off itself. */
+bool virtio_net_gro_merge(virtio_net_gro_t *gro, uint8_t *buf, uint32_t cap,
+                          const uint8_t *frame, uint32_t len, bool copy);
+uint32_t virtio_net_gro_finish(virtio_net_gro_t *gro, uint8_t *buf);
+
 int virtio_net_init(virtio_driver_t *driver);
 int virtio_net_send(virtio_net_device_t *net_dev, void *data, uint32_t len);
 int virtio_net_receive(virtio_net_device_t *net_dev, void *buffer,
                        uint32_t buffer_size);
+int virtio_net_xmit(virtio_net_device_t *net_dev, const netdev_tx_req_t *req);
+void virtio_net_xmit_flush(virtio_net_device_t *net_dev);
+int virtio_net_rx_take(virtio_net_device_t *net_dev, netdev_rx_buf_t *rx);
 bool virtio_net_has_packets(virtio_net_device_t *net_dev);
 virtio_net_device_t *virtio_net_get_device(uint32_t index);
 uint32_t virtio_net_get_device_count(void);
@@ -0,0 +1,365 @@
+// Copyright (C) 2025-2026  lihanrui2913
+#include "net.h"
+#include <libs/endian.h>
+
+#define VNET_ETH_HLEN 14
+#define VNET_ETH_P_IP 0x0800
+#define VNET_ETH_P_IPV6 0x86DD
+#define VNET_IP_PROTO_TCP 6
+#define VNET_IP_PROTO_UDP 17
+#define VNET_TCP_PSH 0x08
+#define VNET_TCP_ACK 0x10
+
+typedef struct vnet_l4 {
+    uint32_t l3_off;
+    uint32_t l4_off;
+    uint32_t l4_len;
+    uint8_t proto;
+    bool ipv6;
+} vnet_l4_t;
+
+static inline uint16_t vnet_get16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t vnet_get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void vnet_put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+/*
+ * Internet checksum arithmetic is done on words in memory order, so results
+ * can be stored into the packet with a plain memcpy on any host endianness.
+ */
+static uint64_t vnet_csum_add(uint64_t sum, const void *data, uint32_t len) {
+    const uint8_t *p = data;
+    uint64_t v64;
+    uint32_t v32;
+    uint16_t v16;
+
+    while (len >= 8) {
+        memcpy(&v64, p, 8);
+        sum += v64;
+        sum += sum < v64;
+        p += 8;
+        len -= 8;
+    }
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+
+    if (len >= 4) {
+        memcpy(&v32, p, 4);
+        sum += v32;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        memcpy(&v16, p, 2);
+        sum += v16;
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        v16 = 0;
+        memcpy(&v16, p, 1);
+        sum += v16;
+    }
+    return sum;
+}
+
+static uint16_t vnet_csum_fold(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+/* Locates the TCP/UDP header of an untagged, unfragmented IPv4 or IPv6 frame
+ * whose transport header directly follows the IP header. Only the first
+ * head_len bytes of the len-byte frame are available for parsing. */
+static bool vnet_parse_l4(const uint8_t *frame, uint32_t head_len, uint32_t len,
+                          vnet_l4_t *l4) {
+    const uint8_t *ip = frame + VNET_ETH_HLEN;
+    uint16_t ethertype;
+
+    if (head_len < VNET_ETH_HLEN) {
+        return false;
+    }
+    ethertype = vnet_get16(frame + 12);
+    l4->l3_off = VNET_ETH_HLEN;
+
+    if (ethertype == VNET_ETH_P_IP) {
+        uint32_t ihl, tot_len;
+
+        if (head_len < VNET_ETH_HLEN + 20 || (ip[0] >> 4) != 4) {
+            return false;
+        }
+        ihl = (ip[0] & 0xF) * 4U;
+        tot_len = vnet_get16(ip + 2);
+        if (ihl < 20 || tot_len < ihl || VNET_ETH_HLEN + ihl > head_len ||
+            VNET_ETH_HLEN + tot_len > len ||
+            (vnet_get16(ip + 6) & 0x3FFF)) {
+            return false;
+        }
+        l4->l4_off = VNET_ETH_HLEN + ihl;
+        l4->l4_len = tot_len - ihl;
+        l4->proto = ip[9];
+        l4->ipv6 = false;
+    } else if (ethertype == VNET_ETH_P_IPV6) {
+        uint32_t payload_len;
+
+        if (head_len < VNET_ETH_HLEN + 40 || (ip[0] >> 4) != 6) {
+            return false;
+        }
+        payload_len = vnet_get16(ip + 4);
+        if (VNET_ETH_HLEN + 40 + payload_len > len) {
+            return false;
+        }
+        l4->l4_off = VNET_ETH_HLEN + 40;
+        l4->l4_len = payload_len;
+        l4->proto = ip[6];
+        l4->ipv6 = true;
+    } else {
+        return false;
+    }
+
+    if (l4->proto == VNET_IP_PROTO_TCP) {
+        return l4->l4_len >= 20;
+    }
+    if (l4->proto == VNET_IP_PROTO_UDP) {
+        return l4->l4_len >= 8;
+    }
+    return false;
+}
+
+static uint64_t vnet_pseudo_sum(const uint8_t *frame, const vnet_l4_t *l4) {
+    const uint8_t *ip = frame + l4->l3_off;
+    uint64_t sum;
+
+    if (l4->ipv6) {
+        sum = vnet_csum_add(0, ip + 8, 32);
+    } else {
+        sum = vnet_csum_add(0, ip + 12, 8);
+    }
+    sum += htobe16((uint16_t)l4->proto);
+    sum += htobe16((uint16_t)l4->l4_len);
+    return sum;
+}
+
+/*
+ * Hands the TCP/UDP checksum of an outgoing frame to the device. The stack
+ * leaves the field zero on netdevs with NETDEV_OFFLOAD_TX_CSUM; the device
+ * expects it to hold the folded pseudo-header sum instead.
+ */
+void virtio_net_tx_csum(virtio_net_hdr_t *hdr, uint8_t *head, uint32_t head_len,
+                       uint32_t len) {
+    vnet_l4_t l4;
+    uint32_t field;
+    uint16_t partial;
+
+    if (!vnet_parse_l4(head, head_len, len, &l4)) {
+        return;
+    }
+
+    field = l4.l4_off + (l4.proto == VNET_IP_PROTO_TCP ? 16 : 6);
+    if (field + sizeof(partial) > head_len || head[field] ||
+        head[field + 1]) {
+        return;
+    }
+
+    partial = vnet_csum_fold(vnet_pseudo_sum(head, &l4));
+    memcpy(head + field, &partial, sizeof(partial));
+
+    hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->csum_start = (uint16_t)l4.l4_off;
+    hdr->csum_offset = (uint16_t)(field - l4.l4_off);
+}
+
+/*
+ * Completes a partially checksummed frame and reports whether its transport
+ * checksum is known to be good. Frames the device did not vouch for are left
+ * to the stack to verify.
+ */
+bool virtio_net_rx_csum(virtio_net_hdr_t *hdr, uint8_t *frame, uint32_t len) {
+    if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+        uint32_t start = hdr->csum_start;
+        uint32_t field = start + hdr->csum_offset;
+        uint16_t csum;
+
+        if (start >= len || field + sizeof(csum) > len) {
+            return false;
+        }
+
+        csum = (uint16_t)~vnet_csum_fold(
+            vnet_csum_add(0, frame + start, len - start));
+        if (csum == 0) {
+            csum = 0xFFFF;
+        }
+        memcpy(frame + field, &csum, sizeof(csum));
+        hdr->flags = VIRTIO_NET_HDR_F_DATA_VALID;
+        return true;
+    }
+
+    return !!(hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID);
+}
+
+/*
+ * Receive-side coalescing. Only plain in-order IPv4 TCP data segments without
+ * IP options are merged; anything else ends the run. Segments must already be
+ * checksum-verified, which lets the payload sum of each one be recovered from
+ * its header alone, so the super-frame's checksum is rebuilt without touching
+ * the payload a second time.
+ */
+static bool vnet_gro_parse(const uint8_t *frame, uint32_t len, vnet_l4_t *l4,
+                           uint32_t *payload_off, uint32_t *payload_len) {
+    const uint8_t *tcp;
+    uint32_t doff;
+
+    if (!vnet_parse_l4(frame, len, len, l4) || l4->ipv6 ||
+        l4->proto != VNET_IP_PROTO_TCP ||
+        l4->l4_off != VNET_ETH_HLEN + 20) {
+        return false;
+    }
+
+    tcp = frame + l4->l4_off;
+    doff = (tcp[12] >> 4) * 4U;
+    if (doff < 20 || doff > l4->l4_len || !(tcp[13] & VNET_TCP_ACK) ||
+        (tcp[13] & ~(VNET_TCP_ACK | VNET_TCP_PSH))) {
+        return false;
+    }
+
+    *payload_off = l4->l4_off + doff;
+    *payload_len = l4->l4_len - doff;
+    return *payload_len != 0;
+}
+
+static uint16_t vnet_gro_payload_sum(const uint8_t *frame, const vnet_l4_t *l4,
+                                     uint32_t payload_off) {
+    uint64_t sum = vnet_pseudo_sum(frame, l4);
+
+    sum = vnet_csum_add(sum, frame + l4->l4_off, payload_off - l4->l4_off);
+    return (uint16_t)~vnet_csum_fold(sum);
+}
+
+bool virtio_net_gro_begin(virtio_net_gro_t *gro, uint8_t *buf, uint32_t len) {
+    vnet_l4_t l4;
+    uint32_t payload_off, payload_len;
+    const uint8_t *tcp;
+
+    if (!vnet_gro_parse(buf, len, &l4, &payload_off, &payload_len)) {
+        return false;
+    }
+
+    tcp = buf + l4.l4_off;
+    if (tcp[13] & VNET_TCP_PSH) {
+        return false;
+    }
+
+    gro->len = payload_off + payload_len;
+    gro->tcp_off = l4.l4_off;
+    gro->payload_off = payload_off;
+    gro->payload_len = payload_len;
+    gro->next_seq = vnet_get32(tcp + 4) + payload_len;
+    gro->payload_sum = vnet_gro_payload_sum(buf, &l4, payload_off);
+    gro->segs = 1;
+    gro->push = false;
+    return true;
+}
+
+bool virtio_net_gro_merge(virtio_net_gro_t *gro, uint8_t *buf, uint32_t cap,
+                          const uint8_t *frame, uint32_t len, bool copy) {
+    const uint8_t *ip = frame + VNET_ETH_HLEN;
+    const uint8_t *gip = buf + VNET_ETH_HLEN;
+    const uint8_t *tcp, *gtcp = buf + gro->tcp_off;
+    uint32_t payload_off, payload_len;
+    uint16_t sum;
+    vnet_l4_t l4;
+
+    if (gro->push ||
+        !vnet_gro_parse(frame, len, &l4, &payload_off, &payload_len) ||
+        payload_off != gro->payload_off) {
+        return false;
+    }
+    tcp = frame + l4.l4_off;
+
+    /* Same addresses, TOS and TTL; same ports, ack, data offset, window and
+     * options. Only the sequence number, PSH and checksum may differ. */
+    if (memcmp(ip + 12, gip + 12, 8) || ip[1] != gip[1] || ip[8] != gip[8] ||
+        memcmp(tcp, gtcp, 4) || memcmp(tcp + 8, gtcp + 8, 5) ||
+        memcmp(tcp + 14, gtcp + 14, 2) ||
+        memcmp(tcp + 20, gtcp + 20, payload_off - l4.l4_off - 20)) {
+        return false;
+    }
+
+    if (vnet_get32(tcp + 4) != gro->next_seq ||
+        gro->len + payload_len > cap ||
+        gro->len + payload_len - VNET_ETH_HLEN > 0xFFFF) {
+        return false;
+    }
+
+    if (copy) {
+        memcpy(buf + gro->len, frame + payload_off, payload_len);
+    }
+
+    sum = vnet_gro_payload_sum(frame, &l4, payload_off);
+    if (gro->payload_len & 1) {
+        sum = __builtin_bswap16(sum);
+    }
+    gro->payload_sum += sum;
+
+    gro->len += payload_len;
+    gro->payload_len += payload_len;
+    gro->next_seq += payload_len;
+    gro->segs++;
+    if (tcp[13] & VNET_TCP_PSH) {
+        gro->push = true;
+    }
+    return true;
+}
+
+uint32_t virtio_net_gro_finish(virtio_net_gro_t *gro, uint8_t *buf) {
+    uint8_t *ip = buf + VNET_ETH_HLEN;
+    uint8_t *tcp = buf + gro->tcp_off;
+    vnet_l4_t l4;
+    uint64_t sum;
+    uint16_t csum;
+
+    if (gro->segs < 2) {
+        return gro->len;
+    }
+
+    vnet_put16(ip + 2, (uint16_t)(gro->len - VNET_ETH_HLEN));
+    ip[10] = 0;
+    ip[11] = 0;
+    csum = (uint16_t)~vnet_csum_fold(vnet_csum_add(0, ip, 20));
+    memcpy(ip + 10, &csum, sizeof(csum));
+
+    if (gro->push) {
+        tcp[13] |= VNET_TCP_PSH;
+    }
+    tcp[16] = 0;
+    tcp[17] = 0;
+
+    l4.l3_off = VNET_ETH_HLEN;
+    l4.l4_off = gro->tcp_off;
+    l4.l4_len = gro->len - gro->tcp_off;
+    l4.proto = VNET_IP_PROTO_TCP;
+    l4.ipv6 = false;
+
+    sum = vnet_pseudo_sum(buf, &l4);
+    sum = vnet_csum_add(sum, tcp, gro->payload_off - gro->tcp_off);
+    sum += gro->payload_sum;
+    csum = (uint16_t)~vnet_csum_fold(sum);
+    if (csum == 0) {
+        csum = 0xFFFF;
+    }
+    memcpy(tcp + 16, &csum, sizeof(csum));
+
+    return gro->len;
+}
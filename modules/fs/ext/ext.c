@@ -11,6 +11,7 @@
 #include <mm/mm.h>
 #include <arch/arch.h>
 #include <task/task.h>
+#include <libs/crc32c.h>
 
 #define EXT_MAP_CACHE_TARGET_BYTES (128u * 1024u)
 #define EXT_MAP_CACHE_MIN_ENTRIES 16u
@@ -281,26 +282,10 @@ static size_t ext_inode_extra_capacity(ext_mount_ctx_t *fs) {
                sizeof(ext_inode_disk_t) - EXT2_GOOD_OLD_INODE_SIZE);
 }
 
-static uint32_t ext_crc32c_update(uint32_t crc, const void *buf, size_t len) {
-    static uint32_t table[256];
-    static bool table_ready;
-    const uint8_t *p = buf;
-
-    if (!table_ready) {
-        for (uint32_t i = 0; i < 256; i++) {
-            uint32_t v = i;
-            for (uint32_t bit = 0; bit < 8; bit++)
-                v = (v & 1) ? (v >> 1) ^ 0x82F63B78u : (v >> 1);
-            table[i] = v;
-        }
-        table_ready = true;
-    }
-
-    /* ext4 metadata checksums use raw crc32c continuation, without final xor.
-     */
-    while (len--)
-        crc = table[(crc ^ *p++) & 0xFFu] ^ (crc >> 8);
-    return crc;
+/* ext4 metadata checksums use raw crc32c continuation, without final xor. */
+static inline uint32_t ext_crc32c_update(uint32_t crc, const void *buf,
+                                         size_t len) {
+    return crc32c(crc, buf, len);
 }
 
 static uint32_t ext_metadata_checksum_seed(const ext_super_block_t *sb) {
@@ -74,6 +74,10 @@
 
 #include "netif/ethernet.h"
 
+#ifdef LWIP_HOOK_FILENAME
+#include LWIP_HOOK_FILENAME
+#endif
+
 #if LWIP_AUTOIP
 #include "lwip/autoip.h"
 #endif /* LWIP_AUTOIP */
@@ -1126,6 +1130,15 @@ err_t netif_loop_output(struct netif *netif, struct pbuf *p) {
     LWIP_ASSERT("netif_loop_output: invalid netif", netif != NULL);
     LWIP_ASSERT("netif_loop_output: invalid pbuf", p != NULL);
 
+#ifdef LWIP_HOOK_NETIF_LOOP_OUTPUT
+    /* The hook may hand the packet to the input path itself. It returns
+       ERR_INPROGRESS to fall back to the copying queue below. */
+    err = LWIP_HOOK_NETIF_LOOP_OUTPUT(netif, p);
+    if (err != ERR_INPROGRESS) {
+        return err;
+    }
+#endif /* LWIP_HOOK_NETIF_LOOP_OUTPUT */
+
     /* Allocate a new pbuf */
     r = pbuf_alloc(PBUF_LINK, p->tot_len, PBUF_RAM);
     if (r == NULL) {
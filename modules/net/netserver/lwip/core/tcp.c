@@ -981,6 +981,84 @@ void tcp_recved(struct tcp_pcb *pcb, u16_t len) {
                  len, pcb->rcv_wnd, (u16_t)(TCP_WND_MAX(pcb) - pcb->rcv_wnd)));
 }
 
+/**
+ * @ingroup tcp_raw
+ * Resizes the receive window of a (non-listening) pcb, e.g. for SO_RCVBUF.
+ * A larger window is announced right away; a smaller one takes effect as
+ * the peer fills the window, the advertised right edge never moves back.
+ *
+ * @param pcb the tcp_pcb to resize
+ * @param wnd the requested window in bytes
+ * @return the window actually in effect
+ */
+tcpwnd_size_t tcp_set_rcv_wnd_max(struct tcp_pcb *pcb, tcpwnd_size_t wnd) {
+    tcpwnd_size_t old_max, new_max;
+
+    LWIP_ASSERT_CORE_LOCKED();
+
+    LWIP_ERROR("tcp_set_rcv_wnd_max: invalid pcb", pcb != NULL, return 0);
+    LWIP_ASSERT("don't resize listen-pcbs", pcb->state != LISTEN);
+
+#if LWIP_WND_SCALE
+    wnd = LWIP_MIN(wnd, (tcpwnd_size_t)0xFFFFU << TCP_RCV_SCALE);
+#else
+    wnd = LWIP_MIN(wnd, (tcpwnd_size_t)0xFFFFU);
+#endif
+    wnd = LWIP_MAX(wnd, (tcpwnd_size_t)(2 * TCP_MSS));
+
+    old_max = TCP_WND_MAX(pcb);
+    pcb->rcv_wnd_max = wnd;
+    new_max = TCP_WND_MAX(pcb);
+    if (new_max >= old_max) {
+        pcb->rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd + (new_max - old_max));
+    } else if (pcb->rcv_wnd > old_max - new_max) {
+        pcb->rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd - (old_max - new_max));
+    } else {
+        pcb->rcv_wnd = 0;
+    }
+
+    if (pcb->state == CLOSED || pcb->state == SYN_SENT) {
+        /* nothing announced yet: the SYN carries the new window */
+        pcb->rcv_ann_wnd = pcb->rcv_wnd;
+    } else if (pcb->state == ESTABLISHED || pcb->state == FIN_WAIT_1 ||
+               pcb->state == FIN_WAIT_2) {
+        tcp_recved(pcb, 0);
+    }
+    return wnd;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Resizes the send buffer of a (non-listening) pcb, e.g. for SO_SNDBUF.
+ * The buffer never shrinks below what is already queued.
+ *
+ * @param pcb the tcp_pcb to resize
+ * @param size the requested buffer size in bytes
+ * @return the size actually in effect
+ */
+tcpwnd_size_t tcp_set_snd_buf_max(struct tcp_pcb *pcb, tcpwnd_size_t size) {
+    tcpwnd_size_t queued;
+
+    LWIP_ASSERT_CORE_LOCKED();
+
+    LWIP_ERROR("tcp_set_snd_buf_max: invalid pcb", pcb != NULL, return 0);
+    LWIP_ASSERT("don't resize listen-pcbs", pcb->state != LISTEN);
+
+    /* writers are woken once more than TCP_SNDLOWAT is free */
+    size = LWIP_MAX(size, (tcpwnd_size_t)(2 * TCP_SNDLOWAT));
+    size = LWIP_MIN(size, (tcpwnd_size_t)((TCP_SNDQUEUELEN_OVERFLOW / 4) *
+                                          TCP_MSS));
+
+    queued = pcb->snd_buf_max > pcb->snd_buf
+                 ? (tcpwnd_size_t)(pcb->snd_buf_max - pcb->snd_buf)
+                 : 0;
+    size = LWIP_MAX(size, queued);
+    pcb->snd_buf = (tcpwnd_size_t)(size - queued);
+    pcb->snd_buf_max = size;
+    pcb->snd_queuelen_max = (u16_t)((4 * size + TCP_MSS - 1) / TCP_MSS);
+    return size;
+}
+
 /**
  * Allocate a new local TCP port.
  *
@@ -1131,7 +1209,7 @@ err_t tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
     /* Start with a window that does not need scaling. When window scaling is
        enabled and used, the window is enlarged when both sides agree on
        scaling. */
-    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
+    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(pcb->rcv_wnd_max);
     pcb->rcv_ann_right_edge = pcb->rcv_nxt;
     pcb->snd_wnd = TCP_WND;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -1899,7 +1977,9 @@ struct tcp_pcb *tcp_alloc(u8_t prio) {
          * zero */
         memset(pcb, 0, sizeof(struct tcp_pcb));
         pcb->prio = prio;
-        pcb->snd_buf = TCP_SND_BUF;
+        pcb->snd_buf = pcb->snd_buf_max = TCP_SND_BUF;
+        pcb->snd_queuelen_max = TCP_SND_QUEUELEN;
+        pcb->rcv_wnd_max = TCP_WND;
         /* Start with a window that does not need scaling. When window scaling
            is enabled and used, the window is enlarged when both sides agree on
            scaling. */
@@ -2163,10 +2163,12 @@ static void tcp_parseopt(struct tcp_pcb *pcb) {
                     /* window scaling is enabled, we can use the full receive
                      * window */
                     LWIP_ASSERT("window not at default value",
-                                pcb->rcv_wnd == TCPWND_MIN16(TCP_WND));
+                                pcb->rcv_wnd ==
+                                    TCPWND_MIN16(pcb->rcv_wnd_max));
                     LWIP_ASSERT("window not at default value",
-                                pcb->rcv_ann_wnd == TCPWND_MIN16(TCP_WND));
-                    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_WND;
+                                pcb->rcv_ann_wnd ==
+                                    TCPWND_MIN16(pcb->rcv_wnd_max));
+                    pcb->rcv_wnd = pcb->rcv_ann_wnd = pcb->rcv_wnd_max;
                 }
                 break;
 #endif /* LWIP_WND_SCALE */
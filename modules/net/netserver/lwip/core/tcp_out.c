@@ -311,6 +311,26 @@ static void tcp_seg_add_chksum(u16_t chksum, u16_t len, u16_t *seg_chksum,
 }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
+/** Allocate a pbuf referencing len bytes of non-copied data. Plain PBUF_ROM
+ * unless TCP_WRITE_FLAG_REF asks the port for a pbuf that keeps the memory
+ * alive on its own (a custom PBUF_ROM, never extended in place). */
+static struct pbuf *tcp_pbuf_nocopy(pbuf_layer layer, const u8_t *data,
+                                    u16_t len, u8_t apiflags) {
+    struct pbuf *p;
+#ifdef LWIP_HOOK_TCP_WRITE_REF_PBUF
+    if (apiflags & TCP_WRITE_FLAG_REF) {
+        return LWIP_HOOK_TCP_WRITE_REF_PBUF(data, len);
+    }
+#else
+    LWIP_UNUSED_ARG(apiflags);
+#endif
+    p = pbuf_alloc(layer, len, PBUF_ROM);
+    if (p != NULL) {
+        ((struct pbuf_rom *)p)->payload = data;
+    }
+    return p;
+}
+
 /** Checks if tcp_write is allowed or not (checks state, snd_buf and
  * snd_queuelen).
  *
@@ -348,10 +368,10 @@ static err_t tcp_write_checks(struct tcp_pcb *pcb, u16_t len) {
      * configured maximum, return an error */
     /* check for configured max queuelen and possible overflow */
     if (pcb->snd_queuelen >=
-        LWIP_MIN(TCP_SND_QUEUELEN, (TCP_SNDQUEUELEN_OVERFLOW + 1))) {
+        LWIP_MIN(pcb->snd_queuelen_max, (TCP_SNDQUEUELEN_OVERFLOW + 1))) {
         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SEVERE,
                     ("tcp_write: too long queue %" U16_F " (max %" U16_F ")\n",
-                     pcb->snd_queuelen, (u16_t)TCP_SND_QUEUELEN));
+                     pcb->snd_queuelen, pcb->snd_queuelen_max));
         TCP_STATS_INC(tcp.memerr);
         tcp_set_flags(pcb, TF_NAGLEMEMERR);
         return ERR_MEM;
@@ -589,7 +609,11 @@ err_t tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len,
                 struct pbuf *p;
                 for (p = last_unsent->p; p->next != NULL; p = p->next)
                     ;
-                if (((p->type_internal &
+                if (!(apiflags & TCP_WRITE_FLAG_REF) &&
+#if LWIP_SUPPORT_CUSTOM_PBUF
+                    !(p->flags & PBUF_FLAG_IS_CUSTOM) &&
+#endif /* LWIP_SUPPORT_CUSTOM_PBUF */
+                    ((p->type_internal &
                       (PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS |
                        PBUF_TYPE_FLAG_DATA_VOLATILE)) == 0) &&
                     (const u8_t *)p->payload + p->len == (const u8_t *)arg) {
@@ -597,16 +621,15 @@ err_t tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len,
                                 pos == 0);
                     extendlen = seglen;
                 } else {
-                    if ((concat_p = pbuf_alloc(PBUF_RAW, seglen, PBUF_ROM)) ==
+                    if ((concat_p = tcp_pbuf_nocopy(PBUF_RAW,
+                                                    (const u8_t *)arg + pos,
+                                                    seglen, apiflags)) ==
                         NULL) {
                         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                                     ("tcp_write: could not allocate memory for "
                                      "zero-copy pbuf\n"));
                         goto memerr;
                     }
-                    /* reference the non-volatile payload data */
-                    ((struct pbuf_rom *)concat_p)->payload =
-                        (const u8_t *)arg + pos;
                     queuelen += pbuf_clen(concat_p);
                 }
 #if TCP_CHECKSUM_ON_COPY
@@ -671,7 +694,8 @@ err_t tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len,
 #if TCP_OVERSIZE
             LWIP_ASSERT("oversize == 0", oversize == 0);
 #endif /* TCP_OVERSIZE */
-            if ((p2 = pbuf_alloc(PBUF_TRANSPORT, seglen, PBUF_ROM)) == NULL) {
+            if ((p2 = tcp_pbuf_nocopy(PBUF_TRANSPORT, (const u8_t *)arg + pos,
+                                      seglen, apiflags)) == NULL) {
                 LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                             ("tcp_write: could not allocate memory for "
                              "zero-copy pbuf\n"));
@@ -685,8 +709,6 @@ err_t tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len,
                 chksum = SWAP_BYTES_IN_WORD(chksum);
             }
 #endif /* TCP_CHECKSUM_ON_COPY */
-            /* reference the non-volatile payload data */
-            ((struct pbuf_rom *)p2)->payload = (const u8_t *)arg + pos;
 
             /* Second, allocate a pbuf for the headers. */
             if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen, PBUF_RAM)) == NULL) {
@@ -707,10 +729,11 @@ err_t tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len,
         /* Now that there are more segments queued, we check again if the
          * length of the queue exceeds the configured maximum or
          * overflows. */
-        if (queuelen > LWIP_MIN(TCP_SND_QUEUELEN, TCP_SNDQUEUELEN_OVERFLOW)) {
+        if (queuelen >
+            LWIP_MIN(pcb->snd_queuelen_max, TCP_SNDQUEUELEN_OVERFLOW)) {
             LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                         ("tcp_write: queue too long %" U16_F " (%d)\n",
-                         queuelen, (int)TCP_SND_QUEUELEN));
+                         queuelen, (int)pcb->snd_queuelen_max));
             pbuf_free(p);
             goto memerr;
         }
@@ -103,7 +103,7 @@ err_t tcp_process_refused_data(struct tcp_pcb *pcb);
       (((tpcb)->unsent != NULL) && (((tpcb)->unsent->next != NULL) ||          \
                                     ((tpcb)->unsent->len >= (tpcb)->mss))) ||  \
       ((tcp_sndbuf(tpcb) == 0) ||                                              \
-       (tcp_sndqueuelen(tpcb) >= TCP_SND_QUEUELEN)))                           \
+       (tcp_sndqueuelen(tpcb) >= (tpcb)->snd_queuelen_max)))                   \
          ? 1                                                                   \
          : 0)
 #define tcp_output_nagle(tpcb)                                                 \
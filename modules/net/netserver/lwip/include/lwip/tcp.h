@@ -145,13 +145,14 @@ typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *tpcb, err_t err);
 #define SND_WND_SCALE(pcb, wnd) (((wnd) << (pcb)->snd_scale))
 #define TCPWND16(x) ((u16_t)LWIP_MIN((x), 0xFFFF))
 #define TCP_WND_MAX(pcb)                                                       \
-    ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_WND                   \
-                                                   : TCPWND16(TCP_WND)))
+    ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE)                             \
+                         ? (pcb)->rcv_wnd_max                                  \
+                         : TCPWND16((pcb)->rcv_wnd_max)))
 #else
 #define RCV_WND_SCALE(pcb, wnd) (wnd)
 #define SND_WND_SCALE(pcb, wnd) (wnd)
 #define TCPWND16(x) (x)
-#define TCP_WND_MAX(pcb) TCP_WND
+#define TCP_WND_MAX(pcb) ((pcb)->rcv_wnd_max)
 #endif
 /* Increments a tcpwnd_size_t and holds at max value rather than rollover */
 #define TCP_WND_INC(wnd, inc)                                                  \
@@ -353,6 +354,12 @@ struct tcp_pcb {
 #define TCP_SNDQUEUELEN_OVERFLOW (0xffffU - 3)
     u16_t snd_queuelen; /* Number of pbufs currently in the send buffer. */
 
+    /* Per-pcb limits, TCP_WND/TCP_SND_BUF/TCP_SND_QUEUELEN unless changed
+     * with tcp_set_rcv_wnd_max()/tcp_set_snd_buf_max() */
+    tcpwnd_size_t rcv_wnd_max;
+    tcpwnd_size_t snd_buf_max;
+    u16_t snd_queuelen_max;
+
 #if TCP_OVERSIZE
     /* Extra bytes available at the end of the last pbuf in unsent. */
     u16_t unsent_oversize;
@@ -495,6 +502,8 @@ void tcp_backlog_accepted(struct tcp_pcb *pcb);
     } while (0) /* compatibility define, not needed any more */
 
 void tcp_recved(struct tcp_pcb *pcb, u16_t len);
+tcpwnd_size_t tcp_set_rcv_wnd_max(struct tcp_pcb *pcb, tcpwnd_size_t wnd);
+tcpwnd_size_t tcp_set_snd_buf_max(struct tcp_pcb *pcb, tcpwnd_size_t size);
 err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port);
 void tcp_bind_netif(struct tcp_pcb *pcb, const struct netif *netif);
 err_t tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
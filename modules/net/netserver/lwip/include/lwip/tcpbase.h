@@ -71,6 +71,9 @@ enum tcp_state {
 /* Flags for "apiflags" parameter in tcp_write */
 #define TCP_WRITE_FLAG_COPY 0x01
 #define TCP_WRITE_FLAG_MORE 0x02
+/* naos: data is not copied, each pbuf pins it through
+ * LWIP_HOOK_TCP_WRITE_REF_PBUF until lwIP frees the pbuf */
+#define TCP_WRITE_FLAG_REF 0x04
 
 #define TCP_PRIO_MIN 1
 #define TCP_PRIO_NORMAL 64
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <lwip/err.h>
+
+struct netif;
+struct pbuf;
+
+err_t naos_lwip_loop_output(struct netif *netif, struct pbuf *p);
+struct pbuf *naos_lwip_tcp_ref_pbuf(const void *data, u16_t len);
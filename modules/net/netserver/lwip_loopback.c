@@ -0,0 +1,577 @@
+#include "netserver_internal.h"
+#include "lwip_hooks.h"
+#include <lwip/inet_chksum.h>
+#include <lwip/prot/ip.h>
+#include <lwip/prot/ip4.h>
+#include <lwip/prot/ip6.h>
+#include <lwip/prot/tcp.h>
+#include <boot/boot.h>
+
+/*
+ * Loopback delivery without the copying queue in netif_loop_output().
+ *
+ * The receive path rewrites headers in place (tcp_input() byte-swaps the TCP
+ * header) and moves payload pointers, while the sender may still own the
+ * pbuf: TCP keeps unacked segments for retransmission, and multicast loop
+ * sends the same chain out of the NIC right after. So the receiver gets its
+ * own small copy of the IP and transport headers, and the payload is chained
+ * behind it as custom pbufs that reference the sender's memory and hold a
+ * pbuf reference until the receiver frees them.
+ */
+
+#define NAOS_LO_MTU 65536
+#define NAOS_LO_MAX_HDR_LEN 128
+
+typedef struct naos_lwip_loop_ref {
+    struct pbuf_custom pc;
+    struct pbuf *orig;
+} naos_lwip_loop_ref_t;
+
+typedef struct naos_lwip_loop_stats {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t zero_copy;
+    uint64_t copied;
+} naos_lwip_loop_stats_t;
+
+struct netif *naos_lwip_loop_netif = NULL;
+static netdev_t *naos_lo_netdev = NULL;
+static naos_lwip_loop_stats_t naos_lo_stats;
+
+static void naos_lwip_loop_ref_free(struct pbuf *p) {
+    naos_lwip_loop_ref_t *ref = (naos_lwip_loop_ref_t *)p;
+
+    pbuf_free(ref->orig);
+    free(ref);
+}
+
+/* Length of the IP header plus the transport header that follows it, or 0 if
+ * the headers are not contiguous in the first pbuf. */
+static size_t naos_lwip_loop_header_len(const struct pbuf *p) {
+    const uint8_t *data = (const uint8_t *)p->payload;
+    size_t ip_len = 0;
+    uint8_t proto = 0;
+    size_t l4_len = 0;
+
+    if (p->len < 1)
+        return 0;
+
+    switch (data[0] >> 4) {
+    case 4:
+        if (p->len < IP_HLEN)
+            return 0;
+        ip_len = (size_t)(data[0] & 0x0F) * 4;
+        proto = data[9];
+        /* Fragments carry no transport header past the first one. */
+        if ((((uint16_t)data[6] << 8) | data[7]) & 0x1FFF)
+            return ip_len <= p->len ? ip_len : 0;
+        break;
+    case 6:
+        if (p->len < IP6_HLEN)
+            return 0;
+        ip_len = IP6_HLEN;
+        proto = data[6];
+        break;
+    default:
+        return 0;
+    }
+
+    if (ip_len > p->len)
+        return 0;
+
+    switch (proto) {
+    case IP_PROTO_TCP:
+        if (p->len < ip_len + TCP_HLEN)
+            return 0;
+        l4_len = (size_t)(data[ip_len + 12] >> 4) * 4;
+        break;
+    case IP_PROTO_UDP:
+    case IP_PROTO_UDPLITE:
+    case IP_PROTO_ICMP:
+    case IP6_NEXTH_ICMP6:
+        l4_len = 8;
+        break;
+    default:
+        l4_len = 0;
+        break;
+    }
+
+    if (ip_len + l4_len > p->len || ip_len + l4_len > NAOS_LO_MAX_HDR_LEN)
+        return 0;
+    return ip_len + l4_len;
+}
+
+static struct pbuf *naos_lwip_loop_clone_by_ref(struct pbuf *p) {
+    size_t hdr_len = naos_lwip_loop_header_len(p);
+    struct pbuf *head = NULL;
+    struct pbuf *q = NULL;
+    size_t offset = hdr_len;
+
+    if (!hdr_len)
+        return NULL;
+
+    for (q = p; q; q = q->next) {
+        if (PBUF_NEEDS_COPY(q))
+            return NULL;
+    }
+
+    head = pbuf_alloc(PBUF_RAW, (u16_t)hdr_len, PBUF_RAM);
+    if (!head)
+        return NULL;
+    memcpy(head->payload, p->payload, hdr_len);
+
+    for (q = p; q; q = q->next) {
+        naos_lwip_loop_ref_t *ref = NULL;
+        struct pbuf *piece = NULL;
+        u16_t len;
+
+        if (offset >= q->len) {
+            offset -= q->len;
+            continue;
+        }
+
+        len = (u16_t)(q->len - offset);
+        ref = malloc(sizeof(*ref));
+        if (!ref) {
+            pbuf_free(head);
+            return NULL;
+        }
+        ref->pc.custom_free_function = naos_lwip_loop_ref_free;
+        ref->orig = q;
+        piece = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &ref->pc,
+                                    (uint8_t *)q->payload + offset, len);
+        if (!piece) {
+            free(ref);
+            pbuf_free(head);
+            return NULL;
+        }
+        pbuf_ref(q);
+        pbuf_cat(head, piece);
+        offset = 0;
+    }
+
+    return head;
+}
+
+static bool naos_lwip_loop_needs_csum(struct netif *netif) {
+    return !NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) ||
+           !NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_UDP);
+}
+
+/*
+ * A NIC netif with checksum offload loops packets for its own address back
+ * without ever reaching the driver, so the TCP/UDP checksum the hardware
+ * would have filled in is computed here. r must own its headers.
+ */
+static void naos_lwip_loop_fill_csum(struct pbuf *r) {
+    const uint8_t *data = (const uint8_t *)r->payload;
+    ip_addr_t src, dst;
+    size_t ip_len, field;
+    uint8_t proto;
+    uint16_t csum;
+
+    if (r->len < 1)
+        return;
+
+    if ((data[0] >> 4) == 4) {
+        if (r->len < IP_HLEN ||
+            ((((uint16_t)data[6] << 8) | data[7]) & 0x3FFF))
+            return;
+        ip_len = (size_t)(data[0] & 0x0F) * 4;
+        proto = data[9];
+        ip_addr_copy_from_ip4(src, ((const struct ip_hdr *)data)->src);
+        ip_addr_copy_from_ip4(dst, ((const struct ip_hdr *)data)->dest);
+    } else if ((data[0] >> 4) == 6) {
+        if (r->len < IP6_HLEN)
+            return;
+        ip_len = IP6_HLEN;
+        proto = data[6];
+        ip_addr_copy_from_ip6_packed(src, ((const struct ip6_hdr *)data)->src);
+        ip_addr_copy_from_ip6_packed(dst,
+                                     ((const struct ip6_hdr *)data)->dest);
+    } else {
+        return;
+    }
+
+    if (proto == IP_PROTO_TCP)
+        field = ip_len + 16;
+    else if (proto == IP_PROTO_UDP)
+        field = ip_len + 6;
+    else
+        return;
+    if (field + 2 > r->len || data[field] || data[field + 1])
+        return;
+
+    if (pbuf_remove_header(r, ip_len))
+        return;
+    csum = ip_chksum_pseudo(r, proto, r->tot_len, &src, &dst);
+    pbuf_add_header(r, ip_len);
+    if (proto == IP_PROTO_UDP && csum == 0)
+        csum = 0xFFFF;
+    memcpy((uint8_t *)r->payload + field, &csum, sizeof(csum));
+}
+
+err_t naos_lwip_loop_output(struct netif *netif, struct pbuf *p) {
+    struct pbuf *r = NULL;
+    bool fill_csum = false;
+    bool by_ref = true;
+
+    if (!netif || !p)
+        return ERR_INPROGRESS;
+
+    fill_csum = naos_lwip_loop_needs_csum(netif);
+    r = naos_lwip_loop_clone_by_ref(p);
+    if (!r && fill_csum) {
+        r = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+        by_ref = false;
+    }
+    if (r) {
+        if (fill_csum)
+            naos_lwip_loop_fill_csum(r);
+        r->if_idx = netif_get_index(netif);
+        if (tcpip_inpkt(r, netif, ip_input) != ERR_OK) {
+            pbuf_free(r);
+            r = NULL;
+        }
+    }
+    if (!r) {
+        __atomic_add_fetch(&naos_lo_stats.copied, 1, __ATOMIC_RELAXED);
+        /* The copying queue would deliver the zero checksum as is. */
+        return fill_csum ? ERR_MEM : ERR_INPROGRESS;
+    }
+
+    naos_lwip_tx_probe_hit();
+    __atomic_add_fetch(&naos_lo_stats.packets, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&naos_lo_stats.bytes, p->tot_len, __ATOMIC_RELAXED);
+    __atomic_add_fetch(by_ref ? &naos_lo_stats.zero_copy
+                              : &naos_lo_stats.copied,
+                       1, __ATOMIC_RELAXED);
+    return ERR_OK;
+}
+
+/* Frames written to the lo netdev directly (packet sockets) carry a zeroed
+ * Ethernet header in front of the IP packet, as on Linux. */
+static int naos_lo_netdev_send(void *desc, void *data, uint32_t len) {
+    struct netif *netif = naos_lwip_loop_netif;
+    struct pbuf *p = NULL;
+    uint16_t ethertype;
+
+    if (!netif || len <= SIZEOF_ETH_HDR || len > NAOS_LO_MTU + SIZEOF_ETH_HDR)
+        return -EINVAL;
+
+    ethertype = ((uint16_t)((uint8_t *)data)[12] << 8) |
+                ((uint8_t *)data)[13];
+    if (ethertype != ETHTYPE_IP && ethertype != ETHTYPE_IPV6)
+        return (int)len;
+
+    p = pbuf_alloc(PBUF_RAW, (u16_t)(len - SIZEOF_ETH_HDR), PBUF_RAM);
+    if (!p)
+        return -ENOMEM;
+    memcpy(p->payload, (uint8_t *)data + SIZEOF_ETH_HDR,
+           len - SIZEOF_ETH_HDR);
+    if (netif->input(p, netif) != ERR_OK) {
+        pbuf_free(p);
+        return -ENOBUFS;
+    }
+    return (int)len;
+}
+
+static int naos_lo_netdev_recv(void *desc, void *data, uint32_t len) {
+    return 0;
+}
+
+static void naos_lo_apply_admin_state(void *arg) {
+    if (!naos_lwip_loop_netif)
+        return;
+
+    if (arg)
+        netif_set_up(naos_lwip_loop_netif);
+    else
+        netif_set_down(naos_lwip_loop_netif);
+}
+
+static void naos_lo_netdev_event(netdev_t *dev, uint32_t events, void *ctx) {
+    if (dev != naos_lo_netdev)
+        return;
+
+    if (events & NETDEV_EVENT_ADMIN_UP)
+        tcpip_callback(naos_lo_apply_admin_state, (void *)1);
+    else if (events & NETDEV_EVENT_ADMIN_DOWN)
+        tcpip_callback(naos_lo_apply_admin_state, NULL);
+}
+
+/* Runs on the tcpip thread right after lwIP has created its loop netif. */
+void naos_lwip_loopback_attach(void) {
+    struct netif *netif = netif_find("lo0");
+
+    if (!netif)
+        return;
+
+    netif->mtu = NAOS_LO_MTU - 1;
+    naos_lwip_loop_netif = netif;
+}
+
+#define NAOS_LO_BENCH_PORT 5201
+#define NAOS_LO_BENCH_BYTES (16U * 1024U * 1024U)
+#define NAOS_LO_BENCH_CHUNK 16384U
+#define NAOS_LO_BENCH_PINGS 1000U
+/* The first bulk round runs with the window lwIP had before window scaling,
+ * the second with the default buffers, the third queues page references the
+ * way sendfile() does; the last round is the echo. */
+#define NAOS_LO_BENCH_SMALL_WND (16 * TCP_MSS)
+#define NAOS_LO_BENCH_ECHO_ROUND 3
+#define NAOS_LO_BENCH_WAIT_NS 100000ULL
+
+static void naos_lo_bench_set_bufsizes(struct netconn *conn,
+                                       tcpwnd_size_t size) {
+    LOCK_TCPIP_CORE();
+    if (conn->pcb.tcp) {
+        tcp_set_rcv_wnd_max(conn->pcb.tcp, size);
+        tcp_set_snd_buf_max(conn->pcb.tcp, size);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+static void naos_lo_bench_nodelay(struct netconn *conn) {
+    LOCK_TCPIP_CORE();
+    if (conn->pcb.tcp)
+        tcp_nagle_disable(conn->pcb.tcp);
+    UNLOCK_TCPIP_CORE();
+}
+
+static void naos_lo_bench_server(uint64_t arg) {
+    struct netconn *listener = (struct netconn *)arg;
+
+    for (int round = 0; round <= NAOS_LO_BENCH_ECHO_ROUND; round++) {
+        struct netconn *conn = NULL;
+        struct pbuf *p = NULL;
+
+        if (netconn_accept(listener, &conn) != ERR_OK)
+            break;
+        if (round == 0)
+            naos_lo_bench_set_bufsizes(conn, NAOS_LO_BENCH_SMALL_WND);
+        if (round == NAOS_LO_BENCH_ECHO_ROUND)
+            naos_lo_bench_nodelay(conn);
+
+        while (netconn_recv_tcp_pbuf(conn, &p) == ERR_OK) {
+            if (round == NAOS_LO_BENCH_ECHO_ROUND) {
+                for (struct pbuf *q = p; q; q = q->next)
+                    netconn_write(conn, q->payload, q->len, NETCONN_COPY);
+            }
+            pbuf_free(p);
+            p = NULL;
+        }
+
+        netconn_close(conn);
+        netconn_delete(conn);
+    }
+
+    netconn_delete(listener);
+}
+
+/* Single-stream bulk transfer; returns MB/s, 0 on failure. */
+static uint64_t naos_lo_bench_bulk(const ip_addr_t *lo, const uint8_t *buf,
+                                   tcpwnd_size_t bufsize) {
+    struct netconn *conn = netconn_new(NETCONN_TCP);
+    uint64_t start, elapsed;
+
+    if (!conn)
+        return 0;
+    if (bufsize)
+        naos_lo_bench_set_bufsizes(conn, bufsize);
+    if (netconn_connect(conn, lo, NAOS_LO_BENCH_PORT) != ERR_OK) {
+        netconn_delete(conn);
+        return 0;
+    }
+
+    start = nano_time();
+    for (uint32_t sent = 0; sent < NAOS_LO_BENCH_BYTES;
+         sent += NAOS_LO_BENCH_CHUNK) {
+        if (netconn_write(conn, buf, NAOS_LO_BENCH_CHUNK, NETCONN_COPY) !=
+            ERR_OK)
+            break;
+    }
+    elapsed = nano_time() - start;
+    netconn_close(conn);
+    netconn_delete(conn);
+
+    return elapsed ? (uint64_t)NAOS_LO_BENCH_BYTES * 1000ULL / elapsed : 0;
+}
+
+/*
+ * Bulk transfer through naos_lwip_tcp_write_ref(), every segment pointing
+ * into one frame. Returns MB/s, 0 on failure, and how many packets the
+ * loopback passed by reference and copied meanwhile.
+ */
+static uint64_t naos_lo_bench_bulk_ref(const ip_addr_t *lo, uint64_t *by_ref,
+                                       uint64_t *copied) {
+    struct netconn *conn = netconn_new(NETCONN_TCP);
+    uint64_t zero_copy0, copied0;
+    uint64_t start, elapsed = 0;
+    uint64_t page = 0;
+    uint32_t sent = 0;
+    size_t off = 0;
+    uint8_t *data;
+
+    *by_ref = 0;
+    *copied = 0;
+    if (!conn)
+        return 0;
+    if (netconn_connect(conn, lo, NAOS_LO_BENCH_PORT) != ERR_OK)
+        goto out;
+    page = alloc_frames(1);
+    if (!page)
+        goto out;
+    data = (uint8_t *)phys_to_virt(page);
+    memset(data, 0x5A, PAGE_SIZE);
+
+    zero_copy0 = __atomic_load_n(&naos_lo_stats.zero_copy, __ATOMIC_RELAXED);
+    copied0 = __atomic_load_n(&naos_lo_stats.copied, __ATOMIC_RELAXED);
+    start = nano_time();
+    while (sent < NAOS_LO_BENCH_BYTES) {
+        size_t written = 0;
+        err_t err = ERR_OK;
+
+        if (!naos_lwip_tcp_write_ref(conn, data + off, PAGE_SIZE - off,
+                                     sent + PAGE_SIZE < NAOS_LO_BENCH_BYTES,
+                                     &written, &err) ||
+            err != ERR_OK)
+            break;
+        if (!written) {
+            // the send buffer is full until the receiver acks
+            task_block(current_task, TASK_BLOCKING, NAOS_LO_BENCH_WAIT_NS,
+                       "lo_bench");
+            continue;
+        }
+        sent += written;
+        off = (off + written) % PAGE_SIZE;
+    }
+    elapsed = nano_time() - start;
+    *by_ref = __atomic_load_n(&naos_lo_stats.zero_copy, __ATOMIC_RELAXED) -
+              zero_copy0;
+    *copied =
+        __atomic_load_n(&naos_lo_stats.copied, __ATOMIC_RELAXED) - copied0;
+
+out:
+    netconn_close(conn);
+    netconn_delete(conn);
+    // queued segments hold references of their own
+    if (page)
+        free_frames(page, 1);
+    return elapsed ? (uint64_t)sent * 1000ULL / elapsed : 0;
+}
+
+static void naos_lo_bench_thread(uint64_t arg) {
+    struct netconn *listener = netconn_new(NETCONN_TCP);
+    struct netconn *conn = NULL;
+    uint8_t *buf = NULL;
+    ip_addr_t lo;
+    uint64_t start, small_mbps, mbps, ref_mbps, ref_by_ref, ref_copied;
+    uint64_t rtt_ns[2] = {0}, wire_ns[2] = {0}, wire_max_ns[2] = {0};
+
+    IP_ADDR4(&lo, 127, 0, 0, 1);
+    if (!listener ||
+        netconn_bind(listener, &lo, NAOS_LO_BENCH_PORT) != ERR_OK ||
+        netconn_listen(listener) != ERR_OK) {
+        printk("netserver: lo bench: listen failed\n");
+        if (listener)
+            netconn_delete(listener);
+        return;
+    }
+    task_create("lo-bench-srv", naos_lo_bench_server, (uint64_t)listener,
+                KTHREAD_PRIORITY);
+
+    buf = malloc(NAOS_LO_BENCH_CHUNK);
+    if (!buf)
+        return;
+    memset(buf, 0x5A, NAOS_LO_BENCH_CHUNK);
+
+    /* Bulk throughput, small buffers first. */
+    small_mbps = naos_lo_bench_bulk(&lo, buf, NAOS_LO_BENCH_SMALL_WND);
+    mbps = naos_lo_bench_bulk(&lo, buf, 0);
+    ref_mbps = naos_lo_bench_bulk_ref(&lo, &ref_by_ref, &ref_copied);
+
+    /* Request/response latency, sent through the netconn API and then
+     * through the direct-call path, with the send-to-wire time of each. */
+    conn = netconn_new(NETCONN_TCP);
+    if (!conn || netconn_connect(conn, &lo, NAOS_LO_BENCH_PORT) != ERR_OK)
+        goto out;
+    naos_lo_bench_nodelay(conn);
+    for (int direct = 0; direct < 2; direct++) {
+        naos_lwip_tx_latency_t lat;
+
+        naos_lwip_tx_latency_take(&lat);
+        start = nano_time();
+        for (uint32_t i = 0; i < NAOS_LO_BENCH_PINGS; i++) {
+            struct netvector vec = {.ptr = buf, .len = 1};
+            struct pbuf *p = NULL;
+            size_t written = 0;
+            err_t err;
+
+            naos_lwip_tx_probe_arm();
+            if (direct)
+                err = naos_lwip_tcp_write_direct(conn, &vec, 1, NETCONN_COPY,
+                                                 &written);
+            else
+                err = netconn_write(conn, buf, 1, NETCONN_COPY);
+            naos_lwip_tx_probe_disarm();
+            if (err != ERR_OK || netconn_recv_tcp_pbuf(conn, &p) != ERR_OK)
+                break;
+            pbuf_free(p);
+        }
+        rtt_ns[direct] = (nano_time() - start) / NAOS_LO_BENCH_PINGS;
+        naos_lwip_tx_latency_take(&lat);
+        wire_ns[direct] = lat.samples ? lat.total_ns / lat.samples : 0;
+        wire_max_ns[direct] = lat.max_ns;
+    }
+
+    printk("netserver: lo bench: tcp %llu MB/s (%u KiB window: %llu MB/s), "
+           "%llu packets by reference, %llu copied\n",
+           mbps, NAOS_LO_BENCH_SMALL_WND / 1024, small_mbps,
+           __atomic_load_n(&naos_lo_stats.zero_copy, __ATOMIC_RELAXED),
+           __atomic_load_n(&naos_lo_stats.copied, __ATOMIC_RELAXED));
+    printk("netserver: lo bench: page references %llu MB/s, "
+           "%llu packets by reference, %llu copied\n",
+           ref_mbps, ref_by_ref, ref_copied);
+    printk("netserver: lo bench: rtt %llu ns, send-to-wire %llu ns (max %llu) "
+           "via netconn; rtt %llu ns, send-to-wire %llu ns (max %llu) "
+           "direct\n",
+           rtt_ns[0], wire_ns[0], wire_max_ns[0], rtt_ns[1], wire_ns[1],
+           wire_max_ns[1]);
+
+out:
+    if (conn) {
+        netconn_close(conn);
+        netconn_delete(conn);
+    }
+    free(buf);
+}
+
+int naos_lwip_loopback_init(void) {
+    netdev_ipv4_info_t info;
+    uint8_t mac[6] = {0};
+
+    if (!naos_lwip_loop_netif) {
+        printk("netserver: lwIP loop netif missing\n");
+        return -ENODEV;
+    }
+
+    naos_lo_netdev = netdev_register_full(
+        "lo", NETDEV_TYPE_LOOPBACK, NULL, mac, NAOS_LO_MTU, naos_lo_netdev_send,
+        naos_lo_netdev_recv, NULL);
+    if (!naos_lo_netdev)
+        return -ENOMEM;
+
+    memset(&info, 0, sizeof(info));
+    info.present = true;
+    info.address = ip4_addr_get_u32(netif_ip4_addr(naos_lwip_loop_netif));
+    info.netmask = ip4_addr_get_u32(netif_ip4_netmask(naos_lwip_loop_netif));
+    netdev_set_ipv4_info(naos_lo_netdev, &info);
+    netdev_register_listener(naos_lo_netdev, naos_lo_netdev_event, NULL);
+
+    const char *cmdline = boot_get_cmdline();
+    if (cmdline && strstr(cmdline, "netserver.lo_bench"))
+        task_create("lo-bench", naos_lo_bench_thread, 0, KTHREAD_PRIORITY);
+
+    return 0;
+}
@@ -1,8 +1,24 @@
 #include "netserver_internal.h"
 #include <lwip/dns.h>
+#include <netif/ethernet.h>
+#include <task/workqueue.h>
+#include <boot/boot.h>
+
+/*
+ * Every non-loopback netdev gets its own lwIP netif and RX thread. Links are
+ * attached from a work item that scans the netdev table, which runs once at
+ * start-up and again whenever a netdev is registered; a link detaches itself
+ * when its netdev goes away.
+ */
+
+#define NAOS_LWIP_MAX_LINKS MAX_NETDEV_NUM
 
 typedef struct naos_lwip_link {
     netdev_t *netdev;
+    struct netif netif;
+    uint32_t generation;
+    bool in_use;
+    bool netif_added;
     bool netdev_ref_held;
     bool stopping;
     bool use_static_ipv4;
@@ -11,10 +27,15 @@ typedef struct naos_lwip_link {
     ip4_addr_t static_gw;
 } naos_lwip_link_t;
 
-static naos_lwip_link_t naos_link;
-struct netif naos_lwip_netif;
+static naos_lwip_link_t naos_links[NAOS_LWIP_MAX_LINKS];
+static spinlock_t naos_links_lock = SPIN_INIT;
+/* Links handed frames under NETDEV_XMIT_MORE since the last flush. */
+static uint32_t naos_lwip_tx_pending;
+static work_struct_t naos_lwip_hotplug_work;
 
 typedef struct naos_lwip_netdev_event {
+    naos_lwip_link_t *link;
+    uint32_t generation;
     bool admin_up;
     bool link_up;
     bool use_static_ipv4;
@@ -23,25 +44,69 @@ typedef struct naos_lwip_netdev_event {
     ip4_addr_t static_gw;
 } naos_lwip_netdev_event_t;
 
-static void naos_lwip_publish_ipv4_state(netdev_t *netdev) {
+static bool naos_lwip_link_live(const naos_lwip_link_t *link) {
+    return __atomic_load_n(&link->netif_added, __ATOMIC_ACQUIRE);
+}
+
+static void naos_lwip_publish_ipv4_state(naos_lwip_link_t *link) {
     netdev_ipv4_info_t info;
+    struct netif *netif = NULL;
 
-    if (!netdev) {
+    if (!link || !link->netdev) {
         return;
     }
+    netif = &link->netif;
 
     memset(&info, 0, sizeof(info));
 
-    if (netdev_admin_is_up(netdev) && netdev_link_is_up(netdev) &&
-        !ip4_addr_isany_val(*netif_ip4_addr(&naos_lwip_netif))) {
+    if (netdev_admin_is_up(link->netdev) && netdev_link_is_up(link->netdev) &&
+        !ip4_addr_isany_val(*netif_ip4_addr(netif))) {
         info.present = true;
-        info.address = ip4_addr_get_u32(netif_ip4_addr(&naos_lwip_netif));
-        info.netmask = ip4_addr_get_u32(netif_ip4_netmask(&naos_lwip_netif));
-        info.gateway = ip4_addr_get_u32(netif_ip4_gw(&naos_lwip_netif));
-        info.has_default_route = info.gateway != 0;
+        info.address = ip4_addr_get_u32(netif_ip4_addr(netif));
+        info.netmask = ip4_addr_get_u32(netif_ip4_netmask(netif));
+        info.gateway = ip4_addr_get_u32(netif_ip4_gw(netif));
+        info.has_default_route = info.gateway != 0 && netif == netif_default;
+    }
+
+    netdev_set_ipv4_info(link->netdev, &info);
+}
+
+static bool naos_lwip_netif_usable(struct netif *netif) {
+    return netif && netif_is_up(netif) && netif_is_link_up(netif) &&
+           !ip4_addr_isany_val(*netif_ip4_addr(netif));
+}
+
+/* Runs with the tcpip core lock held. lwIP routes by subnet first and only
+ * falls back to netif_default, so the default only has to follow whichever
+ * link can reach a gateway. */
+static void naos_lwip_update_default_netif(void) {
+    struct netif *best = NULL;
+    struct netif *cur = netif_default;
+
+    for (uint32_t i = 0; i < NAOS_LWIP_MAX_LINKS; i++) {
+        naos_lwip_link_t *link = &naos_links[i];
+
+        if (!naos_lwip_link_live(link) ||
+            !naos_lwip_netif_usable(&link->netif)) {
+            continue;
+        }
+        if (!ip4_addr_isany_val(*netif_ip4_gw(&link->netif))) {
+            best = &link->netif;
+            break;
+        }
+        if (!best) {
+            best = &link->netif;
+        }
     }
 
-    netdev_set_ipv4_info(netdev, &info);
+    if (cur && cur != naos_lwip_loop_netif && naos_lwip_netif_usable(cur) &&
+        (!best || !ip4_addr_isany_val(*netif_ip4_gw(cur)) ||
+         ip4_addr_isany_val(*netif_ip4_gw(best)))) {
+        return;
+    }
+    if (best && best != cur) {
+        netif_set_default(best);
+    }
 }
 
 static void naos_lwip_log_dns_servers(void) {
@@ -67,85 +132,140 @@ static void naos_lwip_set_fallback_dns(void) {
 }
 
 static void naos_lwip_status_callback(struct netif *netif) {
-    if (!netif) {
+    naos_lwip_link_t *link = netif ? (naos_lwip_link_t *)netif->state : NULL;
+
+    if (!netif || !link) {
         return;
     }
 
 #if LWIP_IPV4 && LWIP_DHCP
     if (dhcp_supplied_address(netif)) {
-        printk("netserver: ipv4=%s netmask=%s gw=%s\n",
+        printk("netserver: %s ipv4=%s netmask=%s gw=%s\n",
+               link->netdev ? link->netdev->name : "?",
                ip4addr_ntoa(netif_ip4_addr(netif)),
                ip4addr_ntoa(netif_ip4_netmask(netif)),
                ip4addr_ntoa(netif_ip4_gw(netif)));
     }
 #endif
 
-    naos_lwip_publish_ipv4_state(naos_link.netdev);
+    naos_lwip_update_default_netif();
+    naos_lwip_publish_ipv4_state(link);
     naos_lwip_set_fallback_dns();
     naos_lwip_log_dns_servers();
 }
 
 static void naos_lwip_apply_link_state(void *arg) {
     naos_lwip_netdev_event_t *event = (naos_lwip_netdev_event_t *)arg;
+    naos_lwip_link_t *link = NULL;
+    struct netif *netif = NULL;
     ip4_addr_t zero_addr;
 
     if (!event) {
         return;
     }
 
+    link = event->link;
+    if (!link || link->generation != event->generation ||
+        !naos_lwip_link_live(link)) {
+        free(event);
+        return;
+    }
+    netif = &link->netif;
+
     ip4_addr_set_zero(&zero_addr);
 
     if (!event->admin_up) {
 #if LWIP_IPV4 && LWIP_DHCP
         if (!event->use_static_ipv4) {
-            netifapi_dhcp_release_and_stop(&naos_lwip_netif);
-            netifapi_netif_set_addr(&naos_lwip_netif, &zero_addr, &zero_addr,
-                                    &zero_addr);
+            netifapi_dhcp_release_and_stop(netif);
+            netifapi_netif_set_addr(netif, &zero_addr, &zero_addr, &zero_addr);
         }
 #endif
-        netifapi_netif_set_link_down(&naos_lwip_netif);
-        netifapi_netif_set_down(&naos_lwip_netif);
-        naos_lwip_publish_ipv4_state(naos_link.netdev);
+        netifapi_netif_set_link_down(netif);
+        netifapi_netif_set_down(netif);
+        naos_lwip_update_default_netif();
+        naos_lwip_publish_ipv4_state(link);
         free(event);
         return;
     }
 
-    netifapi_netif_set_up(&naos_lwip_netif);
+    netifapi_netif_set_up(netif);
 
     if (!event->link_up) {
 #if LWIP_IPV4 && LWIP_DHCP
         if (!event->use_static_ipv4) {
-            netifapi_dhcp_release_and_stop(&naos_lwip_netif);
-            netifapi_netif_set_addr(&naos_lwip_netif, &zero_addr, &zero_addr,
-                                    &zero_addr);
+            netifapi_dhcp_release_and_stop(netif);
+            netifapi_netif_set_addr(netif, &zero_addr, &zero_addr, &zero_addr);
         }
 #endif
-        netifapi_netif_set_link_down(&naos_lwip_netif);
-        naos_lwip_publish_ipv4_state(naos_link.netdev);
+        netifapi_netif_set_link_down(netif);
+        naos_lwip_update_default_netif();
+        naos_lwip_publish_ipv4_state(link);
         free(event);
         return;
     }
 
-    netifapi_netif_set_link_up(&naos_lwip_netif);
+    netifapi_netif_set_link_up(netif);
 
 #if LWIP_IPV4
     if (event->use_static_ipv4) {
-        netifapi_netif_set_addr(&naos_lwip_netif, &event->static_ipaddr,
+        netifapi_netif_set_addr(netif, &event->static_ipaddr,
                                 &event->static_netmask, &event->static_gw);
     }
 #if LWIP_DHCP
     else {
-        netifapi_dhcp_start(&naos_lwip_netif);
+        netifapi_dhcp_start(netif);
     }
 #endif
 #endif
 
-    naos_lwip_publish_ipv4_state(naos_link.netdev);
+    naos_lwip_update_default_netif();
+    naos_lwip_publish_ipv4_state(link);
     naos_lwip_set_fallback_dns();
     free(event);
 }
 
-static void naos_lwip_queue_link_state_update(const naos_lwip_link_t *link) {
+static u16_t naos_lwip_checksum_flags(netdev_t *dev) {
+    u16_t flags = NETIF_CHECKSUM_ENABLE_ALL;
+
+    if (netdev_get_offloads(dev) & NETDEV_OFFLOAD_TX_CSUM) {
+        flags &= ~(NETIF_CHECKSUM_GEN_TCP | NETIF_CHECKSUM_GEN_UDP);
+    }
+    return flags;
+}
+
+static void naos_lwip_apply_offloads(void *arg) {
+    naos_lwip_netdev_event_t *event = (naos_lwip_netdev_event_t *)arg;
+    naos_lwip_link_t *link = event ? event->link : NULL;
+
+    if (link && link->generation == event->generation &&
+        naos_lwip_link_live(link) && link->netdev) {
+        NETIF_SET_CHECKSUM_CTRL(&link->netif,
+                                naos_lwip_checksum_flags(link->netdev));
+    }
+    free(event);
+}
+
+static void naos_lwip_queue_offload_update(naos_lwip_link_t *link) {
+    naos_lwip_netdev_event_t *event = NULL;
+
+    if (!link || !link->netdev) {
+        return;
+    }
+
+    event = calloc(1, sizeof(*event));
+    if (!event) {
+        return;
+    }
+
+    event->link = link;
+    event->generation = link->generation;
+    if (tcpip_callback(naos_lwip_apply_offloads, event) != ERR_OK) {
+        free(event);
+    }
+}
+
+static void naos_lwip_queue_link_state_update(naos_lwip_link_t *link) {
     naos_lwip_netdev_event_t *event = NULL;
 
     if (!link || !link->netdev) {
@@ -157,6 +277,8 @@ static void naos_lwip_queue_link_state_update(const naos_lwip_link_t *link) {
         return;
     }
 
+    event->link = link;
+    event->generation = link->generation;
     event->admin_up = netdev_admin_is_up(link->netdev);
     event->link_up = netdev_link_is_up(link->netdev);
     event->use_static_ipv4 = link->use_static_ipv4;
@@ -179,6 +301,9 @@ static void naos_lwip_netdev_event(netdev_t *dev, uint32_t events, void *ctx) {
         link->stopping = true;
         netdev_unregister_listener(dev, naos_lwip_netdev_event, link);
     }
+    if ((events & NETDEV_EVENT_CONFIG_CHANGED) && !link->stopping) {
+        naos_lwip_queue_offload_update(link);
+    }
     if (!(events & (NETDEV_EVENT_ADMIN_UP | NETDEV_EVENT_ADMIN_DOWN |
                     NETDEV_EVENT_LINK_UP | NETDEV_EVENT_LINK_DOWN |
                     NETDEV_EVENT_UNREGISTERING))) {
@@ -188,41 +313,186 @@ static void naos_lwip_netdev_event(netdev_t *dev, uint32_t events, void *ctx) {
     naos_lwip_queue_link_state_update(link);
 }
 
+static void naos_lwip_netdev_hotplug_event(netdev_t *dev, uint32_t events,
+                                           void *ctx) {
+    if (events & NETDEV_EVENT_REGISTERED) {
+        schedule_work(&naos_lwip_hotplug_work);
+    }
+}
+
+/*
+ * Sampled syscall-to-wire latency. A sender arms the probe on entry, and the
+ * first frame that same task hands to a driver, which with the core lock held
+ * happens in its own context, is charged the elapsed time. Concurrent senders
+ * simply replace each other's sample.
+ */
+bool naos_lwip_tx_probe_enabled;
+static spinlock_t naos_lwip_tx_probe_lock = SPIN_INIT;
+static task_t *naos_lwip_tx_probe_task;
+static uint64_t naos_lwip_tx_probe_start;
+static naos_lwip_tx_latency_t naos_lwip_tx_latency;
+
+void naos_lwip_tx_probe_arm(void) {
+    uint64_t now = nano_time();
+
+    spin_lock(&naos_lwip_tx_probe_lock);
+    naos_lwip_tx_probe_task = current_task;
+    naos_lwip_tx_probe_start = now;
+    spin_unlock(&naos_lwip_tx_probe_lock);
+}
+
+void naos_lwip_tx_probe_disarm(void) {
+    if (__atomic_load_n(&naos_lwip_tx_probe_task, __ATOMIC_RELAXED) !=
+        current_task) {
+        return;
+    }
+
+    spin_lock(&naos_lwip_tx_probe_lock);
+    if (naos_lwip_tx_probe_task == current_task) {
+        naos_lwip_tx_probe_task = NULL;
+    }
+    spin_unlock(&naos_lwip_tx_probe_lock);
+}
+
+void naos_lwip_tx_probe_hit(void) {
+    uint64_t now;
+
+    if (__atomic_load_n(&naos_lwip_tx_probe_task, __ATOMIC_RELAXED) !=
+        current_task) {
+        return;
+    }
+
+    now = nano_time();
+    spin_lock(&naos_lwip_tx_probe_lock);
+    if (naos_lwip_tx_probe_task == current_task) {
+        uint64_t delta = now - naos_lwip_tx_probe_start;
+
+        naos_lwip_tx_probe_task = NULL;
+        naos_lwip_tx_latency.samples++;
+        naos_lwip_tx_latency.total_ns += delta;
+        naos_lwip_tx_latency.max_ns = MAX(naos_lwip_tx_latency.max_ns, delta);
+    }
+    spin_unlock(&naos_lwip_tx_probe_lock);
+}
+
+void naos_lwip_tx_latency_take(naos_lwip_tx_latency_t *out) {
+    spin_lock(&naos_lwip_tx_probe_lock);
+    *out = naos_lwip_tx_latency;
+    memset(&naos_lwip_tx_latency, 0, sizeof(naos_lwip_tx_latency));
+    spin_unlock(&naos_lwip_tx_probe_lock);
+}
+
+#define NAOS_LWIP_TX_LATENCY_REPORT_MS 10000
+
+/* "netserver.tx_latency": sample every TCP sendmsg() and log the numbers. */
+static void naos_lwip_tx_latency_report(void *arg) {
+    naos_lwip_tx_latency_t lat;
+
+    naos_lwip_tx_latency_take(&lat);
+    if (lat.samples) {
+        printk("netserver: sendmsg-to-wire %llu ns avg, %llu ns max over "
+               "%llu sends\n",
+               lat.total_ns / lat.samples, lat.max_ns, lat.samples);
+    }
+    sys_timeout(NAOS_LWIP_TX_LATENCY_REPORT_MS, naos_lwip_tx_latency_report,
+                NULL);
+}
+
+static void naos_lwip_tx_latency_start(void *arg) {
+    naos_lwip_tx_probe_enabled = true;
+    sys_timeout(NAOS_LWIP_TX_LATENCY_REPORT_MS, naos_lwip_tx_latency_report,
+                NULL);
+}
+
+static void naos_lwip_tx_done(void *ctx) { pbuf_free((struct pbuf *)ctx); }
+
+/*
+ * Frames go to the driver as the pbuf chain itself, pinned with a reference
+ * until the hardware is done with it. lwIP holds off retransmitting a segment
+ * whose pbuf is still referenced, so the data cannot change under DMA.
+ * Volatile (PBUF_REF) data and overly long chains are cloned first.
+ */
 static err_t naos_lwip_linkoutput(struct netif *netif, struct pbuf *p) {
     naos_lwip_link_t *link = netif ? (naos_lwip_link_t *)netif->state : NULL;
-    uint8_t *frame = NULL;
-    size_t copied = 0;
+    netdev_frag_t frags[NETDEV_MAX_FRAGS];
+    netdev_tx_req_t req;
+    struct pbuf *out = p;
     struct pbuf *q = NULL;
+    uint32_t nr_frags = 0;
 
     if (!link || !link->netdev || link->stopping || !p) {
         return ERR_IF;
     }
 
-    if (!p->next && p->len == p->tot_len) {
-        return netdev_send(link->netdev, p->payload, (uint32_t)p->len) < 0
-                   ? ERR_IF
-                   : ERR_OK;
+    for (q = p; q; q = q->next) {
+        if (PBUF_NEEDS_COPY(q) ||
+            (q->len && nr_frags == NETDEV_MAX_FRAGS)) {
+            out = NULL;
+            break;
+        }
+        if (q->len) {
+            frags[nr_frags].data = q->payload;
+            frags[nr_frags].len = q->len;
+            nr_frags++;
+        }
     }
 
-    frame = alloc_frames_bytes(p->tot_len);
-    if (!frame) {
-        return ERR_MEM;
+    if (out) {
+        pbuf_ref(out);
+    } else {
+        out = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+        if (!out) {
+            return ERR_MEM;
+        }
+        frags[0].data = out->payload;
+        frags[0].len = out->len;
+        nr_frags = 1;
     }
 
-    for (q = p; q; q = q->next) {
-        memcpy(frame + copied, q->payload, q->len);
-        copied += q->len;
-    }
+    req.frags = frags;
+    req.nr_frags = nr_frags;
+    req.len = p->tot_len;
+    // The doorbell is rung when the core lock is dropped
+    req.flags = NETDEV_XMIT_MORE;
+    req.done = naos_lwip_tx_done;
+    req.ctx = out;
 
-    if (netdev_send(link->netdev, frame, (uint32_t)p->tot_len) < 0) {
-        free_frames_bytes(frame, p->tot_len);
+    if (netdev_xmit(link->netdev, &req) < 0) {
+        pbuf_free(out);
         return ERR_IF;
     }
 
-    free_frames_bytes(frame, p->tot_len);
+    __atomic_or_fetch(&naos_lwip_tx_pending, 1U << (link - naos_links),
+                      __ATOMIC_RELEASE);
+    naos_lwip_tx_probe_hit();
     return ERR_OK;
 }
 
+void naos_lwip_unlock_tcpip_core(void) {
+    netdev_t *devs[NAOS_LWIP_MAX_LINKS];
+    uint32_t nr_devs = 0;
+    uint32_t pending;
+
+    pending = __atomic_exchange_n(&naos_lwip_tx_pending, 0, __ATOMIC_ACQ_REL);
+    if (pending) {
+        spin_lock(&naos_links_lock);
+        for (uint32_t i = 0; i < NAOS_LWIP_MAX_LINKS; i++) {
+            if ((pending & (1U << i)) && naos_links[i].in_use &&
+                netdev_get(naos_links[i].netdev)) {
+                devs[nr_devs++] = naos_links[i].netdev;
+            }
+        }
+        spin_unlock(&naos_links_lock);
+
+        for (uint32_t i = 0; i < nr_devs; i++) {
+            netdev_xmit_flush(devs[i]);
+            netdev_put(devs[i]);
+        }
+    }
+
+    sys_spin_unlock(&lock_tcpip_core);
+}
+
 static err_t naos_lwip_netif_init(struct netif *netif) {
     naos_lwip_link_t *link = netif ? (naos_lwip_link_t *)netif->state : NULL;
 
@@ -245,6 +515,7 @@ static err_t naos_lwip_netif_init(struct netif *netif) {
     memcpy(netif->hwaddr, link->netdev->mac, 6);
     netif->flags =
         NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET;
+    NETIF_SET_CHECKSUM_CTRL(netif, naos_lwip_checksum_flags(link->netdev));
     if (netdev_admin_is_up(link->netdev)) {
         netif->flags |= NETIF_FLAG_UP;
     }
@@ -257,11 +528,16 @@ static err_t naos_lwip_netif_init(struct netif *netif) {
     netif->ip6_autoconfig_enabled = 1;
 #endif
 
+    /* netif_add() calls this with the core lock held, so the link becomes
+     * visible to tcpip-thread callbacks atomically with the netif. */
+    __atomic_store_n(&link->netif_added, true, __ATOMIC_RELEASE);
     return ERR_OK;
 }
 
 static void naos_lwip_tcpip_init_done(void *arg) {
     sys_sem_t *sem = (sys_sem_t *)arg;
+
+    naos_lwip_loopback_attach();
     sys_sem_signal(sem);
 }
 
@@ -275,16 +551,119 @@ static uint32_t naos_prefixlen_to_mask_u32(uint8_t prefixlen) {
     return __builtin_bswap32(~((1U << (32 - prefixlen)) - 1));
 }
 
+static void naos_lwip_link_release(naos_lwip_link_t *link) {
+    /* Before anything else: the listener's ctx is this link slot. */
+    if (link->netdev) {
+        netdev_unregister_listener(link->netdev, naos_lwip_netdev_event, link);
+    }
+
+    if (__atomic_exchange_n(&link->netif_added, false, __ATOMIC_ACQ_REL)) {
+        LOCK_TCPIP_CORE();
+#if LWIP_IPV4 && LWIP_DHCP
+        dhcp_release_and_stop(&link->netif);
+        dhcp_cleanup(&link->netif);
+#endif
+        netif_remove(&link->netif);
+        naos_lwip_update_default_netif();
+        UNLOCK_TCPIP_CORE();
+    }
+
+    if (link->netdev_ref_held && link->netdev) {
+        netdev_put(link->netdev);
+        link->netdev_ref_held = false;
+    }
+
+    spin_lock(&naos_links_lock);
+    link->netdev = NULL;
+    link->in_use = false;
+    spin_unlock(&naos_links_lock);
+}
+
+/* A received pool buffer seen by lwIP as a PBUF_REF pbuf. The wrapper lives
+ * in the buffer's headroom, so wrapping a frame allocates nothing. */
+typedef struct naos_lwip_rx_pbuf {
+    struct pbuf_custom pc;
+    netdev_pool_t *pool;
+    void *buf;
+} naos_lwip_rx_pbuf_t;
+
+_Static_assert(sizeof(naos_lwip_rx_pbuf_t) <= NETDEV_POOL_HEADROOM,
+               "rx pbuf wrapper must fit in the pool headroom");
+
+static void naos_lwip_rx_pbuf_free(struct pbuf *p) {
+    naos_lwip_rx_pbuf_t *rx_pbuf = (naos_lwip_rx_pbuf_t *)p;
+
+    netdev_pool_put(rx_pbuf->pool, rx_pbuf->buf);
+}
+
+static struct pbuf *naos_lwip_rx_wrap(netdev_rx_buf_t *rx) {
+    struct pbuf *head = NULL;
+
+    for (uint32_t i = 0; i < rx->nr_frags; i++) {
+        netdev_rx_frag_t *frag = &rx->frags[i];
+        naos_lwip_rx_pbuf_t *rx_pbuf = (naos_lwip_rx_pbuf_t *)frag->buf;
+        struct pbuf *p;
+
+        rx_pbuf->pc.custom_free_function = naos_lwip_rx_pbuf_free;
+        rx_pbuf->pool = rx->pool;
+        rx_pbuf->buf = frag->buf;
+        p = pbuf_alloced_custom(PBUF_RAW, (u16_t)frag->len, PBUF_REF,
+                                &rx_pbuf->pc, frag->data, (u16_t)frag->len);
+        if (!p) {
+            // Hand the remaining buffers back; wrapped ones go with the chain
+            for (uint32_t j = i; j < rx->nr_frags; j++) {
+                netdev_pool_put(rx->pool, rx->frags[j].buf);
+            }
+            if (head) {
+                pbuf_free(head);
+            }
+            return NULL;
+        }
+
+        if (head) {
+            pbuf_cat(head, p);
+        } else {
+            head = p;
+        }
+    }
+    return head;
+}
+
+/*
+ * Frames are collected into batches of up to NETDEV_RX_BUDGET and run
+ * through the stack under a single core-lock hold rather than one
+ * tcpip_input() round trip each. ACKs and window updates generated by the
+ * batch are sent as it goes, and their doorbells are rung together when the
+ * lock is dropped.
+ */
+static void naos_lwip_rx_deliver(naos_lwip_link_t *link, struct pbuf **batch,
+                                 uint32_t *nr_batch) {
+    if (*nr_batch == 0) {
+        return;
+    }
+
+    LOCK_TCPIP_CORE();
+    for (uint32_t i = 0; i < *nr_batch; i++) {
+        if (ethernet_input(batch[i], &link->netif) != ERR_OK) {
+            pbuf_free(batch[i]);
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    *nr_batch = 0;
+}
+
 static void naos_lwip_rx_thread(uint64_t arg) {
     naos_lwip_link_t *link = (naos_lwip_link_t *)arg;
     uint32_t max_len = 0;
     struct pbuf *rx_pbuf = NULL;
+    struct pbuf *batch[NETDEV_RX_BUDGET];
+    uint32_t nr_batch = 0;
+    bool zero_copy;
 
     if (!link || !link->netdev) {
         return;
     }
-
-    max_len = netdev_max_frame_len(link->netdev->mtu);
+    zero_copy = netdev_has_zc_rx(link->netdev);
 
     for (;;) {
         uint64_t rx_seq;
@@ -292,11 +671,45 @@ static void naos_lwip_rx_thread(uint64_t arg) {
         if (link->stopping || !link->netdev) {
             break;
         }
+        if (nr_batch == NETDEV_RX_BUDGET) {
+            naos_lwip_rx_deliver(link, batch, &nr_batch);
+            // Busy link: let everything else run before the next round
+            schedule(SCHED_FLAG_YIELD);
+        }
 
         rx_seq = netdev_rx_seq(link->netdev);
+        if (zero_copy) {
+            netdev_rx_buf_t rx;
+            struct pbuf *p;
+            int len = netdev_rx_take(link->netdev, &rx);
+
+            if (len > 0) {
+                p = naos_lwip_rx_wrap(&rx);
+                if (p) {
+                    batch[nr_batch++] = p;
+                }
+                continue;
+            }
+            if (len == -ENODEV || link->stopping) {
+                break;
+            }
+            naos_lwip_rx_deliver(link, batch, &nr_batch);
+            int wait_ret = netdev_wait_rx(link->netdev, rx_seq);
+            if (wait_ret == -ENODEV || link->stopping)
+                break;
+            continue;
+        }
+
         if (!rx_pbuf) {
-            rx_pbuf = pbuf_alloc(PBUF_RAW, (u16_t)max_len, PBUF_POOL);
+            /* Pool pbufs cover ordinary frames; GRO super-frames (and jumbo
+             * MTUs) need one contiguous heap pbuf, trimmed after recv(). */
+            max_len = MIN(netdev_rx_buffer_len(link->netdev), 0xFFFF);
+            rx_pbuf = pbuf_alloc(PBUF_RAW, (u16_t)max_len,
+                                 max_len > PBUF_POOL_BUFSIZE ? PBUF_RAM
+                                                             : PBUF_POOL);
             if (!rx_pbuf) {
+                // Frames already taken may be holding the pool
+                naos_lwip_rx_deliver(link, batch, &nr_batch);
                 int wait_ret = netdev_wait_rx(link->netdev, rx_seq);
                 if (wait_ret == -ENODEV || link->stopping)
                     break;
@@ -309,6 +722,7 @@ static void naos_lwip_rx_thread(uint64_t arg) {
             if (len == -ENODEV || link->stopping) {
                 break;
             }
+            naos_lwip_rx_deliver(link, batch, &nr_batch);
             int wait_ret = netdev_wait_rx(link->netdev, rx_seq);
             if (wait_ret == -ENODEV || link->stopping)
                 break;
@@ -316,88 +730,279 @@ static void naos_lwip_rx_thread(uint64_t arg) {
         }
 
         pbuf_realloc(rx_pbuf, (u16_t)len);
-
-        if (naos_lwip_netif.input(rx_pbuf, &naos_lwip_netif) != ERR_OK) {
-            pbuf_free(rx_pbuf);
-        }
+        batch[nr_batch++] = rx_pbuf;
         rx_pbuf = NULL;
     }
 
+    for (uint32_t i = 0; i < nr_batch; i++) {
+        pbuf_free(batch[i]);
+    }
     if (rx_pbuf) {
         pbuf_free(rx_pbuf);
     }
-    if (link->netdev_ref_held && link->netdev) {
-        netdev_put(link->netdev);
-        link->netdev_ref_held = false;
+    naos_lwip_link_release(link);
+}
+
+static naos_lwip_link_t *naos_lwip_find_link(netdev_t *dev) {
+    for (uint32_t i = 0; i < NAOS_LWIP_MAX_LINKS; i++) {
+        if (naos_links[i].in_use && naos_links[i].netdev == dev) {
+            return &naos_links[i];
+        }
     }
-    link->netdev = NULL;
+    return NULL;
 }
 
-int lwip_module_init() {
-    static bool initialized = false;
-    sys_sem_t init_sem = NULL;
+static int naos_lwip_attach_link(netdev_t *netdev) {
+    naos_lwip_link_t *link = NULL;
     ip4_addr_t ipaddr, netmask, gw;
-    netdev_t *netdev = NULL;
-    int32_t ifindex = 0;
-    uint32_t ipv4_addr = 0;
-    uint8_t prefixlen = 0;
-    uint32_t gateway = 0;
-    bool use_static_ipv4 = false;
+    char name[TASK_NAME_MAX];
 
-    if (initialized) {
-        return 0;
+    if (!netdev || netdev->type == NETDEV_TYPE_LOOPBACK) {
+        return -EINVAL;
     }
 
-    netdev = get_default_netdev();
-    if (!netdev) {
-        printk("netserver: no netdev registered, lwIP stack stays offline\n");
-        return -ENODEV;
+    spin_lock(&naos_links_lock);
+    if (naos_lwip_find_link(netdev)) {
+        spin_unlock(&naos_links_lock);
+        return 0;
     }
-
-    if (sys_sem_new(&init_sem, 0) != ERR_OK) {
-        return -ENOMEM;
+    for (uint32_t i = 0; i < NAOS_LWIP_MAX_LINKS; i++) {
+        if (!naos_links[i].in_use) {
+            link = &naos_links[i];
+            break;
+        }
     }
+    if (!link) {
+        spin_unlock(&naos_links_lock);
+        return -ENOSPC;
+    }
+    uint32_t generation = link->generation + 1;
+    memset(link, 0, sizeof(*link));
+    link->generation = generation;
+    link->in_use = true;
+    link->netdev = netdev;
+    spin_unlock(&naos_links_lock);
 
-    tcpip_init(naos_lwip_tcpip_init_done, &init_sem);
-    sys_arch_sem_wait(&init_sem, 0);
-    sys_sem_free(&init_sem);
-
-    memset(&naos_link, 0, sizeof(naos_link));
-    memset(&naos_lwip_netif, 0, sizeof(naos_lwip_netif));
-    naos_link.netdev = netdev;
     if (!netdev_get(netdev)) {
+        naos_lwip_link_release(link);
         return -ENODEV;
     }
-    naos_link.netdev_ref_held = true;
+    link->netdev_ref_held = true;
 
     ip4_addr_set_zero(&ipaddr);
     ip4_addr_set_zero(&netmask);
     ip4_addr_set_zero(&gw);
 
-    if (netifapi_netif_add(&naos_lwip_netif, &ipaddr, &netmask, &gw, &naos_link,
+    if (netifapi_netif_add(&link->netif, &ipaddr, &netmask, &gw, link,
                            naos_lwip_netif_init, tcpip_input) != ERR_OK) {
-        netdev_put(netdev);
-        naos_link.netdev_ref_held = false;
-        naos_link.netdev = NULL;
+        naos_lwip_link_release(link);
         return -EIO;
     }
 
 #if LWIP_NETIF_STATUS_CALLBACK
-    netif_set_status_callback(&naos_lwip_netif, naos_lwip_status_callback);
+    netif_set_status_callback(&link->netif, naos_lwip_status_callback);
 #endif
 
-    netifapi_netif_set_default(&naos_lwip_netif);
-    if (netdev_register_listener(netdev, naos_lwip_netdev_event, &naos_link) !=
-        0) {
-        netdev_put(netdev);
-        naos_link.netdev_ref_held = false;
-        naos_link.netdev = NULL;
+    if (netdev_register_listener(netdev, naos_lwip_netdev_event, link) != 0) {
+        naos_lwip_link_release(link);
         return -EIO;
     }
-    naos_lwip_queue_link_state_update(&naos_link);
+    naos_lwip_queue_link_state_update(link);
+
+    snprintf(name, sizeof(name), "lwip-rx/%s", netdev->name);
+    task_create(name, naos_lwip_rx_thread, (uint64_t)link, KTHREAD_PRIORITY);
+
+    printk("netserver: attached %s\n", netdev->name);
+    return 0;
+}
+
+static void naos_lwip_hotplug_work_fn(work_struct_t *work) {
+    netdev_t *devs[MAX_NETDEV_NUM] = {0};
+    size_t count = netdev_snapshot(devs, MAX_NETDEV_NUM);
 
-    task_create("lwip-rx", naos_lwip_rx_thread, (uint64_t)&naos_link,
-                KTHREAD_PRIORITY);
+    for (size_t i = 0; i < count; i++) {
+        if (devs[i]->type != NETDEV_TYPE_LOOPBACK) {
+            naos_lwip_attach_link(devs[i]);
+        }
+        netdev_put(devs[i]);
+    }
+}
+
+struct netif *naos_lwip_netif_for_netdev(netdev_t *dev) {
+    struct netif *netif = NULL;
+    naos_lwip_link_t *link = NULL;
+
+    if (dev && dev->type == NETDEV_TYPE_LOOPBACK) {
+        return naos_lwip_loop_netif;
+    }
+
+    spin_lock(&naos_links_lock);
+    link = naos_lwip_find_link(dev);
+    if (link && naos_lwip_link_live(link)) {
+        netif = &link->netif;
+    }
+    spin_unlock(&naos_links_lock);
+
+    return netif;
+}
+
+/*
+ * "netserver.tcp_bench" on the command line starts an iperf-style endpoint
+ * on every interface: port 5001 discards whatever a client sends (receive
+ * throughput, e.g. iperf2 or "nc <guest> 5001 < /dev/zero") and port 5002
+ * streams to the client for a fixed time (transmit throughput).
+ */
+#define NAOS_TCP_BENCH_SINK_PORT 5001
+#define NAOS_TCP_BENCH_SOURCE_PORT 5002
+#define NAOS_TCP_BENCH_CHUNK 65536U
+#define NAOS_TCP_BENCH_SOURCE_NS (10ULL * 1000000000ULL)
+
+/* Also shows what the handshake settled on, since a path with any real RTT
+ * is window-limited without scaling. */
+static void naos_tcp_bench_report(const char *dir, struct netconn *conn,
+                                  uint64_t bytes, uint64_t elapsed) {
+    u8_t snd_scale = 0, rcv_scale = 0;
+    bool sack = false;
+    tcpwnd_size_t peer_wnd = 0;
+
+    LOCK_TCPIP_CORE();
+    if (conn->pcb.tcp && conn->pcb.tcp->state != LISTEN) {
+        struct tcp_pcb *pcb = conn->pcb.tcp;
+
+        if (pcb->flags & TF_WND_SCALE) {
+            snd_scale = pcb->snd_scale;
+            rcv_scale = pcb->rcv_scale;
+        }
+        sack = (pcb->flags & TF_SACK) != 0;
+        peer_wnd = pcb->snd_wnd_max;
+    }
+    UNLOCK_TCPIP_CORE();
+
+    printk("netserver: tcp bench %s: %llu bytes in %llu ms, %llu MB/s "
+           "(wscale %u/%u, sack %s, peer window %u)\n",
+           dir, bytes, elapsed / 1000000ULL,
+           elapsed ? bytes * 1000ULL / elapsed : 0, snd_scale, rcv_scale,
+           sack ? "on" : "off", peer_wnd);
+}
+
+static void naos_tcp_bench_sink(uint64_t arg) {
+    struct netconn *conn = (struct netconn *)arg;
+    struct pbuf *p = NULL;
+    uint64_t bytes = 0;
+    uint64_t start = nano_time();
+
+    while (netconn_recv_tcp_pbuf(conn, &p) == ERR_OK) {
+        bytes += p->tot_len;
+        pbuf_free(p);
+        p = NULL;
+    }
+    naos_tcp_bench_report("rx", conn, bytes, nano_time() - start);
+
+    netconn_close(conn);
+    netconn_delete(conn);
+}
+
+static void naos_tcp_bench_source(uint64_t arg) {
+    struct netconn *conn = (struct netconn *)arg;
+    uint8_t *buf = malloc(NAOS_TCP_BENCH_CHUNK);
+    uint64_t bytes = 0;
+    uint64_t start = nano_time();
+
+    if (buf) {
+        struct netvector vec = {.ptr = buf, .len = NAOS_TCP_BENCH_CHUNK};
+        naos_lwip_tx_latency_t lat;
+        size_t written = 0;
+
+        memset(buf, 0, NAOS_TCP_BENCH_CHUNK);
+        naos_lwip_tx_latency_take(&lat);
+        while (nano_time() - start < NAOS_TCP_BENCH_SOURCE_NS) {
+            err_t err;
+
+            naos_lwip_tx_probe_arm();
+            err = naos_lwip_tcp_write_direct(conn, &vec, 1, NETCONN_COPY,
+                                             &written);
+            naos_lwip_tx_probe_disarm();
+            if (err != ERR_OK) {
+                break;
+            }
+            bytes += written;
+        }
+        naos_tcp_bench_report("tx", conn, bytes, nano_time() - start);
+        naos_lwip_tx_latency_take(&lat);
+        printk("netserver: tcp bench tx: send-to-wire %llu ns avg, %llu ns max "
+               "over %llu sends\n",
+               lat.samples ? lat.total_ns / lat.samples : 0, lat.max_ns,
+               lat.samples);
+        free(buf);
+    }
+
+    netconn_close(conn);
+    netconn_delete(conn);
+}
+
+static void naos_tcp_bench_listen(uint64_t arg) {
+    uint16_t port = (uint16_t)arg;
+    struct netconn *listener = netconn_new(NETCONN_TCP);
+    struct netconn *conn = NULL;
+
+    if (!listener || netconn_bind(listener, IP_ADDR_ANY, port) != ERR_OK ||
+        netconn_listen(listener) != ERR_OK) {
+        printk("netserver: tcp bench: listen on %u failed\n", port);
+        if (listener)
+            netconn_delete(listener);
+        return;
+    }
+
+    while (netconn_accept(listener, &conn) == ERR_OK) {
+        task_create(port == NAOS_TCP_BENCH_SINK_PORT ? "tcp-bench-rx"
+                                                     : "tcp-bench-tx",
+                    port == NAOS_TCP_BENCH_SINK_PORT ? naos_tcp_bench_sink
+                                                     : naos_tcp_bench_source,
+                    (uint64_t)conn, KTHREAD_PRIORITY);
+        conn = NULL;
+    }
+
+    netconn_delete(listener);
+}
+
+int lwip_module_init() {
+    static bool initialized = false;
+    sys_sem_t init_sem = NULL;
+
+    if (initialized) {
+        return 0;
+    }
+
+    if (sys_sem_new(&init_sem, 0) != ERR_OK) {
+        return -ENOMEM;
+    }
+
+    tcpip_init(naos_lwip_tcpip_init_done, &init_sem);
+    sys_arch_sem_wait(&init_sem, 0);
+    sys_sem_free(&init_sem);
+
+    naos_lwip_loopback_init();
+
+    INIT_WORK(&naos_lwip_hotplug_work, naos_lwip_hotplug_work_fn);
+    if (netdev_register_listener(NULL, naos_lwip_netdev_hotplug_event, NULL) !=
+        0) {
+        printk("netserver: netdev hotplug listener unavailable\n");
+    }
+
+    /* Attach whatever is already registered before returning so the first
+     * socket sees the NICs; later arrivals go through the work item. */
+    naos_lwip_hotplug_work_fn(&naos_lwip_hotplug_work);
+
+    const char *cmdline = boot_get_cmdline();
+    if (cmdline && strstr(cmdline, "netserver.tx_latency")) {
+        tcpip_callback(naos_lwip_tx_latency_start, NULL);
+    }
+    if (cmdline && strstr(cmdline, "netserver.tcp_bench")) {
+        task_create("tcp-bench", naos_tcp_bench_listen,
+                    NAOS_TCP_BENCH_SINK_PORT, KTHREAD_PRIORITY);
+        task_create("tcp-bench", naos_tcp_bench_listen,
+                    NAOS_TCP_BENCH_SOURCE_PORT, KTHREAD_PRIORITY);
+    }
 
     initialized = true;
     return 0;
@@ -3,6 +3,7 @@
 #include <lwip/raw.h>
 #include <lwip/udp.h>
 #include <init/callbacks.h>
+#include <mm/page.h>
 
 #define FIONBIO_INTERNAL_DISABLE ((ssize_t) - 1)
 #define FIONBIO_INTERNAL_ENABLE ((ssize_t) - 2)
@@ -93,6 +94,8 @@ static ssize_t lwip_socket_read(fd_t *fd, void *buf, size_t offset,
                                 size_t limit);
 static ssize_t lwip_socket_write(fd_t *fd, const void *buf, size_t offset,
                                  size_t limit);
+static ssize_t lwip_socket_sendpage(fd_t *fd, uint64_t page, size_t offset,
+                                    size_t len, int flags);
 static socket_op_t lwip_socket_ops;
 
 static int lwip_errno_from_err(err_t err) {
@@ -770,6 +773,7 @@ static lwip_socket_state_t *lwip_socket_alloc(struct netconn *conn, int domain,
     // Fresh TCP sockets are not writable until connect() completes.
     sock->sendevent = lwip_socket_is_tcp(sock) ? 0 : 1;
     sock->sndbuf = lwip_socket_is_tcp(sock) ? TCP_SND_BUF : 0;
+    sock->rcvbuf = lwip_socket_is_tcp(sock) ? TCP_WND : 0;
     spin_init(&sock->event_lock);
 
     if (conn) {
@@ -779,6 +783,27 @@ static lwip_socket_state_t *lwip_socket_alloc(struct netconn *conn, int domain,
     return sock;
 }
 
+/*
+ * Resizes the receive window and send buffer of the TCP pcb behind a socket
+ * to its SO_RCVBUF/SO_SNDBUF and stores back the sizes lwIP settled on.
+ * Listening pcbs have neither; connections accepted from them inherit the
+ * listener's sizes in accept().
+ */
+static void lwip_socket_apply_tcp_bufsizes(lwip_socket_state_t *sock) {
+    struct tcp_pcb *pcb;
+
+    LOCK_TCPIP_CORE();
+    pcb = sock->conn ? sock->conn->pcb.tcp : NULL;
+    if (pcb && pcb->state != LISTEN) {
+        // lwIP clamps the sizes, negative ones included, to sane minimums
+        sock->rcvbuf = (int)tcp_set_rcv_wnd_max(
+            pcb, (tcpwnd_size_t)MAX(sock->rcvbuf, 0));
+        sock->sndbuf = (int)tcp_set_snd_buf_max(
+            pcb, (tcpwnd_size_t)MAX(sock->sndbuf, 0));
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
 static void lwip_socket_handle_release(socket_handle_t *handle);
 static lwip_socket_state_t *lwip_socket_state_from_node(vfs_node_t *node);
 static lwip_socket_state_t *lwip_socket_state_from_file(fd_t *file);
@@ -805,6 +830,7 @@ static int lwip_socket_install_fd(lwip_socket_state_t *sock, int open_type,
     handle->sock = sock;
     handle->read_op = lwip_socket_read;
     handle->write_op = lwip_socket_write;
+    handle->sendpage_op = lwip_socket_sendpage;
     handle->ioctl_op = lwip_socket_ioctl;
     handle->poll_op = lwip_socket_poll;
     handle->release = lwip_socket_handle_release;
@@ -1075,20 +1101,28 @@ static int lwip_socket_setsockopt_impl(lwip_socket_state_t *sock, int level,
             if (optlen < sizeof(int)) {
                 return -EINVAL;
             }
-            if (value) {
-                netdev_t *dev = netdev_get_by_index((uint32_t)value);
-                if (!dev) {
-                    return -ENODEV;
+            {
+                struct netif *netif = NULL;
+
+                if (value) {
+                    netdev_t *dev = netdev_get_by_index((uint32_t)value);
+                    if (!dev) {
+                        return -ENODEV;
+                    }
+                    strncpy(sock->bind_to_dev, dev->name, IFNAMSIZ - 1);
+                    sock->bind_to_dev[IFNAMSIZ - 1] = '\0';
+                    netif = naos_lwip_netif_for_netdev(dev);
+                    netdev_put(dev);
+                    if (!netif) {
+                        sock->bind_to_dev[0] = '\0';
+                        return -ENODEV;
+                    }
+                } else {
+                    sock->bind_to_dev[0] = '\0';
                 }
-                strncpy(sock->bind_to_dev, dev->name, IFNAMSIZ - 1);
-                sock->bind_to_dev[IFNAMSIZ - 1] = '\0';
-                netdev_put(dev);
-            } else {
-                sock->bind_to_dev[0] = '\0';
+                sock->bind_to_ifindex = value;
+                return lwip_socket_bind_netif(sock, netif);
             }
-            sock->bind_to_ifindex = value;
-            return lwip_socket_bind_netif(sock,
-                                          value ? &naos_lwip_netif : NULL);
         case SO_BINDTODEVICE:
             if (optlen > IFNAMSIZ) {
                 return -EINVAL;
@@ -1101,6 +1135,7 @@ static int lwip_socket_setsockopt_impl(lwip_socket_state_t *sock, int level,
             {
                 char ifname[IFNAMSIZ];
                 netdev_t *dev = NULL;
+                struct netif *netif = NULL;
 
                 memset(ifname, 0, sizeof(ifname));
                 memcpy(ifname, optval, optlen);
@@ -1110,22 +1145,35 @@ static int lwip_socket_setsockopt_impl(lwip_socket_state_t *sock, int level,
                 if (!dev) {
                     return -ENODEV;
                 }
+                netif = naos_lwip_netif_for_netdev(dev);
+                if (!netif) {
+                    netdev_put(dev);
+                    return -ENODEV;
+                }
                 strncpy(sock->bind_to_dev, dev->name, IFNAMSIZ - 1);
                 sock->bind_to_dev[IFNAMSIZ - 1] = '\0';
                 sock->bind_to_ifindex = (int)(dev->id + 1);
                 netdev_put(dev);
+                return lwip_socket_bind_netif(sock, netif);
             }
-            return lwip_socket_bind_netif(sock, &naos_lwip_netif);
         case SO_SNDBUF:
             if (optlen < sizeof(int)) {
                 return -EINVAL;
             }
             sock->sndbuf = value;
+            if (lwip_socket_is_tcp(sock)) {
+                lwip_socket_apply_tcp_bufsizes(sock);
+            }
             return 0;
         case SO_RCVBUF:
             if (optlen < sizeof(int)) {
                 return -EINVAL;
             }
+            if (lwip_socket_is_tcp(sock)) {
+                sock->rcvbuf = value;
+                lwip_socket_apply_tcp_bufsizes(sock);
+                return 0;
+            }
             netconn_set_recvbufsize(sock->conn, value);
             return 0;
         case SO_RCVTIMEO_OLD:
@@ -1393,7 +1441,9 @@ static int lwip_socket_getsockopt_impl(lwip_socket_state_t *sock, int level,
             value = sock->sndbuf;
             break;
         case SO_RCVBUF:
-            value = netconn_get_recvbufsize(sock->conn);
+            value = lwip_socket_is_tcp(sock)
+                        ? sock->rcvbuf
+                        : netconn_get_recvbufsize(sock->conn);
             break;
         case SO_RCVTIMEO_OLD:
         case SO_RCVTIMEO_NEW:
@@ -1780,6 +1830,205 @@ static ssize_t lwip_socket_recvmsg_common(lwip_socket_state_t *sock, fd_t *fd,
     }
 }
 
+/*
+ * Direct-call TCP send. With the core lock held the caller queues whatever
+ * fits in the send buffer with tcp_write() and pushes it out with
+ * tcp_output() itself, the way lwip_netconn_do_writemore() would. A
+ * connection that is connecting, closing, already in a blocking write or has
+ * an error pending, and any remainder a blocking caller has to wait for, go
+ * through netconn_write_vectors_partly() instead.
+ */
+err_t naos_lwip_tcp_write_direct(struct netconn *conn,
+                                 const struct netvector *vectors, u16_t cnt,
+                                 u8_t apiflags, size_t *bytes_written) {
+    bool dontblock =
+        netconn_is_nonblocking(conn) || (apiflags & NETCONN_DONTBLOCK);
+    u8_t write_flags = apiflags & (NETCONN_COPY | NETCONN_MORE);
+    struct netvector *rest = NULL;
+    struct tcp_pcb *pcb = NULL;
+    size_t written = 0;
+    size_t more = 0;
+    size_t off = 0;
+    u16_t i = 0;
+    err_t err = ERR_OK;
+
+    *bytes_written = 0;
+
+    LOCK_TCPIP_CORE();
+    pcb = conn->pcb.tcp;
+    if (conn->state != NETCONN_NONE || !pcb || conn->pending_err != ERR_OK ||
+        (pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT)) {
+        UNLOCK_TCPIP_CORE();
+        return netconn_write_vectors_partly(conn, (struct netvector *)vectors,
+                                            cnt, apiflags, bytes_written);
+    }
+
+    while (i < cnt) {
+        size_t left = vectors[i].len - off;
+        u16_t len = (u16_t)MIN(left, (size_t)tcp_sndbuf(pcb));
+        u8_t flags = write_flags;
+
+        if (left == 0) {
+            i++;
+            off = 0;
+            continue;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (len < left || i + 1 < cnt) {
+            flags |= TCP_WRITE_FLAG_MORE;
+        }
+
+        err = tcp_write(pcb, (const u8_t *)vectors[i].ptr + off, len, flags);
+        if (err != ERR_OK) {
+            break;
+        }
+        written += len;
+        off += len;
+    }
+
+    if (err == ERR_OK || err == ERR_MEM) {
+        err = ERR_OK;
+        if (i < cnt && dontblock) {
+            API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
+            conn->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
+        } else if (tcp_sndbuf(pcb) <= TCP_SNDLOWAT ||
+                   tcp_sndqueuelen(pcb) >= TCP_SNDQUEUELOWAT) {
+            API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
+        }
+        if (tcp_output(pcb) == ERR_RTE) {
+            err = ERR_RTE;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    if (err != ERR_OK) {
+        return err;
+    }
+    *bytes_written = written;
+    if (i == cnt) {
+        return ERR_OK;
+    }
+    if (dontblock) {
+        return written ? ERR_OK : ERR_WOULDBLOCK;
+    }
+
+    rest = malloc((size_t)(cnt - i) * sizeof(*rest));
+    if (!rest) {
+        return written ? ERR_OK : ERR_MEM;
+    }
+    for (u16_t j = i; j < cnt; j++) {
+        rest[j - i] = vectors[j];
+    }
+    rest[0].ptr = (const u8_t *)rest[0].ptr + off;
+    rest[0].len -= off;
+
+    err = netconn_write_vectors_partly(conn, rest, cnt - i, apiflags, &more);
+    free(rest);
+    *bytes_written += more;
+    return written ? ERR_OK : err;
+}
+
+typedef struct naos_lwip_page_ref {
+    struct pbuf_custom pc;
+    uint64_t page;
+} naos_lwip_page_ref_t;
+
+static void naos_lwip_page_ref_free(struct pbuf *p) {
+    naos_lwip_page_ref_t *ref = (naos_lwip_page_ref_t *)p;
+
+    address_release(ref->page);
+    free(ref);
+}
+
+/*
+ * LWIP_HOOK_TCP_WRITE_REF_PBUF: wraps data (a direct-map address inside one
+ * frame) in a custom pbuf that holds a reference on the frame until TCP frees
+ * the segment, i.e. until the bytes are acked or the pcb is gone. The frame
+ * cannot go away before that, so the pbuf is PBUF_ROM rather than PBUF_REF:
+ * PBUF_NEEDS_COPY() stays false and neither naos_lwip_linkoutput() nor the
+ * loopback clones the payload.
+ */
+struct pbuf *naos_lwip_tcp_ref_pbuf(const void *data, u16_t len) {
+    naos_lwip_page_ref_t *ref = malloc(sizeof(*ref));
+    struct pbuf *p = NULL;
+
+    if (!ref) {
+        return NULL;
+    }
+    ref->page = PADDING_DOWN(virt_to_phys(data), PAGE_SIZE);
+    if (!address_ref(ref->page)) {
+        free(ref);
+        return NULL;
+    }
+    ref->pc.custom_free_function = naos_lwip_page_ref_free;
+    p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_ROM, &ref->pc, (void *)data,
+                            len);
+    if (!p) {
+        address_release(ref->page);
+        free(ref);
+    }
+    return p;
+}
+
+/*
+ * Zero-copy counterpart of naos_lwip_tcp_write_direct() for one page: queues
+ * what fits in the send buffer with TCP_WRITE_FLAG_REF and never blocks.
+ * Returns false, having done nothing, when the connection is not in a state
+ * the direct path handles.
+ */
+bool naos_lwip_tcp_write_ref(struct netconn *conn, const void *data,
+                             size_t len, bool more, size_t *written,
+                             err_t *err_out) {
+    struct tcp_pcb *pcb = NULL;
+    u16_t fit = 0;
+    err_t err = ERR_OK;
+
+    *written = 0;
+    *err_out = ERR_OK;
+
+    LOCK_TCPIP_CORE();
+    pcb = conn->pcb.tcp;
+    if (conn->state != NETCONN_NONE || !pcb || conn->pending_err != ERR_OK ||
+        (pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT)) {
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+
+    fit = (u16_t)MIN(len, (size_t)tcp_sndbuf(pcb));
+    if (fit) {
+        u8_t flags = TCP_WRITE_FLAG_REF;
+
+        if (fit < len || more) {
+            flags |= TCP_WRITE_FLAG_MORE;
+        }
+        err = tcp_write(pcb, data, fit, flags);
+        if (err == ERR_OK) {
+            *written = fit;
+        } else if (err == ERR_MEM) {
+            err = ERR_OK;
+        }
+    }
+
+    if (err == ERR_OK) {
+        if (*written < len) {
+            API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
+            conn->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
+        } else if (tcp_sndbuf(pcb) <= TCP_SNDLOWAT ||
+                   tcp_sndqueuelen(pcb) >= TCP_SNDQUEUELOWAT) {
+            API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
+        }
+        if (tcp_output(pcb) == ERR_RTE) {
+            err = ERR_RTE;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    *err_out = err;
+    return true;
+}
+
 static ssize_t lwip_socket_sendmsg_common(lwip_socket_state_t *sock, fd_t *fd,
                                           const struct msghdr *msg, int flags) {
     err_t err = ERR_OK;
@@ -1793,8 +2042,12 @@ static ssize_t lwip_socket_sendmsg_common(lwip_socket_state_t *sock, fd_t *fd,
         u8_t write_flags = NETCONN_COPY;
         int ret = 0;
 
+        if (naos_lwip_tx_probe_enabled) {
+            naos_lwip_tx_probe_arm();
+        }
         ret = lwip_socket_build_bounce_iov(msg, &bounce_iov, &bounce_buffers);
         if (ret < 0) {
+            naos_lwip_tx_probe_disarm();
             return ret;
         }
 
@@ -1805,9 +2058,10 @@ static ssize_t lwip_socket_sendmsg_common(lwip_socket_state_t *sock, fd_t *fd,
             write_flags |= NETCONN_MORE;
         }
 
-        err = netconn_write_vectors_partly(
+        err = naos_lwip_tcp_write_direct(
             sock->conn, (struct netvector *)bounce_iov, (u16_t)msg->msg_iovlen,
             write_flags, &written);
+        naos_lwip_tx_probe_disarm();
         lwip_socket_free_bounce_iov(bounce_iov, bounce_buffers,
                                     msg->msg_iovlen);
         if (err != ERR_OK) {
@@ -2028,6 +2282,10 @@ static int lwip_socket_accept(uint64_t fd, struct sockaddr_un *addr,
         spin_lock(&sock->event_lock);
         sock->sendevent = 1;
         spin_unlock(&sock->event_lock);
+
+        sock->rcvbuf = listener->rcvbuf;
+        sock->sndbuf = listener->sndbuf;
+        lwip_socket_apply_tcp_bufsizes(sock);
     }
 
     newfd = lwip_socket_install_fd(
@@ -2549,6 +2807,53 @@ static ssize_t lwip_socket_write(fd_t *fd, const void *buf, size_t offset,
     return lwip_socket_sendmsg_common(sock, fd, &msg, flags);
 }
 
+/*
+ * sendfile()/splice() into a TCP socket: the segments reference the page
+ * cache frame and the NIC reads it from there. UDP, and TCP connections the
+ * direct path does not handle, copy through sendmsg.
+ */
+static ssize_t lwip_socket_sendpage(fd_t *fd, uint64_t page, size_t offset,
+                                    size_t len, int flags) {
+    const uint8_t *data = (const uint8_t *)phys_to_virt(page) + offset;
+    struct iovec iov = {.iov_base = (void *)data, .len = len};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    lwip_socket_state_t *sock = lwip_socket_state_from_file(fd);
+
+    if (!sock) {
+        return -EBADF;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    flags = lwip_socket_apply_fd_flags(fd, flags);
+    while (lwip_socket_is_tcp(sock)) {
+        size_t written = 0;
+        err_t err = ERR_OK;
+        int ret;
+
+        if (!naos_lwip_tcp_write_ref(sock->conn, data, len,
+                                     !!(flags & MSG_MORE), &written, &err)) {
+            break;
+        }
+        if (err != ERR_OK) {
+            return lwip_errno_from_err(err);
+        }
+        if (written) {
+            return (ssize_t)written;
+        }
+        if (flags & MSG_DONTWAIT) {
+            return -EAGAIN;
+        }
+        ret = vfs_poll_wait_interruptible(fd, EPOLLOUT | EPOLLERR | EPOLLHUP);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return lwip_socket_sendmsg_common(sock, fd, &msg, flags);
+}
+
 static socket_op_t lwip_socket_ops = {
     .shutdown = lwip_socket_shutdown,
     .getpeername = lwip_socket_getpeername,
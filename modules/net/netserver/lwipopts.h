@@ -5,9 +5,11 @@
 #define LWIP_COMPAT_MUTEX 0
 
 #define MEM_ALIGNMENT 8
-#define MEM_LIBC_MALLOC 0
-#define MEMP_MEM_MALLOC 0
-#define MEM_SIZE (1024 * 1024)
+/* lwIP's heap and every memp pool (PCBs, segments, pbufs, ...) come from the
+ * kernel allocator, so they grow with demand instead of being fixed arrays;
+ * the MEMP_NUM_* values below only feed lwIP's sanity checks. */
+#define MEM_LIBC_MALLOC 1
+#define MEMP_MEM_MALLOC 1
 
 #define LWIP_NETCONN 1
 #define LWIP_SOCKET 0
@@ -50,18 +52,44 @@
 #define LWIP_RANDOMIZE_INITIAL_LOCAL_PORTS 1
 #define LWIP_SINGLE_NETIF 0
 
+/* lwIP's own loop netif carries 127.0.0.0/8 and ::1; packets are handed to
+ * the input path by reference where that is safe (see lwip_loopback.c). */
+#define LWIP_NETIF_LOOPBACK 1
+#define LWIP_HAVE_LOOPIF 1
+#define LWIP_NETIF_LOOPBACK_MULTITHREADING 1
+#define LWIP_HOOK_FILENAME "lwip_hooks.h"
+#define LWIP_HOOK_NETIF_LOOP_OUTPUT(netif, p) naos_lwip_loop_output(netif, p)
+/* TCP_WRITE_FLAG_REF data: page-pinning pbufs, see lwip_socket.c. */
+#define LWIP_HOOK_TCP_WRITE_REF_PBUF(data, len) naos_lwip_tcp_ref_pbuf(data, len)
+
+/* NICs with NETDEV_OFFLOAD_TX_CSUM get TCP/UDP checksums from the driver. */
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
+
+/* Received frames are wrapped in place as custom pbufs, and frames sent
+ * while the core lock is held are batched: dropping the lock rings the
+ * doorbell of every NIC that was given frames (see lwip_netif.c). */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+/* Socket calls and RX threads run the stack directly under the core lock;
+ * the tcpip thread is left with timers and callbacks. */
+#define LWIP_TCPIP_CORE_LOCKING 1
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 1
+void naos_lwip_unlock_tcpip_core(void);
+#define LOCK_TCPIP_CORE() sys_spin_lock(&lock_tcpip_core)
+#define UNLOCK_TCPIP_CORE() naos_lwip_unlock_tcpip_core()
+
 #define TCPIP_THREAD_STACKSIZE 0
 #define TCPIP_THREAD_PRIO 0
 #define TCPIP_MBOX_SIZE 128
 #define DEFAULT_UDP_RECVMBOX_SIZE 128
-#define DEFAULT_TCP_RECVMBOX_SIZE 128
+/* sys_mbox_t counts free slots in a u8_t semaphore. */
+#define DEFAULT_TCP_RECVMBOX_SIZE 255
 #define DEFAULT_ACCEPTMBOX_SIZE 32
 
 #define MEMP_NUM_TCPIP_MSG_API 128
 #define MEMP_NUM_NETCONN 128
-#define MEMP_NUM_TCP_PCB 64
-#define MEMP_NUM_TCP_PCB_LISTEN 16
-#define MEMP_NUM_TCP_SEG 128
+#define MEMP_NUM_TCP_PCB 1024
+#define MEMP_NUM_TCP_PCB_LISTEN 64
+#define MEMP_NUM_TCP_SEG TCP_SND_QUEUELEN
 #define MEMP_NUM_UDP_PCB 64
 #define MEMP_NUM_RAW_PCB 16
 #define MEMP_NUM_NETBUF 128
@@ -69,10 +97,19 @@
 #define PBUF_POOL_SIZE 256
 #define PBUF_POOL_BUFSIZE 1700
 
+/* Defaults for SO_RCVBUF/SO_SNDBUF, which resize them per socket up to
+ * 0xFFFF << TCP_RCV_SCALE (2 MiB) of receive window. */
 #define TCP_MSS 1460
-#define TCP_WND (16 * TCP_MSS)
-#define TCP_SND_BUF (16 * TCP_MSS)
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 5
+#define TCP_WND (256 * 1024)
+#define TCP_SND_BUF (256 * 1024)
 #define TCP_SND_QUEUELEN ((4 * TCP_SND_BUF + TCP_MSS - 1) / TCP_MSS)
+/* tcp_sndbuf() is clamped to 16 bits, so the writable threshold has to be
+ * well below that whatever the buffer size. */
+#define TCP_SNDLOWAT (4 * TCP_MSS)
+#define LWIP_TCP_SACK_OUT 1
+#define LWIP_TCP_MAX_SACK_NUM 4
 
 #define LWIP_STATS 0
 #define LWIP_DEBUG 0
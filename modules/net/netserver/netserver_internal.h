@@ -111,6 +111,7 @@ typedef struct lwip_socket_state {
     ip_addr_t peer_addr;
     uint16_t peer_port;
     int sndbuf;
+    int rcvbuf;
     struct timeval sndtimeo;
     struct timeval rcvtimeo;
     volatile s16_t rcvevent;
@@ -130,9 +131,29 @@ typedef struct lwip_socket_state {
     bool rx_peeked;
 } lwip_socket_state_t;
 
+typedef struct naos_lwip_tx_latency {
+    uint64_t samples;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} naos_lwip_tx_latency_t;
+
 extern int lwip_socket_fsid;
-extern struct netif naos_lwip_netif;
+extern struct netif *naos_lwip_loop_netif;
+extern bool naos_lwip_tx_probe_enabled;
 
 int lwip_module_init(void);
+struct netif *naos_lwip_netif_for_netdev(netdev_t *dev);
+void naos_lwip_loopback_attach(void);
+int naos_lwip_loopback_init(void);
+err_t naos_lwip_tcp_write_direct(struct netconn *conn,
+                                 const struct netvector *vectors, u16_t cnt,
+                                 u8_t apiflags, size_t *bytes_written);
+bool naos_lwip_tcp_write_ref(struct netconn *conn, const void *data,
+                             size_t len, bool more, size_t *written,
+                             err_t *err_out);
+void naos_lwip_tx_probe_arm(void);
+void naos_lwip_tx_probe_disarm(void);
+void naos_lwip_tx_probe_hit(void);
+void naos_lwip_tx_latency_take(naos_lwip_tx_latency_t *out);
 void real_socket_v4_init(void);
 void real_socket_v6_init(void);